@@ -33,6 +33,7 @@
 #include "prelude-string.h"
 #include "common.h"
 #include "idmef-data.h"
+#include "prelude-arena.h"
 
 
 /*
@@ -85,7 +86,7 @@ IDMEF_DATA_DECL(IDMEF_DATA_TYPE_FLOAT, float, float, float)
 
 int idmef_data_new(idmef_data_t **data)
 {
-        *data = calloc(1, sizeof(**data));
+        *data = _prelude_object_calloc(sizeof(**data));
         if ( ! *data )
                 return prelude_error_from_errno(errno);
 
@@ -559,7 +560,7 @@ void idmef_data_destroy(idmef_data_t *data)
         idmef_data_destroy_internal(data);
 
         if ( data->flags & IDMEF_DATA_OWN_STRUCTURE )
-                free(data);
+                _prelude_object_free(data);
 }
 
 
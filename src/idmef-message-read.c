@@ -27,6 +27,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #define PRELUDE_ERROR_SOURCE_DEFAULT PRELUDE_ERROR_SOURCE_IDMEF_MESSAGE_READ
@@ -35,9 +36,13 @@
 #include "prelude-list.h"
 #include "prelude-extract.h"
 #include "prelude-io.h"
+#include "prelude-log.h"
 #include "idmef-message-id.h"
 #include "idmef.h"
 #include "idmef-tree-wrap.h"
+#include "prelude-arena.h"
+#include "idmef-lazy.h"
+#include "glthread/lock.h"
 
 #include "idmef-message-read.h"
 
@@ -188,241 +193,397 @@ static inline int prelude_extract_data_safe(idmef_data_t **out, void *buf, uint3
 
 
 
-/**
- * idmef_additional_data_read:
- * @additional_data: Pointer to a #idmef_additional_data_t object.
- * @msg: Pointer to a #prelude_msg_t object, containing a message.
- *
- * Read an idmef_additional_data from the @msg message, and
- * store it into @additional_data.
- *
- * Returns: 0 on success, a negative value if an error occured.
+static inline prelude_bool_t is_class_tag(uint8_t tag)
+{
+        switch ( tag ) {
+                case IDMEF_MSG_ADDITIONAL_DATA_TAG:
+                case IDMEF_MSG_REFERENCE_TAG:
+                case IDMEF_MSG_CLASSIFICATION_TAG:
+                case IDMEF_MSG_USER_ID_TAG:
+                case IDMEF_MSG_USER_TAG:
+                case IDMEF_MSG_ADDRESS_TAG:
+                case IDMEF_MSG_PROCESS_TAG:
+                case IDMEF_MSG_WEB_SERVICE_TAG:
+                case IDMEF_MSG_SNMP_SERVICE_TAG:
+                case IDMEF_MSG_SERVICE_TAG:
+                case IDMEF_MSG_NODE_TAG:
+                case IDMEF_MSG_SOURCE_TAG:
+                case IDMEF_MSG_FILE_ACCESS_TAG:
+                case IDMEF_MSG_INODE_TAG:
+                case IDMEF_MSG_CHECKSUM_TAG:
+                case IDMEF_MSG_FILE_TAG:
+                case IDMEF_MSG_LINKAGE_TAG:
+                case IDMEF_MSG_TARGET_TAG:
+                case IDMEF_MSG_ANALYZER_TAG:
+                case IDMEF_MSG_ALERTIDENT_TAG:
+                case IDMEF_MSG_IMPACT_TAG:
+                case IDMEF_MSG_ACTION_TAG:
+                case IDMEF_MSG_CONFIDENCE_TAG:
+                case IDMEF_MSG_ASSESSMENT_TAG:
+                case IDMEF_MSG_TOOL_ALERT_TAG:
+                case IDMEF_MSG_CORRELATION_ALERT_TAG:
+                case IDMEF_MSG_OVERFLOW_ALERT_TAG:
+                case IDMEF_MSG_ALERT_TAG:
+                case IDMEF_MSG_HEARTBEAT_TAG:
+                        return TRUE;
+
+                default:
+                        return FALSE;
+        }
+}
+
+
+
+typedef struct {
+        const char *name;
+        int (*read_child)(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf);
+
+        /*
+         * Tag used on the wire for each child of the class, indexed by child id.
+         */
+        size_t child_count;
+        const uint8_t *child_tag;
+} idmef_read_class_t;
+
+
+typedef struct {
+        uint32_t offset;
+        uint8_t tag;
+        prelude_bool_t done;
+} idmef_lazy_entry_t;
+
+
+/*
+ * The index is kept until its object is destroyed, so that the object can
+ * be read from several threads: decoding is serialized through @mutex, and
+ * @done is set once nothing is left to decode, @msg being released then.
  */
-int idmef_additional_data_read(idmef_additional_data_t *additional_data, prelude_msg_t *msg)
+struct idmef_lazy {
+        gl_recursive_lock_t mutex;
+        prelude_bool_t done;
+
+        prelude_msg_t *msg;
+        const idmef_read_class_t *class;
+
+        prelude_bool_t loading;
+        int error;
+        unsigned int count;
+        unsigned int pending;
+        idmef_lazy_entry_t *entry;
+
+        /*
+         * Tags that still have undecoded entries.
+         */
+        uint32_t pending_tags[256 / 32];
+};
+
+
+
+/*
+ * Record the offset of every child of the object being read from @msg,
+ * and skip to the end of the object. Nested objects are skipped as a whole.
+ */
+static int lazy_new(idmef_lazy_t **out, const idmef_read_class_t *class, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
         uint8_t tag;
-        uint32_t len;
+        uint32_t len, offset;
+        unsigned int depth = 0, size = 0;
+        idmef_lazy_t *lazy;
+        idmef_lazy_entry_t *entry;
+
+        lazy = calloc(1, sizeof(*lazy));
+        if ( ! lazy )
+                return prelude_error_from_errno(errno);
 
         while ( 1 ) {
+                offset = _prelude_msg_get_read_index(msg);
+
                 ret = prelude_msg_get(msg, &tag, &len, &buf);
                 if ( ret < 0 )
-                        return ret;
-
-                switch ( tag ) {
-
-                        case IDMEF_MSG_ADDITIONAL_DATA_MEANING: {
-                                prelude_string_t *tmp = NULL;
-
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        goto err;
 
-                                idmef_additional_data_set_meaning(additional_data, tmp);
+                if ( tag == IDMEF_MSG_END_OF_TAG ) {
+                        if ( depth == 0 )
                                 break;
-                        }
-
-                        case IDMEF_MSG_ADDITIONAL_DATA_TYPE: {
-                                int32_t tmp = 0;
-
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_additional_data_set_type(additional_data, tmp);
-                                break;
-                        }
+                        depth--;
+                        continue;
+                }
 
-                        case IDMEF_MSG_ADDITIONAL_DATA_DATA: {
-                                idmef_data_t *tmp = NULL;
+                if ( depth == 0 ) {
+                        if ( lazy->count == size ) {
+                                size = (size) ? size * 2 : 16;
 
-                                ret = prelude_extract_data_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                                entry = realloc(lazy->entry, size * sizeof(*entry));
+                                if ( ! entry ) {
+                                        ret = prelude_error_from_errno(errno);
+                                        goto err;
+                                }
 
-                                idmef_additional_data_set_data(additional_data, tmp);
-                                break;
+                                lazy->entry = entry;
                         }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        entry = &lazy->entry[lazy->count++];
+                        entry->offset = offset;
+                        entry->tag = tag;
+                        entry->done = FALSE;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_additional_data_t: '%u'", tag);
+                        lazy->pending_tags[tag / 32] |= 1U << (tag % 32);
                 }
 
+                if ( is_class_tag(tag) )
+                        depth++;
+        }
+
+        if ( lazy->count == 0 ) {
+                free(lazy);
+                *out = NULL;
+                return 0;
         }
 
+        gl_recursive_lock_init(lazy->mutex);
+
+        lazy->class = class;
+        lazy->pending = lazy->count;
+        lazy->msg = prelude_msg_ref(msg);
+        *out = lazy;
+
         return 0;
+
+ err:
+        free(lazy->entry);
+        free(lazy);
+        return ret;
 }
 
-/**
- * idmef_reference_read:
- * @reference: Pointer to a #idmef_reference_t object.
- * @msg: Pointer to a #prelude_msg_t object, containing a message.
- *
- * Read an idmef_reference from the @msg message, and
- * store it into @reference.
- *
- * Returns: 0 on success, a negative value if an error occured.
- */
-int idmef_reference_read(idmef_reference_t *reference, prelude_msg_t *msg)
+
+
+static int lazy_load_entry(idmef_lazy_t *lazy, void *object, unsigned int i)
 {
         int ret;
         void *buf;
         uint8_t tag;
-        uint32_t len;
+        uint32_t len, end;
 
-        while ( 1 ) {
-                ret = prelude_msg_get(msg, &tag, &len, &buf);
-                if ( ret < 0 )
-                        return ret;
+        _prelude_msg_set_read_index(lazy->msg, lazy->entry[i].offset);
 
-                switch ( tag ) {
+        ret = prelude_msg_get(lazy->msg, &tag, &len, &buf);
+        if ( ret == 0 )
+                ret = lazy->class->read_child(object, lazy->msg, tag, len, buf);
 
-                        case IDMEF_MSG_REFERENCE_ORIGIN: {
-                                int32_t tmp = 0;
+        /*
+         * Some children span more than one entry (idmef_data_t values
+         * for example): all of these were consumed.
+         */
+        end = _prelude_msg_get_read_index(lazy->msg);
+        do {
+                lazy->entry[i].done = TRUE;
+                lazy->pending--;
+        } while ( ++i < lazy->count && ! lazy->entry[i].done && lazy->entry[i].offset < end );
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+        return ret;
+}
 
-                                idmef_reference_set_origin(reference, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_REFERENCE_NAME: {
-                                prelude_string_t *tmp = NULL;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+static inline prelude_bool_t lazy_is_done(idmef_lazy_t *lazy)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        return __atomic_load_n(&lazy->done, __ATOMIC_ACQUIRE);
+#else
+        return FALSE;
+#endif
+}
 
-                                idmef_reference_set_name(reference, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_REFERENCE_URL: {
-                                prelude_string_t *tmp = NULL;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+/*
+ * Release what the index no longer needs once @object is fully decoded,
+ * or could not be.
+ */
+static void lazy_set_done(idmef_lazy_t *lazy)
+{
+        prelude_msg_destroy(lazy->msg);
+        lazy->msg = NULL;
 
-                                idmef_reference_set_url(reference, tmp);
-                                break;
-                        }
+        free(lazy->entry);
+        lazy->entry = NULL;
 
-                        case IDMEF_MSG_REFERENCE_MEANING: {
-                                prelude_string_t *tmp = NULL;
+#ifdef HAVE_ATOMIC_BUILTINS
+        __atomic_store_n(&lazy->done, TRUE, __ATOMIC_RELEASE);
+#else
+        lazy->done = TRUE;
+#endif
+}
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_reference_set_meaning(reference, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+static int lazy_load(idmef_lazy_t *lazy, void *object, int child)
+{
+        int ret = 0;
+        uint8_t tag = 0;
+        unsigned int i;
+        uint32_t index;
+        prelude_arena_t *arena;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_reference_t: '%u'", tag);
-                }
+        /*
+         * Accessors used while decoding call us back.
+         */
+        if ( lazy->loading )
+                return 0;
+
+        if ( lazy->done )
+                return lazy->error;
+
+        if ( child >= 0 ) {
+                if ( (size_t) child >= lazy->class->child_count )
+                        return 0;
 
+                tag = lazy->class->child_tag[child];
+                if ( ! (lazy->pending_tags[tag / 32] & (1U << (tag % 32))) )
+                        return 0;
+
+                lazy->pending_tags[tag / 32] &= ~(1U << (tag % 32));
         }
 
-        return 0;
+        lazy->loading = TRUE;
+        index = _prelude_msg_get_read_index(lazy->msg);
+        arena = _prelude_arena_enter(object);
+
+        for ( i = 0; i < lazy->count && ret == 0; i++ ) {
+                if ( lazy->entry[i].done || (child >= 0 && lazy->entry[i].tag != tag) )
+                        continue;
+
+                ret = lazy_load_entry(lazy, object, i);
+        }
+
+        _prelude_arena_leave(arena);
+        _prelude_msg_set_read_index(lazy->msg, index);
+        lazy->loading = FALSE;
+
+        if ( ret < 0 ) {
+                prelude_log(PRELUDE_LOG_ERR, "error decoding %s: %s.\n", lazy->class->name, prelude_strerror(ret));
+                lazy->error = ret;
+        }
+
+        if ( ret < 0 || lazy->pending == 0 )
+                lazy_set_done(lazy);
+
+        return ret;
 }
 
-/**
- * idmef_classification_read:
- * @classification: Pointer to a #idmef_classification_t object.
- * @msg: Pointer to a #prelude_msg_t object, containing a message.
- *
- * Read an idmef_classification from the @msg message, and
- * store it into @classification.
+
+
+/*
+ * Decode the pending entries of @child (all of them if @child is -1) into
+ * @object, which might be shared with other threads.
  *
- * Returns: 0 on success, a negative value if an error occured.
+ * A decoding error is kept in the index and returned by every later
+ * call, since @object is then only partially decoded.
  */
-int idmef_classification_read(idmef_classification_t *classification, prelude_msg_t *msg)
+int _idmef_lazy_load(idmef_lazy_t *lazy, void *object, int child)
 {
         int ret;
-        void *buf;
-        uint8_t tag;
-        uint32_t len;
 
-        while ( 1 ) {
-                ret = prelude_msg_get(msg, &tag, &len, &buf);
-                if ( ret < 0 )
-                        return ret;
+        if ( lazy_is_done(lazy) )
+                return lazy->error;
 
-                switch ( tag ) {
+        gl_recursive_lock_lock(lazy->mutex);
+        ret = lazy_load(lazy, object, child);
+        gl_recursive_lock_unlock(lazy->mutex);
 
-                        case IDMEF_MSG_CLASSIFICATION_IDENT: {
-                                prelude_string_t *tmp = NULL;
+        return ret;
+}
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_classification_set_ident(classification, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_CLASSIFICATION_TEXT: {
-                                prelude_string_t *tmp = NULL;
+void _idmef_lazy_destroy(idmef_lazy_t *lazy)
+{
+        if ( lazy->msg )
+                prelude_msg_destroy(lazy->msg);
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        free(lazy->entry);
+        gl_recursive_lock_destroy(lazy->mutex);
+        free(lazy);
+}
 
-                                idmef_classification_set_text(classification, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_REFERENCE_TAG: {
-                                int ret;
-                                idmef_reference_t *tmp = NULL;
 
-                                ret = idmef_classification_new_reference(classification, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+static int idmef_additional_data_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_additional_data_t *additional_data = object;
 
+        switch ( tag ) {
 
+                case IDMEF_MSG_ADDITIONAL_DATA_MEANING: {
+                        prelude_string_t *tmp = NULL;
 
-                                ret = idmef_reference_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                break;
-                        }
+                        idmef_additional_data_set_meaning(additional_data, tmp);
+                        break;
+                }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                case IDMEF_MSG_ADDITIONAL_DATA_TYPE: {
+                        int32_t tmp = 0;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_classification_t: '%u'", tag);
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_additional_data_set_type(additional_data, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ADDITIONAL_DATA_DATA: {
+                        idmef_data_t *tmp = NULL;
+
+                        ret = prelude_extract_data_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_additional_data_set_data(additional_data, tmp);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_additional_data_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_additional_data_child_tags[] = {
+        IDMEF_MSG_ADDITIONAL_DATA_MEANING,
+        IDMEF_MSG_ADDITIONAL_DATA_TYPE,
+        IDMEF_MSG_ADDITIONAL_DATA_DATA,
+};
+
+
+static const idmef_read_class_t idmef_additional_data_read_class = {
+        "idmef_additional_data_t",
+        idmef_additional_data_read_child,
+        sizeof(idmef_additional_data_child_tags),
+        idmef_additional_data_child_tags
+};
+
 /**
- * idmef_user_id_read:
- * @user_id: Pointer to a #idmef_user_id_t object.
+ * idmef_additional_data_read:
+ * @additional_data: Pointer to a #idmef_additional_data_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_user_id from the @msg message, and
- * store it into @user_id.
+ * Read an idmef_additional_data from the @msg message, and
+ * store it into @additional_data.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_user_id_read(idmef_user_id_t *user_id, prelude_msg_t *msg)
+int idmef_additional_data_read(idmef_additional_data_t *additional_data, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -434,86 +595,102 @@ int idmef_user_id_read(idmef_user_id_t *user_id, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
-
-                        case IDMEF_MSG_USER_ID_IDENT: {
-                                prelude_string_t *tmp = NULL;
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = idmef_additional_data_read_child(additional_data, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                idmef_user_id_set_ident(user_id, tmp);
-                                break;
-                        }
+        return 0;
+}
 
-                        case IDMEF_MSG_USER_ID_TYPE: {
-                                int32_t tmp = 0;
+static int idmef_reference_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_reference_t *reference = object;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
-                                idmef_user_id_set_type(user_id, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_REFERENCE_ORIGIN: {
+                        int32_t tmp = 0;
 
-                        case IDMEF_MSG_USER_ID_TTY: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_reference_set_origin(reference, tmp);
+                        break;
+                }
 
-                                idmef_user_id_set_tty(user_id, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_REFERENCE_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_USER_ID_NAME: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_reference_set_name(reference, tmp);
+                        break;
+                }
 
-                                idmef_user_id_set_name(user_id, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_REFERENCE_URL: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_USER_ID_NUMBER: {
-                                uint32_t tmp = 0;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_reference_set_url(reference, tmp);
+                        break;
+                }
 
-                                idmef_user_id_set_number(user_id, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_REFERENCE_MEANING: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_user_id_t: '%u'", tag);
+                        idmef_reference_set_meaning(reference, tmp);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_reference_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_reference_child_tags[] = {
+        IDMEF_MSG_REFERENCE_ORIGIN,
+        IDMEF_MSG_REFERENCE_NAME,
+        IDMEF_MSG_REFERENCE_URL,
+        IDMEF_MSG_REFERENCE_MEANING,
+};
+
+
+static const idmef_read_class_t idmef_reference_read_class = {
+        "idmef_reference_t",
+        idmef_reference_read_child,
+        sizeof(idmef_reference_child_tags),
+        idmef_reference_child_tags
+};
+
 /**
- * idmef_user_read:
- * @user: Pointer to a #idmef_user_t object.
+ * idmef_reference_read:
+ * @reference: Pointer to a #idmef_reference_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_user from the @msg message, and
- * store it into @user.
+ * Read an idmef_reference from the @msg message, and
+ * store it into @reference.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_user_read(idmef_user_t *user, prelude_msg_t *msg)
+int idmef_reference_read(idmef_reference_t *reference, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -525,70 +702,95 @@ int idmef_user_read(idmef_user_t *user, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_USER_IDENT: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_reference_read_child(reference, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_user_set_ident(user, tmp);
-                                break;
-                        }
+static int idmef_classification_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_classification_t *classification = object;
 
-                        case IDMEF_MSG_USER_CATEGORY: {
-                                int32_t tmp = 0;
+        switch ( tag ) {
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_CLASSIFICATION_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_user_set_category(user, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_USER_ID_TAG: {
-                                int ret;
-                                idmef_user_id_t *tmp = NULL;
+                        idmef_classification_set_ident(classification, tmp);
+                        break;
+                }
 
-                                ret = idmef_user_new_user_id(user, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_CLASSIFICATION_TEXT: {
+                        prelude_string_t *tmp = NULL;
 
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
+                        idmef_classification_set_text(classification, tmp);
+                        break;
+                }
 
-                                ret = idmef_user_id_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_REFERENCE_TAG: {
+                        idmef_reference_t *tmp = NULL;
 
-                                break;
-                        }
+                        ret = idmef_classification_new_reference(classification, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_user_t: '%u'", tag);
+
+                        ret = idmef_reference_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_classification_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_classification_child_tags[] = {
+        IDMEF_MSG_CLASSIFICATION_IDENT,
+        IDMEF_MSG_CLASSIFICATION_TEXT,
+        IDMEF_MSG_REFERENCE_TAG,
+};
+
+
+static const idmef_read_class_t idmef_classification_read_class = {
+        "idmef_classification_t",
+        idmef_classification_read_child,
+        sizeof(idmef_classification_child_tags),
+        idmef_classification_child_tags
+};
+
 /**
- * idmef_address_read:
- * @address: Pointer to a #idmef_address_t object.
+ * idmef_classification_read:
+ * @classification: Pointer to a #idmef_classification_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_address from the @msg message, and
- * store it into @address.
+ * Read an idmef_classification from the @msg message, and
+ * store it into @classification.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_address_read(idmef_address_t *address, prelude_msg_t *msg)
+int idmef_classification_read(idmef_classification_t *classification, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -600,97 +802,114 @@ int idmef_address_read(idmef_address_t *address, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
-
-                        case IDMEF_MSG_ADDRESS_IDENT: {
-                                prelude_string_t *tmp = NULL;
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = idmef_classification_read_child(classification, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                idmef_address_set_ident(address, tmp);
-                                break;
-                        }
+        return 0;
+}
 
-                        case IDMEF_MSG_ADDRESS_CATEGORY: {
-                                int32_t tmp = 0;
+static int idmef_user_id_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_user_id_t *user_id = object;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
-                                idmef_address_set_category(address, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_USER_ID_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_ADDRESS_VLAN_NAME: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_user_id_set_ident(user_id, tmp);
+                        break;
+                }
 
-                                idmef_address_set_vlan_name(address, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_USER_ID_TYPE: {
+                        int32_t tmp = 0;
 
-                        case IDMEF_MSG_ADDRESS_VLAN_NUM: {
-                                int32_t tmp = 0;
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_user_id_set_type(user_id, tmp);
+                        break;
+                }
 
-                                idmef_address_set_vlan_num(address, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_USER_ID_TTY: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_ADDRESS_ADDRESS: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_user_id_set_tty(user_id, tmp);
+                        break;
+                }
 
-                                idmef_address_set_address(address, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_USER_ID_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_ADDRESS_NETMASK: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_user_id_set_name(user_id, tmp);
+                        break;
+                }
 
-                                idmef_address_set_netmask(address, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_USER_ID_NUMBER: {
+                        uint32_t tmp = 0;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_address_t: '%u'", tag);
+                        idmef_user_id_set_number(user_id, tmp);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_user_id_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_user_id_child_tags[] = {
+        IDMEF_MSG_USER_ID_IDENT,
+        IDMEF_MSG_USER_ID_TYPE,
+        IDMEF_MSG_USER_ID_TTY,
+        IDMEF_MSG_USER_ID_NAME,
+        IDMEF_MSG_USER_ID_NUMBER,
+};
+
+
+static const idmef_read_class_t idmef_user_id_read_class = {
+        "idmef_user_id_t",
+        idmef_user_id_read_child,
+        sizeof(idmef_user_id_child_tags),
+        idmef_user_id_child_tags
+};
+
 /**
- * idmef_process_read:
- * @process: Pointer to a #idmef_process_t object.
+ * idmef_user_id_read:
+ * @user_id: Pointer to a #idmef_user_id_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_process from the @msg message, and
- * store it into @process.
+ * Read an idmef_user_id from the @msg message, and
+ * store it into @user_id.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_process_read(idmef_process_t *process, prelude_msg_t *msg)
+int idmef_user_id_read(idmef_user_id_t *user_id, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -702,97 +921,95 @@ int idmef_process_read(idmef_process_t *process, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
-
-                        case IDMEF_MSG_PROCESS_IDENT: {
-                                prelude_string_t *tmp = NULL;
-
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_process_set_ident(process, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_PROCESS_NAME: {
-                                prelude_string_t *tmp = NULL;
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = idmef_user_id_read_child(user_id, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                idmef_process_set_name(process, tmp);
-                                break;
-                        }
+        return 0;
+}
 
-                        case IDMEF_MSG_PROCESS_PID: {
-                                uint32_t tmp = 0;
+static int idmef_user_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_user_t *user = object;
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
-                                idmef_process_set_pid(process, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_USER_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_PROCESS_PATH: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_user_set_ident(user, tmp);
+                        break;
+                }
 
-                                idmef_process_set_path(process, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_USER_CATEGORY: {
+                        int32_t tmp = 0;
 
-                        case IDMEF_MSG_PROCESS_ARG: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_user_set_category(user, tmp);
+                        break;
+                }
 
-                                idmef_process_set_arg(process, tmp, -1);
-                                break;
-                        }
+                case IDMEF_MSG_USER_ID_TAG: {
+                        idmef_user_id_t *tmp = NULL;
 
-                        case IDMEF_MSG_PROCESS_ENV: {
-                                prelude_string_t *tmp = NULL;
+                        ret = idmef_user_new_user_id(user, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_process_set_env(process, tmp, -1);
-                                break;
-                        }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = idmef_user_id_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_process_t: '%u'", tag);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_user_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_user_child_tags[] = {
+        IDMEF_MSG_USER_IDENT,
+        IDMEF_MSG_USER_CATEGORY,
+        IDMEF_MSG_USER_ID_TAG,
+};
+
+
+static const idmef_read_class_t idmef_user_read_class = {
+        "idmef_user_t",
+        idmef_user_read_child,
+        sizeof(idmef_user_child_tags),
+        idmef_user_child_tags
+};
+
 /**
- * idmef_web_service_read:
- * @web_service: Pointer to a #idmef_web_service_t object.
+ * idmef_user_read:
+ * @user: Pointer to a #idmef_user_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_web_service from the @msg message, and
- * store it into @web_service.
+ * Read an idmef_user from the @msg message, and
+ * store it into @user.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_web_service_read(idmef_web_service_t *web_service, prelude_msg_t *msg)
+int idmef_user_read(idmef_user_t *user, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -804,75 +1021,126 @@ int idmef_web_service_read(idmef_web_service_t *web_service, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_WEB_SERVICE_URL: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_user_read_child(user, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_web_service_set_url(web_service, tmp);
-                                break;
-                        }
+static int idmef_address_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_address_t *address = object;
 
-                        case IDMEF_MSG_WEB_SERVICE_CGI: {
-                                prelude_string_t *tmp = NULL;
+        switch ( tag ) {
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_ADDRESS_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_web_service_set_cgi(web_service, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_WEB_SERVICE_HTTP_METHOD: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_address_set_ident(address, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_ADDRESS_CATEGORY: {
+                        int32_t tmp = 0;
 
-                                idmef_web_service_set_http_method(web_service, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_WEB_SERVICE_ARG: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_address_set_category(address, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_ADDRESS_VLAN_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_web_service_set_arg(web_service, tmp, -1);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        idmef_address_set_vlan_name(address, tmp);
+                        break;
+                }
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_web_service_t: '%u'", tag);
+                case IDMEF_MSG_ADDRESS_VLAN_NUM: {
+                        int32_t tmp = 0;
+
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_address_set_vlan_num(address, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ADDRESS_ADDRESS: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_address_set_address(address, tmp);
+                        break;
                 }
 
+                case IDMEF_MSG_ADDRESS_NETMASK: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_address_set_netmask(address, tmp);
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_address_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_address_child_tags[] = {
+        IDMEF_MSG_ADDRESS_IDENT,
+        IDMEF_MSG_ADDRESS_CATEGORY,
+        IDMEF_MSG_ADDRESS_VLAN_NAME,
+        IDMEF_MSG_ADDRESS_VLAN_NUM,
+        IDMEF_MSG_ADDRESS_ADDRESS,
+        IDMEF_MSG_ADDRESS_NETMASK,
+};
+
+
+static const idmef_read_class_t idmef_address_read_class = {
+        "idmef_address_t",
+        idmef_address_read_child,
+        sizeof(idmef_address_child_tags),
+        idmef_address_child_tags
+};
+
 /**
- * idmef_snmp_service_read:
- * @snmp_service: Pointer to a #idmef_snmp_service_t object.
+ * idmef_address_read:
+ * @address: Pointer to a #idmef_address_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_snmp_service from the @msg message, and
- * store it into @snmp_service.
+ * Read an idmef_address from the @msg message, and
+ * store it into @address.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_snmp_service_read(idmef_snmp_service_t *snmp_service, prelude_msg_t *msg)
+int idmef_address_read(idmef_address_t *address, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -884,119 +1152,126 @@ int idmef_snmp_service_read(idmef_snmp_service_t *snmp_service, prelude_msg_t *m
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_SNMP_SERVICE_OID: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_address_read_child(address, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_snmp_service_set_oid(snmp_service, tmp);
-                                break;
-                        }
+static int idmef_process_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_process_t *process = object;
 
-                        case IDMEF_MSG_SNMP_SERVICE_MESSAGE_PROCESSING_MODEL: {
-                                uint32_t tmp = 0;
+        switch ( tag ) {
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_PROCESS_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_snmp_service_set_message_processing_model(snmp_service, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_SNMP_SERVICE_SECURITY_MODEL: {
-                                uint32_t tmp = 0;
+                        idmef_process_set_ident(process, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_PROCESS_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_snmp_service_set_security_model(snmp_service, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_SNMP_SERVICE_SECURITY_NAME: {
-                                prelude_string_t *tmp = NULL;
-
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_snmp_service_set_security_name(snmp_service, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_SNMP_SERVICE_SECURITY_LEVEL: {
-                                uint32_t tmp = 0;
-
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_process_set_name(process, tmp);
+                        break;
+                }
 
-                                idmef_snmp_service_set_security_level(snmp_service, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_PROCESS_PID: {
+                        uint32_t tmp = 0;
 
-                        case IDMEF_MSG_SNMP_SERVICE_CONTEXT_NAME: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_process_set_pid(process, tmp);
+                        break;
+                }
 
-                                idmef_snmp_service_set_context_name(snmp_service, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_PROCESS_PATH: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_SNMP_SERVICE_CONTEXT_ENGINE_ID: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_process_set_path(process, tmp);
+                        break;
+                }
 
-                                idmef_snmp_service_set_context_engine_id(snmp_service, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_PROCESS_ARG: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_SNMP_SERVICE_COMMAND: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_process_set_arg(process, tmp, -1);
+                        break;
+                }
 
-                                idmef_snmp_service_set_command(snmp_service, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_PROCESS_ENV: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_snmp_service_t: '%u'", tag);
+                        idmef_process_set_env(process, tmp, -1);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_process_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_process_child_tags[] = {
+        IDMEF_MSG_PROCESS_IDENT,
+        IDMEF_MSG_PROCESS_NAME,
+        IDMEF_MSG_PROCESS_PID,
+        IDMEF_MSG_PROCESS_PATH,
+        IDMEF_MSG_PROCESS_ARG,
+        IDMEF_MSG_PROCESS_ENV,
+};
+
+
+static const idmef_read_class_t idmef_process_read_class = {
+        "idmef_process_t",
+        idmef_process_read_child,
+        sizeof(idmef_process_child_tags),
+        idmef_process_child_tags
+};
+
 /**
- * idmef_service_read:
- * @service: Pointer to a #idmef_service_t object.
+ * idmef_process_read:
+ * @process: Pointer to a #idmef_process_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_service from the @msg message, and
- * store it into @service.
+ * Read an idmef_process from the @msg message, and
+ * store it into @process.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_service_read(idmef_service_t *service, prelude_msg_t *msg)
+int idmef_process_read(idmef_process_t *process, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -1008,153 +1283,102 @@ int idmef_service_read(idmef_service_t *service, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
-
-                        case IDMEF_MSG_SERVICE_IDENT: {
-                                prelude_string_t *tmp = NULL;
-
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_service_set_ident(service, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_SERVICE_IP_VERSION: {
-                                uint8_t tmp = 0;
-
-                                ret = prelude_extract_uint8_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_service_set_ip_version(service, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_SERVICE_IANA_PROTOCOL_NUMBER: {
-                                uint8_t tmp = 0;
-
-                                ret = prelude_extract_uint8_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_service_set_iana_protocol_number(service, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_SERVICE_IANA_PROTOCOL_NAME: {
-                                prelude_string_t *tmp = NULL;
-
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_service_set_iana_protocol_name(service, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_SERVICE_NAME: {
-                                prelude_string_t *tmp = NULL;
-
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_service_set_name(service, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_SERVICE_PORT: {
-                                uint16_t tmp = 0;
-
-                                ret = prelude_extract_uint16_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_service_set_port(service, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_SERVICE_PORTLIST: {
-                                prelude_string_t *tmp = NULL;
-
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_service_set_portlist(service, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_SERVICE_PROTOCOL: {
-                                prelude_string_t *tmp = NULL;
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = idmef_process_read_child(process, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                idmef_service_set_protocol(service, tmp);
-                                break;
-                        }
+        return 0;
+}
 
-                        case IDMEF_MSG_WEB_SERVICE_TAG: {
-                                int ret;
-                                idmef_web_service_t *tmp = NULL;
+static int idmef_web_service_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_web_service_t *web_service = object;
 
-                                ret = idmef_service_new_web_service(service, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
+                case IDMEF_MSG_WEB_SERVICE_URL: {
+                        prelude_string_t *tmp = NULL;
 
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_web_service_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_web_service_set_url(web_service, tmp);
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_WEB_SERVICE_CGI: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_SNMP_SERVICE_TAG: {
-                                int ret;
-                                idmef_snmp_service_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_service_new_snmp_service(service, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_web_service_set_cgi(web_service, tmp);
+                        break;
+                }
 
+                case IDMEF_MSG_WEB_SERVICE_HTTP_METHOD: {
+                        prelude_string_t *tmp = NULL;
 
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_snmp_service_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_web_service_set_http_method(web_service, tmp);
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_WEB_SERVICE_ARG: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_service_t: '%u'", tag);
+                        idmef_web_service_set_arg(web_service, tmp, -1);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_web_service_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_web_service_child_tags[] = {
+        IDMEF_MSG_WEB_SERVICE_URL,
+        IDMEF_MSG_WEB_SERVICE_CGI,
+        IDMEF_MSG_WEB_SERVICE_HTTP_METHOD,
+        IDMEF_MSG_WEB_SERVICE_ARG,
+};
+
+
+static const idmef_read_class_t idmef_web_service_read_class = {
+        "idmef_web_service_t",
+        idmef_web_service_read_child,
+        sizeof(idmef_web_service_child_tags),
+        idmef_web_service_child_tags
+};
+
 /**
- * idmef_node_read:
- * @node: Pointer to a #idmef_node_t object.
+ * idmef_web_service_read:
+ * @web_service: Pointer to a #idmef_web_service_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_node from the @msg message, and
- * store it into @node.
+ * Read an idmef_web_service from the @msg message, and
+ * store it into @web_service.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_node_read(idmef_node_t *node, prelude_msg_t *msg)
+int idmef_web_service_read(idmef_web_service_t *web_service, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -1166,92 +1390,150 @@ int idmef_node_read(idmef_node_t *node, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_NODE_IDENT: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_web_service_read_child(web_service, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_node_set_ident(node, tmp);
-                                break;
-                        }
+static int idmef_snmp_service_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_snmp_service_t *snmp_service = object;
 
-                        case IDMEF_MSG_NODE_CATEGORY: {
-                                int32_t tmp = 0;
+        switch ( tag ) {
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SNMP_SERVICE_OID: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_node_set_category(node, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_NODE_NAME: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_snmp_service_set_oid(snmp_service, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SNMP_SERVICE_MESSAGE_PROCESSING_MODEL: {
+                        uint32_t tmp = 0;
 
-                                idmef_node_set_name(node, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_NODE_LOCATION: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_snmp_service_set_message_processing_model(snmp_service, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SNMP_SERVICE_SECURITY_MODEL: {
+                        uint32_t tmp = 0;
 
-                                idmef_node_set_location(node, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_ADDRESS_TAG: {
-                                int ret;
-                                idmef_address_t *tmp = NULL;
+                        idmef_snmp_service_set_security_model(snmp_service, tmp);
+                        break;
+                }
 
-                                ret = idmef_node_new_address(node, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SNMP_SERVICE_SECURITY_NAME: {
+                        prelude_string_t *tmp = NULL;
 
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
+                        idmef_snmp_service_set_security_name(snmp_service, tmp);
+                        break;
+                }
 
-                                ret = idmef_address_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SNMP_SERVICE_SECURITY_LEVEL: {
+                        uint32_t tmp = 0;
 
-                                break;
-                        }
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        idmef_snmp_service_set_security_level(snmp_service, tmp);
+                        break;
+                }
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_node_t: '%u'", tag);
+                case IDMEF_MSG_SNMP_SERVICE_CONTEXT_NAME: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_snmp_service_set_context_name(snmp_service, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_SNMP_SERVICE_CONTEXT_ENGINE_ID: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_snmp_service_set_context_engine_id(snmp_service, tmp);
+                        break;
                 }
 
+                case IDMEF_MSG_SNMP_SERVICE_COMMAND: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_snmp_service_set_command(snmp_service, tmp);
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_snmp_service_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_snmp_service_child_tags[] = {
+        IDMEF_MSG_SNMP_SERVICE_OID,
+        IDMEF_MSG_SNMP_SERVICE_MESSAGE_PROCESSING_MODEL,
+        IDMEF_MSG_SNMP_SERVICE_SECURITY_MODEL,
+        IDMEF_MSG_SNMP_SERVICE_SECURITY_NAME,
+        IDMEF_MSG_SNMP_SERVICE_SECURITY_LEVEL,
+        IDMEF_MSG_SNMP_SERVICE_CONTEXT_NAME,
+        IDMEF_MSG_SNMP_SERVICE_CONTEXT_ENGINE_ID,
+        IDMEF_MSG_SNMP_SERVICE_COMMAND,
+};
+
+
+static const idmef_read_class_t idmef_snmp_service_read_class = {
+        "idmef_snmp_service_t",
+        idmef_snmp_service_read_child,
+        sizeof(idmef_snmp_service_child_tags),
+        idmef_snmp_service_child_tags
+};
+
 /**
- * idmef_source_read:
- * @source: Pointer to a #idmef_source_t object.
+ * idmef_snmp_service_read:
+ * @snmp_service: Pointer to a #idmef_snmp_service_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_source from the @msg message, and
- * store it into @source.
+ * Read an idmef_snmp_service from the @msg message, and
+ * store it into @snmp_service.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_source_read(idmef_source_t *source, prelude_msg_t *msg)
+int idmef_snmp_service_read(idmef_snmp_service_t *snmp_service, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -1263,132 +1545,185 @@ int idmef_source_read(idmef_source_t *source, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_SOURCE_IDENT: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_snmp_service_read_child(snmp_service, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_source_set_ident(source, tmp);
-                                break;
-                        }
+static int idmef_service_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_service_t *service = object;
 
-                        case IDMEF_MSG_SOURCE_SPOOFED: {
-                                int32_t tmp = 0;
+        switch ( tag ) {
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SERVICE_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_source_set_spoofed(source, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_SOURCE_INTERFACE: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_service_set_ident(service, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SERVICE_IP_VERSION: {
+                        uint8_t tmp = 0;
 
-                                idmef_source_set_interface(source, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_uint8_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_NODE_TAG: {
-                                int ret;
-                                idmef_node_t *tmp = NULL;
+                        idmef_service_set_ip_version(service, tmp);
+                        break;
+                }
 
-                                ret = idmef_source_new_node(source, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SERVICE_IANA_PROTOCOL_NUMBER: {
+                        uint8_t tmp = 0;
 
+                        ret = prelude_extract_uint8_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
+                        idmef_service_set_iana_protocol_number(service, tmp);
+                        break;
+                }
 
-                                ret = idmef_node_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SERVICE_IANA_PROTOCOL_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_USER_TAG: {
-                                int ret;
-                                idmef_user_t *tmp = NULL;
+                        idmef_service_set_iana_protocol_name(service, tmp);
+                        break;
+                }
 
-                                ret = idmef_source_new_user(source, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SERVICE_NAME: {
+                        prelude_string_t *tmp = NULL;
 
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
+                        idmef_service_set_name(service, tmp);
+                        break;
+                }
 
-                                ret = idmef_user_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SERVICE_PORT: {
+                        uint16_t tmp = 0;
 
-                                break;
-                        }
+                        ret = prelude_extract_uint16_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_PROCESS_TAG: {
-                                int ret;
-                                idmef_process_t *tmp = NULL;
+                        idmef_service_set_port(service, tmp);
+                        break;
+                }
 
-                                ret = idmef_source_new_process(source, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SERVICE_PORTLIST: {
+                        prelude_string_t *tmp = NULL;
 
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
+                        idmef_service_set_portlist(service, tmp);
+                        break;
+                }
 
-                                ret = idmef_process_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SERVICE_PROTOCOL: {
+                        prelude_string_t *tmp = NULL;
 
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_SERVICE_TAG: {
-                                int ret;
-                                idmef_service_t *tmp = NULL;
+                        idmef_service_set_protocol(service, tmp);
+                        break;
+                }
 
-                                ret = idmef_source_new_service(source, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_WEB_SERVICE_TAG: {
+                        idmef_web_service_t *tmp = NULL;
 
+                        ret = idmef_service_new_web_service(service, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
 
-                                ret = idmef_service_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                break;
-                        }
+                        ret = idmef_web_service_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        break;
+                }
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_source_t: '%u'", tag);
+                case IDMEF_MSG_SNMP_SERVICE_TAG: {
+                        idmef_snmp_service_t *tmp = NULL;
+
+                        ret = idmef_service_new_snmp_service(service, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_snmp_service_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_service_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_service_child_tags[] = {
+        IDMEF_MSG_SERVICE_IDENT,
+        IDMEF_MSG_SERVICE_IP_VERSION,
+        IDMEF_MSG_SERVICE_IANA_PROTOCOL_NUMBER,
+        IDMEF_MSG_SERVICE_IANA_PROTOCOL_NAME,
+        IDMEF_MSG_SERVICE_NAME,
+        IDMEF_MSG_SERVICE_PORT,
+        IDMEF_MSG_SERVICE_PORTLIST,
+        IDMEF_MSG_SERVICE_PROTOCOL,
+        IDMEF_MSG_WEB_SERVICE_TAG,
+        IDMEF_MSG_SNMP_SERVICE_TAG,
+        IDMEF_MSG_END_OF_TAG,
+};
+
+
+static const idmef_read_class_t idmef_service_read_class = {
+        "idmef_service_t",
+        idmef_service_read_child,
+        sizeof(idmef_service_child_tags),
+        idmef_service_child_tags
+};
+
 /**
- * idmef_file_access_read:
- * @file_access: Pointer to a #idmef_file_access_t object.
+ * idmef_service_read:
+ * @service: Pointer to a #idmef_service_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_file_access from the @msg message, and
- * store it into @file_access.
+ * Read an idmef_service from the @msg message, and
+ * store it into @service.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_file_access_read(idmef_file_access_t *file_access, prelude_msg_t *msg)
+int idmef_service_read(idmef_service_t *service, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -1400,59 +1735,119 @@ int idmef_file_access_read(idmef_file_access_t *file_access, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_USER_ID_TAG: {
-                                int ret;
-                                idmef_user_id_t *tmp = NULL;
+                ret = idmef_service_read_child(service, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = idmef_file_access_new_user_id(file_access, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
+static int idmef_node_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_node_t *node = object;
 
+        switch ( tag ) {
 
-                                ret = idmef_user_id_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_NODE_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_FILE_ACCESS_PERMISSION: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_node_set_ident(node, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_NODE_CATEGORY: {
+                        int32_t tmp = 0;
 
-                                idmef_file_access_set_permission(file_access, tmp, -1);
-                                break;
-                        }
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        idmef_node_set_category(node, tmp);
+                        break;
+                }
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_file_access_t: '%u'", tag);
+                case IDMEF_MSG_NODE_NAME: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_node_set_name(node, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_NODE_LOCATION: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_node_set_location(node, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ADDRESS_TAG: {
+                        idmef_address_t *tmp = NULL;
+
+                        ret = idmef_node_new_address(node, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_address_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_node_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_node_child_tags[] = {
+        IDMEF_MSG_NODE_IDENT,
+        IDMEF_MSG_NODE_CATEGORY,
+        IDMEF_MSG_NODE_NAME,
+        IDMEF_MSG_NODE_LOCATION,
+        IDMEF_MSG_ADDRESS_TAG,
+};
+
+
+static const idmef_read_class_t idmef_node_read_class = {
+        "idmef_node_t",
+        idmef_node_read_child,
+        sizeof(idmef_node_child_tags),
+        idmef_node_child_tags
+};
+
 /**
- * idmef_inode_read:
- * @inode: Pointer to a #idmef_inode_t object.
+ * idmef_node_read:
+ * @node: Pointer to a #idmef_node_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_inode from the @msg message, and
- * store it into @inode.
+ * Read an idmef_node from the @msg message, and
+ * store it into @node.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_inode_read(idmef_inode_t *inode, prelude_msg_t *msg)
+int idmef_node_read(idmef_node_t *node, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -1464,97 +1859,158 @@ int idmef_inode_read(idmef_inode_t *inode, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_INODE_CHANGE_TIME: {
-                                idmef_time_t *tmp = NULL;
+                ret = idmef_node_read_child(node, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_inode_set_change_time(inode, tmp);
-                                break;
-                        }
+static int idmef_source_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_source_t *source = object;
 
-                        case IDMEF_MSG_INODE_NUMBER: {
-                                uint32_t tmp = 0;
+        switch ( tag ) {
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SOURCE_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_inode_set_number(inode, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_INODE_MAJOR_DEVICE: {
-                                uint32_t tmp = 0;
+                        idmef_source_set_ident(source, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SOURCE_SPOOFED: {
+                        int32_t tmp = 0;
 
-                                idmef_inode_set_major_device(inode, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_INODE_MINOR_DEVICE: {
-                                uint32_t tmp = 0;
+                        idmef_source_set_spoofed(source, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_SOURCE_INTERFACE: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_inode_set_minor_device(inode, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_INODE_C_MAJOR_DEVICE: {
-                                uint32_t tmp = 0;
+                        idmef_source_set_interface(source, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_NODE_TAG: {
+                        idmef_node_t *tmp = NULL;
 
-                                idmef_inode_set_c_major_device(inode, tmp);
-                                break;
-                        }
+                        ret = idmef_source_new_node(source, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_INODE_C_MINOR_DEVICE: {
-                                uint32_t tmp = 0;
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_inode_set_c_minor_device(inode, tmp);
-                                break;
-                        }
+                        ret = idmef_node_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        break;
+                }
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_inode_t: '%u'", tag);
+                case IDMEF_MSG_USER_TAG: {
+                        idmef_user_t *tmp = NULL;
+
+                        ret = idmef_source_new_user(source, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_user_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_PROCESS_TAG: {
+                        idmef_process_t *tmp = NULL;
+
+                        ret = idmef_source_new_process(source, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_process_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_SERVICE_TAG: {
+                        idmef_service_t *tmp = NULL;
+
+                        ret = idmef_source_new_service(source, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_service_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_source_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_source_child_tags[] = {
+        IDMEF_MSG_SOURCE_IDENT,
+        IDMEF_MSG_SOURCE_SPOOFED,
+        IDMEF_MSG_SOURCE_INTERFACE,
+        IDMEF_MSG_NODE_TAG,
+        IDMEF_MSG_USER_TAG,
+        IDMEF_MSG_PROCESS_TAG,
+        IDMEF_MSG_SERVICE_TAG,
+};
+
+
+static const idmef_read_class_t idmef_source_read_class = {
+        "idmef_source_t",
+        idmef_source_read_child,
+        sizeof(idmef_source_child_tags),
+        idmef_source_child_tags
+};
+
 /**
- * idmef_checksum_read:
- * @checksum: Pointer to a #idmef_checksum_t object.
+ * idmef_source_read:
+ * @source: Pointer to a #idmef_source_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_checksum from the @msg message, and
- * store it into @checksum.
+ * Read an idmef_source from the @msg message, and
+ * store it into @source.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_checksum_read(idmef_checksum_t *checksum, prelude_msg_t *msg)
+int idmef_source_read(idmef_source_t *source, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -1566,64 +2022,83 @@ int idmef_checksum_read(idmef_checksum_t *checksum, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_CHECKSUM_VALUE: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_source_read_child(source, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_checksum_set_value(checksum, tmp);
-                                break;
-                        }
+static int idmef_file_access_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_file_access_t *file_access = object;
 
-                        case IDMEF_MSG_CHECKSUM_KEY: {
-                                prelude_string_t *tmp = NULL;
+        switch ( tag ) {
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_USER_ID_TAG: {
+                        idmef_user_id_t *tmp = NULL;
 
-                                idmef_checksum_set_key(checksum, tmp);
-                                break;
-                        }
+                        ret = idmef_file_access_new_user_id(file_access, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_CHECKSUM_ALGORITHM: {
-                                int32_t tmp = 0;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_checksum_set_algorithm(checksum, tmp);
-                                break;
-                        }
+                        ret = idmef_user_id_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        break;
+                }
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_checksum_t: '%u'", tag);
+                case IDMEF_MSG_FILE_ACCESS_PERMISSION: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_file_access_set_permission(file_access, tmp, -1);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_file_access_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_file_access_child_tags[] = {
+        IDMEF_MSG_USER_ID_TAG,
+        IDMEF_MSG_FILE_ACCESS_PERMISSION,
+};
+
+
+static const idmef_read_class_t idmef_file_access_read_class = {
+        "idmef_file_access_t",
+        idmef_file_access_read_child,
+        sizeof(idmef_file_access_child_tags),
+        idmef_file_access_child_tags
+};
+
 /**
- * idmef_file_read:
- * @file: Pointer to a #idmef_file_t object.
+ * idmef_file_access_read:
+ * @file_access: Pointer to a #idmef_file_access_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_file from the @msg message, and
- * store it into @file.
+ * Read an idmef_file_access from the @msg message, and
+ * store it into @file_access.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_file_read(idmef_file_t *file, prelude_msg_t *msg)
+int idmef_file_access_read(idmef_file_access_t *file_access, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -1635,220 +2110,221 @@ int idmef_file_read(idmef_file_t *file, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_FILE_IDENT: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_file_access_read_child(file_access, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_file_set_ident(file, tmp);
-                                break;
-                        }
+static int idmef_inode_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_inode_t *inode = object;
 
-                        case IDMEF_MSG_FILE_NAME: {
-                                prelude_string_t *tmp = NULL;
+        switch ( tag ) {
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_INODE_CHANGE_TIME: {
+                        idmef_time_t *tmp = NULL;
 
-                                idmef_file_set_name(file, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_FILE_PATH: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_inode_set_change_time(inode, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_INODE_NUMBER: {
+                        uint32_t tmp = 0;
 
-                                idmef_file_set_path(file, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_FILE_CREATE_TIME: {
-                                idmef_time_t *tmp = NULL;
+                        idmef_inode_set_number(inode, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_INODE_MAJOR_DEVICE: {
+                        uint32_t tmp = 0;
 
-                                idmef_file_set_create_time(file, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_FILE_MODIFY_TIME: {
-                                idmef_time_t *tmp = NULL;
+                        idmef_inode_set_major_device(inode, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_INODE_MINOR_DEVICE: {
+                        uint32_t tmp = 0;
 
-                                idmef_file_set_modify_time(file, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_FILE_ACCESS_TIME: {
-                                idmef_time_t *tmp = NULL;
+                        idmef_inode_set_minor_device(inode, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_file_set_access_time(file, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_FILE_DATA_SIZE: {
-                                uint64_t tmp = 0;
-
-                                ret = prelude_extract_uint64_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_file_set_data_size(file, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_FILE_DISK_SIZE: {
-                                uint64_t tmp = 0;
-
-                                ret = prelude_extract_uint64_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_file_set_disk_size(file, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_FILE_ACCESS_TAG: {
-                                int ret;
-                                idmef_file_access_t *tmp = NULL;
-
-                                ret = idmef_file_new_file_access(file, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
-
-
-
-                                ret = idmef_file_access_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                break;
-                        }
-
-                        case IDMEF_MSG_LINKAGE_TAG: {
-                                int ret;
-                                idmef_linkage_t *tmp = NULL;
-
-                                ret = idmef_file_new_linkage(file, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_INODE_C_MAJOR_DEVICE: {
+                        uint32_t tmp = 0;
 
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
+                        idmef_inode_set_c_major_device(inode, tmp);
+                        break;
+                }
 
-                                ret = idmef_linkage_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_INODE_C_MINOR_DEVICE: {
+                        uint32_t tmp = 0;
 
-                                break;
-                        }
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_INODE_TAG: {
-                                int ret;
-                                idmef_inode_t *tmp = NULL;
+                        idmef_inode_set_c_minor_device(inode, tmp);
+                        break;
+                }
 
-                                ret = idmef_file_new_inode(file, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_inode_t: '%u'", tag);
+        }
 
+        return 0;
+}
 
 
-                                ret = idmef_inode_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+static const uint8_t idmef_inode_child_tags[] = {
+        IDMEF_MSG_INODE_CHANGE_TIME,
+        IDMEF_MSG_INODE_NUMBER,
+        IDMEF_MSG_INODE_MAJOR_DEVICE,
+        IDMEF_MSG_INODE_MINOR_DEVICE,
+        IDMEF_MSG_INODE_C_MAJOR_DEVICE,
+        IDMEF_MSG_INODE_C_MINOR_DEVICE,
+};
 
-                                break;
-                        }
 
-                        case IDMEF_MSG_CHECKSUM_TAG: {
-                                int ret;
-                                idmef_checksum_t *tmp = NULL;
+static const idmef_read_class_t idmef_inode_read_class = {
+        "idmef_inode_t",
+        idmef_inode_read_child,
+        sizeof(idmef_inode_child_tags),
+        idmef_inode_child_tags
+};
 
-                                ret = idmef_file_new_checksum(file, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+/**
+ * idmef_inode_read:
+ * @inode: Pointer to a #idmef_inode_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Read an idmef_inode from the @msg message, and
+ * store it into @inode.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_inode_read(idmef_inode_t *inode, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
 
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
 
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                                ret = idmef_checksum_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = idmef_inode_read_child(inode, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                break;
-                        }
+        return 0;
+}
 
-                        case IDMEF_MSG_FILE_CATEGORY: {
-                                int32_t tmp = 0;
+static int idmef_checksum_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_checksum_t *checksum = object;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
-                                idmef_file_set_category(file, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_CHECKSUM_VALUE: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_FILE_FSTYPE: {
-                                int32_t tmp = 0;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_checksum_set_value(checksum, tmp);
+                        break;
+                }
 
-                                idmef_file_set_fstype(file, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_CHECKSUM_KEY: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_FILE_FILE_TYPE: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_checksum_set_key(checksum, tmp);
+                        break;
+                }
 
-                                idmef_file_set_file_type(file, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_CHECKSUM_ALGORITHM: {
+                        int32_t tmp = 0;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_file_t: '%u'", tag);
+                        idmef_checksum_set_algorithm(checksum, tmp);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_checksum_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_checksum_child_tags[] = {
+        IDMEF_MSG_CHECKSUM_VALUE,
+        IDMEF_MSG_CHECKSUM_KEY,
+        IDMEF_MSG_CHECKSUM_ALGORITHM,
+};
+
+
+static const idmef_read_class_t idmef_checksum_read_class = {
+        "idmef_checksum_t",
+        idmef_checksum_read_child,
+        sizeof(idmef_checksum_child_tags),
+        idmef_checksum_child_tags
+};
+
 /**
- * idmef_linkage_read:
- * @linkage: Pointer to a #idmef_linkage_t object.
+ * idmef_checksum_read:
+ * @checksum: Pointer to a #idmef_checksum_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_linkage from the @msg message, and
- * store it into @linkage.
+ * Read an idmef_checksum from the @msg message, and
+ * store it into @checksum.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_linkage_read(idmef_linkage_t *linkage, prelude_msg_t *msg)
+int idmef_checksum_read(idmef_checksum_t *checksum, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -1860,235 +2336,254 @@ int idmef_linkage_read(idmef_linkage_t *linkage, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
-
-                        case IDMEF_MSG_LINKAGE_CATEGORY: {
-                                int32_t tmp = 0;
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = idmef_checksum_read_child(checksum, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                idmef_linkage_set_category(linkage, tmp);
-                                break;
-                        }
+        return 0;
+}
 
-                        case IDMEF_MSG_LINKAGE_NAME: {
-                                prelude_string_t *tmp = NULL;
+static int idmef_file_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_file_t *file = object;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
-                                idmef_linkage_set_name(linkage, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_FILE_IDENT: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_LINKAGE_PATH: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_file_set_ident(file, tmp);
+                        break;
+                }
 
-                                idmef_linkage_set_path(linkage, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_FILE_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_FILE_TAG: {
-                                int ret;
-                                idmef_file_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_linkage_new_file(linkage, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_file_set_name(file, tmp);
+                        break;
+                }
 
+                case IDMEF_MSG_FILE_PATH: {
+                        prelude_string_t *tmp = NULL;
 
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_file_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_file_set_path(file, tmp);
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_FILE_CREATE_TIME: {
+                        idmef_time_t *tmp = NULL;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_linkage_t: '%u'", tag);
+                        idmef_file_set_create_time(file, tmp);
+                        break;
                 }
 
-        }
-
-        return 0;
-}
+                case IDMEF_MSG_FILE_MODIFY_TIME: {
+                        idmef_time_t *tmp = NULL;
 
-/**
- * idmef_target_read:
- * @target: Pointer to a #idmef_target_t object.
- * @msg: Pointer to a #prelude_msg_t object, containing a message.
- *
- * Read an idmef_target from the @msg message, and
- * store it into @target.
- *
- * Returns: 0 on success, a negative value if an error occured.
- */
-int idmef_target_read(idmef_target_t *target, prelude_msg_t *msg)
-{
-        int ret;
-        void *buf;
-        uint8_t tag;
-        uint32_t len;
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-        while ( 1 ) {
-                ret = prelude_msg_get(msg, &tag, &len, &buf);
-                if ( ret < 0 )
-                        return ret;
+                        idmef_file_set_modify_time(file, tmp);
+                        break;
+                }
 
-                switch ( tag ) {
+                case IDMEF_MSG_FILE_ACCESS_TIME: {
+                        idmef_time_t *tmp = NULL;
 
-                        case IDMEF_MSG_TARGET_IDENT: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_file_set_access_time(file, tmp);
+                        break;
+                }
 
-                                idmef_target_set_ident(target, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_FILE_DATA_SIZE: {
+                        uint64_t tmp = 0;
 
-                        case IDMEF_MSG_TARGET_DECOY: {
-                                int32_t tmp = 0;
+                        ret = prelude_extract_uint64_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_file_set_data_size(file, tmp);
+                        break;
+                }
 
-                                idmef_target_set_decoy(target, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_FILE_DISK_SIZE: {
+                        uint64_t tmp = 0;
 
-                        case IDMEF_MSG_TARGET_INTERFACE: {
-                                prelude_string_t *tmp = NULL;
+                        ret = prelude_extract_uint64_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_file_set_disk_size(file, tmp);
+                        break;
+                }
 
-                                idmef_target_set_interface(target, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_FILE_ACCESS_TAG: {
+                        idmef_file_access_t *tmp = NULL;
 
-                        case IDMEF_MSG_NODE_TAG: {
-                                int ret;
-                                idmef_node_t *tmp = NULL;
+                        ret = idmef_file_new_file_access(file, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_target_new_node(target, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
 
 
+                        ret = idmef_file_access_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_node_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_LINKAGE_TAG: {
+                        idmef_linkage_t *tmp = NULL;
 
-                        case IDMEF_MSG_USER_TAG: {
-                                int ret;
-                                idmef_user_t *tmp = NULL;
+                        ret = idmef_file_new_linkage(file, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_target_new_user(target, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
 
 
+                        ret = idmef_linkage_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_user_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_INODE_TAG: {
+                        idmef_inode_t *tmp = NULL;
 
-                        case IDMEF_MSG_PROCESS_TAG: {
-                                int ret;
-                                idmef_process_t *tmp = NULL;
+                        ret = idmef_file_new_inode(file, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_target_new_process(target, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
 
 
+                        ret = idmef_inode_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_process_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_CHECKSUM_TAG: {
+                        idmef_checksum_t *tmp = NULL;
 
-                        case IDMEF_MSG_SERVICE_TAG: {
-                                int ret;
-                                idmef_service_t *tmp = NULL;
+                        ret = idmef_file_new_checksum(file, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_target_new_service(target, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
 
 
+                        ret = idmef_checksum_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_service_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_FILE_CATEGORY: {
+                        int32_t tmp = 0;
 
-                        case IDMEF_MSG_FILE_TAG: {
-                                int ret;
-                                idmef_file_t *tmp = NULL;
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_target_new_file(target, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_file_set_category(file, tmp);
+                        break;
+                }
 
+                case IDMEF_MSG_FILE_FSTYPE: {
+                        int32_t tmp = 0;
 
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_file_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_file_set_fstype(file, tmp);
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_FILE_FILE_TYPE: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_target_t: '%u'", tag);
+                        idmef_file_set_file_type(file, tmp);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_file_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_file_child_tags[] = {
+        IDMEF_MSG_FILE_IDENT,
+        IDMEF_MSG_FILE_NAME,
+        IDMEF_MSG_FILE_PATH,
+        IDMEF_MSG_FILE_CREATE_TIME,
+        IDMEF_MSG_FILE_MODIFY_TIME,
+        IDMEF_MSG_FILE_ACCESS_TIME,
+        IDMEF_MSG_FILE_DATA_SIZE,
+        IDMEF_MSG_FILE_DISK_SIZE,
+        IDMEF_MSG_FILE_ACCESS_TAG,
+        IDMEF_MSG_LINKAGE_TAG,
+        IDMEF_MSG_INODE_TAG,
+        IDMEF_MSG_CHECKSUM_TAG,
+        IDMEF_MSG_FILE_CATEGORY,
+        IDMEF_MSG_FILE_FSTYPE,
+        IDMEF_MSG_FILE_FILE_TYPE,
+};
+
+
+static const idmef_read_class_t idmef_file_read_class = {
+        "idmef_file_t",
+        idmef_file_read_child,
+        sizeof(idmef_file_child_tags),
+        idmef_file_child_tags
+};
+
 /**
- * idmef_analyzer_read:
- * @analyzer: Pointer to a #idmef_analyzer_t object.
+ * idmef_file_read:
+ * @file: Pointer to a #idmef_file_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_analyzer from the @msg message, and
- * store it into @analyzer.
+ * Read an idmef_file from the @msg message, and
+ * store it into @file.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_analyzer_read(idmef_analyzer_t *analyzer, prelude_msg_t *msg)
+int idmef_file_read(idmef_file_t *file, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -2100,153 +2595,942 @@ int idmef_analyzer_read(idmef_analyzer_t *analyzer, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_ANALYZER_ANALYZERID: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_file_read_child(file, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_analyzer_set_analyzerid(analyzer, tmp);
-                                break;
-                        }
+static int idmef_linkage_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_linkage_t *linkage = object;
 
-                        case IDMEF_MSG_ANALYZER_NAME: {
-                                prelude_string_t *tmp = NULL;
+        switch ( tag ) {
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_LINKAGE_CATEGORY: {
+                        int32_t tmp = 0;
 
-                                idmef_analyzer_set_name(analyzer, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_ANALYZER_MANUFACTURER: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_linkage_set_category(linkage, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_LINKAGE_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_analyzer_set_manufacturer(analyzer, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_ANALYZER_MODEL: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_linkage_set_name(linkage, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_LINKAGE_PATH: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_analyzer_set_model(analyzer, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_ANALYZER_VERSION: {
-                                prelude_string_t *tmp = NULL;
+                        idmef_linkage_set_path(linkage, tmp);
+                        break;
+                }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_FILE_TAG: {
+                        idmef_file_t *tmp = NULL;
 
-                                idmef_analyzer_set_version(analyzer, tmp);
-                                break;
-                        }
+                        ret = idmef_linkage_new_file(linkage, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_ANALYZER_CLASS: {
-                                prelude_string_t *tmp = NULL;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_analyzer_set_class(analyzer, tmp);
-                                break;
-                        }
+                        ret = idmef_file_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_ANALYZER_OSTYPE: {
-                                prelude_string_t *tmp = NULL;
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_linkage_t: '%u'", tag);
+        }
+
+        return 0;
+}
+
+
+static const uint8_t idmef_linkage_child_tags[] = {
+        IDMEF_MSG_LINKAGE_CATEGORY,
+        IDMEF_MSG_LINKAGE_NAME,
+        IDMEF_MSG_LINKAGE_PATH,
+        IDMEF_MSG_FILE_TAG,
+};
+
+
+static const idmef_read_class_t idmef_linkage_read_class = {
+        "idmef_linkage_t",
+        idmef_linkage_read_child,
+        sizeof(idmef_linkage_child_tags),
+        idmef_linkage_child_tags
+};
+
+/**
+ * idmef_linkage_read:
+ * @linkage: Pointer to a #idmef_linkage_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Read an idmef_linkage from the @msg message, and
+ * store it into @linkage.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_linkage_read(idmef_linkage_t *linkage, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_linkage_read_child(linkage, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+static int idmef_target_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_target_t *target = object;
+
+        switch ( tag ) {
+
+                case IDMEF_MSG_TARGET_IDENT: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_target_set_ident(target, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_TARGET_DECOY: {
+                        int32_t tmp = 0;
+
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_target_set_decoy(target, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_TARGET_INTERFACE: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_target_set_interface(target, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_NODE_TAG: {
+                        idmef_node_t *tmp = NULL;
+
+                        ret = idmef_target_new_node(target, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_node_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_USER_TAG: {
+                        idmef_user_t *tmp = NULL;
+
+                        ret = idmef_target_new_user(target, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_user_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_PROCESS_TAG: {
+                        idmef_process_t *tmp = NULL;
+
+                        ret = idmef_target_new_process(target, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_process_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_SERVICE_TAG: {
+                        idmef_service_t *tmp = NULL;
+
+                        ret = idmef_target_new_service(target, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_service_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_FILE_TAG: {
+                        idmef_file_t *tmp = NULL;
+
+                        ret = idmef_target_new_file(target, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_file_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_target_t: '%u'", tag);
+        }
+
+        return 0;
+}
+
+
+static const uint8_t idmef_target_child_tags[] = {
+        IDMEF_MSG_TARGET_IDENT,
+        IDMEF_MSG_TARGET_DECOY,
+        IDMEF_MSG_TARGET_INTERFACE,
+        IDMEF_MSG_NODE_TAG,
+        IDMEF_MSG_USER_TAG,
+        IDMEF_MSG_PROCESS_TAG,
+        IDMEF_MSG_SERVICE_TAG,
+        IDMEF_MSG_FILE_TAG,
+};
+
+
+static const idmef_read_class_t idmef_target_read_class = {
+        "idmef_target_t",
+        idmef_target_read_child,
+        sizeof(idmef_target_child_tags),
+        idmef_target_child_tags
+};
+
+/**
+ * idmef_target_read:
+ * @target: Pointer to a #idmef_target_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Read an idmef_target from the @msg message, and
+ * store it into @target.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_target_read(idmef_target_t *target, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_target_read_child(target, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+static int idmef_analyzer_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_analyzer_t *analyzer = object;
+
+        switch ( tag ) {
+
+                case IDMEF_MSG_ANALYZER_ANALYZERID: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_analyzer_set_analyzerid(analyzer, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ANALYZER_NAME: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_analyzer_set_name(analyzer, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ANALYZER_MANUFACTURER: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_analyzer_set_manufacturer(analyzer, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ANALYZER_MODEL: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_analyzer_set_model(analyzer, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ANALYZER_VERSION: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_analyzer_set_version(analyzer, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ANALYZER_CLASS: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_analyzer_set_class(analyzer, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ANALYZER_OSTYPE: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_analyzer_set_ostype(analyzer, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ANALYZER_OSVERSION: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_analyzer_set_osversion(analyzer, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_NODE_TAG: {
+                        idmef_node_t *tmp = NULL;
+
+                        ret = idmef_analyzer_new_node(analyzer, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_node_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_PROCESS_TAG: {
+                        idmef_process_t *tmp = NULL;
+
+                        ret = idmef_analyzer_new_process(analyzer, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_process_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_analyzer_t: '%u'", tag);
+        }
+
+        return 0;
+}
+
+
+static const uint8_t idmef_analyzer_child_tags[] = {
+        IDMEF_MSG_ANALYZER_ANALYZERID,
+        IDMEF_MSG_ANALYZER_NAME,
+        IDMEF_MSG_ANALYZER_MANUFACTURER,
+        IDMEF_MSG_ANALYZER_MODEL,
+        IDMEF_MSG_ANALYZER_VERSION,
+        IDMEF_MSG_ANALYZER_CLASS,
+        IDMEF_MSG_ANALYZER_OSTYPE,
+        IDMEF_MSG_ANALYZER_OSVERSION,
+        IDMEF_MSG_NODE_TAG,
+        IDMEF_MSG_PROCESS_TAG,
+};
+
+
+static const idmef_read_class_t idmef_analyzer_read_class = {
+        "idmef_analyzer_t",
+        idmef_analyzer_read_child,
+        sizeof(idmef_analyzer_child_tags),
+        idmef_analyzer_child_tags
+};
+
+/**
+ * idmef_analyzer_read:
+ * @analyzer: Pointer to a #idmef_analyzer_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Read an idmef_analyzer from the @msg message, and
+ * store it into @analyzer.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_analyzer_read(idmef_analyzer_t *analyzer, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_analyzer_read_child(analyzer, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+static int idmef_alertident_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_alertident_t *alertident = object;
+
+        switch ( tag ) {
+
+                case IDMEF_MSG_ALERTIDENT_ALERTIDENT: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_alertident_set_alertident(alertident, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ALERTIDENT_ANALYZERID: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_alertident_set_analyzerid(alertident, tmp);
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_alertident_t: '%u'", tag);
+        }
+
+        return 0;
+}
+
+
+static const uint8_t idmef_alertident_child_tags[] = {
+        IDMEF_MSG_ALERTIDENT_ALERTIDENT,
+        IDMEF_MSG_ALERTIDENT_ANALYZERID,
+};
+
+
+static const idmef_read_class_t idmef_alertident_read_class = {
+        "idmef_alertident_t",
+        idmef_alertident_read_child,
+        sizeof(idmef_alertident_child_tags),
+        idmef_alertident_child_tags
+};
+
+/**
+ * idmef_alertident_read:
+ * @alertident: Pointer to a #idmef_alertident_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Read an idmef_alertident from the @msg message, and
+ * store it into @alertident.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_alertident_read(idmef_alertident_t *alertident, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_alertident_read_child(alertident, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+static int idmef_impact_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_impact_t *impact = object;
+
+        switch ( tag ) {
+
+                case IDMEF_MSG_IMPACT_SEVERITY: {
+                        int32_t tmp = 0;
+
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_impact_set_severity(impact, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_IMPACT_COMPLETION: {
+                        int32_t tmp = 0;
+
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_impact_set_completion(impact, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_IMPACT_TYPE: {
+                        int32_t tmp = 0;
+
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_impact_set_type(impact, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_IMPACT_DESCRIPTION: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_impact_set_description(impact, tmp);
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_impact_t: '%u'", tag);
+        }
+
+        return 0;
+}
+
+
+static const uint8_t idmef_impact_child_tags[] = {
+        IDMEF_MSG_IMPACT_SEVERITY,
+        IDMEF_MSG_IMPACT_COMPLETION,
+        IDMEF_MSG_IMPACT_TYPE,
+        IDMEF_MSG_IMPACT_DESCRIPTION,
+};
+
+
+static const idmef_read_class_t idmef_impact_read_class = {
+        "idmef_impact_t",
+        idmef_impact_read_child,
+        sizeof(idmef_impact_child_tags),
+        idmef_impact_child_tags
+};
+
+/**
+ * idmef_impact_read:
+ * @impact: Pointer to a #idmef_impact_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Read an idmef_impact from the @msg message, and
+ * store it into @impact.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_impact_read(idmef_impact_t *impact, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_impact_read_child(impact, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+static int idmef_action_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_action_t *action = object;
+
+        switch ( tag ) {
+
+                case IDMEF_MSG_ACTION_CATEGORY: {
+                        int32_t tmp = 0;
+
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_action_set_category(action, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ACTION_DESCRIPTION: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_action_set_description(action, tmp);
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_action_t: '%u'", tag);
+        }
+
+        return 0;
+}
+
+
+static const uint8_t idmef_action_child_tags[] = {
+        IDMEF_MSG_ACTION_CATEGORY,
+        IDMEF_MSG_ACTION_DESCRIPTION,
+};
+
+
+static const idmef_read_class_t idmef_action_read_class = {
+        "idmef_action_t",
+        idmef_action_read_child,
+        sizeof(idmef_action_child_tags),
+        idmef_action_child_tags
+};
+
+/**
+ * idmef_action_read:
+ * @action: Pointer to a #idmef_action_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Read an idmef_action from the @msg message, and
+ * store it into @action.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_action_read(idmef_action_t *action, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_action_read_child(action, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+static int idmef_confidence_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_confidence_t *confidence = object;
+
+        switch ( tag ) {
+
+                case IDMEF_MSG_CONFIDENCE_RATING: {
+                        int32_t tmp = 0;
+
+                        ret = prelude_extract_int32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_confidence_set_rating(confidence, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_CONFIDENCE_CONFIDENCE: {
+                        float tmp = 0;
+
+                        ret = prelude_extract_float_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_confidence_set_confidence(confidence, tmp);
+                        break;
+                }
+
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_confidence_t: '%u'", tag);
+        }
+
+        return 0;
+}
+
+
+static const uint8_t idmef_confidence_child_tags[] = {
+        IDMEF_MSG_CONFIDENCE_RATING,
+        IDMEF_MSG_CONFIDENCE_CONFIDENCE,
+};
+
+
+static const idmef_read_class_t idmef_confidence_read_class = {
+        "idmef_confidence_t",
+        idmef_confidence_read_child,
+        sizeof(idmef_confidence_child_tags),
+        idmef_confidence_child_tags
+};
+
+/**
+ * idmef_confidence_read:
+ * @confidence: Pointer to a #idmef_confidence_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Read an idmef_confidence from the @msg message, and
+ * store it into @confidence.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_confidence_read(idmef_confidence_t *confidence, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_confidence_read_child(confidence, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+static int idmef_assessment_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_assessment_t *assessment = object;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
-                                idmef_analyzer_set_ostype(analyzer, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_IMPACT_TAG: {
+                        idmef_impact_t *tmp = NULL;
 
-                        case IDMEF_MSG_ANALYZER_OSVERSION: {
-                                prelude_string_t *tmp = NULL;
+                        ret = idmef_assessment_new_impact(assessment, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_analyzer_set_osversion(analyzer, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_NODE_TAG: {
-                                int ret;
-                                idmef_node_t *tmp = NULL;
+                        ret = idmef_impact_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_analyzer_new_node(analyzer, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                        break;
+                }
 
+                case IDMEF_MSG_ACTION_TAG: {
+                        idmef_action_t *tmp = NULL;
 
+                        ret = idmef_assessment_new_action(assessment, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_node_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                break;
-                        }
 
-                        case IDMEF_MSG_PROCESS_TAG: {
-                                int ret;
-                                idmef_process_t *tmp = NULL;
+                        ret = idmef_action_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_analyzer_new_process(analyzer, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                        break;
+                }
 
+                case IDMEF_MSG_CONFIDENCE_TAG: {
+                        idmef_confidence_t *tmp = NULL;
 
+                        ret = idmef_assessment_new_confidence(assessment, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_process_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                break;
-                        }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = idmef_confidence_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_analyzer_t: '%u'", tag);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_assessment_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_assessment_child_tags[] = {
+        IDMEF_MSG_IMPACT_TAG,
+        IDMEF_MSG_ACTION_TAG,
+        IDMEF_MSG_CONFIDENCE_TAG,
+};
+
+
+static const idmef_read_class_t idmef_assessment_read_class = {
+        "idmef_assessment_t",
+        idmef_assessment_read_child,
+        sizeof(idmef_assessment_child_tags),
+        idmef_assessment_child_tags
+};
+
 /**
- * idmef_alertident_read:
- * @alertident: Pointer to a #idmef_alertident_t object.
+ * idmef_assessment_read:
+ * @assessment: Pointer to a #idmef_assessment_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_alertident from the @msg message, and
- * store it into @alertident.
+ * Read an idmef_assessment from the @msg message, and
+ * store it into @assessment.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_alertident_read(idmef_alertident_t *alertident, prelude_msg_t *msg)
+int idmef_assessment_read(idmef_assessment_t *assessment, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -2258,53 +3542,95 @@ int idmef_alertident_read(idmef_alertident_t *alertident, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_ALERTIDENT_ALERTIDENT: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_assessment_read_child(assessment, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_alertident_set_alertident(alertident, tmp);
-                                break;
-                        }
+static int idmef_tool_alert_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_tool_alert_t *tool_alert = object;
 
-                        case IDMEF_MSG_ALERTIDENT_ANALYZERID: {
-                                prelude_string_t *tmp = NULL;
+        switch ( tag ) {
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_TOOL_ALERT_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_alertident_set_analyzerid(alertident, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        idmef_tool_alert_set_name(tool_alert, tmp);
+                        break;
+                }
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_alertident_t: '%u'", tag);
+                case IDMEF_MSG_TOOL_ALERT_COMMAND: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_tool_alert_set_command(tool_alert, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ALERTIDENT_TAG: {
+                        idmef_alertident_t *tmp = NULL;
+
+                        ret = idmef_tool_alert_new_alertident(tool_alert, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_alertident_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_tool_alert_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_tool_alert_child_tags[] = {
+        IDMEF_MSG_TOOL_ALERT_NAME,
+        IDMEF_MSG_TOOL_ALERT_COMMAND,
+        IDMEF_MSG_ALERTIDENT_TAG,
+};
+
+
+static const idmef_read_class_t idmef_tool_alert_read_class = {
+        "idmef_tool_alert_t",
+        idmef_tool_alert_read_child,
+        sizeof(idmef_tool_alert_child_tags),
+        idmef_tool_alert_child_tags
+};
+
 /**
- * idmef_impact_read:
- * @impact: Pointer to a #idmef_impact_t object.
+ * idmef_tool_alert_read:
+ * @tool_alert: Pointer to a #idmef_tool_alert_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_impact from the @msg message, and
- * store it into @impact.
+ * Read an idmef_tool_alert from the @msg message, and
+ * store it into @tool_alert.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_impact_read(idmef_impact_t *impact, prelude_msg_t *msg)
+int idmef_tool_alert_read(idmef_tool_alert_t *tool_alert, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -2316,75 +3642,83 @@ int idmef_impact_read(idmef_impact_t *impact, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
-
-                        case IDMEF_MSG_IMPACT_SEVERITY: {
-                                int32_t tmp = 0;
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = idmef_tool_alert_read_child(tool_alert, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                idmef_impact_set_severity(impact, tmp);
-                                break;
-                        }
+        return 0;
+}
 
-                        case IDMEF_MSG_IMPACT_COMPLETION: {
-                                int32_t tmp = 0;
+static int idmef_correlation_alert_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_correlation_alert_t *correlation_alert = object;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
-                                idmef_impact_set_completion(impact, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_CORRELATION_ALERT_NAME: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_IMPACT_TYPE: {
-                                int32_t tmp = 0;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_correlation_alert_set_name(correlation_alert, tmp);
+                        break;
+                }
 
-                                idmef_impact_set_type(impact, tmp);
-                                break;
-                        }
+                case IDMEF_MSG_ALERTIDENT_TAG: {
+                        idmef_alertident_t *tmp = NULL;
 
-                        case IDMEF_MSG_IMPACT_DESCRIPTION: {
-                                prelude_string_t *tmp = NULL;
+                        ret = idmef_correlation_alert_new_alertident(correlation_alert, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_impact_set_description(impact, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = idmef_alertident_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_impact_t: '%u'", tag);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_correlation_alert_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_correlation_alert_child_tags[] = {
+        IDMEF_MSG_CORRELATION_ALERT_NAME,
+        IDMEF_MSG_ALERTIDENT_TAG,
+};
+
+
+static const idmef_read_class_t idmef_correlation_alert_read_class = {
+        "idmef_correlation_alert_t",
+        idmef_correlation_alert_read_child,
+        sizeof(idmef_correlation_alert_child_tags),
+        idmef_correlation_alert_child_tags
+};
+
 /**
- * idmef_action_read:
- * @action: Pointer to a #idmef_action_t object.
+ * idmef_correlation_alert_read:
+ * @correlation_alert: Pointer to a #idmef_correlation_alert_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_action from the @msg message, and
- * store it into @action.
+ * Read an idmef_correlation_alert from the @msg message, and
+ * store it into @correlation_alert.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_action_read(idmef_action_t *action, prelude_msg_t *msg)
+int idmef_correlation_alert_read(idmef_correlation_alert_t *correlation_alert, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -2396,111 +3730,370 @@ int idmef_action_read(idmef_action_t *action, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_ACTION_CATEGORY: {
-                                int32_t tmp = 0;
+                ret = idmef_correlation_alert_read_child(correlation_alert, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_action_set_category(action, tmp);
-                                break;
-                        }
+static int idmef_overflow_alert_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_overflow_alert_t *overflow_alert = object;
 
-                        case IDMEF_MSG_ACTION_DESCRIPTION: {
-                                prelude_string_t *tmp = NULL;
+        switch ( tag ) {
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_OVERFLOW_ALERT_PROGRAM: {
+                        prelude_string_t *tmp = NULL;
 
-                                idmef_action_set_description(action, tmp);
-                                break;
-                        }
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        idmef_overflow_alert_set_program(overflow_alert, tmp);
+                        break;
+                }
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_action_t: '%u'", tag);
+                case IDMEF_MSG_OVERFLOW_ALERT_SIZE: {
+                        uint32_t tmp = 0;
+
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_overflow_alert_set_size(overflow_alert, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_OVERFLOW_ALERT_BUFFER: {
+                        idmef_data_t *tmp = NULL;
+
+                        ret = prelude_extract_data_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_overflow_alert_set_buffer(overflow_alert, tmp);
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_overflow_alert_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_overflow_alert_child_tags[] = {
+        IDMEF_MSG_OVERFLOW_ALERT_PROGRAM,
+        IDMEF_MSG_OVERFLOW_ALERT_SIZE,
+        IDMEF_MSG_OVERFLOW_ALERT_BUFFER,
+};
+
+
+static const idmef_read_class_t idmef_overflow_alert_read_class = {
+        "idmef_overflow_alert_t",
+        idmef_overflow_alert_read_child,
+        sizeof(idmef_overflow_alert_child_tags),
+        idmef_overflow_alert_child_tags
+};
+
 /**
- * idmef_confidence_read:
- * @confidence: Pointer to a #idmef_confidence_t object.
+ * idmef_overflow_alert_read:
+ * @overflow_alert: Pointer to a #idmef_overflow_alert_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_confidence from the @msg message, and
- * store it into @confidence.
+ * Read an idmef_overflow_alert from the @msg message, and
+ * store it into @overflow_alert.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_confidence_read(idmef_confidence_t *confidence, prelude_msg_t *msg)
+int idmef_overflow_alert_read(idmef_overflow_alert_t *overflow_alert, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
         uint8_t tag;
         uint32_t len;
 
-        while ( 1 ) {
-                ret = prelude_msg_get(msg, &tag, &len, &buf);
-                if ( ret < 0 )
-                        return ret;
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_overflow_alert_read_child(overflow_alert, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+static int idmef_alert_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_alert_t *alert = object;
+
+        switch ( tag ) {
+
+                case IDMEF_MSG_ALERT_MESSAGEID: {
+                        prelude_string_t *tmp = NULL;
+
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_alert_set_messageid(alert, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ANALYZER_TAG: {
+                        idmef_analyzer_t *tmp = NULL;
+
+                        ret = idmef_alert_new_analyzer(alert, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_analyzer_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_ALERT_CREATE_TIME: {
+                        idmef_time_t *tmp = NULL;
+
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_alert_set_create_time(alert, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_CLASSIFICATION_TAG: {
+                        idmef_classification_t *tmp = NULL;
+
+                        ret = idmef_alert_new_classification(alert, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_classification_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_ALERT_DETECT_TIME: {
+                        idmef_time_t *tmp = NULL;
+
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_alert_set_detect_time(alert, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_ALERT_ANALYZER_TIME: {
+                        idmef_time_t *tmp = NULL;
+
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        idmef_alert_set_analyzer_time(alert, tmp);
+                        break;
+                }
+
+                case IDMEF_MSG_SOURCE_TAG: {
+                        idmef_source_t *tmp = NULL;
+
+                        ret = idmef_alert_new_source(alert, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_source_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_TARGET_TAG: {
+                        idmef_target_t *tmp = NULL;
+
+                        ret = idmef_alert_new_target(alert, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_target_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_ASSESSMENT_TAG: {
+                        idmef_assessment_t *tmp = NULL;
+
+                        ret = idmef_alert_new_assessment(alert, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_assessment_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_ADDITIONAL_DATA_TAG: {
+                        idmef_additional_data_t *tmp = NULL;
+
+                        ret = idmef_alert_new_additional_data(alert, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_additional_data_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_TOOL_ALERT_TAG: {
+                        idmef_tool_alert_t *tmp = NULL;
+
+                        ret = idmef_alert_new_tool_alert(alert, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_tool_alert_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                switch ( tag ) {
+                        break;
+                }
 
-                        case IDMEF_MSG_CONFIDENCE_RATING: {
-                                int32_t tmp = 0;
+                case IDMEF_MSG_CORRELATION_ALERT_TAG: {
+                        idmef_correlation_alert_t *tmp = NULL;
 
-                                ret = prelude_extract_int32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                        ret = idmef_alert_new_correlation_alert(alert, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
-                                idmef_confidence_set_rating(confidence, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_CONFIDENCE_CONFIDENCE: {
-                                float tmp = 0;
 
-                                ret = prelude_extract_float_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                        ret = idmef_correlation_alert_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                idmef_confidence_set_confidence(confidence, tmp);
-                                break;
-                        }
+                        break;
+                }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                case IDMEF_MSG_OVERFLOW_ALERT_TAG: {
+                        idmef_overflow_alert_t *tmp = NULL;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_confidence_t: '%u'", tag);
+                        ret = idmef_alert_new_overflow_alert(alert, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_overflow_alert_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_alert_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_alert_child_tags[] = {
+        IDMEF_MSG_ALERT_MESSAGEID,
+        IDMEF_MSG_ANALYZER_TAG,
+        IDMEF_MSG_ALERT_CREATE_TIME,
+        IDMEF_MSG_CLASSIFICATION_TAG,
+        IDMEF_MSG_ALERT_DETECT_TIME,
+        IDMEF_MSG_ALERT_ANALYZER_TIME,
+        IDMEF_MSG_SOURCE_TAG,
+        IDMEF_MSG_TARGET_TAG,
+        IDMEF_MSG_ASSESSMENT_TAG,
+        IDMEF_MSG_ADDITIONAL_DATA_TAG,
+        IDMEF_MSG_TOOL_ALERT_TAG,
+        IDMEF_MSG_CORRELATION_ALERT_TAG,
+        IDMEF_MSG_OVERFLOW_ALERT_TAG,
+        IDMEF_MSG_END_OF_TAG,
+};
+
+
+static const idmef_read_class_t idmef_alert_read_class = {
+        "idmef_alert_t",
+        idmef_alert_read_child,
+        sizeof(idmef_alert_child_tags),
+        idmef_alert_child_tags
+};
+
+
+/*
+ * Index the children of @alert without decoding them:
+ * they are decoded when first accessed.
+ */
+static int idmef_alert_index(idmef_alert_t *alert, prelude_msg_t *msg)
+{
+        int ret;
+        idmef_lazy_t *lazy;
+
+        ret = lazy_new(&lazy, &idmef_alert_read_class, msg);
+        if ( ret < 0 )
+                return ret;
+
+        _idmef_alert_set_lazy(alert, lazy);
+
+        return 0;
+}
+
 /**
- * idmef_assessment_read:
- * @assessment: Pointer to a #idmef_assessment_t object.
+ * idmef_alert_read:
+ * @alert: Pointer to a #idmef_alert_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_assessment from the @msg message, and
- * store it into @assessment.
+ * Read an idmef_alert from the @msg message, and
+ * store it into @alert.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_assessment_read(idmef_assessment_t *assessment, prelude_msg_t *msg)
+int idmef_alert_read(idmef_alert_t *alert, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -2512,157 +4105,155 @@ int idmef_assessment_read(idmef_assessment_t *assessment, prelude_msg_t *msg)
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
-
-                        case IDMEF_MSG_IMPACT_TAG: {
-                                int ret;
-                                idmef_impact_t *tmp = NULL;
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                                ret = idmef_assessment_new_impact(assessment, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = idmef_alert_read_child(alert, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
+        return 0;
+}
 
+static int idmef_heartbeat_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_heartbeat_t *heartbeat = object;
 
-                                ret = idmef_impact_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        switch ( tag ) {
 
-                                break;
-                        }
+                case IDMEF_MSG_HEARTBEAT_MESSAGEID: {
+                        prelude_string_t *tmp = NULL;
 
-                        case IDMEF_MSG_ACTION_TAG: {
-                                int ret;
-                                idmef_action_t *tmp = NULL;
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_assessment_new_action(assessment, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_heartbeat_set_messageid(heartbeat, tmp);
+                        break;
+                }
 
+                case IDMEF_MSG_ANALYZER_TAG: {
+                        idmef_analyzer_t *tmp = NULL;
 
+                        ret = idmef_heartbeat_new_analyzer(heartbeat, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_action_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                break;
-                        }
 
-                        case IDMEF_MSG_CONFIDENCE_TAG: {
-                                int ret;
-                                idmef_confidence_t *tmp = NULL;
+                        ret = idmef_analyzer_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_assessment_new_confidence(assessment, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                        break;
+                }
 
+                case IDMEF_MSG_HEARTBEAT_CREATE_TIME: {
+                        idmef_time_t *tmp = NULL;
 
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = idmef_confidence_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        idmef_heartbeat_set_create_time(heartbeat, tmp);
+                        break;
+                }
 
-                                break;
-                        }
+                case IDMEF_MSG_HEARTBEAT_ANALYZER_TIME: {
+                        idmef_time_t *tmp = NULL;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                        ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_assessment_t: '%u'", tag);
+                        idmef_heartbeat_set_analyzer_time(heartbeat, tmp);
+                        break;
                 }
 
-        }
-
-        return 0;
-}
+                case IDMEF_MSG_HEARTBEAT_HEARTBEAT_INTERVAL: {
+                        uint32_t tmp = 0;
 
-/**
- * idmef_tool_alert_read:
- * @tool_alert: Pointer to a #idmef_tool_alert_t object.
- * @msg: Pointer to a #prelude_msg_t object, containing a message.
- *
- * Read an idmef_tool_alert from the @msg message, and
- * store it into @tool_alert.
- *
- * Returns: 0 on success, a negative value if an error occured.
- */
-int idmef_tool_alert_read(idmef_tool_alert_t *tool_alert, prelude_msg_t *msg)
-{
-        int ret;
-        void *buf;
-        uint8_t tag;
-        uint32_t len;
+                        ret = prelude_extract_uint32_safe(&tmp, buf, len);
+                        if ( ret < 0 )
+                                return ret;
 
-        while ( 1 ) {
-                ret = prelude_msg_get(msg, &tag, &len, &buf);
-                if ( ret < 0 )
-                        return ret;
+                        idmef_heartbeat_set_heartbeat_interval(heartbeat, tmp);
+                        break;
+                }
 
-                switch ( tag ) {
+                case IDMEF_MSG_ADDITIONAL_DATA_TAG: {
+                        idmef_additional_data_t *tmp = NULL;
 
-                        case IDMEF_MSG_TOOL_ALERT_NAME: {
-                                prelude_string_t *tmp = NULL;
+                        ret = idmef_heartbeat_new_additional_data(heartbeat, &tmp, -1);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_tool_alert_set_name(tool_alert, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_TOOL_ALERT_COMMAND: {
-                                prelude_string_t *tmp = NULL;
+                        ret = idmef_additional_data_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                        break;
+                }
 
-                                idmef_tool_alert_set_command(tool_alert, tmp);
-                                break;
-                        }
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_heartbeat_t: '%u'", tag);
+        }
 
-                        case IDMEF_MSG_ALERTIDENT_TAG: {
-                                int ret;
-                                idmef_alertident_t *tmp = NULL;
+        return 0;
+}
 
-                                ret = idmef_tool_alert_new_alertident(tool_alert, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
 
+static const uint8_t idmef_heartbeat_child_tags[] = {
+        IDMEF_MSG_HEARTBEAT_MESSAGEID,
+        IDMEF_MSG_ANALYZER_TAG,
+        IDMEF_MSG_HEARTBEAT_CREATE_TIME,
+        IDMEF_MSG_HEARTBEAT_ANALYZER_TIME,
+        IDMEF_MSG_HEARTBEAT_HEARTBEAT_INTERVAL,
+        IDMEF_MSG_ADDITIONAL_DATA_TAG,
+};
 
 
-                                ret = idmef_alertident_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+static const idmef_read_class_t idmef_heartbeat_read_class = {
+        "idmef_heartbeat_t",
+        idmef_heartbeat_read_child,
+        sizeof(idmef_heartbeat_child_tags),
+        idmef_heartbeat_child_tags
+};
 
-                                break;
-                        }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+/*
+ * Index the children of @heartbeat without decoding them:
+ * they are decoded when first accessed.
+ */
+static int idmef_heartbeat_index(idmef_heartbeat_t *heartbeat, prelude_msg_t *msg)
+{
+        int ret;
+        idmef_lazy_t *lazy;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_tool_alert_t: '%u'", tag);
-                }
+        ret = lazy_new(&lazy, &idmef_heartbeat_read_class, msg);
+        if ( ret < 0 )
+                return ret;
 
-        }
+        _idmef_heartbeat_set_lazy(heartbeat, lazy);
 
         return 0;
 }
 
 /**
- * idmef_correlation_alert_read:
- * @correlation_alert: Pointer to a #idmef_correlation_alert_t object.
+ * idmef_heartbeat_read:
+ * @heartbeat: Pointer to a #idmef_heartbeat_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_correlation_alert from the @msg message, and
- * store it into @correlation_alert.
+ * Read an idmef_heartbeat from the @msg message, and
+ * store it into @heartbeat.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_correlation_alert_read(idmef_correlation_alert_t *correlation_alert, prelude_msg_t *msg)
+int idmef_heartbeat_read(idmef_heartbeat_t *heartbeat, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -2674,59 +4265,101 @@ int idmef_correlation_alert_read(idmef_correlation_alert_t *correlation_alert, p
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_CORRELATION_ALERT_NAME: {
-                                prelude_string_t *tmp = NULL;
+                ret = idmef_heartbeat_read_child(heartbeat, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                idmef_correlation_alert_set_name(correlation_alert, tmp);
-                                break;
-                        }
+static int idmef_message_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+{
+        int ret;
+        idmef_message_t *message = object;
 
-                        case IDMEF_MSG_ALERTIDENT_TAG: {
-                                int ret;
-                                idmef_alertident_t *tmp = NULL;
+        switch ( tag ) {
 
-                                ret = idmef_correlation_alert_new_alertident(correlation_alert, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_MESSAGE_VERSION: {
+                        prelude_string_t *tmp = NULL;
 
+                        ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                        if ( ret < 0 )
+                                return ret;
 
+                        idmef_message_set_version(message, tmp);
+                        break;
+                }
 
-                                ret = idmef_alertident_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_MSG_ALERT_TAG: {
+                        idmef_alert_t *tmp = NULL;
 
-                                break;
-                        }
+                        ret = idmef_message_new_alert(message, &tmp);
+                        if ( ret < 0 )
+                                return ret;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_correlation_alert_t: '%u'", tag);
+
+                        ret = idmef_alert_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
+                }
+
+                case IDMEF_MSG_HEARTBEAT_TAG: {
+                        idmef_heartbeat_t *tmp = NULL;
+
+                        ret = idmef_message_new_heartbeat(message, &tmp);
+                        if ( ret < 0 )
+                                return ret;
+
+
+
+                        ret = idmef_heartbeat_read(tmp, msg);
+                        if ( ret < 0 )
+                                return ret;
+
+                        break;
                 }
 
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_message_t: '%u'", tag);
         }
 
         return 0;
 }
 
+
+static const uint8_t idmef_message_child_tags[] = {
+        IDMEF_MSG_MESSAGE_VERSION,
+        IDMEF_MSG_ALERT_TAG,
+        IDMEF_MSG_HEARTBEAT_TAG,
+        IDMEF_MSG_END_OF_TAG,
+};
+
+
+static const idmef_read_class_t idmef_message_read_class = {
+        "idmef_message_t",
+        idmef_message_read_child,
+        sizeof(idmef_message_child_tags),
+        idmef_message_child_tags
+};
+
 /**
- * idmef_overflow_alert_read:
- * @overflow_alert: Pointer to a #idmef_overflow_alert_t object.
+ * idmef_message_read:
+ * @message: Pointer to a #idmef_message_t object.
  * @msg: Pointer to a #prelude_msg_t object, containing a message.
  *
- * Read an idmef_overflow_alert from the @msg message, and
- * store it into @overflow_alert.
+ * Read an idmef_message from the @msg message, and
+ * store it into @message.
  *
  * Returns: 0 on success, a negative value if an error occured.
  */
-int idmef_overflow_alert_read(idmef_overflow_alert_t *overflow_alert, prelude_msg_t *msg)
+int idmef_message_read(idmef_message_t *message, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -2738,64 +4371,19 @@ int idmef_overflow_alert_read(idmef_overflow_alert_t *overflow_alert, prelude_ms
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
-
-                        case IDMEF_MSG_OVERFLOW_ALERT_PROGRAM: {
-                                prelude_string_t *tmp = NULL;
-
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_overflow_alert_set_program(overflow_alert, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_OVERFLOW_ALERT_SIZE: {
-                                uint32_t tmp = 0;
-
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_overflow_alert_set_size(overflow_alert, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_OVERFLOW_ALERT_BUFFER: {
-                                idmef_data_t *tmp = NULL;
-
-                                ret = prelude_extract_data_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_overflow_alert_set_buffer(overflow_alert, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
-
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_overflow_alert_t: '%u'", tag);
-                }
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
+                ret = idmef_message_read_child(message, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
         }
 
         return 0;
 }
 
-/**
- * idmef_alert_read:
- * @alert: Pointer to a #idmef_alert_t object.
- * @msg: Pointer to a #prelude_msg_t object, containing a message.
- *
- * Read an idmef_alert from the @msg message, and
- * store it into @alert.
- *
- * Returns: 0 on success, a negative value if an error occured.
- */
-int idmef_alert_read(idmef_alert_t *alert, prelude_msg_t *msg)
+
+static int idmef_message_read_index(idmef_message_t *message, prelude_msg_t *msg)
 {
         int ret;
         void *buf;
@@ -2809,406 +4397,485 @@ int idmef_alert_read(idmef_alert_t *alert, prelude_msg_t *msg)
 
                 switch ( tag ) {
 
-                        case IDMEF_MSG_ALERT_MESSAGEID: {
+                        case IDMEF_MSG_MESSAGE_VERSION: {
                                 prelude_string_t *tmp = NULL;
 
                                 ret = prelude_extract_string_safe(&tmp, buf, len, msg);
                                 if ( ret < 0 )
                                         return ret;
 
-                                idmef_alert_set_messageid(alert, tmp);
-                                break;
-                        }
-
-                        case IDMEF_MSG_ANALYZER_TAG: {
-                                int ret;
-                                idmef_analyzer_t *tmp = NULL;
-
-                                ret = idmef_alert_new_analyzer(alert, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
-
-
-
-                                ret = idmef_analyzer_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                break;
-                        }
-
-                        case IDMEF_MSG_ALERT_CREATE_TIME: {
-                                idmef_time_t *tmp = NULL;
-
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
-
-                                idmef_alert_set_create_time(alert, tmp);
+                                idmef_message_set_version(message, tmp);
                                 break;
                         }
 
-                        case IDMEF_MSG_CLASSIFICATION_TAG: {
-                                int ret;
-                                idmef_classification_t *tmp = NULL;
+                        case IDMEF_MSG_ALERT_TAG: {
+                                idmef_alert_t *tmp = NULL;
 
-                                ret = idmef_alert_new_classification(alert, &tmp);
+                                ret = idmef_message_new_alert(message, &tmp);
                                 if ( ret < 0 )
                                         return ret;
 
 
 
-                                ret = idmef_classification_read(tmp, msg);
+                                ret = idmef_alert_index(tmp, msg);
                                 if ( ret < 0 )
                                         return ret;
 
                                 break;
                         }
 
-                        case IDMEF_MSG_ALERT_DETECT_TIME: {
-                                idmef_time_t *tmp = NULL;
+                        case IDMEF_MSG_HEARTBEAT_TAG: {
+                                idmef_heartbeat_t *tmp = NULL;
 
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                                ret = idmef_message_new_heartbeat(message, &tmp);
                                 if ( ret < 0 )
                                         return ret;
 
-                                idmef_alert_set_detect_time(alert, tmp);
-                                break;
-                        }
 
-                        case IDMEF_MSG_ALERT_ANALYZER_TIME: {
-                                idmef_time_t *tmp = NULL;
 
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
+                                ret = idmef_heartbeat_index(tmp, msg);
                                 if ( ret < 0 )
                                         return ret;
 
-                                idmef_alert_set_analyzer_time(alert, tmp);
                                 break;
                         }
 
-                        case IDMEF_MSG_SOURCE_TAG: {
-                                int ret;
-                                idmef_source_t *tmp = NULL;
-
-                                ret = idmef_alert_new_source(alert, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+                        case IDMEF_MSG_END_OF_TAG:
+                                return 0;
 
+                        default:
+                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_message_t: '%u'", tag);
+                }
 
+        }
 
-                                ret = idmef_source_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        return 0;
+}
 
-                                break;
-                        }
 
-                        case IDMEF_MSG_TARGET_TAG: {
-                                int ret;
-                                idmef_target_t *tmp = NULL;
+/**
+ * idmef_message_read_borrowed:
+ * @message: Pointer where to store the created #idmef_message_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Create a new #idmef_message_t object, and read it from the @msg message.
+ *
+ * Unlike idmef_message_read(), the created message and all of its children
+ * are carved out of a single memory arena, and strings reference the @msg
+ * payload rather than being copied. The arena is released at once when the
+ * message, and any of its objects that was referenced on its own, are destroyed.
+ *
+ * This is an opt-in alternative to idmef_message_read(), meant for consumers
+ * handling each message as a whole: a single object of the message kept
+ * with its own reference holds the whole arena, and the @msg payload, in memory.
+ *
+ * On success, @msg is attached to the created message (see idmef_message_set_pmsg()).
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_message_read_borrowed(idmef_message_t **message, prelude_msg_t *msg)
+{
+        int ret;
+        prelude_arena_t *arena, *prev;
 
-                                ret = idmef_alert_new_target(alert, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+        /*
+         * The decoded tree is usually a few times bigger than its wire
+         * representation: size the initial arena chunk accordingly.
+         */
+        ret = _prelude_arena_new(&arena, prelude_msg_get_datalen(msg) * 4);
+        if ( ret < 0 )
+                return ret;
 
+        _prelude_arena_set_msg(arena, msg);
+        prev = _prelude_arena_set_current(arena);
 
+        ret = idmef_message_new(message);
+        if ( ret == 0 ) {
+                ret = idmef_message_read(*message, msg);
+                if ( ret < 0 )
+                        idmef_message_destroy(*message);
+                else
+                        idmef_message_set_pmsg(*message, msg);
+        }
 
-                                ret = idmef_target_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        _prelude_arena_set_current(prev);
+        _prelude_arena_destroy(arena);
 
-                                break;
-                        }
+        return ret;
+}
 
-                        case IDMEF_MSG_ASSESSMENT_TAG: {
-                                int ret;
-                                idmef_assessment_t *tmp = NULL;
 
-                                ret = idmef_alert_new_assessment(alert, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
 
+/**
+ * idmef_message_read_lazy:
+ * @message: Pointer where to store the created #idmef_message_t object.
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Same as idmef_message_read_borrowed(), except that the children of the
+ * alert or heartbeat contained in @msg are only indexed: each of them is
+ * decoded the first time it is accessed, through the accessor functions
+ * or idmef_path_get(). Consumers that only look at a few fields of each
+ * message thus avoid decoding the rest of it.
+ *
+ * The framing of @msg is checked here, but the content of a child only
+ * once it is decoded: if this fails, idmef_path_get() returns the error
+ * for any field of the alert or heartbeat from then on.
+ *
+ * Decoding is serialized, so that a lazily read message can be read from
+ * several threads at once. It should not be modified concurrently though.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_message_read_lazy(idmef_message_t **message, prelude_msg_t *msg)
+{
+        int ret;
+        prelude_arena_t *arena, *prev;
 
+        ret = _prelude_arena_new(&arena, prelude_msg_get_datalen(msg));
+        if ( ret < 0 )
+                return ret;
 
-                                ret = idmef_assessment_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        _prelude_arena_set_msg(arena, msg);
+        prev = _prelude_arena_set_current(arena);
 
-                                break;
-                        }
+        ret = idmef_message_new(message);
+        if ( ret == 0 ) {
+                ret = idmef_message_read_index(*message, msg);
+                if ( ret < 0 )
+                        idmef_message_destroy(*message);
+                else
+                        idmef_message_set_pmsg(*message, msg);
+        }
 
-                        case IDMEF_MSG_ADDITIONAL_DATA_TAG: {
-                                int ret;
-                                idmef_additional_data_t *tmp = NULL;
+        _prelude_arena_set_current(prev);
+        _prelude_arena_destroy(arena);
 
-                                ret = idmef_alert_new_additional_data(alert, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+        return ret;
+}
 
 
 
-                                ret = idmef_additional_data_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                break;
-                        }
+static const idmef_read_class_t *get_read_class(idmef_class_id_t class)
+{
+        switch ( class ) {
+                case IDMEF_CLASS_ID_ADDITIONAL_DATA:
+                        return &idmef_additional_data_read_class;
 
-                        case IDMEF_MSG_TOOL_ALERT_TAG: {
-                                int ret;
-                                idmef_tool_alert_t *tmp = NULL;
+                case IDMEF_CLASS_ID_REFERENCE:
+                        return &idmef_reference_read_class;
 
-                                ret = idmef_alert_new_tool_alert(alert, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_CLASS_ID_CLASSIFICATION:
+                        return &idmef_classification_read_class;
 
+                case IDMEF_CLASS_ID_USER_ID:
+                        return &idmef_user_id_read_class;
 
+                case IDMEF_CLASS_ID_USER:
+                        return &idmef_user_read_class;
 
-                                ret = idmef_tool_alert_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_CLASS_ID_ADDRESS:
+                        return &idmef_address_read_class;
 
-                                break;
-                        }
+                case IDMEF_CLASS_ID_PROCESS:
+                        return &idmef_process_read_class;
 
-                        case IDMEF_MSG_CORRELATION_ALERT_TAG: {
-                                int ret;
-                                idmef_correlation_alert_t *tmp = NULL;
+                case IDMEF_CLASS_ID_WEB_SERVICE:
+                        return &idmef_web_service_read_class;
 
-                                ret = idmef_alert_new_correlation_alert(alert, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_CLASS_ID_SNMP_SERVICE:
+                        return &idmef_snmp_service_read_class;
 
+                case IDMEF_CLASS_ID_SERVICE:
+                        return &idmef_service_read_class;
 
+                case IDMEF_CLASS_ID_NODE:
+                        return &idmef_node_read_class;
 
-                                ret = idmef_correlation_alert_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_CLASS_ID_SOURCE:
+                        return &idmef_source_read_class;
 
-                                break;
-                        }
+                case IDMEF_CLASS_ID_FILE_ACCESS:
+                        return &idmef_file_access_read_class;
 
-                        case IDMEF_MSG_OVERFLOW_ALERT_TAG: {
-                                int ret;
-                                idmef_overflow_alert_t *tmp = NULL;
+                case IDMEF_CLASS_ID_INODE:
+                        return &idmef_inode_read_class;
 
-                                ret = idmef_alert_new_overflow_alert(alert, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_CLASS_ID_CHECKSUM:
+                        return &idmef_checksum_read_class;
 
+                case IDMEF_CLASS_ID_FILE:
+                        return &idmef_file_read_class;
 
+                case IDMEF_CLASS_ID_LINKAGE:
+                        return &idmef_linkage_read_class;
 
-                                ret = idmef_overflow_alert_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_CLASS_ID_TARGET:
+                        return &idmef_target_read_class;
 
-                                break;
-                        }
+                case IDMEF_CLASS_ID_ANALYZER:
+                        return &idmef_analyzer_read_class;
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+                case IDMEF_CLASS_ID_ALERTIDENT:
+                        return &idmef_alertident_read_class;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_alert_t: '%u'", tag);
-                }
+                case IDMEF_CLASS_ID_IMPACT:
+                        return &idmef_impact_read_class;
 
-        }
+                case IDMEF_CLASS_ID_ACTION:
+                        return &idmef_action_read_class;
 
-        return 0;
-}
+                case IDMEF_CLASS_ID_CONFIDENCE:
+                        return &idmef_confidence_read_class;
 
-/**
- * idmef_heartbeat_read:
- * @heartbeat: Pointer to a #idmef_heartbeat_t object.
- * @msg: Pointer to a #prelude_msg_t object, containing a message.
- *
- * Read an idmef_heartbeat from the @msg message, and
- * store it into @heartbeat.
- *
- * Returns: 0 on success, a negative value if an error occured.
- */
-int idmef_heartbeat_read(idmef_heartbeat_t *heartbeat, prelude_msg_t *msg)
-{
-        int ret;
-        void *buf;
-        uint8_t tag;
-        uint32_t len;
+                case IDMEF_CLASS_ID_ASSESSMENT:
+                        return &idmef_assessment_read_class;
 
-        while ( 1 ) {
-                ret = prelude_msg_get(msg, &tag, &len, &buf);
-                if ( ret < 0 )
-                        return ret;
+                case IDMEF_CLASS_ID_TOOL_ALERT:
+                        return &idmef_tool_alert_read_class;
 
-                switch ( tag ) {
+                case IDMEF_CLASS_ID_CORRELATION_ALERT:
+                        return &idmef_correlation_alert_read_class;
 
-                        case IDMEF_MSG_HEARTBEAT_MESSAGEID: {
-                                prelude_string_t *tmp = NULL;
+                case IDMEF_CLASS_ID_OVERFLOW_ALERT:
+                        return &idmef_overflow_alert_read_class;
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                case IDMEF_CLASS_ID_ALERT:
+                        return &idmef_alert_read_class;
 
-                                idmef_heartbeat_set_messageid(heartbeat, tmp);
-                                break;
-                        }
+                case IDMEF_CLASS_ID_HEARTBEAT:
+                        return &idmef_heartbeat_read_class;
 
-                        case IDMEF_MSG_ANALYZER_TAG: {
-                                int ret;
-                                idmef_analyzer_t *tmp = NULL;
+                case IDMEF_CLASS_ID_MESSAGE:
+                        return &idmef_message_read_class;
 
-                                ret = idmef_heartbeat_new_analyzer(heartbeat, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
+                default:
+                        return NULL;
+        }
+}
 
 
 
-                                ret = idmef_analyzer_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+typedef enum {
+        READ_PATHS_SKIP,
+        READ_PATHS_PARTIAL,
+        READ_PATHS_FULL
+} read_paths_action_t;
 
-                                break;
-                        }
 
-                        case IDMEF_MSG_HEARTBEAT_CREATE_TIME: {
-                                idmef_time_t *tmp = NULL;
+typedef struct {
+        prelude_msg_t *msg;
 
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        size_t count;
+        idmef_path_t * const *path;
 
-                                idmef_heartbeat_set_create_time(heartbeat, tmp);
-                                break;
-                        }
+        /*
+         * Child ids leading to the object being read, paths are at most 16 elements deep.
+         */
+        idmef_class_child_id_t route[16];
+} read_paths_t;
 
-                        case IDMEF_MSG_HEARTBEAT_ANALYZER_TIME: {
-                                idmef_time_t *tmp = NULL;
 
-                                ret = prelude_extract_time_safe(&tmp, buf, len, msg);
-                                if ( ret < 0 )
-                                        return ret;
 
-                                idmef_heartbeat_set_analyzer_time(heartbeat, tmp);
-                                break;
-                        }
+static int skip_object(prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+        unsigned int depth = 0;
 
-                        case IDMEF_MSG_HEARTBEAT_HEARTBEAT_INTERVAL: {
-                                uint32_t tmp = 0;
+        while ( 1 ) {
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
 
-                                ret = prelude_extract_uint32_safe(&tmp, buf, len);
-                                if ( ret < 0 )
-                                        return ret;
+                if ( tag == IDMEF_MSG_END_OF_TAG ) {
+                        if ( depth == 0 )
+                                return 0;
 
-                                idmef_heartbeat_set_heartbeat_interval(heartbeat, tmp);
-                                break;
-                        }
+                        depth--;
+                }
 
-                        case IDMEF_MSG_ADDITIONAL_DATA_TAG: {
-                                int ret;
-                                idmef_additional_data_t *tmp = NULL;
+                else if ( is_class_tag(tag) )
+                        depth++;
+        }
+}
 
-                                ret = idmef_heartbeat_new_additional_data(heartbeat, &tmp, -1);
-                                if ( ret < 0 )
-                                        return ret;
 
 
+/*
+ * Whether @child, found at @depth below the current route, is needed by
+ * one of the requested paths: either as a whole, or because one of its own
+ * children is.
+ */
+static read_paths_action_t read_paths_get_action(read_paths_t *rp, unsigned int depth, idmef_class_child_id_t child)
+{
+        size_t i;
+        unsigned int j, pdepth;
+        const char *key;
+        read_paths_action_t action = READ_PATHS_SKIP;
 
-                                ret = idmef_additional_data_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        for ( i = 0; i < rp->count && action != READ_PATHS_FULL; i++ ) {
+                pdepth = idmef_path_get_depth(rp->path[i]);
+                if ( pdepth <= depth || _idmef_path_get_position(rp->path[i], depth) != child )
+                        continue;
 
+                for ( j = 0; j < depth; j++ ) {
+                        if ( _idmef_path_get_position(rp->path[i], j) != rp->route[j] )
                                 break;
-                        }
-
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
-
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_heartbeat_t: '%u'", tag);
                 }
 
+                if ( j < depth )
+                        continue;
+
+                /*
+                 * Keyed list elements are matched on the decoded key.
+                 */
+                if ( pdepth == depth + 1 || depth + 1 >= sizeof(rp->route) / sizeof(*rp->route) ||
+                     idmef_path_get_key(rp->path[i], depth, &key) == 0 )
+                        action = READ_PATHS_FULL;
+                else
+                        action = READ_PATHS_PARTIAL;
         }
 
-        return 0;
+        return action;
 }
 
-/**
- * idmef_message_read:
- * @message: Pointer to a #idmef_message_t object.
- * @msg: Pointer to a #prelude_msg_t object, containing a message.
- *
- * Read an idmef_message from the @msg message, and
- * store it into @message.
- *
- * Returns: 0 on success, a negative value if an error occured.
- */
-int idmef_message_read(idmef_message_t *message, prelude_msg_t *msg)
+
+
+static int read_paths_object(read_paths_t *rp, unsigned int depth, idmef_class_id_t class, void *object)
 {
         int ret;
-        void *buf;
+        void *buf, *child;
         uint8_t tag;
         uint32_t len;
+        size_t i;
+        read_paths_action_t action;
+        const idmef_read_class_t *rclass = get_read_class(class);
 
         while ( 1 ) {
-                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                ret = prelude_msg_get(rp->msg, &tag, &len, &buf);
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) {
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
 
-                        case IDMEF_MSG_MESSAGE_VERSION: {
-                                prelude_string_t *tmp = NULL;
+                for ( i = 0; i < rclass->child_count && rclass->child_tag[i] != tag; i++ );
 
-                                ret = prelude_extract_string_safe(&tmp, buf, len, msg);
+                if ( i == rclass->child_count )
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading %s: '%u'", rclass->name, tag);
+
+                action = read_paths_get_action(rp, depth, i);
+                if ( action == READ_PATHS_SKIP ) {
+                        /*
+                         * idmef_data_t values span two entries with the same
+                         * tag: the second one is skipped the same way.
+                         */
+                        if ( is_class_tag(tag) ) {
+                                ret = skip_object(rp->msg);
                                 if ( ret < 0 )
                                         return ret;
-
-                                idmef_message_set_version(message, tmp);
-                                break;
                         }
 
-                        case IDMEF_MSG_ALERT_TAG: {
-                                int ret;
-                                idmef_alert_t *tmp = NULL;
+                        continue;
+                }
 
-                                ret = idmef_message_new_alert(message, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+                if ( action == READ_PATHS_FULL || ! is_class_tag(tag) ) {
+                        ret = rclass->read_child(object, rp->msg, tag, len, buf);
+                        if ( ret < 0 )
+                                return ret;
+
+                        continue;
+                }
 
+                ret = idmef_class_new_child(object, class, i, IDMEF_LIST_APPEND, &child);
+                if ( ret < 0 )
+                        return ret;
 
+                rp->route[depth] = i;
 
-                                ret = idmef_alert_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+                ret = read_paths_object(rp, depth + 1, idmef_class_get_child_class(class, i), child);
+                if ( ret < 0 )
+                        return ret;
+        }
+}
 
-                                break;
-                        }
 
-                        case IDMEF_MSG_HEARTBEAT_TAG: {
-                                int ret;
-                                idmef_heartbeat_t *tmp = NULL;
 
-                                ret = idmef_message_new_heartbeat(message, &tmp);
-                                if ( ret < 0 )
-                                        return ret;
+/**
+ * idmef_message_read_paths:
+ * @msg: Pointer to a #prelude_msg_t object, containing a message.
+ * @paths: Array of #idmef_path_t objects, relative to the message root.
+ * @count: Number of elements in @paths.
+ * @values: Array of @count elements where to store the retrieved values.
+ *
+ * Retrieve the values of @paths from the message contained in @msg,
+ * without decoding the whole message: the message is scanned once, and
+ * the objects that are not on the way to one of @paths are skipped
+ * without being decoded.
+ *
+ * For each path, @values is set the same way idmef_path_get() would on
+ * the fully decoded message, or to NULL if the path is not set.
+ *
+ * Returns: the number of paths that were found in @msg, or a negative value if an error occured.
+ */
+int idmef_message_read_paths(prelude_msg_t *msg, idmef_path_t * const *paths, size_t count, idmef_value_t **values)
+{
+        int ret, found = 0;
+        size_t i;
+        read_paths_t rp;
+        idmef_message_t *message;
+        prelude_arena_t *arena, *prev;
 
+        rp.msg = msg;
+        rp.path = paths;
+        rp.count = count;
 
+        ret = _prelude_arena_new(&arena, prelude_msg_get_datalen(msg));
+        if ( ret < 0 )
+                return ret;
 
-                                ret = idmef_heartbeat_read(tmp, msg);
-                                if ( ret < 0 )
-                                        return ret;
+        _prelude_arena_set_msg(arena, msg);
+        prev = _prelude_arena_set_current(arena);
 
-                                break;
-                        }
+        ret = idmef_message_new(&message);
+        if ( ret == 0 ) {
+                ret = read_paths_object(&rp, 0, IDMEF_CLASS_ID_MESSAGE, message);
+                if ( ret < 0 )
+                        idmef_message_destroy(message);
+        }
 
-                        case IDMEF_MSG_END_OF_TAG:
-                                return 0;
+        _prelude_arena_set_current(prev);
+        _prelude_arena_destroy(arena);
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, "Unknown tag while reading idmef_message_t: '%u'", tag);
-                }
+        if ( ret < 0 )
+                return ret;
+
+        /*
+         * Values reference the decoded objects, which remain valid until
+         * the last value is destroyed.
+         */
+        for ( i = 0; i < count; i++ ) {
+                values[i] = NULL;
+
+                ret = idmef_path_get(paths[i], message, &values[i]);
+                if ( ret < 0 )
+                        break;
 
+                if ( ret > 0 )
+                        found++;
         }
 
-        return 0;
+        if ( ret < 0 ) {
+                while ( i-- > 0 ) {
+                        if ( values[i] )
+                                idmef_value_destroy(values[i]);
+                }
+        }
+
+        idmef_message_destroy(message);
+
+        return ( ret < 0 ) ? ret : found;
 }
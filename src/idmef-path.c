@@ -1546,6 +1546,16 @@ const char *idmef_path_get_name(const idmef_path_t *path, int depth)
 
 
 
+/*
+ * Child id, within its parent class, of the element of @path located at @depth.
+ */
+idmef_class_child_id_t _idmef_path_get_position(const idmef_path_t *path, unsigned int depth)
+{
+        return path->elem[depth].position;
+}
+
+
+
 void _idmef_path_cache_lock(void)
 {
         gl_lock_lock(cached_path_mutex);
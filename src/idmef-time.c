@@ -58,6 +58,7 @@
 #include "prelude-log.h"
 #include "common.h"
 #include "idmef-time.h"
+#include "prelude-arena.h"
 
 
 static char *parse_time_ymd(struct tm *tm, const char *buf)
@@ -258,7 +259,7 @@ int idmef_time_new_from_string(idmef_time_t **time, const char *buf)
 
         ret = idmef_time_set_from_string(*time, buf);
         if ( ret < 0 ) {
-                free(*time);
+                idmef_time_destroy(*time);
                 return ret;
         }
 
@@ -402,7 +403,7 @@ int idmef_time_new_from_ntpstamp(idmef_time_t **time, const char *buf)
 
         ret = idmef_time_set_from_ntpstamp(*time, buf);
         if ( ret < 0 ) {
-                free(*time);
+                idmef_time_destroy(*time);
                 return ret;
         }
 
@@ -543,7 +544,7 @@ idmef_time_t *idmef_time_ref(idmef_time_t *time)
  */
 int idmef_time_new(idmef_time_t **time)
 {
-        *time = calloc(1, sizeof(**time));
+        *time = _prelude_object_calloc(sizeof(**time));
         if ( ! *time )
                 return prelude_error_from_errno(errno);
 
@@ -781,7 +782,7 @@ void idmef_time_destroy(idmef_time_t *time)
         if ( --time->refcount )
                 return;
 
-        free(time);
+        _prelude_object_free(time);
 }
 
 
@@ -46,6 +46,8 @@
 #include "idmef-class.h"
 #include "idmef-value.h"
 #include "idmef-object-prv.h"
+#include "prelude-arena.h"
+#include "idmef-lazy.h"
 
 #include "idmef-tree-wrap.h"
 #include "libmissing.h"
@@ -77,6 +79,36 @@
 #define HIDE(type, name) type name
 
 #define REFCOUNT int refcount
+#define LAZY_DECODE idmef_lazy_t *lazy
+
+/*
+ * Decode the given child of a lazily read object, or all of them with -1.
+ */
+#define LAZY_LOAD(ptr, child) do {                                      \
+        if ( (ptr)->lazy )                                              \
+                _idmef_lazy_load((ptr)->lazy, (void *) (ptr), (child)); \
+} while (0)
+
+/*
+ * Decode all the children of a const object, as copy and compare do:
+ * this fills the object in without changing what it holds, and decoding
+ * is serialized by the index, so that the object can be shared.
+ */
+static inline void lazy_load_ro(idmef_lazy_t *lazy, const void *object)
+{
+        union {
+                void *rw;
+                const void *ro;
+        } obj;
+
+        obj.ro = object;
+
+        if ( lazy )
+                _idmef_lazy_load(lazy, obj.rw, -1);
+}
+
+#define LAZY_LOAD_RO(ptr) lazy_load_ro((ptr)->lazy, (ptr))
+
 #define REQUIRED(type, name) type name
 #define IGNORED(type, name) type name
 
@@ -1804,6 +1836,7 @@ struct idmef_alert {
  
          IDMEF_OBJECT;
          REFCOUNT;
+         LAZY_DECODE;
          prelude_string_t *messageid;
  
          LISTED_OBJECT(analyzer_list, idmef_analyzer_t);
@@ -1835,6 +1868,7 @@ struct idmef_heartbeat {
  
          IDMEF_OBJECT;
          REFCOUNT;
+         LAZY_DECODE;
  
          prelude_string_t *messageid;
          LISTED_OBJECT(analyzer_list, idmef_analyzer_t);
@@ -1928,7 +1962,7 @@ struct idmef_message {
  */
 int idmef_additional_data_new(idmef_additional_data_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -2083,7 +2117,7 @@ void idmef_additional_data_destroy(idmef_additional_data_t *ptr)
                 return;
 
         idmef_additional_data_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -2138,7 +2172,11 @@ int idmef_additional_data_new_meaning(idmef_additional_data_t *ptr, prelude_stri
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->meaning ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->meaning);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -2251,7 +2289,11 @@ int idmef_additional_data_new_data(idmef_additional_data_t *ptr, idmef_data_t **
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->data ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_data_new(&ptr->data);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -2365,7 +2407,7 @@ int idmef_additional_data_compare(const idmef_additional_data_t *obj1, const idm
  */
 int idmef_reference_new(idmef_reference_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -2548,7 +2590,7 @@ void idmef_reference_destroy(idmef_reference_t *ptr)
                 return;
 
         idmef_reference_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -2652,7 +2694,11 @@ int idmef_reference_new_name(idmef_reference_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -2713,7 +2759,11 @@ int idmef_reference_new_url(idmef_reference_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->url ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->url);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -2774,7 +2824,11 @@ int idmef_reference_new_meaning(idmef_reference_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->meaning ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->meaning);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -2898,7 +2952,7 @@ int idmef_reference_compare(const idmef_reference_t *obj1, const idmef_reference
  */
 int idmef_classification_new(idmef_classification_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -3120,7 +3174,7 @@ void idmef_classification_destroy(idmef_classification_t *ptr)
                 return;
 
         idmef_classification_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -3175,7 +3229,11 @@ int idmef_classification_new_ident(idmef_classification_t *ptr, prelude_string_t
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -3236,7 +3294,11 @@ int idmef_classification_new_text(idmef_classification_t *ptr, prelude_string_t
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->text ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->text);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -3310,10 +3372,14 @@ void idmef_classification_set_reference(idmef_classification_t *ptr, idmef_refer
 int idmef_classification_new_reference(idmef_classification_t *ptr, idmef_reference_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_reference_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -3464,7 +3530,7 @@ int idmef_classification_compare(const idmef_classification_t *obj1, const idmef
  */
 int idmef_user_id_new(idmef_user_id_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -3637,7 +3703,7 @@ void idmef_user_id_destroy(idmef_user_id_t *ptr)
                 return;
 
         idmef_user_id_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -3692,7 +3758,11 @@ int idmef_user_id_new_ident(idmef_user_id_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -3802,7 +3872,11 @@ int idmef_user_id_new_tty(idmef_user_id_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->tty ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->tty);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -3863,7 +3937,11 @@ int idmef_user_id_new_name(idmef_user_id_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -4066,7 +4144,7 @@ int idmef_user_id_compare(const idmef_user_id_t *obj1, const idmef_user_id_t *ob
  */
 int idmef_user_new(idmef_user_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -4271,7 +4349,7 @@ void idmef_user_destroy(idmef_user_t *ptr)
                 return;
 
         idmef_user_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -4326,7 +4404,11 @@ int idmef_user_new_ident(idmef_user_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -4449,10 +4531,14 @@ void idmef_user_set_user_id(idmef_user_t *ptr, idmef_user_id_t *object, int pos)
 int idmef_user_new_user_id(idmef_user_t *ptr, idmef_user_id_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_user_id_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -4598,7 +4684,7 @@ int idmef_user_compare(const idmef_user_t *obj1, const idmef_user_t *obj2)
  */
 int idmef_address_new(idmef_address_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -4799,7 +4885,7 @@ void idmef_address_destroy(idmef_address_t *ptr)
                 return;
 
         idmef_address_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -4854,7 +4940,11 @@ int idmef_address_new_ident(idmef_address_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -4964,7 +5054,11 @@ int idmef_address_new_vlan_name(idmef_address_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->vlan_name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->vlan_name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -5084,7 +5178,11 @@ int idmef_address_new_address(idmef_address_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->address ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->address);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -5145,7 +5243,11 @@ int idmef_address_new_netmask(idmef_address_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->netmask ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->netmask);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -5299,7 +5401,7 @@ int idmef_address_compare(const idmef_address_t *obj1, const idmef_address_t *ob
  */
 int idmef_process_new(idmef_process_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -5632,7 +5734,7 @@ void idmef_process_destroy(idmef_process_t *ptr)
                 return;
 
         idmef_process_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -5687,7 +5789,11 @@ int idmef_process_new_ident(idmef_process_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -5748,7 +5854,11 @@ int idmef_process_new_name(idmef_process_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -5868,7 +5978,11 @@ int idmef_process_new_path(idmef_process_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->path ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->path);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -5942,10 +6056,14 @@ void idmef_process_set_arg(idmef_process_t *ptr, prelude_string_t *object, int p
 int idmef_process_new_arg(idmef_process_t *ptr, prelude_string_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = prelude_string_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -6020,10 +6138,14 @@ void idmef_process_set_env(idmef_process_t *ptr, prelude_string_t *object, int p
 int idmef_process_new_env(idmef_process_t *ptr, prelude_string_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = prelude_string_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -6240,7 +6362,7 @@ int idmef_process_compare(const idmef_process_t *obj1, const idmef_process_t *ob
  */
 int idmef_web_service_new(idmef_web_service_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -6480,7 +6602,7 @@ void idmef_web_service_destroy(idmef_web_service_t *ptr)
                 return;
 
         idmef_web_service_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -6535,7 +6657,11 @@ int idmef_web_service_new_url(idmef_web_service_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->url ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->url);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -6596,7 +6722,11 @@ int idmef_web_service_new_cgi(idmef_web_service_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->cgi ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->cgi);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -6657,7 +6787,11 @@ int idmef_web_service_new_http_method(idmef_web_service_t *ptr, prelude_string_t
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->http_method ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->http_method);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -6731,10 +6865,14 @@ void idmef_web_service_set_arg(idmef_web_service_t *ptr, prelude_string_t *objec
 int idmef_web_service_new_arg(idmef_web_service_t *ptr, prelude_string_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = prelude_string_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -6900,7 +7038,7 @@ int idmef_web_service_compare(const idmef_web_service_t *obj1, const idmef_web_s
  */
 int idmef_snmp_service_new(idmef_snmp_service_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -7113,7 +7251,7 @@ void idmef_snmp_service_destroy(idmef_snmp_service_t *ptr)
                 return;
 
         idmef_snmp_service_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -7168,7 +7306,11 @@ int idmef_snmp_service_new_oid(idmef_snmp_service_t *ptr, prelude_string_t **ret
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->oid ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->oid);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -7347,7 +7489,11 @@ int idmef_snmp_service_new_security_name(idmef_snmp_service_t *ptr, prelude_stri
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->security_name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->security_name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -7467,7 +7613,11 @@ int idmef_snmp_service_new_context_name(idmef_snmp_service_t *ptr, prelude_strin
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->context_name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->context_name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -7528,7 +7678,11 @@ int idmef_snmp_service_new_context_engine_id(idmef_snmp_service_t *ptr, prelude_
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->context_engine_id ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->context_engine_id);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -7589,7 +7743,11 @@ int idmef_snmp_service_new_command(idmef_snmp_service_t *ptr, prelude_string_t *
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->command ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->command);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -7778,7 +7936,7 @@ int idmef_snmp_service_compare(const idmef_snmp_service_t *obj1, const idmef_snm
  */
 int idmef_service_new(idmef_service_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -8041,7 +8199,7 @@ void idmef_service_destroy(idmef_service_t *ptr)
                 return;
 
         idmef_service_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -8096,7 +8254,11 @@ int idmef_service_new_ident(idmef_service_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -8275,7 +8437,11 @@ int idmef_service_new_iana_protocol_name(idmef_service_t *ptr, prelude_string_t
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->iana_protocol_name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->iana_protocol_name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -8336,7 +8502,11 @@ int idmef_service_new_name(idmef_service_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -8456,7 +8626,11 @@ int idmef_service_new_portlist(idmef_service_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->portlist ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->portlist);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -8517,7 +8691,11 @@ int idmef_service_new_protocol(idmef_service_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->protocol ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->protocol);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -8598,6 +8776,7 @@ void idmef_service_set_web_service(idmef_service_t *ptr, idmef_web_service_t *we
 int idmef_service_new_web_service(idmef_service_t *ptr, idmef_web_service_t **ret)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
@@ -8615,7 +8794,10 @@ int idmef_service_new_web_service(idmef_service_t *ptr, idmef_web_service_t **re
                         break;
         }
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_web_service_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -8683,6 +8865,7 @@ void idmef_service_set_snmp_service(idmef_service_t *ptr, idmef_snmp_service_t *
 int idmef_service_new_snmp_service(idmef_service_t *ptr, idmef_snmp_service_t **ret)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
@@ -8700,7 +8883,10 @@ int idmef_service_new_snmp_service(idmef_service_t *ptr, idmef_snmp_service_t **
                         break;
         }
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_snmp_service_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -8940,7 +9126,7 @@ int idmef_service_compare(const idmef_service_t *obj1, const idmef_service_t *ob
  */
 int idmef_node_new(idmef_node_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -9181,7 +9367,7 @@ void idmef_node_destroy(idmef_node_t *ptr)
                 return;
 
         idmef_node_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -9236,7 +9422,11 @@ int idmef_node_new_ident(idmef_node_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -9346,7 +9536,11 @@ int idmef_node_new_name(idmef_node_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -9407,7 +9601,11 @@ int idmef_node_new_location(idmef_node_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->location ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->location);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -9481,10 +9679,14 @@ void idmef_node_set_address(idmef_node_t *ptr, idmef_address_t *object, int pos)
 int idmef_node_new_address(idmef_node_t *ptr, idmef_address_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_address_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -9660,7 +9862,7 @@ int idmef_node_compare(const idmef_node_t *obj1, const idmef_node_t *obj2)
  */
 int idmef_source_new(idmef_source_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -9885,7 +10087,7 @@ void idmef_source_destroy(idmef_source_t *ptr)
                 return;
 
         idmef_source_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -9940,7 +10142,11 @@ int idmef_source_new_ident(idmef_source_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -10050,7 +10256,11 @@ int idmef_source_new_interface(idmef_source_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->interface ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->interface);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -10111,7 +10321,11 @@ int idmef_source_new_node(idmef_source_t *ptr, idmef_node_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->node ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_node_new(&ptr->node);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -10172,7 +10386,11 @@ int idmef_source_new_user(idmef_source_t *ptr, idmef_user_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->user ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_user_new(&ptr->user);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -10233,7 +10451,11 @@ int idmef_source_new_process(idmef_source_t *ptr, idmef_process_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->process ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_process_new(&ptr->process);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -10294,7 +10516,11 @@ int idmef_source_new_service(idmef_source_t *ptr, idmef_service_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->service ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_service_new(&ptr->service);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -10473,7 +10699,7 @@ int idmef_source_compare(const idmef_source_t *obj1, const idmef_source_t *obj2)
  */
 int idmef_file_access_new(idmef_file_access_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -10684,7 +10910,7 @@ void idmef_file_access_destroy(idmef_file_access_t *ptr)
                 return;
 
         idmef_file_access_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -10739,7 +10965,11 @@ int idmef_file_access_new_user_id(idmef_file_access_t *ptr, idmef_user_id_t **re
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->user_id ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_user_id_new(&ptr->user_id);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -10813,10 +11043,14 @@ void idmef_file_access_set_permission(idmef_file_access_t *ptr, prelude_string_t
 int idmef_file_access_new_permission(idmef_file_access_t *ptr, prelude_string_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = prelude_string_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -10952,7 +11186,7 @@ int idmef_file_access_compare(const idmef_file_access_t *obj1, const idmef_file_
  */
 int idmef_inode_new(idmef_inode_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -11113,7 +11347,7 @@ void idmef_inode_destroy(idmef_inode_t *ptr)
                 return;
 
         idmef_inode_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -11168,7 +11402,11 @@ int idmef_inode_new_change_time(idmef_inode_t *ptr, idmef_time_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->change_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->change_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -11612,7 +11850,7 @@ int idmef_inode_compare(const idmef_inode_t *obj1, const idmef_inode_t *obj2)
  */
 int idmef_checksum_new(idmef_checksum_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -11767,7 +12005,7 @@ void idmef_checksum_destroy(idmef_checksum_t *ptr)
                 return;
 
         idmef_checksum_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -11822,7 +12060,11 @@ int idmef_checksum_new_value(idmef_checksum_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->value ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->value);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -11883,7 +12125,11 @@ int idmef_checksum_new_key(idmef_checksum_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->key ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->key);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -12046,7 +12292,7 @@ int idmef_checksum_compare(const idmef_checksum_t *obj1, const idmef_checksum_t
  */
 int idmef_file_new(idmef_file_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -12603,7 +12849,7 @@ void idmef_file_destroy(idmef_file_t *ptr)
                 return;
 
         idmef_file_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -12658,7 +12904,11 @@ int idmef_file_new_ident(idmef_file_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -12719,7 +12969,11 @@ int idmef_file_new_name(idmef_file_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -12780,7 +13034,11 @@ int idmef_file_new_path(idmef_file_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->path ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->path);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -12841,7 +13099,11 @@ int idmef_file_new_create_time(idmef_file_t *ptr, idmef_time_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->create_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->create_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -12902,7 +13164,11 @@ int idmef_file_new_modify_time(idmef_file_t *ptr, idmef_time_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->modify_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->modify_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -12963,7 +13229,11 @@ int idmef_file_new_access_time(idmef_file_t *ptr, idmef_time_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->access_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->access_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -13155,10 +13425,14 @@ void idmef_file_set_file_access(idmef_file_t *ptr, idmef_file_access_t *object,
 int idmef_file_new_file_access(idmef_file_t *ptr, idmef_file_access_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_file_access_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -13233,10 +13507,14 @@ void idmef_file_set_linkage(idmef_file_t *ptr, idmef_linkage_t *object, int pos)
 int idmef_file_new_linkage(idmef_file_t *ptr, idmef_linkage_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_linkage_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -13298,7 +13576,11 @@ int idmef_file_new_inode(idmef_file_t *ptr, idmef_inode_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->inode ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_inode_new(&ptr->inode);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -13372,10 +13654,14 @@ void idmef_file_set_checksum(idmef_file_t *ptr, idmef_checksum_t *object, int po
 int idmef_file_new_checksum(idmef_file_t *ptr, idmef_checksum_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_checksum_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -13545,7 +13831,11 @@ int idmef_file_new_file_type(idmef_file_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->file_type ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->file_type);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -13897,7 +14187,7 @@ int idmef_file_compare(const idmef_file_t *obj1, const idmef_file_t *obj2)
  */
 int idmef_linkage_new(idmef_linkage_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -14092,7 +14382,7 @@ void idmef_linkage_destroy(idmef_linkage_t *ptr)
                 return;
 
         idmef_linkage_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -14196,7 +14486,11 @@ int idmef_linkage_new_name(idmef_linkage_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -14257,7 +14551,11 @@ int idmef_linkage_new_path(idmef_linkage_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->path ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->path);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -14318,7 +14616,11 @@ int idmef_linkage_new_file(idmef_linkage_t *ptr, idmef_file_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->file ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_file_new(&ptr->file);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -14437,7 +14739,7 @@ int idmef_linkage_compare(const idmef_linkage_t *obj1, const idmef_linkage_t *ob
  */
 int idmef_target_new(idmef_target_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -14745,7 +15047,7 @@ void idmef_target_destroy(idmef_target_t *ptr)
                 return;
 
         idmef_target_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -14800,7 +15102,11 @@ int idmef_target_new_ident(idmef_target_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -14910,7 +15216,11 @@ int idmef_target_new_interface(idmef_target_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->interface ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->interface);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -14971,7 +15281,11 @@ int idmef_target_new_node(idmef_target_t *ptr, idmef_node_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->node ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_node_new(&ptr->node);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -15032,7 +15346,11 @@ int idmef_target_new_user(idmef_target_t *ptr, idmef_user_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->user ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_user_new(&ptr->user);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -15093,7 +15411,11 @@ int idmef_target_new_process(idmef_target_t *ptr, idmef_process_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->process ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_process_new(&ptr->process);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -15154,7 +15476,11 @@ int idmef_target_new_service(idmef_target_t *ptr, idmef_service_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->service ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_service_new(&ptr->service);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -15228,10 +15554,14 @@ void idmef_target_set_file(idmef_target_t *ptr, idmef_file_t *object, int pos)
 int idmef_target_new_file(idmef_target_t *ptr, idmef_file_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_file_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -15452,7 +15782,7 @@ int idmef_target_compare(const idmef_target_t *obj1, const idmef_target_t *obj2)
  */
 int idmef_analyzer_new(idmef_analyzer_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -15734,7 +16064,7 @@ void idmef_analyzer_destroy(idmef_analyzer_t *ptr)
                 return;
 
         idmef_analyzer_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -15789,7 +16119,11 @@ int idmef_analyzer_new_analyzerid(idmef_analyzer_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->analyzerid ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->analyzerid);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -15850,7 +16184,11 @@ int idmef_analyzer_new_name(idmef_analyzer_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -15911,7 +16249,11 @@ int idmef_analyzer_new_manufacturer(idmef_analyzer_t *ptr, prelude_string_t **re
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->manufacturer ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->manufacturer);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -15972,7 +16314,11 @@ int idmef_analyzer_new_model(idmef_analyzer_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->model ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->model);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16033,7 +16379,11 @@ int idmef_analyzer_new_version(idmef_analyzer_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->version ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->version);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16094,7 +16444,11 @@ int idmef_analyzer_new_class(idmef_analyzer_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->class ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->class);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16155,7 +16509,11 @@ int idmef_analyzer_new_ostype(idmef_analyzer_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->ostype ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->ostype);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16216,7 +16574,11 @@ int idmef_analyzer_new_osversion(idmef_analyzer_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->osversion ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->osversion);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16277,7 +16639,11 @@ int idmef_analyzer_new_node(idmef_analyzer_t *ptr, idmef_node_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->node ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_node_new(&ptr->node);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16338,7 +16704,11 @@ int idmef_analyzer_new_process(idmef_analyzer_t *ptr, idmef_process_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->process ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_process_new(&ptr->process);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16572,7 +16942,7 @@ int idmef_analyzer_compare(const idmef_analyzer_t *obj1, const idmef_analyzer_t
  */
 int idmef_alertident_new(idmef_alertident_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -16716,7 +17086,7 @@ void idmef_alertident_destroy(idmef_alertident_t *ptr)
                 return;
 
         idmef_alertident_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -16771,7 +17141,11 @@ int idmef_alertident_new_alertident(idmef_alertident_t *ptr, prelude_string_t **
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->alertident ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->alertident);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16832,7 +17206,11 @@ int idmef_alertident_new_analyzerid(idmef_alertident_t *ptr, prelude_string_t **
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->analyzerid ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->analyzerid);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -16941,7 +17319,7 @@ int idmef_alertident_compare(const idmef_alertident_t *obj1, const idmef_alertid
  */
 int idmef_impact_new(idmef_impact_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -17089,7 +17467,7 @@ void idmef_impact_destroy(idmef_impact_t *ptr)
                 return;
 
         idmef_impact_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -17311,7 +17689,11 @@ int idmef_impact_new_description(idmef_impact_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->description ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->description);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -17435,7 +17817,7 @@ int idmef_impact_compare(const idmef_impact_t *obj1, const idmef_impact_t *obj2)
  */
 int idmef_action_new(idmef_action_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -17562,7 +17944,7 @@ void idmef_action_destroy(idmef_action_t *ptr)
                 return;
 
         idmef_action_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -17666,7 +18048,11 @@ int idmef_action_new_description(idmef_action_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->description ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->description);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -17770,7 +18156,7 @@ int idmef_action_compare(const idmef_action_t *obj1, const idmef_action_t *obj2)
  */
 int idmef_confidence_new(idmef_confidence_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -17879,7 +18265,7 @@ void idmef_confidence_destroy(idmef_confidence_t *ptr)
                 return;
 
         idmef_confidence_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -18064,7 +18450,7 @@ int idmef_confidence_compare(const idmef_confidence_t *obj1, const idmef_confide
  */
 int idmef_assessment_new(idmef_assessment_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -18280,7 +18666,7 @@ void idmef_assessment_destroy(idmef_assessment_t *ptr)
                 return;
 
         idmef_assessment_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -18335,7 +18721,11 @@ int idmef_assessment_new_impact(idmef_assessment_t *ptr, idmef_impact_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->impact ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_impact_new(&ptr->impact);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -18409,10 +18799,14 @@ void idmef_assessment_set_action(idmef_assessment_t *ptr, idmef_action_t *object
 int idmef_assessment_new_action(idmef_assessment_t *ptr, idmef_action_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_action_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -18474,7 +18868,11 @@ int idmef_assessment_new_confidence(idmef_assessment_t *ptr, idmef_confidence_t
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->confidence ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_confidence_new(&ptr->confidence);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -18629,7 +19027,7 @@ int idmef_assessment_compare(const idmef_assessment_t *obj1, const idmef_assessm
  */
 int idmef_tool_alert_new(idmef_tool_alert_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -18851,7 +19249,7 @@ void idmef_tool_alert_destroy(idmef_tool_alert_t *ptr)
                 return;
 
         idmef_tool_alert_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -18906,7 +19304,11 @@ int idmef_tool_alert_new_name(idmef_tool_alert_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -18967,7 +19369,11 @@ int idmef_tool_alert_new_command(idmef_tool_alert_t *ptr, prelude_string_t **ret
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->command ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->command);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -19041,10 +19447,14 @@ void idmef_tool_alert_set_alertident(idmef_tool_alert_t *ptr, idmef_alertident_t
 int idmef_tool_alert_new_alertident(idmef_tool_alert_t *ptr, idmef_alertident_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_alertident_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -19195,7 +19605,7 @@ int idmef_tool_alert_compare(const idmef_tool_alert_t *obj1, const idmef_tool_al
  */
 int idmef_correlation_alert_new(idmef_correlation_alert_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -19399,7 +19809,7 @@ void idmef_correlation_alert_destroy(idmef_correlation_alert_t *ptr)
                 return;
 
         idmef_correlation_alert_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -19454,7 +19864,11 @@ int idmef_correlation_alert_new_name(idmef_correlation_alert_t *ptr, prelude_str
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->name ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->name);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -19528,10 +19942,14 @@ void idmef_correlation_alert_set_alertident(idmef_correlation_alert_t *ptr, idme
 int idmef_correlation_alert_new_alertident(idmef_correlation_alert_t *ptr, idmef_alertident_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_alertident_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -19667,7 +20085,7 @@ int idmef_correlation_alert_compare(const idmef_correlation_alert_t *obj1, const
  */
 int idmef_overflow_alert_new(idmef_overflow_alert_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -19816,7 +20234,7 @@ void idmef_overflow_alert_destroy(idmef_overflow_alert_t *ptr)
                 return;
 
         idmef_overflow_alert_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 }
 
 /**
@@ -19871,7 +20289,11 @@ int idmef_overflow_alert_new_program(idmef_overflow_alert_t *ptr, prelude_string
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->program ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->program);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -19991,7 +20413,11 @@ int idmef_overflow_alert_new_buffer(idmef_overflow_alert_t *ptr, idmef_data_t **
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->buffer ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_data_new(&ptr->buffer);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -20110,7 +20536,7 @@ int idmef_overflow_alert_compare(const idmef_overflow_alert_t *obj1, const idmef
  */
 int idmef_alert_new(idmef_alert_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -20180,6 +20606,12 @@ int _idmef_alert_get_child(void *p, idmef_class_child_id_t child, void **childpt
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
         *childptr = NULL;
 
+        if ( ptr->lazy ) {
+                int retval = _idmef_lazy_load(ptr->lazy, ptr, child);
+                if ( retval < 0 )
+                        return retval;
+        }
+
         switch ( child ) {
 
                 case 0:
@@ -20237,6 +20669,12 @@ int _idmef_alert_new_child(void *p, idmef_class_child_id_t child, int n, void **
 
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        if ( ptr->lazy ) {
+                int retval = _idmef_lazy_load(ptr->lazy, ptr, child);
+                if ( retval < 0 )
+                        return retval;
+        }
+
         switch ( child ) {
 
                 case 0:
@@ -20413,6 +20851,12 @@ int _idmef_alert_destroy_child(void *p, idmef_class_child_id_t child, int n)
 
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        if ( ptr->lazy ) {
+                int retval = _idmef_lazy_load(ptr->lazy, ptr, child);
+                if ( retval < 0 )
+                        return retval;
+        }
+
         switch ( child ) {
 
                 case 0:
@@ -20626,6 +21070,9 @@ static void idmef_alert_destroy_internal(idmef_alert_t *ptr)
 {
         prelude_return_if_fail(ptr);
 
+        if ( ptr->lazy )
+                _idmef_lazy_destroy(ptr->lazy);
+
         if ( ptr->messageid ) {
                 prelude_string_destroy(ptr->messageid);
                 ptr->messageid = NULL;
@@ -20741,7 +21188,17 @@ void idmef_alert_destroy(idmef_alert_t *ptr)
                 return;
 
         idmef_alert_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
+}
+
+void _idmef_alert_set_lazy(idmef_alert_t *ptr, idmef_lazy_t *lazy)
+{
+        prelude_return_if_fail(ptr);
+
+        if ( ptr->lazy )
+                _idmef_lazy_destroy(ptr->lazy);
+
+        ptr->lazy = lazy;
 }
 
 /**
@@ -20755,6 +21212,7 @@ void idmef_alert_destroy(idmef_alert_t *ptr)
 prelude_string_t *idmef_alert_get_messageid(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 0);
 
         return ptr->messageid;
 }
@@ -20772,6 +21230,7 @@ prelude_string_t *idmef_alert_get_messageid(idmef_alert_t *ptr)
 void idmef_alert_set_messageid(idmef_alert_t *ptr, prelude_string_t *messageid)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 0);
 
         if ( ptr->messageid )
                 prelude_string_destroy(ptr->messageid);
@@ -20794,9 +21253,14 @@ int idmef_alert_new_messageid(idmef_alert_t *ptr, prelude_string_t **ret)
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 0);
 
         if ( ! ptr->messageid ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->messageid);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -20821,6 +21285,7 @@ idmef_analyzer_t *idmef_alert_get_next_analyzer(idmef_alert_t *alert, idmef_anal
         prelude_list_t *tmp = (analyzer_cur) ? &((prelude_linked_object_t *) analyzer_cur)->_list : NULL;
 
         prelude_return_val_if_fail(alert, NULL);
+        LAZY_LOAD(alert, 1);
 
         prelude_list_for_each_continue(&alert->analyzer_list, tmp)
                 return prelude_linked_object_get_object(tmp);
@@ -20844,6 +21309,7 @@ void idmef_alert_set_analyzer(idmef_alert_t *ptr, idmef_analyzer_t *object, int
 {
         prelude_return_if_fail(ptr);
         prelude_return_if_fail(object);
+        LAZY_LOAD(ptr, 1);
 
         if ( ! prelude_list_is_empty(&((prelude_linked_object_t *) object)->_list) )
                 prelude_list_del_init(&((prelude_linked_object_t *) object)->_list);
@@ -20870,10 +21336,15 @@ void idmef_alert_set_analyzer(idmef_alert_t *ptr, idmef_analyzer_t *object, int
 int idmef_alert_new_analyzer(idmef_alert_t *ptr, idmef_analyzer_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 1);
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_analyzer_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -20894,6 +21365,7 @@ int idmef_alert_new_analyzer(idmef_alert_t *ptr, idmef_analyzer_t **ret, int pos
 idmef_time_t *idmef_alert_get_create_time(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 2);
 
         return ptr->create_time;
 }
@@ -20911,6 +21383,7 @@ idmef_time_t *idmef_alert_get_create_time(idmef_alert_t *ptr)
 void idmef_alert_set_create_time(idmef_alert_t *ptr, idmef_time_t *create_time)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 2);
 
         if ( ptr->create_time )
                 idmef_time_destroy(ptr->create_time);
@@ -20933,9 +21406,14 @@ int idmef_alert_new_create_time(idmef_alert_t *ptr, idmef_time_t **ret)
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 2);
 
         if ( ! ptr->create_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->create_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -20955,6 +21433,7 @@ int idmef_alert_new_create_time(idmef_alert_t *ptr, idmef_time_t **ret)
 idmef_classification_t *idmef_alert_get_classification(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 3);
 
         return ptr->classification;
 }
@@ -20972,6 +21451,7 @@ idmef_classification_t *idmef_alert_get_classification(idmef_alert_t *ptr)
 void idmef_alert_set_classification(idmef_alert_t *ptr, idmef_classification_t *classification)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 3);
 
         if ( ptr->classification )
                 idmef_classification_destroy(ptr->classification);
@@ -20994,9 +21474,14 @@ int idmef_alert_new_classification(idmef_alert_t *ptr, idmef_classification_t **
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 3);
 
         if ( ! ptr->classification ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_classification_new(&ptr->classification);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -21016,6 +21501,7 @@ int idmef_alert_new_classification(idmef_alert_t *ptr, idmef_classification_t **
 idmef_time_t *idmef_alert_get_detect_time(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 4);
 
         return ptr->detect_time;
 }
@@ -21033,6 +21519,7 @@ idmef_time_t *idmef_alert_get_detect_time(idmef_alert_t *ptr)
 void idmef_alert_set_detect_time(idmef_alert_t *ptr, idmef_time_t *detect_time)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 4);
 
         if ( ptr->detect_time )
                 idmef_time_destroy(ptr->detect_time);
@@ -21055,9 +21542,14 @@ int idmef_alert_new_detect_time(idmef_alert_t *ptr, idmef_time_t **ret)
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 4);
 
         if ( ! ptr->detect_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->detect_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -21077,6 +21569,7 @@ int idmef_alert_new_detect_time(idmef_alert_t *ptr, idmef_time_t **ret)
 idmef_time_t *idmef_alert_get_analyzer_time(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 5);
 
         return ptr->analyzer_time;
 }
@@ -21094,6 +21587,7 @@ idmef_time_t *idmef_alert_get_analyzer_time(idmef_alert_t *ptr)
 void idmef_alert_set_analyzer_time(idmef_alert_t *ptr, idmef_time_t *analyzer_time)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 5);
 
         if ( ptr->analyzer_time )
                 idmef_time_destroy(ptr->analyzer_time);
@@ -21116,9 +21610,14 @@ int idmef_alert_new_analyzer_time(idmef_alert_t *ptr, idmef_time_t **ret)
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 5);
 
         if ( ! ptr->analyzer_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->analyzer_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -21143,6 +21642,7 @@ idmef_source_t *idmef_alert_get_next_source(idmef_alert_t *alert, idmef_source_t
         prelude_list_t *tmp = (source_cur) ? &((prelude_linked_object_t *) source_cur)->_list : NULL;
 
         prelude_return_val_if_fail(alert, NULL);
+        LAZY_LOAD(alert, 6);
 
         prelude_list_for_each_continue(&alert->source_list, tmp)
                 return prelude_linked_object_get_object(tmp);
@@ -21166,6 +21666,7 @@ void idmef_alert_set_source(idmef_alert_t *ptr, idmef_source_t *object, int pos)
 {
         prelude_return_if_fail(ptr);
         prelude_return_if_fail(object);
+        LAZY_LOAD(ptr, 6);
 
         if ( ! prelude_list_is_empty(&((prelude_linked_object_t *) object)->_list) )
                 prelude_list_del_init(&((prelude_linked_object_t *) object)->_list);
@@ -21192,10 +21693,15 @@ void idmef_alert_set_source(idmef_alert_t *ptr, idmef_source_t *object, int pos)
 int idmef_alert_new_source(idmef_alert_t *ptr, idmef_source_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 6);
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_source_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -21221,6 +21727,7 @@ idmef_target_t *idmef_alert_get_next_target(idmef_alert_t *alert, idmef_target_t
         prelude_list_t *tmp = (target_cur) ? &((prelude_linked_object_t *) target_cur)->_list : NULL;
 
         prelude_return_val_if_fail(alert, NULL);
+        LAZY_LOAD(alert, 7);
 
         prelude_list_for_each_continue(&alert->target_list, tmp)
                 return prelude_linked_object_get_object(tmp);
@@ -21244,6 +21751,7 @@ void idmef_alert_set_target(idmef_alert_t *ptr, idmef_target_t *object, int pos)
 {
         prelude_return_if_fail(ptr);
         prelude_return_if_fail(object);
+        LAZY_LOAD(ptr, 7);
 
         if ( ! prelude_list_is_empty(&((prelude_linked_object_t *) object)->_list) )
                 prelude_list_del_init(&((prelude_linked_object_t *) object)->_list);
@@ -21270,10 +21778,15 @@ void idmef_alert_set_target(idmef_alert_t *ptr, idmef_target_t *object, int pos)
 int idmef_alert_new_target(idmef_alert_t *ptr, idmef_target_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 7);
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_target_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -21294,6 +21807,7 @@ int idmef_alert_new_target(idmef_alert_t *ptr, idmef_target_t **ret, int pos)
 idmef_assessment_t *idmef_alert_get_assessment(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 8);
 
         return ptr->assessment;
 }
@@ -21311,6 +21825,7 @@ idmef_assessment_t *idmef_alert_get_assessment(idmef_alert_t *ptr)
 void idmef_alert_set_assessment(idmef_alert_t *ptr, idmef_assessment_t *assessment)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 8);
 
         if ( ptr->assessment )
                 idmef_assessment_destroy(ptr->assessment);
@@ -21333,9 +21848,14 @@ int idmef_alert_new_assessment(idmef_alert_t *ptr, idmef_assessment_t **ret)
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 8);
 
         if ( ! ptr->assessment ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_assessment_new(&ptr->assessment);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -21360,6 +21880,7 @@ idmef_additional_data_t *idmef_alert_get_next_additional_data(idmef_alert_t *ale
         prelude_list_t *tmp = (additional_data_cur) ? &((prelude_linked_object_t *) additional_data_cur)->_list : NULL;
 
         prelude_return_val_if_fail(alert, NULL);
+        LAZY_LOAD(alert, 9);
 
         prelude_list_for_each_continue(&alert->additional_data_list, tmp)
                 return prelude_linked_object_get_object(tmp);
@@ -21383,6 +21904,7 @@ void idmef_alert_set_additional_data(idmef_alert_t *ptr, idmef_additional_data_t
 {
         prelude_return_if_fail(ptr);
         prelude_return_if_fail(object);
+        LAZY_LOAD(ptr, 9);
 
         if ( ! prelude_list_is_empty(&((prelude_linked_object_t *) object)->_list) )
                 prelude_list_del_init(&((prelude_linked_object_t *) object)->_list);
@@ -21409,10 +21931,15 @@ void idmef_alert_set_additional_data(idmef_alert_t *ptr, idmef_additional_data_t
 int idmef_alert_new_additional_data(idmef_alert_t *ptr, idmef_additional_data_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 9);
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_additional_data_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -21433,6 +21960,9 @@ int idmef_alert_new_additional_data(idmef_alert_t *ptr, idmef_additional_data_t
 idmef_alert_type_t idmef_alert_get_type(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 10);
+        LAZY_LOAD(ptr, 11);
+        LAZY_LOAD(ptr, 12);
         return ptr->type;
 }
 
@@ -21447,6 +21977,7 @@ idmef_alert_type_t idmef_alert_get_type(idmef_alert_t *ptr)
 idmef_tool_alert_t *idmef_alert_get_tool_alert(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, NULL);
+        LAZY_LOAD(ptr, 10);
         return (ptr->type == IDMEF_ALERT_TYPE_TOOL) ? ptr->detail.tool_alert : NULL;
 }
 
@@ -21462,6 +21993,9 @@ idmef_tool_alert_t *idmef_alert_get_tool_alert(idmef_alert_t *ptr)
 void idmef_alert_set_tool_alert(idmef_alert_t *ptr, idmef_tool_alert_t *tool_alert)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 10);
+        LAZY_LOAD(ptr, 11);
+        LAZY_LOAD(ptr, 12);
 
         switch ( ptr->type ) {
 
@@ -21498,8 +22032,12 @@ void idmef_alert_set_tool_alert(idmef_alert_t *ptr, idmef_tool_alert_t *tool_ale
 int idmef_alert_new_tool_alert(idmef_alert_t *ptr, idmef_tool_alert_t **ret)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 10);
+        LAZY_LOAD(ptr, 11);
+        LAZY_LOAD(ptr, 12);
 
         switch ( ptr->type ) {
 
@@ -21519,7 +22057,10 @@ int idmef_alert_new_tool_alert(idmef_alert_t *ptr, idmef_tool_alert_t **ret)
                         break;
         }
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_tool_alert_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -21540,6 +22081,7 @@ int idmef_alert_new_tool_alert(idmef_alert_t *ptr, idmef_tool_alert_t **ret)
 idmef_correlation_alert_t *idmef_alert_get_correlation_alert(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, NULL);
+        LAZY_LOAD(ptr, 11);
         return (ptr->type == IDMEF_ALERT_TYPE_CORRELATION) ? ptr->detail.correlation_alert : NULL;
 }
 
@@ -21555,6 +22097,9 @@ idmef_correlation_alert_t *idmef_alert_get_correlation_alert(idmef_alert_t *ptr)
 void idmef_alert_set_correlation_alert(idmef_alert_t *ptr, idmef_correlation_alert_t *correlation_alert)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 10);
+        LAZY_LOAD(ptr, 11);
+        LAZY_LOAD(ptr, 12);
 
         switch ( ptr->type ) {
 
@@ -21591,8 +22136,12 @@ void idmef_alert_set_correlation_alert(idmef_alert_t *ptr, idmef_correlation_ale
 int idmef_alert_new_correlation_alert(idmef_alert_t *ptr, idmef_correlation_alert_t **ret)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 10);
+        LAZY_LOAD(ptr, 11);
+        LAZY_LOAD(ptr, 12);
 
         switch ( ptr->type ) {
 
@@ -21612,7 +22161,10 @@ int idmef_alert_new_correlation_alert(idmef_alert_t *ptr, idmef_correlation_aler
                         break;
         }
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_correlation_alert_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -21633,6 +22185,7 @@ int idmef_alert_new_correlation_alert(idmef_alert_t *ptr, idmef_correlation_aler
 idmef_overflow_alert_t *idmef_alert_get_overflow_alert(idmef_alert_t *ptr)
 {
         prelude_return_val_if_fail(ptr, NULL);
+        LAZY_LOAD(ptr, 12);
         return (ptr->type == IDMEF_ALERT_TYPE_OVERFLOW) ? ptr->detail.overflow_alert : NULL;
 }
 
@@ -21648,6 +22201,9 @@ idmef_overflow_alert_t *idmef_alert_get_overflow_alert(idmef_alert_t *ptr)
 void idmef_alert_set_overflow_alert(idmef_alert_t *ptr, idmef_overflow_alert_t *overflow_alert)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 10);
+        LAZY_LOAD(ptr, 11);
+        LAZY_LOAD(ptr, 12);
 
         switch ( ptr->type ) {
 
@@ -21684,8 +22240,12 @@ void idmef_alert_set_overflow_alert(idmef_alert_t *ptr, idmef_overflow_alert_t *
 int idmef_alert_new_overflow_alert(idmef_alert_t *ptr, idmef_overflow_alert_t **ret)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 10);
+        LAZY_LOAD(ptr, 11);
+        LAZY_LOAD(ptr, 12);
 
         switch ( ptr->type ) {
 
@@ -21705,7 +22265,10 @@ int idmef_alert_new_overflow_alert(idmef_alert_t *ptr, idmef_overflow_alert_t **
                         break;
         }
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_overflow_alert_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -21730,6 +22293,8 @@ int idmef_alert_copy(const idmef_alert_t *src, idmef_alert_t *dst)
 
         prelude_return_val_if_fail(src, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(dst, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD_RO(src);
+        LAZY_LOAD(dst, -1);
 
         ret = 0;
 
@@ -21938,6 +22503,9 @@ int idmef_alert_compare(const idmef_alert_t *obj1, const idmef_alert_t *obj2)
         else if ( obj1 == NULL || obj2 == NULL )
                 return -1;
 
+        LAZY_LOAD_RO(obj1);
+        LAZY_LOAD_RO(obj2);
+
         ret = prelude_string_compare(obj1->messageid, obj2->messageid);
         if ( ret != 0 )
                 return ret;
@@ -22096,7 +22664,7 @@ int idmef_alert_compare(const idmef_alert_t *obj1, const idmef_alert_t *obj2)
  */
 int idmef_heartbeat_new(idmef_heartbeat_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -22150,6 +22718,12 @@ int _idmef_heartbeat_get_child(void *p, idmef_class_child_id_t child, void **chi
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
         *childptr = NULL;
 
+        if ( ptr->lazy ) {
+                int retval = _idmef_lazy_load(ptr->lazy, ptr, child);
+                if ( retval < 0 )
+                        return retval;
+        }
+
         switch ( child ) {
 
                 case 0:
@@ -22180,6 +22754,12 @@ int _idmef_heartbeat_new_child(void *p, idmef_class_child_id_t child, int n, voi
 
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        if ( ptr->lazy ) {
+                int retval = _idmef_lazy_load(ptr->lazy, ptr, child);
+                if ( retval < 0 )
+                        return retval;
+        }
+
         switch ( child ) {
 
                 case 0:
@@ -22273,6 +22853,12 @@ int _idmef_heartbeat_destroy_child(void *p, idmef_class_child_id_t child, int n)
 
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        if ( ptr->lazy ) {
+                int retval = _idmef_lazy_load(ptr->lazy, ptr, child);
+                if ( retval < 0 )
+                        return retval;
+        }
+
         switch ( child ) {
 
                 case 0:
@@ -22374,6 +22960,9 @@ static void idmef_heartbeat_destroy_internal(idmef_heartbeat_t *ptr)
 {
         prelude_return_if_fail(ptr);
 
+        if ( ptr->lazy )
+                _idmef_lazy_destroy(ptr->lazy);
+
         if ( ptr->messageid ) {
                 prelude_string_destroy(ptr->messageid);
                 ptr->messageid = NULL;
@@ -22431,7 +23020,17 @@ void idmef_heartbeat_destroy(idmef_heartbeat_t *ptr)
                 return;
 
         idmef_heartbeat_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
+}
+
+void _idmef_heartbeat_set_lazy(idmef_heartbeat_t *ptr, idmef_lazy_t *lazy)
+{
+        prelude_return_if_fail(ptr);
+
+        if ( ptr->lazy )
+                _idmef_lazy_destroy(ptr->lazy);
+
+        ptr->lazy = lazy;
 }
 
 /**
@@ -22445,6 +23044,7 @@ void idmef_heartbeat_destroy(idmef_heartbeat_t *ptr)
 prelude_string_t *idmef_heartbeat_get_messageid(idmef_heartbeat_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 0);
 
         return ptr->messageid;
 }
@@ -22462,6 +23062,7 @@ prelude_string_t *idmef_heartbeat_get_messageid(idmef_heartbeat_t *ptr)
 void idmef_heartbeat_set_messageid(idmef_heartbeat_t *ptr, prelude_string_t *messageid)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 0);
 
         if ( ptr->messageid )
                 prelude_string_destroy(ptr->messageid);
@@ -22484,9 +23085,14 @@ int idmef_heartbeat_new_messageid(idmef_heartbeat_t *ptr, prelude_string_t **ret
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 0);
 
         if ( ! ptr->messageid ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->messageid);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -22511,6 +23117,7 @@ idmef_analyzer_t *idmef_heartbeat_get_next_analyzer(idmef_heartbeat_t *heartbeat
         prelude_list_t *tmp = (analyzer_cur) ? &((prelude_linked_object_t *) analyzer_cur)->_list : NULL;
 
         prelude_return_val_if_fail(heartbeat, NULL);
+        LAZY_LOAD(heartbeat, 1);
 
         prelude_list_for_each_continue(&heartbeat->analyzer_list, tmp)
                 return prelude_linked_object_get_object(tmp);
@@ -22534,6 +23141,7 @@ void idmef_heartbeat_set_analyzer(idmef_heartbeat_t *ptr, idmef_analyzer_t *obje
 {
         prelude_return_if_fail(ptr);
         prelude_return_if_fail(object);
+        LAZY_LOAD(ptr, 1);
 
         if ( ! prelude_list_is_empty(&((prelude_linked_object_t *) object)->_list) )
                 prelude_list_del_init(&((prelude_linked_object_t *) object)->_list);
@@ -22560,10 +23168,15 @@ void idmef_heartbeat_set_analyzer(idmef_heartbeat_t *ptr, idmef_analyzer_t *obje
 int idmef_heartbeat_new_analyzer(idmef_heartbeat_t *ptr, idmef_analyzer_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 1);
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_analyzer_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -22584,6 +23197,7 @@ int idmef_heartbeat_new_analyzer(idmef_heartbeat_t *ptr, idmef_analyzer_t **ret,
 idmef_time_t *idmef_heartbeat_get_create_time(idmef_heartbeat_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 2);
 
         return ptr->create_time;
 }
@@ -22601,6 +23215,7 @@ idmef_time_t *idmef_heartbeat_get_create_time(idmef_heartbeat_t *ptr)
 void idmef_heartbeat_set_create_time(idmef_heartbeat_t *ptr, idmef_time_t *create_time)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 2);
 
         if ( ptr->create_time )
                 idmef_time_destroy(ptr->create_time);
@@ -22623,9 +23238,14 @@ int idmef_heartbeat_new_create_time(idmef_heartbeat_t *ptr, idmef_time_t **ret)
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 2);
 
         if ( ! ptr->create_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->create_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -22645,6 +23265,7 @@ int idmef_heartbeat_new_create_time(idmef_heartbeat_t *ptr, idmef_time_t **ret)
 idmef_time_t *idmef_heartbeat_get_analyzer_time(idmef_heartbeat_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 3);
 
         return ptr->analyzer_time;
 }
@@ -22662,6 +23283,7 @@ idmef_time_t *idmef_heartbeat_get_analyzer_time(idmef_heartbeat_t *ptr)
 void idmef_heartbeat_set_analyzer_time(idmef_heartbeat_t *ptr, idmef_time_t *analyzer_time)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 3);
 
         if ( ptr->analyzer_time )
                 idmef_time_destroy(ptr->analyzer_time);
@@ -22684,9 +23306,14 @@ int idmef_heartbeat_new_analyzer_time(idmef_heartbeat_t *ptr, idmef_time_t **ret
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 3);
 
         if ( ! ptr->analyzer_time ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_time_new(&ptr->analyzer_time);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -22706,6 +23333,7 @@ int idmef_heartbeat_new_analyzer_time(idmef_heartbeat_t *ptr, idmef_time_t **ret
 uint32_t *idmef_heartbeat_get_heartbeat_interval(idmef_heartbeat_t *ptr)
 {
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
+        LAZY_LOAD(ptr, 4);
 
         return ptr->heartbeat_interval_is_set ? &ptr->heartbeat_interval : NULL;
 }
@@ -22723,6 +23351,7 @@ uint32_t *idmef_heartbeat_get_heartbeat_interval(idmef_heartbeat_t *ptr)
 void idmef_heartbeat_set_heartbeat_interval(idmef_heartbeat_t *ptr, uint32_t heartbeat_interval)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 4);
         ptr->heartbeat_interval = heartbeat_interval;
         ptr->heartbeat_interval_is_set = 1;
 }
@@ -22731,6 +23360,7 @@ void idmef_heartbeat_set_heartbeat_interval(idmef_heartbeat_t *ptr, uint32_t hea
 void idmef_heartbeat_unset_heartbeat_interval(idmef_heartbeat_t *ptr)
 {
         prelude_return_if_fail(ptr);
+        LAZY_LOAD(ptr, 4);
         ptr->heartbeat_interval_is_set = 0;
 }
 
@@ -22748,6 +23378,7 @@ void idmef_heartbeat_unset_heartbeat_interval(idmef_heartbeat_t *ptr)
 int idmef_heartbeat_new_heartbeat_interval(idmef_heartbeat_t *ptr, uint32_t **ret)
 {
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 4);
         ptr->heartbeat_interval_is_set = 1;
 
         *ret = &ptr->heartbeat_interval;
@@ -22770,6 +23401,7 @@ idmef_additional_data_t *idmef_heartbeat_get_next_additional_data(idmef_heartbea
         prelude_list_t *tmp = (additional_data_cur) ? &((prelude_linked_object_t *) additional_data_cur)->_list : NULL;
 
         prelude_return_val_if_fail(heartbeat, NULL);
+        LAZY_LOAD(heartbeat, 5);
 
         prelude_list_for_each_continue(&heartbeat->additional_data_list, tmp)
                 return prelude_linked_object_get_object(tmp);
@@ -22793,6 +23425,7 @@ void idmef_heartbeat_set_additional_data(idmef_heartbeat_t *ptr, idmef_additiona
 {
         prelude_return_if_fail(ptr);
         prelude_return_if_fail(object);
+        LAZY_LOAD(ptr, 5);
 
         if ( ! prelude_list_is_empty(&((prelude_linked_object_t *) object)->_list) )
                 prelude_list_del_init(&((prelude_linked_object_t *) object)->_list);
@@ -22819,10 +23452,15 @@ void idmef_heartbeat_set_additional_data(idmef_heartbeat_t *ptr, idmef_additiona
 int idmef_heartbeat_new_additional_data(idmef_heartbeat_t *ptr, idmef_additional_data_t **ret, int pos)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD(ptr, 5);
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_additional_data_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -22847,6 +23485,8 @@ int idmef_heartbeat_copy(const idmef_heartbeat_t *src, idmef_heartbeat_t *dst)
 
         prelude_return_val_if_fail(src, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(dst, prelude_error(PRELUDE_ERROR_ASSERTION));
+        LAZY_LOAD_RO(src);
+        LAZY_LOAD(dst, -1);
 
         ret = 0;
 
@@ -22958,6 +23598,9 @@ int idmef_heartbeat_compare(const idmef_heartbeat_t *obj1, const idmef_heartbeat
         else if ( obj1 == NULL || obj2 == NULL )
                 return -1;
 
+        LAZY_LOAD_RO(obj1);
+        LAZY_LOAD_RO(obj2);
+
         ret = prelude_string_compare(obj1->messageid, obj2->messageid);
         if ( ret != 0 )
                 return ret;
@@ -23039,7 +23682,7 @@ int idmef_heartbeat_compare(const idmef_heartbeat_t *obj1, const idmef_heartbeat
  */
 int idmef_message_new(idmef_message_t **ret)
 {
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -23246,7 +23889,11 @@ int idmef_message_new_version(idmef_message_t *ptr, prelude_string_t **ret)
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         if ( ! ptr->version ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = prelude_string_new(&ptr->version);
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -23327,6 +23974,7 @@ void idmef_message_set_alert(idmef_message_t *ptr, idmef_alert_t *alert)
 int idmef_message_new_alert(idmef_message_t *ptr, idmef_alert_t **ret)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
@@ -23344,7 +23992,10 @@ int idmef_message_new_alert(idmef_message_t *ptr, idmef_alert_t **ret)
                         break;
         }
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_alert_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -23412,6 +24063,7 @@ void idmef_message_set_heartbeat(idmef_message_t *ptr, idmef_heartbeat_t *heartb
 int idmef_message_new_heartbeat(idmef_message_t *ptr, idmef_heartbeat_t **ret)
 {
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
 
@@ -23429,7 +24081,10 @@ int idmef_message_new_heartbeat(idmef_message_t *ptr, idmef_heartbeat_t **ret)
                         break;
         }
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_heartbeat_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -23585,6 +24240,47 @@ prelude_msg_t *idmef_message_get_pmsg(idmef_message_t *message)
 }
 
 
+/**
+ * idmef_message_new_with_arena:
+ * @ret: Pointer where to store the created #idmef_message_t object.
+ *
+ * Create a new #idmef_message_t object, allocated from a memory arena
+ * private to this message.
+ *
+ * Children objects created through the message accessors (for example
+ * idmef_message_new_alert() or idmef_alert_new_classification()) are carved
+ * out of the same arena, as are the strings, times and data created by them.
+ * The whole arena is released at once when the message, and any of its
+ * objects that was referenced on its own, are destroyed. Arena memory is
+ * recycled on a per-thread basis.
+ *
+ * Allocation from the arena is not synchronized: the message must not be
+ * modified from several threads at once, even on distinct objects. Memory
+ * of the objects freed or replaced while the message is alive is only
+ * given back once the whole arena is released, so such a message is not
+ * meant to be modified over and over.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_message_new_with_arena(idmef_message_t **ret)
+{
+        int retval;
+        prelude_arena_t *arena, *prev;
+
+        retval = _prelude_arena_new(&arena, 0);
+        if ( retval < 0 )
+                return retval;
+
+        prev = _prelude_arena_set_current(arena);
+        retval = idmef_message_new(ret);
+        _prelude_arena_set_current(prev);
+
+        _prelude_arena_destroy(arena);
+
+        return retval;
+}
+
+
 /**
  * idmef_message_destroy:
  * @ptr: pointer to a #idmef_message_t object.
@@ -23604,5 +24300,5 @@ void idmef_message_destroy(idmef_message_t *ptr)
         if ( ptr->pmsg )
                 prelude_msg_destroy(ptr->pmsg);
 
-        free(ptr);
+        _prelude_object_free(ptr);
 }
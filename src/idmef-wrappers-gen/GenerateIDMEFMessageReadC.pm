@@ -28,6 +28,7 @@ use IDMEFTree;
 sub     header
 {
      my $self = shift;
+     my $tree = shift;
 
      $self->output("
 /*****
@@ -58,6 +59,7 @@ sub     header
 #include \"config.h\"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #define PRELUDE_ERROR_SOURCE_DEFAULT PRELUDE_ERROR_SOURCE_IDMEF_MESSAGE_READ
@@ -66,9 +68,13 @@ sub     header
 #include \"prelude-list.h\"
 #include \"prelude-extract.h\"
 #include \"prelude-io.h\"
+#include \"prelude-log.h\"
 #include \"idmef-message-id.h\"
 #include \"idmef.h\"
 #include \"idmef-tree-wrap.h\"
+#include \"prelude-arena.h\"
+#include \"idmef-lazy.h\"
+#include \"glthread/lock.h\"
 
 #include \"idmef-message-read.h\"
 
@@ -218,6 +224,303 @@ static inline int prelude_extract_data_safe(idmef_data_t **out, void *buf, uint3
 \}
 
 
+");
+
+     $self->output("
+static inline prelude_bool_t is_class_tag(uint8_t tag)
+\{
+        switch ( tag ) \{
+");
+
+     foreach my $struct ( @{ $tree->{struct_list} } ) {
+         $self->output("                case IDMEF_MSG_" . uc($struct->{short_typename}) . "_TAG:\n") if ( ! $struct->{toplevel} );
+     }
+
+     $self->output("                        return TRUE;
+
+                default:
+                        return FALSE;
+        \}
+\}
+
+
+
+typedef struct \{
+        const char *name;
+        int (*read_child)(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf);
+
+        /*
+         * Tag used on the wire for each child of the class, indexed by child id.
+         */
+        size_t child_count;
+        const uint8_t *child_tag;
+\} idmef_read_class_t;
+
+
+typedef struct \{
+        uint32_t offset;
+        uint8_t tag;
+        prelude_bool_t done;
+\} idmef_lazy_entry_t;
+
+
+/*
+ * The index is kept until its object is destroyed, so that the object can
+ * be read from several threads: decoding is serialized through \@mutex, and
+ * \@done is set once nothing is left to decode, \@msg being released then.
+ */
+struct idmef_lazy \{
+        gl_recursive_lock_t mutex;
+        prelude_bool_t done;
+
+        prelude_msg_t *msg;
+        const idmef_read_class_t *class;
+
+        prelude_bool_t loading;
+        int error;
+        unsigned int count;
+        unsigned int pending;
+        idmef_lazy_entry_t *entry;
+
+        /*
+         * Tags that still have undecoded entries.
+         */
+        uint32_t pending_tags[256 / 32];
+\};
+
+
+
+/*
+ * Record the offset of every child of the object being read from \@msg,
+ * and skip to the end of the object. Nested objects are skipped as a whole.
+ */
+static int lazy_new(idmef_lazy_t **out, const idmef_read_class_t *class, prelude_msg_t *msg)
+\{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len, offset;
+        unsigned int depth = 0, size = 0;
+        idmef_lazy_t *lazy;
+        idmef_lazy_entry_t *entry;
+
+        lazy = calloc(1, sizeof(*lazy));
+        if ( ! lazy )
+                return prelude_error_from_errno(errno);
+
+        while ( 1 ) \{
+                offset = _prelude_msg_get_read_index(msg);
+
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        goto err;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG ) \{
+                        if ( depth == 0 )
+                                break;
+
+                        depth--;
+                        continue;
+                \}
+
+                if ( depth == 0 ) \{
+                        if ( lazy->count == size ) \{
+                                size = (size) ? size * 2 : 16;
+
+                                entry = realloc(lazy->entry, size * sizeof(*entry));
+                                if ( ! entry ) \{
+                                        ret = prelude_error_from_errno(errno);
+                                        goto err;
+                                \}
+
+                                lazy->entry = entry;
+                        \}
+
+                        entry = &lazy->entry[lazy->count++];
+                        entry->offset = offset;
+                        entry->tag = tag;
+                        entry->done = FALSE;
+
+                        lazy->pending_tags[tag / 32] |= 1U << (tag % 32);
+                \}
+
+                if ( is_class_tag(tag) )
+                        depth++;
+        \}
+
+        if ( lazy->count == 0 ) \{
+                free(lazy);
+                *out = NULL;
+                return 0;
+        \}
+
+        gl_recursive_lock_init(lazy->mutex);
+
+        lazy->class = class;
+        lazy->pending = lazy->count;
+        lazy->msg = prelude_msg_ref(msg);
+        *out = lazy;
+
+        return 0;
+
+ err:
+        free(lazy->entry);
+        free(lazy);
+        return ret;
+\}
+
+
+
+static int lazy_load_entry(idmef_lazy_t *lazy, void *object, unsigned int i)
+\{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len, end;
+
+        _prelude_msg_set_read_index(lazy->msg, lazy->entry[i].offset);
+
+        ret = prelude_msg_get(lazy->msg, &tag, &len, &buf);
+        if ( ret == 0 )
+                ret = lazy->class->read_child(object, lazy->msg, tag, len, buf);
+
+        /*
+         * Some children span more than one entry (idmef_data_t values
+         * for example): all of these were consumed.
+         */
+        end = _prelude_msg_get_read_index(lazy->msg);
+        do \{
+                lazy->entry[i].done = TRUE;
+                lazy->pending--;
+        \} while ( ++i < lazy->count && ! lazy->entry[i].done && lazy->entry[i].offset < end );
+
+        return ret;
+\}
+
+
+
+static inline prelude_bool_t lazy_is_done(idmef_lazy_t *lazy)
+\{
+#ifdef HAVE_ATOMIC_BUILTINS
+        return __atomic_load_n(&lazy->done, __ATOMIC_ACQUIRE);
+#else
+        return FALSE;
+#endif
+\}
+
+
+
+/*
+ * Release what the index no longer needs once \@object is fully decoded,
+ * or could not be.
+ */
+static void lazy_set_done(idmef_lazy_t *lazy)
+\{
+        prelude_msg_destroy(lazy->msg);
+        lazy->msg = NULL;
+
+        free(lazy->entry);
+        lazy->entry = NULL;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+        __atomic_store_n(&lazy->done, TRUE, __ATOMIC_RELEASE);
+#else
+        lazy->done = TRUE;
+#endif
+\}
+
+
+
+static int lazy_load(idmef_lazy_t *lazy, void *object, int child)
+\{
+        int ret = 0;
+        uint8_t tag = 0;
+        unsigned int i;
+        uint32_t index;
+        prelude_arena_t *arena;
+
+        /*
+         * Accessors used while decoding call us back.
+         */
+        if ( lazy->loading )
+                return 0;
+
+        if ( lazy->done )
+                return lazy->error;
+
+        if ( child >= 0 ) \{
+                if ( (size_t) child >= lazy->class->child_count )
+                        return 0;
+
+                tag = lazy->class->child_tag[child];
+                if ( ! (lazy->pending_tags[tag / 32] & (1U << (tag % 32))) )
+                        return 0;
+
+                lazy->pending_tags[tag / 32] &= ~(1U << (tag % 32));
+        \}
+
+        lazy->loading = TRUE;
+        index = _prelude_msg_get_read_index(lazy->msg);
+        arena = _prelude_arena_enter(object);
+
+        for ( i = 0; i < lazy->count && ret == 0; i++ ) \{
+                if ( lazy->entry[i].done || (child >= 0 && lazy->entry[i].tag != tag) )
+                        continue;
+
+                ret = lazy_load_entry(lazy, object, i);
+        \}
+
+        _prelude_arena_leave(arena);
+        _prelude_msg_set_read_index(lazy->msg, index);
+        lazy->loading = FALSE;
+
+        if ( ret < 0 ) \{
+                prelude_log(PRELUDE_LOG_ERR, \"error decoding %s: %s.\\n\", lazy->class->name, prelude_strerror(ret));
+                lazy->error = ret;
+        \}
+
+        if ( ret < 0 || lazy->pending == 0 )
+                lazy_set_done(lazy);
+
+        return ret;
+\}
+
+
+
+/*
+ * Decode the pending entries of \@child (all of them if \@child is -1) into
+ * \@object, which might be shared with other threads.
+ *
+ * A decoding error is kept in the index and returned by every later
+ * call, since \@object is then only partially decoded.
+ */
+int _idmef_lazy_load(idmef_lazy_t *lazy, void *object, int child)
+\{
+        int ret;
+
+        if ( lazy_is_done(lazy) )
+                return lazy->error;
+
+        gl_recursive_lock_lock(lazy->mutex);
+        ret = lazy_load(lazy, object, child);
+        gl_recursive_lock_unlock(lazy->mutex);
+
+        return ret;
+\}
+
+
+
+void _idmef_lazy_destroy(idmef_lazy_t *lazy)
+\{
+        if ( lazy->msg )
+                prelude_msg_destroy(lazy->msg);
+
+        free(lazy->entry);
+        gl_recursive_lock_destroy(lazy->mutex);
+        free(lazy);
+\}
+
+
 ");
 }
 
@@ -267,7 +570,6 @@ sub     struct_field_struct
 
     $self->output("
                         case IDMEF_MSG_",  uc($field->{short_typename}), "_TAG", ": \{
-                                int ret;
                                 $field->{typename} *tmp = NULL;
 ");
 
@@ -285,10 +587,12 @@ sub     struct_field_struct
 ");
     }
 
+    my  $read = ( $self->{index_children} && $tree->{objs}->{$field->{typename}}->{lazy} ) ? "index" : "read";
+
     $self->output("
 
 
-                                ret = idmef_$field->{short_typename}_read(tmp, msg);
+                                ret = idmef_$field->{short_typename}_${read}(tmp, msg);
                                 if ( ret < 0 )
                                         return ret;
 
@@ -309,12 +613,191 @@ sub     struct_field_union
     }
 }
 
+sub     struct_fields
+{
+    my  $self = shift;
+    my  $tree = shift;
+    my  $struct = shift;
+
+    foreach my $field ( @{$struct->{field_list}} ) {
+
+        if ( $field->{metatype} & &METATYPE_NORMAL ) {
+
+            if ( $field->{metatype} & &METATYPE_PRIMITIVE ) {
+                $self->struct_field_normal($tree, $struct, $field);
+
+            } elsif ( $field->{metatype} & &METATYPE_ENUM ) {
+                $self->struct_field_normal($tree, $struct, $field, "int32", "int32_t");
+
+            } else {
+                $self->struct_field_struct($tree, $struct, $field);
+            }
+
+        } elsif ( $field->{metatype} & &METATYPE_LIST ) {
+            if ( $field->{metatype} & &METATYPE_PRIMITIVE ) {
+                $self->struct_field_normal($tree, $struct, $field);
+
+            } else {
+                $self->struct_field_struct($tree, $struct, $field, $field->{short_name});
+            }
+
+        } elsif ( $field->{metatype} & &METATYPE_UNION ) {
+            $self->struct_field_union($tree, $struct, $field);
+        }
+    }
+}
+
+sub     struct_read
+{
+    my  $self = shift;
+    my  $tree = shift;
+    my  $struct = shift;
+    my  $func = shift;
+
+    $self->output("
+$func($struct->{typename} *$struct->{short_typename}, prelude_msg_t *msg)
+\{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+
+        while ( 1 ) \{
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                switch ( tag ) \{
+");
+
+    $self->struct_fields($tree, $struct);
+
+    $self->output("
+                        case IDMEF_MSG_END_OF_TAG:
+                                return 0;
+
+                        default:
+                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, \"Unknown tag while reading " . $struct->{typename} . ": '%u'\", tag);
+                \}
+
+        \}
+
+        return 0;
+\}
+");
+}
+
+sub     child_tags
+{
+    my  $struct = shift;
+    my  @tags;
+
+    foreach my $field ( @{$struct->{field_list}} ) {
+
+        if ( $field->{metatype} & &METATYPE_UNION ) {
+            push(@tags, "IDMEF_MSG_" . uc($_->{short_typename}) . "_TAG") foreach ( @{$field->{member_list}} );
+            push(@tags, "IDMEF_MSG_END_OF_TAG");
+
+        } elsif ( $field->{metatype} & (&METATYPE_PRIMITIVE | &METATYPE_ENUM) ) {
+            push(@tags, "IDMEF_MSG_" . uc($struct->{short_typename}) . "_" . uc($field->{short_name}));
+
+        } else {
+            push(@tags, "IDMEF_MSG_" . uc($field->{short_typename}) . "_TAG");
+        }
+    }
+
+    return @tags;
+}
+
+sub     struct_read_child
+{
+    my  $self = shift;
+    my  $tree = shift;
+    my  $struct = shift;
+    my  $cases = "";
+    my  $file = $self->{file};
+
+    #
+    # Reuse the switch cases of the regular reader, one level of indentation less.
+    #
+    open(my $fh, '>', \$cases);
+    $self->{file} = $fh;
+    $self->struct_fields($tree, $struct);
+    close($fh);
+    $self->{file} = $file;
+
+    $cases =~ s/^        //mg;
+
+    $self->output("
+static int idmef_$struct->{short_typename}_read_child(void *object, prelude_msg_t *msg, uint8_t tag, uint32_t len, void *buf)
+\{
+        int ret;
+        $struct->{typename} *$struct->{short_typename} = object;
+
+        switch ( tag ) \{
+$cases
+                default:
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, \"Unknown tag while reading " . $struct->{typename} . ": '%u'\", tag);
+        \}
+
+        return 0;
+\}
+
+
+static const uint8_t idmef_$struct->{short_typename}_child_tags[] = \{
+");
+
+    $self->output("        $_,\n") foreach ( child_tags($struct) );
+
+    $self->output("\};
+
+
+static const idmef_read_class_t idmef_$struct->{short_typename}_read_class = \{
+        \"$struct->{typename}\",
+        idmef_$struct->{short_typename}_read_child,
+        sizeof(idmef_$struct->{short_typename}_child_tags),
+        idmef_$struct->{short_typename}_child_tags
+\};
+");
+}
+
+sub     struct_index
+{
+    my  $self = shift;
+    my  $tree = shift;
+    my  $struct = shift;
+
+    $self->output("
+
+/*
+ * Index the children of \@$struct->{short_typename} without decoding them:
+ * they are decoded when first accessed.
+ */
+static int idmef_$struct->{short_typename}_index($struct->{typename} *$struct->{short_typename}, prelude_msg_t *msg)
+\{
+        int ret;
+        idmef_lazy_t *lazy;
+
+        ret = lazy_new(&lazy, &idmef_$struct->{short_typename}_read_class, msg);
+        if ( ret < 0 )
+                return ret;
+
+        _idmef_$struct->{short_typename}_set_lazy($struct->{short_typename}, lazy);
+
+        return 0;
+\}
+");
+}
+
 sub     struct
 {
     my  $self = shift;
     my  $tree = shift;
     my  $struct = shift;
 
+    $self->struct_read_child($tree, $struct);
+    $self->struct_index($tree, $struct) if ( $struct->{lazy} );
+
     $self->output("
 /**
  * idmef_$struct->{short_typename}_read:
@@ -325,7 +808,9 @@ sub     struct
  * store it into \@$struct->{short_typename}.
  *
  * Returns: 0 on success, a negative value if an error occured.
- */
+ */");
+
+    $self->output("
 int idmef_$struct->{short_typename}_read($struct->{typename} *$struct->{short_typename}, prelude_msg_t *msg)
 \{
         int ret;
@@ -338,47 +823,382 @@ int idmef_$struct->{short_typename}_read($struct->{typename} *$struct->{short_ty
                 if ( ret < 0 )
                         return ret;
 
-                switch ( tag ) \{
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                ret = idmef_$struct->{short_typename}_read_child($struct->{short_typename}, msg, tag, len, buf);
+                if ( ret < 0 )
+                        return ret;
+        \}
+
+        return 0;
+\}
 ");
 
-    foreach my $field ( @{$struct->{field_list}} ) {
+    return if ( ! grep { $tree->{objs}->{$_->{typename}}->{lazy} } map { $_->{metatype} & &METATYPE_UNION ? @{$_->{member_list}} : $_ } @{$struct->{field_list}} );
 
-        if ( $field->{metatype} & &METATYPE_NORMAL ) {
+    #
+    # Same as above, with children that support it being indexed rather than decoded.
+    #
+    $self->{index_children} = 1;
+    $self->output("\n");
+    $self->struct_read($tree, $struct, "static int idmef_$struct->{short_typename}_read_index");
+    $self->{index_children} = 0;
+}
 
-            if ( $field->{metatype} & &METATYPE_PRIMITIVE ) {
-                $self->struct_field_normal($tree, $struct, $field);
+sub     footer
+{
+    my  $self = shift;
+    my  $tree = shift;
 
-            } elsif ( $field->{metatype} & &METATYPE_ENUM ) {
-                $self->struct_field_normal($tree, $struct, $field, "int32", "int32_t");
+    $self->output("
 
-            } else {
-                $self->struct_field_struct($tree, $struct, $field);
-            }
+/**
+ * idmef_message_read_borrowed:
+ * \@message: Pointer where to store the created #idmef_message_t object.
+ * \@msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Create a new #idmef_message_t object, and read it from the \@msg message.
+ *
+ * Unlike idmef_message_read(), the created message and all of its children
+ * are carved out of a single memory arena, and strings reference the \@msg
+ * payload rather than being copied. The arena is released at once when the
+ * message, and any of its objects that was referenced on its own, are destroyed.
+ *
+ * This is an opt-in alternative to idmef_message_read(), meant for consumers
+ * handling each message as a whole: a single object of the message kept
+ * with its own reference holds the whole arena, and the \@msg payload, in memory.
+ *
+ * On success, \@msg is attached to the created message (see idmef_message_set_pmsg()).
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_message_read_borrowed(idmef_message_t **message, prelude_msg_t *msg)
+\{
+        int ret;
+        prelude_arena_t *arena, *prev;
 
-        } elsif ( $field->{metatype} & &METATYPE_LIST ) {
-            if ( $field->{metatype} & &METATYPE_PRIMITIVE ) {
-                $self->struct_field_normal($tree, $struct, $field);
+        /*
+         * The decoded tree is usually a few times bigger than its wire
+         * representation: size the initial arena chunk accordingly.
+         */
+        ret = _prelude_arena_new(&arena, prelude_msg_get_datalen(msg) * 4);
+        if ( ret < 0 )
+                return ret;
 
-            } else {
-                $self->struct_field_struct($tree, $struct, $field, $field->{short_name});
-            }
+        _prelude_arena_set_msg(arena, msg);
+        prev = _prelude_arena_set_current(arena);
 
-        } elsif ( $field->{metatype} & &METATYPE_UNION ) {
-            $self->struct_field_union($tree, $struct, $field);
-        }
-    }
+        ret = idmef_message_new(message);
+        if ( ret == 0 ) \{
+                ret = idmef_message_read(*message, msg);
+                if ( ret < 0 )
+                        idmef_message_destroy(*message);
+                else
+                        idmef_message_set_pmsg(*message, msg);
+        \}
+
+        _prelude_arena_set_current(prev);
+        _prelude_arena_destroy(arena);
+
+        return ret;
+\}
+
+
+
+/**
+ * idmef_message_read_lazy:
+ * \@message: Pointer where to store the created #idmef_message_t object.
+ * \@msg: Pointer to a #prelude_msg_t object, containing a message.
+ *
+ * Same as idmef_message_read_borrowed(), except that the children of the
+ * alert or heartbeat contained in \@msg are only indexed: each of them is
+ * decoded the first time it is accessed, through the accessor functions
+ * or idmef_path_get(). Consumers that only look at a few fields of each
+ * message thus avoid decoding the rest of it.
+ *
+ * The framing of \@msg is checked here, but the content of a child only
+ * once it is decoded: if this fails, idmef_path_get() returns the error
+ * for any field of the alert or heartbeat from then on.
+ *
+ * Decoding is serialized, so that a lazily read message can be read from
+ * several threads at once. It should not be modified concurrently though.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_message_read_lazy(idmef_message_t **message, prelude_msg_t *msg)
+\{
+        int ret;
+        prelude_arena_t *arena, *prev;
+
+        ret = _prelude_arena_new(&arena, prelude_msg_get_datalen(msg));
+        if ( ret < 0 )
+                return ret;
+
+        _prelude_arena_set_msg(arena, msg);
+        prev = _prelude_arena_set_current(arena);
+
+        ret = idmef_message_new(message);
+        if ( ret == 0 ) \{
+                ret = idmef_message_read_index(*message, msg);
+                if ( ret < 0 )
+                        idmef_message_destroy(*message);
+                else
+                        idmef_message_set_pmsg(*message, msg);
+        \}
+
+        _prelude_arena_set_current(prev);
+        _prelude_arena_destroy(arena);
+
+        return ret;
+\}
+
+
+
+");
 
     $self->output("
-                        case IDMEF_MSG_END_OF_TAG:
+static const idmef_read_class_t *get_read_class(idmef_class_id_t class)
+\{
+        switch ( class ) \{
+");
+
+    foreach my $struct ( @{ $tree->{struct_list} } ) {
+        $self->output("                case IDMEF_CLASS_ID_" . uc($struct->{short_typename}) . ":
+                        return &idmef_$struct->{short_typename}_read_class;
+
+");
+    }
+
+    $self->output("                default:
+                        return NULL;
+        \}
+\}
+
+
+
+typedef enum \{
+        READ_PATHS_SKIP,
+        READ_PATHS_PARTIAL,
+        READ_PATHS_FULL
+\} read_paths_action_t;
+
+
+typedef struct \{
+        prelude_msg_t *msg;
+
+        size_t count;
+        idmef_path_t * const *path;
+
+        /*
+         * Child ids leading to the object being read, paths are at most 16 elements deep.
+         */
+        idmef_class_child_id_t route[16];
+\} read_paths_t;
+
+
+
+static int skip_object(prelude_msg_t *msg)
+\{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+        unsigned int depth = 0;
+
+        while ( 1 ) \{
+                ret = prelude_msg_get(msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG ) \{
+                        if ( depth == 0 )
                                 return 0;
 
-                        default:
-                                return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, \"Unknown tag while reading " . $struct->{typename} . ": '%u'\", tag);
+                        depth--;
                 \}
 
+                else if ( is_class_tag(tag) )
+                        depth++;
         \}
+\}
 
-        return 0;
+
+
+/*
+ * Whether \@child, found at \@depth below the current route, is needed by
+ * one of the requested paths: either as a whole, or because one of its own
+ * children is.
+ */
+static read_paths_action_t read_paths_get_action(read_paths_t *rp, unsigned int depth, idmef_class_child_id_t child)
+\{
+        size_t i;
+        unsigned int j, pdepth;
+        const char *key;
+        read_paths_action_t action = READ_PATHS_SKIP;
+
+        for ( i = 0; i < rp->count && action != READ_PATHS_FULL; i++ ) \{
+                pdepth = idmef_path_get_depth(rp->path[i]);
+                if ( pdepth <= depth || _idmef_path_get_position(rp->path[i], depth) != child )
+                        continue;
+
+                for ( j = 0; j < depth; j++ ) \{
+                        if ( _idmef_path_get_position(rp->path[i], j) != rp->route[j] )
+                                break;
+                \}
+
+                if ( j < depth )
+                        continue;
+
+                /*
+                 * Keyed list elements are matched on the decoded key.
+                 */
+                if ( pdepth == depth + 1 || depth + 1 >= sizeof(rp->route) / sizeof(*rp->route) ||
+                     idmef_path_get_key(rp->path[i], depth, &key) == 0 )
+                        action = READ_PATHS_FULL;
+                else
+                        action = READ_PATHS_PARTIAL;
+        \}
+
+        return action;
+\}
+
+
+
+static int read_paths_object(read_paths_t *rp, unsigned int depth, idmef_class_id_t class, void *object)
+\{
+        int ret;
+        void *buf, *child;
+        uint8_t tag;
+        uint32_t len;
+        size_t i;
+        read_paths_action_t action;
+        const idmef_read_class_t *rclass = get_read_class(class);
+
+        while ( 1 ) \{
+                ret = prelude_msg_get(rp->msg, &tag, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( tag == IDMEF_MSG_END_OF_TAG )
+                        return 0;
+
+                for ( i = 0; i < rclass->child_count && rclass->child_tag[i] != tag; i++ );
+
+                if ( i == rclass->child_count )
+                        return prelude_error_verbose(PRELUDE_ERROR_IDMEF_UNKNOWN_TAG, \"Unknown tag while reading %s: '%u'\", rclass->name, tag);
+
+                action = read_paths_get_action(rp, depth, i);
+                if ( action == READ_PATHS_SKIP ) \{
+                        /*
+                         * idmef_data_t values span two entries with the same
+                         * tag: the second one is skipped the same way.
+                         */
+                        if ( is_class_tag(tag) ) \{
+                                ret = skip_object(rp->msg);
+                                if ( ret < 0 )
+                                        return ret;
+                        \}
+
+                        continue;
+                \}
+
+                if ( action == READ_PATHS_FULL || ! is_class_tag(tag) ) \{
+                        ret = rclass->read_child(object, rp->msg, tag, len, buf);
+                        if ( ret < 0 )
+                                return ret;
+
+                        continue;
+                \}
+
+                ret = idmef_class_new_child(object, class, i, IDMEF_LIST_APPEND, &child);
+                if ( ret < 0 )
+                        return ret;
+
+                rp->route[depth] = i;
+
+                ret = read_paths_object(rp, depth + 1, idmef_class_get_child_class(class, i), child);
+                if ( ret < 0 )
+                        return ret;
+        \}
+\}
+
+
+
+/**
+ * idmef_message_read_paths:
+ * \@msg: Pointer to a #prelude_msg_t object, containing a message.
+ * \@paths: Array of #idmef_path_t objects, relative to the message root.
+ * \@count: Number of elements in \@paths.
+ * \@values: Array of \@count elements where to store the retrieved values.
+ *
+ * Retrieve the values of \@paths from the message contained in \@msg,
+ * without decoding the whole message: the message is scanned once, and
+ * the objects that are not on the way to one of \@paths are skipped
+ * without being decoded.
+ *
+ * For each path, \@values is set the same way idmef_path_get() would on
+ * the fully decoded message, or to NULL if the path is not set.
+ *
+ * Returns: the number of paths that were found in \@msg, or a negative value if an error occured.
+ */
+int idmef_message_read_paths(prelude_msg_t *msg, idmef_path_t * const *paths, size_t count, idmef_value_t **values)
+\{
+        int ret, found = 0;
+        size_t i;
+        read_paths_t rp;
+        idmef_message_t *message;
+        prelude_arena_t *arena, *prev;
+
+        rp.msg = msg;
+        rp.path = paths;
+        rp.count = count;
+
+        ret = _prelude_arena_new(&arena, prelude_msg_get_datalen(msg));
+        if ( ret < 0 )
+                return ret;
+
+        _prelude_arena_set_msg(arena, msg);
+        prev = _prelude_arena_set_current(arena);
+
+        ret = idmef_message_new(&message);
+        if ( ret == 0 ) \{
+                ret = read_paths_object(&rp, 0, IDMEF_CLASS_ID_MESSAGE, message);
+                if ( ret < 0 )
+                        idmef_message_destroy(message);
+        \}
+
+        _prelude_arena_set_current(prev);
+        _prelude_arena_destroy(arena);
+
+        if ( ret < 0 )
+                return ret;
+
+        /*
+         * Values reference the decoded objects, which remain valid until
+         * the last value is destroyed.
+         */
+        for ( i = 0; i < count; i++ ) \{
+                values[i] = NULL;
+
+                ret = idmef_path_get(paths[i], message, &values[i]);
+                if ( ret < 0 )
+                        break;
+
+                if ( ret > 0 )
+                        found++;
+        \}
+
+        if ( ret < 0 ) \{
+                while ( i-- > 0 ) \{
+                        if ( values[i] )
+                                idmef_value_destroy(values[i]);
+                \}
+        \}
+
+        idmef_message_destroy(message);
+
+        return ( ret < 0 ) ? ret : found;
 \}
 ");
 }
@@ -74,6 +74,9 @@ sub     footer
     my  $self = shift;
 
     $self->output("
+int idmef_message_read_borrowed(idmef_message_t **message, prelude_msg_t *msg);
+int idmef_message_read_lazy(idmef_message_t **message, prelude_msg_t *msg);
+int idmef_message_read_paths(prelude_msg_t *msg, idmef_path_t * const *paths, size_t count, idmef_value_t **values);
 
 #ifdef __cplusplus
  }
@@ -91,48 +91,42 @@ static inline int prelude_string_write(prelude_string_t *string, prelude_msgbuf_
         if ( ! string || prelude_string_is_empty(string) )
                 return 0;
 
-        return prelude_msgbuf_set(msg, tag, prelude_string_get_len(string) + 1, prelude_string_get_string(string));
+        return prelude_msgbuf_set_string(msg, tag, prelude_string_get_string(string), prelude_string_get_len(string));
 \}
 
 
 
 static inline int uint64_write(uint64_t data, prelude_msgbuf_t *msg, uint8_t tag)
 \{
-        uint64_t dst;
-
-        dst = prelude_hton64(data);
-
-        return prelude_msgbuf_set(msg, tag, sizeof(dst), &dst);
+        return prelude_msgbuf_set_uint(msg, tag, sizeof(data), data);
 \}
 
 
 
 static inline int uint32_write(uint32_t data, prelude_msgbuf_t *msg, uint8_t tag)
 \{
-        data = htonl(data);
-        return prelude_msgbuf_set(msg, tag, sizeof(data), &data);
+        return prelude_msgbuf_set_uint(msg, tag, sizeof(data), data);
 \}
 
 
 
 static inline int int32_write(uint32_t data, prelude_msgbuf_t *msg, uint8_t tag)
 \{
-        return uint32_write(data, msg, tag);
+        return prelude_msgbuf_set_int(msg, tag, sizeof(data), (int32_t) data);
 \}
 
 
 
 static inline int uint8_write(uint8_t data, prelude_msgbuf_t *msg, uint8_t tag)
 \{
-        return prelude_msgbuf_set(msg, tag, sizeof (data), &data);
+        return prelude_msgbuf_set_uint(msg, tag, sizeof(data), data);
 \}
 
 
 
 static inline int uint16_write(uint16_t data, prelude_msgbuf_t *msg, uint8_t tag)
 \{
-        data = htons(data);
-        return prelude_msgbuf_set(msg, tag, sizeof(data), &data);
+        return prelude_msgbuf_set_uint(msg, tag, sizeof(data), data);
 \}
 
 
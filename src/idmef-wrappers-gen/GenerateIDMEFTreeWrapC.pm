@@ -78,6 +78,8 @@ sub     header
 #include \"idmef-class.h\"
 #include \"idmef-value.h\"
 #include \"idmef-object-prv.h\"
+#include \"prelude-arena.h\"
+#include \"idmef-lazy.h\"
 
 #include \"idmef-tree-wrap.h\"
 #include \"libmissing.h\"
@@ -109,6 +111,36 @@ sub     header
 #define HIDE(type, name) type name
 
 #define REFCOUNT int refcount
+#define LAZY_DECODE idmef_lazy_t *lazy
+
+/*
+ * Decode the given child of a lazily read object, or all of them with -1.
+ */
+#define LAZY_LOAD(ptr, child) do {                                      \\
+        if ( (ptr)->lazy )                                              \\
+                _idmef_lazy_load((ptr)->lazy, (void *) (ptr), (child)); \\
+} while (0)
+
+/*
+ * Decode all the children of a const object, as copy and compare do:
+ * this fills the object in without changing what it holds, and decoding
+ * is serialized by the index, so that the object can be shared.
+ */
+static inline void lazy_load_ro(idmef_lazy_t *lazy, const void *object)
+\{
+        union \{
+                void *rw;
+                const void *ro;
+        \} obj;
+
+        obj.ro = object;
+
+        if ( lazy )
+                _idmef_lazy_load(lazy, obj.rw, -1);
+\}
+
+#define LAZY_LOAD_RO(ptr) lazy_load_ro((ptr)->lazy, (ptr))
+
 #define REQUIRED(type, name) type name
 #define IGNORED(type, name) type name
 
@@ -296,6 +328,75 @@ static void list_insert(prelude_list_t *head, prelude_list_t *item, int pos)
 ");
 }
 
+sub     child_id
+{
+    my  $struct = shift;
+    my  $name = shift;
+    my  $n = 0;
+
+    foreach my $field ( @{ $struct->{field_list} } ) {
+        if ( $field->{metatype} & &METATYPE_UNION ) {
+            foreach my $member ( @{ $field->{member_list} } ) {
+                return $n if ( $member->{name} eq $name );
+                $n++;
+            }
+        }
+
+        elsif ( $field->{name} eq $name ) {
+            return $n;
+        }
+
+        $n++;
+    }
+
+    die "unknown child $name in $struct->{typename}";
+}
+
+sub     lazy_load
+{
+    my  $struct = shift;
+    my  $ptr = shift;
+    my  $out = "";
+
+    return "" if ( ! $struct->{lazy} );
+
+    foreach my $name ( @_ ) {
+        my $child = ($name eq "*") ? -1 : child_id($struct, $name);
+        $out .= "        LAZY_LOAD($ptr, $child);\n";
+    }
+
+    return $out;
+}
+
+sub     lazy_load_ro
+{
+    my  $struct = shift;
+    my  $out = "";
+
+    return "" if ( ! $struct->{lazy} );
+
+    foreach my $ptr ( @_ ) {
+        $out .= "        LAZY_LOAD_RO($ptr);\n";
+    }
+
+    return $out;
+}
+
+sub     lazy_load_child
+{
+    my  $struct = shift;
+
+    return "" if ( ! $struct->{lazy} );
+
+    return "
+        if ( ptr->lazy ) \{
+                int retval = _idmef_lazy_load(ptr->lazy, ptr, child);
+                if ( retval < 0 )
+                        return retval;
+        \}
+";
+}
+
 sub     struct_desc
 {
     my  $self = shift;
@@ -336,7 +437,7 @@ sub     struct_constructor
  */
 int idmef_$struct->{short_typename}_new($struct->{typename} **ret)
 \{
-        *ret = calloc(1, sizeof(**ret));
+        *ret = _prelude_object_calloc(sizeof(**ret));
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
@@ -422,7 +523,7 @@ int _idmef_$struct->{short_typename}_get_child(void *p, idmef_class_child_id_t c
 
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
         *childptr = NULL;
-
+", lazy_load_child($struct), "
         switch ( child ) \{
 ");
 
@@ -538,7 +639,7 @@ int _idmef_$struct->{short_typename}_destroy_child(void *p, idmef_class_child_id
         $struct->{typename} *ptr = p;
 
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
-
+", lazy_load_child($struct), "
         switch ( child ) \{
 ");
 
@@ -688,7 +789,7 @@ int _idmef_$struct->{short_typename}_new_child(void *p, idmef_class_child_id_t c
         $struct->{typename} *ptr = p;
 
         prelude_return_val_if_fail(p, prelude_error(PRELUDE_ERROR_ASSERTION));
-
+", lazy_load_child($struct), "
         switch ( child ) \{
 ");
 
@@ -781,7 +882,7 @@ int idmef_$struct->{short_typename}_copy(const $struct->{typename} *src, $struct
 
         prelude_return_val_if_fail(src, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(dst, prelude_error(PRELUDE_ERROR_ASSERTION));
-
+", lazy_load_ro($struct, "src"), lazy_load($struct, "dst", "*"), "
         ret = 0;
 ");
 
@@ -965,7 +1066,7 @@ int idmef_$struct->{short_typename}_compare(const $struct->{typename} *obj1, con
 
         else if ( obj1 == NULL || obj2 == NULL )
                 return -1;
-");
+", ($struct->{lazy} ? "\n" : ""), lazy_load_ro($struct, "obj1", "obj2"));
 
     foreach my $field ( @{ $struct->{field_list} } ) {
         my $compare_func = "$field->{short_typename}_compare";
@@ -1081,6 +1182,11 @@ static void idmef_$struct->{short_typename}_destroy_internal($struct->{typename}
         prelude_return_if_fail(ptr);
 ");
 
+    $self->output("
+        if ( ptr->lazy )
+                _idmef_lazy_destroy(ptr->lazy);
+") if ( $struct->{lazy} );
+
     $self->output("
        if ( ! prelude_list_is_empty(&((prelude_linked_object_t *)ptr)->_list) )
                prelude_list_del_init(&((prelude_linked_object_t *)ptr)->_list);
@@ -1188,7 +1294,7 @@ void idmef_$struct->{short_typename}_destroy($struct->{typename} *ptr)
                 return;
 
         idmef_$struct->{short_typename}_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 \}
 ");
 
@@ -1199,7 +1305,7 @@ void idmef_$struct->{short_typename}_destroy($struct->{typename} *ptr)
         prelude_return_if_fail(ptr);
 
         idmef_$struct->{short_typename}_destroy_internal(ptr);
-        free(ptr);
+        _prelude_object_free(ptr);
 \}
 ");
     }
@@ -1233,6 +1339,27 @@ $struct->{typename} *idmef_$struct->{short_typename}_ref($struct->{typename} *$s
 ");
 }
 
+sub     struct_lazy
+{
+    my  $self = shift;
+    my  $tree = shift;
+    my  $struct = shift;
+
+    $struct->{lazy} or return;
+
+    $self->output("
+void _idmef_$struct->{short_typename}_set_lazy($struct->{typename} *ptr, idmef_lazy_t *lazy)
+\{
+        prelude_return_if_fail(ptr);
+
+        if ( ptr->lazy )
+                _idmef_lazy_destroy(ptr->lazy);
+
+        ptr->lazy = lazy;
+\}
+");
+}
+
 sub     struct_field_normal
 {
     my  $self = shift;
@@ -1274,7 +1401,7 @@ sub     struct_field_normal
 $field->{typename} ${ptr}idmef_$struct->{short_typename}_get_${name}($struct->{typename} *ptr)
 \{
         prelude_return_val_if_fail(ptr, 0); /* FIXME */
-");
+", lazy_load($struct, "ptr", $field->{name}));
 
     if ( $field->{metatype} & &METATYPE_OPTIONAL_INT ) {
         $self->output("
@@ -1318,7 +1445,7 @@ $field->{typename} ${ptr}idmef_$struct->{short_typename}_get_${name}($struct->{t
 void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr, $field->{typename} $field_name)
 \{
         prelude_return_if_fail(ptr);
-        ptr->$field->{name} = $field_name;
+", lazy_load($struct, "ptr", $field->{name}), "        ptr->$field->{name} = $field_name;
         ptr->$field->{name}_is_set = 1;
 \}
 
@@ -1326,7 +1453,7 @@ void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr
 void idmef_$struct->{short_typename}_unset_$field->{name}($struct->{typename} *ptr)
 \{
         prelude_return_if_fail(ptr);
-        ptr->$field->{name}_is_set = 0;
+", lazy_load($struct, "ptr", $field->{name}), "        ptr->$field->{name}_is_set = 0;
 \}
 
 ");
@@ -1341,7 +1468,7 @@ void idmef_$struct->{short_typename}_unset_$field->{name}($struct->{typename} *p
 void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr, $field->{typename} *$field_name)
 \{
         prelude_return_if_fail(ptr);
-
+", lazy_load($struct, "ptr", $field->{name}), "
         if ( ptr->$field->{name} )
                 ${destroy_func}(ptr->$field->{name});
 
@@ -1357,7 +1484,7 @@ void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr
 void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr, $field->{typename} *$field_name)
 \{
         prelude_return_if_fail(ptr);
-
+", lazy_load($struct, "ptr", $field->{name}), "
         ${destroy_internal_func}(&ptr->$field->{name});
         if ( $field_name ) {
                 memcpy(&ptr->$field->{name}, $field_name, sizeof(ptr->$field->{name}));
@@ -1372,7 +1499,7 @@ void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr
 void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr, $field->{typename} $field_name)
 \{
         prelude_return_if_fail(ptr);
-
+", lazy_load($struct, "ptr", $field->{name}), "
         if ( ptr->$field->{name} )
                 free(ptr->$field->{name});
 
@@ -1388,7 +1515,7 @@ void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr
 void idmef_$struct->{short_typename}_set_$field->{name}($struct->{typename} *ptr, $field->{typename} $field_name)
 \{
         prelude_return_if_fail(ptr);
-        ptr->$field->{name} = $field_name;
+", lazy_load($struct, "ptr", $field->{name}), "        ptr->$field->{name} = $field_name;
 ");
 
         if ( $struct->{typename} eq "idmef_additional_data_t" and $name eq "type" ) {
@@ -1426,7 +1553,7 @@ int idmef_$struct->{short_typename}_new_${name}($struct->{typename} *ptr, $field
         $need_check = 0;
         $self->output("
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
-        ptr->$field->{name}_is_set = 1;
+", lazy_load($struct, "ptr", $field->{name}), "        ptr->$field->{name}_is_set = 1;
 ");
     } elsif ( $field->{metatype} & &METATYPE_PRIMITIVE ) {
 
@@ -1439,9 +1566,13 @@ int idmef_$struct->{short_typename}_new_${name}($struct->{typename} *ptr, $field
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
-
+", lazy_load($struct, "ptr", $field->{name}), "
         if ( ! ptr->$field->{name} ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = $field->{short_typename}_new(&ptr->$field->{name});
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -1457,9 +1588,13 @@ int idmef_$struct->{short_typename}_new_${name}($struct->{typename} *ptr, $field
         int retval;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
-
+", lazy_load($struct, "ptr", $field->{name}), "
         if ( ! ptr->$field->{name} ) {
+                prelude_arena_t *arena = _prelude_arena_enter(ptr);
+
                 retval = idmef_$field->{short_typename}_new(&ptr->$field->{name});
+                _prelude_arena_leave(arena);
+
                 if ( retval < 0 )
                         return retval;
         }
@@ -1469,7 +1604,7 @@ int idmef_$struct->{short_typename}_new_${name}($struct->{typename} *ptr, $field
                      $need_check = 0;
                      $self->output("
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
-        prelude_list_init(&ptr->$field->{name}._list);");
+", lazy_load($struct, "ptr", $field->{name}), "        prelude_list_init(&ptr->$field->{name}._list);");
                  }
             }
         }
@@ -1480,7 +1615,7 @@ int idmef_$struct->{short_typename}_new_${name}($struct->{typename} *ptr, $field
     if ( $need_check ) {
         $self->output("
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
-");
+", lazy_load($struct, "ptr", $field->{name}), "");
     }
 
     if ( $field->{typename} eq "idmef_additional_data_type_t" and $field->{name} eq "type" ) {
@@ -1513,7 +1648,7 @@ sub     struct_field_union
 $field->{typename} idmef_$struct->{short_typename}_get_$field->{var}($struct->{typename} *ptr)
 \{
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
-        return ptr->$field->{var};
+", lazy_load($struct, "ptr", map { $_->{name} } @{ $field->{member_list} }), "        return ptr->$field->{var};
 \}
 ");
 
@@ -1530,7 +1665,7 @@ $field->{typename} idmef_$struct->{short_typename}_get_$field->{var}($struct->{t
 $member->{typename} *idmef_$struct->{short_typename}_get_$member->{name}($struct->{typename} *ptr)
 \{
         prelude_return_val_if_fail(ptr, NULL);
-        return (ptr->$field->{var} == $member->{value}) ? ptr->$field->{name}.$member->{name} : NULL;
+", lazy_load($struct, "ptr", $member->{name}), "        return (ptr->$field->{var} == $member->{value}) ? ptr->$field->{name}.$member->{name} : NULL;
 \}
 "
 );
@@ -1548,7 +1683,7 @@ $member->{typename} *idmef_$struct->{short_typename}_get_$member->{name}($struct
 void idmef_$struct->{short_typename}_set_$member->{name}($struct->{typename} *ptr, $member->{typename} *$member->{name})
 \{
         prelude_return_if_fail(ptr);
-
+", lazy_load($struct, "ptr", map { $_->{name} } @{ $field->{member_list} }), "
         switch ( ptr->$field->{var} ) \{
 ");
         foreach my $member ( @{ $field->{member_list} } ) {
@@ -1583,9 +1718,10 @@ void idmef_$struct->{short_typename}_set_$member->{name}($struct->{typename} *pt
 int idmef_$struct->{short_typename}_new_$member->{name}($struct->{typename} *ptr, $member->{typename} **ret)
 \{
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
-
+", lazy_load($struct, "ptr", map { $_->{name} } @{ $field->{member_list} }), "
         switch ( ptr->$field->{var} ) \{
 ");
         foreach my $other_member ( @{ $field->{member_list} } ) {
@@ -1610,7 +1746,10 @@ int idmef_$struct->{short_typename}_new_$member->{name}($struct->{typename} *ptr
                         break;
         \}
 
+        arena = _prelude_arena_enter(ptr);
         retval = idmef_$member->{short_typename}_new(ret);
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -1650,7 +1789,7 @@ $field->{typename} *idmef_$struct->{short_typename}_get_next_$field->{short_name
         prelude_list_t *tmp = ($field->{short_typename}_cur) ? &((prelude_linked_object_t *) $field->{short_typename}_cur)->_list : NULL;
 
         prelude_return_val_if_fail($struct->{short_typename}, NULL);
-
+", lazy_load($struct, $struct->{short_typename}, $field->{name}), "
         prelude_list_for_each_continue(&$struct->{short_typename}->$field->{name}, tmp)
                 return prelude_linked_object_get_object(tmp);
 
@@ -1673,7 +1812,7 @@ void idmef_$struct->{short_typename}_set_$field->{short_name}($struct->{typename
 \{
         prelude_return_if_fail(ptr);
         prelude_return_if_fail(object);
-
+", lazy_load($struct, "ptr", $field->{name}), "
         if ( ! prelude_list_is_empty(&((prelude_linked_object_t *) object)->_list) )
                 prelude_list_del_init(&((prelude_linked_object_t *) object)->_list);
 
@@ -1699,10 +1838,14 @@ void idmef_$struct->{short_typename}_set_$field->{short_name}($struct->{typename
 int idmef_$struct->{short_typename}_new_$field->{short_name}($struct->{typename} *ptr, $field->{typename} **ret, int pos)
 \{
         int retval;
+        prelude_arena_t *arena;
 
         prelude_return_val_if_fail(ptr, prelude_error(PRELUDE_ERROR_ASSERTION));
-
+", lazy_load($struct, "ptr", $field->{name}), "
+        arena = _prelude_arena_enter(ptr);
         retval = $new_field_function;
+        _prelude_arena_leave(arena);
+
         if ( retval < 0 )
                 return retval;
 
@@ -1749,6 +1892,7 @@ sub        struct_func
     $self->struct_destroy_child($tree, $struct);
     $self->struct_destroy_internal($tree, $struct);
     $self->struct_destroy($tree, $struct);
+    $self->struct_lazy($tree, $struct);
     $self->struct_fields($tree, $struct);
     $self->struct_copy($tree, $struct);
     $self->struct_clone($tree, $struct);
@@ -1889,6 +2033,47 @@ prelude_msg_t *idmef_message_get_pmsg(idmef_message_t *message)
 \}
 
 
+/**
+ * idmef_message_new_with_arena:
+ * \@ret: Pointer where to store the created #idmef_message_t object.
+ *
+ * Create a new #idmef_message_t object, allocated from a memory arena
+ * private to this message.
+ *
+ * Children objects created through the message accessors (for example
+ * idmef_message_new_alert() or idmef_alert_new_classification()) are carved
+ * out of the same arena, as are the strings, times and data created by them.
+ * The whole arena is released at once when the message, and any of its
+ * objects that was referenced on its own, are destroyed. Arena memory is
+ * recycled on a per-thread basis.
+ *
+ * Allocation from the arena is not synchronized: the message must not be
+ * modified from several threads at once, even on distinct objects. Memory
+ * of the objects freed or replaced while the message is alive is only
+ * given back once the whole arena is released, so such a message is not
+ * meant to be modified over and over.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int idmef_message_new_with_arena(idmef_message_t **ret)
+\{
+        int retval;
+        prelude_arena_t *arena, *prev;
+
+        retval = _prelude_arena_new(&arena, 0);
+        if ( retval < 0 )
+                return retval;
+
+        prev = _prelude_arena_set_current(arena);
+        retval = idmef_message_new(ret);
+        _prelude_arena_set_current(prev);
+
+        _prelude_arena_destroy(arena);
+
+        return retval;
+\}
+
+
 /**
  * idmef_message_destroy:
  * \@ptr: pointer to a #idmef_message_t object.
@@ -1908,7 +2093,7 @@ void idmef_message_destroy(idmef_message_t *ptr)
         if ( ptr->pmsg )
                 prelude_msg_destroy(ptr->pmsg);
 
-        free(ptr);
+        _prelude_object_free(ptr);
 \}
 ");
 
@@ -77,6 +77,8 @@ sub     header
 #define IDMEF_LIST_APPEND  INT_MAX
 #define IDMEF_LIST_PREPEND (INT_MAX - 1)
 
+struct idmef_lazy;
+
 ");
 }
 
@@ -89,6 +91,8 @@ void idmef_message_set_pmsg(idmef_message_t *message, prelude_msg_t *msg);
 
 prelude_msg_t *idmef_message_get_pmsg(idmef_message_t *message);
 
+int idmef_message_new_with_arena(idmef_message_t **ret);
+
 int _idmef_additional_data_type_is_set(idmef_additional_data_t *ad);
 
 #ifdef __cplusplus
@@ -177,6 +181,7 @@ sub     struct_destroy
     my  $struct = shift;
 
     $self->output("void idmef_$struct->{short_typename}_destroy($struct->{typename} *ptr);\n");
+    $self->output("void _idmef_$struct->{short_typename}_set_lazy($struct->{typename} *ptr, struct idmef_lazy *lazy);\n") if ( $struct->{lazy} );
 }
 
 sub     struct_field_normal
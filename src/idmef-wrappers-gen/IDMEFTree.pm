@@ -167,7 +167,7 @@ sub	parse_struct
 {
     my	$self = shift;
     my	$line = shift;
-    my	$struct = { obj_type => &OBJ_STRUCT, toplevel => 0, is_listed => 0, is_key_listed => 0, refcount => 0, desc => [ $line ], attributes => [] };
+    my	$struct = { obj_type => &OBJ_STRUCT, toplevel => 0, is_listed => 0, is_key_listed => 0, refcount => 0, lazy => 0, desc => [ $line ], attributes => [] };
     my	@field_list;
     my	$ptr;
     my	$typename;
@@ -190,6 +190,10 @@ sub	parse_struct
 	    $struct->{refcount} = 1;
 	    $self->debug("struct is refcounted\n");
 
+	} elsif ( $line =~ /^\s*LAZY_DECODE\s*\;\s*$/ ) {
+	    $struct->{lazy} = 1;
+	    $self->debug("struct can be lazily decoded\n");
+
 	} elsif ( $line =~ /^\s*IDMEF_LINKED_OBJECT\s*\;\s*$/ ) {
 	    $struct->{is_listed} = 1;
 	    $self->debug("struct is listed\n");
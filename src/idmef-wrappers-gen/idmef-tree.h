@@ -43,6 +43,10 @@
  *   registers my_struct_t as struct.
  *
  * - TYPE_ID(type, id): set ID number of type 'type' to 'id'
+ *
+ * - LAZY_DECODE: objects of this class can be read from a message without
+ *   decoding their children, which are then decoded on first access
+ *   (see idmef_message_read_lazy()).
  */
 
 
@@ -79,6 +83,8 @@
 
 #define REFCOUNT int refcount
 
+#define LAZY_DECODE idmef_lazy_t *lazy
+
 #define OPTIONAL_INT(type, name) type name; unsigned int name_ ## is_set:1
 
 #define IDENT(name) uint64_t name
@@ -797,6 +803,7 @@ ENUM(idmef) {
 struct {
         IDMEF_OBJECT;
         REFCOUNT;
+        LAZY_DECODE;
         prelude_string_t *messageid;
 
         LISTED_OBJECT(analyzer_list, idmef_analyzer_t);
@@ -831,6 +838,7 @@ struct {
 struct {
         IDMEF_OBJECT;
         REFCOUNT;
+        LAZY_DECODE;
 
         prelude_string_t *messageid;
         LISTED_OBJECT(analyzer_list, idmef_analyzer_t);
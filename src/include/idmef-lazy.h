@@ -0,0 +1,37 @@
+/*****
+*
+* Copyright (C) 2020 CS GROUP - France. All Rights Reserved.
+*
+* This file is part of the Prelude library.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2.1, or (at your option)
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*
+*****/
+
+#ifndef _LIBPRELUDE_IDMEF_LAZY_H
+#define _LIBPRELUDE_IDMEF_LAZY_H
+
+/*
+ * Index of the children of an object read with idmef_message_read_lazy(),
+ * which are still to be decoded. See idmef-message-read.c.
+ */
+typedef struct idmef_lazy idmef_lazy_t;
+
+
+int _idmef_lazy_load(idmef_lazy_t *lazy, void *object, int child);
+
+void _idmef_lazy_destroy(idmef_lazy_t *lazy);
+
+#endif
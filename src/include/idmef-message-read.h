@@ -96,6 +96,9 @@ int idmef_heartbeat_read(idmef_heartbeat_t *heartbeat, prelude_msg_t *msg);
 
 int idmef_message_read(idmef_message_t *message, prelude_msg_t *msg);
 
+int idmef_message_read_borrowed(idmef_message_t **message, prelude_msg_t *msg);
+int idmef_message_read_lazy(idmef_message_t **message, prelude_msg_t *msg);
+int idmef_message_read_paths(prelude_msg_t *msg, idmef_path_t * const *paths, size_t count, idmef_value_t **values);
 
 #ifdef __cplusplus
  }
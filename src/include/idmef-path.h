@@ -94,6 +94,8 @@ int idmef_path_check_operator(const idmef_path_t *path, idmef_criterion_operator
 int idmef_path_get_applicable_operators(const idmef_path_t *path, idmef_criterion_operator_t *result);
 
 #ifndef SWIG
+idmef_class_child_id_t _idmef_path_get_position(const idmef_path_t *path, unsigned int depth);
+
 void _idmef_path_cache_lock(void);
 
 void _idmef_path_cache_reinit(void);
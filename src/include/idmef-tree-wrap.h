@@ -46,6 +46,8 @@
 #define IDMEF_LIST_APPEND  INT_MAX
 #define IDMEF_LIST_PREPEND (INT_MAX - 1)
 
+struct idmef_lazy;
+
 typedef enum {
         IDMEF_ADDITIONAL_DATA_TYPE_ERROR = -1,
         IDMEF_ADDITIONAL_DATA_TYPE_STRING = 0,
@@ -1736,6 +1738,7 @@ const char *idmef_alert_type_to_string(idmef_alert_type_t val);
  * struct {
  *         IDMEF_OBJECT;
  *         REFCOUNT;
+ *         LAZY_DECODE;
  *         prelude_string_t *messageid;
  * 
  *         LISTED_OBJECT(analyzer_list, idmef_analyzer_t);
@@ -1777,6 +1780,7 @@ int _idmef_alert_destroy_child(void *p, idmef_class_child_id_t child, int n);
 #endif
 
 void idmef_alert_destroy(idmef_alert_t *ptr);
+void _idmef_alert_set_lazy(idmef_alert_t *ptr, struct idmef_lazy *lazy);
 prelude_string_t *idmef_alert_get_messageid(idmef_alert_t *ptr);
 void idmef_alert_set_messageid(idmef_alert_t *ptr, prelude_string_t *messageid);
 int idmef_alert_new_messageid(idmef_alert_t *ptr, prelude_string_t **ret);
@@ -1836,6 +1840,7 @@ int idmef_alert_new_overflow_alert(idmef_alert_t *ptr, idmef_overflow_alert_t **
  * struct {
  *         IDMEF_OBJECT;
  *         REFCOUNT;
+ *         LAZY_DECODE;
  * 
  *         prelude_string_t *messageid;
  *         LISTED_OBJECT(analyzer_list, idmef_analyzer_t);
@@ -1864,6 +1869,7 @@ int _idmef_heartbeat_destroy_child(void *p, idmef_class_child_id_t child, int n)
 #endif
 
 void idmef_heartbeat_destroy(idmef_heartbeat_t *ptr);
+void _idmef_heartbeat_set_lazy(idmef_heartbeat_t *ptr, struct idmef_lazy *lazy);
 prelude_string_t *idmef_heartbeat_get_messageid(idmef_heartbeat_t *ptr);
 void idmef_heartbeat_set_messageid(idmef_heartbeat_t *ptr, prelude_string_t *messageid);
 int idmef_heartbeat_new_messageid(idmef_heartbeat_t *ptr, prelude_string_t **ret);
@@ -1953,6 +1959,8 @@ void idmef_message_set_pmsg(idmef_message_t *message, prelude_msg_t *msg);
 
 prelude_msg_t *idmef_message_get_pmsg(idmef_message_t *message);
 
+int idmef_message_new_with_arena(idmef_message_t **ret);
+
 int _idmef_additional_data_type_is_set(idmef_additional_data_t *ad);
 
 #ifdef __cplusplus
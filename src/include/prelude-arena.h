@@ -0,0 +1,53 @@
+/*****
+*
+* Copyright (C) 2020 CS GROUP - France. All Rights Reserved.
+*
+* This file is part of the Prelude library.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2.1, or (at your option)
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*
+*****/
+
+#ifndef _LIBPRELUDE_PRELUDE_ARENA_H
+#define _LIBPRELUDE_PRELUDE_ARENA_H
+
+#include "prelude-msg.h"
+
+
+typedef struct prelude_arena prelude_arena_t;
+
+
+int _prelude_arena_new(prelude_arena_t **arena, size_t size);
+
+void _prelude_arena_destroy(prelude_arena_t *arena);
+
+void _prelude_arena_set_msg(prelude_arena_t *arena, prelude_msg_t *msg);
+
+prelude_arena_t *_prelude_arena_set_current(prelude_arena_t *arena);
+
+prelude_arena_t *_prelude_arena_enter(const void *parent);
+
+void _prelude_arena_leave(prelude_arena_t *prev);
+
+void _prelude_arena_deinit(void);
+
+
+void *_prelude_object_calloc(size_t size);
+
+void _prelude_object_free(void *ptr);
+
+prelude_arena_t *_prelude_object_get_arena(const void *ptr);
+
+#endif
@@ -26,6 +26,7 @@
 
 
 #include "prelude-linked-object.h"
+#include "prelude-inttypes.h"
 
 #ifdef __cplusplus
  extern "C" {
@@ -47,8 +48,64 @@ typedef enum {
         PRELUDE_ASYNC_FLAGS_TIMER   = 0x01
 } prelude_async_flags_t;
 
+/**
+ * prelude_async_overflow_policy_t
+ * @PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK: Wait for room in the queue.
+ * @PRELUDE_ASYNC_OVERFLOW_POLICY_DROP_OLDEST: Drop the oldest objects of the queue.
+ * @PRELUDE_ASYNC_OVERFLOW_POLICY_SPILL: Save the oldest objects of the queue for later processing.
+ *
+ * Behavior of asynchronous queues holding more objects than the configured limit.
+ */
+typedef enum {
+        PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK       = 0,
+        PRELUDE_ASYNC_OVERFLOW_POLICY_DROP_OLDEST = 1,
+        PRELUDE_ASYNC_OVERFLOW_POLICY_SPILL       = 2
+} prelude_async_overflow_policy_t;
+
+/**
+ * prelude_async_scheduling_t
+ * @PRELUDE_ASYNC_SCHEDULING_STRICT: Process higher priority objects first.
+ * @PRELUDE_ASYNC_SCHEDULING_WEIGHTED: Share processing between priorities according to their weight.
+ *
+ * Order in which objects of different priorities within a queue are processed.
+ */
+typedef enum {
+        PRELUDE_ASYNC_SCHEDULING_STRICT   = 0,
+        PRELUDE_ASYNC_SCHEDULING_WEIGHTED = 1
+} prelude_async_scheduling_t;
+
+/*
+ * Number of priority levels of a queue, matching #prelude_msg_priority_t.
+ */
+#define PRELUDE_ASYNC_PRIORITY_COUNT 4
+
 typedef void (*prelude_async_callback_t)(void *object, void *data);
 
+typedef struct prelude_async_queue prelude_async_queue_t;
+
+
+/**
+ * prelude_async_stats_t:
+ * @queued: Number of objects waiting to be processed.
+ * @max_queued: Highest number of objects ever waiting at once.
+ * @processed: Number of objects processed.
+ * @overflowed: Number of objects handed to the overflow callback.
+ * @latency_total: Cumulated time objects spent waiting, in microseconds.
+ * @latency_max: Longest time an object spent waiting, in microseconds.
+ * @stolen: Number of times a queue was picked up by an idle worker.
+ *
+ * Asynchronous processing statistics.
+ */
+typedef struct {
+        uint64_t queued;
+        uint64_t max_queued;
+        uint64_t processed;
+        uint64_t overflowed;
+        uint64_t latency_total;
+        uint64_t latency_max;
+        uint64_t stolen;
+} prelude_async_stats_t;
+
 
 
 #define PRELUDE_ASYNC_OBJECT                   \
@@ -86,6 +143,36 @@ void prelude_async_del(prelude_async_object_t *obj);
 
 void prelude_async_exit(void);
 
+void prelude_async_set_worker_count(unsigned int count);
+
+unsigned int prelude_async_get_worker_count(void);
+
+void prelude_async_set_queue_limit(unsigned int limit);
+
+unsigned int prelude_async_get_queue_limit(void);
+
+void prelude_async_set_overflow_policy(prelude_async_overflow_policy_t policy);
+
+prelude_async_overflow_policy_t prelude_async_get_overflow_policy(void);
+
+void prelude_async_set_scheduling(prelude_async_scheduling_t sched);
+
+prelude_async_scheduling_t prelude_async_get_scheduling(void);
+
+void prelude_async_get_stats(prelude_async_stats_t *stats);
+
+int prelude_async_queue_new(prelude_async_queue_t **queue);
+
+void prelude_async_queue_destroy(prelude_async_queue_t *queue);
+
+void prelude_async_queue_add(prelude_async_queue_t *queue, prelude_async_object_t *obj);
+
+void prelude_async_queue_add_priority(prelude_async_queue_t *queue, prelude_async_object_t *obj, unsigned int priority);
+
+void prelude_async_queue_set_overflow_callback(prelude_async_queue_t *queue, prelude_async_callback_t func);
+
+void prelude_async_queue_get_stats(prelude_async_queue_t *queue, prelude_async_stats_t *stats);
+
 
 void _prelude_async_fork_prepare(void);
 void _prelude_async_fork_parent(void);
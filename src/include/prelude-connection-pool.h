@@ -26,6 +26,7 @@
 
 #include "prelude-list.h"
 #include "prelude-connection.h"
+#include "prelude-async.h"
 
 #ifdef __cplusplus
  extern "C" {
@@ -33,16 +34,40 @@
 
 typedef enum {
         PRELUDE_CONNECTION_POOL_FLAGS_RECONNECT        = 0x01,
-        PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER         = 0x02
+        PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER         = 0x02,
+        PRELUDE_CONNECTION_POOL_FLAGS_BATCH            = 0x04,
+        PRELUDE_CONNECTION_POOL_FLAGS_ACK              = 0x08,
+        PRELUDE_CONNECTION_POOL_FLAGS_REPLAY           = 0x10,
+        PRELUDE_CONNECTION_POOL_FLAGS_TLS_OFFLOAD      = 0x20,
+        PRELUDE_CONNECTION_POOL_FLAGS_COMPACT          = 0x40,
+        PRELUDE_CONNECTION_POOL_FLAGS_DICTIONARY       = 0x80,
+        PRELUDE_CONNECTION_POOL_FLAGS_COMPRESSION      = 0x100
 } prelude_connection_pool_flags_t;
 
 
 typedef enum {
         PRELUDE_CONNECTION_POOL_EVENT_INPUT            = 0x01,
         PRELUDE_CONNECTION_POOL_EVENT_DEAD             = 0x02,
-        PRELUDE_CONNECTION_POOL_EVENT_ALIVE            = 0x04
+        PRELUDE_CONNECTION_POOL_EVENT_ALIVE            = 0x04,
+        PRELUDE_CONNECTION_POOL_EVENT_REPLAY           = 0x08
 } prelude_connection_pool_event_t;
 
+
+typedef enum {
+        PRELUDE_CONNECTION_POOL_BALANCE_ROUND_ROBIN    = 0,
+        PRELUDE_CONNECTION_POOL_BALANCE_HASH           = 1,
+        PRELUDE_CONNECTION_POOL_BALANCE_LEAST_LOADED   = 2
+} prelude_connection_pool_balance_t;
+
+
+typedef struct {
+        uint64_t replayed_msg;
+        uint64_t replayed_bytes;
+        uint64_t remaining_msg;
+        unsigned int eta; /* seconds */
+} prelude_connection_pool_replay_stats_t;
+
+
 typedef struct prelude_connection_pool prelude_connection_pool_t;
 
 
@@ -50,6 +75,8 @@ void prelude_connection_pool_broadcast(prelude_connection_pool_t *pool, prelude_
 
 void prelude_connection_pool_broadcast_async(prelude_connection_pool_t *pool, prelude_msg_t *msg);
 
+void prelude_connection_pool_get_async_stats(prelude_connection_pool_t *pool, prelude_async_stats_t *stats);
+
 int prelude_connection_pool_init(prelude_connection_pool_t *pool);
 
 int prelude_connection_pool_new(prelude_connection_pool_t **ret,
@@ -75,8 +102,27 @@ prelude_connection_pool_t *prelude_connection_pool_ref(prelude_connection_pool_t
 
 prelude_connection_pool_flags_t prelude_connection_pool_get_flags(prelude_connection_pool_t *pool);
 
+prelude_connection_feature_t prelude_connection_pool_get_features(prelude_connection_pool_t *pool);
+
 void prelude_connection_pool_set_flags(prelude_connection_pool_t *pool, prelude_connection_pool_flags_t flags);
 
+void prelude_connection_pool_set_batch_size(prelude_connection_pool_t *pool, size_t size);
+
+void prelude_connection_pool_set_batch_delay(prelude_connection_pool_t *pool, unsigned int delay);
+
+void prelude_connection_pool_set_ack_window(prelude_connection_pool_t *pool, size_t window);
+
+unsigned int prelude_connection_pool_get_unacked_msg_count(prelude_connection_pool_t *pool);
+
+uint64_t prelude_connection_pool_get_ack_dropped_msg_count(prelude_connection_pool_t *pool);
+
+void prelude_connection_pool_set_balance(prelude_connection_pool_t *pool, prelude_connection_pool_balance_t balance);
+
+void prelude_connection_pool_set_replay_rate(prelude_connection_pool_t *pool, unsigned int rate);
+
+int prelude_connection_pool_get_replay_stats(prelude_connection_pool_t *pool, prelude_connection_t *cnx,
+                                             prelude_connection_pool_replay_stats_t *stats);
+
 void prelude_connection_pool_set_required_permission(prelude_connection_pool_t *pool, prelude_connection_permission_t req_perm);
 
 void prelude_connection_pool_set_data(prelude_connection_pool_t *pool, void *data);
@@ -39,10 +39,24 @@ typedef enum {
         PRELUDE_CONNECTION_STATE_ESTABLISHED     = 0x01
 } prelude_connection_state_t;
 
+typedef enum {
+        PRELUDE_CONNECTION_FEATURE_ACK           = 0x01, /* peer acknowledges received messages */
+        PRELUDE_CONNECTION_FEATURE_COMPACT       = 0x02, /* peer reads PRELUDE_MSG_VERSION_2 messages */
+        PRELUDE_CONNECTION_FEATURE_DICTIONARY    = 0x04, /* peer keeps a dictionary of the strings it received */
+        PRELUDE_CONNECTION_FEATURE_COMPRESSION   = 0x08  /* data following the capability message is deflated */
+} prelude_connection_feature_t;
+
 
 typedef struct prelude_connection prelude_connection_t;
 
 
+typedef struct {
+        uint64_t handshakes;
+        uint64_t resumed_handshakes;
+        uint64_t handshake_usec;
+} prelude_connection_tls_stats_t;
+
+
 #include "prelude-msg.h"
 #include "prelude-msgbuf.h"
 #include "prelude-string.h"
@@ -54,8 +68,14 @@ void prelude_connection_destroy(prelude_connection_t *conn);
 
 prelude_connection_t *prelude_connection_ref(prelude_connection_t *conn);
 
+void prelude_connection_get_tls_stats(prelude_connection_tls_stats_t *stats);
+
 int prelude_connection_send(prelude_connection_t *cnx, prelude_msg_t *msg);
 
+int prelude_connection_sendv(prelude_connection_t *cnx, prelude_msg_t **msgs, size_t count);
+
+int _prelude_connection_prepare_msg(prelude_connection_t *cnx, prelude_msg_t *msg, prelude_msg_t **out);
+
 int prelude_connection_recv(prelude_connection_t *cnx, prelude_msg_t **outmsg);
 
 int prelude_connection_recv_idmef(prelude_connection_t *con, idmef_message_t **idmef);
@@ -64,6 +84,14 @@ int prelude_connection_connect(prelude_connection_t *cnx,
                                prelude_client_profile_t *profile,
                                prelude_connection_permission_t permission);
 
+int prelude_connection_connect_nonblock(prelude_connection_t *cnx,
+                                        prelude_client_profile_t *profile,
+                                        prelude_connection_permission_t permission);
+
+int prelude_connection_connect_resume(prelude_connection_t *cnx);
+
+prelude_bool_t prelude_connection_connect_want_write(prelude_connection_t *cnx);
+
 ssize_t prelude_connection_forward(prelude_connection_t *cnx, prelude_io_t *src, size_t count);
 
 const char *prelude_connection_get_local_addr(prelude_connection_t *cnx);
@@ -98,6 +126,20 @@ prelude_connection_permission_t prelude_connection_get_permission(prelude_connec
 
 uint64_t prelude_connection_get_peer_analyzerid(prelude_connection_t *cnx);
 
+void prelude_connection_set_wanted_features(prelude_connection_t *cnx, prelude_connection_feature_t features);
+
+int prelude_connection_set_features(prelude_connection_t *cnx, prelude_connection_feature_t features);
+
+prelude_connection_feature_t prelude_connection_get_features(prelude_connection_t *cnx);
+
+int prelude_connection_send_ack(prelude_connection_t *cnx);
+
+uint64_t prelude_connection_get_sent_count(prelude_connection_t *cnx);
+
+uint64_t prelude_connection_get_acked_count(prelude_connection_t *cnx);
+
+void prelude_connection_set_tls_offload(prelude_connection_t *cnx, prelude_bool_t enabled);
+
 void prelude_connection_set_peer_analyzerid(prelude_connection_t *cnx, uint64_t analyzerid);
 
 #include "prelude-client.h"
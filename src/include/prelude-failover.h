@@ -24,12 +24,33 @@
 #ifndef _LIBPRELUDE_PRELUDE_FAILOVER_H
 #define _LIBPRELUDE_PRELUDE_FAILOVER_H
 
+#include "prelude-inttypes.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
 
 typedef struct prelude_failover prelude_failover_t;
 
+typedef enum {
+        PRELUDE_FAILOVER_DURABILITY_NONE    = 0,
+        PRELUDE_FAILOVER_DURABILITY_BATCH   = 1,
+        PRELUDE_FAILOVER_DURABILITY_MESSAGE = 2
+} prelude_failover_durability_t;
+
+typedef enum {
+        PRELUDE_FAILOVER_COMPRESSION_NONE    = 0,
+        PRELUDE_FAILOVER_COMPRESSION_DEFLATE = 1
+} prelude_failover_compression_t;
+
+typedef struct {
+        uint64_t saved_msg;
+        uint64_t saved_bytes;
+        uint64_t stored_bytes;
+        uint64_t journal_writes;
+        uint64_t syncs;
+} prelude_failover_stats_t;
+
 void prelude_failover_destroy(prelude_failover_t *failover);
 
 int prelude_failover_new(prelude_failover_t **ret, const char *dirname);
@@ -40,6 +61,8 @@ int prelude_failover_save_msg(prelude_failover_t *failover, prelude_msg_t *msg);
 
 ssize_t prelude_failover_get_saved_msg(prelude_failover_t *failover, prelude_msg_t **out);
 
+ssize_t prelude_failover_get_saved_msgs(prelude_failover_t *failover, prelude_msg_t **msgs, size_t count);
+
 unsigned long prelude_failover_get_deleted_msg_count(prelude_failover_t *failover);
 
 unsigned long prelude_failover_get_available_msg_count(prelude_failover_t *failover);
@@ -52,6 +75,22 @@ int prelude_failover_commit(prelude_failover_t *failover, prelude_msg_t *msg);
 
 int prelude_failover_rollback(prelude_failover_t *failover, prelude_msg_t *msg);
 
+void prelude_failover_set_group_commit(prelude_failover_t *failover, unsigned int max_msg, unsigned int max_delay);
+
+void prelude_failover_set_durability(prelude_failover_t *failover, prelude_failover_durability_t durability);
+
+int prelude_failover_flush(prelude_failover_t *failover);
+
+void prelude_failover_get_stats(prelude_failover_t *failover, prelude_failover_stats_t *stats);
+
+void prelude_failover_set_default_group_commit(unsigned int max_msg, unsigned int max_delay);
+
+void prelude_failover_set_default_durability(prelude_failover_durability_t durability);
+
+void prelude_failover_set_default_segment_size(size_t size);
+
+int prelude_failover_set_default_compression(prelude_failover_compression_t compression);
+
 #ifdef __cplusplus
  }
 #endif
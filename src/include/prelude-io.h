@@ -39,6 +39,47 @@
 
 typedef struct prelude_io prelude_io_t;
 
+struct iovec;
+
+typedef struct {
+        uint64_t read_bytes;
+        uint64_t read_syscalls;
+        uint64_t write_bytes;
+        uint64_t write_syscalls;
+
+        /*
+         * With compression, bytes actually exchanged with the peer,
+         * and processor time spent compressing, in microseconds.
+         */
+        uint64_t compressed_read_bytes;
+        uint64_t compressed_write_bytes;
+        uint64_t compression_usec;
+} prelude_io_stats_t;
+
+
+/**
+ * prelude_io_compression_t
+ * @PRELUDE_IO_COMPRESSION_NONE: Data is not compressed.
+ * @PRELUDE_IO_COMPRESSION_DEFLATE: Data is compressed with deflate (zlib).
+ *
+ * Compression algorithms for prelude_io_set_compression().
+ */
+typedef enum {
+        PRELUDE_IO_COMPRESSION_NONE    = 0,
+        PRELUDE_IO_COMPRESSION_DEFLATE = 1
+} prelude_io_compression_t;
+
+
+/**
+ * prelude_io_forward_flags_t
+ * @PRELUDE_IO_FORWARD_FLAGS_MORE: More data is about to be forwarded to the same destination.
+ *
+ * Flags for prelude_io_forward_full().
+ */
+typedef enum {
+        PRELUDE_IO_FORWARD_FLAGS_MORE = 0x01
+} prelude_io_forward_flags_t;
+
 /*
  * Object creation / destruction functions.
  */
@@ -50,6 +91,14 @@ void prelude_io_set_file_io(prelude_io_t *pio, FILE *fd);
 
 void prelude_io_set_tls_io(prelude_io_t *pio, void *tls);
 
+int prelude_io_set_tls_offload(prelude_io_t *pio);
+
+prelude_bool_t prelude_io_is_tls_offloaded(prelude_io_t *pio);
+
+int prelude_io_set_compression(prelude_io_t *pio, prelude_io_compression_t algo);
+
+prelude_io_compression_t prelude_io_get_compression(prelude_io_t *pio);
+
 void prelude_io_set_sys_io(prelude_io_t *pio, int fd);
 
 int prelude_io_set_buffer_io(prelude_io_t *pio);
@@ -80,9 +129,16 @@ ssize_t prelude_io_write(prelude_io_t *pio, const void *buf, size_t count);
 
 ssize_t prelude_io_write_delimited(prelude_io_t *pio, const void *buf, uint16_t count);
 
+ssize_t prelude_io_writev(prelude_io_t *pio, const struct iovec *iov, int iovcnt);
+
 
 ssize_t prelude_io_forward(prelude_io_t *dst, prelude_io_t *src, size_t count);
 
+ssize_t prelude_io_forward_full(prelude_io_t *dst, prelude_io_t *src, const void *head, size_t headlen,
+                                size_t count, prelude_io_forward_flags_t flags);
+
+int prelude_io_forward_flush(prelude_io_t *pio);
+
 int prelude_io_get_fd(prelude_io_t *pio);
 
 void *prelude_io_get_fdptr(prelude_io_t *pio);
@@ -91,6 +147,10 @@ ssize_t prelude_io_pending(prelude_io_t *pio);
 
 prelude_bool_t prelude_io_is_error_fatal(prelude_io_t *pio, int error);
 
+void prelude_io_get_stats(prelude_io_t *pio, prelude_io_stats_t *stats);
+
+void prelude_io_reset_stats(prelude_io_t *pio);
+
 #ifdef __cplusplus
   }
 #endif
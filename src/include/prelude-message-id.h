@@ -34,6 +34,7 @@
 #define PRELUDE_MSG_CONNECTION_CAPABILITY    6
 #define PRELUDE_MSG_OPTION_REQUEST 7
 #define PRELUDE_MSG_OPTION_REPLY   8
+#define PRELUDE_MSG_ACK            9
 
 /*
  * PRELUDE_MSG_ID submessage
@@ -45,6 +46,20 @@
  */
 #define PRELUDE_MSG_AUTH_SUCCEED   6
 #define PRELUDE_MSG_AUTH_FAILED    7
+#define PRELUDE_MSG_AUTH_FEATURES  8
+
+/*
+ * PRELUDE_MSG_CONNECTION_CAPABILITY submessages: the tag of the first
+ * one is the requested permission, and features agreed upon use a tag
+ * that no permission can take.
+ */
+#define PRELUDE_MSG_CONNECTION_CAPABILITY_FEATURES 0x80
+
+/*
+ * PRELUDE_MSG_ACK submessage: number of messages received on the
+ * connection since the capability message, as an uint64.
+ */
+#define PRELUDE_MSG_ACK_COUNT      0
 
 
 /*
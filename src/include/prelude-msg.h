@@ -33,6 +33,11 @@
 
 typedef struct prelude_msg prelude_msg_t;
 
+/*
+ * Per connection string dictionary, see prelude_msg_set_string().
+ */
+typedef struct prelude_msg_dict prelude_msg_dict_t;
+
 
 typedef enum {
         PRELUDE_MSG_PRIORITY_NONE = 0,
@@ -42,10 +47,28 @@ typedef enum {
 } prelude_msg_priority_t;
 
 
+/*
+ * Encoding of the chunks contained in a message, see prelude_msg_set_version().
+ */
+typedef enum {
+        PRELUDE_MSG_VERSION_1 = 1,
+        PRELUDE_MSG_VERSION_2 = 2
+} prelude_msg_version_t;
+
+
+typedef struct {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t resident_bytes;
+} prelude_msg_pool_stats_t;
+
+
 int prelude_msg_read(prelude_msg_t **msg, prelude_io_t *pio);
 
 int prelude_msg_forward(prelude_msg_t *msg, prelude_io_t *dst, prelude_io_t *src);
 
+int prelude_msg_forward_full(prelude_msg_t *msg, prelude_io_t *dst, prelude_io_t *src, prelude_io_forward_flags_t flags);
+
 int prelude_msg_get(prelude_msg_t *msg, uint8_t *tag, uint32_t *len, void **buf);
 
 
@@ -65,10 +88,18 @@ int prelude_msg_clone(prelude_msg_t **dst, const prelude_msg_t *src);
 
 int prelude_msg_set(prelude_msg_t *msg, uint8_t tag, uint32_t len, const void *data);
 
+int prelude_msg_set_uint(prelude_msg_t *msg, uint8_t tag, size_t size, uint64_t value);
+
+int prelude_msg_set_int(prelude_msg_t *msg, uint8_t tag, size_t size, int64_t value);
+
+int prelude_msg_set_string(prelude_msg_t *msg, uint8_t tag, const char *str, size_t len);
+
 int prelude_msg_write(prelude_msg_t *msg, prelude_io_t *dst);
 
 int prelude_msg_write_r(prelude_msg_t *msg, prelude_io_t *dst, uint32_t *windex);
 
+int prelude_msg_writev(prelude_msg_t **msgs, size_t count, prelude_io_t *dst, size_t *windex);
+
 
 
 /*
@@ -78,6 +109,10 @@ void prelude_msg_set_tag(prelude_msg_t *msg, uint8_t tag);
 
 void prelude_msg_set_priority(prelude_msg_t *msg, prelude_msg_priority_t priority);
 
+void prelude_msg_set_version(prelude_msg_t *msg, prelude_msg_version_t version);
+
+prelude_msg_version_t prelude_msg_get_version(prelude_msg_t *msg);
+
 uint8_t prelude_msg_get_tag(prelude_msg_t *msg);
 
 prelude_msg_priority_t prelude_msg_get_priority(prelude_msg_t *msg);
@@ -104,6 +139,42 @@ void *prelude_msg_get_data(prelude_msg_t *msg);
 
 prelude_msg_t *prelude_msg_ref(prelude_msg_t *msg);
 
+
+/*
+ * Message buffer pool.
+ */
+void prelude_msg_pool_set_high_water_mark(size_t size);
+
+void prelude_msg_pool_get_stats(prelude_msg_pool_stats_t *stats);
+
+void _prelude_msg_pool_deinit(void);
+
+int _prelude_msg_new_borrowed(prelude_msg_t **out, unsigned char *data, uint32_t len);
+
+uint32_t _prelude_msg_get_read_index(prelude_msg_t *msg);
+
+void _prelude_msg_set_read_index(prelude_msg_t *msg, uint32_t index);
+
+void _prelude_msg_dict_destroy(prelude_msg_dict_t *dict);
+
+int _prelude_msg_dict_renew(prelude_msg_dict_t **dict);
+
+prelude_bool_t _prelude_msg_dict_is_desync(prelude_msg_dict_t *dict);
+
+void _prelude_msg_set_dict(prelude_msg_t *msg, prelude_msg_dict_t *dict);
+
+int _prelude_msg_load_dict(prelude_msg_t *msg, prelude_msg_dict_t **dict);
+
+int _prelude_msg_expand(prelude_msg_t *msg, prelude_msg_t **out);
+
+int _prelude_msg_downgrade(prelude_msg_t *msg, prelude_msg_t **out);
+
+int _prelude_msg_dict_prepare(prelude_msg_t *msg, prelude_msg_dict_t **peer, uint32_t *count, prelude_msg_t **out);
+
+void _prelude_msg_fork_prepare(void);
+void _prelude_msg_fork_parent(void);
+void _prelude_msg_fork_child(void);
+
 #ifdef __cplusplus
  }
 #endif
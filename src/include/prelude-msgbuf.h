@@ -31,7 +31,9 @@
 typedef struct prelude_msgbuf prelude_msgbuf_t;
 
 typedef enum {
-        PRELUDE_MSGBUF_FLAGS_ASYNC = 0x01
+        PRELUDE_MSGBUF_FLAGS_ASYNC   = 0x01,
+        PRELUDE_MSGBUF_FLAGS_COMPACT = 0x02,
+        PRELUDE_MSGBUF_FLAGS_DICTIONARY = 0x04
 } prelude_msgbuf_flags_t;
 
 
@@ -47,6 +49,12 @@ void prelude_msgbuf_mark_end(prelude_msgbuf_t *msgbuf);
 
 int prelude_msgbuf_set(prelude_msgbuf_t *msgbuf, uint8_t tag, uint32_t len, const void *data);
 
+int prelude_msgbuf_set_uint(prelude_msgbuf_t *msgbuf, uint8_t tag, size_t size, uint64_t value);
+
+int prelude_msgbuf_set_int(prelude_msgbuf_t *msgbuf, uint8_t tag, size_t size, int64_t value);
+
+int prelude_msgbuf_set_string(prelude_msgbuf_t *msgbuf, uint8_t tag, const char *str, size_t len);
+
 prelude_msg_t *prelude_msgbuf_get_msg(prelude_msgbuf_t *msgbuf);
 
 void prelude_msgbuf_set_callback(prelude_msgbuf_t *msgbuf, int (*send_msg)(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg));
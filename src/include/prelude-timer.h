@@ -38,12 +38,15 @@
 #endif
 
 #include "prelude-list.h"
+#include "prelude-inttypes.h"
 
 #ifdef __cplusplus
  extern "C" {
 #endif
 
 
+typedef struct prelude_timer_base prelude_timer_base_t;
+
 typedef struct {
         prelude_list_t list;
 
@@ -52,6 +55,13 @@ typedef struct {
 
         void *data;
         void (*function)(void *data);
+
+        /*
+         * Private members.
+         */
+        unsigned int _expire_ms;
+        uint64_t _due;
+        prelude_timer_base_t *_base;
 } prelude_timer_t;
 
 /*
@@ -62,7 +72,10 @@ typedef struct {
 #define prelude_timer_get_data(timer) (timer)->data
 #define prelude_timer_get_callback(timer) (timer)->function
 
-#define prelude_timer_set_expire(timer, x) prelude_timer_get_expire((timer)) = (x)
+#define prelude_timer_get_expire_ms(timer) ((timer)->_expire_ms ? (uint64_t) (timer)->_expire_ms : (uint64_t) (timer)->expire * 1000)
+
+#define prelude_timer_set_expire(timer, x) ((timer)->_expire_ms = 0, prelude_timer_get_expire((timer)) = (x))
+#define prelude_timer_set_expire_ms(timer, x) ((timer)->_expire_ms = (x), prelude_timer_get_expire((timer)) = (x) / 1000)
 #define prelude_timer_set_data(timer, x) prelude_timer_get_data((timer)) = (x)
 #define prelude_timer_set_callback(timer, x) prelude_timer_get_callback((timer)) = (x)
 
@@ -88,7 +101,7 @@ void prelude_timer_destroy(prelude_timer_t *timer);
 
 /*
  * Wake up time that need it.
- * This function should be called every second to work properly.
+ * Returns the number of seconds until the next timer expires.
  */
 int prelude_timer_wake_up(void);
 
@@ -110,11 +123,29 @@ void prelude_timer_lock_critical_region(void);
 void prelude_timer_unlock_critical_region(void);
 
 
+/*
+ * Timer bases, for threads handling their own timers.
+ */
+int prelude_timer_base_new(prelude_timer_base_t **base);
+
+void prelude_timer_base_destroy(prelude_timer_base_t *base);
+
+void prelude_timer_set_thread_base(prelude_timer_base_t *base);
+
+prelude_timer_base_t *prelude_timer_get_thread_base(void);
+
+unsigned int prelude_timer_base_wake_up(prelude_timer_base_t *base);
+
+
 /*
  *
  */
 int _prelude_timer_init(void);
 
+unsigned int _prelude_timer_wake_up(void);
+
+void _prelude_timer_set_notify(void (*notify)(void));
+
 
 void _prelude_timer_fork_prepare(void);
 void _prelude_timer_fork_parent(void);
@@ -28,11 +28,30 @@
 #include "prelude-connection.h"
 
 
+typedef struct tls_auth_state tls_auth_state_t;
+
+int tls_auth_connection_start(prelude_client_profile_t *cp, prelude_io_t *io, int crypt,
+                              uint64_t peer_analyzerid, tls_auth_state_t **state);
+
+int tls_auth_connection_resume(tls_auth_state_t *state, uint64_t *peer_analyzerid, prelude_connection_permission_t *permission);
+
+prelude_bool_t tls_auth_connection_want_write(tls_auth_state_t *state);
+
+prelude_connection_feature_t tls_auth_connection_get_peer_features(tls_auth_state_t *state);
+
+void tls_auth_connection_destroy(tls_auth_state_t *state);
+
 int tls_auth_connection(prelude_client_profile_t *cp, prelude_io_t *io, int crypt,
                         uint64_t *peer_analyzerid, prelude_connection_permission_t *permission);
 
 int tls_auth_init(prelude_client_profile_t *cp, gnutls_certificate_credentials_t *cred);
 
+int tls_auth_get_credentials(prelude_client_profile_t *cp, gnutls_certificate_credentials_t *cred);
+
+void tls_auth_release_credentials(gnutls_certificate_credentials_t cred);
+
+void tls_auth_get_stats(prelude_connection_tls_stats_t *stats);
+
 int tls_auth_init_priority(const char *tlsopts);
 
 void tls_auth_deinit(void);
@@ -0,0 +1,397 @@
+/*****
+*
+* Copyright (C) 2020 CS GROUP - France. All Rights Reserved.
+*
+* This file is part of the Prelude library.
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2.1, or (at your option)
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU Lesser General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License along
+* with this program; if not, write to the Free Software Foundation, Inc.,
+* 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*
+*****/
+
+#include "config.h"
+#include "libmissing.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#include "glthread/tls.h"
+#include "glthread/lock.h"
+
+#define PRELUDE_ERROR_SOURCE_DEFAULT PRELUDE_ERROR_SOURCE_IDMEF_TREE_WRAP
+#include "prelude-error.h"
+
+#include "prelude-inttypes.h"
+#include "prelude-msg.h"
+#include "prelude-arena.h"
+#include "common.h"
+
+
+#define ARENA_MIN_CHUNK_SIZE 4096
+#define ARENA_MAX_CHUNK_SIZE (1024 * 1024)
+
+#define ARENA_ALIGN(size) (((size) + sizeof(object_header_t) - 1) & ~(sizeof(object_header_t) - 1))
+#define ARENA_CHUNK_HEADER_SIZE ARENA_ALIGN(sizeof(arena_chunk_t))
+
+#ifndef MAX
+# define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#endif
+
+#ifndef MIN
+# define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#endif
+
+
+/*
+ * Every object allocated through _prelude_object_calloc() is prefixed
+ * with an header recording the arena it was carved from (NULL for objects
+ * allocated from the heap), so that _prelude_object_free() knows how to
+ * release it.
+ */
+typedef union {
+        prelude_arena_t *arena;
+        uint64_t align;
+} object_header_t;
+
+
+typedef struct arena_chunk {
+        struct arena_chunk *next;
+        size_t size;
+        size_t used;
+} arena_chunk_t;
+
+
+/*
+ * The arena is released once its owner dropped its reference, and
+ * every object carved from it was freed. Objects escaping the arena
+ * through their own reference count thus keep the whole arena alive.
+ *
+ * @live counts both the owner reference and the objects, so that the
+ * last of them, possibly released from another thread, frees the arena.
+ *
+ * Allocation is not synchronized: only one thread at a time may create
+ * objects from a given arena. Memory of freed objects is not reused
+ * before the whole arena is released.
+ */
+struct prelude_arena {
+        uint64_t live;
+
+        prelude_msg_t *msg;
+        arena_chunk_t *chunk;
+};
+
+
+gl_once_define(static, arena_once);
+static gl_tls_key_t arena_current_key;
+static gl_tls_key_t arena_cache_key;
+
+/*
+ * Set once an arena was made current: until then, objects are allocated
+ * from the heap without looking the current arena up.
+ */
+static volatile sig_atomic_t arena_used = FALSE;
+
+
+/*
+ * Returned by _prelude_arena_enter() when the current arena was left untouched.
+ */
+static prelude_arena_t arena_unchanged;
+
+#ifndef HAVE_ATOMIC_BUILTINS
+static gl_lock_t atomic_mutex = gl_lock_initializer;
+#endif
+
+
+
+static inline uint64_t arena_add(prelude_arena_t *arena, int64_t val)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        return __atomic_add_fetch(&arena->live, val, __ATOMIC_ACQ_REL);
+#else
+        uint64_t ret;
+
+        gl_lock_lock(atomic_mutex);
+        ret = arena->live += val;
+        gl_lock_unlock(atomic_mutex);
+
+        return ret;
+#endif
+}
+
+
+
+static void arena_init(void)
+{
+        gl_tls_key_init(arena_current_key, NULL);
+        gl_tls_key_init(arena_cache_key, free);
+}
+
+
+
+static void arena_free(prelude_arena_t *arena)
+{
+        prelude_arena_t *cached;
+        arena_chunk_t *chunk, *next;
+
+        /*
+         * The last chunk of the list was allocated along with the arena.
+         */
+        for ( chunk = arena->chunk; chunk->next; chunk = next ) {
+                next = chunk->next;
+                free(chunk);
+        }
+
+        arena->chunk = chunk;
+
+        if ( arena->msg ) {
+                prelude_msg_destroy(arena->msg);
+                arena->msg = NULL;
+        }
+
+        /*
+         * Keep the arena around for the next message handled by this
+         * thread, unless a bigger one is already cached.
+         */
+        gl_once(arena_once, arena_init);
+
+        cached = gl_tls_get(arena_cache_key);
+        if ( cached && cached->chunk->size >= chunk->size ) {
+                free(arena);
+                return;
+        }
+
+        free(cached);
+
+        chunk->used = 0;
+        gl_tls_set(arena_cache_key, arena);
+}
+
+
+
+static void *arena_alloc(prelude_arena_t *arena, size_t size)
+{
+        void *ptr;
+        size_t csize;
+        arena_chunk_t *chunk = arena->chunk;
+
+        size = ARENA_ALIGN(size);
+
+        if ( chunk->size - chunk->used < size ) {
+                csize = MAX(MIN(chunk->size * 2, ARENA_MAX_CHUNK_SIZE), size);
+
+                chunk = malloc(ARENA_CHUNK_HEADER_SIZE + csize);
+                if ( ! chunk )
+                        return NULL;
+
+                chunk->size = csize;
+                chunk->used = 0;
+                chunk->next = arena->chunk;
+                arena->chunk = chunk;
+        }
+
+        ptr = (unsigned char *) chunk + ARENA_CHUNK_HEADER_SIZE + chunk->used;
+        chunk->used += size;
+
+        return ptr;
+}
+
+
+
+/*
+ * Create a new arena, whose first chunk can hold @size bytes.
+ */
+int _prelude_arena_new(prelude_arena_t **arena, size_t size)
+{
+        arena_chunk_t *chunk;
+
+        size = ARENA_ALIGN(MIN(MAX(size, ARENA_MIN_CHUNK_SIZE), ARENA_MAX_CHUNK_SIZE));
+
+        gl_once(arena_once, arena_init);
+
+        *arena = gl_tls_get(arena_cache_key);
+        if ( *arena && (*arena)->chunk->size >= size ) {
+                gl_tls_set(arena_cache_key, NULL);
+                (*arena)->live = 1;
+                return 0;
+        }
+
+        *arena = malloc(ARENA_ALIGN(sizeof(**arena)) + ARENA_CHUNK_HEADER_SIZE + size);
+        if ( ! *arena )
+                return prelude_error_from_errno(errno);
+
+        chunk = (arena_chunk_t *) ((unsigned char *) *arena + ARENA_ALIGN(sizeof(**arena)));
+        chunk->next = NULL;
+        chunk->size = size;
+        chunk->used = 0;
+
+        (*arena)->live = 1;
+        (*arena)->msg = NULL;
+        (*arena)->chunk = chunk;
+
+        return 0;
+}
+
+
+
+/*
+ * Drop the owner reference on @arena. The memory is released as soon
+ * as no object allocated from the arena remains.
+ */
+void _prelude_arena_destroy(prelude_arena_t *arena)
+{
+        if ( arena_add(arena, -1) == 0 )
+                arena_free(arena);
+}
+
+
+
+/*
+ * Keep a reference on @msg for as long as @arena is alive, so that
+ * objects referencing @msg payload stay valid.
+ */
+void _prelude_arena_set_msg(prelude_arena_t *arena, prelude_msg_t *msg)
+{
+        if ( arena->msg )
+                prelude_msg_destroy(arena->msg);
+
+        arena->msg = (msg) ? prelude_msg_ref(msg) : NULL;
+}
+
+
+
+/*
+ * Make @arena the arena objects created by the calling thread are
+ * allocated from, or revert to heap allocation if @arena is NULL.
+ * The previously used arena is returned.
+ */
+prelude_arena_t *_prelude_arena_set_current(prelude_arena_t *arena)
+{
+        prelude_arena_t *prev;
+
+        gl_once(arena_once, arena_init);
+
+        if ( arena )
+                arena_used = TRUE;
+
+        prev = gl_tls_get(arena_current_key);
+        gl_tls_set(arena_current_key, arena);
+
+        return prev;
+}
+
+
+
+/*
+ * Make the arena @parent was allocated from the current one, so that
+ * objects attached to @parent share its allocation policy. The returned
+ * value is to be handed to _prelude_arena_leave().
+ */
+prelude_arena_t *_prelude_arena_enter(const void *parent)
+{
+        prelude_arena_t *arena, *prev;
+
+        /*
+         * No arena was ever made current, @parent comes from the heap.
+         */
+        if ( ! arena_used )
+                return &arena_unchanged;
+
+        gl_once(arena_once, arena_init);
+
+        arena = _prelude_object_get_arena(parent);
+
+        prev = gl_tls_get(arena_current_key);
+        if ( prev == arena )
+                return &arena_unchanged;
+
+        gl_tls_set(arena_current_key, arena);
+
+        return prev;
+}
+
+
+
+void _prelude_arena_leave(prelude_arena_t *prev)
+{
+        if ( prev != &arena_unchanged )
+                gl_tls_set(arena_current_key, prev);
+}
+
+
+
+/*
+ * Release the arena cached by the calling thread.
+ */
+void _prelude_arena_deinit(void)
+{
+        gl_once(arena_once, arena_init);
+
+        free(gl_tls_get(arena_cache_key));
+        gl_tls_set(arena_cache_key, NULL);
+}
+
+
+
+void *_prelude_object_calloc(size_t size)
+{
+        object_header_t *hdr;
+        prelude_arena_t *arena = NULL;
+
+        if ( arena_used ) {
+                gl_once(arena_once, arena_init);
+                arena = gl_tls_get(arena_current_key);
+        }
+
+        if ( ! arena ) {
+                hdr = calloc(1, sizeof(*hdr) + size);
+                if ( ! hdr )
+                        return NULL;
+        } else {
+                hdr = arena_alloc(arena, sizeof(*hdr) + size);
+                if ( ! hdr )
+                        return NULL;
+
+                memset(hdr, 0, sizeof(*hdr) + size);
+                hdr->arena = arena;
+                arena_add(arena, 1);
+        }
+
+        return hdr + 1;
+}
+
+
+
+void _prelude_object_free(void *ptr)
+{
+        prelude_arena_t *arena;
+        object_header_t *hdr = (object_header_t *) ptr - 1;
+
+        arena = hdr->arena;
+        if ( ! arena ) {
+                free(hdr);
+                return;
+        }
+
+        if ( arena_add(arena, -1) == 0 )
+                arena_free(arena);
+}
+
+
+
+prelude_arena_t *_prelude_object_get_arena(const void *ptr)
+{
+        return ((const object_header_t *) ptr - 1)->arena;
+}
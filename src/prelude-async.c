@@ -46,6 +46,10 @@
 #include "glthread/thread.h"
 #include "glthread/lock.h"
 #include "glthread/cond.h"
+#include "glthread/tls.h"
+
+#define PRELUDE_ERROR_SOURCE_DEFAULT PRELUDE_ERROR_SOURCE_ASYNC
+#include "prelude-error.h"
 
 #include "prelude-list.h"
 #include "prelude-inttypes.h"
@@ -54,89 +58,1102 @@
 #include "prelude-log.h"
 #include "prelude-io.h"
 #include "prelude-async.h"
+#include "common.h"
+
+
+#define ASYNC_MAX_WORKERS 64
+
+/*
+ * Maximum number of objects processed from a queue before the
+ * worker gives other queues a chance to run.
+ */
+#define ASYNC_QUEUE_BATCH 32
+
+/*
+ * Milliseconds between attempts to queue an object when out of memory.
+ */
+#define ENTRY_RETRY_DELAY 10
+
+
+#ifndef MAX
+# define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#endif
+
+
+/*
+ * A lane is a lock-free multiple producers / single consumer list of
+ * entries, one for each queued object.
+ */
+typedef struct {
+        prelude_list_t *head;
+        prelude_list_t *tail;
+        prelude_list_t stub;
+} async_lane_t;
+
+
+/*
+ * The state the queue keeps for an object lives in its entry, so that
+ * PRELUDE_ASYNC_OBJECT is left unchanged. While the object is queued,
+ * the previous pointer of its link refers to the entry, which is how
+ * prelude_async_del() finds it. Since the object may be released right
+ * after prelude_async_del(), the lanes link entries rather than objects.
+ */
+typedef struct {
+        prelude_list_t link;
+        prelude_async_object_t *obj;
+        uint64_t time;
+} async_entry_t;
+
+
+/*
+ * A queue holds one lane per priority. It is processed by a single worker
+ * at a time, which guarantee objects added to the same queue with the same
+ * priority are processed in order.
+ *
+ * The producer bringing the number of pending objects from 0 to 1 schedules
+ * the queue in the run queue of a worker, the queue then holds a reference
+ * on itself until the consumer drains it. Adding to an already scheduled
+ * queue thus does not take any lock.
+ */
+struct prelude_async_queue {
+        prelude_list_t list;
+        prelude_list_t registry;
+
+        uint64_t refcount;
+        unsigned int home;
+
+        async_lane_t lane[PRELUDE_ASYNC_PRIORITY_COUNT];
+        uint64_t pending;
+
+        /*
+         * Lane being processed, and number of objects it may still
+         * provide, with weighted scheduling.
+         */
+        unsigned int current;
+        unsigned int credit;
+
+        /*
+         * Only used by producers waiting for room in the queue.
+         */
+        gl_lock_t mutex;
+        gl_cond_t cond;
+        uint64_t waiters;
+
+        /*
+         * Serializes removal from the lanes, between the worker and the
+         * producers making room in a full queue.
+         */
+        gl_lock_t pop_mutex;
+
+        prelude_async_callback_t overflow_func;
+        prelude_async_stats_t stats;
+};
+
+
+typedef struct {
+        gl_thread_t thread;
+        gl_lock_t mutex;
+        gl_cond_t cond;
+
+        unsigned int id;
+        prelude_list_t runq;
+        prelude_bool_t sleeping;
+
+        uint64_t stolen;
+} async_worker_t;
+
+
+
+static PRELUDE_LIST(queue_list);
+static prelude_async_stats_t retired_stats;
+static prelude_async_queue_t default_queue;
+static async_worker_t workers[ASYNC_MAX_WORKERS];
+
+static unsigned int next_home = 0;
+static unsigned int worker_count = 1;
+static uint64_t running_workers = 0;
+
+static uint64_t queue_limit = 0;
+static prelude_async_overflow_policy_t overflow_policy = PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK;
+static prelude_async_scheduling_t scheduling = PRELUDE_ASYNC_SCHEDULING_STRICT;
+
+static prelude_async_flags_t async_flags = 0;
+static uint64_t stop_processing = FALSE;
+
+static gl_thread_t timer_tid;
+static prelude_bool_t timer_kick = FALSE;
+static prelude_bool_t timer_running = FALSE;
+static gl_lock_t timer_mutex = gl_lock_initializer;
+static gl_cond_t timer_cond = gl_cond_initializer;
+
+static gl_lock_t mutex = gl_lock_initializer;
+gl_once_define(static, async_once);
+
+/*
+ * Set in the workers and the timer thread: these never wait for room in
+ * a queue, which might only be made by themselves.
+ */
+static gl_tls_key_t internal_thread_key;
+
+static volatile sig_atomic_t is_initialized = FALSE;
+
+#ifndef HAVE_ATOMIC_BUILTINS
+static gl_lock_t atomic_mutex = gl_lock_initializer;
+#endif
+
+
+
+/*
+ * Atomic operations, emulated through a lock when the
+ * compiler does not provide them.
+ */
+static inline prelude_list_t *atomic_list_xchg(prelude_list_t **ptr, prelude_list_t *val)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        return __atomic_exchange_n(ptr, val, __ATOMIC_ACQ_REL);
+#else
+        prelude_list_t *old;
+
+        gl_lock_lock(atomic_mutex);
+        old = *ptr;
+        *ptr = val;
+        gl_lock_unlock(atomic_mutex);
+
+        return old;
+#endif
+}
+
+
+static inline prelude_list_t *atomic_list_load(prelude_list_t **ptr)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+        return atomic_list_xchg(ptr, *ptr);
+#endif
+}
+
+
+static inline void atomic_list_store(prelude_list_t **ptr, prelude_list_t *val)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        __atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+#else
+        atomic_list_xchg(ptr, val);
+#endif
+}
+
+
+static inline prelude_async_object_t *atomic_obj_xchg(prelude_async_object_t **ptr, prelude_async_object_t *val)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        return __atomic_exchange_n(ptr, val, __ATOMIC_ACQ_REL);
+#else
+        prelude_async_object_t *old;
+
+        gl_lock_lock(atomic_mutex);
+        old = *ptr;
+        *ptr = val;
+        gl_lock_unlock(atomic_mutex);
+
+        return old;
+#endif
+}
+
+
+static inline uint64_t atomic_add(uint64_t *ptr, int64_t val)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        return __atomic_add_fetch(ptr, val, __ATOMIC_SEQ_CST);
+#else
+        uint64_t ret;
+
+        gl_lock_lock(atomic_mutex);
+        ret = *ptr += val;
+        gl_lock_unlock(atomic_mutex);
+
+        return ret;
+#endif
+}
+
+
+static inline uint64_t atomic_load(uint64_t *ptr)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#else
+        return atomic_add(ptr, 0);
+#endif
+}
+
+
+static inline void atomic_store(uint64_t *ptr, uint64_t val)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+#else
+        gl_lock_lock(atomic_mutex);
+        *ptr = val;
+        gl_lock_unlock(atomic_mutex);
+#endif
+}
+
+
+static inline void atomic_max(uint64_t *ptr, uint64_t val)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+        uint64_t old = __atomic_load_n(ptr, __ATOMIC_RELAXED);
+
+        while ( old < val && ! __atomic_compare_exchange_n(ptr, &old, val, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+#else
+        gl_lock_lock(atomic_mutex);
+        *ptr = MAX(*ptr, val);
+        gl_lock_unlock(atomic_mutex);
+#endif
+}
+
+
+
+static inline struct timespec *get_timespec(struct timespec *ts)
+{
+        struct timeval now;
+
+        gettimeofday(&now, NULL);
+
+        ts->tv_sec = now.tv_sec;
+        ts->tv_nsec = now.tv_usec * 1000;
+
+        return ts;
+}
+
+
+static inline uint64_t get_usec(void)
+{
+        struct timeval now;
+
+        gettimeofday(&now, NULL);
+
+        return (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+
+
+static void init_worker(async_worker_t *worker, unsigned int id)
+{
+        worker->id = id;
+        worker->stolen = 0;
+        worker->sleeping = FALSE;
+
+        gl_lock_init(worker->mutex);
+        gl_cond_init(worker->cond);
+        prelude_list_init(&worker->runq);
+}
+
+
+
+static void reset_queue(prelude_async_queue_t *queue)
+{
+        unsigned int i;
+
+        for ( i = 0; i < PRELUDE_ASYNC_PRIORITY_COUNT; i++ ) {
+                queue->lane[i].stub.next = NULL;
+                queue->lane[i].head = queue->lane[i].tail = &queue->lane[i].stub;
+        }
+
+        queue->current = PRELUDE_ASYNC_PRIORITY_COUNT - 1;
+        queue->credit = 1 << queue->current;
+        queue->pending = 0;
+        queue->waiters = 0;
+
+        gl_lock_init(queue->mutex);
+        gl_cond_init(queue->cond);
+        gl_lock_init(queue->pop_mutex);
+}
+
+
+
+static void init_queue(prelude_async_queue_t *queue)
+{
+        queue->refcount = 1;
+        queue->overflow_func = NULL;
+        memset(&queue->stats, 0, sizeof(queue->stats));
+
+        reset_queue(queue);
+}
+
+
+
+static void lane_push(async_lane_t *lane, prelude_list_t *node)
+{
+        prelude_list_t *prev;
+
+        node->next = NULL;
+        prev = atomic_list_xchg(&lane->head, node);
+        atomic_list_store(&prev->next, node);
+}
+
+
+
+/*
+ * Only called with the pop mutex of the queue of @lane held. NULL might be
+ * returned while objects are pending, if a producer did not finish linking
+ * its object.
+ */
+static prelude_list_t *lane_pop(async_lane_t *lane)
+{
+        prelude_list_t *tail = lane->tail, *next;
+
+        next = atomic_list_load(&tail->next);
+
+        if ( tail == &lane->stub ) {
+                if ( ! next )
+                        return NULL;
+
+                lane->tail = tail = next;
+                next = atomic_list_load(&next->next);
+        }
+
+        if ( next ) {
+                lane->tail = next;
+                return tail;
+        }
+
+        if ( tail != atomic_list_load(&lane->head) )
+                return NULL;
+
+        lane_push(lane, &lane->stub);
+
+        next = atomic_list_load(&tail->next);
+        if ( ! next )
+                return NULL;
+
+        lane->tail = next;
+
+        return tail;
+}
+
+
+
+/*
+ * Pick the next object to process: with strict scheduling, the oldest object
+ * of the highest priority lane. With weighted scheduling, lanes are served
+ * in turn, from the highest priority down, each providing up to its weight
+ * (doubling with every priority level) objects before the next one is used.
+ */
+static prelude_list_t *queue_pop(prelude_async_queue_t *queue)
+{
+        unsigned int i;
+        prelude_list_t *node;
+
+        if ( scheduling == PRELUDE_ASYNC_SCHEDULING_STRICT ) {
+                for ( i = PRELUDE_ASYNC_PRIORITY_COUNT; i > 0; i-- ) {
+                        node = lane_pop(&queue->lane[i - 1]);
+                        if ( node )
+                                return node;
+                }
+
+                return NULL;
+        }
+
+        for ( i = 0; i <= PRELUDE_ASYNC_PRIORITY_COUNT; i++ ) {
+                if ( queue->credit ) {
+                        node = lane_pop(&queue->lane[queue->current]);
+                        if ( node ) {
+                                queue->credit--;
+                                return node;
+                        }
+                }
+
+                queue->current = (queue->current + PRELUDE_ASYNC_PRIORITY_COUNT - 1) % PRELUDE_ASYNC_PRIORITY_COUNT;
+                queue->credit = 1 << queue->current;
+        }
+
+        return NULL;
+}
+
+
+
+/*
+ * Objects removed because of the overflow policy are taken from
+ * the lowest priority lane first, never above @priority.
+ */
+static prelude_list_t *queue_pop_lowest(prelude_async_queue_t *queue, unsigned int priority)
+{
+        unsigned int i;
+        prelude_list_t *node;
+
+        for ( i = 0; i <= priority; i++ ) {
+                node = lane_pop(&queue->lane[i]);
+                if ( node )
+                        return node;
+        }
+
+        return NULL;
+}
+
+
+
+/*
+ * Take the object of @entry, popped from its lane, and release the entry.
+ * NULL is returned if the object was removed with prelude_async_del().
+ */
+static prelude_async_object_t *entry_claim(async_entry_t *entry)
+{
+        prelude_async_object_t *obj;
+
+        obj = atomic_obj_xchg(&entry->obj, NULL);
+        if ( ! obj ) {
+                free(entry);
+                return NULL;
+        }
+
+        /*
+         * Otherwise, prelude_async_del() releases the entry if it got to
+         * the object link first.
+         */
+        if ( atomic_list_xchg(&obj->_list.prev, NULL) == &entry->link )
+                free(entry);
+
+        return obj;
+}
+
+
+
+static void async_init_once(void)
+{
+        unsigned int i;
+
+        gl_tls_key_init(internal_thread_key, NULL);
+
+        for ( i = 0; i < ASYNC_MAX_WORKERS; i++ )
+                init_worker(&workers[i], i);
+
+        init_queue(&default_queue);
+        prelude_list_add_tail(&queue_list, &default_queue.registry);
+}
+
+
+
+static void get_queue_stats(prelude_async_queue_t *queue, prelude_async_stats_t *stats)
+{
+        stats->queued = atomic_load(&queue->pending);
+        stats->max_queued = atomic_load(&queue->stats.max_queued);
+        stats->processed = atomic_load(&queue->stats.processed);
+        stats->overflowed = atomic_load(&queue->stats.overflowed);
+        stats->latency_total = atomic_load(&queue->stats.latency_total);
+        stats->latency_max = atomic_load(&queue->stats.latency_max);
+        stats->stolen = 0;
+}
+
+
+
+static void merge_stats(prelude_async_stats_t *dst, const prelude_async_stats_t *src)
+{
+        dst->queued += src->queued;
+        dst->processed += src->processed;
+        dst->overflowed += src->overflowed;
+        dst->latency_total += src->latency_total;
+        dst->max_queued = MAX(dst->max_queued, src->max_queued);
+        dst->latency_max = MAX(dst->latency_max, src->latency_max);
+}
+
+
+
+static void queue_unref(prelude_async_queue_t *queue)
+{
+        prelude_async_stats_t stats;
+
+        if ( atomic_add(&queue->refcount, -1) > 0 )
+                return;
+
+        /*
+         * Keep the statistics of released queues accounted for.
+         */
+        get_queue_stats(queue, &stats);
+
+        gl_lock_lock(mutex);
+        prelude_list_del(&queue->registry);
+        merge_stats(&retired_stats, &stats);
+        gl_lock_unlock(mutex);
+
+        gl_cond_destroy(queue->cond);
+        gl_lock_destroy(queue->mutex);
+        gl_lock_destroy(queue->pop_mutex);
+        free(queue);
+}
+
+
+
+/*
+ * Hand @queue over to its home worker, waking it up if needed. When the
+ * home worker is busy, an idle worker is woken up so that it can steal
+ * the queue.
+ */
+static void schedule_queue(prelude_async_queue_t *queue)
+{
+        unsigned int i, count;
+        async_worker_t *home, *worker;
+        prelude_bool_t woken = FALSE;
+
+        count = MAX(atomic_load(&running_workers), 1);
+        home = &workers[queue->home % count];
+
+        gl_lock_lock(home->mutex);
+
+        prelude_list_add_tail(&home->runq, &queue->list);
+        if ( home->sleeping ) {
+                home->sleeping = FALSE;
+                gl_cond_signal(home->cond);
+                woken = TRUE;
+        }
+
+        gl_lock_unlock(home->mutex);
+
+        for ( i = 1; ! woken && i < count; i++ ) {
+                worker = &workers[(home->id + i) % count];
+
+                gl_lock_lock(worker->mutex);
+
+                if ( worker->sleeping ) {
+                        worker->sleeping = FALSE;
+                        gl_cond_signal(worker->cond);
+                        woken = TRUE;
+                }
+
+                gl_lock_unlock(worker->mutex);
+        }
+}
+
+
+
+static prelude_async_queue_t *pop_runq(async_worker_t *worker)
+{
+        prelude_async_queue_t *queue = NULL;
+
+        gl_lock_lock(worker->mutex);
+
+        if ( ! prelude_list_is_empty(&worker->runq) ) {
+                queue = prelude_list_entry(worker->runq.next, prelude_async_queue_t, list);
+                prelude_list_del(&queue->list);
+        }
+
+        gl_lock_unlock(worker->mutex);
+
+        return queue;
+}
+
+
+
+static prelude_async_queue_t *steal_queue(async_worker_t *worker)
+{
+        unsigned int i, count;
+        prelude_async_queue_t *queue;
+
+        count = atomic_load(&running_workers);
+
+        for ( i = 1; i < count; i++ ) {
+                queue = pop_runq(&workers[(worker->id + i) % count]);
+                if ( queue ) {
+                        gl_lock_lock(worker->mutex);
+                        worker->stolen++;
+                        gl_lock_unlock(worker->mutex);
+
+                        return queue;
+                }
+        }
+
+        return NULL;
+}
+
+
+
+/*
+ * Wait for a queue to become available.
+ */
+static int wait_queue(async_worker_t *worker, prelude_async_queue_t **queue)
+{
+        prelude_bool_t stop;
+
+        gl_lock_lock(worker->mutex);
+        worker->sleeping = TRUE;
+        gl_lock_unlock(worker->mutex);
+
+        /*
+         * Producers only wake up sleeping workers: announcing ourselves
+         * before looking at other run queues guarantee no queue is missed.
+         */
+        *queue = steal_queue(worker);
+
+        gl_lock_lock(worker->mutex);
+
+        while ( ! *queue && worker->sleeping && prelude_list_is_empty(&worker->runq) && ! atomic_load(&stop_processing) )
+                gl_cond_wait(worker->cond, worker->mutex);
+
+        worker->sleeping = FALSE;
+        stop = (! *queue && atomic_load(&stop_processing) && prelude_list_is_empty(&worker->runq));
+
+        gl_lock_unlock(worker->mutex);
+
+        return (stop) ? -1 : 0;
+}
+
+
+
+/*
+ * Process a batch of objects from @queue, then either reschedule the
+ * queue, or release it if it was drained.
+ */
+static void run_queue(async_worker_t *worker, prelude_async_queue_t *queue)
+{
+        unsigned int i;
+        prelude_list_t *node;
+        uint64_t latency, left;
+        async_entry_t *entry;
+        prelude_async_object_t *obj;
+
+        for ( i = 0; i < ASYNC_QUEUE_BATCH; i++ ) {
+                gl_lock_lock(queue->pop_mutex);
+                node = queue_pop(queue);
+                gl_lock_unlock(queue->pop_mutex);
+
+                if ( ! node )
+                        break;
+
+                entry = prelude_list_entry(node, async_entry_t, link);
+                latency = get_usec() - entry->time;
+
+                obj = entry_claim(entry);
+                if ( obj ) {
+                        atomic_add(&queue->stats.latency_total, latency);
+                        atomic_max(&queue->stats.latency_max, latency);
+                        atomic_add(&queue->stats.processed, 1);
+
+                        obj->_async_func(obj, obj->_async_data);
+                }
+
+                left = atomic_add(&queue->pending, -1);
+
+                if ( atomic_load(&queue->waiters) ) {
+                        gl_lock_lock(queue->mutex);
+                        gl_cond_broadcast(queue->cond);
+                        gl_lock_unlock(queue->mutex);
+                }
+
+                if ( left == 0 ) {
+                        queue_unref(queue);
+                        return;
+                }
+        }
+
+        gl_lock_lock(worker->mutex);
+        prelude_list_add_tail(&worker->runq, &queue->list);
+        gl_lock_unlock(worker->mutex);
+}
+
+
+
+static int block_signals(void)
+{
+        int ret;
+        sigset_t set;
+
+        ret = sigfillset(&set);
+        if ( ret < 0 ) {
+                prelude_log(PRELUDE_LOG_ERR, "sigfillset error: %s.\n", strerror(errno));
+                return ret;
+        }
+
+        ret = glthread_sigmask(SIG_BLOCK, &set, NULL);
+        if ( ret < 0 ) {
+                prelude_log(PRELUDE_LOG_ERR, "pthread_sigmask error: %s.\n", strerror(errno));
+                return ret;
+        }
+
+        return 0;
+}
+
+
+
+/*
+ * Called by the timer subsystem when a timer expiring before the
+ * current timer thread deadline is added.
+ */
+static void timer_notify(void)
+{
+        gl_lock_lock(timer_mutex);
+        timer_kick = TRUE;
+        gl_cond_signal(timer_cond);
+        gl_lock_unlock(timer_mutex);
+}
+
+
+
+/*
+ * Handle timers from the global base when PRELUDE_ASYNC_FLAGS_TIMER is set,
+ * waking up as they expire, rather than from a worker that might be busy.
+ */
+static void *timer_thread(void *arg)
+{
+        int ret;
+        unsigned int next;
+        struct timespec ts;
+
+        if ( block_signals() < 0 )
+                return NULL;
+
+        gl_tls_set(internal_thread_key, &timer_tid);
+
+        gl_lock_lock(timer_mutex);
+
+        while ( ! atomic_load(&stop_processing) ) {
+                if ( ! (async_flags & PRELUDE_ASYNC_FLAGS_TIMER) ) {
+                        gl_cond_wait(timer_cond, timer_mutex);
+                        continue;
+                }
+
+                timer_kick = FALSE;
+                gl_lock_unlock(timer_mutex);
+
+                next = _prelude_timer_wake_up();
+
+                get_timespec(&ts);
+                ts.tv_sec += next / 1000;
+                ts.tv_nsec += (next % 1000) * 1000000;
+                if ( ts.tv_nsec >= 1000000000 ) {
+                        ts.tv_sec++;
+                        ts.tv_nsec -= 1000000000;
+                }
+
+                gl_lock_lock(timer_mutex);
+
+                ret = 0;
+                while ( ! timer_kick && ! atomic_load(&stop_processing) && ret != ETIMEDOUT )
+                        ret = glthread_cond_timedwait(&timer_cond, &timer_mutex, &ts);
+        }
+
+        gl_lock_unlock(timer_mutex);
+
+        return NULL;
+}
+
+
+
+static void *async_thread(void *arg)
+{
+        int ret;
+        async_worker_t *worker = arg;
+        prelude_async_queue_t *queue;
+
+        if ( block_signals() < 0 )
+                return NULL;
+
+        gl_tls_set(internal_thread_key, worker);
+
+        while ( 1 ) {
+                queue = pop_runq(worker);
+                if ( ! queue ) {
+                        ret = wait_queue(worker, &queue);
+                        if ( ret < 0 ) {
+                                /*
+                                 * On some implementation (namely, recent Linux + glibc version),
+                                 * calling pthread_exit() from a shared library and joining the thread from
+                                 * an atexit callback result in a deadlock.
+                                 *
+                                 * Appear to be related to:
+                                 * http://sources.redhat.com/bugzilla/show_bug.cgi?id=654
+                                 *
+                                 * Simply returning from the thread seems to fix this problem.
+                                 */
+                                break;
+                        }
+
+                        if ( ! queue )
+                                continue;
+                }
+
+                run_queue(worker, queue);
+        }
+
+        return NULL;
+}
+
+
+
+/*
+ * Start workers up to the configured count, called with mutex held.
+ */
+static int start_workers(void)
+{
+        int ret;
+
+        unsigned int running = atomic_load(&running_workers);
+
+        while ( running < worker_count ) {
+                ret = glthread_create(&workers[running].thread, async_thread, &workers[running]);
+                if ( ret != 0 ) {
+                        prelude_log(PRELUDE_LOG_ERR, "error creating asynchronous thread: %s.\n", strerror(ret));
+                        return ret;
+                }
+
+                running++;
+                atomic_add(&running_workers, 1);
+        }
+
+        return 0;
+}
+
+
+
+/*
+ * Start the timer thread, called with mutex held.
+ */
+static int start_timer(void)
+{
+        int ret;
+
+        if ( timer_running )
+                return 0;
+
+        ret = glthread_create(&timer_tid, timer_thread, NULL);
+        if ( ret != 0 ) {
+                prelude_log(PRELUDE_LOG_ERR, "error creating asynchronous timer thread: %s.\n", strerror(ret));
+                return ret;
+        }
+
+        timer_running = TRUE;
+        _prelude_timer_set_notify(timer_notify);
+
+        return 0;
+}
+
+
+
+static int do_init_async(void)
+{
+        int ret;
+
+        gl_lock_lock(mutex);
+
+        ret = start_workers();
+        if ( ret == 0 )
+                ret = start_timer();
+
+        gl_lock_unlock(mutex);
+
+        if ( ret != 0 && atomic_load(&running_workers) == 0 )
+                return ret;
+
+        /*
+         * There is a problem with OpenBSD, where using atexit() from a multithread
+         * application result in a deadlock. No workaround has been found at the moment.
+         *
+         */
+#if ! defined(__OpenBSD__)
+        return atexit(prelude_async_exit);
+#else
+        return 0;
+#endif
+}
+
+
+
+/**
+ * prelude_async_set_flags:
+ * @flags: flags you want to set
+ *
+ * Sets flags to the asynchronous subsystem.
+ *
+ */
+void prelude_async_set_flags(prelude_async_flags_t flags)
+{
+        gl_once(async_once, async_init_once);
+
+        gl_lock_lock(timer_mutex);
+
+        async_flags = flags;
+        timer_kick = TRUE;
+        gl_cond_signal(timer_cond);
+
+        gl_lock_unlock(timer_mutex);
+}
+
+
+
+/**
+ * prelude_async_get_flags:
+ *
+ * Retrieves flags from the asynchronous subsystem
+ *
+ * Returns: asynchronous flags
+ */
+prelude_async_flags_t prelude_async_get_flags(void)
+{
+        return async_flags;
+}
 
 
-static PRELUDE_LIST(joblist);
 
-static prelude_async_flags_t async_flags = 0;
-static prelude_bool_t stop_processing = FALSE;
+/**
+ * prelude_async_set_worker_count:
+ * @count: Number of asynchronous worker threads.
+ *
+ * Sets the number of threads processing asynchronous operations. Operations
+ * added to the same queue are always processed in order, while different
+ * queues are processed concurrently, idle workers stealing queues from busy
+ * ones. The default is a single worker.
+ *
+ * Additional workers are started immediately if the asynchronous subsystem is
+ * already running, reducing the number of workers only takes effect the next time
+ * prelude_async_init() is called.
+ */
+void prelude_async_set_worker_count(unsigned int count)
+{
+        if ( count == 0 )
+                count = 1;
 
+        else if ( count > ASYNC_MAX_WORKERS )
+                count = ASYNC_MAX_WORKERS;
 
-static gl_thread_t thread;
-static gl_cond_t cond = gl_cond_initializer;
-static gl_lock_t mutex = gl_lock_initializer;
+        gl_lock_lock(mutex);
 
-static volatile sig_atomic_t is_initialized = FALSE;
+        worker_count = count;
+        if ( is_initialized )
+                start_workers();
+
+        gl_lock_unlock(mutex);
+}
 
 
 
-static int timespec_elapsed(struct timespec *end, struct timespec *start)
+/**
+ * prelude_async_get_worker_count:
+ *
+ * Returns: the number of asynchronous worker threads.
+ */
+unsigned int prelude_async_get_worker_count(void)
 {
-        int diff = end->tv_sec - start->tv_sec;
+        return worker_count;
+}
 
-        if ( end->tv_nsec < start->tv_nsec )
-                diff -= 1;
 
-        return diff;
+
+/**
+ * prelude_async_set_queue_limit:
+ * @limit: Maximum number of objects waiting in a queue, 0 for no limit.
+ *
+ * Sets the number of objects a queue can hold before the overflow policy
+ * set with prelude_async_set_overflow_policy() applies. There is no
+ * limit by default.
+ */
+void prelude_async_set_queue_limit(unsigned int limit)
+{
+        atomic_store(&queue_limit, limit);
 }
 
 
-static prelude_bool_t timespec_expired(struct timespec *end, struct timespec *start)
+
+/**
+ * prelude_async_get_queue_limit:
+ *
+ * Returns: the maximum number of objects waiting in a queue, 0 if there is no limit.
+ */
+unsigned int prelude_async_get_queue_limit(void)
 {
-        return ( timespec_elapsed(end, start) ) ? TRUE : FALSE;
+        return atomic_load(&queue_limit);
 }
 
 
-static inline struct timespec *get_timespec(struct timespec *ts)
+
+/**
+ * prelude_async_set_overflow_policy:
+ * @policy: Policy to use for full queues.
+ *
+ * Sets the behavior of queues holding more objects than allowed by
+ * prelude_async_set_queue_limit():
+ *
+ * #PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK: prelude_async_queue_add() blocks until
+ * the queue has room for the new object. Objects added from the asynchronous
+ * workers or timer thread, from an object or timer callback for example, are
+ * queued beyond the limit instead: these threads never block, since the room
+ * they would wait for might only be made by themselves.
+ *
+ * #PRELUDE_ASYNC_OVERFLOW_POLICY_DROP_OLDEST and
+ * #PRELUDE_ASYNC_OVERFLOW_POLICY_SPILL: adding to a full queue removes its
+ * oldest object, among those with the lowest priority, which is handed to the
+ * callback set with prelude_async_queue_set_overflow_callback() instead of
+ * being processed. Objects with a higher priority than the one added are
+ * kept: the new object is removed instead. This callback is called from the
+ * thread adding the new object, and is expected to release the removed one,
+ * or to save it for later processing, depending on the policy. Queues without
+ * an overflow callback are not limited.
+ */
+void prelude_async_set_overflow_policy(prelude_async_overflow_policy_t policy)
 {
-        struct timeval now;
+        overflow_policy = policy;
+}
 
-        gettimeofday(&now, NULL);
 
-        ts->tv_sec = now.tv_sec;
-        ts->tv_nsec = now.tv_usec * 1000;
 
-        return ts;
+/**
+ * prelude_async_get_overflow_policy:
+ *
+ * Returns: the policy used for full queues.
+ */
+prelude_async_overflow_policy_t prelude_async_get_overflow_policy(void)
+{
+        return overflow_policy;
 }
 
 
 
-static int wait_timer_and_data(prelude_async_flags_t *flags)
+/**
+ * prelude_async_set_scheduling:
+ * @sched: Scheduling to use between priorities.
+ *
+ * Sets how objects of different priorities within a queue are processed:
+ *
+ * #PRELUDE_ASYNC_SCHEDULING_STRICT: objects are only processed once no
+ * higher priority object is waiting. This is the default.
+ *
+ * #PRELUDE_ASYNC_SCHEDULING_WEIGHTED: each priority gets a share of the
+ * processing doubling with every level, so that low priority objects
+ * still make progress while higher priority ones are flowing in.
+ */
+void prelude_async_set_scheduling(prelude_async_scheduling_t sched)
 {
-        int ret;
-        struct timespec ts;
-        static struct timespec last_wakeup;
-        prelude_bool_t no_job_available = TRUE;
+        scheduling = sched;
+}
 
-        get_timespec(&last_wakeup);
-        last_wakeup.tv_sec--;
 
-        while ( no_job_available ) {
-                ret = 0;
 
-                gl_lock_lock(mutex);
+/**
+ * prelude_async_get_scheduling:
+ *
+ * Returns: the scheduling used between priorities.
+ */
+prelude_async_scheduling_t prelude_async_get_scheduling(void)
+{
+        return scheduling;
+}
 
-                ts.tv_sec = last_wakeup.tv_sec + 1;
-                ts.tv_nsec = last_wakeup.tv_nsec;
 
-                while ( (no_job_available = prelude_list_is_empty(&joblist)) &&
-                        ! stop_processing && async_flags == *flags && ret != ETIMEDOUT ) {
-                        ret = glthread_cond_timedwait(&cond, &mutex, &ts);
-                }
 
-                if ( no_job_available && stop_processing ) {
-                        gl_lock_unlock(mutex);
-                        return -1;
-                }
+/**
+ * prelude_async_init:
+ *
+ * Initialize the asynchronous subsystem.
+ *
+ * Returns: 0 on success, -1 if an error occured.
+ */
+int prelude_async_init(void)
+{
+        gl_once(async_once, async_init_once);
 
-                *flags = async_flags;
-                gl_lock_unlock(mutex);
+        if ( ! is_initialized ) {
+                is_initialized = TRUE;
+                atomic_store(&stop_processing, FALSE);
 
-                if ( ret == ETIMEDOUT || timespec_expired(get_timespec(&ts), &last_wakeup) ) {
-                        prelude_timer_wake_up();
-                        last_wakeup.tv_sec = ts.tv_sec;
-                        last_wakeup.tv_nsec = ts.tv_nsec;
-                }
+                return do_init_async();
         }
 
         return 0;
@@ -144,20 +1161,29 @@ static int wait_timer_and_data(prelude_async_flags_t *flags)
 
 
 
-
-static int wait_data(prelude_async_flags_t *flags)
+/**
+ * prelude_async_queue_new:
+ * @queue: Pointer where to store the created #prelude_async_queue_t object.
+ *
+ * Create a new asynchronous queue. Objects added to the queue through
+ * prelude_async_queue_add() are processed in order of priority, then in
+ * order of addition, concurrently with objects from other queues.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_async_queue_new(prelude_async_queue_t **queue)
 {
-        gl_lock_lock(mutex);
+        gl_once(async_once, async_init_once);
 
-        while ( prelude_list_is_empty(&joblist) && ! stop_processing && async_flags == *flags )
-                gl_cond_wait(cond, mutex);
+        *queue = malloc(sizeof(**queue));
+        if ( ! *queue )
+                return prelude_error_from_errno(errno);
 
-        if ( prelude_list_is_empty(&joblist) && stop_processing ) {
-                gl_lock_unlock(mutex);
-                return -1;
-        }
+        init_queue(*queue);
 
-        *flags = async_flags;
+        gl_lock_lock(mutex);
+        (*queue)->home = next_home++;
+        prelude_list_add_tail(&queue_list, &(*queue)->registry);
         gl_lock_unlock(mutex);
 
         return 0;
@@ -165,149 +1191,253 @@ static int wait_data(prelude_async_flags_t *flags)
 
 
 
-static prelude_async_object_t *get_next_job(void)
+/**
+ * prelude_async_queue_destroy:
+ * @queue: Pointer to a #prelude_async_queue_t object.
+ *
+ * Destroy @queue. Objects still waiting in @queue are processed
+ * before the queue is released.
+ */
+void prelude_async_queue_destroy(prelude_async_queue_t *queue)
 {
-        prelude_list_t *tmp;
-        prelude_async_object_t *obj = NULL;
+        prelude_return_if_fail(queue);
+        queue_unref(queue);
+}
 
-        gl_lock_lock(mutex);
 
-        prelude_list_for_each(&joblist, tmp) {
-                obj = prelude_linked_object_get_object(tmp);
-                prelude_linked_object_del((prelude_linked_object_t *) obj);
-                break;
-        }
 
-        gl_lock_unlock(mutex);
+/**
+ * prelude_async_queue_set_overflow_callback:
+ * @queue: Pointer to a #prelude_async_queue_t object.
+ * @func: Callback receiving objects removed from a full @queue.
+ *
+ * Sets the function called, in place of the object callback, for objects
+ * removed from @queue because of the overflow policy, or that could not be
+ * queued for lack of memory.
+ */
+void prelude_async_queue_set_overflow_callback(prelude_async_queue_t *queue, prelude_async_callback_t func)
+{
+        prelude_return_if_fail(queue);
+        queue->overflow_func = func;
+}
 
-        return obj;
+
+
+/*
+ * Wait for @queue to go below @limit, see prelude_async_set_overflow_policy().
+ */
+static void wait_queue_room(prelude_async_queue_t *queue, uint64_t limit)
+{
+        gl_lock_lock(queue->mutex);
+        atomic_add(&queue->waiters, 1);
+
+        while ( atomic_load(&queue->pending) >= limit && is_initialized && ! atomic_load(&stop_processing) )
+                gl_cond_wait(queue->cond, queue->mutex);
+
+        atomic_add(&queue->waiters, -1);
+        gl_lock_unlock(queue->mutex);
 }
 
 
 
-static void *async_thread(void *arg)
+/*
+ * Allocate the entry of @obj, added to @queue. Out of memory, @obj is handed
+ * to the overflow callback of @queue, as if the queue was full: NULL is then
+ * returned. Without callback, the allocation is retried as objects of @queue
+ * get processed, or every ENTRY_RETRY_DELAY milliseconds. The object callback
+ * is never run from the thread adding it.
+ */
+static async_entry_t *entry_new(prelude_async_queue_t *queue, prelude_async_object_t *obj)
 {
-        int ret;
-        sigset_t set;
-        prelude_async_object_t *obj;
-        prelude_async_flags_t nflags = async_flags;
+        async_entry_t *entry;
+        struct timespec ts;
 
-        ret = sigfillset(&set);
-        if ( ret < 0 ) {
-                prelude_log(PRELUDE_LOG_ERR, "sigfillset error: %s.\n", strerror(errno));
-                return NULL;
-        }
+        entry = malloc(sizeof(*entry));
+        if ( entry )
+                return entry;
 
-        ret = glthread_sigmask(SIG_BLOCK, &set, NULL);
-        if ( ret < 0 ) {
-                prelude_log(PRELUDE_LOG_ERR, "pthread_sigmask error: %s.\n", strerror(errno));
+        prelude_log(PRELUDE_LOG_ERR, "error queueing asynchronous object: %s.\n", strerror(errno));
+
+        if ( queue->overflow_func ) {
+                atomic_add(&queue->stats.overflowed, 1);
+                queue->overflow_func(obj, obj->_async_data);
                 return NULL;
         }
 
-        while ( 1 ) {
-
-                if ( nflags & PRELUDE_ASYNC_FLAGS_TIMER )
-                        ret = wait_timer_and_data(&nflags);
-                else
-                        ret = wait_data(&nflags);
-
-                if ( ret < 0 ) {
-                        /*
-                         * On some implementation (namely, recent Linux + glibc version),
-                         * calling pthread_exit() from a shared library and joining the thread from
-                         * an atexit callback result in a deadlock.
-                         *
-                         * Appear to be related to:
-                         * http://sources.redhat.com/bugzilla/show_bug.cgi?id=654
-                         *
-                         * Simply returning from the thread seems to fix this problem.
-                         */
-                        break;
+        while ( ! (entry = malloc(sizeof(*entry))) ) {
+                get_timespec(&ts);
+                ts.tv_nsec += ENTRY_RETRY_DELAY * 1000000;
+                if ( ts.tv_nsec >= 1000000000 ) {
+                        ts.tv_sec++;
+                        ts.tv_nsec -= 1000000000;
                 }
 
-                while ( (obj = get_next_job()) )
-                        obj->_async_func(obj, obj->_async_data);
+                gl_lock_lock(queue->mutex);
+                atomic_add(&queue->waiters, 1);
+                glthread_cond_timedwait(&queue->cond, &queue->mutex, &ts);
+                atomic_add(&queue->waiters, -1);
+                gl_lock_unlock(queue->mutex);
         }
 
-        return NULL;
+        return entry;
 }
 
 
 
-static int do_init_async(void)
+/*
+ * With the drop-oldest and spill policies, @entry takes the place of the
+ * oldest, lowest priority, object of the full @queue, which is handed to
+ * the overflow callback. Objects of a higher priority than @priority are
+ * never removed: when only such objects are waiting, or being processed,
+ * @entry is the one overflowing.
+ */
+static void queue_replace(prelude_async_queue_t *queue, async_entry_t *entry, unsigned int priority)
 {
-        int ret;
+        prelude_list_t *node;
+        prelude_async_object_t *obj;
 
-        ret = glthread_create(&thread, async_thread, NULL);
-        if ( ret != 0 ) {
-                prelude_log(PRELUDE_LOG_ERR, "error creating asynchronous thread: %s.\n", strerror(ret));
-                return ret;
-        }
+        gl_lock_lock(queue->pop_mutex);
 
-        /*
-         * There is a problem with OpenBSD, where using atexit() from a multithread
-         * application result in a deadlock. No workaround has been found at the moment.
-         *
-         */
-#if ! defined(__OpenBSD__)
-        return atexit(prelude_async_exit);
-#else
-        return 0;
-#endif
+        node = queue_pop_lowest(queue, priority);
+        if ( node )
+                lane_push(&queue->lane[priority], &entry->link);
+        else
+                node = &entry->link;
+
+        gl_lock_unlock(queue->pop_mutex);
+
+        obj = entry_claim(prelude_list_entry(node, async_entry_t, link));
+        if ( obj ) {
+                atomic_add(&queue->stats.overflowed, 1);
+                queue->overflow_func(obj, obj->_async_data);
+        }
 }
 
 
 
 /**
- * prelude_async_set_flags:
- * @flags: flags you want to set
+ * prelude_async_queue_add_priority:
+ * @queue: Pointer to a #prelude_async_queue_t object.
+ * @obj: Pointer to a #prelude_async_t object.
+ * @priority: Priority of @obj, from 0 to #PRELUDE_ASYNC_PRIORITY_COUNT - 1.
  *
- * Sets flags to the asynchronous subsystem.
+ * Adds @obj to the asynchronous processing @queue. Higher priority objects
+ * are processed first, according to the scheduling set with
+ * prelude_async_set_scheduling(), while objects of the same priority are
+ * processed in order. Values of #prelude_msg_priority_t can be used as
+ * @priority.
  *
+ * Unless @queue is full, this function does not take any lock. See
+ * prelude_async_set_overflow_policy() for what happens when it is.
  */
-void prelude_async_set_flags(prelude_async_flags_t flags)
+void prelude_async_queue_add_priority(prelude_async_queue_t *queue, prelude_async_object_t *obj, unsigned int priority)
 {
-        gl_lock_lock(mutex);
+        uint64_t pending, limit;
+        async_entry_t *entry;
 
-        async_flags = flags;
-        gl_cond_signal(cond);
+        prelude_return_if_fail(queue);
+        prelude_return_if_fail(obj);
+        prelude_return_if_fail(priority < PRELUDE_ASYNC_PRIORITY_COUNT);
 
-        gl_lock_unlock(mutex);
+        entry = entry_new(queue, obj);
+        if ( ! entry )
+                return;
+
+        limit = atomic_load(&queue_limit);
+        if ( limit && overflow_policy == PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK &&
+             atomic_load(&queue->pending) >= limit && ! gl_tls_get(internal_thread_key) )
+                wait_queue_room(queue, limit);
+
+        entry->obj = obj;
+        entry->time = get_usec();
+        atomic_list_store(&obj->_list.prev, &entry->link);
+
+        if ( limit && overflow_policy != PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK && queue->overflow_func &&
+             atomic_load(&queue->pending) >= limit ) {
+                queue_replace(queue, entry, priority);
+                return;
+        }
+
+        lane_push(&queue->lane[priority], &entry->link);
+
+        pending = atomic_add(&queue->pending, 1);
+        atomic_max(&queue->stats.max_queued, pending);
+
+        if ( pending == 1 ) {
+                atomic_add(&queue->refcount, 1);
+                schedule_queue(queue);
+        }
 }
 
 
 
 /**
- * prelude_async_get_flags:
- *
- * Retrieves flags from the asynchronous subsystem
+ * prelude_async_queue_add:
+ * @queue: Pointer to a #prelude_async_queue_t object.
+ * @obj: Pointer to a #prelude_async_t object.
  *
- * Returns: asynchronous flags
+ * Adds @obj to the asynchronous processing @queue, with the lowest
+ * priority. See prelude_async_queue_add_priority().
  */
-prelude_async_flags_t prelude_async_get_flags(void)
+void prelude_async_queue_add(prelude_async_queue_t *queue, prelude_async_object_t *obj)
 {
-        return async_flags;
+        prelude_async_queue_add_priority(queue, obj, 0);
 }
 
 
 
 /**
- * prelude_async_init:
+ * prelude_async_queue_get_stats:
+ * @queue: Pointer to a #prelude_async_queue_t object.
+ * @stats: Pointer where to store @queue statistics.
  *
- * Initialize the asynchronous subsystem.
+ * Retrieves processing statistics for @queue.
+ */
+void prelude_async_queue_get_stats(prelude_async_queue_t *queue, prelude_async_stats_t *stats)
+{
+        prelude_return_if_fail(queue);
+        prelude_return_if_fail(stats);
+
+        get_queue_stats(queue, stats);
+}
+
+
+
+/**
+ * prelude_async_get_stats:
+ * @stats: Pointer where to store the statistics.
  *
- * Returns: 0 on success, -1 if an error occured.
+ * Retrieves processing statistics for the whole asynchronous subsystem:
+ * counters are summed over every queue, including destroyed ones, while
+ * @max_queued and @latency_max report the highest value of any queue.
  */
-int prelude_async_init(void)
+void prelude_async_get_stats(prelude_async_stats_t *stats)
 {
-        if ( ! is_initialized ) {
-                is_initialized = TRUE;
-                stop_processing = FALSE;
+        unsigned int i;
+        prelude_list_t *tmp;
+        prelude_async_stats_t qstats;
 
-                return do_init_async();
+        prelude_return_if_fail(stats);
+
+        gl_once(async_once, async_init_once);
+        memset(stats, 0, sizeof(*stats));
+
+        gl_lock_lock(mutex);
+
+        merge_stats(stats, &retired_stats);
+
+        prelude_list_for_each(&queue_list, tmp) {
+                get_queue_stats(prelude_list_entry(tmp, prelude_async_queue_t, registry), &qstats);
+                merge_stats(stats, &qstats);
         }
 
-        return 0;
+        gl_lock_unlock(mutex);
+
+        for ( i = 0; i < ASYNC_MAX_WORKERS; i++ ) {
+                gl_lock_lock(workers[i].mutex);
+                stats->stolen += workers[i].stolen;
+                gl_lock_unlock(workers[i].mutex);
+        }
 }
 
 
@@ -316,16 +1446,12 @@ int prelude_async_init(void)
  * prelude_async_add:
  * @obj: Pointer to a #prelude_async_t object.
  *
- * Adds @obj to the asynchronous processing list.
+ * Adds @obj to the default asynchronous processing queue.
  */
 void prelude_async_add(prelude_async_object_t *obj)
 {
-        gl_lock_lock(mutex);
-
-        prelude_linked_object_add_tail(&joblist, (prelude_linked_object_t *) obj);
-        gl_cond_signal(cond);
-
-        gl_lock_unlock(mutex);
+        gl_once(async_once, async_init_once);
+        prelude_async_queue_add(&default_queue, obj);
 }
 
 
@@ -334,38 +1460,84 @@ void prelude_async_add(prelude_async_object_t *obj)
  * prelude_async_del:
  * @obj: Pointer to a #prelude_async_t object.
  *
- * Deletes @obj from the asynchronous processing list.
+ * Removes @obj from the queue it was added to: it won't be processed, and
+ * may be released once this function returns. An object whose processing
+ * already started is not waited for.
  */
 void prelude_async_del(prelude_async_object_t *obj)
 {
-        gl_lock_lock(mutex);
-        prelude_linked_object_del((prelude_linked_object_t *) obj);
-        gl_lock_unlock(mutex);
+        prelude_list_t *link;
+        async_entry_t *entry;
+
+        prelude_return_if_fail(obj);
+
+        link = atomic_list_xchg(&obj->_list.prev, NULL);
+        if ( ! link )
+                return;
+
+        /*
+         * The entry is left in its lane, and released by the worker,
+         * unless the worker already claimed the object.
+         */
+        entry = prelude_list_entry(link, async_entry_t, link);
+        if ( ! atomic_obj_xchg(&entry->obj, NULL) )
+                free(entry);
 }
 
 
 
 void prelude_async_exit(void)
 {
-        prelude_bool_t has_job;
+        prelude_list_t *tmp;
+        unsigned int i, count;
+        prelude_async_stats_t stats;
+        prelude_async_queue_t *queue;
 
         if ( ! is_initialized )
                 return;
 
+        prelude_async_get_stats(&stats);
+        if ( stats.queued )
+                prelude_log(PRELUDE_LOG_INFO, "Waiting for asynchronous operation to complete.\n");
+
+        count = atomic_load(&running_workers);
+        atomic_store(&stop_processing, TRUE);
+
+        for ( i = 0; i < count; i++ ) {
+                gl_lock_lock(workers[i].mutex);
+                gl_cond_signal(workers[i].cond);
+                gl_lock_unlock(workers[i].mutex);
+        }
+
+        gl_lock_lock(timer_mutex);
+        gl_cond_signal(timer_cond);
+        gl_lock_unlock(timer_mutex);
+
+        /*
+         * Release producers waiting for room in a queue.
+         */
         gl_lock_lock(mutex);
 
-        stop_processing = TRUE;
-        gl_cond_signal(cond);
-        has_job = ! prelude_list_is_empty(&joblist);
+        prelude_list_for_each(&queue_list, tmp) {
+                queue = prelude_list_entry(tmp, prelude_async_queue_t, registry);
+
+                gl_lock_lock(queue->mutex);
+                gl_cond_broadcast(queue->cond);
+                gl_lock_unlock(queue->mutex);
+        }
 
         gl_lock_unlock(mutex);
 
-        if ( has_job )
-                prelude_log(PRELUDE_LOG_INFO, "Waiting for asynchronous operation to complete.\n");
+        for ( i = 0; i < count; i++ )
+                gl_thread_join(workers[i].thread, NULL);
+
+        atomic_add(&running_workers, -(int64_t) count);
 
-        gl_thread_join(thread, NULL);
-        gl_cond_destroy(cond);
-        gl_lock_destroy(mutex);
+        if ( timer_running ) {
+                gl_thread_join(timer_tid, NULL);
+                _prelude_timer_set_notify(NULL);
+                timer_running = FALSE;
+        }
 
         is_initialized = FALSE;
 }
@@ -374,13 +1546,53 @@ void prelude_async_exit(void)
 
 void _prelude_async_fork_prepare(void)
 {
+        unsigned int i;
+        prelude_list_t *tmp;
+        prelude_async_queue_t *queue;
+
+        gl_once(async_once, async_init_once);
+
         gl_lock_lock(mutex);
+
+        prelude_list_for_each(&queue_list, tmp) {
+                queue = prelude_list_entry(tmp, prelude_async_queue_t, registry);
+                gl_lock_lock(queue->mutex);
+                gl_lock_lock(queue->pop_mutex);
+        }
+
+        for ( i = 0; i < ASYNC_MAX_WORKERS; i++ )
+                gl_lock_lock(workers[i].mutex);
+
+        gl_lock_lock(timer_mutex);
+
+#ifndef HAVE_ATOMIC_BUILTINS
+        gl_lock_lock(atomic_mutex);
+#endif
 }
 
 
 
 void _prelude_async_fork_parent(void)
 {
+        unsigned int i;
+        prelude_list_t *tmp;
+        prelude_async_queue_t *queue;
+
+#ifndef HAVE_ATOMIC_BUILTINS
+        gl_lock_unlock(atomic_mutex);
+#endif
+
+        gl_lock_unlock(timer_mutex);
+
+        for ( i = 0; i < ASYNC_MAX_WORKERS; i++ )
+                gl_lock_unlock(workers[i].mutex);
+
+        prelude_list_for_each(&queue_list, tmp) {
+                queue = prelude_list_entry(tmp, prelude_async_queue_t, registry);
+                gl_lock_unlock(queue->pop_mutex);
+                gl_lock_unlock(queue->mutex);
+        }
+
         gl_lock_unlock(mutex);
 }
 
@@ -388,8 +1600,44 @@ void _prelude_async_fork_parent(void)
 
 void _prelude_async_fork_child(void)
 {
+        unsigned int i;
+        prelude_async_stats_t stats;
+        prelude_async_queue_t *queue;
+        prelude_list_t *tmp, *bkp;
+
+        /*
+         * Threads aren't copied accross fork(): pending operations
+         * are dropped, and queues left unscheduled.
+         */
         is_initialized = FALSE;
-        prelude_list_init(&joblist);
+        running_workers = 0;
+
+#ifndef HAVE_ATOMIC_BUILTINS
+        gl_lock_init(atomic_mutex);
+#endif
+
+        timer_running = FALSE;
+        gl_lock_init(timer_mutex);
+        gl_cond_init(timer_cond);
+
+        for ( i = 0; i < ASYNC_MAX_WORKERS; i++ )
+                init_worker(&workers[i], i);
+
+        prelude_list_for_each_safe(&queue_list, tmp, bkp) {
+                queue = prelude_list_entry(tmp, prelude_async_queue_t, registry);
+
+                if ( queue->pending )
+                        queue->refcount--;
+
+                reset_queue(queue);
+
+                if ( queue->refcount == 0 ) {
+                        get_queue_stats(queue, &stats);
+                        prelude_list_del(&queue->registry);
+                        merge_stats(&retired_stats, &stats);
+                        free(queue);
+                }
+        }
+
         gl_lock_init(mutex);
-        gl_cond_init(cond);
 }
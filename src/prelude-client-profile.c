@@ -609,7 +609,7 @@ void prelude_client_profile_destroy(prelude_client_profile_t *cp)
                 return;
 
         if ( cp->credentials )
-                gnutls_certificate_free_credentials(cp->credentials);
+                tls_auth_release_credentials(cp->credentials);
 
         if ( cp->name )
                 free(cp->name);
@@ -758,7 +758,8 @@ int prelude_client_profile_set_name(prelude_client_profile_t *cp, const char *na
  * @cp: Pointer to a #prelude_client_profile_t object.
  * @credentials: The GNU TLS certificate credentials retrieved.
  *
- * Gets the prelude client profile credentials
+ * Gets the prelude client profile credentials. Profiles using the same
+ * key and certificate files share their credentials, which are only loaded once.
  *
  * Returns: 0 on success or a negative value if an error occured.
  */
@@ -773,7 +774,7 @@ int prelude_client_profile_get_credentials(prelude_client_profile_t *cp, void **
                 return 0;
         }
 
-        ret = tls_auth_init(cp, &cp->credentials);
+        ret = tls_auth_get_credentials(cp, &cp->credentials);
         if ( ret < 0 )
                 return ret;
 
@@ -52,6 +52,7 @@
 #include "prelude-log.h"
 #include "prelude-ident.h"
 #include "prelude-async.h"
+#include "prelude-failover.h"
 #include "prelude-option.h"
 #include "prelude-connection-pool.h"
 #include "prelude-client.h"
@@ -143,6 +144,9 @@ extern int _prelude_connection_keepalive_probes;
 extern int _prelude_connection_keepalive_intvl;
 prelude_option_t *_prelude_generic_optlist = NULL;
 
+static unsigned int failover_batch_size = 1;
+static unsigned int failover_batch_delay = 0;
+
 
 
 static int client_write_cb(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg)
@@ -947,12 +951,16 @@ static int connection_pool_event_cb(prelude_connection_pool_t *pool,
         if ( event != PRELUDE_CONNECTION_POOL_EVENT_INPUT )
                 return 0;
 
+        /*
+         * Acknowledgements are consumed by prelude_connection_recv(),
+         * only wait for the rest of a partially read message.
+         */
         do {
                 ret = prelude_connection_recv(conn, &msg);
-        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN && msg );
 
         if ( ret < 0 )
-                return ret;
+                return (prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN) ? 0 : ret;
 
         client = prelude_connection_pool_get_data(pool);
 
@@ -1000,11 +1008,278 @@ static int set_tcp_keepalive_intvl(prelude_option_t *opt, const char *optarg, pr
 }
 
 
+static int set_msg_pool_high_water_mark(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_msg_pool_set_high_water_mark(strtoul(optarg, NULL, 10));
+        return 0;
+}
+
+
+static int set_async_workers(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_async_set_worker_count(strtoul(optarg, NULL, 10));
+        return 0;
+}
+
+
+static int set_async_queue_limit(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_async_set_queue_limit(strtoul(optarg, NULL, 10));
+        return 0;
+}
+
+
+static int set_async_overflow_policy(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        if ( strcmp(optarg, "block") == 0 )
+                prelude_async_set_overflow_policy(PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK);
+
+        else if ( strcmp(optarg, "drop-oldest") == 0 )
+                prelude_async_set_overflow_policy(PRELUDE_ASYNC_OVERFLOW_POLICY_DROP_OLDEST);
+
+        else if ( strcmp(optarg, "spill") == 0 )
+                prelude_async_set_overflow_policy(PRELUDE_ASYNC_OVERFLOW_POLICY_SPILL);
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "unknown asynchronous overflow policy '%s'", optarg);
+
+        return 0;
+}
+
+
+static int set_async_scheduling(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        if ( strcmp(optarg, "strict") == 0 )
+                prelude_async_set_scheduling(PRELUDE_ASYNC_SCHEDULING_STRICT);
+
+        else if ( strcmp(optarg, "weighted") == 0 )
+                prelude_async_set_scheduling(PRELUDE_ASYNC_SCHEDULING_WEIGHTED);
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "unknown asynchronous scheduling '%s'", optarg);
+
+        return 0;
+}
+
+
+static int set_failover_batch_size(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        failover_batch_size = strtoul(optarg, NULL, 10);
+        prelude_failover_set_default_group_commit(failover_batch_size, failover_batch_delay);
+
+        return 0;
+}
+
+
+static int set_failover_batch_delay(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        failover_batch_delay = strtoul(optarg, NULL, 10);
+        prelude_failover_set_default_group_commit(failover_batch_size, failover_batch_delay);
+
+        return 0;
+}
+
+
+static int set_failover_durability(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        if ( strcmp(optarg, "none") == 0 )
+                prelude_failover_set_default_durability(PRELUDE_FAILOVER_DURABILITY_NONE);
+
+        else if ( strcmp(optarg, "batch") == 0 )
+                prelude_failover_set_default_durability(PRELUDE_FAILOVER_DURABILITY_BATCH);
+
+        else if ( strcmp(optarg, "message") == 0 )
+                prelude_failover_set_default_durability(PRELUDE_FAILOVER_DURABILITY_MESSAGE);
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "unknown failover durability '%s'", optarg);
+
+        return 0;
+}
+
+
+static int set_failover_segment_size(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_failover_set_default_segment_size(strtoul(optarg, NULL, 10));
+        return 0;
+}
+
+
+static int set_failover_compression(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        if ( strcmp(optarg, "none") == 0 )
+                return prelude_failover_set_default_compression(PRELUDE_FAILOVER_COMPRESSION_NONE);
+
+        else if ( strcmp(optarg, "deflate") == 0 )
+                return prelude_failover_set_default_compression(PRELUDE_FAILOVER_COMPRESSION_DEFLATE);
+
+        return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "unknown failover compression '%s'", optarg);
+}
+
+
+static int set_batch_size(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        size_t size;
+        prelude_client_t *client = context;
+        prelude_connection_pool_flags_t flags = prelude_connection_pool_get_flags(client->cpool);
+
+        size = strtoul(optarg, NULL, 10);
+        if ( size )
+                prelude_connection_pool_set_batch_size(client->cpool, size);
+
+        flags = (size) ? flags | PRELUDE_CONNECTION_POOL_FLAGS_BATCH : flags & ~PRELUDE_CONNECTION_POOL_FLAGS_BATCH;
+        prelude_connection_pool_set_flags(client->cpool, flags);
+
+        return 0;
+}
+
+
+static int set_batch_delay(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_client_t *client = context;
+
+        prelude_connection_pool_set_batch_delay(client->cpool, strtoul(optarg, NULL, 10));
+        return 0;
+}
+
+
+static int set_ack_window(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        size_t window;
+        prelude_client_t *client = context;
+        prelude_connection_pool_flags_t flags = prelude_connection_pool_get_flags(client->cpool);
+
+        window = strtoul(optarg, NULL, 10);
+        if ( window )
+                prelude_connection_pool_set_ack_window(client->cpool, window);
+
+        flags = (window) ? flags | PRELUDE_CONNECTION_POOL_FLAGS_ACK : flags & ~PRELUDE_CONNECTION_POOL_FLAGS_ACK;
+        prelude_connection_pool_set_flags(client->cpool, flags);
+
+        return 0;
+}
+
+
+static int set_failover_replay_rate(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        unsigned int rate;
+        prelude_client_t *client = context;
+        prelude_connection_pool_flags_t flags = prelude_connection_pool_get_flags(client->cpool);
+
+        rate = strtoul(optarg, NULL, 10);
+        if ( rate )
+                prelude_connection_pool_set_replay_rate(client->cpool, rate);
+
+        flags = (rate) ? flags | PRELUDE_CONNECTION_POOL_FLAGS_REPLAY : flags & ~PRELUDE_CONNECTION_POOL_FLAGS_REPLAY;
+        prelude_connection_pool_set_flags(client->cpool, flags);
+
+        return 0;
+}
+
+
+static int set_server_balance(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_client_t *client = context;
+
+        if ( strcmp(optarg, "round-robin") == 0 )
+                prelude_connection_pool_set_balance(client->cpool, PRELUDE_CONNECTION_POOL_BALANCE_ROUND_ROBIN);
+
+        else if ( strcmp(optarg, "hash") == 0 )
+                prelude_connection_pool_set_balance(client->cpool, PRELUDE_CONNECTION_POOL_BALANCE_HASH);
+
+        else if ( strcmp(optarg, "least-loaded") == 0 )
+                prelude_connection_pool_set_balance(client->cpool, PRELUDE_CONNECTION_POOL_BALANCE_LEAST_LOADED);
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "unknown server balance '%s'", optarg);
+
+        return 0;
+}
+
+
 static int set_tls_options(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
 {
         return tls_auth_init_priority(optarg);
 }
 
+
+static int set_tls_offload(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_client_t *client = context;
+        prelude_connection_pool_flags_t flags = prelude_connection_pool_get_flags(client->cpool);
+
+        if ( strcmp(optarg, "yes") == 0 )
+                flags |= PRELUDE_CONNECTION_POOL_FLAGS_TLS_OFFLOAD;
+
+        else if ( strcmp(optarg, "no") == 0 )
+                flags &= ~PRELUDE_CONNECTION_POOL_FLAGS_TLS_OFFLOAD;
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "invalid tls-offload value '%s' (yes or no expected)", optarg);
+
+        prelude_connection_pool_set_flags(client->cpool, flags);
+
+        return 0;
+}
+
+
+static int set_compact_encoding(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_client_t *client = context;
+        prelude_connection_pool_flags_t flags = prelude_connection_pool_get_flags(client->cpool);
+
+        if ( strcmp(optarg, "yes") == 0 )
+                flags |= PRELUDE_CONNECTION_POOL_FLAGS_COMPACT;
+
+        else if ( strcmp(optarg, "no") == 0 )
+                flags &= ~PRELUDE_CONNECTION_POOL_FLAGS_COMPACT;
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "invalid compact-encoding value '%s' (yes or no expected)", optarg);
+
+        prelude_connection_pool_set_flags(client->cpool, flags);
+
+        return 0;
+}
+
+static int set_dictionary_encoding(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_client_t *client = context;
+        prelude_connection_pool_flags_t flags = prelude_connection_pool_get_flags(client->cpool);
+
+        if ( strcmp(optarg, "yes") == 0 )
+                flags |= PRELUDE_CONNECTION_POOL_FLAGS_DICTIONARY;
+
+        else if ( strcmp(optarg, "no") == 0 )
+                flags &= ~PRELUDE_CONNECTION_POOL_FLAGS_DICTIONARY;
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "invalid dictionary-encoding value '%s' (yes or no expected)", optarg);
+
+        prelude_connection_pool_set_flags(client->cpool, flags);
+
+        return 0;
+}
+
+static int set_compression(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
+{
+        prelude_client_t *client = context;
+        prelude_connection_pool_flags_t flags = prelude_connection_pool_get_flags(client->cpool);
+
+        if ( strcmp(optarg, "yes") == 0 )
+                flags |= PRELUDE_CONNECTION_POOL_FLAGS_COMPRESSION;
+
+        else if ( strcmp(optarg, "no") == 0 )
+                flags &= ~PRELUDE_CONNECTION_POOL_FLAGS_COMPRESSION;
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "invalid compression value '%s' (yes or no expected)", optarg);
+
+        prelude_connection_pool_set_flags(client->cpool, flags);
+
+        return 0;
+}
+
 static int set_heartbeat_interval(prelude_option_t *opt, const char *optarg, prelude_string_t *err, void *context)
 {
         prelude_client_t *ptr = context;
@@ -1148,6 +1423,30 @@ int _prelude_client_register_options(void)
         if ( ret < 0 )
                 return ret;
 
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "tls-offload", "Hand TLS records encryption to the kernel when supported (yes, no)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_tls_offload, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "compact-encoding", "Use the compact message encoding with managers supporting it (yes, no)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_compact_encoding, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "dictionary-encoding", "Send repeated strings once per manager connection, along with compact-encoding (yes, no)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_dictionary_encoding, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "compression", "Compress the data sent to managers supporting it (yes, no)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_compression, NULL);
+        if ( ret < 0 )
+                return ret;
+
         ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
                                  "tcp-keepalive-time", "Interval between the last data packet sent and the first keepalive probe",
                                  PRELUDE_OPTION_ARGUMENT_REQUIRED, set_tcp_keepalive_time, NULL);
@@ -1166,6 +1465,96 @@ int _prelude_client_register_options(void)
         if ( ret < 0 )
                 return ret;
 
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "msg-pool-high-water-mark", "Maximum number of bytes of unused message buffer kept for reuse",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_msg_pool_high_water_mark, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "async-workers", "Number of threads used for asynchronous message delivery",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_async_workers, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "async-queue-limit", "Maximum number of messages waiting for asynchronous delivery (0 for no limit)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_async_queue_limit, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "async-overflow-policy", "What to do when async-queue-limit is reached (block, drop-oldest, spill)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_async_overflow_policy, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "async-scheduling", "Order of asynchronous delivery between message priorities (strict, weighted)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_async_scheduling, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "failover-batch-size", "Number of failover messages written with a single journal update",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_failover_batch_size, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "failover-batch-delay", "Maximum number of milliseconds a failover message waits for its batch to be written",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_failover_batch_delay, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "failover-durability", "When failover data are synchronized to disk (none, batch, message)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_failover_durability, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "failover-segment-size", "Size of memory mapped failover segments in bytes (0 to use a single data file)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_failover_segment_size, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "failover-compression", "Compression of failover segments (none, deflate)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_failover_compression, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "failover-replay-rate", "Number of failover messages replayed per second in the background (0 to replay them all at once)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_failover_replay_rate, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "batch-size", "Maximum size in bytes of the batches of messages written to each manager (0 to disable batching)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_batch_size, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "batch-delay", "Maximum number of microseconds a message waits for its batch to be written",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_batch_delay, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "ack-window", "Maximum number of messages awaiting acknowledgement from each manager (0 to disable acknowledgements)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_ack_window, NULL);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CFG, 0,
+                                 "server-balance", "How messages are spread across managers joined with '<>' (round-robin, hash, least-loaded)",
+                                 PRELUDE_OPTION_ARGUMENT_REQUIRED, set_server_balance, NULL);
+        if ( ret < 0 )
+                return ret;
+
         ret = prelude_option_add(root_list, NULL, PRELUDE_OPTION_TYPE_CLI|PRELUDE_OPTION_TYPE_CFG|
                                  PRELUDE_OPTION_TYPE_WIDE, 0, "analyzer-name", "Name for this analyzer",
                                  PRELUDE_OPTION_ARGUMENT_OPTIONAL, set_analyzer_name, get_analyzer_name);
@@ -1500,6 +1889,9 @@ void prelude_client_send_msg(prelude_client_t *client, prelude_msg_t *msg)
  */
 void prelude_client_send_idmef(prelude_client_t *client, idmef_message_t *msg)
 {
+        prelude_msgbuf_flags_t flags;
+        prelude_connection_feature_t features;
+
         prelude_return_if_fail(client);
         prelude_return_if_fail(msg);
 
@@ -1509,6 +1901,21 @@ void prelude_client_send_idmef(prelude_client_t *client, idmef_message_t *msg)
          */
         gl_lock_lock(client->msgbuf_lock);
 
+        /*
+         * The compact encoding and the dictionary are only used once
+         * every manager agreed on them.
+         */
+        features = prelude_connection_pool_get_features(client->cpool);
+        flags = prelude_msgbuf_get_flags(client->msgbuf) & ~(PRELUDE_MSGBUF_FLAGS_COMPACT|PRELUDE_MSGBUF_FLAGS_DICTIONARY);
+
+        if ( features & PRELUDE_CONNECTION_FEATURE_COMPACT )
+                flags |= PRELUDE_MSGBUF_FLAGS_COMPACT;
+
+        if ( features & PRELUDE_CONNECTION_FEATURE_DICTIONARY )
+                flags |= PRELUDE_MSGBUF_FLAGS_DICTIONARY;
+
+        prelude_msgbuf_set_flags(client->msgbuf, flags);
+
         _idmef_message_assign_missing(client, msg);
         idmef_message_write(msg, client->msgbuf);
         prelude_msgbuf_mark_end(client->msgbuf);
@@ -33,7 +33,23 @@
 #include <sys/select.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <limits.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/time.h>
+
+#ifdef HAVE_EPOLL_CREATE1
+# include <sys/epoll.h>
+#endif
+
+#ifdef HAVE_SYS_IOCTL_H
+# include <sys/ioctl.h>
+#endif
+
+#ifdef HAVE_NETINET_TCP_H
+# include <netinet/in.h>
+# include <netinet/tcp.h>
+#endif
 
 #include "glthread/lock.h"
 
@@ -57,6 +73,18 @@
 
 #define INITIAL_EXPIRATION_TIME 10
 #define MAXIMUM_EXPIRATION_TIME 3600
+#define CONNECTION_TIMEOUT 60
+#define CONNECTION_POLL_INTERVAL 100
+#define FAILOVER_FLUSH_BATCH 64
+#define EPOLL_MAX_EVENTS 64
+#define BATCH_MAX_MSG 64
+#define BATCH_MIN_SIZE 1024
+#define BATCH_DEFAULT_SIZE (64 * 1024)
+#define BATCH_DEFAULT_DELAY 1000
+#define ACK_DEFAULT_WINDOW 256
+#define ACK_RESERVED_SHARE 4
+#define REPLAY_INTERVAL 100
+#define REPLAY_DEFAULT_RATE 1000
 
 
 /*
@@ -76,11 +104,45 @@ typedef struct cnx_list {
         unsigned int dead;
         unsigned int total;
 
+        /*
+         * Members of a balanced list ("<>") share the messages instead
+         * of each receiving all of them. With round-robin balancing,
+         * index of the next member to use.
+         */
+        prelude_bool_t balance;
+        unsigned int next;
+
         prelude_connection_pool_t *parent;
 } cnx_list_t;
 
 
 
+typedef struct {
+        prelude_msg_t *msg;
+        uint64_t seq;
+} ack_entry_t;
+
+
+
+/*
+ * State of a failover replayed in the background.
+ */
+typedef struct {
+        prelude_timer_t timer;
+        prelude_bool_t running;
+        prelude_failover_t *failover;
+
+        struct cnx *cnx;
+        struct cnx_list *clist;
+        struct prelude_connection_pool *pool;
+
+        uint64_t msg;
+        uint64_t bytes;
+        struct timeval start;
+} replay_t;
+
+
+
 typedef struct cnx {
         struct cnx *and;
 
@@ -90,6 +152,14 @@ typedef struct cnx {
         prelude_timer_t timer;
         prelude_failover_t *failover;
 
+        /*
+         * Reconnection delay, in seconds, and state of the non blocking
+         * reconnection attempt in progress, if any.
+         */
+        unsigned int backoff;
+        prelude_bool_t connecting;
+        time_t connect_deadline;
+
         /*
          * Pointer on a client object.
          */
@@ -104,10 +174,75 @@ typedef struct cnx {
          * Pointer to the parent of this client.
          */
         cnx_list_t *parent;
+
+        /*
+         * With epoll, whether the connection is monitored, and its
+         * entry in the list of connections with data waiting. The watch
+         * identifier is the one carried by its epoll events.
+         */
+        prelude_bool_t watched;
+        uint64_t watch_id;
+        prelude_bool_t ready;
+        prelude_list_t ready_list;
+
+        /*
+         * Messages waiting to be written together, the adaptive size limit
+         * of the batch, and the last measured round trip time (usec).
+         */
+        prelude_msg_t *batch[BATCH_MAX_MSG];
+        size_t batch_count;
+        size_t batch_len;
+        size_t batch_limit;
+        unsigned int batch_rtt;
+        struct timeval batch_start;
+        prelude_timer_t batch_timer;
+
+        /*
+         * Messages written but not yet acknowledged by the peer, oldest
+         * first, along with the sent count of the connection once they
+         * were written.
+         */
+        ack_entry_t *ack;
+        size_t ack_size;
+        size_t ack_first;
+        size_t ack_count;
+        size_t ack_len;
+        prelude_bool_t ack_dropping;
+
+        /*
+         * Replay of the connection failover.
+         */
+        replay_t replay;
+
+        /*
+         * Messages sent with prelude_connection_pool_broadcast_async() are
+         * queued per connection, so that a slow peer only delays itself.
+         * They are written without the pool lock held, under write_mutex:
+         * closing the connection increments write_gen, which invalidates
+         * the writes prepared before. A connection removed from the pool
+         * while queued messages still reference it is detached, and freed
+         * along with the last of them.
+         */
+        prelude_async_queue_t *async_queue;
+        gl_lock_t write_mutex;
+        unsigned int write_gen;
+        unsigned int refcount;
+        prelude_bool_t detached;
 } cnx_t;
 
 
 
+/*
+ * A message queued for a single connection.
+ */
+typedef struct {
+        PRELUDE_ASYNC_OBJECT;
+        cnx_t *cnx;
+        prelude_msg_t *msg;
+} cnx_job_t;
+
+
+
 struct prelude_connection_pool {
         gl_recursive_lock_t mutex;
 
@@ -115,10 +250,58 @@ struct prelude_connection_pool {
         prelude_bool_t initialized;
         prelude_failover_t *failover;
 
+        /*
+         * Connections are monitored using epoll when available, and
+         * select otherwise.
+         */
+        int epfd;
+        prelude_list_t ready;
+
+        /*
+         * Watched connections, indexed by the low half of their watch
+         * identifier, the high half being a generation: events for a
+         * connection unwatched while epoll_wait() was running are
+         * recognized and dropped.
+         */
+        cnx_t **watch_table;
+        unsigned int watch_size;
+        uint32_t watch_gen;
+
         int nfd;
         fd_set fds;
         int refcount;
 
+        /*
+         * With PRELUDE_CONNECTION_POOL_FLAGS_BATCH, maximum size (bytes) and
+         * delay (usec) of the batches of messages sent to each connection.
+         */
+        size_t batch_size;
+        unsigned int batch_delay;
+
+        /*
+         * With PRELUDE_CONNECTION_POOL_FLAGS_ACK, maximum number of
+         * unacknowledged messages per connection.
+         */
+        size_t ack_window;
+
+        /*
+         * Unacknowledged messages forgotten because the window was full,
+         * without failover to keep them.
+         */
+        uint64_t ack_dropped;
+
+        /*
+         * How messages are spread across the members of balanced lists.
+         */
+        prelude_connection_pool_balance_t balance;
+
+        /*
+         * With PRELUDE_CONNECTION_POOL_FLAGS_REPLAY, number of failover
+         * messages replayed per second, and replay of the pool failover.
+         */
+        unsigned int replay_rate;
+        replay_t replay;
+
         char *connection_string;
         prelude_connection_permission_t permission;
 
@@ -129,6 +312,12 @@ struct prelude_connection_pool {
         prelude_timer_t timer;
         prelude_list_t all_cnx;
 
+        /*
+         * Statistics of the asynchronous queues of the connections
+         * that were destroyed.
+         */
+        prelude_async_stats_t async_stats;
+
         void *data;
 
         prelude_connection_pool_event_t global_wanted_event;
@@ -145,23 +334,86 @@ struct prelude_connection_pool {
 
 
 static void set_state_dead(cnx_t *cnx, prelude_error_t error, prelude_bool_t init_time, prelude_bool_t global_notice);
+static void connection_resume(cnx_t *cnx, int ret);
+static void batch_release(cnx_t *cnx, prelude_bool_t save);
+static int batch_flush(cnx_t *cnx);
+static void replay_stop(replay_t *replay);
+static void ack_release(cnx_t *cnx, prelude_bool_t save);
+static void ack_update(cnx_t *cnx);
+static int ack_read(cnx_t *cnx);
+static prelude_bool_t ack_enabled(cnx_t *cnx);
+static int write_complete(cnx_t *cnx, unsigned int gen, prelude_msg_t **msgs, size_t count, uint64_t seq, int ret);
+static int cnx_job_new(cnx_job_t **job, cnx_t *cnx, prelude_msg_t *msg);
+static void batch_queue_jobs(prelude_list_t *jobs);
+static void batch_flush_due(prelude_connection_pool_t *pool, prelude_list_t *jobs);
 
 
-static int do_send(prelude_connection_t *conn, prelude_msg_t *msg)
+/*
+ * Write @msgs to @cnx, unless it was closed since @gen was retrieved.
+ * The pool lock does not need to be held: messages are prepared for the
+ * connection, and written, under its write lock, so that they go out in
+ * the order their string dictionary references were assigned. The sent
+ * count of the connection once the first message is written is stored
+ * in @seq.
+ */
+static int cnx_write(cnx_t *cnx, unsigned int gen, prelude_msg_t **msgs, size_t count, uint64_t *seq)
 {
-        int ret;
+        int ret = 0;
+        size_t i, j, n;
+        prelude_msg_t *out[BATCH_MAX_MSG];
 
-        /*
-         * handle EAGAIN in case the caller use non blocking IO.
-         */
-        do {
-                ret = prelude_connection_send(conn, msg);
-        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+        gl_lock_lock(cnx->write_mutex);
+
+        if ( gen != cnx->write_gen ) {
+                gl_lock_unlock(cnx->write_mutex);
+                return -1;
+        }
+
+        for ( i = 0; i < count && ret >= 0; i += n ) {
+                n = MIN(count - i, BATCH_MAX_MSG);
+
+                for ( j = 0; j < n; j++ ) {
+                        ret = _prelude_connection_prepare_msg(cnx->cnx, msgs[i + j], &out[j]);
+                        if ( ret < 0 )
+                                break;
+                }
+
+                /*
+                 * handle EAGAIN in case the caller use non blocking IO.
+                 */
+                if ( ret >= 0 ) {
+                        do {
+                                ret = prelude_connection_sendv(cnx->cnx, out, n);
+                        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+                }
+
+                while ( j-- > 0 )
+                        prelude_msg_destroy(out[j]);
+        }
+
+        if ( seq )
+                *seq = prelude_connection_get_sent_count(cnx->cnx) - count;
+
+        gl_lock_unlock(cnx->write_mutex);
 
         return ret;
 }
 
 
+/*
+ * Close @cnx: writes that were prepared before are discarded.
+ */
+static void cnx_close(cnx_t *cnx)
+{
+        gl_lock_lock(cnx->write_mutex);
+
+        cnx->write_gen++;
+        prelude_connection_close(cnx->cnx);
+
+        gl_lock_unlock(cnx->write_mutex);
+}
+
+
 static int global_event_handler(prelude_connection_pool_t *pool, int event)
 {
         int ret = 0;
@@ -209,24 +461,34 @@ static int check_connection_event(prelude_connection_pool_t *pool, cnx_t *cnx,
                                 goto error;
                         }
 
+                        ack_update(cnx);
                         return 0;
                 }
 
                 *outmsg = cnx->msg;
                 cnx->msg = NULL;
 
+                ack_update(cnx);
                 return 1;
         }
 
         else if ( event_cb )
                 ret = event_cb(pool, PRELUDE_CONNECTION_POOL_EVENT_INPUT, cnx->cnx, extra);
 
+        /*
+         * Nobody is interested in input: only acknowledgements are expected.
+         */
+        else if ( ! (pool->wanted_event & PRELUDE_CONNECTION_POOL_EVENT_INPUT && pool->event_handler) && ack_enabled(cnx) )
+                ret = ack_read(cnx);
+
         else
                 ret = event_handler(pool, PRELUDE_CONNECTION_POOL_EVENT_INPUT, cnx->cnx);
 
         if ( ret < 0 || ! prelude_connection_is_alive(cnx->cnx) )
                 goto error;
 
+        ack_update(cnx);
+
         return 0;
 
 error:
@@ -258,21 +520,13 @@ static int timeval_subtract(struct timeval *x, struct timeval *y)
 
 
 
-static int connection_pool_check_event(prelude_connection_pool_t *pool, int timeout,
-                                       int (*event_cb)(prelude_connection_pool_t *pool,
-                                                       prelude_connection_pool_event_t event,
-                                                       prelude_connection_t *cnx, void *extra),
-                                       void *extra, prelude_connection_t **outcon, prelude_msg_t **outmsg)
+/*
+ * Wait for input with select(): connections are then checked in turn.
+ */
+static int select_wait(prelude_connection_pool_t *pool, int timeout, fd_set *rfds)
 {
-        cnx_t *cnx;
-        fd_set rfds;
-        cnx_list_t *or;
-        int ret, i = 0, nfd, fd;
-        struct timeval ts, to, te;
-        prelude_connection_pool_event_t global_event = 0;
-
-again:
-        gettimeofday(&ts, NULL);
+        int ret, nfd;
+        struct timeval to;
 
         do {
                 if ( timeout > 0 ) {
@@ -284,20 +538,31 @@ again:
                 }
 
                 gl_recursive_lock_lock(pool->mutex);
-                rfds = pool->fds;
+                *rfds = pool->fds;
                 nfd = pool->nfd;
                 gl_recursive_lock_unlock(pool->mutex);
 
-                ret = select(nfd, &rfds, NULL, NULL, &to);
+                ret = select(nfd, rfds, NULL, NULL, &to);
                 if ( ret < 0 )
                         return prelude_error_from_errno(errno);
 
         } while ( ret == 0 && timeout == -1 );
 
-        if ( ret == 0 )
-                return 0;
+        return ret;
+}
 
-        gl_recursive_lock_lock(pool->mutex);
+
+
+static int select_dispatch(prelude_connection_pool_t *pool, fd_set *rfds,
+                           prelude_connection_pool_event_t *global_event,
+                           int (*event_cb)(prelude_connection_pool_t *pool,
+                                           prelude_connection_pool_event_t event,
+                                           prelude_connection_t *cnx, void *extra),
+                           void *extra, prelude_connection_t **outcon, prelude_msg_t **outmsg)
+{
+        int ret, fd, i = 0;
+        cnx_t *cnx;
+        cnx_list_t *or;
 
         for ( or = pool->or_list; or != NULL; or = or->or ) {
         for ( cnx = or->and; cnx != NULL; cnx = cnx->and ) {
@@ -305,219 +570,1435 @@ again:
                         continue;
 
                 fd = prelude_io_get_fd(prelude_connection_get_fd(cnx->cnx));
-                if ( ! FD_ISSET(fd, &rfds) )
+                if ( ! FD_ISSET(fd, rfds) )
                         continue;
 
                 i++;
-                global_event |= PRELUDE_CONNECTION_POOL_EVENT_INPUT;
+                *global_event |= PRELUDE_CONNECTION_POOL_EVENT_INPUT;
 
-                ret = check_connection_event(pool, cnx, &global_event, event_cb, extra, outcon, outmsg);
+                ret = check_connection_event(pool, cnx, global_event, event_cb, extra, outcon, outmsg);
                 if ( ret == 1 )
-                        break;
+                        return i;
 
                 else if ( ret <= 0 )
                         i--;
         }}
 
-        gl_recursive_lock_unlock(pool->mutex);
-        global_event_handler(pool, global_event);
+        return i;
+}
 
-        if ( pool->connection_string_changed )
-                prelude_connection_pool_init(pool);
 
-        if ( timeout == -1 && i == 0 )
-                goto again;
 
-        gettimeofday(&te, NULL);
-        ret = timeval_subtract(&te, &ts);
+#ifdef HAVE_EPOLL_CREATE1
+static cnx_t *watch_lookup(prelude_connection_pool_t *pool, uint64_t id)
+{
+        cnx_t *cnx;
+        uint32_t slot = id & 0xffffffff;
 
-        if ( i == 0 && ret < timeout ) {
-                timeout -= ret;
-                goto again;
-        }
+        if ( slot >= pool->watch_size )
+                return NULL;
 
-        return i;
+        cnx = pool->watch_table[slot];
+        if ( ! cnx || cnx->watch_id != id )
+                return NULL;
+
+        return cnx;
 }
 
 
-static int get_connection_backup_path(prelude_connection_t *cn, const char *path, char **out)
-{
-        int ret;
-        char c, buf[512];
-        const char *addr;
-        prelude_string_t *str;
 
-        ret = prelude_string_new_dup(&str, path);
-        if ( ret < 0 )
-                return ret;
+static int watch_add(prelude_connection_pool_t *pool, cnx_t *cnx)
+{
+        cnx_t **ptr;
+        unsigned int slot, size;
 
-        prelude_string_cat(str, "/");
+        for ( slot = 0; slot < pool->watch_size; slot++ ) {
+                if ( ! pool->watch_table[slot] )
+                        break;
+        }
 
-        /*
-         * FIXME: ideally we should only use peer analyzerid. This would
-         * imply creating the failover after the first connection.
-         */
-        addr = prelude_connection_get_peer_addr(cn);
-        if ( ! addr )
-                prelude_string_sprintf(str, "%" PRELUDE_PRIu64, prelude_connection_get_peer_analyzerid(cn));
+        if ( slot == pool->watch_size ) {
+                size = MAX(pool->watch_size * 2, 16);
 
-        else {
-                snprintf(buf, sizeof(buf), "%s:%u",
-                         prelude_connection_get_peer_addr(cn), prelude_connection_get_peer_port(cn));
+                ptr = _prelude_realloc(pool->watch_table, size * sizeof(*ptr));
+                if ( ! ptr )
+                        return prelude_error_from_errno(errno);
 
-                while ( (c = *addr++) ) {
-                        if ( c == '/' )
-                                c = '_';
+                memset(ptr + pool->watch_size, 0, (size - pool->watch_size) * sizeof(*ptr));
 
-                        prelude_string_ncat(str, &c, 1);
-                }
+                pool->watch_table = ptr;
+                pool->watch_size = size;
         }
 
-        ret = prelude_string_get_string_released(str, out);
-        prelude_string_destroy(str);
+        pool->watch_table[slot] = cnx;
+        cnx->watch_id = ((uint64_t) ++pool->watch_gen << 32) | slot;
 
-        return ret;
+        return 0;
 }
 
 
-static void notify_event(prelude_connection_pool_t *pool,
-                         prelude_connection_pool_event_t event,
-                         prelude_connection_t *connection, prelude_bool_t global_notice)
-{
-        event_handler(pool, event, connection);
-
-        if ( global_notice )
-                global_event_handler(pool, event);
-}
-
 
-static void init_cnx_timer(cnx_t *cnx)
+static void watch_del(prelude_connection_pool_t *pool, cnx_t *cnx)
 {
-        if ( cnx->parent->parent->flags & PRELUDE_CONNECTION_POOL_FLAGS_RECONNECT )
-                prelude_timer_init(&cnx->timer);
+        if ( cnx->watched )
+                pool->watch_table[cnx->watch_id & 0xffffffff] = NULL;
 }
 
 
-static void destroy_connection_single(cnx_t *cnx)
-{
-        prelude_timer_destroy(&cnx->timer);
-        prelude_connection_destroy(cnx->cnx);
-
-        if ( cnx->failover )
-                prelude_failover_destroy(cnx->failover);
-
-        free(cnx);
-}
-
 
-static void connection_list_destroy(cnx_list_t *clist)
+/*
+ * Connections are registered edge triggered, and put in the ready list
+ * when notified. They stay there as long as they have data waiting, so
+ * that only those are looked at, whatever the number of connections.
+ */
+static int epoll_wait_ready(prelude_connection_pool_t *pool, int timeout)
 {
-        void *bkp;
+        int ret, i, wait;
         cnx_t *cnx;
+        struct epoll_event events[EPOLL_MAX_EVENTS];
 
-        for ( ; clist != NULL; clist = bkp ) {
+        do {
+                gl_recursive_lock_lock(pool->mutex);
+                wait = prelude_list_is_empty(&pool->ready) ? timeout : 0;
+                gl_recursive_lock_unlock(pool->mutex);
 
-                for ( cnx = clist->and; cnx != NULL; cnx = bkp ) {
-                        bkp = cnx->and;
-                        destroy_connection_single(cnx);
-                }
+                ret = epoll_wait(pool->epfd, events, EPOLL_MAX_EVENTS, (wait < 0) ? 1000 : wait);
+                if ( ret < 0 )
+                        return prelude_error_from_errno(errno);
 
-                bkp = clist->or;
-                free(clist);
-        }
-}
+                gl_recursive_lock_lock(pool->mutex);
 
+                for ( i = 0; i < ret; i++ ) {
+                        cnx = watch_lookup(pool, events[i].data.u64);
+                        if ( ! cnx )
+                                continue;
 
-static int failover_save_msg(prelude_failover_t *failover, prelude_msg_t *msg)
-{
-        int ret;
+                        if ( ! cnx->ready ) {
+                                cnx->ready = TRUE;
+                                prelude_list_add_tail(&pool->ready, &cnx->ready_list);
+                        }
+                }
 
-        ret = prelude_failover_save_msg(failover, msg);
-        if ( ret < 0 )
-                prelude_log(PRELUDE_LOG_WARN, "failover error: %s.\n", prelude_strerror(ret));
+                ret = ! prelude_list_is_empty(&pool->ready);
+                gl_recursive_lock_unlock(pool->mutex);
+
+        } while ( ret == 0 && timeout == -1 );
 
         return ret;
 }
 
 
-static void broadcast_message(prelude_msg_t *msg, cnx_t *cnx)
+
+static int epoll_dispatch(prelude_connection_pool_t *pool,
+                          prelude_connection_pool_event_t *global_event,
+                          int (*event_cb)(prelude_connection_pool_t *pool,
+                                          prelude_connection_pool_event_t event,
+                                          prelude_connection_t *cnx, void *extra),
+                          void *extra, prelude_connection_t **outcon, prelude_msg_t **outmsg)
 {
-        int ret = -1;
+        int ret = 0, i = 0;
+        cnx_t *cnx;
+        prelude_list_t ready;
 
-        if ( ! cnx )
-                return;
+        /*
+         * Connections might be unwatched, and thus removed from the
+         * ready list, by the callbacks.
+         */
+        prelude_list_init(&ready);
+        prelude_list_splice_tail(&ready, &pool->ready);
+        prelude_list_init(&pool->ready);
 
-        if ( prelude_connection_is_alive(cnx->cnx) ) {
+        while ( ! prelude_list_is_empty(&ready) && ret != 1 ) {
+                cnx = prelude_list_entry(ready.next, cnx_t, ready_list);
 
-                ret = do_send(cnx->cnx, msg);
-                if ( ret < 0 )
-                        set_state_dead(cnx, ret, FALSE, TRUE);
-        }
+                prelude_list_del(&cnx->ready_list);
+                cnx->ready = FALSE;
 
-        if ( ret < 0 && cnx->failover )
-                failover_save_msg(cnx->failover, msg);
+                if ( cnx->connecting ) {
+                        connection_resume(cnx, prelude_connection_connect_resume(cnx->cnx));
+                        continue;
+                }
 
-        broadcast_message(msg, cnx->and);
-}
+                if ( ! prelude_connection_is_alive(cnx->cnx) )
+                        continue;
 
+                i++;
+                *global_event |= PRELUDE_CONNECTION_POOL_EVENT_INPUT;
 
+                ret = check_connection_event(pool, cnx, global_event, event_cb, extra, outcon, outmsg);
+                if ( ret <= 0 )
+                        i--;
 
-static int failover_flush(prelude_failover_t *failover, cnx_list_t *clist, cnx_t *cnx)
-{
-        char name[128];
-        prelude_msg_t *msg;
-        size_t totsize = 0;
-        ssize_t size, ret = 0;
-        unsigned int available, count = 0;
+                if ( cnx->watched && prelude_io_pending(prelude_connection_get_fd(cnx->cnx)) > 0 ) {
+                        cnx->ready = TRUE;
+                        prelude_list_add_tail(&pool->ready, &cnx->ready_list);
+                }
+        }
+
+        prelude_list_splice_tail(&pool->ready, &ready);
+
+        return i;
+}
+#endif
+
+
+
+#ifdef HAVE_EPOLL_CREATE1
+static int epoll_watch(prelude_connection_pool_t *pool, cnx_t *cnx, uint32_t events)
+{
+        int ret;
+        struct epoll_event ev;
+        int fd = prelude_io_get_fd(prelude_connection_get_fd(cnx->cnx));
+
+        if ( ! cnx->watched ) {
+                ret = watch_add(pool, cnx);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        ev.events = events|EPOLLET;
+        ev.data.u64 = cnx->watch_id;
+
+        ret = epoll_ctl(pool->epfd, (cnx->watched) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+        if ( ret < 0 ) {
+                ret = prelude_error_from_errno(errno);
+
+                if ( ! cnx->watched )
+                        pool->watch_table[cnx->watch_id & 0xffffffff] = NULL;
+
+                return ret;
+        }
+
+        cnx->watched = TRUE;
+
+        return 0;
+}
+#endif
+
+
+
+static void pool_watch(prelude_connection_pool_t *pool, cnx_t *cnx)
+{
+        int fd = prelude_io_get_fd(prelude_connection_get_fd(cnx->cnx));
+
+#ifdef HAVE_EPOLL_CREATE1
+        if ( pool->epfd >= 0 ) {
+                if ( epoll_watch(pool, cnx, EPOLLIN) < 0 )
+                        prelude_log(PRELUDE_LOG_ERR, "could not monitor connection: %s.\n", strerror(errno));
+
+                return;
+        }
+#endif
+
+        assert(fd < FD_SETSIZE);
+
+        FD_SET(fd, &pool->fds);
+        pool->nfd = MAX(fd + 1, pool->nfd);
+}
+
+
+
+static void pool_unwatch(prelude_connection_pool_t *pool, cnx_t *cnx)
+{
+        int fd = prelude_io_get_fd(prelude_connection_get_fd(cnx->cnx));
+
+#ifdef HAVE_EPOLL_CREATE1
+        if ( pool->epfd >= 0 ) {
+                if ( cnx->watched )
+                        epoll_ctl(pool->epfd, EPOLL_CTL_DEL, fd, NULL);
+
+                watch_del(pool, cnx);
+
+                if ( cnx->ready )
+                        prelude_list_del(&cnx->ready_list);
+
+                cnx->watched = cnx->ready = FALSE;
+                return;
+        }
+#endif
+
+        if ( fd < 0 )
+                return;
+
+        assert(fd < FD_SETSIZE);
+        FD_CLR(fd, &pool->fds);
+}
+
+
+
+static int connection_pool_check_event(prelude_connection_pool_t *pool, int timeout,
+                                       int (*event_cb)(prelude_connection_pool_t *pool,
+                                                       prelude_connection_pool_event_t event,
+                                                       prelude_connection_t *cnx, void *extra),
+                                       void *extra, prelude_connection_t **outcon, prelude_msg_t **outmsg)
+{
+        fd_set rfds;
+        int ret, i = 0;
+        struct timeval ts, te;
+        PRELUDE_LIST(jobs);
+        prelude_connection_pool_event_t global_event = 0;
+
+again:
+        gettimeofday(&ts, NULL);
+
+#ifdef HAVE_EPOLL_CREATE1
+        if ( pool->epfd >= 0 )
+                ret = epoll_wait_ready(pool, timeout);
+        else
+#endif
+        ret = select_wait(pool, timeout, &rfds);
+
+        gl_recursive_lock_lock(pool->mutex);
+
+        if ( ret > 0 ) {
+#ifdef HAVE_EPOLL_CREATE1
+                if ( pool->epfd >= 0 )
+                        i = epoll_dispatch(pool, &global_event, event_cb, extra, outcon, outmsg);
+                else
+#endif
+                i = select_dispatch(pool, &rfds, &global_event, event_cb, extra, outcon, outmsg);
+        }
+
+        batch_flush_due(pool, &jobs);
+
+        gl_recursive_lock_unlock(pool->mutex);
+        batch_queue_jobs(&jobs);
+
+        if ( ret <= 0 )
+                return ret;
+
+        global_event_handler(pool, global_event);
+
+        if ( pool->connection_string_changed )
+                prelude_connection_pool_init(pool);
+
+        if ( timeout == -1 && i == 0 )
+                goto again;
+
+        gettimeofday(&te, NULL);
+        ret = timeval_subtract(&te, &ts);
+
+        if ( i == 0 && ret < timeout ) {
+                timeout -= ret;
+                goto again;
+        }
+
+        return i;
+}
+
+
+static int get_connection_backup_path(prelude_connection_t *cn, const char *path, char **out)
+{
+        int ret;
+        char c, buf[512];
+        const char *addr;
+        prelude_string_t *str;
+
+        ret = prelude_string_new_dup(&str, path);
+        if ( ret < 0 )
+                return ret;
+
+        prelude_string_cat(str, "/");
+
+        /*
+         * FIXME: ideally we should only use peer analyzerid. This would
+         * imply creating the failover after the first connection.
+         */
+        addr = prelude_connection_get_peer_addr(cn);
+        if ( ! addr )
+                prelude_string_sprintf(str, "%" PRELUDE_PRIu64, prelude_connection_get_peer_analyzerid(cn));
+
+        else {
+                snprintf(buf, sizeof(buf), "%s:%u",
+                         prelude_connection_get_peer_addr(cn), prelude_connection_get_peer_port(cn));
+
+                while ( (c = *addr++) ) {
+                        if ( c == '/' )
+                                c = '_';
+
+                        prelude_string_ncat(str, &c, 1);
+                }
+        }
+
+        ret = prelude_string_get_string_released(str, out);
+        prelude_string_destroy(str);
+
+        return ret;
+}
+
+
+static void notify_event(prelude_connection_pool_t *pool,
+                         prelude_connection_pool_event_t event,
+                         prelude_connection_t *connection, prelude_bool_t global_notice)
+{
+        event_handler(pool, event, connection);
+
+        if ( global_notice )
+                global_event_handler(pool, event);
+}
+
+
+static void init_cnx_timer(cnx_t *cnx)
+{
+        if ( cnx->parent->parent->flags & PRELUDE_CONNECTION_POOL_FLAGS_RECONNECT )
+                prelude_timer_init(&cnx->timer);
+}
+
+
+static void async_stats_add(prelude_async_stats_t *dst, const prelude_async_stats_t *src)
+{
+        dst->queued += src->queued;
+        dst->max_queued = MAX(dst->max_queued, src->max_queued);
+        dst->processed += src->processed;
+        dst->overflowed += src->overflowed;
+        dst->latency_total += src->latency_total;
+        dst->latency_max = MAX(dst->latency_max, src->latency_max);
+        dst->stolen += src->stolen;
+}
+
+
+static void cnx_unref(cnx_t *cnx, prelude_connection_pool_t *pool)
+{
+        prelude_async_stats_t stats;
+
+        if ( --cnx->refcount != 0 )
+                return;
+
+        if ( cnx->async_queue ) {
+                prelude_async_queue_get_stats(cnx->async_queue, &stats);
+                async_stats_add(&pool->async_stats, &stats);
+                prelude_async_queue_destroy(cnx->async_queue);
+        }
+
+        gl_lock_destroy(cnx->write_mutex);
+        free(cnx);
+}
+
+
+static void destroy_connection_single(cnx_t *cnx)
+{
+        int ret = -1;
+        prelude_connection_pool_t *pool = cnx->parent->parent;
+
+        /*
+         * Messages the peer did not acknowledge yet are kept for the next run.
+         */
+        ack_release(cnx, TRUE);
+
+        if ( cnx->batch_count && prelude_connection_is_alive(cnx->cnx) )
+                ret = cnx_write(cnx, cnx->write_gen, cnx->batch, cnx->batch_count, NULL);
+
+        batch_release(cnx, ret < 0);
+
+        if ( cnx->watched || cnx->ready )
+                pool_unwatch(pool, cnx);
+
+        replay_stop(&cnx->replay);
+        prelude_timer_destroy(&cnx->timer);
+
+        /*
+         * Messages still queued for the connection go to the pool failover.
+         */
+        gl_lock_lock(cnx->write_mutex);
+        cnx->write_gen++;
+        prelude_connection_destroy(cnx->cnx);
+        gl_lock_unlock(cnx->write_mutex);
+
+        if ( cnx->failover )
+                prelude_failover_destroy(cnx->failover);
+
+        if ( cnx->ack )
+                free(cnx->ack);
+
+        cnx->cnx = NULL;
+        cnx->failover = NULL;
+        cnx->ack = NULL;
+        cnx->detached = TRUE;
+
+        cnx_unref(cnx, pool);
+}
+
+
+static void connection_list_destroy(cnx_list_t *clist)
+{
+        void *bkp;
+        cnx_t *cnx;
+
+        for ( ; clist != NULL; clist = bkp ) {
+
+                for ( cnx = clist->and; cnx != NULL; cnx = bkp ) {
+                        bkp = cnx->and;
+                        destroy_connection_single(cnx);
+                }
+
+                bkp = clist->or;
+                free(clist);
+        }
+}
+
+
+static int failover_save_msg(prelude_failover_t *failover, prelude_msg_t *msg)
+{
+        int ret;
+        prelude_msg_t *out;
+
+        /*
+         * Saved messages might be replayed to any connection, possibly
+         * to a manager that no longer reads compact messages, and should
+         * not depend on the string dictionary of a previous one.
+         */
+        ret = _prelude_msg_downgrade(msg, &out);
+        if ( ret == 0 ) {
+                ret = prelude_failover_save_msg(failover, out);
+                prelude_msg_destroy(out);
+        }
+
+        if ( ret < 0 )
+                prelude_log(PRELUDE_LOG_WARN, "failover error: %s.\n", prelude_strerror(ret));
+
+        return ret;
+}
+
+
+static prelude_bool_t ack_enabled(cnx_t *cnx)
+{
+        prelude_connection_pool_t *pool = cnx->parent->parent;
+
+        if ( ! (pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_ACK) ||
+             ! (prelude_connection_get_features(cnx->cnx) & PRELUDE_CONNECTION_FEATURE_ACK) )
+                return FALSE;
+
+        if ( ! cnx->ack ) {
+                cnx->ack = malloc(pool->ack_window * sizeof(*cnx->ack));
+                if ( ! cnx->ack )
+                        return FALSE;
+
+                cnx->ack_size = pool->ack_window;
+        }
+
+        return TRUE;
+}
+
+
+
+/*
+ * Keep the @count messages written to @cnx once its sent count was @seq
+ * until the peer acknowledges them. Without failover, sending is never
+ * delayed by the window: once full, the oldest message is forgotten,
+ * which is counted and reported.
+ */
+static void ack_track(cnx_t *cnx, prelude_msg_t **msgs, size_t count, uint64_t seq)
+{
+        size_t i, pos;
+        ack_entry_t *entry, *prev;
+        prelude_connection_pool_t *pool = cnx->parent->parent;
+
+        if ( ! ack_enabled(cnx) )
+                return;
+
+        for ( i = 0; i < count; i++ ) {
+                if ( cnx->ack_count == cnx->ack_size ) {
+                        if ( ! cnx->ack_dropping ) {
+                                prelude_log(PRELUDE_LOG_WARN, "acknowledgement window of %s is full: unacknowledged messages will be lost if the connection fails.\n",
+                                            prelude_connection_get_peer_addr(cnx->cnx));
+                                cnx->ack_dropping = TRUE;
+                        }
+
+                        pool->ack_dropped++;
+                        cnx->ack_len -= prelude_msg_get_len(cnx->ack[cnx->ack_first].msg);
+                        prelude_msg_destroy(cnx->ack[cnx->ack_first].msg);
+                        cnx->ack_first = (cnx->ack_first + 1) % cnx->ack_size;
+                        cnx->ack_count--;
+                }
+
+                /*
+                 * Writes done without the pool lock might complete out of
+                 * order: the window is kept sorted.
+                 */
+                seq++;
+                pos = cnx->ack_count++;
+
+                for ( ; pos > 0; pos-- ) {
+                        prev = &cnx->ack[(cnx->ack_first + pos - 1) % cnx->ack_size];
+                        if ( prev->seq < seq )
+                                break;
+
+                        cnx->ack[(cnx->ack_first + pos) % cnx->ack_size] = *prev;
+                }
+
+                entry = &cnx->ack[(cnx->ack_first + pos) % cnx->ack_size];
+                entry->msg = prelude_msg_ref(msgs[i]);
+                entry->seq = seq;
+                cnx->ack_len += prelude_msg_get_len(msgs[i]);
+        }
+}
+
+
+
+static void ack_release(cnx_t *cnx, prelude_bool_t save)
+{
+        ack_entry_t *entry;
+
+        for ( ; cnx->ack_count; cnx->ack_count-- ) {
+                entry = &cnx->ack[cnx->ack_first];
+
+                if ( save && cnx->failover )
+                        failover_save_msg(cnx->failover, entry->msg);
+
+                prelude_msg_destroy(entry->msg);
+                cnx->ack_first = (cnx->ack_first + 1) % cnx->ack_size;
+        }
+
+        cnx->ack_first = cnx->ack_len = 0;
+}
+
+
+
+/*
+ * Number of messages of @priority allowed in the window: a share of
+ * it is kept for high priority messages, so that lower priority ones
+ * are the first to spill when the peer lags behind.
+ */
+static size_t ack_get_limit(cnx_t *cnx, prelude_msg_priority_t priority)
+{
+        if ( priority == PRELUDE_MSG_PRIORITY_HIGH )
+                return cnx->ack_size;
+
+        return cnx->ack_size - cnx->ack_size / ACK_RESERVED_SHARE;
+}
+
+
+
+/*
+ * With a failover, messages beyond the window wait there for the peer
+ * to catch up, behind the ones already waiting. High priority messages
+ * overtake them.
+ */
+static prelude_bool_t ack_must_spill(cnx_t *cnx, prelude_msg_t *msg)
+{
+        prelude_msg_priority_t priority;
+
+        if ( ! cnx->failover || ! ack_enabled(cnx) )
+                return FALSE;
+
+        priority = prelude_msg_get_priority(msg);
+        if ( cnx->ack_count + cnx->batch_count >= ack_get_limit(cnx, priority) )
+                return TRUE;
+
+        if ( priority == PRELUDE_MSG_PRIORITY_HIGH )
+                return FALSE;
+
+        return prelude_failover_get_available_msg_count(cnx->failover) ? TRUE : FALSE;
+}
+
+
+
+/*
+ * Write as many messages from the failover as the window allows,
+ * leaving the share kept for high priority messages.
+ */
+static int ack_replay(cnx_t *cnx)
+{
+        int ret = 0;
+        size_t limit;
+        ssize_t nmsg;
+        uint64_t seq = 0;
+        unsigned int gen;
+        prelude_msg_t *msgs[FAILOVER_FLUSH_BATCH];
+
+        if ( cnx->batch_count ) {
+                ret = batch_flush(cnx);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        limit = ack_get_limit(cnx, PRELUDE_MSG_PRIORITY_NONE);
+
+        while ( cnx->ack_count < limit ) {
+                nmsg = prelude_failover_get_saved_msgs(cnx->failover, msgs, MIN(limit - cnx->ack_count, FAILOVER_FLUSH_BATCH));
+                if ( nmsg == 0 )
+                        break;
+
+                if ( nmsg < 0 ) {
+                        prelude_log(PRELUDE_LOG_ERR, "error reading message from failover: %s", prelude_strerror(nmsg));
+                        return nmsg;
+                }
+
+                gen = cnx->write_gen;
+                ret = cnx_write(cnx, gen, msgs, nmsg, &seq);
+
+                ret = write_complete(cnx, gen, msgs, nmsg, seq, ret);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        return 0;
+}
+
+
+
+/*
+ * Forget about the messages acknowledged by the peer, and fill the
+ * room they left in the window.
+ */
+static void ack_update(cnx_t *cnx)
+{
+        uint64_t acked;
+
+        if ( ! ack_enabled(cnx) )
+                return;
+
+        acked = prelude_connection_get_acked_count(cnx->cnx);
+
+        while ( cnx->ack_count && cnx->ack[cnx->ack_first].seq <= acked ) {
+                cnx->ack_len -= prelude_msg_get_len(cnx->ack[cnx->ack_first].msg);
+                prelude_msg_destroy(cnx->ack[cnx->ack_first].msg);
+                cnx->ack_first = (cnx->ack_first + 1) % cnx->ack_size;
+                cnx->ack_count--;
+                cnx->ack_dropping = FALSE;
+        }
+
+        if ( cnx->failover && prelude_failover_get_available_msg_count(cnx->failover) )
+                ack_replay(cnx);
+}
+
+
+
+static int ack_read(cnx_t *cnx)
+{
+        int ret;
+
+        ret = prelude_connection_recv(cnx->cnx, &cnx->msg);
+        if ( ret < 0 ) {
+                if ( prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN )
+                        return 0;
+
+                if ( cnx->msg ) {
+                        prelude_msg_destroy(cnx->msg);
+                        cnx->msg = NULL;
+                }
+
+                return ret;
+        }
+
+        prelude_log_debug(1, "ignoring unexpected message with tag %d.\n", prelude_msg_get_tag(cnx->msg));
+
+        prelude_msg_destroy(cnx->msg);
+        cnx->msg = NULL;
+
+        return 0;
+}
+
+
+
+static void batch_release(cnx_t *cnx, prelude_bool_t save)
+{
+        size_t i;
+
+        prelude_timer_destroy(&cnx->batch_timer);
+
+        for ( i = 0; i < cnx->batch_count; i++ ) {
+                if ( save && cnx->failover )
+                        failover_save_msg(cnx->failover, cnx->batch[i]);
+
+                prelude_msg_destroy(cnx->batch[i]);
+        }
+
+        cnx->batch_count = cnx->batch_len = 0;
+}
+
+
+
+/*
+ * The size limit of the batch grows while data is still queued in the
+ * socket send buffer after a write, since the network is then the
+ * bottleneck and fewer, larger writes are cheaper. It shrinks once the
+ * queue is drained, so that latency stays low. The round trip time caps
+ * the delay: batching should not cost more latency than the network.
+ */
+static void batch_adapt(cnx_t *cnx)
+{
+        int fd;
+        size_t max = cnx->parent->parent->batch_size;
+
+        fd = prelude_io_get_fd(prelude_connection_get_fd(cnx->cnx));
+
+#ifdef TIOCOUTQ
+        {
+                int queued;
+
+                if ( ioctl(fd, TIOCOUTQ, &queued) == 0 ) {
+                        if ( (size_t) queued > cnx->batch_limit )
+                                cnx->batch_limit = MIN(cnx->batch_limit * 2, max);
+
+                        else if ( queued == 0 )
+                                cnx->batch_limit = MAX(cnx->batch_limit / 2, MIN(BATCH_MIN_SIZE, max));
+                }
+        }
+#endif
+
+#if defined(TCP_INFO) && defined(__linux__)
+        {
+                struct tcp_info info;
+                socklen_t len = sizeof(info);
+
+                if ( getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 )
+                        cnx->batch_rtt = info.tcpi_rtt;
+        }
+#endif
+}
+
+
+
+/*
+ * Account for the result @ret of writing the @count messages from @msgs
+ * to @cnx, with the pool locked, and release them. Messages written are
+ * kept until acknowledged. On failure, the connection is closed, unless
+ * it already was since @gen, and the messages are saved to the failover.
+ */
+static int write_complete(cnx_t *cnx, unsigned int gen, prelude_msg_t **msgs, size_t count, uint64_t seq, int ret)
+{
+        size_t i;
+        prelude_connection_pool_t *pool = cnx->parent->parent;
+
+        /*
+         * Written before the connection was closed: as for the messages
+         * that were in the window then, unacknowledged ones are kept.
+         */
+        if ( ret >= 0 && gen != cnx->write_gen ) {
+                if ( pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_ACK )
+                        ret = -1;
+        }
+
+        else if ( ret >= 0 ) {
+                ack_track(cnx, msgs, count, seq);
+
+                if ( pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_BATCH )
+                        batch_adapt(cnx);
+        }
+
+        /*
+         * Unacknowledged messages were written before these ones.
+         */
+        else if ( gen == cnx->write_gen )
+                set_state_dead(cnx, ret, FALSE, TRUE);
+
+        for ( i = 0; i < count; i++ ) {
+                if ( ret < 0 && cnx->failover )
+                        failover_save_msg(cnx->failover, msgs[i]);
+
+                prelude_msg_destroy(msgs[i]);
+        }
+
+        return ret;
+}
+
+
+
+/*
+ * Move the messages of the batch of @cnx to @msgs, and return their count.
+ */
+static size_t batch_take(cnx_t *cnx, prelude_msg_t **msgs)
+{
+        size_t count = cnx->batch_count;
+
+        prelude_timer_destroy(&cnx->batch_timer);
+
+        memcpy(msgs, cnx->batch, count * sizeof(*msgs));
+        cnx->batch_count = cnx->batch_len = 0;
+
+        return count;
+}
+
+
+
+static int batch_flush(cnx_t *cnx)
+{
+        int ret;
+        size_t count;
+        uint64_t seq = 0;
+        unsigned int gen = cnx->write_gen;
+        prelude_msg_t *msgs[BATCH_MAX_MSG];
+
+        count = batch_take(cnx, msgs);
+        if ( ! count )
+                return 0;
+
+        ret = cnx_write(cnx, gen, msgs, count, &seq);
+
+        return write_complete(cnx, gen, msgs, count, seq, ret);
+}
+
+
+
+/*
+ * Write the batch of @cnx, with the pool locked. The worker handling the
+ * queue of the connection writes the batch when there is one, so that a
+ * slow peer does not hold the pool lock: the job doing so is added to
+ * @jobs, to be queued once the pool is unlocked.
+ */
+static void batch_expire(cnx_t *cnx, prelude_list_t *jobs)
+{
+        cnx_job_t *job;
+
+        prelude_timer_destroy(&cnx->batch_timer);
+
+        if ( cnx->async_queue && cnx_job_new(&job, cnx, NULL) >= 0 )
+                prelude_linked_object_add_tail(jobs, (prelude_linked_object_t *) job);
+        else
+                batch_flush(cnx);
+}
+
+
+
+static void batch_queue_jobs(prelude_list_t *jobs)
+{
+        cnx_job_t *job;
+        prelude_list_t *tmp, *bkp;
+
+        prelude_list_for_each_safe(jobs, tmp, bkp) {
+                job = prelude_linked_object_get_object(tmp);
+                prelude_linked_object_del((prelude_linked_object_t *) job);
+                prelude_async_queue_add_priority(job->cnx->async_queue, (prelude_async_object_t *) job, PRELUDE_MSG_PRIORITY_HIGH);
+        }
+}
+
+
+
+static void batch_timer_expire(void *data)
+{
+        cnx_t *cnx = data;
+        prelude_connection_pool_t *pool = cnx->parent->parent;
+        PRELUDE_LIST(jobs);
+
+        gl_recursive_lock_lock(pool->mutex);
+        batch_expire(cnx, &jobs);
+        gl_recursive_lock_unlock(pool->mutex);
+
+        batch_queue_jobs(&jobs);
+}
+
+
+
+static unsigned int batch_get_delay(cnx_t *cnx)
+{
+        unsigned int delay = cnx->parent->parent->batch_delay;
+
+        return (cnx->batch_rtt) ? MIN(delay, cnx->batch_rtt) : delay;
+}
+
+
+
+static prelude_bool_t batch_is_due(cnx_t *cnx, struct timeval *now)
+{
+        return ( (uint64_t) (now->tv_sec - cnx->batch_start.tv_sec) * 1000000 +
+                 (now->tv_usec - cnx->batch_start.tv_usec) >= batch_get_delay(cnx) );
+}
+
+
+
+/*
+ * Write the batches whose first message waited for the batch delay. This is
+ * done from the pool event loop, and from the send path, so that batches
+ * do not depend on how often the batch timers are serviced.
+ */
+static void batch_flush_due(prelude_connection_pool_t *pool, prelude_list_t *jobs)
+{
+        cnx_t *cnx;
+        cnx_list_t *clist;
+        struct timeval now;
+
+        if ( ! (pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_BATCH) )
+                return;
+
+        gettimeofday(&now, NULL);
+
+        for ( clist = pool->or_list; clist != NULL; clist = clist->or ) {
+                for ( cnx = clist->and; cnx != NULL; cnx = cnx->and ) {
+                        if ( cnx->batch_count && batch_is_due(cnx, &now) )
+                                batch_expire(cnx, jobs);
+                }
+        }
+}
+
+
+
+/*
+ * Queue @msg for @cnx: the batch is to be written once it reaches its
+ * size limit, once its first message waited for the batch delay, or as
+ * soon as a high priority message is added. Returns TRUE when it is.
+ */
+static prelude_bool_t batch_add(cnx_t *cnx, prelude_msg_t *msg)
+{
+        unsigned int delay;
+        struct timeval now;
+        prelude_connection_pool_t *pool = cnx->parent->parent;
+
+        if ( ! cnx->batch_limit || cnx->batch_limit > pool->batch_size )
+                cnx->batch_limit = pool->batch_size;
+
+        delay = batch_get_delay(cnx);
+        gettimeofday(&now, NULL);
+
+        if ( cnx->batch_count == 0 ) {
+                cnx->batch_start = now;
+
+                prelude_timer_set_expire_ms(&cnx->batch_timer, MAX(1, (delay + 999) / 1000));
+                prelude_timer_init(&cnx->batch_timer);
+        }
+
+        cnx->batch[cnx->batch_count++] = prelude_msg_ref(msg);
+        cnx->batch_len += prelude_msg_get_len(msg);
+
+        /*
+         * High priority messages are not delayed.
+         */
+        return ( prelude_msg_get_priority(msg) == PRELUDE_MSG_PRIORITY_HIGH ||
+                 cnx->batch_count == BATCH_MAX_MSG || cnx->batch_len >= cnx->batch_limit || batch_is_due(cnx, &now) );
+}
+
+
+
+/*
+ * Handle @msg for @cnx, with the pool locked: the messages that are to
+ * be written to @cnx now are stored in @msgs, and their count returned.
+ * Messages beyond the acknowledgement window wait in the failover.
+ */
+static size_t send_prepare(cnx_t *cnx, prelude_msg_t *msg, prelude_msg_t **msgs)
+{
+        if ( ack_must_spill(cnx, msg) || ! prelude_connection_is_alive(cnx->cnx) ) {
+                if ( cnx->failover )
+                        failover_save_msg(cnx->failover, msg);
+
+                return 0;
+        }
+
+        if ( ! (cnx->parent->parent->flags & PRELUDE_CONNECTION_POOL_FLAGS_BATCH) ) {
+                msgs[0] = prelude_msg_ref(msg);
+                return 1;
+        }
+
+        return batch_add(cnx, msg) ? batch_take(cnx, msgs) : 0;
+}
+
+
+
+static void send_message(prelude_msg_t *msg, cnx_t *cnx)
+{
+        int ret;
+        size_t count;
+        uint64_t seq = 0;
+        unsigned int gen;
+        prelude_msg_t *msgs[BATCH_MAX_MSG];
+
+        if ( ! cnx )
+                return;
+
+        count = send_prepare(cnx, msg, msgs);
+        if ( ! count )
+                return;
+
+        gen = cnx->write_gen;
+        ret = cnx_write(cnx, gen, msgs, count, &seq);
+
+        write_complete(cnx, gen, msgs, count, seq, ret);
+}
+
+
+
+static void cnx_job_destroy(cnx_job_t *job, prelude_connection_pool_t *pool)
+{
+        gl_recursive_lock_lock(pool->mutex);
+
+        if ( job->msg )
+                prelude_msg_destroy(job->msg);
+
+        cnx_unref(job->cnx, pool);
+
+        gl_recursive_lock_unlock(pool->mutex);
+
+        prelude_connection_pool_destroy(pool);
+        free(job);
+}
+
+
+/*
+ * Write the message of a job, or the batch of its connection when it
+ * has none. The pool is unlocked while writing, so that the other
+ * connections are not held up by a slow peer.
+ */
+static void cnx_job_run(void *obj, void *data)
+{
+        int ret;
+        size_t i, count = 0;
+        uint64_t seq = 0;
+        unsigned int gen = 0;
+        cnx_job_t *job = obj;
+        cnx_t *cnx = job->cnx;
+        prelude_connection_pool_t *pool = data;
+        prelude_msg_t *msgs[BATCH_MAX_MSG];
+
+        gl_recursive_lock_lock(pool->mutex);
+
+        if ( cnx->detached ) {
+                if ( job->msg && pool->failover )
+                        failover_save_msg(pool->failover, job->msg);
+        } else {
+                count = (job->msg) ? send_prepare(cnx, job->msg, msgs) : batch_take(cnx, msgs);
+                gen = cnx->write_gen;
+        }
+
+        gl_recursive_lock_unlock(pool->mutex);
+
+        if ( count ) {
+                ret = cnx_write(cnx, gen, msgs, count, &seq);
+
+                gl_recursive_lock_lock(pool->mutex);
+
+                if ( ! cnx->detached )
+                        write_complete(cnx, gen, msgs, count, seq, ret);
+
+                else for ( i = 0; i < count; i++ ) {
+                        if ( ret < 0 && pool->failover )
+                                failover_save_msg(pool->failover, msgs[i]);
+
+                        prelude_msg_destroy(msgs[i]);
+                }
+
+                gl_recursive_lock_unlock(pool->mutex);
+        }
+
+        cnx_job_destroy(job, pool);
+}
+
+
+/*
+ * Called for jobs removed from a full queue: the message is saved to
+ * the failover when spilling is requested.
+ */
+static void cnx_job_overflow(void *obj, void *data)
+{
+        cnx_job_t *job = obj;
+        prelude_failover_t *failover;
+        prelude_connection_pool_t *pool = data;
+
+        if ( job->msg && prelude_async_get_overflow_policy() == PRELUDE_ASYNC_OVERFLOW_POLICY_SPILL ) {
+                gl_recursive_lock_lock(pool->mutex);
+
+                failover = (job->cnx->detached) ? pool->failover : job->cnx->failover;
+                if ( failover )
+                        failover_save_msg(failover, job->msg);
+
+                gl_recursive_lock_unlock(pool->mutex);
+        }
+
+        cnx_job_destroy(job, pool);
+}
+
+
+/*
+ * Create a job writing @msg to @cnx, or its batch if @msg is NULL. The
+ * job holds a reference on the connection and on the pool.
+ */
+static int cnx_job_new(cnx_job_t **job, cnx_t *cnx, prelude_msg_t *msg)
+{
+        int ret;
+        prelude_connection_pool_t *pool = cnx->parent->parent;
+
+        if ( ! cnx->async_queue ) {
+                ret = prelude_async_queue_new(&cnx->async_queue);
+                if ( ret < 0 )
+                        return ret;
+
+                prelude_async_queue_set_overflow_callback(cnx->async_queue, cnx_job_overflow);
+        }
+
+        *job = malloc(sizeof(**job));
+        if ( ! *job )
+                return prelude_error_from_errno(errno);
+
+        (*job)->cnx = cnx;
+        (*job)->msg = msg;
+
+        cnx->refcount++;
+        pool->refcount++;
+
+        prelude_async_set_callback((prelude_async_object_t *) *job, cnx_job_run);
+        prelude_async_set_data((prelude_async_object_t *) *job, pool);
+
+        return 0;
+}
+
+
+
+/*
+ * Queue @msg for @cnx, to be written by an asynchronous worker. The
+ * first destination takes over @msg, the others get their own copy,
+ * since messages are modified as they are written.
+ */
+static void queue_message(prelude_msg_t *msg, cnx_t *cnx, prelude_list_t *jobs)
+{
+        int ret = 0;
+        cnx_job_t *job;
+        prelude_msg_t *copy = msg;
+
+        if ( ! prelude_list_is_empty(jobs) )
+                ret = prelude_msg_clone(&copy, msg);
+
+        if ( ret == 0 ) {
+                ret = cnx_job_new(&job, cnx, copy);
+                if ( ret == 0 ) {
+                        prelude_linked_object_add_tail(jobs, (prelude_linked_object_t *) job);
+                        return;
+                }
+
+                if ( copy != msg )
+                        prelude_msg_destroy(copy);
+        }
+
+        prelude_log(PRELUDE_LOG_WARN, "error queueing message: %s.\n", prelude_strerror(ret));
+        send_message(msg, cnx);
+}
+
+
+
+/*
+ * Send @msg to @cnx, or queue it in @jobs when not NULL.
+ */
+static void dispatch_message(prelude_msg_t *msg, cnx_t *cnx, prelude_list_t *jobs)
+{
+        if ( ! cnx )
+                return;
+
+        if ( jobs )
+                queue_message(msg, cnx, jobs);
+        else
+                send_message(msg, cnx);
+}
+
+
+
+static void broadcast_message(prelude_msg_t *msg, cnx_t *cnx, prelude_list_t *jobs)
+{
+        for ( ; cnx != NULL; cnx = cnx->and )
+                dispatch_message(msg, cnx, jobs);
+}
 
-        if ( ! failover )
-                return 0;
 
-        available = prelude_failover_get_available_msg_count(failover);
-        if ( ! available )
-                return 0;
 
+/*
+ * Number of bytes written to @cnx that the peer did not process yet.
+ */
+static uint64_t get_outstanding_bytes(cnx_t *cnx)
+{
+        uint64_t len = cnx->batch_len;
+
+        if ( cnx->ack_count || ! prelude_connection_is_alive(cnx->cnx) )
+                return len + cnx->ack_len;
+
+#ifdef TIOCOUTQ
+        {
+                int queued;
+
+                if ( ioctl(prelude_io_get_fd(prelude_connection_get_fd(cnx->cnx)), TIOCOUTQ, &queued) == 0 )
+                        len += queued;
+        }
+#endif
+
+        return len;
+}
+
+
+
+/*
+ * Rendez-vous hashing: each analyzer uses the member with the highest
+ * hash, so that only the analyzers using a member that goes away move.
+ */
+static uint64_t get_member_hash(uint64_t analyzerid, prelude_connection_t *cnx)
+{
+        unsigned int i;
+        const char *addr;
+        uint64_t hash = 14695981039346656037ULL;
+        unsigned int port = prelude_connection_get_peer_port(cnx);
+
+        for ( i = 0; i < sizeof(analyzerid); i++ ) {
+                hash ^= (analyzerid >> (i * 8)) & 0xff;
+                hash *= 1099511628211ULL;
+        }
+
+        for ( addr = prelude_connection_get_peer_addr(cnx); addr && *addr; addr++ ) {
+                hash ^= (unsigned char) *addr;
+                hash *= 1099511628211ULL;
+        }
+
+        for ( i = 0; i < sizeof(uint16_t); i++ ) {
+                hash ^= (port >> (i * 8)) & 0xff;
+                hash *= 1099511628211ULL;
+        }
+
+        return hash;
+}
+
+
+
+/*
+ * Pick the member of @clist with the lowest cost for the balancing
+ * strategy in use, live members first.
+ */
+static cnx_t *balance_select(cnx_list_t *clist)
+{
+        cnx_t *cnx, *best = NULL;
+        uint64_t cost, best_cost = 0;
+        unsigned int i, best_index = 0;
+        prelude_bool_t alive, best_alive = FALSE;
+        prelude_connection_pool_t *pool = clist->parent;
+        uint64_t analyzerid = prelude_client_profile_get_analyzerid(pool->client_profile);
+
+        for ( i = 0, cnx = clist->and; cnx != NULL; i++, cnx = cnx->and ) {
+                alive = prelude_connection_is_alive(cnx->cnx);
+                if ( best && best_alive && ! alive )
+                        continue;
+
+                if ( pool->balance == PRELUDE_CONNECTION_POOL_BALANCE_HASH )
+                        cost = ~get_member_hash(analyzerid, cnx->cnx);
+
+                else if ( pool->balance == PRELUDE_CONNECTION_POOL_BALANCE_LEAST_LOADED )
+                        cost = get_outstanding_bytes(cnx);
+
+                else
+                        cost = (i + clist->total - clist->next % clist->total) % clist->total;
+
+                if ( best && alive == best_alive && cost >= best_cost )
+                        continue;
+
+                best = cnx;
+                best_cost = cost;
+                best_index = i;
+                best_alive = alive;
+        }
+
+        if ( best )
+                clist->next = best_index + 1;
+
+        return best;
+}
+
+
+
+static void send_to_list(prelude_msg_t *msg, cnx_list_t *clist, prelude_list_t *jobs)
+{
+        if ( clist->balance )
+                dispatch_message(msg, balance_select(clist), jobs);
+        else
+                broadcast_message(msg, clist->and, jobs);
+}
+
+
+
+/*
+ * Whether messages sent to @clist reach all their destinations: all the
+ * members of a AND list, or any member of a balanced list.
+ */
+static prelude_bool_t list_is_complete(cnx_list_t *clist)
+{
+        if ( clist->balance )
+                return (clist->dead < clist->total) ? TRUE : FALSE;
+
+        return (clist->dead == 0) ? TRUE : FALSE;
+}
+
+
+
+static void get_replay_name(cnx_list_t *clist, cnx_t *cnx, char *name, size_t size)
+{
         if ( clist )
-                snprintf(name, sizeof(name), "any");
+                snprintf(name, size, "any");
         else
-                snprintf(name, sizeof(name), "0x%" PRELUDE_PRIx64, prelude_connection_get_peer_analyzerid(cnx->cnx));
+                snprintf(name, size, "0x%" PRELUDE_PRIx64, prelude_connection_get_peer_analyzerid(cnx->cnx));
+}
 
-        prelude_log(PRELUDE_LOG_INFO,
-                    "Flushing %u message to %s (%lu erased due to quota)...\n",
-                    available, name, prelude_failover_get_deleted_msg_count(failover));
 
-        do {
-                size = prelude_failover_get_saved_msg(failover, &msg);
-                if ( size == 0 )
+
+/*
+ * Write up to @max messages from @failover to @clist, or to @cnx.
+ * Messages are read in batches, and written to the connection with
+ * a single system call where possible.
+ */
+static int failover_replay(prelude_failover_t *failover, cnx_list_t *clist, cnx_t *cnx,
+                           unsigned int max, unsigned int *count, size_t *totsize)
+{
+        uint64_t seq = 0;
+        unsigned int gen;
+        ssize_t i, nmsg, ret = 0;
+        prelude_msg_t *msgs[FAILOVER_FLUSH_BATCH];
+
+        while ( ret >= 0 && *count < max ) {
+                nmsg = prelude_failover_get_saved_msgs(failover, msgs, MIN(max - *count, FAILOVER_FLUSH_BATCH));
+                if ( nmsg == 0 )
                         break;
 
-                if ( size < 0 ) {
-                        prelude_log(PRELUDE_LOG_ERR, "error reading message from failover: %s", prelude_strerror(size));
+                if ( nmsg < 0 ) {
+                        prelude_log(PRELUDE_LOG_ERR, "error reading message from failover: %s", prelude_strerror(nmsg));
                         break;
                 }
 
                 if ( clist ) {
-                        broadcast_message(msg, clist->and);
-                        if ( clist->dead )
-                                ret = -1;
+                        for ( i = 0; i < nmsg && ret == 0; i++ ) {
+                                send_to_list(msgs[i], clist, NULL);
+                                if ( ! list_is_complete(clist) )
+                                        ret = -1;
+
+                                (*count)++;
+                                *totsize += prelude_msg_get_len(msgs[i]);
+                        }
+
+                        /*
+                         * Messages we did not get to are kept for later.
+                         */
+                        for ( ; i < nmsg; i++ )
+                                failover_save_msg(failover, msgs[i]);
+
+                        for ( i = 0; i < nmsg; i++ )
+                                prelude_msg_destroy(msgs[i]);
                 } else {
-                        ret = do_send(cnx->cnx, msg);
-                        if ( ret < 0 ) {
-                                set_state_dead(cnx, ret, FALSE, TRUE);
-                                if ( cnx->failover )
-                                        failover_save_msg(cnx->failover, msg);
+                        gen = cnx->write_gen;
+                        ret = cnx_write(cnx, gen, msgs, nmsg, &seq);
+                        if ( ret >= 0 ) {
+                                *count += nmsg;
+                                for ( i = 0; i < nmsg; i++ )
+                                        *totsize += prelude_msg_get_len(msgs[i]);
                         }
+
+                        ret = write_complete(cnx, gen, msgs, nmsg, seq, ret);
                 }
+        }
 
-                prelude_msg_destroy(msg);
+        return ret;
+}
 
-                if ( ret < 0 )
-                        break;
 
-                count++;
-                totsize += size;
 
-        } while ( 1 );
+static int failover_flush(prelude_failover_t *failover, cnx_list_t *clist, cnx_t *cnx)
+{
+        int ret;
+        char name[128];
+        size_t totsize = 0;
+        unsigned int available, count = 0;
+
+        if ( ! failover )
+                return 0;
+
+        available = prelude_failover_get_available_msg_count(failover);
+        if ( ! available )
+                return 0;
+
+        get_replay_name(clist, cnx, name, sizeof(name));
+
+        prelude_log(PRELUDE_LOG_INFO,
+                    "Flushing %u message to %s (%lu erased due to quota)...\n",
+                    available, name, prelude_failover_get_deleted_msg_count(failover));
+
+        ret = failover_replay(failover, clist, cnx, UINT_MAX, &count, &totsize);
 
         prelude_log(PRELUDE_LOG_WARN, "Failover recovery: %u/%u messages flushed (%" PRELUDE_PRIu64 " bytes).\n",
                     count, available, (uint64_t) totsize);
@@ -526,13 +2007,166 @@ static int failover_flush(prelude_failover_t *failover, cnx_list_t *clist, cnx_t
 }
 
 
+
+static void replay_stop(replay_t *replay)
+{
+        prelude_timer_destroy(&replay->timer);
+        replay->running = FALSE;
+}
+
+
+
+static void replay_notify(replay_t *replay)
+{
+        if ( replay->cnx )
+                event_handler(replay->pool, PRELUDE_CONNECTION_POOL_EVENT_REPLAY, replay->cnx->cnx);
+        else
+                global_event_handler(replay->pool, PRELUDE_CONNECTION_POOL_EVENT_REPLAY);
+}
+
+
+
+/*
+ * Each time the replay timer expires, a slice of the failover is
+ * written, so that the pool is not locked for the whole replay and
+ * live messages are interleaved with replayed ones.
+ */
+static uint64_t replay_get_elapsed(replay_t *replay)
+{
+        struct timeval now;
+
+        gettimeofday(&now, NULL);
+
+        return (uint64_t) (now.tv_sec - replay->start.tv_sec) * 1000 + (now.tv_usec - replay->start.tv_usec) / 1000;
+}
+
+
+
+static void replay_timer_expire(void *data)
+{
+        int ret;
+        uint64_t due;
+        char name[128];
+        size_t totsize = 0;
+        unsigned int count = 0, max = 0;
+        replay_t *replay = data;
+        prelude_connection_pool_t *pool = replay->pool;
+
+        gl_recursive_lock_lock(pool->mutex);
+
+        if ( (replay->cnx && ! prelude_connection_is_alive(replay->cnx->cnx)) ||
+             (replay->clist && ! list_is_complete(replay->clist)) ) {
+                replay_stop(replay);
+                gl_recursive_lock_unlock(pool->mutex);
+                return;
+        }
+
+        /*
+         * The slice is what the rate allows since the replay started, so
+         * that late timers do not slow it down, up to a second worth of
+         * messages so that they do not make it burst either.
+         */
+        due = (uint64_t) pool->replay_rate * replay_get_elapsed(replay) / 1000;
+        if ( due > replay->msg )
+                max = MIN(due - replay->msg, pool->replay_rate);
+
+        ret = failover_replay(replay->failover, replay->clist, replay->cnx, max, &count, &totsize);
+
+        replay->msg += count;
+        replay->bytes += totsize;
+
+        if ( ret < 0 || ! prelude_failover_get_available_msg_count(replay->failover) ) {
+                get_replay_name(replay->clist, replay->cnx, name, sizeof(name));
+                prelude_log(PRELUDE_LOG_WARN, "Failover recovery to %s: %" PRELUDE_PRIu64 " messages flushed (%" PRELUDE_PRIu64 " bytes).\n",
+                            name, replay->msg, replay->bytes);
+                replay_stop(replay);
+        }
+
+        else if ( replay->running )
+                prelude_timer_reset(&replay->timer);
+
+        replay_notify(replay);
+
+        gl_recursive_lock_unlock(pool->mutex);
+}
+
+
+
+/*
+ * Replay @failover to @clist or @cnx from the background, or right away
+ * without PRELUDE_CONNECTION_POOL_FLAGS_REPLAY.
+ */
+static int replay_start(replay_t *replay, prelude_failover_t *failover, cnx_list_t *clist, cnx_t *cnx)
+{
+        char name[128];
+        prelude_connection_pool_t *pool = replay->pool;
+
+        if ( ! (pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_REPLAY) )
+                return failover_flush(failover, clist, cnx);
+
+        if ( ! failover || replay->running || ! prelude_failover_get_available_msg_count(failover) )
+                return 0;
+
+        get_replay_name(clist, cnx, name, sizeof(name));
+        prelude_log(PRELUDE_LOG_INFO, "Replaying %lu message to %s at %u messages per second (%lu erased due to quota)...\n",
+                    prelude_failover_get_available_msg_count(failover), name, pool->replay_rate,
+                    prelude_failover_get_deleted_msg_count(failover));
+
+        replay->cnx = cnx;
+        replay->clist = clist;
+        replay->failover = failover;
+        replay->running = TRUE;
+        replay->msg = replay->bytes = 0;
+        gettimeofday(&replay->start, NULL);
+
+        prelude_timer_set_data(&replay->timer, replay);
+        prelude_timer_set_callback(&replay->timer, replay_timer_expire);
+        prelude_timer_set_expire_ms(&replay->timer, REPLAY_INTERVAL);
+        prelude_timer_init(&replay->timer);
+
+        return 0;
+}
+
+
+
+static void replay_get_stats(replay_t *replay, prelude_connection_pool_replay_stats_t *stats)
+{
+        uint64_t elapsed;
+
+        memset(stats, 0, sizeof(*stats));
+
+        if ( ! replay->failover )
+                return;
+
+        stats->replayed_msg = replay->msg;
+        stats->replayed_bytes = replay->bytes;
+
+        if ( ! replay->running )
+                return;
+
+        elapsed = replay_get_elapsed(replay);
+        stats->remaining_msg = prelude_failover_get_available_msg_count(replay->failover);
+
+        /*
+         * The estimate uses the observed rate once there is one.
+         */
+        if ( replay->msg && elapsed )
+                stats->eta = (stats->remaining_msg * elapsed / replay->msg + 999) / 1000;
+        else
+                stats->eta = (stats->remaining_msg + replay->pool->replay_rate - 1) / replay->pool->replay_rate;
+}
+
+
+
 static int set_state_alive(cnx_t *cnx, prelude_bool_t global_notice)
 {
-        int ret, fd;
+        int ret;
         cnx_list_t *clist = cnx->parent;
         prelude_connection_pool_t *pool = clist->parent;
 
         prelude_timer_destroy(&cnx->timer);
+
+        cnx->backoff = INITIAL_EXPIRATION_TIME;
         prelude_timer_set_expire(&cnx->timer, INITIAL_EXPIRATION_TIME);
 
         if ( clist->dead )
@@ -541,21 +2175,21 @@ static int set_state_alive(cnx_t *cnx, prelude_bool_t global_notice)
         prelude_log_debug(3, "notify alive: total=%d dead=%d\n", clist->total, clist->dead);
         notify_event(pool, PRELUDE_CONNECTION_POOL_EVENT_ALIVE, cnx->cnx, global_notice);
 
-        ret = failover_flush(cnx->failover, NULL, cnx);
+        if ( cnx->failover && ack_enabled(cnx) )
+                ret = ack_replay(cnx);
+        else
+                ret = replay_start(&cnx->replay, cnx->failover, NULL, cnx);
+
         if ( ret < 0 )
                 return ret;
 
-        if ( pool->failover && clist->dead == 0 ) {
-                ret = failover_flush(pool->failover, clist, NULL);
+        if ( pool->failover && list_is_complete(clist) ) {
+                ret = replay_start(&pool->replay, pool->failover, clist, NULL);
                 if ( ret < 0 )
                         return ret;
         }
 
-        fd = prelude_io_get_fd(prelude_connection_get_fd(cnx->cnx));
-        assert(fd < FD_SETSIZE);
-
-        FD_SET(fd, &pool->fds);
-        pool->nfd = MAX(fd + 1, pool->nfd);
+        pool_watch(pool, cnx);
 
         return 0;
 }
@@ -563,11 +2197,18 @@ static int set_state_alive(cnx_t *cnx, prelude_bool_t global_notice)
 
 static void set_state_dead(cnx_t *cnx, prelude_error_t error, prelude_bool_t init_time, prelude_bool_t global_notice)
 {
-        int fd;
         cnx_list_t *clist = cnx->parent;
         prelude_connection_pool_t *pool = clist->parent;
 
-        prelude_connection_close(cnx->cnx);
+        /*
+         * Unacknowledged messages were written before the batched ones.
+         */
+        ack_release(cnx, TRUE);
+        batch_release(cnx, TRUE);
+        replay_stop(&cnx->replay);
+
+        pool_unwatch(pool, cnx);
+        cnx_close(cnx);
 
         if ( ! init_time || prelude_error_get_code(error) != PRELUDE_ERROR_PROFILE )
                 prelude_log(PRELUDE_LOG_WARN, "%sconnection error with %s: %s\n",
@@ -580,10 +2221,6 @@ static void set_state_dead(cnx_t *cnx, prelude_error_t error, prelude_bool_t ini
         init_cnx_timer(cnx);
 
         notify_event(pool, PRELUDE_CONNECTION_POOL_EVENT_DEAD, cnx->cnx, global_notice);
-
-        fd = prelude_io_get_fd(prelude_connection_get_fd(cnx->cnx));
-        assert(fd < FD_SETSIZE);
-        FD_CLR(fd, &pool->fds);
 }
 
 
@@ -598,9 +2235,10 @@ static void check_for_data_cb(void *arg)
 
 /*
  * Returns 0 on sucess, -1 on a new failure,
- * -2 on an already signaled failure.
+ * -2 on an already signaled failure. With @jobs, messages are queued
+ * there instead of being sent.
  */
-static int walk_manager_lists(prelude_connection_pool_t *pool, prelude_msg_t *msg)
+static int walk_manager_lists(prelude_connection_pool_t *pool, prelude_msg_t *msg, prelude_list_t *jobs)
 {
         int ret = 0;
         cnx_list_t *or;
@@ -608,27 +2246,132 @@ static int walk_manager_lists(prelude_connection_pool_t *pool, prelude_msg_t *ms
         for ( or = pool->or_list; or != NULL; or = or->or ) {
 
                 /*
-                 * if all connections are dead and we have a or, go to next.
+                 * if all connections are dead and we have a or, go to next.
+                 */
+                if ( or->dead == or->total && (pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER) ) {
+                        ret = -2;
+                        continue;
+                }
+
+                send_to_list(msg, or, jobs);
+                return 0;
+        }
+
+        if ( pool->failover )
+                failover_save_msg(pool->failover, msg);
+
+        return ret;
+}
+
+
+
+static void set_wanted_features(cnx_t *cnx)
+{
+        prelude_connection_feature_t features = 0;
+        prelude_connection_pool_flags_t flags = cnx->parent->parent->flags;
+
+        if ( flags & PRELUDE_CONNECTION_POOL_FLAGS_ACK )
+                features |= PRELUDE_CONNECTION_FEATURE_ACK;
+
+        if ( flags & PRELUDE_CONNECTION_POOL_FLAGS_COMPACT )
+                features |= PRELUDE_CONNECTION_FEATURE_COMPACT;
+
+        if ( flags & PRELUDE_CONNECTION_POOL_FLAGS_DICTIONARY )
+                features |= PRELUDE_CONNECTION_FEATURE_DICTIONARY;
+
+        if ( flags & PRELUDE_CONNECTION_POOL_FLAGS_COMPRESSION )
+                features |= PRELUDE_CONNECTION_FEATURE_COMPRESSION;
+
+        prelude_connection_set_wanted_features(cnx->cnx, features);
+        prelude_connection_set_tls_offload(cnx->cnx, (flags & PRELUDE_CONNECTION_POOL_FLAGS_TLS_OFFLOAD) ? TRUE : FALSE);
+}
+
+
+
+/*
+ * Forget about the connection being established: its file descriptor
+ * has been closed, which also removed it from the epoll set.
+ */
+static void connection_forget(cnx_t *cnx)
+{
+#ifdef HAVE_EPOLL_CREATE1
+        watch_del(cnx->parent->parent, cnx);
+#endif
+
+        if ( cnx->ready )
+                prelude_list_del(&cnx->ready_list);
+
+        cnx->connecting = cnx->watched = cnx->ready = FALSE;
+}
+
+
+
+/*
+ * Handle the result of a step of a non blocking reconnection attempt.
+ */
+static void connection_resume(cnx_t *cnx, int ret)
+{
+        prelude_connection_pool_t *pool = cnx->parent->parent;
+
+        if ( ret >= 0 ) {
+                /*
+                 * The socket is now blocking: make sure we don't try
+                 * to read from it on a stale readiness notification.
+                 */
+                if ( cnx->ready ) {
+                        prelude_list_del(&cnx->ready_list);
+                        cnx->ready = FALSE;
+                }
+
+                cnx->connecting = FALSE;
+
+                /*
+                 * A failure to replay the failover right after connecting
+                 * is handled as a connection error, and retried later.
                  */
-                if ( or->dead == or->total && (pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER) ) {
-                        ret = -2;
-                        continue;
-                }
+                ret = set_state_alive(cnx, TRUE);
+                if ( ret < 0 )
+                        set_state_dead(cnx, ret, FALSE, TRUE);
 
-                broadcast_message(msg, or->and);
-                return 0;
+                return;
         }
 
-        if ( pool->failover )
-                failover_save_msg(pool->failover, msg);
+        if ( prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN ) {
+#ifdef HAVE_EPOLL_CREATE1
+                if ( pool->epfd >= 0 )
+                        epoll_watch(pool, cnx, prelude_connection_connect_want_write(cnx->cnx) ? EPOLLOUT : EPOLLIN);
+#endif
+                /*
+                 * The pool event loop might not be running: poll the
+                 * connection from its timer as well.
+                 */
+                prelude_timer_set_expire_ms(&cnx->timer, CONNECTION_POLL_INTERVAL);
+                prelude_timer_reset(&cnx->timer);
+                return;
+        }
 
-        return ret;
+        connection_forget(cnx);
+
+        prelude_log(PRELUDE_LOG_WARN, "%sconnection error with %s: %s\n",
+                    (pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER) ? "Failover enabled: " : "",
+                     prelude_connection_get_peer_addr(cnx->cnx), prelude_strerror(ret));
+
+        /*
+         * Connection failed, expand timeout and reset the timer.
+         */
+        if ( cnx->backoff < MAXIMUM_EXPIRATION_TIME )
+                cnx->backoff *= 2;
+
+        prelude_timer_set_expire(&cnx->timer, cnx->backoff);
+        prelude_timer_reset(&cnx->timer);
 }
 
 
 
 /*
  * Function called back when one of the client reconnection timer expires.
+ * The connection is established without blocking, so that an unreachable
+ * manager does not delay the others.
  */
 static void connection_timer_expire(void *data)
 {
@@ -638,25 +2381,24 @@ static void connection_timer_expire(void *data)
 
         gl_recursive_lock_lock(pool->mutex);
 
-        ret = prelude_connection_connect(cnx->cnx, pool->client_profile, pool->permission);
-        if ( ret >= 0 ) {
-                set_state_alive(cnx, TRUE);
-                goto out;
+        if ( ! cnx->connecting ) {
+                cnx->connecting = TRUE;
+                cnx->connect_deadline = time(NULL) + CONNECTION_TIMEOUT;
+
+                set_wanted_features(cnx);
+                ret = prelude_connection_connect_nonblock(cnx->cnx, pool->client_profile, pool->permission);
         }
 
-        prelude_log(PRELUDE_LOG_WARN, "%sconnection error with %s: %s\n",
-                    (pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER) ? "Failover enabled: " : "",
-                     prelude_connection_get_peer_addr(cnx->cnx), prelude_strerror(ret));
+        else if ( time(NULL) >= cnx->connect_deadline ) {
+                cnx_close(cnx);
+                ret = prelude_error_from_errno(ETIMEDOUT);
+        }
 
-        /*
-         * Connection failed, expand timeout and reset the timer.
-         */
-        if ( prelude_timer_get_expire(&cnx->timer) < MAXIMUM_EXPIRATION_TIME )
-                prelude_timer_set_expire(&cnx->timer, prelude_timer_get_expire(&cnx->timer) * 2);
+        else
+                ret = prelude_connection_connect_resume(cnx->cnx);
 
-        prelude_timer_reset(&cnx->timer);
+        connection_resume(cnx, ret);
 
-out:
         gl_recursive_lock_unlock(pool->mutex);
 }
 
@@ -675,8 +2417,29 @@ static int new_connection(cnx_t **ncnx, prelude_client_profile_t *cp, cnx_list_t
         nc->msg = NULL;
         nc->failover = NULL;
         nc->parent = clist;
+        nc->watched = nc->ready = nc->connecting = FALSE;
+        nc->backoff = INITIAL_EXPIRATION_TIME;
         prelude_timer_init_list(&nc->timer);
 
+        nc->batch_count = nc->batch_len = nc->batch_limit = 0;
+        nc->batch_rtt = 0;
+        prelude_timer_init_list(&nc->batch_timer);
+
+        nc->replay.running = FALSE;
+        nc->replay.pool = clist->parent;
+        prelude_timer_init_list(&nc->replay.timer);
+
+        nc->ack = NULL;
+        nc->ack_size = nc->ack_first = nc->ack_count = nc->ack_len = 0;
+        nc->ack_dropping = FALSE;
+
+        nc->async_queue = NULL;
+        nc->write_gen = 0;
+        nc->refcount = 1;
+        nc->detached = FALSE;
+        prelude_timer_set_data(&nc->batch_timer, nc);
+        prelude_timer_set_callback(&nc->batch_timer, batch_timer_expire);
+
         if ( flags & PRELUDE_CONNECTION_POOL_FLAGS_RECONNECT ) {
                 prelude_timer_set_data(&nc->timer, nc);
                 prelude_timer_set_expire(&nc->timer, INITIAL_EXPIRATION_TIME);
@@ -696,6 +2459,8 @@ static int new_connection(cnx_t **ncnx, prelude_client_profile_t *cp, cnx_list_t
                         goto err;
         }
 
+        gl_lock_init(nc->write_mutex);
+
         nc->cnx = cnx;
         nc->and = NULL;
         clist->total++;
@@ -790,13 +2555,14 @@ static char *parse_config_string(char **line)
 
 
 /*
- * Parse Manager configuration line: x.x.x.x && y.y.y.y || z.z.z.z
+ * Parse Manager configuration line: x.x.x.x && y.y.y.y || z.z.z.z <> w.w.w.w
  */
 static int parse_config_line(prelude_connection_pool_t *pool)
 {
         int ret;
         cnx_t **cnx;
         cnx_list_t *clist = NULL;
+        prelude_bool_t and = FALSE;
         char *ptr, *cfgline = pool->connection_string;
 
         ret = create_connection_list(&pool->or_list, pool);
@@ -830,11 +2596,21 @@ static int parse_config_line(prelude_connection_pool_t *pool)
 
                         clist = clist->or;
                         cnx = &clist->and;
+                        and = FALSE;
                         continue;
                 }
 
-                ret = strcmp(ptr, "&&");
-                if ( ret == 0 )
+                if ( strcmp(ptr, "&&") == 0 )
+                        and = TRUE;
+
+                else if ( strcmp(ptr, "<>") == 0 )
+                        clist->balance = TRUE;
+
+                if ( and && clist->balance )
+                        return prelude_error_verbose(PRELUDE_ERROR_CONNECTION_STRING,
+                                                     "'&&' and '<>' can not be mixed without '||' in between");
+
+                if ( strcmp(ptr, "&&") == 0 || strcmp(ptr, "<>") == 0 )
                         continue;
 
                 ret = new_connection_from_address(cnx, pool->client_profile, clist, ptr, pool->flags);
@@ -866,18 +2642,6 @@ static cnx_t *search_cnx(prelude_connection_pool_t *pool, prelude_connection_t *
 }
 
 
-static void broadcast_async_cb(void *obj, void *data)
-{
-        prelude_msg_t *msg = obj;
-        prelude_connection_pool_t *pool = data;
-
-        prelude_connection_pool_broadcast(pool, msg);
-        prelude_msg_destroy(msg);
-
-        prelude_connection_pool_destroy(pool);
-}
-
-
 /**
  * prelude_connection_pool_broadcast:
  * @pool: Pointer to a #prelude_connection_pool_t object.
@@ -887,12 +2651,19 @@ static void broadcast_async_cb(void *obj, void *data)
  */
 void prelude_connection_pool_broadcast(prelude_connection_pool_t *pool, prelude_msg_t *msg)
 {
+        PRELUDE_LIST(jobs);
+
         prelude_return_if_fail(pool);
         prelude_return_if_fail(msg);
 
         gl_recursive_lock_lock(pool->mutex);
-        walk_manager_lists(pool, msg);
+
+        walk_manager_lists(pool, msg, NULL);
+        batch_flush_due(pool, &jobs);
+
         gl_recursive_lock_unlock(pool->mutex);
+
+        batch_queue_jobs(&jobs);
 }
 
 
@@ -904,19 +2675,79 @@ void prelude_connection_pool_broadcast(prelude_connection_pool_t *pool, prelude_
  * Sends the message contained in @msg to all connections
  * in @pool asynchronously. After the request is processed,
  * the @msg message will be freed.
+ *
+ * Each connection has its own queue, so that a slow peer does not
+ * delay the others. Messages are processed according to their
+ * priority, see prelude_async_queue_add_priority(): when a queue is
+ * full, the lowest priority ones are the first to be dropped or
+ * spilled to the failover of the connection.
  */
 void prelude_connection_pool_broadcast_async(prelude_connection_pool_t *pool, prelude_msg_t *msg)
 {
+        cnx_job_t *job;
+        prelude_list_t jobs, *tmp, *bkp;
+        prelude_msg_priority_t priority;
+
         prelude_return_if_fail(pool);
         prelude_return_if_fail(msg);
 
+        prelude_list_init(&jobs);
+        priority = prelude_msg_get_priority(msg);
+
         gl_recursive_lock_lock(pool->mutex);
-        pool->refcount++;
+
+        walk_manager_lists(pool, msg, &jobs);
+        if ( prelude_list_is_empty(&jobs) )
+                prelude_msg_destroy(msg);
+
         gl_recursive_lock_unlock(pool->mutex);
 
-        prelude_async_set_callback((prelude_async_object_t *) msg, &broadcast_async_cb);
-        prelude_async_set_data((prelude_async_object_t *) msg, pool);
-        prelude_async_add((prelude_async_object_t *) msg);
+        /*
+         * Queues are filled without the pool lock, since adding might
+         * block until the worker, which needs it, made some room.
+         */
+        prelude_list_for_each_safe(&jobs, tmp, bkp) {
+                job = prelude_linked_object_get_object(tmp);
+                prelude_linked_object_del((prelude_linked_object_t *) job);
+                prelude_async_queue_add_priority(job->cnx->async_queue, (prelude_async_object_t *) job, priority);
+        }
+}
+
+
+
+/**
+ * prelude_connection_pool_get_async_stats:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ * @stats: Pointer where to store the statistics.
+ *
+ * Retrieves statistics about messages sent through
+ * prelude_connection_pool_broadcast_async() to @pool, cumulated
+ * over the queues of its connections.
+ */
+void prelude_connection_pool_get_async_stats(prelude_connection_pool_t *pool, prelude_async_stats_t *stats)
+{
+        cnx_t *cnx;
+        cnx_list_t *clist;
+        prelude_async_stats_t cstats;
+
+        prelude_return_if_fail(pool);
+        prelude_return_if_fail(stats);
+
+        gl_recursive_lock_lock(pool->mutex);
+
+        *stats = pool->async_stats;
+
+        for ( clist = pool->or_list; clist != NULL; clist = clist->or ) {
+                for ( cnx = clist->and; cnx != NULL; cnx = cnx->and ) {
+                        if ( ! cnx->async_queue )
+                                continue;
+
+                        prelude_async_queue_get_stats(cnx->async_queue, &cstats);
+                        async_stats_add(stats, &cstats);
+                }
+        }
+
+        gl_recursive_lock_unlock(pool->mutex);
 }
 
 
@@ -959,6 +2790,8 @@ int prelude_connection_pool_init(prelude_connection_pool_t *pool)
 
         if ( pool->connection_string_changed ) {
                 pool->connection_string_changed = FALSE;
+
+                replay_stop(&pool->replay);
                 connection_list_destroy(pool->or_list);
 
                 pool->nfd = 0;
@@ -975,6 +2808,7 @@ int prelude_connection_pool_init(prelude_connection_pool_t *pool)
                         if ( prelude_connection_is_alive(cnx->cnx) )
                                 continue;
 
+                        set_wanted_features(cnx);
                         ret = prelude_connection_connect(cnx->cnx, clist->parent->client_profile, clist->parent->permission);
                         if ( ret < 0 ) {
                                 if ( prelude_error_get_code(ret) == PRELUDE_ERROR_PROFILE )
@@ -987,7 +2821,12 @@ int prelude_connection_pool_init(prelude_connection_pool_t *pool)
 
                         else if ( prelude_connection_is_alive(cnx->cnx) ) {
                                 event |= PRELUDE_CONNECTION_POOL_EVENT_DEAD;
-                                set_state_alive(cnx, FALSE);
+
+                                ret = set_state_alive(cnx, FALSE);
+                                if ( ret < 0 ) {
+                                        set_state_dead(cnx, ret, TRUE, FALSE);
+                                        ret = 0;
+                                }
                         }
                 }
 
@@ -1000,7 +2839,10 @@ int prelude_connection_pool_init(prelude_connection_pool_t *pool)
         if ( ret < 0 )
                 prelude_log(PRELUDE_LOG_WARN, "Can't contact configured Manager - Enabling failsafe mode.\n");
 
-        if ( pool->wanted_event & PRELUDE_CONNECTION_POOL_EVENT_INPUT ) {
+        /*
+         * Acknowledgements have to be read even if nobody is interested in input.
+         */
+        if ( pool->wanted_event & PRELUDE_CONNECTION_POOL_EVENT_INPUT || pool->flags & PRELUDE_CONNECTION_POOL_FLAGS_ACK ) {
                 prelude_timer_set_data(&pool->timer, pool);
                 prelude_timer_set_expire(&pool->timer, 1);
                 prelude_timer_set_callback(&pool->timer, check_for_data_cb);
@@ -1038,16 +2880,31 @@ int prelude_connection_pool_new(prelude_connection_pool_t **ret,
                 return prelude_error_from_errno(errno);
 
         FD_ZERO(&new->fds);
+        new->epfd = -1;
         new->refcount = 1;
         new->client_profile = cp;
         new->permission = permission;
         new->connection_string_changed = FALSE;
         new->flags = PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER;
+        new->batch_size = BATCH_DEFAULT_SIZE;
+        new->batch_delay = BATCH_DEFAULT_DELAY;
+        new->ack_window = ACK_DEFAULT_WINDOW;
+        new->balance = PRELUDE_CONNECTION_POOL_BALANCE_ROUND_ROBIN;
+        new->replay_rate = REPLAY_DEFAULT_RATE;
+        new->replay.pool = new;
 
         prelude_list_init(&new->all_cnx);
+        prelude_timer_init_list(&new->replay.timer);
+        prelude_list_init(&new->ready);
         prelude_timer_init_list(&new->timer);
         gl_recursive_lock_init(new->mutex);
 
+#ifdef HAVE_EPOLL_CREATE1
+        new->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if ( new->epfd < 0 )
+                prelude_log_debug(1, "epoll unavailable, using select: %s.\n", strerror(errno));
+#endif
+
         return 0;
 }
 
@@ -1070,6 +2927,7 @@ void prelude_connection_pool_destroy(prelude_connection_pool_t *pool)
         }
 
         prelude_timer_destroy(&pool->timer);
+        replay_stop(&pool->replay);
 
         if ( pool->connection_string )
                 free(pool->connection_string);
@@ -1079,6 +2937,12 @@ void prelude_connection_pool_destroy(prelude_connection_pool_t *pool)
         if ( pool->failover )
                 prelude_failover_destroy(pool->failover);
 
+        if ( pool->epfd >= 0 )
+                close(pool->epfd);
+
+        if ( pool->watch_table )
+                free(pool->watch_table);
+
         gl_recursive_lock_unlock(pool->mutex);
         gl_recursive_lock_destroy(pool->mutex);
 
@@ -1143,16 +3007,17 @@ int prelude_connection_pool_add_connection(prelude_connection_pool_t *pool, prel
                 goto out;
 
         if ( pool->initialized && ! prelude_connection_is_alive(cnx) ) {
+                set_wanted_features(*c);
                 ret = prelude_connection_connect(cnx, pool->client_profile, pool->permission);
+                if ( ret >= 0 && prelude_connection_is_alive(cnx) )
+                        ret = set_state_alive(*c, TRUE);
+
                 if ( ret < 0 )
                         set_state_dead(*c, ret, FALSE, TRUE);
-
-                else if ( prelude_connection_is_alive(cnx) )
-                        set_state_alive(*c, TRUE);
         }
 
-        if ( (*c)->parent->dead == 0 && pool->failover ) {
-                ret = failover_flush(pool->failover, (*c)->parent, NULL);
+        if ( list_is_complete((*c)->parent) && pool->failover ) {
+                ret = replay_start(&pool->replay, pool->failover, (*c)->parent, NULL);
                 if ( ret < 0 )
                         goto out;
         }
@@ -1291,7 +3156,6 @@ int prelude_connection_pool_set_connection_dead(prelude_connection_pool_t *pool,
         if ( ! prelude_connection_is_alive(cnx) )
                 goto out;
 
-        prelude_connection_set_state(cnx, 0);
         set_state_dead(c, 0, FALSE, FALSE);
 
 out:
@@ -1350,12 +3214,13 @@ out:
  * @cfgstr: Connection string.
  *
  * Sets the connection string for @pool. The connection string should be
- * in the form of : "address". Special operand like || (OR) and && (AND),
- * are also accepted: "address && address".
+ * in the form of : "address". Special operand like || (OR), && (AND) and
+ * <> (BALANCE) are also accepted: "address && address".
  *
  * Where && means that alert sent using @pool will go to both configured
- * addresses, and || means that if the left address fails, the right address
- * will be used.
+ * addresses, <> that each alert will go to one of the configured addresses
+ * (see prelude_connection_pool_set_balance()), and || means that if the left
+ * addresses fail, the right address will be used.
  *
  * prelude_connection_pool_init() should be used to initiates the connection.
  *
@@ -1417,6 +3282,213 @@ void prelude_connection_pool_set_flags(prelude_connection_pool_t *pool, prelude_
 }
 
 
+/**
+ * prelude_connection_pool_set_batch_size:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ * @size: Maximum size of a batch, in bytes.
+ *
+ * With %PRELUDE_CONNECTION_POOL_FLAGS_BATCH, messages sent to each
+ * connection of @pool are written together once they reach @size bytes.
+ * The actual limit adapts to the connection, up to @size.
+ */
+void prelude_connection_pool_set_batch_size(prelude_connection_pool_t *pool, size_t size)
+{
+        prelude_return_if_fail(pool);
+
+        gl_recursive_lock_lock(pool->mutex);
+        pool->batch_size = MAX(size, 1);
+        gl_recursive_lock_unlock(pool->mutex);
+}
+
+
+
+/**
+ * prelude_connection_pool_set_batch_delay:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ * @delay: Maximum delay, in microseconds.
+ *
+ * With %PRELUDE_CONNECTION_POOL_FLAGS_BATCH, a message sent to a connection
+ * of @pool waits at most @delay microseconds for its batch to be written.
+ * The delay is lowered to the round trip time of the connection, when known.
+ * Timers have a millisecond resolution.
+ */
+void prelude_connection_pool_set_batch_delay(prelude_connection_pool_t *pool, unsigned int delay)
+{
+        prelude_return_if_fail(pool);
+
+        gl_recursive_lock_lock(pool->mutex);
+        pool->batch_delay = delay;
+        gl_recursive_lock_unlock(pool->mutex);
+}
+
+
+
+/**
+ * prelude_connection_pool_set_ack_window:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ * @window: Maximum number of unacknowledged messages per connection.
+ *
+ * With %PRELUDE_CONNECTION_POOL_FLAGS_ACK, messages sent to a connection
+ * of @pool are kept until the peer acknowledges them, and saved to the
+ * failover if the connection dies meanwhile. With
+ * %PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER, messages exceeding @window are
+ * saved to the failover until the peer catches up. Without it, sending
+ * is not delayed: once @window is full, the oldest unacknowledged message
+ * is forgotten, and would be lost if the connection failed. These are
+ * counted by prelude_connection_pool_get_ack_dropped_msg_count().
+ *
+ * This should be called before prelude_connection_pool_init().
+ */
+void prelude_connection_pool_set_ack_window(prelude_connection_pool_t *pool, size_t window)
+{
+        prelude_return_if_fail(pool);
+
+        gl_recursive_lock_lock(pool->mutex);
+        pool->ack_window = MAX(window, 1);
+        gl_recursive_lock_unlock(pool->mutex);
+}
+
+
+
+/**
+ * prelude_connection_pool_set_balance:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ * @balance: Balancing strategy.
+ *
+ * Sets how messages are spread across the members of the lists of the
+ * connection string joined with the "<>" operator: in turn, by hash of
+ * the analyzerid so that each analyzer sticks to one member, or to the
+ * member with the least outstanding data. Dead members are skipped.
+ */
+void prelude_connection_pool_set_balance(prelude_connection_pool_t *pool, prelude_connection_pool_balance_t balance)
+{
+        prelude_return_if_fail(pool);
+
+        gl_recursive_lock_lock(pool->mutex);
+        pool->balance = balance;
+        gl_recursive_lock_unlock(pool->mutex);
+}
+
+
+
+/**
+ * prelude_connection_pool_set_replay_rate:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ * @rate: Number of messages per second.
+ *
+ * With %PRELUDE_CONNECTION_POOL_FLAGS_REPLAY, messages saved to a failover
+ * are replayed in the background at @rate messages per second once the
+ * connection is back, interleaved with live messages, instead of all at
+ * once with @pool locked.
+ *
+ * The progress of the replay is notified with
+ * %PRELUDE_CONNECTION_POOL_EVENT_REPLAY, see
+ * prelude_connection_pool_get_replay_stats().
+ */
+void prelude_connection_pool_set_replay_rate(prelude_connection_pool_t *pool, unsigned int rate)
+{
+        prelude_return_if_fail(pool);
+
+        gl_recursive_lock_lock(pool->mutex);
+        pool->replay_rate = MAX(rate, 1);
+        gl_recursive_lock_unlock(pool->mutex);
+}
+
+
+
+/**
+ * prelude_connection_pool_get_replay_stats:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ * @cnx: Pointer to a #prelude_connection_t object, or NULL.
+ * @stats: Pointer to a #prelude_connection_pool_replay_stats_t object.
+ *
+ * Retrieve the progress of the current, or last, replay of the failover
+ * of @cnx, or of the failover of @pool if @cnx is NULL. @stats is zeroed
+ * if there was no replay.
+ *
+ * Returns: 0 on success, a negative value if @cnx is not within @pool.
+ */
+int prelude_connection_pool_get_replay_stats(prelude_connection_pool_t *pool, prelude_connection_t *cnx,
+                                             prelude_connection_pool_replay_stats_t *stats)
+{
+        cnx_t *c;
+        int ret = 0;
+
+        prelude_return_val_if_fail(pool, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(stats, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        gl_recursive_lock_lock(pool->mutex);
+
+        if ( ! cnx )
+                replay_get_stats(&pool->replay, stats);
+
+        else if ( (c = search_cnx(pool, cnx)) )
+                replay_get_stats(&c->replay, stats);
+
+        else
+                ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "Connection is not within pool");
+
+        gl_recursive_lock_unlock(pool->mutex);
+
+        return ret;
+}
+
+
+
+/**
+ * prelude_connection_pool_get_unacked_msg_count:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ *
+ * Returns: the number of messages sent to the connections of @pool
+ * and waiting to be acknowledged.
+ */
+unsigned int prelude_connection_pool_get_unacked_msg_count(prelude_connection_pool_t *pool)
+{
+        cnx_t *cnx;
+        cnx_list_t *clist;
+        unsigned int count = 0;
+
+        prelude_return_val_if_fail(pool, 0);
+
+        gl_recursive_lock_lock(pool->mutex);
+
+        for ( clist = pool->or_list; clist != NULL; clist = clist->or ) {
+                for ( cnx = clist->and; cnx != NULL; cnx = cnx->and )
+                        count += cnx->ack_count;
+        }
+
+        gl_recursive_lock_unlock(pool->mutex);
+
+        return count;
+}
+
+
+
+/**
+ * prelude_connection_pool_get_ack_dropped_msg_count:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ *
+ * Without %PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER, a connection whose
+ * acknowledgement window is full forgets the oldest unacknowledged
+ * message to make room: should the connection fail, this message is lost.
+ *
+ * Returns: the number of unacknowledged messages forgotten by @pool.
+ */
+uint64_t prelude_connection_pool_get_ack_dropped_msg_count(prelude_connection_pool_t *pool)
+{
+        uint64_t count;
+
+        prelude_return_val_if_fail(pool, 0);
+
+        gl_recursive_lock_lock(pool->mutex);
+        count = pool->ack_dropped;
+        gl_recursive_lock_unlock(pool->mutex);
+
+        return count;
+}
+
+
+
 void prelude_connection_pool_set_required_permission(prelude_connection_pool_t *pool, prelude_connection_permission_t req_perm)
 {
         prelude_return_if_fail(pool);
@@ -1439,6 +3511,42 @@ prelude_connection_pool_flags_t prelude_connection_pool_get_flags(prelude_connec
 
 
 
+/**
+ * prelude_connection_pool_get_features:
+ * @pool: Pointer to a #prelude_connection_pool_t object.
+ *
+ * Messages broadcast to @pool might reach any of its connections, now
+ * or later through the failover: only the protocol extensions agreed
+ * upon with every connection can be relied upon when writing them. A
+ * connection that is not established does not support any.
+ *
+ * Returns: the #prelude_connection_feature_t supported by all the connections of @pool.
+ */
+prelude_connection_feature_t prelude_connection_pool_get_features(prelude_connection_pool_t *pool)
+{
+        cnx_t *c;
+        cnx_list_t *clist;
+        prelude_connection_feature_t features = ~0;
+
+        prelude_return_val_if_fail(pool, 0);
+
+        gl_recursive_lock_lock(pool->mutex);
+
+        if ( ! pool->or_list )
+                features = 0;
+
+        for ( clist = pool->or_list; clist != NULL; clist = clist->or ) {
+                for ( c = clist->and; c != NULL; c = c->and )
+                        features &= prelude_connection_get_features(c->cnx);
+        }
+
+        gl_recursive_lock_unlock(pool->mutex);
+
+        return features;
+}
+
+
+
 /**
  * prelude_connection_pool_check_event:
  * @pool: Pointer to a #prelude_connection_pool_t object.
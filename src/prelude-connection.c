@@ -62,6 +62,7 @@
 #include "prelude-io.h"
 #include "prelude-msg.h"
 #include "prelude-message-id.h"
+#include "prelude-extract.h"
 #include "prelude-client.h"
 #include "prelude-option.h"
 #include "prelude-list.h"
@@ -94,6 +95,14 @@ int _prelude_connection_keepalive_intvl = 0;
 
 
 
+typedef enum {
+        CONNECT_STEP_NONE,
+        CONNECT_STEP_TCP,
+        CONNECT_STEP_AUTH,
+        CONNECT_STEP_CAPABILITY
+} connect_step_t;
+
+
 struct prelude_connection {
         PRELUDE_LINKED_OBJECT;
 
@@ -114,8 +123,44 @@ struct prelude_connection {
 
         void *data;
         prelude_msg_t *msg;
+        size_t sendv_index;
+        prelude_bool_t sendv_pending;
 
         prelude_connection_state_t state;
+
+        /*
+         * Non blocking connection establishment.
+         */
+        connect_step_t connect_step;
+        tls_auth_state_t *connect_auth;
+        prelude_msg_t *connect_msg;
+        prelude_client_profile_t *connect_profile;
+        prelude_connection_permission_t connect_permission;
+
+        /*
+         * Protocol extensions agreed upon with the peer, and number of
+         * messages exchanged since the connection was established.
+         */
+        prelude_connection_feature_t features;
+        prelude_connection_feature_t wanted_features;
+        uint64_t sent_count;
+        uint64_t recv_count;
+        uint64_t acked_count;
+
+        /*
+         * String dictionary of the messages received from the peer, and
+         * dictionary the peer is known to use for the messages we send,
+         * of which it knows the tx_dict_count first entries.
+         */
+        prelude_msg_dict_t *rx_dict;
+        prelude_msg_dict_t *tx_dict;
+        uint32_t tx_dict_count;
+
+        /*
+         * Whether records encryption should be handed to the kernel
+         * once the connection is established.
+         */
+        prelude_bool_t tls_offload;
 };
 
 
@@ -248,11 +293,34 @@ static void set_inet_socket_option(int sock, struct sockaddr *sa)
 
 
 
+static int set_socket_blocking(int sock, prelude_bool_t blocking)
+{
+#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
+        int flags;
+
+        flags = fcntl(sock, F_GETFL);
+        if ( flags < 0 )
+                return prelude_error_from_errno(errno);
+
+        flags = (blocking) ? flags & ~O_NONBLOCK : flags | O_NONBLOCK;
+
+        if ( fcntl(sock, F_SETFL, flags) < 0 )
+                return prelude_error_from_errno(errno);
+#endif
+
+        return 0;
+}
+
+
+
 /*
  * Connect to the specified address in a generic manner
- * (can be Unix or Inet ).
+ * (can be Unix or Inet ), without blocking.
+ *
+ * Returns 0 if the connection completed immediately, or
+ * PRELUDE_ERROR_EAGAIN if it is in progress.
  */
-static int generic_connect(struct sockaddr *sa, socklen_t salen)
+static int generic_connect(struct sockaddr *sa, socklen_t salen, int *out)
 {
         int ret, sock;
 
@@ -274,68 +342,98 @@ static int generic_connect(struct sockaddr *sa, socklen_t salen)
         if ( sa->sa_family != AF_UNIX )
                 set_inet_socket_option(sock, sa);
 
-        ret = connect(sock, sa, salen);
+        ret = set_socket_blocking(sock, FALSE);
         if ( ret < 0 ) {
                 close(sock);
-                return prelude_error_from_errno(errno);
+                return ret;
         }
 
-        return sock;
-}
+        ret = connect(sock, sa, salen);
+        if ( ret < 0 && errno != EINPROGRESS ) {
+                ret = prelude_error_from_errno(errno);
+                close(sock);
+                return ret;
+        }
 
+        *out = sock;
 
+        return (ret < 0) ? prelude_error(PRELUDE_ERROR_EAGAIN) : 0;
+}
 
 
 
-static int handle_authentication(prelude_connection_t *cnx,
-                                 prelude_connection_permission_t reqperms, prelude_client_profile_t *cp, int crypt)
+static int check_connect_result(int sock)
 {
-        int ret;
-        prelude_string_t *gbuf, *wbuf;
+        int ret, error;
+        socklen_t len;
+        struct pollfd pfd;
 
-        ret = tls_auth_connection(cp, cnx->fd, crypt, &cnx->peer_analyzerid, &cnx->permission);
+        pfd.fd = sock;
+        pfd.events = POLLOUT;
+
+        ret = poll(&pfd, 1, 0);
         if ( ret < 0 )
-                return auth_error(cnx, reqperms, cp, ret, "%s", prelude_strerror(ret));
+                return prelude_error_from_errno(errno);
 
-        if ( (cnx->permission & reqperms) != reqperms ) {
-                ret = prelude_string_new(&gbuf);
-                if ( ret < 0 )
-                        goto err;
+        if ( ret == 0 )
+                return prelude_error(PRELUDE_ERROR_EAGAIN);
 
-                ret = prelude_string_new(&wbuf);
-                if ( ret < 0 ) {
-                        prelude_string_destroy(gbuf);
-                        goto err;
-                }
+        len = sizeof(error);
+
+        ret = getsockopt(sock, SOL_SOCKET, SO_ERROR, (void *) &error, &len);
+        if ( ret < 0 )
+                return prelude_error_from_errno(errno);
+
+        return (error) ? prelude_error_from_errno(error) : 0;
+}
 
-                prelude_connection_permission_to_string(cnx->permission, gbuf);
-                prelude_connection_permission_to_string(reqperms, wbuf);
 
-                ret = auth_error(cnx, reqperms, cp, prelude_error(PRELUDE_ERROR_PROFILE),
-                                 "Insufficient credentials: got '%s' but at least '%s' required",
-                                 prelude_string_get_string(gbuf), prelude_string_get_string(wbuf));
 
-                prelude_string_destroy(gbuf);
-                prelude_string_destroy(wbuf);
+static int check_permission(prelude_connection_t *cnx)
+{
+        int ret;
+        prelude_string_t *gbuf, *wbuf;
+        prelude_connection_permission_t reqperms = cnx->connect_permission;
+
+        if ( (cnx->permission & reqperms) == reqperms ) {
+                prelude_log(PRELUDE_LOG_INFO, "TLS authentication succeed with Prelude Manager.\n");
+                return 0;
+        }
+
+        ret = prelude_string_new(&gbuf);
+        if ( ret < 0 )
+                return ret;
 
-        err:
+        ret = prelude_string_new(&wbuf);
+        if ( ret < 0 ) {
+                prelude_string_destroy(gbuf);
                 return ret;
         }
 
-        prelude_log(PRELUDE_LOG_INFO, "TLS authentication succeed with Prelude Manager.\n");
+        prelude_connection_permission_to_string(cnx->permission, gbuf);
+        prelude_connection_permission_to_string(reqperms, wbuf);
 
-        return 0;
-}
+        ret = auth_error(cnx, reqperms, cnx->connect_profile, prelude_error(PRELUDE_ERROR_PROFILE),
+                         "Insufficient credentials: got '%s' but at least '%s' required",
+                         prelude_string_get_string(gbuf), prelude_string_get_string(wbuf));
 
+        prelude_string_destroy(gbuf);
+        prelude_string_destroy(wbuf);
 
+        return ret;
+}
 
 
 
-static int start_inet_connection(prelude_connection_t *cnx,
-                                 prelude_connection_permission_t reqperms, prelude_client_profile_t *profile)
+/*
+ * Get information about the connection,
+ * because the sensor might want to know source addr/port used.
+ */
+static int get_source_address(prelude_connection_t *cnx)
 {
+        int ret;
         socklen_t len;
-        int sock, ret, tmp;
+        char buf[512];
         union {
                 struct sockaddr sa;
 #ifdef HAVE_IPV6
@@ -347,89 +445,92 @@ static int start_inet_connection(prelude_connection_t *cnx,
 #endif
         } addr;
 
-        sock = generic_connect(cnx->sa, cnx->salen);
-        if ( sock < 0 )
-                return sock;
+        len = sizeof(addr.addr);
 
-        prelude_io_set_sys_io(cnx->fd, sock);
+        ret = getsockname(prelude_io_get_fd(cnx->fd), &addr.sa, &len);
+        if ( ret < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_SYSTEM_ERROR, "getsockname failed: %s", strerror(errno));
 
-        ret = handle_authentication(cnx, reqperms, profile, 1);
-        if ( ret < 0 ) {
-                do {
-                        tmp = prelude_io_close(cnx->fd);
-                } while ( tmp < 0 && ! prelude_io_is_error_fatal(cnx->fd, tmp) );
+        if ( inet_ntop(addr.sa.sa_family, prelude_sockaddr_get_inaddr(&addr.sa), buf, sizeof(buf)) )
+                cnx->saddr = strdup(buf);
+        else
+                cnx->saddr = NULL;
 
-                return ret;
-        }
+        cnx->sport = ntohs(ADDR_PORT(addr.addr));
 
-        /*
-         * Get information about the connection,
-         * because the sensor might want to know source addr/port used.
-         */
-        len = sizeof(addr.addr);
+        return 0;
+}
 
-        ret = getsockname(sock, &addr.sa, &len);
-        if ( ret < 0 )
-                ret = prelude_error_verbose(PRELUDE_ERROR_SYSTEM_ERROR, "getsockname failed: %s", strerror(errno));
-        else {
-                char buf[512];
 
-                if ( inet_ntop(addr.sa.sa_family, prelude_sockaddr_get_inaddr(&addr.sa), buf, sizeof(buf)) )
-                        cnx->saddr = strdup(buf);
-                else
-                        cnx->saddr = NULL;
 
-                cnx->sport = ntohs(ADDR_PORT(addr.addr));
+static void session_reset(prelude_connection_t *cnx)
+{
+        cnx->features = 0;
+        cnx->sent_count = cnx->recv_count = cnx->acked_count = 0;
+
+        /*
+         * Dictionaries do not survive the connection.
+         */
+        if ( cnx->rx_dict ) {
+                _prelude_msg_dict_destroy(cnx->rx_dict);
+                cnx->rx_dict = NULL;
         }
 
-        return ret;
+        if ( cnx->tx_dict ) {
+                _prelude_msg_dict_destroy(cnx->tx_dict);
+                cnx->tx_dict = NULL;
+        }
+
+        cnx->tx_dict_count = 0;
 }
 
 
 
-#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
-static int start_unix_connection(prelude_connection_t *cnx,
-                                 prelude_connection_permission_t reqperms, prelude_client_profile_t *profile)
+static void connect_reset(prelude_connection_t *cnx)
 {
-        int ret, sock, tmp;
-
-        sock = generic_connect(cnx->sa, cnx->salen);
-        if ( sock < 0 )
-                return sock;
+        if ( cnx->connect_auth ) {
+                tls_auth_connection_destroy(cnx->connect_auth);
+                cnx->connect_auth = NULL;
+        }
 
-        prelude_io_set_sys_io(cnx->fd, sock);
+        if ( cnx->connect_msg ) {
+                prelude_msg_destroy(cnx->connect_msg);
+                cnx->connect_msg = NULL;
+        }
 
-        ret = handle_authentication(cnx, reqperms, profile, 0);
-        if ( ret < 0 )
-                do {
-                        tmp = prelude_io_close(cnx->fd);
-                } while ( tmp < 0 && ! prelude_io_is_error_fatal(cnx->fd, tmp) );
+        if ( cnx->connect_profile ) {
+                prelude_client_profile_destroy(cnx->connect_profile);
+                cnx->connect_profile = NULL;
+        }
 
-        return ret;
+        cnx->connect_step = CONNECT_STEP_NONE;
 }
-#endif
 
 
 
-static int do_connect(prelude_connection_t *cnx,
-                      prelude_connection_permission_t reqperms, prelude_client_profile_t *profile)
+static int connect_abort(prelude_connection_t *cnx, int error)
 {
-        int ret = 0;
+        int ret;
 
-        if ( cnx->sa->sa_family != AF_UNIX ) {
-                prelude_log(PRELUDE_LOG_INFO, "Connecting to %s prelude Manager server.\n", cnx->daddr);
-                ret = start_inet_connection(cnx, reqperms, profile);
-        }
+        connect_reset(cnx);
+        session_reset(cnx);
 
-#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
-        else {
-                prelude_log(PRELUDE_LOG_INFO, "Connecting to %s (UNIX) prelude Manager server.\n",
-                            ((struct sockaddr_un *) cnx->sa)->sun_path);
-                ret = start_unix_connection(cnx, reqperms, profile);
+        /*
+         * The peer is not authenticated, there is no need for
+         * a graceful shutdown that could block.
+         */
+        shutdown(prelude_io_get_fd(cnx->fd), SHUT_RDWR);
+
+        do {
+                ret = prelude_io_close(cnx->fd);
+        } while ( ret < 0 && ! prelude_io_is_error_fatal(cnx->fd, ret) );
+
+        if ( cnx->saddr ) {
+                free(cnx->saddr);
+                cnx->saddr = NULL;
         }
-#endif
 
-        return ret;
+        return error;
 }
 
 
@@ -439,6 +540,9 @@ static int close_connection_fd(prelude_connection_t *cnx)
 {
         int ret;
 
+        if ( cnx->connect_step != CONNECT_STEP_NONE )
+                return connect_abort(cnx, 0);
+
         if ( ! (cnx->state & PRELUDE_CONNECTION_STATE_ESTABLISHED) )
                 return -1;
 
@@ -449,7 +553,10 @@ static int close_connection_fd(prelude_connection_t *cnx)
                         cnx->saddr = NULL;
                 }
 
+                cnx->sendv_index = 0;
+                cnx->sendv_pending = FALSE;
                 cnx->state &= ~PRELUDE_CONNECTION_STATE_ESTABLISHED;
+                session_reset(cnx);
         }
 
         return ret;
@@ -461,7 +568,7 @@ static int close_connection_fd_block(prelude_connection_t *cnx)
 {
         int ret;
 
-        if ( ! (cnx->state & PRELUDE_CONNECTION_STATE_ESTABLISHED) )
+        if ( cnx->connect_step == CONNECT_STEP_NONE && ! (cnx->state & PRELUDE_CONNECTION_STATE_ESTABLISHED) )
                 return -1;
 
         do {
@@ -614,6 +721,7 @@ void prelude_connection_destroy(prelude_connection_t *conn)
                 return;
 
         destroy_connection_fd(conn);
+        session_reset(conn);
 
         free(conn->daddr);
         free(conn->sa);
@@ -688,39 +796,229 @@ void prelude_connection_set_fd_nodup(prelude_connection_t *cnx, prelude_io_t *fd
 
 
 
-int prelude_connection_connect(prelude_connection_t *conn,
-                               prelude_client_profile_t *profile,
-                               prelude_connection_permission_t permission)
+/**
+ * prelude_connection_connect_resume:
+ * @conn: Pointer to a #prelude_connection_t object.
+ *
+ * Continue a connection attempt started with prelude_connection_connect_nonblock().
+ * This should be called once the connection file descriptor is ready for
+ * the operation reported by prelude_connection_connect_want_write().
+ *
+ * On error, the connection attempt is aborted.
+ *
+ * Returns: 0 once the connection is established, a #prelude_error_t with the
+ * %PRELUDE_ERROR_EAGAIN code if it is still in progress, or a negative value
+ * if an error occured.
+ */
+int prelude_connection_connect_resume(prelude_connection_t *conn)
 {
         int ret;
-        prelude_msg_t *msg;
+        uint32_t features;
+        prelude_connection_feature_t peer_features;
+
+        prelude_return_val_if_fail(conn, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(conn->connect_step != CONNECT_STEP_NONE, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        switch ( conn->connect_step ) {
+
+        case CONNECT_STEP_TCP:
+                ret = check_connect_result(prelude_io_get_fd(conn->fd));
+                if ( ret < 0 )
+                        break;
+
+                ret = tls_auth_connection_start(conn->connect_profile, conn->fd, conn->sa->sa_family != AF_UNIX,
+                                                conn->peer_analyzerid, &conn->connect_auth);
+                if ( ret < 0 ) {
+                        ret = auth_error(conn, conn->connect_permission, conn->connect_profile, ret, "%s", prelude_strerror(ret));
+                        break;
+                }
+
+                conn->connect_step = CONNECT_STEP_AUTH;
+
+                /* fall through */
+
+        case CONNECT_STEP_AUTH:
+                ret = tls_auth_connection_resume(conn->connect_auth, &conn->peer_analyzerid, &conn->permission);
+                if ( ret < 0 ) {
+                        if ( prelude_error_get_code(ret) != PRELUDE_ERROR_EAGAIN )
+                                ret = auth_error(conn, conn->connect_permission, conn->connect_profile, ret, "%s", prelude_strerror(ret));
+                        break;
+                }
+
+                peer_features = tls_auth_connection_get_peer_features(conn->connect_auth);
+                conn->features = conn->wanted_features & peer_features;
+
+                tls_auth_connection_destroy(conn->connect_auth);
+                conn->connect_auth = NULL;
+
+                ret = check_permission(conn);
+                if ( ret < 0 )
+                        break;
+
+                if ( conn->sa->sa_family != AF_UNIX ) {
+                        ret = get_source_address(conn);
+                        if ( ret < 0 )
+                                break;
+                }
+
+                ret = prelude_msg_new(&conn->connect_msg, 2, sizeof(uint32_t), PRELUDE_MSG_CONNECTION_CAPABILITY, 0);
+                if ( ret < 0 )
+                        break;
+
+                prelude_msg_set(conn->connect_msg, conn->connect_permission, 0, NULL);
+
+                /*
+                 * Only managers advertising features know about this chunk.
+                 */
+                if ( peer_features ) {
+                        features = htonl(conn->features);
+                        prelude_msg_set(conn->connect_msg, PRELUDE_MSG_CONNECTION_CAPABILITY_FEATURES, sizeof(features), &features);
+                }
+                conn->connect_step = CONNECT_STEP_CAPABILITY;
+
+                /* fall through */
+
+        case CONNECT_STEP_CAPABILITY:
+                ret = prelude_msg_write(conn->connect_msg, conn->fd);
+                if ( ret < 0 )
+                        break;
+
+                /*
+                 * Once established, the connection is used in blocking mode.
+                 */
+                ret = set_socket_blocking(prelude_io_get_fd(conn->fd), TRUE);
+                if ( ret < 0 )
+                        break;
+
+                /*
+                 * Without kernel support, GnuTLS keeps encrypting records itself.
+                 */
+                if ( conn->tls_offload && prelude_io_get_fdptr(conn->fd) ) {
+                        ret = prelude_io_set_tls_offload(conn->fd);
+                        if ( ret < 0 )
+                                prelude_log_debug(1, "%s: %s.\n", conn->daddr, prelude_strerror(ret));
+                }
+
+                /*
+                 * The peer decompresses what follows the capability message,
+                 * on top of TLS.
+                 */
+                if ( conn->features & PRELUDE_CONNECTION_FEATURE_COMPRESSION ) {
+                        ret = prelude_io_set_compression(conn->fd, PRELUDE_IO_COMPRESSION_DEFLATE);
+                        if ( ret < 0 )
+                                break;
+                }
+
+                connect_reset(conn);
+                conn->state |= PRELUDE_CONNECTION_STATE_ESTABLISHED;
+
+                return 0;
+
+        default:
+                return prelude_error(PRELUDE_ERROR_ASSERTION);
+        }
+
+        if ( prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN )
+                return ret;
+
+        return connect_abort(conn, ret);
+}
+
+
+
+/**
+ * prelude_connection_connect_want_write:
+ * @conn: Pointer to a #prelude_connection_t object.
+ *
+ * Returns: TRUE if the connection attempt in progress is waiting for the
+ * connection file descriptor to become writable, FALSE if it is waiting
+ * for it to become readable.
+ */
+prelude_bool_t prelude_connection_connect_want_write(prelude_connection_t *conn)
+{
+        prelude_return_val_if_fail(conn, FALSE);
+
+        if ( conn->connect_step == CONNECT_STEP_AUTH )
+                return tls_auth_connection_want_write(conn->connect_auth);
+
+        return (conn->connect_step != CONNECT_STEP_NONE) ? TRUE : FALSE;
+}
+
+
+
+/**
+ * prelude_connection_connect_nonblock:
+ * @conn: Pointer to a #prelude_connection_t object.
+ * @profile: The #prelude_client_profile_t to use for connection.
+ * @permission: Permission the connection should be granted.
+ *
+ * Start connecting @conn to the remote Manager, without blocking. The
+ * TCP connection, TLS handshake and authentication exchange are then
+ * driven by calling prelude_connection_connect_resume() each time the
+ * connection file descriptor becomes ready.
+ *
+ * Returns: 0 if the connection is established, a #prelude_error_t with the
+ * %PRELUDE_ERROR_EAGAIN code if it is in progress, or a negative value
+ * if an error occured.
+ */
+int prelude_connection_connect_nonblock(prelude_connection_t *conn,
+                                        prelude_client_profile_t *profile,
+                                        prelude_connection_permission_t permission)
+{
+        int ret, sock = -1;
 
         prelude_return_val_if_fail(conn, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(profile, prelude_error(PRELUDE_ERROR_ASSERTION));
 
         close_connection_fd_block(conn);
+        session_reset(conn);
 
-        ret = do_connect(conn, permission, profile);
-        if ( ret < 0 )
+        if ( conn->sa->sa_family != AF_UNIX )
+                prelude_log(PRELUDE_LOG_INFO, "Connecting to %s prelude Manager server.\n", conn->daddr);
+
+#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
+        else
+                prelude_log(PRELUDE_LOG_INFO, "Connecting to %s (UNIX) prelude Manager server.\n",
+                            ((struct sockaddr_un *) conn->sa)->sun_path);
+#endif
+
+        ret = generic_connect(conn->sa, conn->salen, &sock);
+        if ( ret < 0 && prelude_error_get_code(ret) != PRELUDE_ERROR_EAGAIN )
                 return ret;
 
-        ret = prelude_msg_new(&msg, 1, sizeof(uint8_t), PRELUDE_MSG_CONNECTION_CAPABILITY, 0);
-        if ( ret < 0 )
-                goto err;
+        prelude_io_set_sys_io(conn->fd, sock);
 
-        prelude_msg_set(msg, permission, 0, NULL);
-        ret = prelude_msg_write(msg, conn->fd);
-        prelude_msg_destroy(msg);
+        conn->connect_step = CONNECT_STEP_TCP;
+        conn->connect_permission = permission;
+        conn->connect_profile = prelude_client_profile_ref(profile);
 
         if ( ret < 0 )
-                goto err;
+                return ret;
+
+        return prelude_connection_connect_resume(conn);
+}
 
-        conn->state |= PRELUDE_CONNECTION_STATE_ESTABLISHED;
 
-        return ret;
 
- err:
-        close_connection_fd_block(conn);
+int prelude_connection_connect(prelude_connection_t *conn,
+                               prelude_client_profile_t *profile,
+                               prelude_connection_permission_t permission)
+{
+        int ret;
+        struct pollfd pfd;
+
+        ret = prelude_connection_connect_nonblock(conn, profile, permission);
+
+        while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN ) {
+                pfd.fd = prelude_io_get_fd(conn->fd);
+                pfd.events = prelude_connection_connect_want_write(conn) ? POLLOUT : POLLIN;
+
+                ret = poll(&pfd, 1, -1);
+                if ( ret < 0 && errno != EINTR )
+                        return connect_abort(conn, prelude_error_from_errno(errno));
+
+                ret = prelude_connection_connect_resume(conn);
+        }
 
         return ret;
 }
@@ -737,9 +1035,25 @@ int prelude_connection_close(prelude_connection_t *cnx)
 
 
 
+/*
+ * Get the message to send to @cnx in place of @msg, which might use
+ * strings from a dictionary the peer does not know about. The messages
+ * given to prelude_connection_sendv() have to be prepared this way.
+ */
+int _prelude_connection_prepare_msg(prelude_connection_t *cnx, prelude_msg_t *msg, prelude_msg_t **out)
+{
+        if ( cnx->features & PRELUDE_CONNECTION_FEATURE_DICTIONARY )
+                return _prelude_msg_dict_prepare(msg, &cnx->tx_dict, &cnx->tx_dict_count, out);
+
+        return _prelude_msg_expand(msg, out);
+}
+
+
+
 int prelude_connection_send(prelude_connection_t *cnx, prelude_msg_t *msg)
 {
         ssize_t ret;
+        prelude_msg_t *out;
 
         prelude_return_val_if_fail(cnx, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(msg, prelude_error(PRELUDE_ERROR_ASSERTION));
@@ -747,10 +1061,30 @@ int prelude_connection_send(prelude_connection_t *cnx, prelude_msg_t *msg)
         if ( ! (cnx->state & PRELUDE_CONNECTION_STATE_ESTABLISHED) )
                 return -1;
 
-        ret = prelude_msg_write(msg, cnx->fd);
+        ret = _prelude_connection_prepare_msg(cnx, msg, &out);
+        if ( ret < 0 )
+                return ret;
+
+        if ( out == msg ) {
+                prelude_msg_destroy(out);
+                ret = prelude_msg_write(msg, cnx->fd);
+        } else {
+                /*
+                 * The expanded copy does not outlive this call, so that
+                 * it has to be written completely.
+                 */
+                do {
+                        ret = prelude_msg_write(out, cnx->fd);
+                } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+
+                prelude_msg_destroy(out);
+        }
+
         if ( ret < 0 )
                 return ret;
 
+        cnx->sent_count++;
+
         ret = is_tcp_connection_still_established(cnx->fd);
         if ( ret < 0 )
                 return ret;
@@ -760,6 +1094,71 @@ int prelude_connection_send(prelude_connection_t *cnx, prelude_msg_t *msg)
 
 
 
+/*
+ * Send a batch of message using a single vectored write. On
+ * PRELUDE_ERROR_EAGAIN, the very same batch should be provided again
+ * so that the remaining data get written.
+ *
+ * The messages are counted as sent before being written: the peer might
+ * acknowledge them to another thread before the write returns.
+ */
+int prelude_connection_sendv(prelude_connection_t *cnx, prelude_msg_t **msgs, size_t count)
+{
+        ssize_t ret;
+
+        prelude_return_val_if_fail(cnx, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(msgs || count == 0, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        if ( ! (cnx->state & PRELUDE_CONNECTION_STATE_ESTABLISHED) )
+                return -1;
+
+        if ( ! cnx->sendv_pending ) {
+                cnx->sent_count += count;
+                cnx->sendv_pending = TRUE;
+        }
+
+        ret = prelude_msg_writev(msgs, count, cnx->fd, &cnx->sendv_index);
+        if ( ret < 0 )
+                return ret;
+
+        cnx->sendv_pending = FALSE;
+
+        return is_tcp_connection_still_established(cnx->fd);
+}
+
+
+
+static int read_ack(prelude_connection_t *cnx, prelude_msg_t *msg)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+        uint64_t count;
+
+        while ( (ret = prelude_msg_get(msg, &tag, &len, &buf)) == 0 ) {
+                if ( tag != PRELUDE_MSG_ACK_COUNT )
+                        continue;
+
+                ret = prelude_extract_uint64_safe(&count, buf, len);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( count > cnx->sent_count )
+                        return prelude_error_verbose(PRELUDE_ERROR_INVAL_MESSAGE, "peer acknowledged unsent messages");
+
+                cnx->acked_count = MAX(cnx->acked_count, count);
+        }
+
+        return (prelude_error_get_code(ret) == PRELUDE_ERROR_EOF) ? 0 : ret;
+}
+
+
+
+/*
+ * Acknowledgements are consumed here: PRELUDE_ERROR_EAGAIN is returned
+ * if no other message is available yet.
+ */
 int prelude_connection_recv(prelude_connection_t *cnx, prelude_msg_t **msg)
 {
         int ret;
@@ -770,11 +1169,35 @@ int prelude_connection_recv(prelude_connection_t *cnx, prelude_msg_t **msg)
         if ( ! (cnx->state & PRELUDE_CONNECTION_STATE_ESTABLISHED) )
                 return -1;
 
+ again:
         ret = prelude_msg_read(msg, cnx->fd);
         if ( ret < 0 )
                 return ret;
 
         tag = prelude_msg_get_tag(*msg);
+        if ( tag == PRELUDE_MSG_ACK ) {
+                ret = read_ack(cnx, *msg);
+
+                prelude_msg_destroy(*msg);
+                *msg = NULL;
+
+                if ( ret < 0 )
+                        return ret;
+
+                if ( prelude_io_pending(cnx->fd) > 0 )
+                        goto again;
+
+                return prelude_error(PRELUDE_ERROR_EAGAIN);
+        }
+
+        cnx->recv_count++;
+
+        if ( cnx->features & PRELUDE_CONNECTION_FEATURE_DICTIONARY ) {
+                ret = _prelude_msg_load_dict(*msg, &cnx->rx_dict);
+                if ( ret < 0 )
+                        return ret;
+        }
+
         if ( tag == PRELUDE_MSG_IDMEF && !(cnx->permission & PRELUDE_CONNECTION_PERMISSION_IDMEF_READ) )
                 return prelude_error_verbose(PRELUDE_ERROR_PROFILE,
                                              "Insufficient credentials for receiving IDMEF message");
@@ -904,6 +1327,10 @@ prelude_connection_state_t prelude_connection_get_state(prelude_connection_t *cn
 
 
 
+/*
+ * @count is expected to cover a single message, for acknowledgements
+ * to be accounted correctly.
+ */
 ssize_t prelude_connection_forward(prelude_connection_t *cnx, prelude_io_t *src, size_t count)
 {
         ssize_t ret;
@@ -918,6 +1345,8 @@ ssize_t prelude_connection_forward(prelude_connection_t *cnx, prelude_io_t *src,
         if ( ret < 0 )
                 return ret;
 
+        cnx->sent_count++;
+
         ret = is_tcp_connection_still_established(cnx->fd);
         if ( ret < 0 )
                 return ret;
@@ -964,6 +1393,155 @@ void prelude_connection_set_peer_analyzerid(prelude_connection_t *cnx, uint64_t
 
 
 
+/**
+ * prelude_connection_set_wanted_features:
+ * @cnx: Pointer to a #prelude_connection_t object.
+ * @features: Protocol extensions to use if the peer supports them.
+ *
+ * The features supported by both sides are agreed upon when @cnx is
+ * connected, see prelude_connection_get_features().
+ */
+void prelude_connection_set_wanted_features(prelude_connection_t *cnx, prelude_connection_feature_t features)
+{
+        prelude_return_if_fail(cnx);
+
+#ifndef HAVE_ZLIB
+        features &= ~PRELUDE_CONNECTION_FEATURE_COMPRESSION;
+#endif
+
+        cnx->wanted_features = features;
+}
+
+
+
+/**
+ * prelude_connection_set_features:
+ * @cnx: Pointer to a #prelude_connection_t object.
+ * @features: Protocol extensions in use on @cnx.
+ *
+ * Set the features in use on an established connection, as requested
+ * by a peer connecting to us through its capability message. With
+ * %PRELUDE_CONNECTION_FEATURE_COMPRESSION, the data following this
+ * message is compressed, see prelude_io_set_compression().
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_connection_set_features(prelude_connection_t *cnx, prelude_connection_feature_t features)
+{
+        int ret;
+
+        prelude_return_val_if_fail(cnx, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        ret = prelude_io_set_compression(cnx->fd, (features & PRELUDE_CONNECTION_FEATURE_COMPRESSION) ?
+                                         PRELUDE_IO_COMPRESSION_DEFLATE : PRELUDE_IO_COMPRESSION_NONE);
+        if ( ret < 0 )
+                return ret;
+
+        cnx->features = features;
+
+        return 0;
+}
+
+
+
+/**
+ * prelude_connection_get_features:
+ * @cnx: Pointer to a #prelude_connection_t object.
+ *
+ * Returns: the protocol extensions in use on @cnx.
+ */
+prelude_connection_feature_t prelude_connection_get_features(prelude_connection_t *cnx)
+{
+        prelude_return_val_if_fail(cnx, 0);
+        return cnx->features;
+}
+
+
+
+/**
+ * prelude_connection_send_ack:
+ * @cnx: Pointer to a #prelude_connection_t object.
+ *
+ * Acknowledge all the messages received so far on @cnx. Acknowledgements
+ * are not accounted as messages on either side.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_connection_send_ack(prelude_connection_t *cnx)
+{
+        int ret;
+        uint64_t count;
+        prelude_msg_t *msg;
+
+        prelude_return_val_if_fail(cnx, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        if ( ! (cnx->state & PRELUDE_CONNECTION_STATE_ESTABLISHED) )
+                return -1;
+
+        ret = prelude_msg_new(&msg, 1, sizeof(count), PRELUDE_MSG_ACK, 0);
+        if ( ret < 0 )
+                return ret;
+
+        count = prelude_hton64(cnx->recv_count);
+        prelude_msg_set(msg, PRELUDE_MSG_ACK_COUNT, sizeof(count), &count);
+
+        do {
+                ret = prelude_msg_write(msg, cnx->fd);
+        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+
+        prelude_msg_destroy(msg);
+
+        return ret;
+}
+
+
+
+/**
+ * prelude_connection_get_sent_count:
+ * @cnx: Pointer to a #prelude_connection_t object.
+ *
+ * Returns: the number of messages sent since @cnx was established.
+ */
+uint64_t prelude_connection_get_sent_count(prelude_connection_t *cnx)
+{
+        prelude_return_val_if_fail(cnx, 0);
+        return cnx->sent_count;
+}
+
+
+
+/**
+ * prelude_connection_get_acked_count:
+ * @cnx: Pointer to a #prelude_connection_t object.
+ *
+ * Returns: the number of messages sent since @cnx was established,
+ * and acknowledged by the peer.
+ */
+uint64_t prelude_connection_get_acked_count(prelude_connection_t *cnx)
+{
+        prelude_return_val_if_fail(cnx, 0);
+        return cnx->acked_count;
+}
+
+
+
+/**
+ * prelude_connection_set_tls_offload:
+ * @cnx: Pointer to a #prelude_connection_t object.
+ * @enabled: Whether the encryption of written records should be offloaded.
+ *
+ * When @enabled, the encryption of the records written to @cnx is handed
+ * to the kernel once the connection is established, if the kernel and the
+ * negotiated cipher support it. See prelude_io_set_tls_offload().
+ */
+void prelude_connection_set_tls_offload(prelude_connection_t *cnx, prelude_bool_t enabled)
+{
+        prelude_return_if_fail(cnx);
+        cnx->tls_offload = enabled;
+}
+
+
+
 int prelude_connection_new_msgbuf(prelude_connection_t *connection, prelude_msgbuf_t **msgbuf)
 {
         int ret;
@@ -977,6 +1555,10 @@ int prelude_connection_new_msgbuf(prelude_connection_t *connection, prelude_msgb
         prelude_msgbuf_set_data(*msgbuf, connection);
         prelude_msgbuf_set_callback(*msgbuf, connection_write_msgbuf);
 
+        if ( connection->features & PRELUDE_CONNECTION_FEATURE_COMPACT )
+                prelude_msgbuf_set_flags(*msgbuf, PRELUDE_MSGBUF_FLAGS_COMPACT |
+                                         ((connection->features & PRELUDE_CONNECTION_FEATURE_DICTIONARY) ? PRELUDE_MSGBUF_FLAGS_DICTIONARY : 0));
+
         return 0;
 }
 
@@ -1123,3 +1705,19 @@ prelude_connection_t *prelude_connection_ref(prelude_connection_t *conn)
         conn->refcount++;
         return conn;
 }
+
+
+
+/**
+ * prelude_connection_get_tls_stats:
+ * @stats: Pointer to a #prelude_connection_tls_stats_t object where to store the statistics.
+ *
+ * Retrieve the number of TLS handshakes performed by this process, how many
+ * of them resumed a previous session, and the total time they took, in
+ * microseconds.
+ */
+void prelude_connection_get_tls_stats(prelude_connection_tls_stats_t *stats)
+{
+        prelude_return_if_fail(stats);
+        tls_auth_get_stats(stats);
+}
@@ -29,30 +29,120 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <netinet/in.h>
+
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+#endif
+
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
 
 #include <assert.h>
 
 #include "glthread/thread.h"
+#include "glthread/lock.h"
 
 #include "common.h"
 #include "prelude-log.h"
 #include "prelude-io.h"
 #include "prelude-msg.h"
+#include "prelude-timer.h"
 #include "prelude-failover.h"
 
 #define PRELUDE_ERROR_SOURCE_DEFAULT PRELUDE_ERROR_SOURCE_FAILOVER
 #include "prelude-error.h"
 
 
+#ifndef MAX
+# define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#endif
+
+#ifndef MIN
+# define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#endif
+
 #define FAILOVER_CHECKSUM_SIZE       4
 #define FAILOVER_JOURNAL_ENTRY_SIZE 20
 
+#define FAILOVER_SEGMENT_PREFIX       "segment"
+#define FAILOVER_SEGMENT_LOCK         "segment.lock"
+#define FAILOVER_SEGMENT_DICT         "segment.dict"
+#define FAILOVER_SEGMENT_MAGIC        0x50534731
+#define FAILOVER_SEGMENT_MAGIC_DEFLATE 0x50535a31
+#define FAILOVER_SEGMENT_HEADER_SIZE  16
+#define FAILOVER_SEGMENT_ENTRY_SIZE   12
+#define FAILOVER_SEGMENT_MIN_SIZE     (64 * 1024)
+#define FAILOVER_MSG_HDR_SIZE         16
+
+#define FAILOVER_RECORD_HDR_SIZE      4
+#define FAILOVER_RECORD_DICT          0x80000000
+#define FAILOVER_DICT_SIZE            (32 * 1024)
+
+
+/*
+ * A segment starts with a header, followed by messages data, while the
+ * index of messages offsets grows backward from the end of the segment:
+ *
+ * | header | msg 0 | msg 1 | ... free space ... | entry 1 | entry 0 |
+ *
+ * The header rcount member holds the number of messages already replayed.
+ *
+ * In compressed segments, each message is deflated on its own, and
+ * preceded by its uncompressed length. The FAILOVER_RECORD_DICT bit of the
+ * length is set when the message was compressed using the dictionary
+ * identified by the header dict_id member.
+ */
+typedef struct {
+        uint32_t magic;
+        uint32_t size;
+        uint32_t rcount;
+        uint32_t dict_id;
+} failover_segment_header_t;
+
+
+typedef struct {
+        uint32_t offset;
+        uint32_t len;
+        uint32_t crc;
+} failover_segment_entry_t;
+
+
+typedef struct {
+        prelude_list_t list;
+
+        unsigned int seq;
+        unsigned char *map;
+        size_t size;
+
+        prelude_bool_t compressed;
+        uint32_t dict_id;
+
+        /*
+         * wpos is the end of the last message, wend the end of written data,
+         * including fragments of a message not completely written yet.
+         */
+        uint32_t wcount;
+        uint32_t wpos;
+        uint32_t wend;
+
+        /*
+         * rnext is the next message to replay, rcount the number of
+         * replayed messages that were committed.
+         */
+        uint32_t rnext;
+        uint32_t rcount;
+} failover_segment_t;
+
+
 struct prelude_failover {
         int jfd;
         prelude_io_t *wfd;
@@ -62,9 +152,82 @@ struct prelude_failover {
         uint64_t rindex;
 
         prelude_bool_t transaction_enabled;
+
+        /*
+         * Group commit: messages are appended to the batch buffer, which is
+         * written together with a single journal entry once it holds
+         * batch_max messages, or batch_delay milliseconds after it was started.
+         */
+        gl_lock_t mutex;
+        prelude_io_t *bfd;
+        prelude_timer_t timer;
+
+        unsigned char *batch;
+        size_t batch_len;
+        size_t batch_size;
+        unsigned int batch_count;
+
+        unsigned int batch_max;
+        unsigned int batch_delay;
+        prelude_failover_durability_t durability;
+
+        prelude_failover_stats_t stats;
+
+        /*
+         * Segmented store, used when segment_size is not 0.
+         */
+        char *dirname;
+        int lockfd;
+        size_t segment_size;
+        size_t total_size;
+        size_t quota;
+        uint64_t deleted;
+        unsigned int next_seq;
+
+        prelude_list_t segments;
+        prelude_list_t retired;
+
+        prelude_io_t *sfd;
+        prelude_io_t *mfd;
+        const unsigned char *mptr;
+        size_t mlen;
+        size_t mpos;
+
+        /*
+         * Compression of the segmented store: the batch buffer holds the
+         * message being compressed, using a dictionary made of the first
+         * messages saved to the store. Decompressed messages are kept in
+         * the inflated list until the next read.
+         */
+        prelude_failover_compression_t compression;
+        unsigned char *dict;
+        size_t dict_len;
+        uint32_t dict_id;
+        prelude_bool_t dict_ready;
+        prelude_list_t inflated;
+#ifdef HAVE_ZLIB
+        z_stream deflate;
+        z_stream inflate;
+        prelude_bool_t deflate_ready;
+        prelude_bool_t inflate_ready;
+#endif
+
+        /*
+         * Data files left over from the single file format, and the number
+         * of messages read from it that were not committed yet.
+         */
+        prelude_failover_t *legacy;
+        unsigned int legacy_pending;
 };
 
 
+static unsigned int default_batch_max = 1;
+static unsigned int default_batch_delay = 0;
+static prelude_failover_durability_t default_durability = PRELUDE_FAILOVER_DURABILITY_NONE;
+static size_t default_segment_size = 0;
+static prelude_failover_compression_t default_compression = PRELUDE_FAILOVER_COMPRESSION_NONE;
+
+
 typedef union {
         struct {
                 uint64_t count;
@@ -122,10 +285,53 @@ static int journal_write(prelude_failover_t *failover)
                 rcount += ret;
         } while ( ret >= 0 && rcount != sizeof(fj.data) );
 
+        failover->stats.journal_writes++;
+
         return ret;
 }
 
 
+
+static int failover_sync(prelude_failover_t *failover, int fd)
+{
+        int ret;
+
+#ifdef HAVE_FDATASYNC
+        ret = fdatasync(fd);
+#elif HAVE_FSYNC
+        ret = fsync(fd);
+#else
+        ret = 0;
+#endif
+        if ( ret < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error synchronizing failover: %s", strerror(errno));
+
+        failover->stats.syncs++;
+
+        return 0;
+}
+
+
+
+/*
+ * Make data written up to now, then the journal, durable.
+ */
+static int journal_sync(prelude_failover_t *failover)
+{
+        int ret;
+
+        ret = failover_sync(failover, prelude_io_get_fd(failover->wfd));
+        if ( ret < 0 )
+                return ret;
+
+        ret = journal_write(failover);
+        if ( ret < 0 )
+                return ret;
+
+        return failover_sync(failover, failover->jfd);
+}
+
+
 static int truncate_failover(prelude_failover_t *failover)
 {
         off_t off;
@@ -419,228 +625,1988 @@ static int get_failover_data_filename_and_fd(const char *dirname, char *filename
 }
 
 
-int prelude_failover_commit(prelude_failover_t *failover, prelude_msg_t *msg)
+
+static void batch_arm_timer(prelude_failover_t *failover)
 {
-        /*
-         * Make sure that we don't go down zero. This might happen with a message
-         * data file with more message than what the journal specified.
-         */
-        if ( failover->count > 0 )
-                failover->count--;
+        if ( ! failover->batch_delay )
+                return;
 
-        failover->rindex += prelude_msg_get_len(msg);
-        journal_write(failover);
+        prelude_timer_set_expire_ms(&failover->timer, failover->batch_delay);
+        prelude_timer_init(&failover->timer);
+}
 
-        return 0;
+
+#ifdef HAVE_MMAP
+
+static size_t get_page_size(void)
+{
+        static size_t page_size = 0;
+
+        if ( ! page_size )
+                page_size = sysconf(_SC_PAGESIZE);
+
+        return page_size;
 }
 
 
-int prelude_failover_rollback(prelude_failover_t *failover, prelude_msg_t *msg)
+
+static uint32_t segment_data_end(failover_segment_t *seg, uint32_t count)
 {
-        off_t off;
+        return seg->size - count * FAILOVER_SEGMENT_ENTRY_SIZE;
+}
 
-        off = lseek(prelude_io_get_fd(failover->rfd), - prelude_msg_get_len(msg), SEEK_CUR);
-        if ( off == (off_t) -1 )
-                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error setting failover read position: %s", strerror(errno));
 
-        return 0;
+
+static void segment_get_entry(failover_segment_t *seg, uint32_t i, failover_segment_entry_t *entry)
+{
+        memcpy(entry, seg->map + segment_data_end(seg, i + 1), sizeof(*entry));
 }
 
 
-ssize_t prelude_failover_get_saved_msg(prelude_failover_t *failover, prelude_msg_t **msg)
+
+static void segment_set_entry(failover_segment_t *seg, uint32_t i, failover_segment_entry_t *entry)
 {
-        int ret;
+        memcpy(seg->map + segment_data_end(seg, i + 1), entry, sizeof(*entry));
+}
 
-        *msg = NULL;
 
-        ret = prelude_msg_read(msg, failover->rfd);
-        if ( ret < 0 ) {
-                uint64_t bkp = failover->count;
 
-                truncate_failover(failover);
+static void segment_set_rcount(failover_segment_t *seg)
+{
+        memcpy(seg->map + offsetof(failover_segment_header_t, rcount), &seg->rcount, sizeof(seg->rcount));
+}
 
-                if ( prelude_error_get_code(ret) == PRELUDE_ERROR_EOF )
-                        return 0;
-                else
-                        return prelude_error_verbose(PRELUDE_ERROR_GENERIC,
-                                                     "%" PRELUDE_PRIu64 " messages failed to recover: %s",
-                                                     bkp, prelude_strerror(ret));
-        }
 
-        if ( ! failover->transaction_enabled )
-                prelude_failover_commit(failover, *msg);
 
-        return prelude_msg_get_len(*msg);
+static void segment_set_dict_id(failover_segment_t *seg, uint32_t dict_id)
+{
+        seg->dict_id = dict_id;
+        memcpy(seg->map + offsetof(failover_segment_header_t, dict_id), &seg->dict_id, sizeof(seg->dict_id));
 }
 
 
 
-int prelude_failover_save_msg(prelude_failover_t *failover, prelude_msg_t *msg)
+static failover_segment_t *segment_get_write(prelude_failover_t *failover)
 {
-        int ret;
-        sigset_t oldset;
+        if ( prelude_list_is_empty(&failover->segments) )
+                return NULL;
 
-        mask_signal(&oldset);
+        return prelude_list_entry(failover->segments.prev, failover_segment_t, list);
+}
 
-        do {
-                ret = prelude_msg_write(msg, failover->wfd);
-        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EINTR );
 
-        if ( ret < 0 )
-                goto error;
 
-        if ( ! prelude_msg_is_fragment(msg) ) {
-                failover->count++;
-                journal_write(failover);
-        }
+static int segment_get_filename(prelude_failover_t *failover, unsigned int seq, char *buf, size_t size)
+{
+        int ret;
 
-error:
-        unmask_signal(&oldset);
+        ret = snprintf(buf, size, "%s/" FAILOVER_SEGMENT_PREFIX "%08u", failover->dirname, seq);
+        if ( ret < 0 || (size_t) ret >= size )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "failover segment filename is too long");
 
-        return ret;
+        return 0;
 }
 
 
 
-int prelude_failover_new(prelude_failover_t **out, const char *dirname)
+/*
+ * Find the messages that were completely written: the index is only
+ * trusted up to its first entry that does not match the data.
+ */
+static void segment_scan(failover_segment_t *seg)
 {
-        mode_t mode;
-        size_t flen;
-        int ret, wfd, rfd;
-        char filename[PATH_MAX];
-        prelude_failover_t *new;
+        uint32_t i = 0, pos = FAILOVER_SEGMENT_HEADER_SIZE, min;
+        failover_segment_header_t hdr;
+        failover_segment_entry_t entry;
 
-        mode = umask(S_IRWXO);
+        memcpy(&hdr, seg->map, sizeof(hdr));
+        min = (seg->compressed) ? FAILOVER_RECORD_HDR_SIZE + 1 : FAILOVER_MSG_HDR_SIZE;
 
-        ret = mkdir(dirname, S_IRWXU|S_IRWXG);
-        if ( ret < 0 && errno != EEXIST ) {
-                umask(mode);
-                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not create directory '%s': %s", dirname, strerror(errno));
-        }
+        while ( pos <= segment_data_end(seg, i + 1) ) {
+                segment_get_entry(seg, i, &entry);
 
-        wfd = get_failover_data_filename_and_fd(dirname, filename, sizeof(filename));
-        if ( wfd < 0 ) {
-                umask(mode);
-                return wfd;
-        }
+                if ( entry.offset != pos || entry.len < min || entry.len > segment_data_end(seg, i + 1) - pos )
+                        break;
 
-#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
-        fcntl(wfd, F_SETFD, fcntl(wfd, F_GETFD) | FD_CLOEXEC);
-#endif
+                if ( prelude_crc32(seg->map + pos, entry.len) != entry.crc )
+                        break;
 
-        rfd = open(filename, O_RDONLY);
-        if ( rfd < 0 ) {
-                umask(mode);
-                close(wfd);
-                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not open '%s' for reading: %s", filename, strerror(errno));
+                pos += entry.len;
+                i++;
         }
 
-#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
-        fcntl(rfd, F_SETFD, fcntl(rfd, F_GETFD) | FD_CLOEXEC);
+        seg->wcount = i;
+        seg->wpos = seg->wend = pos;
+        seg->rcount = seg->rnext = MIN(hdr.rcount, seg->wcount);
+}
+
+
+
+static int segment_allocate(int fd, size_t size)
+{
+        int ret;
+
+#ifdef HAVE_POSIX_FALLOCATE
+        /*
+         * Reserve disk space now: running out of it while writing
+         * through the mapping would raise SIGBUS.
+         */
+        ret = posix_fallocate(fd, 0, size);
+        if ( ret == 0 )
+                return 0;
+
+        if ( ret != EINVAL && ret != EOPNOTSUPP )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error allocating failover segment: %s", strerror(ret));
 #endif
 
-        new = calloc(1, sizeof(*new));
-        if ( ! new ) {
-                umask(mode);
-                close(rfd);
-                close(wfd);
-                return prelude_error_from_errno(errno);
-        }
+        ret = ftruncate(fd, size);
+        if ( ret < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error allocating failover segment: %s", strerror(errno));
 
-        new->jfd = -1;
+        return 0;
+}
 
-        ret = prelude_io_new(&new->wfd);
-        if ( ret < 0 ) {
-                umask(mode);
-                close(rfd);
-                close(wfd);
-                free(new);
+
+
+static int segment_map(prelude_failover_t *failover, unsigned int seq, size_t size, prelude_bool_t create, failover_segment_t **out)
+{
+        int fd, ret;
+        struct stat st;
+        failover_segment_t *seg;
+        char filename[PATH_MAX];
+        failover_segment_header_t hdr;
+
+        ret = segment_get_filename(failover, seq, filename, sizeof(filename));
+        if ( ret < 0 )
                 return ret;
+
+        fd = open(filename, (create) ? O_CREAT|O_EXCL|O_RDWR : O_RDWR, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
+        if ( fd < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not open '%s': %s", filename, strerror(errno));
+
+        if ( create )
+                ret = segment_allocate(fd, size);
+        else {
+                ret = fstat(fd, &st);
+                if ( ret < 0 )
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not stat '%s': %s", filename, strerror(errno));
+
+                else if ( st.st_size < FAILOVER_SEGMENT_MIN_SIZE || (uint64_t) st.st_size > 0xffffffff )
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "invalid failover segment size");
+
+                size = st.st_size;
         }
 
-        ret = prelude_io_new(&new->rfd);
         if ( ret < 0 ) {
-                umask(mode);
-                close(rfd);
-                close(wfd);
-                free(new);
+                close(fd);
                 return ret;
         }
 
-        prelude_io_set_sys_io(new->wfd, wfd);
-        prelude_io_set_sys_io(new->rfd, rfd);
+        seg = calloc(1, sizeof(*seg));
+        if ( ! seg ) {
+                close(fd);
+                return prelude_error_from_errno(errno);
+        }
 
-        flen = strlen(filename);
+        seg->seq = seq;
+        seg->size = size;
+        seg->map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
 
-        ret = snprintf(filename + flen, sizeof(filename) - flen, ".journal");
-        if ( ret < 0 || (size_t) ret >= (sizeof(filename) - flen) ) {
-                umask(mode);
-                prelude_failover_destroy(new);
-                return -1;
+        if ( seg->map == MAP_FAILED ) {
+                free(seg);
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not map '%s': %s", filename, strerror(errno));
         }
 
-        ret = journal_initialize(new, filename);
-        if ( ret < 0 ) {
-                umask(mode);
-                prelude_failover_destroy(new);
-                return ret;
-        }
+        if ( create ) {
+                seg->compressed = (failover->compression != PRELUDE_FAILOVER_COMPRESSION_NONE);
 
-        umask(mode);
-        *out = new;
+                hdr.magic = (seg->compressed) ? FAILOVER_SEGMENT_MAGIC_DEFLATE : FAILOVER_SEGMENT_MAGIC;
+                hdr.size = size;
+                hdr.rcount = hdr.dict_id = 0;
 
-        return 0;
-}
+                memcpy(seg->map, &hdr, sizeof(hdr));
+                seg->wpos = seg->wend = FAILOVER_SEGMENT_HEADER_SIZE;
+        } else {
+                memcpy(&hdr, seg->map, sizeof(hdr));
 
+                if ( (hdr.magic != FAILOVER_SEGMENT_MAGIC && hdr.magic != FAILOVER_SEGMENT_MAGIC_DEFLATE) || hdr.size != size )
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "invalid failover segment header");
 
+#ifndef HAVE_ZLIB
+                else if ( hdr.magic == FAILOVER_SEGMENT_MAGIC_DEFLATE )
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "compressed failover segments are not supported");
+#endif
+                else if ( hdr.dict_id && (! failover->dict_ready || hdr.dict_id != failover->dict_id) )
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "failover segment compression dictionary is missing");
 
-void prelude_failover_destroy(prelude_failover_t *failover)
-{
-        close(failover->jfd);
+                if ( ret < 0 ) {
+                        munmap(seg->map, seg->size);
+                        free(seg);
+                        return ret;
+                }
 
-        if ( failover->wfd ) {
-                prelude_io_close(failover->wfd);
-                prelude_io_destroy(failover->wfd);
-        }
+                seg->compressed = (hdr.magic == FAILOVER_SEGMENT_MAGIC_DEFLATE);
+                seg->dict_id = hdr.dict_id;
 
-        if ( failover->rfd ) {
-                prelude_io_close(failover->rfd);
-                prelude_io_destroy(failover->rfd);
+                segment_scan(seg);
         }
 
-        free(failover);
+        *out = seg;
+
+        return 0;
 }
 
 
 
-void prelude_failover_set_quota(prelude_failover_t *failover, size_t limit)
+static void segment_unmap(failover_segment_t *seg)
 {
-        /* FIXME: quota */
+        munmap(seg->map, seg->size);
+        free(seg);
 }
 
 
 
-unsigned long prelude_failover_get_deleted_msg_count(prelude_failover_t *failover)
+/*
+ * The segment file is removed at once, but the mapping stays around until
+ * segment_release_retired() is called, since borrowed messages might still
+ * reference it.
+ */
+static void segment_retire(prelude_failover_t *failover, failover_segment_t *seg)
 {
-        /* FIXME: quota */
-        return 0;
-}
+        char filename[PATH_MAX];
 
+        if ( segment_get_filename(failover, seg->seq, filename, sizeof(filename)) == 0 )
+                unlink(filename);
 
+        failover->total_size -= seg->size;
 
-unsigned long prelude_failover_get_available_msg_count(prelude_failover_t *failover)
-{
-        return (unsigned long) failover->count;
+        prelude_list_del(&seg->list);
+        prelude_list_add_tail(&failover->retired, &seg->list);
 }
 
 
-void prelude_failover_enable_transaction(prelude_failover_t *failover)
+
+static void segment_release_retired(prelude_failover_t *failover)
 {
-        failover->transaction_enabled = TRUE;
+        failover_segment_t *seg;
+        prelude_list_t *tmp, *bkp;
+
+        prelude_list_for_each_safe(&failover->retired, tmp, bkp) {
+                seg = prelude_list_entry(tmp, failover_segment_t, list);
+
+                prelude_list_del(&seg->list);
+                segment_unmap(seg);
+        }
+
+        prelude_list_for_each_safe(&failover->inflated, tmp, bkp) {
+                prelude_list_del(tmp);
+                free(tmp);
+        }
 }
 
 
-void prelude_failover_disable_transaction(prelude_failover_t *failover)
+
+static int segment_sync(prelude_failover_t *failover, failover_segment_t *seg, size_t start, size_t end)
 {
-        failover->transaction_enabled = FALSE;
+        int ret;
+
+        start -= start % get_page_size();
+
+        ret = msync(seg->map + start, end - start, MS_SYNC);
+        if ( ret < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error synchronizing failover segment: %s", strerror(errno));
+
+        failover->stats.syncs++;
+
+        return 0;
+}
+
+
+
+static int segment_flush(prelude_failover_t *failover)
+{
+        int ret;
+        failover_segment_t *seg;
+
+        prelude_timer_destroy(&failover->timer);
+
+        if ( failover->batch_count == 0 )
+                return 0;
+
+        seg = segment_get_write(failover);
+        if ( ! seg ) {
+                failover->batch_count = 0;
+                return 0;
+        }
+
+        /*
+         * The batch stays pending, and is synchronized again on the next flush.
+         */
+        ret = segment_sync(failover, seg, 0, seg->size);
+        if ( ret < 0 ) {
+                batch_arm_timer(failover);
+                return ret;
+        }
+
+        failover->batch_count = 0;
+
+        return 0;
+}
+
+
+
+/*
+ * Evict the oldest segments until the store fits in the quota. Segments
+ * with messages being replayed, and the segment being written, are kept.
+ */
+static void segment_enforce_quota(prelude_failover_t *failover)
+{
+        uint32_t evicted;
+        failover_segment_t *seg;
+
+        while ( failover->quota && failover->total_size > failover->quota ) {
+                if ( prelude_list_is_empty(&failover->segments) )
+                        break;
+
+                seg = prelude_list_entry(failover->segments.next, failover_segment_t, list);
+                if ( seg == segment_get_write(failover) || seg->rnext != seg->rcount )
+                        break;
+
+                evicted = seg->wcount - seg->rcount;
+
+                failover->count -= evicted;
+                failover->deleted += evicted;
+
+                prelude_log(PRELUDE_LOG_WARN, "Failover: quota reached, %u messages deleted.\n", evicted);
+                segment_retire(failover, seg);
+        }
+}
+
+
+
+static void segment_close(prelude_failover_t *failover, failover_segment_t *seg)
+{
+        int ret;
+
+        if ( failover->durability != PRELUDE_FAILOVER_DURABILITY_NONE ) {
+                ret = segment_sync(failover, seg, 0, seg->size);
+                if ( ret < 0 )
+                        prelude_log(PRELUDE_LOG_WARN, "failover error: %s.\n", prelude_strerror(ret));
+        }
+
+        if ( seg->rcount == seg->wcount )
+                segment_retire(failover, seg);
+}
+
+
+
+static int segment_new(prelude_failover_t *failover, size_t needed, failover_segment_t **seg)
+{
+        int ret;
+        size_t size, page_size = get_page_size();
+
+        size = MAX(failover->segment_size, FAILOVER_SEGMENT_HEADER_SIZE + needed + FAILOVER_SEGMENT_ENTRY_SIZE);
+        size = (size + page_size - 1) / page_size * page_size;
+
+        ret = segment_map(failover, failover->next_seq, size, TRUE, seg);
+        if ( ret < 0 )
+                return ret;
+
+        failover->next_seq++;
+        failover->total_size += size;
+        prelude_list_add_tail(&failover->segments, &(*seg)->list);
+
+        return 0;
+}
+
+
+
+/*
+ * Make room for count more bytes of data in the segment being written.
+ * A message that doesn't fit is moved, with the fragments already
+ * written, to a new segment. So is a message written with compression
+ * settings different from the segment ones.
+ */
+static int segment_reserve(prelude_failover_t *failover, size_t count, failover_segment_t **out)
+{
+        int ret;
+        size_t partial;
+        failover_segment_t *seg, *new;
+        prelude_bool_t compressed = (failover->compression != PRELUDE_FAILOVER_COMPRESSION_NONE);
+
+        seg = segment_get_write(failover);
+
+        if ( ! seg || seg->compressed != compressed || (seg->dict_id && seg->dict_id != failover->dict_id) ||
+             seg->wend + count > segment_data_end(seg, seg->wcount + 1) ) {
+                partial = (seg) ? seg->wend - seg->wpos : 0;
+
+                ret = segment_new(failover, partial + count, &new);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( seg ) {
+                        memcpy(new->map + new->wend, seg->map + seg->wpos, partial);
+                        new->wend += partial;
+                        seg->wend = seg->wpos;
+
+                        segment_close(failover, seg);
+                }
+
+                segment_enforce_quota(failover);
+                seg = new;
+        }
+
+        *out = seg;
+
+        return 0;
+}
+
+
+
+static ssize_t segment_write(prelude_io_t *pio, const void *buf, size_t count)
+{
+        int ret;
+        failover_segment_t *seg;
+        prelude_failover_t *failover = prelude_io_get_fdptr(pio);
+
+        ret = segment_reserve(failover, count, &seg);
+        if ( ret < 0 )
+                return ret;
+
+        memcpy(seg->map + seg->wend, buf, count);
+        seg->wend += count;
+
+        return count;
+}
+
+
+
+#ifdef HAVE_ZLIB
+static int segment_get_dict_filename(prelude_failover_t *failover, const char *suffix, char *buf, size_t size)
+{
+        int ret;
+
+        ret = snprintf(buf, size, "%s/" FAILOVER_SEGMENT_DICT "%s", failover->dirname, suffix);
+        if ( ret < 0 || (size_t) ret >= size )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "failover dictionary filename is too long");
+
+        return 0;
+}
+
+
+
+/*
+ * The dictionary is written to a temporary file first, so that a crash
+ * never leaves an incomplete dictionary behind.
+ */
+static int segment_write_dict(prelude_failover_t *failover)
+{
+        int fd, ret;
+        ssize_t wret;
+        size_t wcount = 0;
+        char tmp[PATH_MAX], filename[PATH_MAX];
+
+        ret = segment_get_dict_filename(failover, ".tmp", tmp, sizeof(tmp));
+        if ( ret < 0 )
+                return ret;
+
+        ret = segment_get_dict_filename(failover, "", filename, sizeof(filename));
+        if ( ret < 0 )
+                return ret;
+
+        fd = open(tmp, O_CREAT|O_TRUNC|O_WRONLY, S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP);
+        if ( fd < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not open '%s': %s", tmp, strerror(errno));
+
+        do {
+                wret = write(fd, failover->dict + wcount, failover->dict_len - wcount);
+                if ( wret < 0 && errno == EINTR )
+                        continue;
+
+                if ( wret < 0 ) {
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error writing failover dictionary: %s", strerror(errno));
+                        close(fd);
+                        unlink(tmp);
+                        return ret;
+                }
+
+                wcount += wret;
+        } while ( wcount < failover->dict_len );
+
+        ret = failover_sync(failover, fd);
+        close(fd);
+
+        if ( ret < 0 || rename(tmp, filename) < 0 ) {
+                unlink(tmp);
+                return (ret < 0) ? ret : prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error renaming '%s': %s", tmp, strerror(errno));
+        }
+
+        return 0;
+}
+
+
+
+/*
+ * Gather the first messages saved to the store into the dictionary. Once
+ * it is full, it is written to disk and used for the following messages.
+ */
+static void segment_train_dict(prelude_failover_t *failover)
+{
+        int ret;
+        size_t len;
+
+        if ( ! failover->dict ) {
+                failover->dict = malloc(FAILOVER_DICT_SIZE);
+                if ( ! failover->dict )
+                        return;
+        }
+
+        len = MIN(failover->batch_len, FAILOVER_DICT_SIZE - failover->dict_len);
+        memcpy(failover->dict + failover->dict_len, failover->batch, len);
+
+        failover->dict_len += len;
+        if ( failover->dict_len < FAILOVER_DICT_SIZE )
+                return;
+
+        ret = segment_write_dict(failover);
+        if ( ret < 0 ) {
+                prelude_log(PRELUDE_LOG_WARN, "failover error: %s.\n", prelude_strerror(ret));
+                return;
+        }
+
+        failover->dict_id = adler32(adler32(0, NULL, 0), failover->dict, failover->dict_len);
+        failover->dict_ready = TRUE;
+}
+
+
+
+static int segment_load_dict(prelude_failover_t *failover)
+{
+        int fd, ret;
+        ssize_t rret;
+        char filename[PATH_MAX];
+
+        ret = segment_get_dict_filename(failover, "", filename, sizeof(filename));
+        if ( ret < 0 )
+                return ret;
+
+        fd = open(filename, O_RDONLY);
+        if ( fd < 0 )
+                return (errno == ENOENT) ? 0 : prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not open '%s': %s", filename, strerror(errno));
+
+        failover->dict = malloc(FAILOVER_DICT_SIZE);
+        if ( ! failover->dict ) {
+                close(fd);
+                return prelude_error_from_errno(errno);
+        }
+
+        do {
+                rret = read(fd, failover->dict + failover->dict_len, FAILOVER_DICT_SIZE - failover->dict_len);
+                if ( rret > 0 )
+                        failover->dict_len += rret;
+
+        } while ( (rret > 0 && failover->dict_len < FAILOVER_DICT_SIZE) || (rret < 0 && errno == EINTR) );
+
+        close(fd);
+
+        if ( rret < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error reading '%s': %s", filename, strerror(errno));
+
+        failover->dict_id = adler32(adler32(0, NULL, 0), failover->dict, failover->dict_len);
+        failover->dict_ready = TRUE;
+
+        return 0;
+}
+
+
+
+static void segment_discard_dict(prelude_failover_t *failover)
+{
+        char filename[PATH_MAX];
+
+        if ( segment_get_dict_filename(failover, "", filename, sizeof(filename)) == 0 )
+                unlink(filename);
+
+        failover->dict_len = 0;
+        failover->dict_id = 0;
+        failover->dict_ready = FALSE;
+}
+
+
+
+/*
+ * Compress the message gathered in the batch buffer into the segment
+ * being written.
+ */
+static int segment_deflate(prelude_failover_t *failover)
+{
+        int ret;
+        uint32_t hdr;
+        size_t bound;
+        failover_segment_t *seg;
+        z_stream *z = &failover->deflate;
+
+        if ( ! failover->deflate_ready ) {
+                ret = deflateInit2(z, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+                if ( ret != Z_OK )
+                        return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error initializing failover compression: %s", z->msg ? z->msg : "unknown error");
+
+                failover->deflate_ready = TRUE;
+        }
+
+        if ( ! failover->dict_ready )
+                segment_train_dict(failover);
+
+        deflateReset(z);
+        if ( failover->dict_ready )
+                deflateSetDictionary(z, failover->dict, failover->dict_len);
+
+        bound = deflateBound(z, failover->batch_len);
+
+        ret = segment_reserve(failover, FAILOVER_RECORD_HDR_SIZE + bound, &seg);
+        if ( ret < 0 )
+                return ret;
+
+        if ( failover->dict_ready && ! seg->dict_id )
+                segment_set_dict_id(seg, failover->dict_id);
+
+        z->next_in = failover->batch;
+        z->avail_in = failover->batch_len;
+        z->next_out = seg->map + seg->wend + FAILOVER_RECORD_HDR_SIZE;
+        z->avail_out = bound;
+
+        ret = deflate(z, Z_FINISH);
+        if ( ret != Z_STREAM_END )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error compressing failover message: %s", z->msg ? z->msg : "unknown error");
+
+        hdr = htonl(failover->batch_len | ((failover->dict_ready) ? FAILOVER_RECORD_DICT : 0));
+        memcpy(seg->map + seg->wend, &hdr, sizeof(hdr));
+
+        seg->wend += FAILOVER_RECORD_HDR_SIZE + bound - z->avail_out;
+        failover->batch_len = 0;
+
+        return 0;
+}
+
+
+
+static int segment_inflate(prelude_failover_t *failover, failover_segment_t *seg,
+                           failover_segment_entry_t *entry, unsigned char **out, uint32_t *len)
+{
+        int ret;
+        uint32_t hdr;
+        prelude_list_t *block;
+        z_stream *z = &failover->inflate;
+
+        if ( ! failover->inflate_ready ) {
+                ret = inflateInit2(z, -MAX_WBITS);
+                if ( ret != Z_OK )
+                        return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error initializing failover decompression: %s", z->msg ? z->msg : "unknown error");
+
+                failover->inflate_ready = TRUE;
+        }
+
+        memcpy(&hdr, seg->map + entry->offset, sizeof(hdr));
+        hdr = ntohl(hdr);
+
+        *len = hdr & ~FAILOVER_RECORD_DICT;
+        if ( *len < FAILOVER_MSG_HDR_SIZE )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        block = malloc(sizeof(*block) + *len);
+        if ( ! block )
+                return prelude_error_from_errno(errno);
+
+        inflateReset(z);
+        if ( hdr & FAILOVER_RECORD_DICT )
+                inflateSetDictionary(z, failover->dict, failover->dict_len);
+
+        z->next_in = seg->map + entry->offset + FAILOVER_RECORD_HDR_SIZE;
+        z->avail_in = entry->len - FAILOVER_RECORD_HDR_SIZE;
+        z->next_out = (unsigned char *) (block + 1);
+        z->avail_out = *len;
+
+        ret = inflate(z, Z_FINISH);
+        if ( ret != Z_STREAM_END || z->avail_out != 0 ) {
+                free(block);
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error decompressing failover message: %s", z->msg ? z->msg : "corrupted data");
+        }
+
+        prelude_list_add_tail(&failover->inflated, block);
+        *out = (unsigned char *) (block + 1);
+
+        return 0;
+}
+#endif
+
+
+
+static int segment_save_msg(prelude_failover_t *failover, prelude_msg_t *msg)
+{
+        int ret;
+        uint32_t start;
+        failover_segment_t *seg;
+        failover_segment_entry_t entry;
+
+        if ( failover->compression == PRELUDE_FAILOVER_COMPRESSION_NONE )
+                ret = prelude_msg_write(msg, failover->sfd);
+        else
+                ret = prelude_msg_write(msg, failover->bfd);
+
+        if ( ret < 0 || prelude_msg_is_fragment(msg) )
+                return ret;
+
+#ifdef HAVE_ZLIB
+        if ( failover->compression != PRELUDE_FAILOVER_COMPRESSION_NONE ) {
+                ret = segment_deflate(failover);
+                if ( ret < 0 ) {
+                        failover->batch_len = 0;
+                        return ret;
+                }
+        }
+#endif
+
+        seg = segment_get_write(failover);
+
+        entry.offset = start = seg->wpos;
+        entry.len = seg->wend - seg->wpos;
+        entry.crc = prelude_crc32(seg->map + seg->wpos, entry.len);
+
+        segment_set_entry(seg, seg->wcount, &entry);
+
+        seg->wpos = seg->wend;
+        seg->wcount++;
+
+        failover->count++;
+        failover->stats.journal_writes++;
+        failover->stats.stored_bytes += entry.len;
+
+        if ( failover->durability == PRELUDE_FAILOVER_DURABILITY_MESSAGE ) {
+                ret = segment_sync(failover, seg, start, seg->wpos);
+                if ( ret < 0 )
+                        return ret;
+
+                return segment_sync(failover, seg, segment_data_end(seg, seg->wcount), seg->size);
+        }
+
+        if ( failover->durability == PRELUDE_FAILOVER_DURABILITY_BATCH ) {
+                if ( ++failover->batch_count >= failover->batch_max )
+                        return segment_flush(failover);
+
+                if ( failover->batch_count == 1 )
+                        batch_arm_timer(failover);
+        }
+
+        return 0;
+}
+
+
+
+static prelude_bool_t segment_next(prelude_failover_t *failover, failover_segment_t **seg, failover_segment_entry_t *entry)
+{
+        prelude_list_t *tmp;
+
+        prelude_list_for_each(&failover->segments, tmp) {
+                *seg = prelude_list_entry(tmp, failover_segment_t, list);
+
+                if ( (*seg)->rnext < (*seg)->wcount ) {
+                        segment_get_entry(*seg, (*seg)->rnext, entry);
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+
+
+static void segment_commit(prelude_failover_t *failover)
+{
+        prelude_list_t *tmp;
+        failover_segment_t *seg;
+
+        prelude_list_for_each(&failover->segments, tmp) {
+                seg = prelude_list_entry(tmp, failover_segment_t, list);
+
+                if ( seg->rcount == seg->rnext )
+                        continue;
+
+                seg->rcount++;
+                segment_set_rcount(seg);
+
+                if ( failover->count > 0 )
+                        failover->count--;
+
+                if ( seg->rcount == seg->wcount && seg != segment_get_write(failover) )
+                        segment_retire(failover, seg);
+
+                return;
+        }
+}
+
+
+
+static void segment_rollback(prelude_failover_t *failover)
+{
+        prelude_list_t *tmp;
+        failover_segment_t *seg;
+
+        prelude_list_for_each_reversed(&failover->segments, tmp) {
+                seg = prelude_list_entry(tmp, failover_segment_t, list);
+
+                if ( seg->rnext > seg->rcount ) {
+                        seg->rnext--;
+                        return;
+                }
+        }
+}
+
+
+
+static ssize_t segment_read(prelude_io_t *pio, void *buf, size_t count)
+{
+        prelude_failover_t *failover = prelude_io_get_fdptr(pio);
+
+        if ( failover->mpos == failover->mlen )
+                return prelude_error(PRELUDE_ERROR_EOF);
+
+        count = MIN(count, failover->mlen - failover->mpos);
+
+        memcpy(buf, failover->mptr + failover->mpos, count);
+        failover->mpos += count;
+
+        return count;
+}
+
+
+
+/*
+ * Read the next message, either as a copy, reassembled from its
+ * fragments, or referencing the segment mapping.
+ */
+static ssize_t segment_get_saved_msg(prelude_failover_t *failover, prelude_msg_t **msg, prelude_bool_t borrowed)
+{
+        int ret;
+        uint32_t len;
+        unsigned char *data;
+        failover_segment_t *seg;
+        failover_segment_entry_t entry;
+
+        if ( ! segment_next(failover, &seg, &entry) )
+                return 0;
+
+        seg->rnext++;
+
+        data = seg->map + entry.offset;
+        len = entry.len;
+
+#ifdef HAVE_ZLIB
+        if ( seg->compressed ) {
+                ret = segment_inflate(failover, seg, &entry, &data, &len);
+                if ( ret < 0 )
+                        goto error;
+        }
+#endif
+
+        if ( borrowed )
+                ret = _prelude_msg_new_borrowed(msg, data, len);
+        else {
+                failover->mptr = data;
+                failover->mlen = len;
+                failover->mpos = 0;
+
+                ret = prelude_msg_read(msg, failover->mfd);
+        }
+
+        if ( ret < 0 )
+                goto error;
+
+        if ( ! failover->transaction_enabled )
+                segment_commit(failover);
+
+        return len;
+
+error:
+        segment_commit(failover);
+        return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "failover message could not be recovered: %s", prelude_strerror(ret));
+}
+
+
+
+static int segment_cmp(const void *a, const void *b)
+{
+        unsigned int sa = *(const unsigned int *) a, sb = *(const unsigned int *) b;
+
+        return (sa > sb) - (sa < sb);
+}
+
+
+
+static prelude_bool_t is_legacy_data_file(const char *dirname, const char *name)
+{
+        int ret;
+        struct stat st;
+        char filename[PATH_MAX];
+
+        if ( strlen(name) <= 4 || ! isdigit(name[4]) )
+                return FALSE;
+
+        if ( strncmp(name, "data", 4) != 0 || strchr(name, '.') )
+                return FALSE;
+
+        ret = snprintf(filename, sizeof(filename), "%s/%s", dirname, name);
+        if ( ret < 0 || (size_t) ret >= sizeof(filename) )
+                return FALSE;
+
+        return (stat(filename, &st) == 0 && st.st_size > 0) ? TRUE : FALSE;
+}
+
+
+
+/*
+ * Map the existing segments, in order. Messages left in data
+ * files from the single file format are replayed first.
+ */
+static int segment_load(prelude_failover_t *failover, prelude_bool_t *legacy)
+{
+        DIR *dir;
+        int ret = 0;
+        struct dirent *de;
+        failover_segment_t *seg;
+        char filename[PATH_MAX];
+        size_t i, count = 0, size = 0;
+        unsigned int *seqs = NULL, *ptr;
+        const size_t plen = strlen(FAILOVER_SEGMENT_PREFIX);
+
+        *legacy = FALSE;
+
+#ifdef HAVE_ZLIB
+        ret = segment_load_dict(failover);
+        if ( ret < 0 )
+                return ret;
+#endif
+
+        dir = opendir(failover->dirname);
+        if ( ! dir )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error opening '%s': %s", failover->dirname, strerror(errno));
+
+        while ( (de = readdir(dir)) ) {
+                if ( is_legacy_data_file(failover->dirname, de->d_name) )
+                        *legacy = TRUE;
+
+                if ( strncmp(de->d_name, FAILOVER_SEGMENT_PREFIX, plen) != 0 || strlen(de->d_name + plen) != 8 ||
+                     strspn(de->d_name + plen, "0123456789") != 8 )
+                        continue;
+
+                if ( count == size ) {
+                        size = MAX(size * 2, 16);
+
+                        ptr = _prelude_realloc(seqs, size * sizeof(*seqs));
+                        if ( ! ptr ) {
+                                ret = prelude_error_from_errno(errno);
+                                goto out;
+                        }
+
+                        seqs = ptr;
+                }
+
+                seqs[count++] = strtoul(de->d_name + plen, NULL, 10);
+        }
+
+        qsort(seqs, count, sizeof(*seqs), segment_cmp);
+
+        for ( i = 0; i < count; i++ ) {
+                failover->next_seq = seqs[i] + 1;
+
+                ret = segment_map(failover, seqs[i], 0, FALSE, &seg);
+                if ( ret < 0 ) {
+                        prelude_log(PRELUDE_LOG_WARN, "Failover: removing invalid segment %08u: %s.\n", seqs[i], prelude_strerror(ret));
+
+                        if ( segment_get_filename(failover, seqs[i], filename, sizeof(filename)) == 0 )
+                                unlink(filename);
+
+                        continue;
+                }
+
+                failover->count += seg->wcount - seg->rcount;
+                failover->total_size += seg->size;
+                prelude_list_add_tail(&failover->segments, &seg->list);
+
+                if ( seg->rcount == seg->wcount )
+                        segment_retire(failover, seg);
+        }
+
+#ifdef HAVE_ZLIB
+        /*
+         * Nothing uses the dictionary anymore: train a new one, that will
+         * better match the messages to come.
+         */
+        if ( failover->dict_ready && prelude_list_is_empty(&failover->segments) )
+                segment_discard_dict(failover);
+#endif
+
+        ret = 0;
+
+out:
+        free(seqs);
+        closedir(dir);
+
+        return ret;
+}
+
+
+
+static void segment_destroy(prelude_failover_t *failover)
+{
+        int ret;
+        failover_segment_t *seg;
+        prelude_list_t *tmp, *bkp;
+
+        ret = segment_flush(failover);
+        if ( ret < 0 )
+                prelude_log(PRELUDE_LOG_WARN, "failover error: %s.\n", prelude_strerror(ret));
+
+        segment_release_retired(failover);
+
+        prelude_list_for_each_safe(&failover->segments, tmp, bkp) {
+                seg = prelude_list_entry(tmp, failover_segment_t, list);
+
+                prelude_list_del(&seg->list);
+                segment_unmap(seg);
+        }
+
+        if ( failover->lockfd >= 0 )
+                close(failover->lockfd);
+
+        if ( failover->legacy )
+                prelude_failover_destroy(failover->legacy);
+
+        if ( failover->sfd )
+                prelude_io_destroy(failover->sfd);
+
+        if ( failover->mfd )
+                prelude_io_destroy(failover->mfd);
+
+#ifdef HAVE_ZLIB
+        if ( failover->deflate_ready )
+                deflateEnd(&failover->deflate);
+
+        if ( failover->inflate_ready )
+                inflateEnd(&failover->inflate);
+#endif
+
+        free(failover->dict);
+        free(failover->dirname);
+}
+
+#endif
+
+
+static ssize_t batch_write(prelude_io_t *pio, const void *buf, size_t count)
+{
+        size_t size;
+        unsigned char *ptr;
+        prelude_failover_t *failover = prelude_io_get_fdptr(pio);
+
+        if ( failover->batch_len + count > failover->batch_size ) {
+                size = MAX(failover->batch_size * 2, failover->batch_len + count);
+
+                ptr = _prelude_realloc(failover->batch, size);
+                if ( ! ptr )
+                        return prelude_error_from_errno(errno);
+
+                failover->batch = ptr;
+                failover->batch_size = size;
+        }
+
+        memcpy(failover->batch + failover->batch_len, buf, count);
+        failover->batch_len += count;
+
+        return count;
+}
+
+
+
+/*
+ * Write the batch to the failover file. On error, the partially written
+ * batch is truncated from the file, and kept to be written again by the
+ * next flush.
+ */
+static int batch_flush(prelude_failover_t *failover)
+{
+        int fd;
+        struct stat st;
+        ssize_t ret = 0;
+        size_t wcount = 0;
+        sigset_t oldset;
+
+#ifdef HAVE_MMAP
+        if ( failover->segment_size )
+                return segment_flush(failover);
+#endif
+
+        if ( failover->batch_len == 0 )
+                return 0;
+
+        prelude_timer_destroy(&failover->timer);
+
+        fd = prelude_io_get_fd(failover->wfd);
+        if ( fstat(fd, &st) < 0 ) {
+                batch_arm_timer(failover);
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error getting failover size: %s", strerror(errno));
+        }
+
+        mask_signal(&oldset);
+
+        do {
+                ret = write(fd, failover->batch + wcount, failover->batch_len - wcount);
+                if ( ret < 0 && errno == EINTR )
+                        continue;
+
+                if ( ret < 0 ) {
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error writing failover data: %s", strerror(errno));
+                        break;
+                }
+
+                wcount += ret;
+        } while ( wcount != failover->batch_len );
+
+        if ( ret < 0 ) {
+                if ( wcount && ftruncate(fd, st.st_size) < 0 )
+                        prelude_log(PRELUDE_LOG_ERR, "error truncating failover: %s.\n", strerror(errno));
+
+                unmask_signal(&oldset);
+                batch_arm_timer(failover);
+
+                return ret;
+        }
+
+        failover->count += failover->batch_count;
+
+        if ( failover->durability == PRELUDE_FAILOVER_DURABILITY_NONE )
+                ret = journal_write(failover);
+        else
+                ret = journal_sync(failover);
+
+        unmask_signal(&oldset);
+
+        failover->batch_len = 0;
+        failover->batch_count = 0;
+
+        return (ret < 0) ? ret : 0;
+}
+
+
+
+static void batch_timer_cb(void *data)
+{
+        int ret;
+        prelude_failover_t *failover = data;
+
+        gl_lock_lock(failover->mutex);
+
+        ret = batch_flush(failover);
+        if ( ret < 0 )
+                prelude_log(PRELUDE_LOG_WARN, "failover error: %s.\n", prelude_strerror(ret));
+
+        gl_lock_unlock(failover->mutex);
+}
+
+
+
+static int batch_save_msg(prelude_failover_t *failover, prelude_msg_t *msg)
+{
+        int ret;
+
+        ret = prelude_msg_write(msg, failover->bfd);
+        if ( ret < 0 )
+                return ret;
+
+        if ( prelude_msg_is_fragment(msg) )
+                return 0;
+
+        failover->batch_count++;
+
+        if ( failover->batch_count >= failover->batch_max )
+                return batch_flush(failover);
+
+        if ( failover->batch_count == 1 )
+                batch_arm_timer(failover);
+
+        return 0;
+}
+
+
+
+static int failover_commit(prelude_failover_t *failover, prelude_msg_t *msg)
+{
+        if ( failover->legacy_pending ) {
+                failover->legacy_pending--;
+                return prelude_failover_commit(failover->legacy, msg);
+        }
+
+#ifdef HAVE_MMAP
+        if ( failover->segment_size ) {
+                segment_commit(failover);
+                return 0;
+        }
+#endif
+
+        /*
+         * Make sure that we don't go down zero. This might happen with a message
+         * data file with more message than what the journal specified.
+         */
+        if ( failover->count > 0 )
+                failover->count--;
+
+        failover->rindex += prelude_msg_get_len(msg);
+        journal_write(failover);
+
+        return 0;
+}
+
+
+
+int prelude_failover_commit(prelude_failover_t *failover, prelude_msg_t *msg)
+{
+        int ret;
+
+        gl_lock_lock(failover->mutex);
+        ret = failover_commit(failover, msg);
+        gl_lock_unlock(failover->mutex);
+
+        return ret;
+}
+
+
+int prelude_failover_rollback(prelude_failover_t *failover, prelude_msg_t *msg)
+{
+        off_t off;
+        int ret = 0;
+
+        gl_lock_lock(failover->mutex);
+
+        if ( failover->legacy_pending ) {
+                failover->legacy_pending--;
+                ret = prelude_failover_rollback(failover->legacy, msg);
+        }
+
+#ifdef HAVE_MMAP
+        else if ( failover->segment_size )
+                segment_rollback(failover);
+#endif
+
+        else {
+                off = lseek(prelude_io_get_fd(failover->rfd), - prelude_msg_get_len(msg), SEEK_CUR);
+                if ( off == (off_t) -1 )
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "error setting failover read position: %s", strerror(errno));
+        }
+
+        gl_lock_unlock(failover->mutex);
+
+        return ret;
+}
+
+
+
+/*
+ * Read messages left in the single file format store first, and get rid
+ * of it once it is empty.
+ */
+static ssize_t legacy_get_saved_msg(prelude_failover_t *failover, prelude_msg_t **msg)
+{
+        ssize_t ret;
+
+        if ( failover->transaction_enabled )
+                prelude_failover_enable_transaction(failover->legacy);
+        else
+                prelude_failover_disable_transaction(failover->legacy);
+
+        ret = prelude_failover_get_saved_msg(failover->legacy, msg);
+        if ( ret > 0 && failover->transaction_enabled )
+                failover->legacy_pending++;
+
+        else if ( ret == 0 && ! failover->legacy_pending ) {
+                prelude_failover_destroy(failover->legacy);
+                failover->legacy = NULL;
+        }
+
+        return ret;
+}
+
+
+
+static ssize_t failover_get_saved_msg(prelude_failover_t *failover, prelude_msg_t **msg, prelude_bool_t borrowed)
+{
+        int ret;
+
+        *msg = NULL;
+
+        if ( failover->legacy ) {
+                ret = legacy_get_saved_msg(failover, msg);
+                if ( ret != 0 )
+                        return ret;
+        }
+
+#ifdef HAVE_MMAP
+        if ( failover->segment_size )
+                return segment_get_saved_msg(failover, msg, borrowed);
+#endif
+
+        ret = batch_flush(failover);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_msg_read(msg, failover->rfd);
+        if ( ret < 0 ) {
+                uint64_t bkp = failover->count;
+
+                truncate_failover(failover);
+
+                if ( prelude_error_get_code(ret) == PRELUDE_ERROR_EOF )
+                        return 0;
+                else
+                        return prelude_error_verbose(PRELUDE_ERROR_GENERIC,
+                                                     "%" PRELUDE_PRIu64 " messages failed to recover: %s",
+                                                     bkp, prelude_strerror(ret));
+        }
+
+        if ( ! failover->transaction_enabled )
+                failover_commit(failover, *msg);
+
+        return prelude_msg_get_len(*msg);
+}
+
+
+
+ssize_t prelude_failover_get_saved_msg(prelude_failover_t *failover, prelude_msg_t **msg)
+{
+        ssize_t ret;
+
+        gl_lock_lock(failover->mutex);
+
+#ifdef HAVE_MMAP
+        segment_release_retired(failover);
+#endif
+        ret = failover_get_saved_msg(failover, msg, FALSE);
+
+        gl_lock_unlock(failover->mutex);
+
+        return ret;
+}
+
+
+
+/**
+ * prelude_failover_get_saved_msgs:
+ * @failover: Pointer to a #prelude_failover_t object.
+ * @msgs: Array where to store the read #prelude_msg_t objects.
+ * @count: Maximum number of messages to read.
+ *
+ * Read up to @count messages from @failover, so that they can be forwarded
+ * together. With the segmented store (see prelude_failover_set_default_segment_size()),
+ * messages reference the segment data without copying it: they are meant to
+ * be forwarded as is, and should be destroyed before @failover is accessed again.
+ *
+ * Returns: the number of messages read, 0 if there is none left, or a negative value if an error occured.
+ */
+ssize_t prelude_failover_get_saved_msgs(prelude_failover_t *failover, prelude_msg_t **msgs, size_t count)
+{
+        size_t i;
+        ssize_t ret = 0;
+
+        gl_lock_lock(failover->mutex);
+
+#ifdef HAVE_MMAP
+        segment_release_retired(failover);
+#endif
+
+        for ( i = 0; i < count; i++ ) {
+                ret = failover_get_saved_msg(failover, &msgs[i], TRUE);
+                if ( ret <= 0 )
+                        break;
+        }
+
+        gl_lock_unlock(failover->mutex);
+
+        if ( ret < 0 && i == 0 )
+                return ret;
+
+        return i;
+}
+
+
+
+int prelude_failover_save_msg(prelude_failover_t *failover, prelude_msg_t *msg)
+{
+        int ret;
+        sigset_t oldset;
+
+        gl_lock_lock(failover->mutex);
+
+        if ( ! prelude_msg_is_fragment(msg) ) {
+                failover->stats.saved_msg++;
+                failover->stats.saved_bytes += prelude_msg_get_len(msg);
+        }
+
+#ifdef HAVE_MMAP
+        if ( failover->segment_size ) {
+                ret = segment_save_msg(failover, msg);
+                gl_lock_unlock(failover->mutex);
+                return ret;
+        }
+#endif
+
+        if ( failover->batch_max > 1 && failover->durability != PRELUDE_FAILOVER_DURABILITY_MESSAGE ) {
+                ret = batch_save_msg(failover, msg);
+                if ( ret >= 0 )
+                        failover->stats.stored_bytes += prelude_msg_get_len(msg);
+
+                gl_lock_unlock(failover->mutex);
+                return ret;
+        }
+
+        mask_signal(&oldset);
+
+        do {
+                ret = prelude_msg_write(msg, failover->wfd);
+        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EINTR );
+
+        if ( ret < 0 )
+                goto error;
+
+        failover->stats.stored_bytes += prelude_msg_get_len(msg);
+
+        if ( ! prelude_msg_is_fragment(msg) ) {
+                failover->count++;
+
+                if ( failover->durability == PRELUDE_FAILOVER_DURABILITY_NONE )
+                        journal_write(failover);
+                else
+                        ret = journal_sync(failover);
+        }
+
+error:
+        unmask_signal(&oldset);
+        gl_lock_unlock(failover->mutex);
+
+        return ret;
+}
+
+
+
+static int failover_alloc(prelude_failover_t **out)
+{
+        prelude_failover_t *new;
+
+        new = calloc(1, sizeof(*new));
+        if ( ! new )
+                return prelude_error_from_errno(errno);
+
+        new->jfd = -1;
+        new->lockfd = -1;
+        new->batch_max = default_batch_max;
+        new->batch_delay = default_batch_delay;
+        new->durability = default_durability;
+
+        gl_lock_init(new->mutex);
+
+        prelude_list_init(&new->segments);
+        prelude_list_init(&new->retired);
+        prelude_list_init(&new->inflated);
+
+        prelude_timer_init_list(&new->timer);
+        prelude_timer_set_data(&new->timer, new);
+        prelude_timer_set_callback(&new->timer, batch_timer_cb);
+
+        *out = new;
+
+        return 0;
+}
+
+
+
+static int failover_new_single(prelude_failover_t **out, const char *dirname)
+{
+        mode_t mode;
+        size_t flen;
+        int ret, wfd, rfd;
+        char filename[PATH_MAX];
+        prelude_failover_t *new;
+
+        mode = umask(S_IRWXO);
+
+        ret = mkdir(dirname, S_IRWXU|S_IRWXG);
+        if ( ret < 0 && errno != EEXIST ) {
+                umask(mode);
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not create directory '%s': %s", dirname, strerror(errno));
+        }
+
+        wfd = get_failover_data_filename_and_fd(dirname, filename, sizeof(filename));
+        if ( wfd < 0 ) {
+                umask(mode);
+                return wfd;
+        }
+
+#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
+        fcntl(wfd, F_SETFD, fcntl(wfd, F_GETFD) | FD_CLOEXEC);
+#endif
+
+        rfd = open(filename, O_RDONLY);
+        if ( rfd < 0 ) {
+                umask(mode);
+                close(wfd);
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not open '%s' for reading: %s", filename, strerror(errno));
+        }
+
+#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
+        fcntl(rfd, F_SETFD, fcntl(rfd, F_GETFD) | FD_CLOEXEC);
+#endif
+
+        ret = failover_alloc(&new);
+        if ( ret < 0 ) {
+                umask(mode);
+                close(rfd);
+                close(wfd);
+                return ret;
+        }
+
+        ret = prelude_io_new(&new->wfd);
+        if ( ret < 0 ) {
+                umask(mode);
+                close(rfd);
+                close(wfd);
+                free(new);
+                return ret;
+        }
+
+        ret = prelude_io_new(&new->rfd);
+        if ( ret < 0 ) {
+                umask(mode);
+                close(rfd);
+                close(wfd);
+                free(new);
+                return ret;
+        }
+
+        prelude_io_set_sys_io(new->wfd, wfd);
+        prelude_io_set_sys_io(new->rfd, rfd);
+
+        ret = prelude_io_new(&new->bfd);
+        if ( ret < 0 ) {
+                umask(mode);
+                prelude_failover_destroy(new);
+                return ret;
+        }
+
+        prelude_io_set_fdptr(new->bfd, new);
+        prelude_io_set_write_callback(new->bfd, batch_write);
+
+        flen = strlen(filename);
+
+        ret = snprintf(filename + flen, sizeof(filename) - flen, ".journal");
+        if ( ret < 0 || (size_t) ret >= (sizeof(filename) - flen) ) {
+                umask(mode);
+                prelude_failover_destroy(new);
+                return -1;
+        }
+
+        ret = journal_initialize(new, filename);
+        if ( ret < 0 ) {
+                umask(mode);
+                prelude_failover_destroy(new);
+                return ret;
+        }
+
+        umask(mode);
+        *out = new;
+
+        return 0;
+}
+
+
+
+#ifdef HAVE_MMAP
+static int failover_new_segmented(prelude_failover_t **out, const char *dirname)
+{
+        int ret;
+        mode_t mode;
+        prelude_bool_t legacy;
+        char filename[PATH_MAX];
+        prelude_failover_t *new;
+
+        mode = umask(S_IRWXO);
+
+        ret = mkdir(dirname, S_IRWXU|S_IRWXG);
+        if ( ret < 0 && errno != EEXIST ) {
+                umask(mode);
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not create directory '%s': %s", dirname, strerror(errno));
+        }
+
+        ret = failover_alloc(&new);
+        if ( ret < 0 ) {
+                umask(mode);
+                return ret;
+        }
+
+        new->segment_size = MAX(default_segment_size, FAILOVER_SEGMENT_MIN_SIZE);
+
+        new->dirname = strdup(dirname);
+        if ( ! new->dirname ) {
+                ret = prelude_error_from_errno(errno);
+                goto error;
+        }
+
+        ret = snprintf(filename, sizeof(filename), "%s/%s", dirname, FAILOVER_SEGMENT_LOCK);
+        if ( ret < 0 || (size_t) ret >= sizeof(filename) ) {
+                ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "failover segment filename is too long");
+                goto error;
+        }
+
+        ret = open_exclusive(filename, O_CREAT|O_RDWR, &new->lockfd);
+        if ( ret <= 0 ) {
+                new->lockfd = -1;
+                if ( ret == 0 )
+                        ret = prelude_error_verbose(PRELUDE_ERROR_GENERIC, "failover '%s' is already in use", dirname);
+                goto error;
+        }
+
+#if !((defined _WIN32 || defined __WIN32__) && !defined __CYGWIN__)
+        fcntl(new->lockfd, F_SETFD, fcntl(new->lockfd, F_GETFD) | FD_CLOEXEC);
+#endif
+
+        ret = prelude_io_new(&new->sfd);
+        if ( ret < 0 )
+                goto error;
+
+        prelude_io_set_fdptr(new->sfd, new);
+        prelude_io_set_write_callback(new->sfd, segment_write);
+
+        ret = prelude_io_new(&new->mfd);
+        if ( ret < 0 )
+                goto error;
+
+        prelude_io_set_fdptr(new->mfd, new);
+        prelude_io_set_read_callback(new->mfd, segment_read);
+
+        new->compression = default_compression;
+        if ( new->compression != PRELUDE_FAILOVER_COMPRESSION_NONE ) {
+                ret = prelude_io_new(&new->bfd);
+                if ( ret < 0 )
+                        goto error;
+
+                prelude_io_set_fdptr(new->bfd, new);
+                prelude_io_set_write_callback(new->bfd, batch_write);
+        }
+
+        ret = segment_load(new, &legacy);
+        if ( ret < 0 )
+                goto error;
+
+        if ( legacy ) {
+                ret = failover_new_single(&new->legacy, dirname);
+                if ( ret < 0 )
+                        goto error;
+        }
+
+        umask(mode);
+        *out = new;
+
+        return 0;
+
+error:
+        umask(mode);
+        prelude_failover_destroy(new);
+
+        return ret;
+}
+#endif
+
+
+
+int prelude_failover_new(prelude_failover_t **out, const char *dirname)
+{
+#ifdef HAVE_MMAP
+        if ( default_segment_size )
+                return failover_new_segmented(out, dirname);
+#endif
+
+        return failover_new_single(out, dirname);
+}
+
+
+
+void prelude_failover_destroy(prelude_failover_t *failover)
+{
+        int ret;
+
+#ifdef HAVE_MMAP
+        if ( failover->segment_size )
+                segment_destroy(failover);
+#endif
+
+        if ( failover->bfd ) {
+                ret = batch_flush(failover);
+                if ( ret < 0 )
+                        prelude_log(PRELUDE_LOG_WARN, "failover error: %s.\n", prelude_strerror(ret));
+
+                prelude_io_destroy(failover->bfd);
+        }
+
+        prelude_timer_destroy(&failover->timer);
+
+        if ( failover->jfd >= 0 )
+                close(failover->jfd);
+
+        if ( failover->wfd ) {
+                prelude_io_close(failover->wfd);
+                prelude_io_destroy(failover->wfd);
+        }
+
+        if ( failover->rfd ) {
+                prelude_io_close(failover->rfd);
+                prelude_io_destroy(failover->rfd);
+        }
+
+        if ( failover->batch )
+                free(failover->batch);
+
+        gl_lock_destroy(failover->mutex);
+        free(failover);
+}
+
+
+
+/**
+ * prelude_failover_set_quota:
+ * @failover: Pointer to a #prelude_failover_t object.
+ * @limit: Maximum number of bytes used by @failover, 0 for no limit.
+ *
+ * With the segmented store, the oldest segments are deleted, together with
+ * the messages they hold, once @failover uses more than @limit bytes.
+ * The single file store does not support quota.
+ */
+void prelude_failover_set_quota(prelude_failover_t *failover, size_t limit)
+{
+        gl_lock_lock(failover->mutex);
+
+        failover->quota = limit;
+#ifdef HAVE_MMAP
+        if ( failover->segment_size )
+                segment_enforce_quota(failover);
+#endif
+
+        gl_lock_unlock(failover->mutex);
+}
+
+
+
+unsigned long prelude_failover_get_deleted_msg_count(prelude_failover_t *failover)
+{
+        unsigned long count;
+
+        gl_lock_lock(failover->mutex);
+        count = (unsigned long) failover->deleted;
+        gl_lock_unlock(failover->mutex);
+
+        return count;
+}
+
+
+
+unsigned long prelude_failover_get_available_msg_count(prelude_failover_t *failover)
+{
+        unsigned long count;
+
+        gl_lock_lock(failover->mutex);
+
+        count = (unsigned long) (failover->count + failover->batch_count);
+        if ( failover->segment_size )
+                count = (unsigned long) failover->count;
+
+        if ( failover->legacy )
+                count += prelude_failover_get_available_msg_count(failover->legacy);
+
+        gl_lock_unlock(failover->mutex);
+
+        return count;
+}
+
+
+void prelude_failover_enable_transaction(prelude_failover_t *failover)
+{
+        failover->transaction_enabled = TRUE;
+}
+
+
+void prelude_failover_disable_transaction(prelude_failover_t *failover)
+{
+        failover->transaction_enabled = FALSE;
+}
+
+
+
+/**
+ * prelude_failover_set_group_commit:
+ * @failover: Pointer to a #prelude_failover_t object.
+ * @max_msg: Maximum number of messages written with a single journal entry.
+ * @max_delay: Maximum number of milliseconds a message is kept before being written, 0 for no limit.
+ *
+ * Enable group commit when @max_msg is higher than 1: saved messages are
+ * written to disk by batch of @max_msg messages, or once @max_delay
+ * milliseconds elapsed since the first message of the batch was saved,
+ * with a single journal update per batch.
+ *
+ * Messages from a batch not yet written are lost if the process crashes.
+ * When writing a batch fails, prelude_failover_save_msg() returns the error,
+ * and the batch is kept to be written again with the next flush.
+ */
+void prelude_failover_set_group_commit(prelude_failover_t *failover, unsigned int max_msg, unsigned int max_delay)
+{
+        gl_lock_lock(failover->mutex);
+
+        batch_flush(failover);
+
+        failover->batch_max = max_msg;
+        failover->batch_delay = max_delay;
+
+        gl_lock_unlock(failover->mutex);
+}
+
+
+
+/**
+ * prelude_failover_set_durability:
+ * @failover: Pointer to a #prelude_failover_t object.
+ * @durability: Durability level.
+ *
+ * Set whether written messages should be synchronized to disk:
+ * #PRELUDE_FAILOVER_DURABILITY_NONE leaves this to the operating system,
+ * #PRELUDE_FAILOVER_DURABILITY_BATCH synchronizes data and journal once per
+ * batch, and #PRELUDE_FAILOVER_DURABILITY_MESSAGE once per message, which
+ * disables group commit.
+ */
+void prelude_failover_set_durability(prelude_failover_t *failover, prelude_failover_durability_t durability)
+{
+        gl_lock_lock(failover->mutex);
+
+        batch_flush(failover);
+        failover->durability = durability;
+
+        gl_lock_unlock(failover->mutex);
+}
+
+
+
+/**
+ * prelude_failover_flush:
+ * @failover: Pointer to a #prelude_failover_t object.
+ *
+ * Write messages from the current batch to disk.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_failover_flush(prelude_failover_t *failover)
+{
+        int ret;
+
+        gl_lock_lock(failover->mutex);
+        ret = batch_flush(failover);
+        gl_lock_unlock(failover->mutex);
+
+        return ret;
+}
+
+
+
+/**
+ * prelude_failover_get_stats:
+ * @failover: Pointer to a #prelude_failover_t object.
+ * @stats: Pointer to a #prelude_failover_stats_t object where to store the statistics.
+ *
+ * Retrieve the number of messages and bytes saved to @failover, the number of
+ * bytes actually stored once compressed, and the number of journal updates and
+ * disk synchronizations this required.
+ */
+void prelude_failover_get_stats(prelude_failover_t *failover, prelude_failover_stats_t *stats)
+{
+        gl_lock_lock(failover->mutex);
+        *stats = failover->stats;
+        gl_lock_unlock(failover->mutex);
+}
+
+
+
+/**
+ * prelude_failover_set_default_group_commit:
+ * @max_msg: Maximum number of messages written with a single journal entry.
+ * @max_delay: Maximum number of milliseconds a message is kept before being written.
+ *
+ * Set the group commit parameters of failovers created afterward,
+ * see prelude_failover_set_group_commit().
+ */
+void prelude_failover_set_default_group_commit(unsigned int max_msg, unsigned int max_delay)
+{
+        default_batch_max = max_msg;
+        default_batch_delay = max_delay;
+}
+
+
+
+/**
+ * prelude_failover_set_default_durability:
+ * @durability: Durability level.
+ *
+ * Set the durability level of failovers created afterward,
+ * see prelude_failover_set_durability().
+ */
+void prelude_failover_set_default_durability(prelude_failover_durability_t durability)
+{
+        default_durability = durability;
+}
+
+
+
+/**
+ * prelude_failover_set_default_segment_size:
+ * @size: Size of segment files in bytes, or 0.
+ *
+ * Failovers created afterward store messages in memory mapped segment
+ * files of @size bytes, instead of a single data file and its journal.
+ * Segments are deleted once all their messages were replayed, and replayed
+ * messages are read straight from the mapping. Messages left in the single
+ * file format are replayed first.
+ *
+ * This is not available on systems without mmap(), where @size is ignored.
+ */
+void prelude_failover_set_default_segment_size(size_t size)
+{
+        default_segment_size = size;
+}
+
+
+
+/**
+ * prelude_failover_set_default_compression:
+ * @compression: Compression method.
+ *
+ * Failovers using the segmented store (see prelude_failover_set_default_segment_size()),
+ * created afterward, compress the messages they save using @compression.
+ * Each message is compressed on its own, with a dictionary made of the first
+ * messages saved to the store, so that replaying a message never requires
+ * decompressing others.
+ *
+ * Returns: 0 on success, or a negative value if @compression is not available.
+ */
+int prelude_failover_set_default_compression(prelude_failover_compression_t compression)
+{
+#if !defined(HAVE_MMAP) || !defined(HAVE_ZLIB)
+        if ( compression != PRELUDE_FAILOVER_COMPRESSION_NONE )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "failover compression is not available");
+#endif
+
+        default_compression = compression;
+
+        return 0;
 }
@@ -31,7 +31,11 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 #include <gnutls/gnutls.h>
 
 #include "prelude-inttypes.h"
@@ -40,6 +44,27 @@
 # include <sys/filio.h>
 #endif
 
+#ifdef HAVE_NETINET_TCP_H
+# include <netinet/tcp.h>
+#endif
+
+#ifdef HAVE_LINUX_TLS_H
+# include <linux/tls.h>
+#endif
+
+#if defined(HAVE_LINUX_TLS_H) && defined(HAVE_GNUTLS_RECORD_GET_STATE) && defined(TCP_ULP) && defined(SOL_TLS)
+# define HAVE_TLS_OFFLOAD
+#endif
+
+#ifdef HAVE_ZLIB
+# include <time.h>
+# define ZLIB_CONST
+# include <zlib.h>
+# ifndef z_const
+#  define z_const
+# endif
+#endif
+
 
 #include "prelude-log.h"
 #include "prelude-io.h"
@@ -51,11 +76,16 @@
 
 
 #define CHUNK_SIZE 1024
+#define FORWARD_BUFFER_SIZE (64 * 1024)
+#define COMPRESS_BUFFER_SIZE (16 * 1024)
+#define COMPRESS_PLAIN_SIZE (64 * 1024)
 
 #ifndef MIN
 # define MIN(x, y) ((x) < (y) ? (x) : (y))
 #endif
 
+typedef struct io_compress io_compress_t;
+
 struct prelude_io {
 
         int fd;
@@ -67,11 +97,61 @@ struct prelude_io {
         int (*close)(prelude_io_t *pio);
         ssize_t (*read)(prelude_io_t *pio, void *buf, size_t count);
         ssize_t (*write)(prelude_io_t *pio, const void *buf, size_t count);
+        ssize_t (*writev)(prelude_io_t *pio, const struct iovec *iov, int iovcnt);
         ssize_t (*pending)(prelude_io_t *pio);
+
+        prelude_io_stats_t stats;
+
+        /*
+         * Forwarded data not written yet, waiting either in the pipe used
+         * for splicing, or in the copy buffer.
+         */
+        int pipe[2];
+        size_t pipe_len;
+        size_t pipe_size;
+
+        unsigned char *fwd_buf;
+        size_t fwd_len;
+
+        /*
+         * Compression layer, on top of the functions above.
+         */
+        io_compress_t *compress;
 };
 
 
 
+/*
+ * Generic vectored write, used by backends that have no native
+ * scatter/gather primitive: the vector is flushed one buffer at a time
+ * through the object write callback, stopping on the first short write.
+ */
+static ssize_t generic_writev(prelude_io_t *pio, const struct iovec *iov, int iovcnt)
+{
+        int i;
+        ssize_t ret;
+        size_t total = 0;
+
+        for ( i = 0; i < iovcnt; i++ ) {
+                if ( iov[i].iov_len == 0 )
+                        continue;
+
+                ret = pio->write(pio, iov[i].iov_base, iov[i].iov_len);
+                pio->stats.write_syscalls++;
+
+                if ( ret < 0 )
+                        return (total > 0) ? (ssize_t) total : ret;
+
+                total += ret;
+                if ( (size_t) ret != iov[i].iov_len )
+                        break;
+        }
+
+        return total;
+}
+
+
+
 /*
  * Buffer IO functions.
  */
@@ -175,6 +255,24 @@ static ssize_t sys_write(prelude_io_t *pio, const void *buf, size_t count)
 
 
 
+static ssize_t sys_writev(prelude_io_t *pio, const struct iovec *iov, int iovcnt)
+{
+        ssize_t ret;
+
+        do {
+                ret = writev(pio->fd, iov, iovcnt);
+        } while ( ret < 0 && errno == EINTR );
+
+        pio->stats.write_syscalls++;
+
+        if ( ret < 0 )
+                return prelude_error_from_errno(errno);
+
+        return ret;
+}
+
+
+
 static int sys_close(prelude_io_t *pio)
 {
         int ret;
@@ -337,96 +435,959 @@ static ssize_t tls_read(prelude_io_t *pio, void *buf, size_t count)
 
 
 
+#ifdef HAVE_GNUTLS_RECORD_CORK
+/*
+ * Cork the session so that the whole vector is packed into as few TLS
+ * records as possible, then push everything in one go.
+ *
+ * Data GnuTLS could not push without blocking stays corked, and is not
+ * reported as written. As with gnutls_record_send(), the caller is then
+ * expected to call us again with the same data first: that much of it
+ * is skipped, since it is pushed from the corked buffer.
+ */
+static ssize_t tls_writev(prelude_io_t *pio, const struct iovec *iov, int iovcnt)
+{
+        int i;
+        ssize_t ret = 0;
+        size_t len, skip, total;
+
+        skip = total = gnutls_record_check_corked(pio->fd_ptr);
+
+        gnutls_record_cork(pio->fd_ptr);
+
+        for ( i = 0; i < iovcnt; i++ ) {
+                if ( iov[i].iov_len <= skip ) {
+                        skip -= iov[i].iov_len;
+                        continue;
+                }
+
+                len = iov[i].iov_len - skip;
+
+                ret = gnutls_record_send(pio->fd_ptr, (const char *) iov[i].iov_base + skip, len);
+                if ( ret < 0 )
+                        break;
+
+                total += len;
+                skip = 0;
+        }
+
+        /*
+         * Report a failure right away only when nothing was buffered,
+         * the rest of the vector fails again on the next call otherwise.
+         */
+        if ( ret < 0 && total == 0 ) {
+                gnutls_record_uncork(pio->fd_ptr, 0);
+                return tls_check_error(pio, ret);
+        }
+
+        do {
+                ret = gnutls_record_uncork(pio->fd_ptr, 0);
+        } while ( ret == GNUTLS_E_INTERRUPTED );
+
+        pio->stats.write_syscalls++;
+
+        if ( ret == GNUTLS_E_AGAIN ) {
+                total -= gnutls_record_check_corked(pio->fd_ptr);
+                return (total > 0) ? (ssize_t) total : tls_check_error(pio, ret);
+        }
+
+        if ( ret < 0 )
+                return tls_check_error(pio, ret);
+
+        return total;
+}
+#endif
+
+
+
 static ssize_t tls_write(prelude_io_t *pio, const void *buf, size_t count)
 {
         ssize_t ret;
 
+#ifdef HAVE_GNUTLS_RECORD_CORK
+        /*
+         * Data from an incomplete tls_writev() is still corked.
+         */
+        if ( gnutls_record_check_corked(pio->fd_ptr) > 0 ) {
+                struct iovec iov;
+                union {
+                        void *rw;
+                        const void *ro;
+                } data;
+
+                data.ro = buf;
+
+                iov.iov_base = data.rw;
+                iov.iov_len = count;
+
+                return tls_writev(pio, &iov, 1);
+        }
+#endif
+
         do {
                 ret = gnutls_record_send(pio->fd_ptr, buf, count);
         } while ( ret < 0 && ret == GNUTLS_E_INTERRUPTED );
 
-        if ( ret < 0 )
-                return tls_check_error(pio, ret);
+        if ( ret < 0 )
+                return tls_check_error(pio, ret);
+
+        return ret;
+}
+
+
+
+static int tls_close(prelude_io_t *pio)
+{
+        int ret;
+
+        do {
+                ret = gnutls_bye(pio->fd_ptr, GNUTLS_SHUT_RDWR);
+        } while ( ret < 0 && ret == GNUTLS_E_INTERRUPTED );
+
+        if ( ret < 0 ) {
+                ret = tls_check_error(pio, ret);
+                if ( prelude_io_is_error_fatal(pio, ret) )
+                        sys_close(pio);
+
+                return ret;
+        }
+
+        gnutls_deinit(pio->fd_ptr);
+
+        /*
+         * this is not expected to fail
+         */
+        prelude_io_set_sys_io(pio, pio->fd);
+        return sys_close(pio);
+}
+
+
+
+static ssize_t tls_pending(prelude_io_t *pio)
+{
+        ssize_t ret;
+
+        ret = gnutls_record_check_pending(pio->fd_ptr);
+        if ( ret > 0 )
+                return ret;
+
+        ret = sys_pending(pio);
+        if ( ret > 0 )
+                return ret;
+
+        return 0;
+}
+
+
+
+#ifdef HAVE_TLS_OFFLOAD
+/*
+ * Kernel TLS offload: once the write state of the session is handed over
+ * to the kernel, records are encrypted by the socket itself, and writes
+ * are plain system writes. Reads still go through GnuTLS, which keeps
+ * handling control records.
+ */
+typedef union {
+        struct tls12_crypto_info_aes_gcm_128 aes128;
+        struct tls12_crypto_info_aes_gcm_256 aes256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+        struct tls12_crypto_info_chacha20_poly1305 chacha20;
+#endif
+} tls_offload_info_t;
+
+
+/*
+ * With AES-GCM, the first bytes of the IV are the salt. The remaining
+ * ones are the TLS 1.3 nonce, while TLS 1.2 uses the record sequence
+ * number as explicit nonce.
+ */
+#define tls_offload_set_gcm(gcm, cipher, tlsversion, ivdata, keydata, seqdata) do {                        \
+        (gcm).info.version = (tlsversion);                                                                 \
+        (gcm).info.cipher_type = (cipher);                                                                 \
+        memcpy((gcm).salt, (ivdata)->data, sizeof((gcm).salt));                                            \
+        if ( (tlsversion) == TLS_1_3_VERSION )                                                             \
+                memcpy((gcm).iv, (unsigned char *) (ivdata)->data + sizeof((gcm).salt), sizeof((gcm).iv)); \
+        else                                                                                               \
+                memcpy((gcm).iv, (seqdata), sizeof((gcm).iv));                                             \
+        memcpy((gcm).key, (keydata)->data, sizeof((gcm).key));                                             \
+        memcpy((gcm).rec_seq, (seqdata), sizeof((gcm).rec_seq));                                           \
+} while (0)
+
+
+static int tls_offload_get_info(gnutls_session_t session, tls_offload_info_t *info, socklen_t *len)
+{
+        int ret;
+        uint16_t version;
+        size_t keylen, ivlen;
+        unsigned char seq[8];
+        gnutls_datum_t mac, iv, key;
+        gnutls_cipher_algorithm_t cipher;
+
+        if ( gnutls_protocol_get_version(session) == GNUTLS_TLS1_2 )
+                version = TLS_1_2_VERSION;
+
+        else if ( gnutls_protocol_get_version(session) == GNUTLS_TLS1_3 )
+                version = TLS_1_3_VERSION;
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_TLS, "TLS offload is not supported with %s",
+                                             gnutls_protocol_get_name(gnutls_protocol_get_version(session)));
+
+        ret = gnutls_record_get_state(session, 0, &mac, &iv, &key, seq);
+        if ( ret < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_TLS, "TLS: %s", gnutls_strerror(ret));
+
+        memset(info, 0, sizeof(*info));
+        cipher = gnutls_cipher_get(session);
+
+        if ( cipher == GNUTLS_CIPHER_AES_128_GCM ) {
+                keylen = sizeof(info->aes128.key);
+                ivlen = sizeof(info->aes128.salt) + ((version == TLS_1_3_VERSION) ? sizeof(info->aes128.iv) : 0);
+                *len = sizeof(info->aes128);
+        }
+
+        else if ( cipher == GNUTLS_CIPHER_AES_256_GCM ) {
+                keylen = sizeof(info->aes256.key);
+                ivlen = sizeof(info->aes256.salt) + ((version == TLS_1_3_VERSION) ? sizeof(info->aes256.iv) : 0);
+                *len = sizeof(info->aes256);
+        }
+
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+        else if ( cipher == GNUTLS_CIPHER_CHACHA20_POLY1305 ) {
+                keylen = sizeof(info->chacha20.key);
+                ivlen = sizeof(info->chacha20.iv);
+                *len = sizeof(info->chacha20);
+        }
+#endif
+
+        else
+                return prelude_error_verbose(PRELUDE_ERROR_TLS, "TLS offload is not supported with %s", gnutls_cipher_get_name(cipher));
+
+        if ( key.size != keylen || iv.size < ivlen )
+                return prelude_error_verbose(PRELUDE_ERROR_TLS, "unexpected %s record state", gnutls_cipher_get_name(cipher));
+
+        if ( cipher == GNUTLS_CIPHER_AES_128_GCM )
+                tls_offload_set_gcm(info->aes128, TLS_CIPHER_AES_GCM_128, version, &iv, &key, seq);
+
+        else if ( cipher == GNUTLS_CIPHER_AES_256_GCM )
+                tls_offload_set_gcm(info->aes256, TLS_CIPHER_AES_GCM_256, version, &iv, &key, seq);
+
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+        else {
+                info->chacha20.info.version = version;
+                info->chacha20.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+                memcpy(info->chacha20.iv, iv.data, sizeof(info->chacha20.iv));
+                memcpy(info->chacha20.key, key.data, sizeof(info->chacha20.key));
+                memcpy(info->chacha20.rec_seq, seq, sizeof(info->chacha20.rec_seq));
+        }
+#endif
+
+        return 0;
+}
+
+
+
+/*
+ * Records GnuTLS would still write itself (a TLS 1.3 key update, for
+ * example) would use a state it no longer owns: fail them, so that the
+ * connection is closed rather than corrupted.
+ */
+static ssize_t tls_offload_push(gnutls_transport_ptr_t ptr, const void *buf, size_t count)
+{
+        errno = EIO;
+        return -1;
+}
+
+
+
+/*
+ * GnuTLS can't send the closure alert anymore: the kernel does it,
+ * as a record of the alert type.
+ */
+static int tls_offload_close(prelude_io_t *pio)
+{
+        struct iovec iov;
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+        unsigned char alert[2] = { GNUTLS_AL_WARNING, GNUTLS_A_CLOSE_NOTIFY };
+        union {
+                struct cmsghdr align;
+                char buf[CMSG_SPACE(sizeof(unsigned char))];
+        } control;
+
+        iov.iov_base = alert;
+        iov.iov_len = sizeof(alert);
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_TLS;
+        cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+        *CMSG_DATA(cmsg) = 21; /* alert */
+
+        sendmsg(pio->fd, &msg, MSG_DONTWAIT);
+
+        gnutls_deinit(pio->fd_ptr);
+        prelude_io_set_sys_io(pio, pio->fd);
+
+        return sys_close(pio);
+}
+#endif
+
+
+
+#ifdef HAVE_ZLIB
+/*
+ * Compression layer: data written to the object is deflated before being
+ * handed to the backend (system, file, TLS...) functions, and data read
+ * from them is inflated. Every write ends with a flush, so that the peer
+ * can decode a message as soon as it is written. The compression history
+ * is kept from one write to the next, so that data repeated across
+ * messages compresses well.
+ */
+struct io_compress {
+        prelude_io_compression_t algo;
+
+        z_stream deflate;
+        z_stream inflate;
+
+        /*
+         * Compressed data not written yet, and the number of bytes it
+         * stands for.
+         */
+        unsigned char *out;
+        size_t out_size;
+        size_t out_len;
+        size_t out_index;
+        size_t out_count;
+
+        /*
+         * Inflated data not read yet. more is set if the inflate
+         * stream might hold more.
+         */
+        unsigned char plain[COMPRESS_PLAIN_SIZE];
+        size_t plain_len;
+        size_t plain_index;
+        prelude_bool_t more;
+
+        unsigned char in[COMPRESS_BUFFER_SIZE];
+};
+
+
+
+static uint64_t get_cpu_usec(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+        struct timespec ts;
+
+        if ( clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0 )
+                return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+
+        return 0;
+}
+
+
+
+static void compress_destroy(prelude_io_t *pio)
+{
+        io_compress_t *c = pio->compress;
+
+        deflateEnd(&c->deflate);
+        inflateEnd(&c->inflate);
+
+        free(c->out);
+        free(c);
+
+        pio->compress = NULL;
+}
+
+
+
+static int compress_new(prelude_io_t *pio, prelude_io_compression_t algo)
+{
+        int ret;
+        io_compress_t *c;
+
+        c = calloc(1, sizeof(*c));
+        if ( ! c )
+                return prelude_error_from_errno(errno);
+
+        c->algo = algo;
+
+        ret = deflateInit2(&c->deflate, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        if ( ret != Z_OK ) {
+                free(c);
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not initialize deflate stream: %s", zError(ret));
+        }
+
+        ret = inflateInit2(&c->inflate, -MAX_WBITS);
+        if ( ret != Z_OK ) {
+                deflateEnd(&c->deflate);
+                free(c);
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "could not initialize inflate stream: %s", zError(ret));
+        }
+
+        pio->compress = c;
+
+        return 0;
+}
+
+
+
+static int compress_deflate(io_compress_t *c, const void *buf, size_t count, int flush)
+{
+        int ret;
+        unsigned char *new;
+        z_stream *z = &c->deflate;
+
+        z->next_in = (z_const Bytef *) buf;
+        z->avail_in = count;
+
+        do {
+                if ( c->out_len == c->out_size ) {
+                        new = _prelude_realloc(c->out, c->out_size + COMPRESS_BUFFER_SIZE);
+                        if ( ! new )
+                                return prelude_error_from_errno(errno);
+
+                        c->out = new;
+                        c->out_size += COMPRESS_BUFFER_SIZE;
+                }
+
+                z->next_out = c->out + c->out_len;
+                z->avail_out = c->out_size - c->out_len;
+
+                ret = deflate(z, flush);
+                if ( ret != Z_OK && ret != Z_BUF_ERROR )
+                        return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "deflate error: %s", zError(ret));
+
+                c->out_len = c->out_size - z->avail_out;
+
+        } while ( z->avail_in || z->avail_out == 0 );
+
+        return 0;
+}
+
+
+
+/*
+ * The data is compressed at once, then written through the backend. On
+ * PRELUDE_ERROR_EAGAIN, the same data should be provided again, the same
+ * way it is with TLS: the remaining compressed data is then written, and
+ * the data size returned.
+ */
+static ssize_t compress_writev(prelude_io_t *pio, const struct iovec *iov, int iovcnt)
+{
+        int i;
+        ssize_t ret;
+        uint64_t start;
+        size_t count = 0;
+        io_compress_t *c = pio->compress;
+
+        if ( ! c->out_len ) {
+                start = get_cpu_usec();
+
+                for ( i = 0; i < iovcnt; i++ ) {
+                        if ( ! iov[i].iov_len )
+                                continue;
+
+                        ret = compress_deflate(c, iov[i].iov_base, iov[i].iov_len, Z_NO_FLUSH);
+                        if ( ret < 0 )
+                                return ret;
+
+                        count += iov[i].iov_len;
+                }
+
+                if ( count ) {
+                        ret = compress_deflate(c, NULL, 0, Z_SYNC_FLUSH);
+                        if ( ret < 0 )
+                                return ret;
+                }
+
+                pio->stats.compression_usec += get_cpu_usec() - start;
+                c->out_count = count;
+        }
+
+        while ( c->out_index < c->out_len ) {
+                ret = pio->write(pio, c->out + c->out_index, c->out_len - c->out_index);
+                if ( ret < 0 )
+                        return ret;
+
+                c->out_index += ret;
+                pio->stats.compressed_write_bytes += ret;
+        }
+
+        c->out_len = c->out_index = 0;
+
+        return c->out_count;
+}
+
+
+
+static ssize_t compress_write(prelude_io_t *pio, const void *buf, size_t count)
+{
+        struct iovec iov;
+        union {
+                void *rw;
+                const void *ro;
+        } data;
+
+        data.ro = buf;
+
+        iov.iov_base = data.rw;
+        iov.iov_len = count;
+
+        return compress_writev(pio, &iov, 1);
+}
+
+
+
+static ssize_t compress_inflate(prelude_io_t *pio)
+{
+        int ret;
+        uint64_t start;
+        io_compress_t *c = pio->compress;
+        z_stream *z = &c->inflate;
+
+        z->next_out = c->plain;
+        z->avail_out = sizeof(c->plain);
+
+        start = get_cpu_usec();
+        ret = inflate(z, Z_SYNC_FLUSH);
+        pio->stats.compression_usec += get_cpu_usec() - start;
+
+        if ( ret != Z_OK && ret != Z_BUF_ERROR )
+                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "inflate error: %s", (z->msg) ? z->msg : zError(ret));
+
+        c->plain_index = 0;
+        c->plain_len = sizeof(c->plain) - z->avail_out;
+        c->more = (z->avail_out == 0) ? TRUE : FALSE;
+
+        return c->plain_len;
+}
+
+
+
+static ssize_t compress_read(prelude_io_t *pio, void *buf, size_t count)
+{
+        ssize_t ret;
+        io_compress_t *c = pio->compress;
+
+        /*
+         * When the previous inflate filled the plain buffer exactly, the
+         * stream might not hold anything more: in that case, c->more is
+         * cleared and the next iteration reads from the backend.
+         */
+        while ( c->plain_index == c->plain_len ) {
+                if ( ! c->more && ! c->inflate.avail_in ) {
+                        ret = pio->read(pio, c->in, sizeof(c->in));
+                        if ( ret <= 0 )
+                                return ret;
+
+                        pio->stats.compressed_read_bytes += ret;
+
+                        c->inflate.next_in = c->in;
+                        c->inflate.avail_in = ret;
+                }
+
+                ret = compress_inflate(pio);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        count = MIN(count, c->plain_len - c->plain_index);
+
+        memcpy(buf, c->plain + c->plain_index, count);
+        c->plain_index += count;
+
+        return count;
+}
+
+
+
+/*
+ * Number of bytes buffered by the compression layer.
+ */
+static size_t compress_pending(prelude_io_t *pio)
+{
+        io_compress_t *c = pio->compress;
+
+        if ( ! c )
+                return 0;
+
+        /*
+         * Find out whether the stream holds more than what filled the
+         * plain buffer, rather than have the caller wait for the backend.
+         * An inflate error is reported by the next read.
+         */
+        if ( c->plain_index == c->plain_len && c->more && ! c->inflate.avail_in ) {
+                if ( compress_inflate(pio) < 0 )
+                        return 1;
+        }
+
+        return (c->plain_len - c->plain_index) + c->inflate.avail_in;
+}
+#endif
+
+
+
+static size_t io_buffered(prelude_io_t *pio)
+{
+#ifdef HAVE_ZLIB
+        return compress_pending(pio);
+#else
+        return 0;
+#endif
+}
+
+
+
+static ssize_t io_read(prelude_io_t *pio, void *buf, size_t count)
+{
+#ifdef HAVE_ZLIB
+        if ( pio->compress )
+                return compress_read(pio, buf, count);
+#endif
+
+        return pio->read(pio, buf, count);
+}
+
+
+
+static ssize_t io_write(prelude_io_t *pio, const void *buf, size_t count)
+{
+#ifdef HAVE_ZLIB
+        if ( pio->compress )
+                return compress_write(pio, buf, count);
+#endif
+
+        return pio->write(pio, buf, count);
+}
+
+
+
+/*
+ * Write the whole @count bytes of @buf to @pio.
+ */
+static ssize_t write_all(prelude_io_t *pio, const unsigned char *buf, size_t count)
+{
+        ssize_t ret;
+        size_t len = 0;
+
+        while ( len < count ) {
+                ret = io_write(pio, buf + len, count - len);
+
+                pio->stats.write_syscalls++;
+                if ( ret < 0 )
+                        return ret;
+
+                pio->stats.write_bytes += ret;
+                len += ret;
+        }
+
+        return len;
+}
+
+
+
+#ifdef HAVE_SPLICE
+/*
+ * Data is only spliced to a pipe as long as it has room for it, so
+ * that forwarding never waits for the pipe to be drained.
+ */
+static size_t get_pipe_size(int fd)
+{
+#ifdef F_GETPIPE_SZ
+        int ret;
+
+        ret = fcntl(fd, F_GETPIPE_SZ);
+        if ( ret > 0 )
+                return ret;
+#endif
+
+        return PIPE_BUF;
+}
+
+
+
+static void forward_pipe_close(prelude_io_t *pio)
+{
+        if ( pio->pipe[0] < 0 )
+                return;
+
+        close(pio->pipe[0]);
+        close(pio->pipe[1]);
+
+        pio->pipe[0] = pio->pipe[1] = -1;
+        pio->pipe_len = 0;
+}
+
+
+
+/*
+ * Move the data waiting in the pipe of @pio to its file descriptor.
+ */
+static int forward_pipe_flush(prelude_io_t *pio, prelude_bool_t more)
+{
+        ssize_t ret;
+
+        while ( pio->pipe_len ) {
+                do {
+                        ret = splice(pio->pipe[0], NULL, pio->fd, NULL, pio->pipe_len, SPLICE_F_MOVE | (more ? SPLICE_F_MORE : 0));
+                } while ( ret < 0 && errno == EINTR );
+
+                pio->stats.write_syscalls++;
+
+                /*
+                 * What is left in the pipe can't be delivered anymore.
+                 */
+                if ( ret <= 0 ) {
+                        ret = prelude_error_from_errno((ret < 0) ? errno : EPIPE);
+                        forward_pipe_close(pio);
+                        return ret;
+                }
+
+                pio->stats.write_bytes += ret;
+                pio->pipe_len -= ret;
+        }
+
+        return 0;
+}
+#endif
+
+
+
+static int forward_buffer_flush(prelude_io_t *pio)
+{
+        ssize_t ret;
+
+        if ( ! pio->fwd_len )
+                return 0;
+
+        ret = write_all(pio, pio->fwd_buf, pio->fwd_len);
+        pio->fwd_len = 0;
+
+        return (ret < 0) ? ret : 0;
+}
+
+
+
+/*
+ * Write the forwarded data kept for batching before anything else
+ * is written to @pio.
+ */
+static int forward_flush(prelude_io_t *pio)
+{
+#ifdef HAVE_SPLICE
+        if ( pio->pipe_len )
+                return forward_pipe_flush(pio, FALSE);
+#endif
+
+        return forward_buffer_flush(pio);
+}
+
+
+
+/*
+ * Forward data through a buffer: header and data go out in as few writes
+ * as the buffer allows, whatever the size of the records read from @src.
+ */
+static ssize_t copy_forward(prelude_io_t *dst, prelude_io_t *src, const void *head, size_t headlen,
+                            size_t count, prelude_io_forward_flags_t flags)
+{
+        ssize_t ret;
+        size_t len;
+
+        if ( ! dst->fwd_buf ) {
+                dst->fwd_buf = malloc(FORWARD_BUFFER_SIZE);
+                if ( ! dst->fwd_buf )
+                        return prelude_error_from_errno(errno);
+        }
+
+        if ( dst->fwd_len + headlen > FORWARD_BUFFER_SIZE ) {
+                ret = forward_buffer_flush(dst);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        if ( headlen > FORWARD_BUFFER_SIZE ) {
+                ret = write_all(dst, head, headlen);
+                if ( ret < 0 )
+                        return ret;
+        } else if ( headlen ) {
+                memcpy(dst->fwd_buf + dst->fwd_len, head, headlen);
+                dst->fwd_len += headlen;
+        }
+
+        for ( len = 0; len < count; len += ret ) {
+                if ( dst->fwd_len == FORWARD_BUFFER_SIZE ) {
+                        ret = forward_buffer_flush(dst);
+                        if ( ret < 0 )
+                                return ret;
+                }
+
+                ret = prelude_io_read(src, dst->fwd_buf + dst->fwd_len, MIN(count - len, FORWARD_BUFFER_SIZE - dst->fwd_len));
+                if ( ret <= 0 ) {
+                        forward_buffer_flush(dst);
+                        return (ret < 0) ? ret : prelude_error(PRELUDE_ERROR_EOF);
+                }
+
+                dst->fwd_len += ret;
+        }
+
+        if ( ! (flags & PRELUDE_IO_FORWARD_FLAGS_MORE) ) {
+                ret = forward_buffer_flush(dst);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-        return ret;
+        return count;
 }
 
 
 
-static int tls_close(prelude_io_t *pio)
+#ifdef HAVE_SPLICE
+/*
+ * Forward data between two file descriptors through a pipe, without it
+ * ever being copied to user space. The pipe also holds the data kept for
+ * batching.
+ */
+static ssize_t splice_forward(prelude_io_t *dst, prelude_io_t *src, const void *head, size_t headlen,
+                              size_t count, prelude_io_forward_flags_t flags)
 {
-        int ret;
+        ssize_t ret;
+        size_t len;
+        if ( dst->pipe[0] < 0 ) {
+                if ( pipe(dst->pipe) < 0 ) {
+                        dst->pipe[0] = dst->pipe[1] = -1;
+                        return copy_forward(dst, src, head, headlen, count, flags);
+                }
+
+                dst->pipe_size = get_pipe_size(dst->pipe[1]);
+        }
 
-        do {
-                ret = gnutls_bye(pio->fd_ptr, GNUTLS_SHUT_RDWR);
-        } while ( ret < 0 && ret == GNUTLS_E_INTERRUPTED );
+        if ( dst->pipe_len + headlen > dst->pipe_size ) {
+                ret = forward_pipe_flush(dst, TRUE);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-        if ( ret < 0 ) {
-                ret = tls_check_error(pio, ret);
-                if ( prelude_io_is_error_fatal(pio, ret) )
-                        sys_close(pio);
+        if ( headlen > dst->pipe_size ) {
+                ret = write_all(dst, head, headlen);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-                return ret;
+        else if ( headlen ) {
+                /*
+                 * The header is copied: it does not outlive the caller.
+                 */
+                do {
+                        ret = write(dst->pipe[1], head, headlen);
+                } while ( ret < 0 && errno == EINTR );
+
+                if ( ret != (ssize_t) headlen ) {
+                        ret = prelude_error_from_errno((ret < 0) ? errno : EIO);
+                        forward_pipe_close(dst);
+                        return ret;
+                }
+
+                dst->pipe_len += headlen;
         }
 
-        gnutls_deinit(pio->fd_ptr);
+        for ( len = 0; len < count; len += ret ) {
+                if ( dst->pipe_len == dst->pipe_size ) {
+                        ret = forward_pipe_flush(dst, TRUE);
+                        if ( ret < 0 )
+                                return ret;
+                }
 
-        /*
-         * this is not expected to fail
-         */
-        prelude_io_set_sys_io(pio, pio->fd);
-        return sys_close(pio);
-}
+                do {
+                        ret = splice(src->fd, NULL, dst->pipe[1], NULL, MIN(count - len, dst->pipe_size - dst->pipe_len), SPLICE_F_MOVE);
+                } while ( ret < 0 && errno == EINTR );
 
+                src->stats.read_syscalls++;
 
+                if ( ret <= 0 ) {
+                        if ( ret == 0 || errno == ECONNRESET )
+                                ret = prelude_error(PRELUDE_ERROR_EOF);
+                        else
+                                ret = prelude_error_from_errno(errno);
 
-static ssize_t tls_pending(prelude_io_t *pio)
-{
-        ssize_t ret;
+                        forward_pipe_flush(dst, FALSE);
+                        return ret;
+                }
 
-        ret = gnutls_record_check_pending(pio->fd_ptr);
-        if ( ret > 0 )
-                return ret;
+                src->stats.read_bytes += ret;
+                dst->pipe_len += ret;
+        }
 
-        ret = sys_pending(pio);
-        if ( ret > 0 )
-                return ret;
+        if ( ! (flags & PRELUDE_IO_FORWARD_FLAGS_MORE) ) {
+                ret = forward_pipe_flush(dst, FALSE);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-        return 0;
+        return count;
 }
+#endif
 
 
 
-/*
- * Forward data from one fd to another using copy.
+/**
+ * prelude_io_forward_full:
+ * @dst: Pointer to a #prelude_io_t object.
+ * @src: Pointer to a #prelude_io_t object.
+ * @head: Data to write to @dst before the forwarded data, or NULL.
+ * @headlen: Size of @head.
+ * @count: Number of byte to forward from @src to @dst.
+ * @flags: Forwarding flags.
+ *
+ * Writes @head to @dst, followed by exactly @count bytes read from @src.
+ *
+ * Between two system file descriptors, data is moved by the kernel without
+ * being copied to user space. Otherwise, it goes through a buffer large
+ * enough for TLS records to be written whole.
+ *
+ * With #PRELUDE_IO_FORWARD_FLAGS_MORE, more data is about to be forwarded
+ * to @dst: the data might be kept so that several messages are written
+ * at once. It is written no later than by the next forward without this
+ * flag, the next write to @dst, or prelude_io_forward_flush().
+ *
+ * Returns: @count on success, or a negative value if an error occured.
  */
-static ssize_t copy_forward(prelude_io_t *dst, prelude_io_t *src, size_t count)
+ssize_t prelude_io_forward_full(prelude_io_t *dst, prelude_io_t *src, const void *head, size_t headlen,
+                                size_t count, prelude_io_forward_flags_t flags)
 {
+#ifdef HAVE_SPLICE
         int ret;
-        size_t scount;
-        unsigned char buf[8192];
-
-        scount = count;
-
-        while ( count ) {
-
-                ret = (count < sizeof(buf)) ? count : sizeof(buf);
-
-                ret = prelude_io_read(src, buf, ret);
-                if ( ret <= 0 )
-                        return ret;
+#endif
 
-                count -= ret;
+        prelude_return_val_if_fail(dst, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(src, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(head || headlen == 0, prelude_error(PRELUDE_ERROR_ASSERTION));
 
-                ret = prelude_io_write(dst, buf, ret);
+#ifdef HAVE_SPLICE
+        if ( src->read == sys_read && dst->write == sys_write && ! src->compress && ! dst->compress ) {
+                ret = forward_buffer_flush(dst);
                 if ( ret < 0 )
                         return ret;
-        }
 
-        return scount;
-}
+                return splice_forward(dst, src, head, headlen, count, flags);
+        }
 
+        ret = forward_pipe_flush(dst, FALSE);
+        if ( ret < 0 )
+                return ret;
+#endif
 
+        return copy_forward(dst, src, head, headlen, count, flags);
+}
 
 
 
@@ -438,17 +1399,31 @@ static ssize_t copy_forward(prelude_io_t *dst, prelude_io_t *src, size_t count)
  *
  * prelude_io_forward() attempts to transfer up to @count bytes from
  * the file descriptor identified by @src into the file descriptor
- * identified by @dst.
+ * identified by @dst. See prelude_io_forward_full().
  *
  * Returns: If the transfer was successful, the number of bytes written
  * to @dst is returned.  On error, -1 is returned, and errno is set appropriately.
  */
 ssize_t prelude_io_forward(prelude_io_t *dst, prelude_io_t *src, size_t count)
 {
-        prelude_return_val_if_fail(dst, prelude_error(PRELUDE_ERROR_ASSERTION));
-        prelude_return_val_if_fail(src, prelude_error(PRELUDE_ERROR_ASSERTION));
+        return prelude_io_forward_full(dst, src, NULL, 0, count, 0);
+}
 
-        return copy_forward(dst, src, count);
+
+
+/**
+ * prelude_io_forward_flush:
+ * @pio: Pointer to a #prelude_io_t object.
+ *
+ * Writes the data forwarded to @pio with #PRELUDE_IO_FORWARD_FLAGS_MORE
+ * that is still waiting.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_io_forward_flush(prelude_io_t *pio)
+{
+        prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
+        return forward_flush(pio);
 }
 
 
@@ -480,11 +1455,19 @@ ssize_t prelude_io_forward(prelude_io_t *dst, prelude_io_t *src, size_t count)
  */
 ssize_t prelude_io_read(prelude_io_t *pio, void *buf, size_t count)
 {
+        ssize_t ret;
+
         prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(pio->read, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(buf, prelude_error(PRELUDE_ERROR_ASSERTION));
 
-        return pio->read(pio, buf, count);
+        ret = io_read(pio, buf, count);
+
+        pio->stats.read_syscalls++;
+        if ( ret > 0 )
+                pio->stats.read_bytes += ret;
+
+        return ret;
 }
 
 
@@ -528,12 +1511,17 @@ ssize_t prelude_io_read_wait(prelude_io_t *pio, void *buf, size_t count)
         pfd.events = POLLIN;
 
         do {
-                ret = poll(&pfd, 1, -1);
-                if ( ret < 0 )
-                        return prelude_error_from_errno(errno);
-
-                if ( ! (pfd.revents & POLLIN) )
-                        return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "expected POLLIN event");
+                /*
+                 * Data already decompressed is not seen by poll().
+                 */
+                if ( ! io_buffered(pio) ) {
+                        ret = poll(&pfd, 1, -1);
+                        if ( ret < 0 )
+                                return prelude_error_from_errno(errno);
+
+                        if ( ! (pfd.revents & POLLIN) )
+                                return prelude_error_verbose(PRELUDE_ERROR_GENERIC, "expected POLLIN event");
+                }
 
                 ret = prelude_io_read(pio, &in[n], count - n);
                 if ( ret < 0 )
@@ -619,11 +1607,78 @@ ssize_t prelude_io_read_delimited(prelude_io_t *pio, unsigned char **buf)
  */
 ssize_t prelude_io_write(prelude_io_t *pio, const void *buf, size_t count)
 {
+        ssize_t ret;
+
         prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(pio->write, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(buf, prelude_error(PRELUDE_ERROR_ASSERTION));
 
-        return pio->write(pio, buf, count);
+        ret = forward_flush(pio);
+        if ( ret < 0 )
+                return ret;
+
+        ret = io_write(pio, buf, count);
+
+        pio->stats.write_syscalls++;
+        if ( ret > 0 )
+                pio->stats.write_bytes += ret;
+
+        return ret;
+}
+
+
+
+/**
+ * prelude_io_writev:
+ * @pio: Pointer to a #prelude_io_t object.
+ * @iov: Array of buffers to be written.
+ * @iovcnt: Number of entry in @iov.
+ *
+ * prelude_io_writev() writes the @iovcnt buffers described by @iov to the
+ * file descriptor identified by @pio, in order, the same way writev() does.
+ *
+ * On system IO, a single writev() call is issued. On TLS IO, the buffers
+ * are packed together and pushed as a batch of records. Other kind of IO
+ * (or IO using a user defined write callback) fall back to one write per
+ * buffer.
+ *
+ * The case where the write function would be interrupted by a signal is
+ * handled internally. So you don't have to check for EINTR.
+ *
+ * After a partial write or #PRELUDE_ERROR_EAGAIN, the next write to a TLS
+ * IO should start with the data that was not written, as
+ * prelude_msg_writev() does.
+ *
+ * Returns: On success, the number of bytes written is returned. This might
+ * be less than the sum of the buffers size. On error, a negative value is returned.
+ */
+ssize_t prelude_io_writev(prelude_io_t *pio, const struct iovec *iov, int iovcnt)
+{
+        ssize_t ret;
+
+        prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(pio->write, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(iov || iovcnt == 0, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        ret = forward_flush(pio);
+        if ( ret < 0 )
+                return ret;
+
+#ifdef HAVE_ZLIB
+        if ( pio->compress ) {
+                ret = compress_writev(pio, iov, iovcnt);
+                pio->stats.write_syscalls++;
+        } else
+#endif
+        if ( pio->writev )
+                ret = pio->writev(pio, iov, iovcnt);
+        else
+                ret = generic_writev(pio, iov, iovcnt);
+
+        if ( ret > 0 )
+                pio->stats.write_bytes += ret;
+
+        return ret;
 }
 
 
@@ -694,6 +1749,16 @@ int prelude_io_close(prelude_io_t *pio)
         prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
         prelude_return_val_if_fail(pio->close, prelude_error(PRELUDE_ERROR_ASSERTION));
 
+        forward_flush(pio);
+
+#ifdef HAVE_ZLIB
+        /*
+         * The compression history does not outlive the connection.
+         */
+        if ( pio->compress )
+                compress_destroy(pio);
+#endif
+
         return pio->close(pio);
 }
 
@@ -714,6 +1779,8 @@ int prelude_io_new(prelude_io_t **ret)
         if ( ! *ret )
                 return prelude_error_from_errno(errno);
 
+        (*ret)->pipe[0] = (*ret)->pipe[1] = -1;
+
         return 0;
 }
 
@@ -736,6 +1803,7 @@ void prelude_io_set_file_io(prelude_io_t *pio, FILE *fdptr)
         pio->fd_ptr = fdptr;
         pio->read = file_read;
         pio->write = file_write;
+        pio->writev = NULL;
         pio->close = file_close;
         pio->pending = file_pending;
 }
@@ -767,6 +1835,11 @@ void prelude_io_set_tls_io(prelude_io_t *pio, void *tls)
         pio->fd_ptr = tls;
         pio->read = tls_read;
         pio->write = tls_write;
+#ifdef HAVE_GNUTLS_RECORD_CORK
+        pio->writev = tls_writev;
+#else
+        pio->writev = NULL;
+#endif
         pio->close = tls_close;
         pio->pending = tls_pending;
 }
@@ -774,6 +1847,156 @@ void prelude_io_set_tls_io(prelude_io_t *pio, void *tls)
 
 
 
+/**
+ * prelude_io_set_tls_offload:
+ * @pio: A pointer on a #prelude_io_t object set up with prelude_io_set_tls_io().
+ *
+ * Hand the encryption of the records written to @pio over to the
+ * kernel (Linux kernel TLS): writes then go straight to the socket,
+ * without being copied through GnuTLS. Records are still read
+ * through GnuTLS.
+ *
+ * This should be called once the handshake is over, while no data is
+ * waiting to be written. On failure, @pio is left untouched and keeps
+ * encrypting records itself.
+ *
+ * Returns: 0 on success, a negative value if the offload is not supported.
+ */
+int prelude_io_set_tls_offload(prelude_io_t *pio)
+{
+#ifdef HAVE_TLS_OFFLOAD
+        int ret;
+        socklen_t len = 0;
+        tls_offload_info_t info;
+
+        prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(pio->close == tls_close, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        if ( gnutls_record_check_corked(pio->fd_ptr) > 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_TLS, "TLS offload with data pending");
+
+        ret = tls_offload_get_info(pio->fd_ptr, &info, &len);
+        if ( ret < 0 )
+                return ret;
+
+        /*
+         * Until its transmit state is set, a socket with the TLS upper
+         * layer protocol attached behaves as a regular one.
+         */
+        ret = setsockopt(pio->fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"));
+        if ( ret == 0 )
+                ret = setsockopt(pio->fd, SOL_TLS, TLS_TX, &info, len);
+
+        memset(&info, 0, sizeof(info));
+
+        if ( ret < 0 )
+                return prelude_error_verbose(PRELUDE_ERROR_TLS, "TLS offload unavailable: %s", strerror(errno));
+
+        gnutls_transport_set_push_function(pio->fd_ptr, tls_offload_push);
+
+        pio->write = sys_write;
+        pio->writev = sys_writev;
+        pio->close = tls_offload_close;
+
+        return 0;
+#else
+        prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
+# ifdef ENOTSUP
+        return prelude_error_from_errno(ENOTSUP);
+# else
+        return prelude_error(PRELUDE_ERROR_GENERIC);
+# endif
+#endif
+}
+
+
+
+/**
+ * prelude_io_is_tls_offloaded:
+ * @pio: A pointer on a #prelude_io_t object.
+ *
+ * Returns: TRUE if the records written to @pio are encrypted by the
+ * kernel, see prelude_io_set_tls_offload().
+ */
+prelude_bool_t prelude_io_is_tls_offloaded(prelude_io_t *pio)
+{
+        prelude_return_val_if_fail(pio, FALSE);
+
+#ifdef HAVE_TLS_OFFLOAD
+        return (pio->close == tls_offload_close) ? TRUE : FALSE;
+#else
+        return FALSE;
+#endif
+}
+
+
+
+/**
+ * prelude_io_set_compression:
+ * @pio: A pointer on a #prelude_io_t object.
+ * @algo: The #prelude_io_compression_t algorithm to use.
+ *
+ * Compress the data written to @pio, and decompress the data read from
+ * it, on top of its current file, system or TLS functions, which can be
+ * changed afterward. Each write is flushed, so that the peer can decode
+ * the data as soon as it is received, while the compression history is
+ * kept from one write to the next. Both sides should start compressing
+ * at the same point of the stream, and %PRELUDE_IO_COMPRESSION_NONE
+ * removes the compression layer.
+ *
+ * The number of bytes exchanged with the peer and the processor time
+ * spent compressing are reported by prelude_io_get_stats().
+ *
+ * Returns: 0 on success, a negative value if an error occured or if
+ * @algo is not supported.
+ */
+int prelude_io_set_compression(prelude_io_t *pio, prelude_io_compression_t algo)
+{
+        prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+#ifdef HAVE_ZLIB
+        if ( pio->compress && pio->compress->algo == algo )
+                return 0;
+
+        if ( pio->compress )
+                compress_destroy(pio);
+
+        if ( algo == PRELUDE_IO_COMPRESSION_DEFLATE )
+                return compress_new(pio, algo);
+#endif
+
+        if ( algo == PRELUDE_IO_COMPRESSION_NONE )
+                return 0;
+
+#ifdef ENOTSUP
+        return prelude_error_from_errno(ENOTSUP);
+#else
+        return prelude_error(PRELUDE_ERROR_GENERIC);
+#endif
+}
+
+
+
+/**
+ * prelude_io_get_compression:
+ * @pio: A pointer on a #prelude_io_t object.
+ *
+ * Returns: the #prelude_io_compression_t algorithm used by @pio.
+ */
+prelude_io_compression_t prelude_io_get_compression(prelude_io_t *pio)
+{
+        prelude_return_val_if_fail(pio, PRELUDE_IO_COMPRESSION_NONE);
+
+#ifdef HAVE_ZLIB
+        if ( pio->compress )
+                return pio->compress->algo;
+#endif
+
+        return PRELUDE_IO_COMPRESSION_NONE;
+}
+
+
+
 /**
  * prelude_io_set_sys_io:
  * @pio: A pointer on the #prelude_io_t object.
@@ -790,6 +2013,7 @@ void prelude_io_set_sys_io(prelude_io_t *pio, int fd)
         pio->fd_ptr = NULL;
         pio->read = sys_read;
         pio->write = sys_write;
+        pio->writev = sys_writev;
         pio->close = sys_close;
         pio->pending = sys_pending;
 }
@@ -805,6 +2029,7 @@ int prelude_io_set_buffer_io(prelude_io_t *pio)
 
         pio->read = buffer_read;
         pio->write = buffer_write;
+        pio->writev = NULL;
         pio->close = buffer_close;
         pio->pending = buffer_pending;
 
@@ -850,6 +2075,17 @@ void *prelude_io_get_fdptr(prelude_io_t *pio)
 void prelude_io_destroy(prelude_io_t *pio)
 {
         prelude_return_if_fail(pio);
+
+#ifdef HAVE_SPLICE
+        forward_pipe_close(pio);
+#endif
+
+#ifdef HAVE_ZLIB
+        if ( pio->compress )
+                compress_destroy(pio);
+#endif
+
+        free(pio->fwd_buf);
         free(pio);
 }
 
@@ -869,6 +2105,10 @@ void prelude_io_destroy(prelude_io_t *pio)
 ssize_t prelude_io_pending(prelude_io_t *pio)
 {
         prelude_return_val_if_fail(pio, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        if ( io_buffered(pio) )
+                return io_buffered(pio);
+
         return pio->pending(pio);
 }
 
@@ -913,6 +2153,7 @@ prelude_bool_t prelude_io_is_error_fatal(prelude_io_t *pio, int error)
 void prelude_io_set_write_callback(prelude_io_t *pio, ssize_t (*write)(prelude_io_t *io, const void *buf, size_t count))
 {
         pio->write = write;
+        pio->writev = NULL;
 }
 
 
@@ -958,3 +2199,36 @@ void prelude_io_set_fdptr(prelude_io_t *pio, void *ptr)
 {
         pio->fd_ptr = ptr;
 }
+
+
+
+/**
+ * prelude_io_get_stats:
+ * @pio: Pointer to a #prelude_io_t object.
+ * @stats: Pointer to a #prelude_io_stats_t object where to store the counters.
+ *
+ * Retrieve the number of bytes transfered through @pio, and the number of
+ * underlying read / write operations that were needed to transfer them,
+ * since @pio was created or since the last prelude_io_reset_stats() call.
+ */
+void prelude_io_get_stats(prelude_io_t *pio, prelude_io_stats_t *stats)
+{
+        prelude_return_if_fail(pio);
+        prelude_return_if_fail(stats);
+
+        *stats = pio->stats;
+}
+
+
+
+/**
+ * prelude_io_reset_stats:
+ * @pio: Pointer to a #prelude_io_t object.
+ *
+ * Reset @pio transfer counters.
+ */
+void prelude_io_reset_stats(prelude_io_t *pio)
+{
+        prelude_return_if_fail(pio);
+        memset(&pio->stats, 0, sizeof(pio->stats));
+}
@@ -31,6 +31,7 @@
 #include <assert.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/uio.h>
 
 #if TIME_WITH_SYS_TIME
 # include <sys/time.h>
@@ -46,6 +47,9 @@
 #define PRELUDE_ERROR_SOURCE_DEFAULT PRELUDE_ERROR_SOURCE_MESSAGE
 #include "prelude-error.h"
 
+#include "glthread/lock.h"
+#include "glthread/tls.h"
+
 #include "common.h"
 #include "prelude-log.h"
 #include "prelude-inttypes.h"
@@ -57,10 +61,103 @@
 
 
 #define MSGBUF_SIZE 8192
-#define PRELUDE_MSG_VERSION 1
 #define PRELUDE_MSG_HDR_SIZE 16
 #define MINIMUM_FRAGMENT_DATA_SIZE 1
 
+/*
+ * Maximum number of buffer handed to a single writev() call.
+ */
+#define MSG_IOV_MAX 64
+
+/*
+ * Message buffer pool parameters.
+ */
+#define MSG_POOL_CLASS_COUNT 5
+#define MSG_POOL_NO_CLASS -1
+#define MSG_POOL_THREAD_CACHE_SIZE 32
+#define MSG_POOL_DEFAULT_HIGH_WATER_MARK (4 * 1024 * 1024)
+
+/*
+ * With PRELUDE_MSG_VERSION_2, a chunk tag is followed by a LEB128 varint
+ * rather than by a 32 bits length. The two low bits of the varint tell
+ * how the chunk content is encoded, the remaining bits hold its length.
+ * Integers are stored as a varint following the chunk header, with their
+ * original size as the chunk length. Signed integers are zig-zag encoded
+ * so that small negative values stay short.
+ */
+#define CHUNK_TYPE_RAW  0
+#define CHUNK_TYPE_UINT 1
+#define CHUNK_TYPE_INT  2
+#define CHUNK_TYPE_DICT 3
+#define VARINT_MAX_SIZE 10
+
+/*
+ * Strings written with prelude_msg_set_string() to a message using a
+ * dictionary get an identifier the second time they are seen: the
+ * chunk then holds the identifier followed by the string, and later
+ * occurrences only hold the identifier. Identifiers are allocated in
+ * sequence and never reused, so that a message can still be decoded
+ * once later ones were received. Defining the first identifier starts
+ * a new dictionary.
+ */
+#define DICT_MAX_ENTRIES 1024
+#define DICT_MAX_STRING_LEN 256
+#define DICT_HASH_SIZE (2 * DICT_MAX_ENTRIES)
+#define DICT_NO_ID UINT32_MAX
+
+
+
+typedef struct {
+        char *data;
+        uint32_t len;
+} dict_entry_t;
+
+
+struct prelude_msg_dict {
+        int refcount;
+        gl_lock_t mutex;
+
+        /*
+         * Set once a message could not be sent with this dictionary, so
+         * that the writer starts a new one.
+         */
+        prelude_bool_t desync;
+
+        uint32_t count;
+        dict_entry_t entries[DICT_MAX_ENTRIES];
+
+        /*
+         * Writer side: identifier + 1 of the entries, indexed by their
+         * hash, and hash of the strings seen once.
+         */
+        uint32_t *hash;
+        uint32_t *seen;
+};
+
+
+typedef struct {
+        uint8_t tag;
+        uint8_t type;
+        uint32_t len;
+
+        /*
+         * Chunk content, of which size bytes are available.
+         */
+        unsigned char *data;
+        uint32_t size;
+
+        /*
+         * Integer chunks value, or dictionary chunks identifier
+         * and string, which is NULL for a reference.
+         */
+        uint64_t value;
+        char *str;
+        uint32_t strlen;
+} chunk_t;
+
+
+static prelude_msg_dict_t *dict_ref(prelude_msg_dict_t *dict);
+
 
 
 typedef struct {
@@ -90,11 +187,74 @@ struct prelude_msg {
         unsigned char hdrbuf[PRELUDE_MSG_HDR_SIZE];
         unsigned char *payload;
 
+        /*
+         * Big endian representation of the last varint integer returned
+         * by prelude_msg_get().
+         */
+        unsigned char intbuf[sizeof(uint64_t)];
+
+        /*
+         * Dictionary used by the strings of this message, the first
+         * identifier it defines and the one following the last identifier
+         * it uses. chunk_index is the position of the first chunk of a
+         * fragment, the data before it belonging to a chunk started in
+         * the previous fragment.
+         */
+        prelude_msg_dict_t *dict;
+        uint32_t dict_first;
+        uint32_t dict_end;
+        uint32_t chunk_index;
+
         void *send_msg_data;
         int (*flush_msg_cb)(prelude_msg_t **msg, void *data);
+
+        int pool_class;
+        size_t capacity;
+
+        /*
+         * The payload is owned by someone else, and already hold
+         * the message headers.
+         */
+        prelude_bool_t borrowed;
 };
 
 
+/*
+ * Message buffers are sorted in size classes, according to their
+ * payload capacity. Released buffers are first kept in a per-thread
+ * cache, which is accessed without locking. Once a thread cache is full,
+ * half of it is handed over to a shared depot, holding at most
+ * msg_pool_high_water_mark bytes. Anything above that is given back
+ * to the system.
+ */
+typedef struct msg_pool_block {
+        struct msg_pool_block *next;
+} msg_pool_block_t;
+
+
+typedef struct {
+        prelude_list_t list;
+
+        msg_pool_block_t *free[MSG_POOL_CLASS_COUNT];
+        unsigned int count[MSG_POOL_CLASS_COUNT];
+
+        uint64_t hits;
+        uint64_t misses;
+} msg_pool_cache_t;
+
+
+static const size_t msg_pool_class_size[MSG_POOL_CLASS_COUNT] = { 256, 1024, 4096, MSGBUF_SIZE, 65536 };
+
+gl_once_define(static, msg_pool_once);
+static gl_tls_key_t msg_pool_key;
+static gl_lock_t msg_pool_mutex = gl_lock_initializer;
+static PRELUDE_LIST(msg_pool_cache_list);
+static msg_pool_block_t *msg_pool_depot[MSG_POOL_CLASS_COUNT];
+static size_t msg_pool_depot_size = 0;
+static size_t msg_pool_high_water_mark = MSG_POOL_DEFAULT_HIGH_WATER_MARK;
+static uint64_t msg_pool_hits = 0, msg_pool_misses = 0;
+
+
 /*
  * Anything bigger than this will be discarded.
  */
@@ -102,263 +262,786 @@ static const size_t max_message_size = 100 * 1024 * 1024;
 
 
 
-static int call_alloc_cb(prelude_msg_t **msg)
+static size_t msg_pool_block_size(int class)
 {
-        int ret;
+        return sizeof(prelude_msg_t) + msg_pool_class_size[class];
+}
 
-        ret = (*msg)->flush_msg_cb(msg, (*msg)->send_msg_data);
-        if ( ret < 0 )
-                return ret;
 
-        /*
-         * Within the callback, the caller have the choise to use
-         * a newly allocated message or to flush the current message and
-         * reuse it.
-         *
-         * We have to reset write_index and is_fragment header member
-         * in order to properly address the message buffer. And in order
-         * for not all message to not look like fragment.
-         */
-        (*msg)->header_index = 0;
-        (*msg)->write_index = PRELUDE_MSG_HDR_SIZE;
-        (*msg)->hdr.is_fragment = 0;
 
-        return 0;
+static int msg_pool_get_class(size_t capacity)
+{
+        int i;
+
+        for ( i = 0; i < MSG_POOL_CLASS_COUNT; i++ ) {
+                if ( capacity <= msg_pool_class_size[i] )
+                        return i;
+        }
+
+        return MSG_POOL_NO_CLASS;
 }
 
 
 
-static void write_message_header(prelude_msg_t *msg)
+/*
+ * Hand back a block to the depot, or to the system if the depot
+ * reached its high water mark. Called with msg_pool_mutex held.
+ */
+static void msg_pool_depot_put(msg_pool_block_t *block, int class)
 {
-        uint32_t dlen;
-        struct timeval tv;
-        uint32_t hdr_offset = msg->header_index;
+        size_t size = msg_pool_block_size(class);
 
-        dlen = htonl(msg->write_index - msg->header_index - PRELUDE_MSG_HDR_SIZE);
+        if ( msg_pool_depot_size + size > msg_pool_high_water_mark ) {
+                free(block);
+                return;
+        }
 
-        msg->payload[hdr_offset++] = PRELUDE_MSG_VERSION;
-        msg->payload[hdr_offset++] = msg->hdr.tag;
-        msg->payload[hdr_offset++] = msg->hdr.priority;
-        msg->payload[hdr_offset++] = msg->hdr.is_fragment;
+        block->next = msg_pool_depot[class];
+        msg_pool_depot[class] = block;
+        msg_pool_depot_size += size;
+}
 
-        gettimeofday(&tv, NULL);
 
-        msg->hdr.tv_sec = htonl(tv.tv_sec);
-        msg->hdr.tv_usec = htonl(tv.tv_usec);
 
-        memcpy(&msg->payload[hdr_offset], &dlen, sizeof(dlen));
-        memcpy(&msg->payload[hdr_offset + 4], &msg->hdr.tv_sec, sizeof(msg->hdr.tv_sec));
-        memcpy(&msg->payload[hdr_offset + 8], &msg->hdr.tv_usec, sizeof(msg->hdr.tv_usec));
-}
+static void msg_pool_depot_trim(void)
+{
+        int i;
+        msg_pool_block_t *block;
 
+        for ( i = MSG_POOL_CLASS_COUNT - 1; i >= 0 && msg_pool_depot_size > msg_pool_high_water_mark; i-- ) {
+
+                while ( msg_pool_depot[i] && msg_pool_depot_size > msg_pool_high_water_mark ) {
+                        block = msg_pool_depot[i];
+                        msg_pool_depot[i] = block->next;
+                        msg_pool_depot_size -= msg_pool_block_size(i);
+                        free(block);
+                }
+        }
+}
 
 
 
-static int set_data(prelude_msg_t **m, const void *buf, size_t size)
+static void msg_pool_cache_drain(msg_pool_cache_t *cache, int class, unsigned int count)
 {
-        int ret;
-        size_t remaining;
-        prelude_msg_t *msg = *m;
+        msg_pool_block_t *block;
 
-        remaining = (msg->hdr.datalen - msg->write_index);
-        assert(msg->flush_msg_cb != NULL || remaining >= size);
+        gl_lock_lock(msg_pool_mutex);
 
-        if ( size > remaining ) {
+        while ( count-- && (block = cache->free[class]) ) {
+                cache->free[class] = block->next;
+                cache->count[class]--;
+                msg_pool_depot_put(block, class);
+        }
 
-                /*
-                 * there is not enough free buffer space to store the whole
-                 * data in the message. Store what we can, and call the message
-                 * flushing function, which'll emit the current buffer
-                 * and allocate a new one.
-                 */
-                memcpy(msg->payload + msg->write_index, buf, remaining);
+        gl_lock_unlock(msg_pool_mutex);
+}
 
-                size -= remaining;
-                msg->write_index += remaining;
-                buf = (const uint8_t *) buf + remaining;
 
-                /*
-                 * this is a fragment of message.
-                 */
-                msg->hdr.is_fragment = 1;
 
-                /*
-                 * the caller might destroy the message after this and re-allocate
-                 * one... or use synchronous send and reuse the same message.
-                 */
-                ret = call_alloc_cb(m);
-                if ( ret < 0 )
-                        return ret;
+static void msg_pool_cache_refill(msg_pool_cache_t *cache, int class)
+{
+        unsigned int count = MSG_POOL_THREAD_CACHE_SIZE / 2;
+        msg_pool_block_t *block;
 
-                return set_data(m, buf, size);
-        }
+        gl_lock_lock(msg_pool_mutex);
 
-        memcpy(msg->payload + msg->write_index, buf, size);
-        msg->write_index += size;
+        while ( count-- && (block = msg_pool_depot[class]) ) {
+                msg_pool_depot[class] = block->next;
+                msg_pool_depot_size -= msg_pool_block_size(class);
 
-        return 0;
-}
+                block->next = cache->free[class];
+                cache->free[class] = block;
+                cache->count[class]++;
+        }
 
+        gl_lock_unlock(msg_pool_mutex);
+}
 
 
 
-inline static int read_message_data(unsigned char *dst, size_t *size, prelude_io_t *fd)
+static void msg_pool_cache_destroy(void *data)
 {
-        ssize_t ret;
-        size_t count = *size;
+        int i;
+        msg_pool_cache_t *cache = data;
 
-        *size = 0;
+        for ( i = 0; i < MSG_POOL_CLASS_COUNT; i++ )
+                msg_pool_cache_drain(cache, i, cache->count[i]);
 
-        /*
-         * Read the whole header.
-         */
-        do {
-                ret = prelude_io_read(fd, dst + *size, count - *size);
-                if ( ret < 0 )
-                        return ret;
+        gl_lock_lock(msg_pool_mutex);
 
-                *size += ret;
+        msg_pool_hits += cache->hits;
+        msg_pool_misses += cache->misses;
+        prelude_list_del(&cache->list);
 
-        } while ( *size != count );
+        gl_lock_unlock(msg_pool_mutex);
 
-        return 0;
+        free(cache);
 }
 
 
 
+static void msg_pool_init(void)
+{
+        gl_tls_key_init(msg_pool_key, msg_pool_cache_destroy);
+}
 
 
-inline static int slice_message_header(prelude_msg_t *msg, unsigned char *hdrbuf)
-{
-        uint32_t tmp;
 
-        if ( ! msg->hdr.datalen ) {
-                /*
-                 * tag and priority are set on first fragment only.
-                 */
-                msg->hdr.version = hdrbuf[0];
-                msg->hdr.tag = hdrbuf[1];
-                msg->hdr.tv_sec = prelude_extract_uint32(hdrbuf + 8);
-                msg->hdr.tv_usec = prelude_extract_uint32(hdrbuf + 12);
-        }
+static msg_pool_cache_t *msg_pool_get_cache(void)
+{
+        msg_pool_cache_t *cache;
 
-        /*
-         * message priority might be set in any fragment.
-         */
-        if ( msg->hdr.priority == PRELUDE_MSG_PRIORITY_NONE )
-                msg->hdr.priority = hdrbuf[2];
+        gl_once(msg_pool_once, msg_pool_init);
 
-        msg->hdr.is_fragment = hdrbuf[3];
-        tmp = prelude_extract_uint32(hdrbuf + 4);
+        cache = gl_tls_get(msg_pool_key);
+        if ( cache )
+                return cache;
 
-        if ( (msg->hdr.datalen + tmp) <= msg->hdr.datalen )
-                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+        cache = calloc(1, sizeof(*cache));
+        if ( ! cache )
+                return NULL;
 
-        if ( (msg->hdr.datalen + tmp) >= max_message_size )
-                return prelude_error_verbose(PRELUDE_ERROR_INVAL_LENGTH, "maximum message size exceeded: %" PRELUDE_PRIu64 " > %" PRELUDE_PRIu64,
-                                             (uint64_t) (msg->hdr.datalen + tmp), (uint64_t) max_message_size);
+        gl_tls_set(msg_pool_key, cache);
 
-        msg->hdr.datalen += tmp;
+        gl_lock_lock(msg_pool_mutex);
+        prelude_list_add_tail(&msg_pool_cache_list, &cache->list);
+        gl_lock_unlock(msg_pool_mutex);
 
-        return 0;
+        return cache;
 }
 
 
 
-
-static int read_message_header(prelude_msg_t **msgptr, prelude_io_t *fd)
+static prelude_msg_t *msg_pool_alloc(size_t capacity)
 {
-        int ret;
-        size_t count;
-        uint32_t old_dlen;
-        prelude_msg_t *msg = *msgptr;
-        unsigned char *hdrptr = &msg->hdrbuf[msg->header_index];
-
-        count = PRELUDE_MSG_HDR_SIZE - msg->header_index;
+        int class;
+        prelude_msg_t *msg;
+        msg_pool_cache_t *cache;
+        msg_pool_block_t *block = NULL;
+
+        class = msg_pool_get_class(capacity);
+        if ( class != MSG_POOL_NO_CLASS ) {
+                capacity = msg_pool_class_size[class];
+
+                cache = msg_pool_get_cache();
+                if ( cache ) {
+                        if ( ! cache->free[class] )
+                                msg_pool_cache_refill(cache, class);
+
+                        block = cache->free[class];
+                        if ( ! block )
+                                cache->misses++;
+                        else {
+                                cache->free[class] = block->next;
+                                cache->count[class]--;
+                                cache->hits++;
+                        }
+                }
+        }
 
-        ret = read_message_data(hdrptr, &count, fd);
-        msg->header_index += count;
+        if ( ! block ) {
+                block = malloc(sizeof(prelude_msg_t) + capacity);
+                if ( ! block )
+                        return NULL;
+        }
 
-        if ( ret < 0 )
-                return ret;
+        msg = (prelude_msg_t *) block;
+        msg->pool_class = class;
+        msg->capacity = capacity;
+        msg->borrowed = FALSE;
 
-        /*
-         * we have a full header. Move it from our buffer
-         * into a real header structure.
-         */
-        old_dlen = msg->hdr.datalen;
-        ret = slice_message_header(msg, msg->hdrbuf);
-        if ( ret < 0 )
-                return ret;
+        msg->dict = NULL;
+        msg->dict_first = DICT_NO_ID;
+        msg->dict_end = 0;
+        msg->chunk_index = PRELUDE_MSG_HDR_SIZE;
 
-        /*
-         * sanity check. An attacker could arrange to make datalen
-         * wrap arround by specifying an odd dlen in a fragment header.
-         */
-        if ( (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE) <= old_dlen )
-                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+        return msg;
+}
 
-        /*
-         * Check protocol version.
-         */
-        if ( msg->hdr.version != PRELUDE_MSG_VERSION )
-                return prelude_error_verbose(PRELUDE_ERROR_PROTOCOL_VERSION, "invalid protocol version '%d' (expected %d)",
-                                             msg->hdr.version, PRELUDE_MSG_VERSION);
 
-        msg->write_index = msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE;
 
-        /*
-         * allocate our data buffer. We also want our buffer to be able to contain an
-         * header so that it can be eventually sent...
-         */
+static void msg_pool_release(prelude_msg_t *msg)
+{
+        int class = msg->pool_class;
+        msg_pool_cache_t *cache;
+        msg_pool_block_t *block = (msg_pool_block_t *) msg;
 
-        msg = _prelude_realloc(msg, sizeof(*msg) + PRELUDE_MSG_HDR_SIZE + msg->hdr.datalen);
-        if ( ! msg )
-                return prelude_error_from_errno(errno);
+        if ( class == MSG_POOL_NO_CLASS || ! (cache = msg_pool_get_cache()) ) {
+                free(msg);
+                return;
+        }
 
-        *msgptr = msg;
-        msg->payload = ((unsigned char *) msg) + sizeof(*msg);
+        if ( cache->count[class] == MSG_POOL_THREAD_CACHE_SIZE )
+                msg_pool_cache_drain(cache, class, MSG_POOL_THREAD_CACHE_SIZE / 2);
 
-        return 0;
+        block->next = cache->free[class];
+        cache->free[class] = block;
+        cache->count[class]++;
 }
 
 
 
-
-static int read_message_content(prelude_msg_t **m, prelude_io_t *fd)
+static int call_alloc_cb(prelude_msg_t **msg)
 {
         int ret;
-        size_t count;
-        prelude_msg_t *msg = *m;
-
-        count = (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE) - msg->read_index;
+        uint8_t version = (*msg)->hdr.version;
+        prelude_msg_dict_t *dict = ((*msg)->dict) ? dict_ref((*msg)->dict) : NULL;
 
-        ret = read_message_data(&msg->payload[msg->read_index], &count, fd);
-        msg->read_index += count;
+        ret = (*msg)->flush_msg_cb(msg, (*msg)->send_msg_data);
+        if ( ret < 0 ) {
+                if ( dict )
+                        _prelude_msg_dict_destroy(dict);
 
-        if ( ret != 0 )
-                /*
-                 * there is still data to be read.
-                 */
                 return ret;
+        }
+
+        /*
+         * Within the callback, the caller have the choise to use
+         * a newly allocated message or to flush the current message and
+         * reuse it.
+         *
+         * We have to reset write_index and is_fragment header member
+         * in order to properly address the message buffer. And in order
+         * for not all message to not look like fragment.
+         */
+        (*msg)->header_index = 0;
+        (*msg)->write_index = PRELUDE_MSG_HDR_SIZE;
+        (*msg)->hdr.is_fragment = 0;
+
+        /*
+         * The remaining fragments use the same encoding.
+         */
+        (*msg)->hdr.version = version;
+
+        (*msg)->dict_first = DICT_NO_ID;
+        (*msg)->dict_end = 0;
+        (*msg)->chunk_index = PRELUDE_MSG_HDR_SIZE;
+
+        if ( ! (*msg)->dict )
+                (*msg)->dict = dict;
+
+        else if ( dict )
+                _prelude_msg_dict_destroy(dict);
+
+        return 0;
+}
+
+
+
+static int check_version(uint8_t version)
+{
+        if ( version >= PRELUDE_MSG_VERSION_1 && version <= PRELUDE_MSG_VERSION_2 )
+                return 0;
+
+        return prelude_error_verbose(PRELUDE_ERROR_PROTOCOL_VERSION, "invalid protocol version '%d' (expected %d to %d)",
+                                     version, PRELUDE_MSG_VERSION_1, PRELUDE_MSG_VERSION_2);
+}
+
+
+
+static size_t varint_encode(unsigned char *buf, uint64_t value)
+{
+        size_t i = 0;
+
+        while ( value >= 0x80 ) {
+                buf[i++] = (value & 0x7f) | 0x80;
+                value >>= 7;
+        }
+
+        buf[i++] = value;
+
+        return i;
+}
+
+
+
+static size_t varint_size(uint64_t value)
+{
+        unsigned char buf[VARINT_MAX_SIZE];
+        return varint_encode(buf, value);
+}
+
+
+
+static int varint_get(const unsigned char *buf, uint32_t end, uint32_t *index, uint64_t *value)
+{
+        unsigned char byte;
+        unsigned int shift = 0;
+
+        *value = 0;
+
+        do {
+                if ( *index >= end || shift >= 64 )
+                        return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+                byte = buf[(*index)++];
+                *value |= (uint64_t) (byte & 0x7f) << shift;
+                shift += 7;
+
+        } while ( byte & 0x80 );
+
+        return 0;
+}
+
+
+
+/*
+ * Parse the PRELUDE_MSG_VERSION_2 chunk starting at *index. The content
+ * of a raw chunk might extend past @end, when a fragment is parsed on
+ * its own.
+ */
+static int next_chunk(unsigned char *buf, uint32_t end, uint32_t *index, chunk_t *chunk)
+{
+        int ret;
+        uint64_t hdr;
+        uint32_t start;
+
+        if ( *index >= end )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        chunk->tag = buf[(*index)++];
+
+        ret = varint_get(buf, end, index, &hdr);
+        if ( ret < 0 )
+                return ret;
+
+        if ( (hdr >> 2) > UINT32_MAX )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        chunk->type = hdr & 0x03;
+        chunk->len = hdr >> 2;
+        chunk->data = &buf[*index];
+
+        if ( chunk->type == CHUNK_TYPE_RAW ) {
+                chunk->size = MIN(chunk->len, end - *index);
+                *index += chunk->size;
+                return 0;
+        }
+
+        if ( chunk->type != CHUNK_TYPE_DICT ) {
+                if ( chunk->len != 1 && chunk->len != 2 && chunk->len != 4 && chunk->len != 8 )
+                        return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+                start = *index;
+
+                ret = varint_get(buf, end, index, &chunk->value);
+                if ( ret < 0 )
+                        return ret;
+
+                chunk->size = *index - start;
+                return 0;
+        }
+
+        if ( chunk->len > end - *index )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        start = *index;
+        *index += chunk->len;
+        chunk->size = chunk->len;
+
+        ret = varint_get(buf, *index, &start, &chunk->value);
+        if ( ret < 0 )
+                return ret;
+
+        if ( chunk->value >= DICT_MAX_ENTRIES )
+                return prelude_error_verbose(PRELUDE_ERROR_INVAL_MESSAGE, "invalid dictionary identifier %" PRELUDE_PRIu64, chunk->value);
+
+        chunk->strlen = *index - start;
+        chunk->str = (chunk->strlen) ? (char *) &buf[start] : NULL;
+
+        if ( chunk->str && (chunk->strlen > DICT_MAX_STRING_LEN || chunk->str[chunk->strlen - 1] != 0) )
+                return prelude_error_verbose(PRELUDE_ERROR_INVAL_MESSAGE, "invalid dictionary string");
+
+        return 0;
+}
+
+
+
+static int dict_new(prelude_msg_dict_t **dict)
+{
+        *dict = calloc(1, sizeof(**dict));
+        if ( ! *dict )
+                return prelude_error_from_errno(errno);
+
+        (*dict)->refcount = 1;
+        gl_lock_init((*dict)->mutex);
+
+        return 0;
+}
+
+
+
+static prelude_msg_dict_t *dict_ref(prelude_msg_dict_t *dict)
+{
+        gl_lock_lock(dict->mutex);
+        dict->refcount++;
+        gl_lock_unlock(dict->mutex);
+
+        return dict;
+}
+
+
+
+/*
+ * @len includes the terminating nul byte.
+ */
+static int dict_add(prelude_msg_dict_t *dict, const char *str, uint32_t len)
+{
+        char *data;
+
+        data = malloc(len);
+        if ( ! data )
+                return prelude_error_from_errno(errno);
+
+        memcpy(data, str, len - 1);
+        data[len - 1] = 0;
+
+        dict->entries[dict->count].data = data;
+        dict->entries[dict->count].len = len;
+        dict->count++;
+
+        return 0;
+}
+
+
+
+static uint32_t dict_hash(const char *str, size_t len)
+{
+        size_t i;
+        uint32_t hash = 2166136261U;
+
+        for ( i = 0; i < len; i++ ) {
+                hash ^= (unsigned char) str[i];
+                hash *= 16777619U;
+        }
+
+        return hash;
+}
+
+
+
+/*
+ * Returns the identifier of @str in @dict, or DICT_NO_ID if it is to be
+ * sent in full. *define is set if the identifier was just allocated.
+ */
+static uint32_t dict_get_id(prelude_msg_dict_t *dict, const char *str, size_t len, prelude_bool_t *define)
+{
+        uint32_t hash, i, id;
+
+        *define = FALSE;
+
+        if ( len + 1 > DICT_MAX_STRING_LEN )
+                return DICT_NO_ID;
+
+        if ( ! dict->hash ) {
+                dict->hash = calloc(DICT_HASH_SIZE, sizeof(*dict->hash));
+                dict->seen = calloc(DICT_HASH_SIZE, sizeof(*dict->seen));
+                if ( ! dict->hash || ! dict->seen )
+                        return DICT_NO_ID;
+        }
+
+        hash = dict_hash(str, len);
+
+        for ( i = hash % DICT_HASH_SIZE; dict->hash[i]; i = (i + 1) % DICT_HASH_SIZE ) {
+                id = dict->hash[i] - 1;
+
+                if ( dict->entries[id].len == len + 1 && memcmp(dict->entries[id].data, str, len) == 0 )
+                        return id;
+        }
+
+        /*
+         * Strings only get an identifier once they repeat, so that unique
+         * values do not fill the dictionary.
+         */
+        if ( dict->count == DICT_MAX_ENTRIES || dict->seen[hash % DICT_HASH_SIZE] != hash ) {
+                dict->seen[hash % DICT_HASH_SIZE] = hash;
+                return DICT_NO_ID;
+        }
+
+        if ( dict_add(dict, str, len + 1) < 0 )
+                return DICT_NO_ID;
+
+        dict->hash[i] = dict->count;
+        *define = TRUE;
+
+        return dict->count - 1;
+}
+
+
+
+static void write_message_header(prelude_msg_t *msg)
+{
+        uint32_t dlen;
+        struct timeval tv;
+        uint32_t hdr_offset = msg->header_index;
+
+        if ( msg->borrowed )
+                return;
+
+        dlen = htonl(msg->write_index - msg->header_index - PRELUDE_MSG_HDR_SIZE);
+
+        msg->payload[hdr_offset++] = msg->hdr.version;
+        msg->payload[hdr_offset++] = msg->hdr.tag;
+        msg->payload[hdr_offset++] = msg->hdr.priority;
+        msg->payload[hdr_offset++] = msg->hdr.is_fragment;
+
+        gettimeofday(&tv, NULL);
+
+        msg->hdr.tv_sec = htonl(tv.tv_sec);
+        msg->hdr.tv_usec = htonl(tv.tv_usec);
+
+        memcpy(&msg->payload[hdr_offset], &dlen, sizeof(dlen));
+        memcpy(&msg->payload[hdr_offset + 4], &msg->hdr.tv_sec, sizeof(msg->hdr.tv_sec));
+        memcpy(&msg->payload[hdr_offset + 8], &msg->hdr.tv_usec, sizeof(msg->hdr.tv_usec));
+}
+
+
+
+
+static int set_data(prelude_msg_t **m, const void *buf, size_t size)
+{
+        int ret;
+        size_t remaining;
+        prelude_msg_t *msg = *m;
+
+        remaining = (msg->hdr.datalen - msg->write_index);
+        assert(msg->flush_msg_cb != NULL || remaining >= size);
+
+        if ( size > remaining ) {
 
-        if ( msg->hdr.is_fragment ) {
                 /*
-                 * We just finished reading one fragment (not the last one).
-                 * Next bytes will be another message header. So reset header_index
-                 * to trigger header read on next prelude_msg_read() call.
+                 * there is not enough free buffer space to store the whole
+                 * data in the message. Store what we can, and call the message
+                 * flushing function, which'll emit the current buffer
+                 * and allocate a new one.
                  */
-                msg->header_index = 0;
-                return prelude_msg_read(m, fd);
+                memcpy(msg->payload + msg->write_index, buf, remaining);
+
+                size -= remaining;
+                msg->write_index += remaining;
+                buf = (const uint8_t *) buf + remaining;
+
+                /*
+                 * this is a fragment of message.
+                 */
+                msg->hdr.is_fragment = 1;
+
+                /*
+                 * the caller might destroy the message after this and re-allocate
+                 * one... or use synchronous send and reuse the same message.
+                 */
+                ret = call_alloc_cb(m);
+                if ( ret < 0 )
+                        return ret;
+
+                /*
+                 * The remaining data do not start a new chunk.
+                 */
+                (*m)->chunk_index = (*m)->write_index + MIN(size, (*m)->hdr.datalen - (*m)->write_index);
+
+                return set_data(m, buf, size);
         }
 
+        memcpy(msg->payload + msg->write_index, buf, size);
+        msg->write_index += size;
+
+        return 0;
+}
+
+
+
+/*
+ * With version 2, chunk headers and chunks other than raw ones are
+ * never split over two fragments, so that each fragment can be parsed
+ * on its own, see _prelude_msg_expand() and _prelude_msg_downgrade().
+ */
+static int reserve(prelude_msg_t **msg, size_t size)
+{
+        if ( (*msg)->hdr.version != PRELUDE_MSG_VERSION_2 || ! (*msg)->flush_msg_cb )
+                return 0;
+
+        if ( (*msg)->hdr.datalen - (*msg)->write_index >= size || prelude_msg_is_empty(*msg) )
+                return 0;
+
+        (*msg)->hdr.is_fragment = 1;
+
+        return call_alloc_cb(msg);
+}
+
+
+
+
+inline static int read_message_data(unsigned char *dst, size_t *size, prelude_io_t *fd)
+{
+        ssize_t ret;
+        size_t count = *size;
+
+        *size = 0;
 
         /*
-         * we now have a full message.
-         *
-         * reset is_fragment to 0, so that if the message is written in the future,
-         * it won't be marked as fragmented (we already defragmented it).
-         *
+         * Read the whole header.
+         */
+        do {
+                ret = prelude_io_read(fd, dst + *size, count - *size);
+                if ( ret < 0 )
+                        return ret;
+
+                *size += ret;
+
+        } while ( *size != count );
+
+        return 0;
+}
+
+
+
+
+
+inline static int slice_message_header(prelude_msg_t *msg, unsigned char *hdrbuf)
+{
+        uint32_t tmp;
+
+        if ( ! msg->hdr.datalen ) {
+                /*
+                 * tag and priority are set on first fragment only.
+                 */
+                msg->hdr.version = hdrbuf[0];
+                msg->hdr.tag = hdrbuf[1];
+                msg->hdr.tv_sec = prelude_extract_uint32(hdrbuf + 8);
+                msg->hdr.tv_usec = prelude_extract_uint32(hdrbuf + 12);
+        }
+
+        /*
+         * message priority might be set in any fragment.
+         */
+        if ( msg->hdr.priority == PRELUDE_MSG_PRIORITY_NONE )
+                msg->hdr.priority = hdrbuf[2];
+
+        msg->hdr.is_fragment = hdrbuf[3];
+        tmp = prelude_extract_uint32(hdrbuf + 4);
+
+        if ( (msg->hdr.datalen + tmp) <= msg->hdr.datalen )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        if ( (msg->hdr.datalen + tmp) >= max_message_size )
+                return prelude_error_verbose(PRELUDE_ERROR_INVAL_LENGTH, "maximum message size exceeded: %" PRELUDE_PRIu64 " > %" PRELUDE_PRIu64,
+                                             (uint64_t) (msg->hdr.datalen + tmp), (uint64_t) max_message_size);
+
+        msg->hdr.datalen += tmp;
+
+        return 0;
+}
+
+
+
+
+static int read_message_header(prelude_msg_t **msgptr, prelude_io_t *fd)
+{
+        int ret;
+        size_t count;
+        uint32_t old_dlen;
+        prelude_msg_t *msg = *msgptr;
+        unsigned char *hdrptr = &msg->hdrbuf[msg->header_index];
+
+        count = PRELUDE_MSG_HDR_SIZE - msg->header_index;
+
+        ret = read_message_data(hdrptr, &count, fd);
+        msg->header_index += count;
+
+        if ( ret < 0 )
+                return ret;
+
+        /*
+         * we have a full header. Move it from our buffer
+         * into a real header structure.
+         */
+        old_dlen = msg->hdr.datalen;
+        ret = slice_message_header(msg, msg->hdrbuf);
+        if ( ret < 0 )
+                return ret;
+
+        /*
+         * sanity check. An attacker could arrange to make datalen
+         * wrap arround by specifying an odd dlen in a fragment header.
+         */
+        if ( (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE) <= old_dlen )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        /*
+         * Check protocol version.
+         */
+        ret = check_version(msg->hdr.version);
+        if ( ret < 0 )
+                return ret;
+
+        msg->write_index = msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE;
+
+        /*
+         * allocate our data buffer. We also want our buffer to be able to contain an
+         * header so that it can be eventually sent...
+         */
+
+        if ( PRELUDE_MSG_HDR_SIZE + msg->hdr.datalen > msg->capacity ) {
+                int class;
+                size_t capacity;
+
+                msg = msg_pool_alloc(PRELUDE_MSG_HDR_SIZE + msg->hdr.datalen);
+                if ( ! msg )
+                        return prelude_error_from_errno(errno);
+
+                class = msg->pool_class;
+                capacity = msg->capacity;
+
+                memcpy(msg, *msgptr, sizeof(*msg) + ((*msgptr)->payload ? (*msgptr)->read_index : 0));
+                msg_pool_release(*msgptr);
+
+                msg->pool_class = class;
+                msg->capacity = capacity;
+        }
+
+        *msgptr = msg;
+        msg->payload = ((unsigned char *) msg) + sizeof(*msg);
+
+        return 0;
+}
+
+
+
+
+static int read_message_content(prelude_msg_t **m, prelude_io_t *fd)
+{
+        int ret;
+        size_t count;
+        prelude_msg_t *msg = *m;
+
+        count = (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE) - msg->read_index;
+
+        ret = read_message_data(&msg->payload[msg->read_index], &count, fd);
+        msg->read_index += count;
+
+        if ( ret != 0 )
+                /*
+                 * there is still data to be read.
+                 */
+                return ret;
+
+        if ( msg->hdr.is_fragment ) {
+                /*
+                 * We just finished reading one fragment (not the last one).
+                 * Next bytes will be another message header. So reset header_index
+                 * to trigger header read on next prelude_msg_read() call.
+                 */
+                msg->header_index = 0;
+                return prelude_msg_read(m, fd);
+        }
+
+
+        /*
+         * we now have a full message.
+         *
+         * reset is_fragment to 0, so that if the message is written in the future,
+         * it won't be marked as fragmented (we already defragmented it).
+         *
          * Reset header_index to 0 because we would compute an invalid datalen
          * if this message is to be written in the future.
          *
@@ -367,215 +1050,1069 @@ static int read_message_content(prelude_msg_t **m, prelude_io_t *fd)
          */
         msg->hdr.is_fragment = 0;
         msg->header_index = 0;
-        msg->read_index = PRELUDE_MSG_HDR_SIZE;
+        msg->read_index = PRELUDE_MSG_HDR_SIZE;
+
+        return ret;
+}
+
+
+
+
+
+
+/**
+ * prelude_msg_read:
+ * @msg: Pointer on a #prelude_msg_t object address.
+ * @pio: Pointer on a #prelude_io_t object.
+ *
+ * Read a message on @pio into @msg. If @msg is NULL, it is
+ * allocated. This function will never block.
+ *
+ * Returns: 0 if reading the message is complete, or a #prelude_error_t
+ * error if an error occured. Take particular attention to #PRELUDE_ERROR_EAGAIN
+ * and PRELUDE_ERROR_EOF.
+ */
+int prelude_msg_read(prelude_msg_t **msg, prelude_io_t *pio)
+{
+        int ret = 0;
+
+        /*
+         * *msg is NULL,
+         * this mean the caller want to work on a new message.
+         */
+        if ( ! *msg ) {
+                *msg = msg_pool_alloc(0);
+                if ( ! *msg )
+                        return prelude_error_from_errno(errno);
+
+                (*msg)->refcount = 1;
+                (*msg)->hdr.datalen = 0;
+                (*msg)->hdr.priority = PRELUDE_MSG_PRIORITY_NONE;
+
+                (*msg)->payload = NULL;
+                (*msg)->write_index = 0;
+                (*msg)->header_index = 0;
+                (*msg)->fd_write_index = 0;
+                (*msg)->read_index = PRELUDE_MSG_HDR_SIZE;
+        }
+
+        /*
+         * We didn't finished reading the message header yet.
+         */
+        if ( (*msg)->header_index != PRELUDE_MSG_HDR_SIZE )
+                ret = read_message_header(msg, pio);
+
+        /*
+         * Notice that ret is initialized to 0 so that we will read
+         * the message if this function is called and we already have
+         * the header.
+         *
+         * In case read_message_header return PRELUDE_ERROR_EAGAIN,
+         * we don't want to try to read the rest of the message right now,
+         * as it is unlikely we can read something.
+         *
+         * In case it return 0, there is some chance there are other data
+         * waiting to be read.
+         */
+        if ( (*msg)->payload && ret == 0 )
+                ret = read_message_content(msg, pio);
+
+        /*
+         * check for msg as well since this function can be called recursively.
+         */
+        if ( *msg && ret < 0 && prelude_error_get_code(ret) != PRELUDE_ERROR_EAGAIN ) {
+                prelude_msg_destroy(*msg);
+                /*
+                 * reset message to NULL, because the caller might not take
+                 * care of the return value enough (and may call us again with an
+                 * undefined *msg address.
+                 */
+                *msg = NULL;
+        }
+
+        return ret;
+}
+
+
+
+
+static int get_dict_string(prelude_msg_t *msg, chunk_t *chunk, uint32_t *len, void **buf)
+{
+        dict_entry_t *entry;
+
+        if ( chunk->str ) {
+                *len = chunk->strlen;
+                *buf = chunk->str;
+                return 0;
+        }
+
+        /*
+         * References are resolved with the dictionary of the connection
+         * the message was received from, see _prelude_msg_load_dict().
+         */
+        if ( ! msg->dict || chunk->value >= msg->dict_end )
+                return prelude_error_verbose(PRELUDE_ERROR_INVAL_MESSAGE, "unknown dictionary identifier %" PRELUDE_PRIu64, chunk->value);
+
+        entry = &msg->dict->entries[chunk->value];
+
+        *len = entry->len;
+        *buf = entry->data;
+
+        return 0;
+}
+
+
+
+/*
+ * Store the value of an integer chunk in @buf the way version 1 does.
+ */
+static void get_chunk_integer(const chunk_t *chunk, unsigned char *buf)
+{
+        size_t i;
+        uint64_t value = chunk->value;
+
+        if ( chunk->type == CHUNK_TYPE_INT )
+                value = (value >> 1) ^ (~(value & 1) + 1);
+
+        for ( i = chunk->len; i > 0; i-- ) {
+                buf[i - 1] = value & 0xff;
+                value >>= 8;
+        }
+}
+
+
+
+static int get_compact_chunk(prelude_msg_t *msg, uint8_t *tag, uint32_t *len, void **buf)
+{
+        int ret;
+        chunk_t chunk;
+
+        ret = next_chunk(msg->payload, msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE, &msg->read_index, &chunk);
+        if ( ret < 0 )
+                return ret;
+
+        *tag = chunk.tag;
+        *len = chunk.len;
+
+        if ( chunk.type == CHUNK_TYPE_RAW ) {
+                if ( chunk.size != chunk.len )
+                        return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+                if ( chunk.len )
+                        *buf = chunk.data;
+
+                return 0;
+        }
+
+        if ( chunk.type == CHUNK_TYPE_DICT )
+                return get_dict_string(msg, &chunk, len, buf);
+
+        /*
+         * Hand the integer over the way version 1 stores it.
+         */
+        get_chunk_integer(&chunk, msg->intbuf);
+        *buf = msg->intbuf;
+
+        return 0;
+}
+
+
+
+
+/**
+ * prelude_msg_get:
+ * @msg: Pointer on a #prelude_msg_t object representing the message to get data from.
+ * @tag: Pointer on a 8 bits unsigned integer to store the message tag.
+ * @len: Pointer on a 32 bits unsigned integer to store the message len to.
+ * @buf: Address of a pointer to store the buffer starting address.
+ *
+ * prelude_msg_get() read the next data chunk contained in the message.
+ * @tag is updated to contain the kind of data the chunk contain.
+ * @len is updated to contain the len of the data chunk.
+ * @buf is updated to point on the data chunk.
+ *
+ * Returns: 0 on success, or a #prelude_error_t value on error.
+ */
+int prelude_msg_get(prelude_msg_t *msg, uint8_t *tag, uint32_t *len, void **buf)
+{
+        if ( msg->read_index == (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE) ) {
+                /*
+                 * no more sub - messages in the buffer.
+                 */
+                return prelude_error(PRELUDE_ERROR_EOF);
+        }
+
+        if ( msg->hdr.version == PRELUDE_MSG_VERSION_2 )
+                return get_compact_chunk(msg, tag, len, buf);
+
+        /*
+         * bound check our buffer,
+         * so that we won't overflow if it doesn't contain tag and len.
+         */
+        if ( msg->read_index > (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE - 5) )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        /*
+         * slice wanted data.
+         */
+        *tag = msg->payload[msg->read_index++];
+        *len = prelude_extract_uint32(&msg->payload[msg->read_index]);
+        msg->read_index += sizeof(uint32_t);
+
+        if ( ! *len )
+                return 0;
+
+        /*
+         * bound check again, against specified len.
+         */
+        if ( (msg->read_index + *len) <= msg->read_index )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        if ( (msg->read_index + *len) > (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE) )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+        *buf = &msg->payload[msg->read_index];
+        msg->read_index += *len;
+
+        return 0;
+}
+
+
+
+
+/**
+ * prelude_msg_forward_full:
+ * @msg: Pointer on a #prelude_msg_t object containing a message header.
+ * @dst: Pointer on a #prelude_io_t object to send message to.
+ * @src: Pointer on a #prelude_io_t object to read message from.
+ * @flags: Forwarding flags.
+ *
+ * Same as prelude_msg_forward(). With #PRELUDE_IO_FORWARD_FLAGS_MORE,
+ * the message might be kept so that it is written to @dst together
+ * with the next ones, see prelude_io_forward_full().
+ *
+ * Messages are forwarded as is: those received from a connection using
+ * %PRELUDE_CONNECTION_FEATURE_DICTIONARY might reference strings that
+ * only this connection knows about.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_msg_forward_full(prelude_msg_t *msg, prelude_io_t *dst, prelude_io_t *src, prelude_io_forward_flags_t flags)
+{
+        ssize_t ret;
+        uint32_t dlen = htonl(msg->hdr.datalen);
+        unsigned char buf[PRELUDE_MSG_HDR_SIZE];
+
+        buf[0] = msg->hdr.version;
+        buf[1] = msg->hdr.tag;
+        buf[2] = msg->hdr.priority;
+        buf[3] = msg->hdr.is_fragment;
+
+        memcpy(&buf[4], &dlen, sizeof(dlen));
+
+        /*
+         * The header goes out along with the message data.
+         */
+        ret = prelude_io_forward_full(dst, src, buf, sizeof(buf), msg->hdr.datalen, flags);
+        if ( ret < 0 )
+                return ret;
+
+        return 0;
+}
+
+
+
+/**
+ * prelude_msg_forward:
+ * @msg: Pointer on a #prelude_msg_t object containing a message header.
+ * @dst: Pointer on a #prelude_io_t object to send message to.
+ * @src: Pointer on a #prelude_io_t object to read message from.
+ *
+ * prelude_msg_forward() read the message corresponding to the @msg object
+ * containing the message header previously gathered using prelude_msg_read_header()
+ * from the @src object, and transfer it to @dst. The header is also transfered.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_msg_forward(prelude_msg_t *msg, prelude_io_t *dst, prelude_io_t *src)
+{
+        return prelude_msg_forward_full(msg, dst, src, 0);
+}
+
+
+
+static uint32_t get_write_len(prelude_msg_t *msg)
+{
+        if ( msg->write_index <= PRELUDE_MSG_HDR_SIZE )
+                return 0;
+
+        /*
+         * prelude_msg_mark_end() was called, the trailing header
+         * space is not part of the message.
+         */
+        if ( msg->header_index != 0 && ! msg->hdr.is_fragment )
+                return msg->write_index - PRELUDE_MSG_HDR_SIZE;
+
+        return msg->write_index;
+}
+
+
+
+static int flush_iovec(prelude_io_t *dst, struct iovec *iov, int iovcnt, size_t len, size_t *windex)
+{
+        ssize_t ret;
+
+        ret = prelude_io_writev(dst, iov, iovcnt);
+        if ( ret < 0 )
+                return ret;
+
+        *windex += ret;
+
+        return ( (size_t) ret == len ) ? 0 : prelude_error(PRELUDE_ERROR_EAGAIN);
+}
+
+
+
+/**
+ * prelude_msg_write_r:
+ * @msg: Pointer on a #prelude_msg_t object containing the message.
+ * @dst: Pointer on a #prelude_io_t object to send the message to.
+ * @windex: Number of byte written to @dst
+ *
+ * prelude_msg_write_r() write the message corresponding to the @msg
+ * object to @dst. The message should have been created using the
+ * prelude_msg_new() and prelude_msg_set() functions.
+ *
+ * @windex is used to hold the number of byte written to @dst in case
+ * the write could not complete (PRELUDE_ERROR_EAGAIN). In case the write
+ * is complete, it's value is reset to 0.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_msg_write_r(prelude_msg_t *msg, prelude_io_t *dst, uint32_t *windex)
+{
+        ssize_t ret;
+        uint32_t dlen;
+
+        /*
+         * no need to send... There's no data in this message.
+         */
+        dlen = get_write_len(msg);
+        if ( dlen == 0 )
+                return 0;
+
+        /*
+         * if the message header index is 0 (write called, without
+         * prelude_msg_mark_end() first), mark end of the message
+         * cause the caller didn't do it in this case.
+         */
+        if ( msg->header_index == 0 )
+                write_message_header(msg);
+
+        ret = prelude_io_write(dst, msg->payload + *windex, dlen - *windex);
+        if ( ret < 0 )
+                return ret;
+
+        *windex += ret;
+
+        if ( *windex == dlen ) {
+                *windex = 0;
+                return 0;
+        }
+
+        return prelude_error(PRELUDE_ERROR_EAGAIN);
+}
+
+
+
+/**
+ * prelude_msg_writev:
+ * @msgs: Array of pointer on #prelude_msg_t objects.
+ * @count: Number of message in @msgs.
+ * @dst: Pointer on a #prelude_io_t object to send the messages to.
+ * @windex: Number of byte written to @dst
+ *
+ * prelude_msg_writev() write the @count messages from @msgs to @dst, in
+ * order, using as few underlying write operation as possible (see
+ * prelude_io_writev()). This is typically used to flush a set of queued
+ * messages, or the fragments of a dynamic message, in one go.
+ *
+ * @windex is used to hold the number of byte of the whole batch written to
+ * @dst in case the write could not complete (PRELUDE_ERROR_EAGAIN). The same
+ * batch should then be provided again. In case the write is complete, it's
+ * value is reset to 0.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_msg_writev(prelude_msg_t **msgs, size_t count, prelude_io_t *dst, size_t *windex)
+{
+        int ret, iovcnt = 0;
+        uint32_t dlen;
+        size_t i, len = 0, skip;
+        struct iovec iov[MSG_IOV_MAX];
+
+        prelude_return_val_if_fail(msgs || count == 0, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(dst, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(windex, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        skip = *windex;
+
+        for ( i = 0; i < count; i++ ) {
+                dlen = get_write_len(msgs[i]);
+
+                /*
+                 * Skip data that were written by a previous, incomplete, call.
+                 */
+                if ( skip >= dlen ) {
+                        skip -= dlen;
+                        continue;
+                }
+
+                if ( skip == 0 && msgs[i]->header_index == 0 )
+                        write_message_header(msgs[i]);
+
+                iov[iovcnt].iov_base = msgs[i]->payload + skip;
+                iov[iovcnt].iov_len = dlen - skip;
+                len += iov[iovcnt++].iov_len;
+                skip = 0;
+
+                if ( iovcnt == MSG_IOV_MAX ) {
+                        ret = flush_iovec(dst, iov, iovcnt, len, windex);
+                        if ( ret < 0 )
+                                return ret;
+
+                        iovcnt = len = 0;
+                }
+        }
+
+        if ( iovcnt > 0 ) {
+                ret = flush_iovec(dst, iov, iovcnt, len, windex);
+                if ( ret < 0 )
+                        return ret;
+        }
+
+        *windex = 0;
+
+        return 0;
+}
+
+
+
+/**
+ * prelude_msg_write:
+ * @msg: Pointer on a #prelude_msg_t object containing the message.
+ * @dst: Pointer on a #prelude_io_t object to send the message to.
+ *
+ * prelude_msg_write() write the message corresponding to the @msg
+ * object to @dst. The message should have been created using the
+ * prelude_msg_new() and prelude_msg_set() functions.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_msg_write(prelude_msg_t *msg, prelude_io_t *dst)
+{
+        return prelude_msg_write_r(msg, dst, &msg->fd_write_index);
+}
+
+
+
+
+/**
+ * prelude_msg_recycle:
+ * @msg: Pointer on #prelude_msg_t object.
+ *
+ * Recycle @msg so you can write at it again, even
+ * thought it was written.
+ */
+void prelude_msg_recycle(prelude_msg_t *msg)
+{
+        msg->header_index = 0;
+        msg->fd_write_index = 0;
+        msg->write_index = PRELUDE_MSG_HDR_SIZE;
+        msg->payload = (unsigned char *) msg + sizeof(*msg);
+
+        if ( msg->dict ) {
+                _prelude_msg_dict_destroy(msg->dict);
+                msg->dict = NULL;
+        }
+
+        msg->dict_first = DICT_NO_ID;
+        msg->dict_end = 0;
+        msg->chunk_index = PRELUDE_MSG_HDR_SIZE;
+
+        if ( msg->read_index )
+                msg->read_index = PRELUDE_MSG_HDR_SIZE;
+}
+
+
+
+/**
+ * prelude_msg_mark_end:
+ * @msg: Pointer on #prelude_msg_t object.
+ *
+ * Mark end of message in the @msg buffer, so you can continue
+ * adding different message in the same buffer.
+ */
+void prelude_msg_mark_end(prelude_msg_t *msg)
+{
+        int ret;
+
+        if ( msg->write_index - msg->header_index - PRELUDE_MSG_HDR_SIZE <= 0 )
+                return;
+
+        write_message_header(msg);
+
+        if ( msg->write_index + PRELUDE_MSG_HDR_SIZE + MINIMUM_FRAGMENT_DATA_SIZE > msg->hdr.datalen ) {
+
+                ret = call_alloc_cb(&msg);
+                if ( ret < 0 )
+                        return;
+        } else {
+                msg->header_index = msg->write_index;
+                msg->write_index += PRELUDE_MSG_HDR_SIZE;
+        }
+}
+
+
+
+
+/**
+ * prelude_msg_set:
+ * @msg: Pointer on a #prelude_msg_t object to store the data to.
+ * @tag: 8 bits unsigned integer describing the kind of data.
+ * @len: len of the data chunk.
+ * @data: Pointer to the starting address of the data.
+ *
+ * prelude_msg_set() append @len bytes of data from the @data buffer
+ * to the @msg object representing a message. The data is tagged with @tag.
+ *
+ * Returns: 0 on success, or a negative value if the remaining space is not
+ * available. You might check the return value mostly if using a dynamic message
+ * through prelude_msg_dynamic_new()
+ */
+int prelude_msg_set(prelude_msg_t *msg, uint8_t tag, uint32_t len, const void *data)
+{
+        int ret;
+        uint32_t l;
+        unsigned char hdr[1 + VARINT_MAX_SIZE];
+
+        if ( msg->hdr.version == PRELUDE_MSG_VERSION_2 ) {
+                hdr[0] = tag;
+                l = 1 + varint_encode(hdr + 1, ((uint64_t) len << 2) | CHUNK_TYPE_RAW);
+
+                ret = reserve(&msg, l);
+                if ( ret < 0 )
+                        return ret;
+
+                ret = set_data(&msg, hdr, l);
+                if ( ret < 0 )
+                        return ret;
+
+                return set_data(&msg, data, len);
+        }
+
+        l = htonl(len);
+
+        ret = set_data(&msg, &tag, sizeof(tag));
+        if ( ret < 0 )
+                return ret;
+
+        ret = set_data(&msg, &l, sizeof(l));
+        if ( ret < 0 )
+                return ret;
+
+        return set_data(&msg, data, len);
+}
+
+
+
+static int set_integer(prelude_msg_t *msg, uint8_t tag, size_t size, uint64_t value, int type)
+{
+        int ret;
+        size_t i, len = 0;
+        unsigned char buf[1 + 2 * VARINT_MAX_SIZE];
+
+        prelude_return_val_if_fail(size == 1 || size == 2 || size == 4 || size == 8, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        if ( msg->hdr.version != PRELUDE_MSG_VERSION_2 ) {
+                for ( i = size; i > 0; i-- ) {
+                        buf[i - 1] = value & 0xff;
+                        value >>= 8;
+                }
+
+                return prelude_msg_set(msg, tag, size, buf);
+        }
+
+        if ( type == CHUNK_TYPE_INT )
+                value = (value << 1) ^ (~(value >> 63) + 1);
+
+        buf[len++] = tag;
+        len += varint_encode(buf + len, (size << 2) | type);
+        len += varint_encode(buf + len, value);
+
+        ret = reserve(&msg, len);
+        if ( ret < 0 )
+                return ret;
+
+        return set_data(&msg, buf, len);
+}
+
+
+
+/**
+ * prelude_msg_set_uint:
+ * @msg: Pointer on a #prelude_msg_t object to store the data to.
+ * @tag: 8 bits unsigned integer describing the kind of data.
+ * @size: size of the integer, in bytes (1, 2, 4 or 8).
+ * @value: unsigned integer to store.
+ *
+ * Append @value to @msg, tagged with @tag. The receiver retrieves it
+ * with prelude_msg_get() as a @size bytes, big endian, integer, whatever
+ * the message version. With %PRELUDE_MSG_VERSION_2, small values take
+ * less room on the wire.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_msg_set_uint(prelude_msg_t *msg, uint8_t tag, size_t size, uint64_t value)
+{
+        return set_integer(msg, tag, size, value, CHUNK_TYPE_UINT);
+}
+
+
+
+/**
+ * prelude_msg_set_int:
+ * @msg: Pointer on a #prelude_msg_t object to store the data to.
+ * @tag: 8 bits unsigned integer describing the kind of data.
+ * @size: size of the integer, in bytes (1, 2, 4 or 8).
+ * @value: signed integer to store.
+ *
+ * Same as prelude_msg_set_uint(), for a signed integer.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_msg_set_int(prelude_msg_t *msg, uint8_t tag, size_t size, int64_t value)
+{
+        return set_integer(msg, tag, size, (uint64_t) value, CHUNK_TYPE_INT);
+}
+
+
+
+/**
+ * prelude_msg_set_string:
+ * @msg: Pointer on a #prelude_msg_t object to store the data to.
+ * @tag: 8 bits unsigned integer describing the kind of data.
+ * @str: nul terminated string to store.
+ * @len: length of @str, not including the terminating nul byte.
+ *
+ * Append @str to @msg, including its terminating nul byte, tagged with
+ * @tag. When @msg uses the dictionary of a #prelude_msgbuf_t created with
+ * %PRELUDE_MSGBUF_FLAGS_DICTIONARY, repeated strings are only sent in
+ * full once. The receiver retrieves @str with prelude_msg_get() either way.
+ *
+ * Returns: 0 on success, or a negative value if an error occured.
+ */
+int prelude_msg_set_string(prelude_msg_t *msg, uint8_t tag, const char *str, size_t len)
+{
+        int ret;
+        uint32_t id;
+        size_t hlen = 0, slen;
+        prelude_bool_t define;
+        unsigned char hdr[1 + 2 * VARINT_MAX_SIZE];
+
+        prelude_return_val_if_fail(msg, prelude_error(PRELUDE_ERROR_ASSERTION));
+        prelude_return_val_if_fail(str, prelude_error(PRELUDE_ERROR_ASSERTION));
+
+        if ( ! msg->dict || (id = dict_get_id(msg->dict, str, len, &define)) == DICT_NO_ID )
+                return prelude_msg_set(msg, tag, len + 1, str);
+
+        slen = (define) ? len + 1 : 0;
+
+        hdr[hlen++] = tag;
+        hlen += varint_encode(hdr + hlen, ((uint64_t) (varint_size(id) + slen) << 2) | CHUNK_TYPE_DICT);
+        hlen += varint_encode(hdr + hlen, id);
+
+        ret = reserve(&msg, hlen + slen);
+        if ( ret < 0 )
+                goto err;
+
+        ret = set_data(&msg, hdr, hlen);
+        if ( ret < 0 )
+                goto err;
+
+        ret = set_data(&msg, str, slen);
+        if ( ret < 0 )
+                goto err;
+
+        if ( define && msg->dict_first == DICT_NO_ID )
+                msg->dict_first = id;
+
+        msg->dict_end = MAX(msg->dict_end, id + 1);
+
+        return 0;
+
+ err:
+        /*
+         * The peer might miss a definition.
+         */
+        if ( msg->dict )
+                msg->dict->desync = TRUE;
+
+        return ret;
+}
+
+
+
+
+
+/**
+ * prelude_msg_new:
+ * @ret: Pointer where to store the created #prelude_msg_t.
+ * @msgcount: Number of chunk of data the created object can accept.
+ * @msglen: Maximum number of bytes the object should handle for all the chunks.
+ * @tag: A tag identifying the kind of message.
+ * @priority: The priority of this message.
+ *
+ * Allocate a new #prelude_msg_t object and store it into @ret. prelude_msg_set()
+ * can then be used to add chunk of data to the message, and prelude_msg_write()
+ * to send it.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_msg_new(prelude_msg_t **ret, size_t msgcount, size_t msglen, uint8_t tag, prelude_msg_priority_t priority)
+{
+        size_t len;
+        prelude_msg_t *msg;
+
+        len = msglen;
+
+        /*
+         * 5 bytes of header by chunks :
+         * - 1 byte:  tag
+         * - 4 bytes: len
+         */
+        len += msgcount * 5;
+
+        /*
+         * For alert header.
+         */
+        len += PRELUDE_MSG_HDR_SIZE;
+
+        msg = msg_pool_alloc(len);
+        if ( ! msg )
+                return prelude_error_from_errno(errno);
+
+        msg->payload = (unsigned char *) msg + sizeof(prelude_msg_t);
+
+        msg->refcount = 1;
+        msg->header_index = 0;
+        msg->hdr.version = PRELUDE_MSG_VERSION_1;
+        msg->hdr.tag = tag;
+        msg->hdr.priority = priority;
+        msg->hdr.is_fragment = 0;
+        msg->hdr.datalen = len;
+        msg->read_index = 0;
+        msg->write_index = PRELUDE_MSG_HDR_SIZE;
+        msg->fd_write_index = 0;
+        msg->flush_msg_cb = NULL;
+
+        *ret = msg;
+
+        return 0;
+}
+
+
+
+/**
+ * prelude_msg_dynamic_new:
+ * @ret: Pointer where to store the create #prelude_msg_t.
+ * @flush_msg_cb: Callback function to call when the buffer need to be flushed.
+ * @data: Data to pass to the @flush_msg_cb callback function.
+ *
+ * Allocate a new #prelude_msg_t object. prelude_msg_set() can then be used to
+ * add chunk of data to the message, and prelude_msg_mark_start() to separate
+ * different message in the same buffer.
+ *
+ * This function use memory chunk of static size to store the message in. If
+ * the size of the data you want to store is bigger than the actual chunk size,
+ * @flush_msg_cb callback will be called for the current message to be flushed,
+ * and the returned message will be used in order to store remaining data.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_msg_dynamic_new(prelude_msg_t **ret, int (*flush_msg_cb)(prelude_msg_t **msg, void *data), void *data)
+{
+        prelude_msg_t *msg;
+
+        msg = msg_pool_alloc(MSGBUF_SIZE);
+        if ( ! msg )
+                return prelude_error_from_errno(errno);
+
+        msg->refcount = 1;
+        msg->hdr.tag = 0;
+        msg->hdr.priority = 0;
+        msg->hdr.is_fragment = 0;
+        msg->hdr.version = PRELUDE_MSG_VERSION_1;
+        msg->hdr.datalen = MSGBUF_SIZE;
+
+        msg->payload = (unsigned char *) msg + sizeof(prelude_msg_t);
+
+        msg->header_index = 0;
+        msg->send_msg_data = data;
+        msg->read_index = 0;
+        msg->flush_msg_cb = flush_msg_cb;
+        msg->write_index = PRELUDE_MSG_HDR_SIZE;
+        msg->fd_write_index = 0;
 
-        return ret;
+        *ret = msg;
+
+        return 0;
+}
+
+
+/**
+ * prelude_msg_set_tag:
+ * @msg: Pointer on a #prelude_msg_t object.
+ * @tag: Tag to associate with @msg.
+ *
+ * Tag @msg.
+ */
+void prelude_msg_set_tag(prelude_msg_t *msg, uint8_t tag)
+{
+        msg->hdr.tag = tag;
 }
 
 
 
+/**
+ * prelude_msg_set_priority:
+ * @msg: Pointer on a #prelude_msg_t object.
+ * @priority: Priority to associate with @msg.
+ *
+ * Associate @priority with @msg.
+ */
+void prelude_msg_set_priority(prelude_msg_t *msg, prelude_msg_priority_t priority)
+{
+        msg->hdr.priority = priority;
+}
+
 
 
 
 /**
- * prelude_msg_read:
- * @msg: Pointer on a #prelude_msg_t object address.
- * @pio: Pointer on a #prelude_io_t object.
+ * prelude_msg_set_version:
+ * @msg: Pointer on a #prelude_msg_t object.
+ * @version: Encoding to use for the chunks of @msg.
  *
- * Read a message on @pio into @msg. If @msg is NULL, it is
- * allocated. This function will never block.
+ * Select how the chunks added to @msg are encoded on the wire. Messages
+ * use %PRELUDE_MSG_VERSION_1 by default, which every peer understands.
+ * %PRELUDE_MSG_VERSION_2 should only be used with peers that agreed on
+ * %PRELUDE_CONNECTION_FEATURE_COMPACT.
  *
- * Returns: 0 if reading the message is complete, or a #prelude_error_t
- * error if an error occured. Take particular attention to #PRELUDE_ERROR_EAGAIN
- * and PRELUDE_ERROR_EOF.
+ * The version can only be changed before the first chunk of a message is added.
  */
-int prelude_msg_read(prelude_msg_t **msg, prelude_io_t *pio)
+void prelude_msg_set_version(prelude_msg_t *msg, prelude_msg_version_t version)
 {
-        int ret = 0;
+        prelude_return_if_fail(msg);
+        prelude_return_if_fail(version >= PRELUDE_MSG_VERSION_1 && version <= PRELUDE_MSG_VERSION_2);
+        prelude_return_if_fail(msg->write_index == msg->header_index + PRELUDE_MSG_HDR_SIZE);
 
-        /*
-         * *msg is NULL,
-         * this mean the caller want to work on a new message.
-         */
-        if ( ! *msg ) {
-                *msg = malloc(sizeof(prelude_msg_t));
-                if ( ! *msg )
-                        return prelude_error_from_errno(errno);
+        msg->hdr.version = version;
+}
 
-                (*msg)->refcount = 1;
-                (*msg)->hdr.datalen = 0;
-                (*msg)->hdr.priority = PRELUDE_MSG_PRIORITY_NONE;
 
-                (*msg)->payload = NULL;
-                (*msg)->write_index = 0;
-                (*msg)->header_index = 0;
-                (*msg)->fd_write_index = 0;
-                (*msg)->read_index = PRELUDE_MSG_HDR_SIZE;
-        }
 
-        /*
-         * We didn't finished reading the message header yet.
-         */
-        if ( (*msg)->header_index != PRELUDE_MSG_HDR_SIZE )
-                ret = read_message_header(msg, pio);
+/**
+ * prelude_msg_get_version:
+ * @msg: Pointer on a #prelude_msg_t object.
+ *
+ * Returns: the encoding used by the chunks of @msg.
+ */
+prelude_msg_version_t prelude_msg_get_version(prelude_msg_t *msg)
+{
+        return msg->hdr.version;
+}
 
-        /*
-         * Notice that ret is initialized to 0 so that we will read
-         * the message if this function is called and we already have
-         * the header.
-         *
-         * In case read_message_header return PRELUDE_ERROR_EAGAIN,
-         * we don't want to try to read the rest of the message right now,
-         * as it is unlikely we can read something.
-         *
-         * In case it return 0, there is some chance there are other data
-         * waiting to be read.
-         */
-        if ( (*msg)->payload && ret == 0 )
-                ret = read_message_content(msg, pio);
 
-        /*
-         * check for msg as well since this function can be called recursively.
-         */
-        if ( *msg && ret < 0 && prelude_error_get_code(ret) != PRELUDE_ERROR_EAGAIN ) {
-                prelude_msg_destroy(*msg);
-                /*
-                 * reset message to NULL, because the caller might not take
-                 * care of the return value enough (and may call us again with an
-                 * undefined *msg address.
-                 */
-                *msg = NULL;
-        }
 
-        return ret;
+/**
+ * prelude_msg_get_tag:
+ * @msg: Pointer on a #prelude_msg_t object.
+ *
+ * prelude_msg_get_tag() return the tag contained in the @msg header.
+ *
+ * Returns: A tag.
+ */
+uint8_t prelude_msg_get_tag(prelude_msg_t *msg)
+{
+        return msg->hdr.tag;
+}
+
+
+
+/**
+ * prelude_msg_get_priority:
+ * @msg: Pointer on a #prelude_msg_t object.
+ *
+ * prelude_msg_get_priority() return the priority contained in the @msg header.
+ *
+ * Returns: A priority.
+ */
+prelude_msg_priority_t prelude_msg_get_priority(prelude_msg_t *msg)
+{
+        return msg->hdr.priority;
 }
 
 
 
 
 /**
- * prelude_msg_get:
- * @msg: Pointer on a #prelude_msg_t object representing the message to get data from.
- * @tag: Pointer on a 8 bits unsigned integer to store the message tag.
- * @len: Pointer on a 32 bits unsigned integer to store the message len to.
- * @buf: Address of a pointer to store the buffer starting address.
+ * prelude_msg_get_datalen:
+ * @msg: Pointer on a #prelude_msg_t object.
  *
- * prelude_msg_get() read the next data chunk contained in the message.
- * @tag is updated to contain the kind of data the chunk contain.
- * @len is updated to contain the len of the data chunk.
- * @buf is updated to point on the data chunk.
+ * prelude_msg_get_datalen() return the len of the whole message
+ * contained in the @msg header.
  *
- * Returns: 0 on success, or a #prelude_error_t value on error.
+ * Returns: Len of the message.
  */
-int prelude_msg_get(prelude_msg_t *msg, uint8_t *tag, uint32_t *len, void **buf)
+uint32_t prelude_msg_get_datalen(prelude_msg_t *msg)
 {
-        if ( msg->read_index == (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE) ) {
-                /*
-                 * no more sub - messages in the buffer.
-                 */
-                return prelude_error(PRELUDE_ERROR_EOF);
-        }
+        return msg->hdr.datalen;
+}
 
-        /*
-         * bound check our buffer,
-         * so that we won't overflow if it doesn't contain tag and len.
-         */
-        if ( msg->read_index > (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE - 5) )
-                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
 
-        /*
-         * slice wanted data.
-         */
-        *tag = msg->payload[msg->read_index++];
-        *len = prelude_extract_uint32(&msg->payload[msg->read_index]);
-        msg->read_index += sizeof(uint32_t);
 
-        if ( ! *len )
-                return 0;
+/**
+ * prelude_msg_get_len:
+ * @msg: Pointer on a #prelude_msg_t object.
+ *
+ * prelude_msg_get_len() return the currently used
+ * len for the @msg message.
+ *
+ * Returns: Len of the message.
+ */
+uint32_t prelude_msg_get_len(prelude_msg_t *msg)
+{
+        return msg->write_index;
+}
 
-        /*
-         * bound check again, against specified len.
-         */
-        if ( (msg->read_index + *len) <= msg->read_index )
-                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
 
-        if ( (msg->read_index + *len) > (msg->hdr.datalen + PRELUDE_MSG_HDR_SIZE) )
-                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
 
-        *buf = &msg->payload[msg->read_index];
-        msg->read_index += *len;
 
-        return 0;
+/**
+ * prelude_msg_destroy:
+ * @msg: Pointer on a #prelude_msg_t object.
+ *
+ * prelude_msg_destroy() destroy the #prelude_msg_t object pointed
+ * to by @msg. All the ressources for this message are freed.
+ */
+void prelude_msg_destroy(prelude_msg_t *msg)
+{
+        if ( --msg->refcount )
+                return;
+
+        if ( msg->dict )
+                _prelude_msg_dict_destroy(msg->dict);
+
+        msg_pool_release(msg);
+}
+
+
+
+
+/**
+ * prelude_msg_set_callback:
+ * @msg: Pointer on a #prelude_msg_t object.
+ * @flush_msg_cb: Pointer on a function responssible of sending the message.
+ *
+ * prelude_msg_set_callback() allow to change the callback used
+ * to flush a message created with prelude_msg_dynamic_new().
+ */
+void prelude_msg_set_callback(prelude_msg_t *msg, int (*flush_msg_cb)(prelude_msg_t **msg, void *data))
+{
+        msg->flush_msg_cb = flush_msg_cb;
+}
+
+
+
+/**
+ * prelude_msg_set_data:
+ * @msg: Pointer on a #prelude_msg_t object.
+ * @data: Pointer on the data to associate to this message.
+ *
+ * prelude_msg_set_data() allow to change the data passed
+ * to the message sending callback.
+ */
+void prelude_msg_set_data(prelude_msg_t *msg, void *data)
+{
+        msg->send_msg_data = data;
+}
+
+
+
+
+/**
+ * prelude_msg_get_data:
+ * @msg: Pointer on a #prelude_msg_t object.
+ *
+ * prelude_msg_get_data() allow to retrieve the data passed
+ * to the message sending callback.
+ *
+ * Returns: Pointer to the data
+ */
+void *prelude_msg_get_data(prelude_msg_t *msg)
+{
+        return msg->send_msg_data;
+}
+
+
+
+/**
+ * prelude_msg_is_fragment:
+ * @msg: Pointer on a #prelude_msg_t object.
+ *
+ * Returns: true if @msg only contain a fragment of message.
+ */
+int prelude_msg_is_fragment(prelude_msg_t *msg)
+{
+        return msg->hdr.is_fragment ? 1 : 0;
 }
 
 
 
-
 /**
- * prelude_msg_forward:
- * @msg: Pointer on a #prelude_msg_t object containing a message header.
- * @dst: Pointer on a #prelude_io_t object to send message to.
- * @src: Pointer on a #prelude_io_t object to read message from.
- *
- * prelude_msg_forward() read the message corresponding to the @msg object
- * containing the message header previously gathered using prelude_msg_read_header()
- * from the @src object, and transfer it to @dst. The header is also transfered.
+ * prelude_msg_is_empty:
+ * @msg: Pointer on a #prelude_msg_t object.
  *
- * Returns: 0 on success, or a negative value if an error occured.
+ * Returns: true if @msg doesn't contain any data to send.
  */
-int prelude_msg_forward(prelude_msg_t *msg, prelude_io_t *dst, prelude_io_t *src)
+int prelude_msg_is_empty(prelude_msg_t *msg)
 {
-        ssize_t ret;
-        uint32_t dlen = htonl(msg->hdr.datalen);
-        unsigned char buf[PRELUDE_MSG_HDR_SIZE];
-
-        buf[0] = msg->hdr.version;
-        buf[1] = msg->hdr.tag;
-        buf[2] = msg->hdr.priority;
-        buf[3] = msg->hdr.is_fragment;
+        return (msg->write_index - msg->header_index - PRELUDE_MSG_HDR_SIZE <= 0) ? 1 : 0;
+}
 
-        memcpy(&buf[4], &dlen, sizeof(dlen));
 
-        ret = prelude_io_write(dst, buf, sizeof(buf));
-        if ( ret < 0 )
-                return ret;
 
-        ret = prelude_io_forward(dst, src, msg->hdr.datalen);
-        if ( ret < 0 )
-                return ret;
+struct timeval *prelude_msg_get_time(prelude_msg_t *msg, struct timeval *tv)
+{
+        tv->tv_sec = msg->hdr.tv_sec;
+        tv->tv_usec = msg->hdr.tv_usec;
 
-        return 0;
+        return tv;
 }
 
 
 
-/**
- * prelude_msg_write_r:
- * @msg: Pointer on a #prelude_msg_t object containing the message.
- * @dst: Pointer on a #prelude_io_t object to send the message to.
- * @windex: Number of byte written to @dst
- *
- * prelude_msg_write_r() write the message corresponding to the @msg
- * object to @dst. The message should have been created using the
- * prelude_msg_new() and prelude_msg_set() functions.
- *
- * @windex is used to hold the number of byte written to @dst in case
- * the write could not complete (PRELUDE_ERROR_EAGAIN). In case the write
- * is complete, it's value is reset to 0.
- *
- * Returns: 0 on success, or a negative value if an error occured.
- */
-int prelude_msg_write_r(prelude_msg_t *msg, prelude_io_t *dst, uint32_t *windex)
+prelude_msg_t *prelude_msg_ref(prelude_msg_t *msg)
 {
-        ssize_t ret;
-        uint32_t dlen = msg->write_index;
+        msg->refcount++;
+        return msg;
+}
 
-        /*
-         * no need to send... There's no data in this message.
-         */
-        if ( msg->write_index - PRELUDE_MSG_HDR_SIZE <= 0 )
-                return 0;
 
+
+const unsigned char *prelude_msg_get_message_data(prelude_msg_t *msg)
+{
         /*
          * if the message header index is 0 (write called, without
          * prelude_msg_mark_end() first), mark end of the message
@@ -584,465 +2121,572 @@ int prelude_msg_write_r(prelude_msg_t *msg, prelude_io_t *dst, uint32_t *windex)
         if ( msg->header_index == 0 )
                 write_message_header(msg);
 
-        /*
-         * in this case, prelude_msg_mark_end() was called.
-         */
-        else if ( ! msg->hdr.is_fragment )
-                dlen -= PRELUDE_MSG_HDR_SIZE;
+        return msg->payload + msg->fd_write_index;
+}
 
-        ret = prelude_io_write(dst, msg->payload + *windex, dlen - *windex);
-        if ( ret < 0 )
-                return ret;
 
-        *windex += ret;
 
-        if ( *windex == dlen ) {
-                *windex = 0;
-                return 0;
+int prelude_msg_clone(prelude_msg_t **dst, const prelude_msg_t *src)
+{
+        int class;
+        size_t capacity;
+
+        *dst = msg_pool_alloc(src->borrowed ? src->write_index : src->capacity);
+        if ( ! *dst )
+                return prelude_error_from_errno(errno);
+
+        class = (*dst)->pool_class;
+        capacity = (*dst)->capacity;
+
+        memcpy(*dst, src, sizeof(*src));
+
+        (*dst)->refcount = 1;
+        (*dst)->pool_class = class;
+        (*dst)->capacity = capacity;
+        (*dst)->borrowed = FALSE;
+
+        if ( src->dict )
+                dict_ref(src->dict);
+
+        if ( src->payload ) {
+                (*dst)->payload = (unsigned char *) (*dst) + sizeof(**dst);
+                memcpy((*dst)->payload, src->payload, src->write_index);
         }
 
-        return prelude_error(PRELUDE_ERROR_EAGAIN);
+        return 0;
 }
 
 
 
-/**
- * prelude_msg_write:
- * @msg: Pointer on a #prelude_msg_t object containing the message.
- * @dst: Pointer on a #prelude_io_t object to send the message to.
- *
- * prelude_msg_write() write the message corresponding to the @msg
- * object to @dst. The message should have been created using the
- * prelude_msg_new() and prelude_msg_set() functions.
- *
- * Returns: 0 on success, or a negative value if an error occured.
+/*
+ * Create a message referencing @len bytes of wire data, holding one or
+ * more message fragments, without copying them. The data must outlive
+ * the message. Such a message is meant to be forwarded as is: only its
+ * first fragment can be read with prelude_msg_get().
  */
-int prelude_msg_write(prelude_msg_t *msg, prelude_io_t *dst)
+int _prelude_msg_new_borrowed(prelude_msg_t **out, unsigned char *data, uint32_t len)
 {
-        return prelude_msg_write_r(msg, dst, &msg->fd_write_index);
-}
+        int ret;
+        prelude_msg_t *msg;
 
+        if ( len < PRELUDE_MSG_HDR_SIZE )
+                return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
 
+        ret = check_version(data[0]);
+        if ( ret < 0 )
+                return ret;
 
+        msg = msg_pool_alloc(0);
+        if ( ! msg )
+                return prelude_error_from_errno(errno);
 
-/**
- * prelude_msg_recycle:
- * @msg: Pointer on #prelude_msg_t object.
- *
- * Recycle @msg so you can write at it again, even
- * thought it was written.
- */
-void prelude_msg_recycle(prelude_msg_t *msg)
-{
+        msg->refcount = 1;
+        msg->hdr.datalen = 0;
+        msg->hdr.priority = PRELUDE_MSG_PRIORITY_NONE;
+
+        ret = slice_message_header(msg, data);
+        if ( ret < 0 || PRELUDE_MSG_HDR_SIZE + msg->hdr.datalen > len ) {
+                msg_pool_release(msg);
+                return (ret < 0) ? ret : prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+        }
+
+        msg->hdr.is_fragment = 0;
+        msg->borrowed = TRUE;
+        msg->payload = data;
         msg->header_index = 0;
         msg->fd_write_index = 0;
-        msg->write_index = PRELUDE_MSG_HDR_SIZE;
-        msg->payload = (unsigned char *) msg + sizeof(*msg);
+        msg->read_index = PRELUDE_MSG_HDR_SIZE;
+        msg->write_index = len;
+        msg->flush_msg_cb = NULL;
 
-        if ( msg->read_index )
-                msg->read_index = PRELUDE_MSG_HDR_SIZE;
+        *out = msg;
+
+        return 0;
 }
 
 
 
-/**
- * prelude_msg_mark_end:
- * @msg: Pointer on #prelude_msg_t object.
- *
- * Mark end of message in the @msg buffer, so you can continue
- * adding different message in the same buffer.
+/*
+ * Position of the next chunk returned by prelude_msg_get(): this allows
+ * to come back to a chunk that was skipped before.
  */
-void prelude_msg_mark_end(prelude_msg_t *msg)
+uint32_t _prelude_msg_get_read_index(prelude_msg_t *msg)
 {
-        int ret;
+        return msg->read_index;
+}
 
-        if ( msg->write_index - msg->header_index - PRELUDE_MSG_HDR_SIZE <= 0 )
+
+
+void _prelude_msg_set_read_index(prelude_msg_t *msg, uint32_t index)
+{
+        msg->read_index = index;
+}
+
+
+
+void _prelude_msg_dict_destroy(prelude_msg_dict_t *dict)
+{
+        int refcount;
+        uint32_t i;
+
+        gl_lock_lock(dict->mutex);
+        refcount = --dict->refcount;
+        gl_lock_unlock(dict->mutex);
+
+        if ( refcount )
                 return;
 
-        write_message_header(msg);
+        for ( i = 0; i < dict->count; i++ )
+                free(dict->entries[i].data);
 
-        if ( msg->write_index + PRELUDE_MSG_HDR_SIZE + MINIMUM_FRAGMENT_DATA_SIZE > msg->hdr.datalen ) {
+        if ( dict->hash )
+                free(dict->hash);
 
-                ret = call_alloc_cb(&msg);
-                if ( ret < 0 )
-                        return;
-        } else {
-                msg->header_index = msg->write_index;
-                msg->write_index += PRELUDE_MSG_HDR_SIZE;
-        }
-}
+        if ( dict->seen )
+                free(dict->seen);
 
+        gl_lock_destroy(dict->mutex);
+        free(dict);
+}
 
 
 
-/**
- * prelude_msg_set:
- * @msg: Pointer on a #prelude_msg_t object to store the data to.
- * @tag: 8 bits unsigned integer describing the kind of data.
- * @len: len of the data chunk.
- * @data: Pointer to the starting address of the data.
- *
- * prelude_msg_set() append @len bytes of data from the @data buffer
- * to the @msg object representing a message. The data is tagged with @tag.
- *
- * Returns: 0 on success, or a negative value if the remaining space is not
- * available. You might check the return value mostly if using a dynamic message
- * through prelude_msg_dynamic_new()
+/*
+ * Replace *dict with a new, empty, dictionary.
  */
-int prelude_msg_set(prelude_msg_t *msg, uint8_t tag, uint32_t len, const void *data)
+int _prelude_msg_dict_renew(prelude_msg_dict_t **dict)
 {
         int ret;
-        uint32_t l;
-
-        l = htonl(len);
+        prelude_msg_dict_t *new;
 
-        ret = set_data(&msg, &tag, sizeof(tag));
+        ret = dict_new(&new);
         if ( ret < 0 )
                 return ret;
 
-        ret = set_data(&msg, &l, sizeof(l));
-        if ( ret < 0 )
-                return ret;
+        if ( *dict )
+                _prelude_msg_dict_destroy(*dict);
 
-        return set_data(&msg, data, len);
+        *dict = new;
+
+        return 0;
 }
 
 
 
+prelude_bool_t _prelude_msg_dict_is_desync(prelude_msg_dict_t *dict)
+{
+        return dict->desync;
+}
 
 
-/**
- * prelude_msg_new:
- * @ret: Pointer where to store the created #prelude_msg_t.
- * @msgcount: Number of chunk of data the created object can accept.
- * @msglen: Maximum number of bytes the object should handle for all the chunks.
- * @tag: A tag identifying the kind of message.
- * @priority: The priority of this message.
- *
- * Allocate a new #prelude_msg_t object and store it into @ret. prelude_msg_set()
- * can then be used to add chunk of data to the message, and prelude_msg_write()
- * to send it.
- *
- * Returns: 0 on success, a negative value if an error occured.
+
+/*
+ * Strings written to @msg from now on are looked up in @dict,
+ * which might be NULL.
  */
-int prelude_msg_new(prelude_msg_t **ret, size_t msgcount, size_t msglen, uint8_t tag, prelude_msg_priority_t priority)
+void _prelude_msg_set_dict(prelude_msg_t *msg, prelude_msg_dict_t *dict)
 {
-        size_t len;
-        prelude_msg_t *msg;
+        if ( msg->dict == dict )
+                return;
 
-        len = msglen;
+        if ( msg->dict )
+                _prelude_msg_dict_destroy(msg->dict);
 
-        /*
-         * 5 bytes of header by chunks :
-         * - 1 byte:  tag
-         * - 4 bytes: len
-         */
-        len += msgcount * 5;
+        msg->dict = (dict) ? dict_ref(dict) : NULL;
+}
 
-        /*
-         * For alert header.
-         */
-        len += PRELUDE_MSG_HDR_SIZE;
 
-        msg = malloc(sizeof(prelude_msg_t) + len);
-        if ( ! msg )
-                return prelude_error_from_errno(errno);
 
-        msg->payload = (unsigned char *) msg + sizeof(prelude_msg_t);
+/*
+ * Apply the dictionary definitions of @msg, received on a connection
+ * using *dict, and check its references. Messages are to be loaded in
+ * the order they were received.
+ */
+int _prelude_msg_load_dict(prelude_msg_t *msg, prelude_msg_dict_t **dict)
+{
+        int ret;
+        chunk_t chunk;
+        prelude_bool_t seen = FALSE;
+        uint32_t index = PRELUDE_MSG_HDR_SIZE, end = PRELUDE_MSG_HDR_SIZE + msg->hdr.datalen;
+
+        if ( msg->hdr.version != PRELUDE_MSG_VERSION_2 )
+                return 0;
+
+        msg->dict_first = DICT_NO_ID;
+        msg->dict_end = 0;
+
+        while ( index < end ) {
+                ret = next_chunk(msg->payload, end, &index, &chunk);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( chunk.type == CHUNK_TYPE_RAW && chunk.size != chunk.len )
+                        return prelude_error(PRELUDE_ERROR_INVAL_LENGTH);
+
+                if ( chunk.type != CHUNK_TYPE_DICT )
+                        continue;
+
+                if ( chunk.str && chunk.value == 0 && ! seen ) {
+                        ret = _prelude_msg_dict_renew(dict);
+                        if ( ret < 0 )
+                                return ret;
+                }
+
+                /*
+                 * Definitions come in sequence, references are to known identifiers.
+                 */
+                if ( ! *dict || ((chunk.str) ? chunk.value != (*dict)->count : chunk.value >= (*dict)->count) )
+                        return prelude_error_verbose(PRELUDE_ERROR_INVAL_MESSAGE, "unexpected dictionary identifier %" PRELUDE_PRIu64, chunk.value);
+
+                if ( chunk.str ) {
+                        ret = dict_add(*dict, chunk.str, chunk.strlen);
+                        if ( ret < 0 )
+                                return ret;
 
-        msg->refcount = 1;
-        msg->header_index = 0;
-        msg->hdr.version = PRELUDE_MSG_VERSION;
-        msg->hdr.tag = tag;
-        msg->hdr.priority = priority;
-        msg->hdr.is_fragment = 0;
-        msg->hdr.datalen = len;
-        msg->read_index = 0;
-        msg->write_index = PRELUDE_MSG_HDR_SIZE;
-        msg->fd_write_index = 0;
-        msg->flush_msg_cb = NULL;
+                        if ( msg->dict_first == DICT_NO_ID )
+                                msg->dict_first = chunk.value;
+                }
 
-        *ret = msg;
+                seen = TRUE;
+                msg->dict_end = MAX(msg->dict_end, chunk.value + 1);
+        }
+
+        if ( seen )
+                _prelude_msg_set_dict(msg, *dict);
 
         return 0;
 }
 
 
 
-/**
- * prelude_msg_dynamic_new:
- * @ret: Pointer where to store the create #prelude_msg_t.
- * @flush_msg_cb: Callback function to call when the buffer need to be flushed.
- * @data: Data to pass to the @flush_msg_cb callback function.
- *
- * Allocate a new #prelude_msg_t object. prelude_msg_set() can then be used to
- * add chunk of data to the message, and prelude_msg_mark_start() to separate
- * different message in the same buffer.
- *
- * This function use memory chunk of static size to store the message in. If
- * the size of the data you want to store is bigger than the actual chunk size,
- * @flush_msg_cb callback will be called for the current message to be flushed,
- * and the returned message will be used in order to store remaining data.
- *
- * Returns: 0 on success, a negative value if an error occured.
+/*
+ * Append @chunk to @dst, when not NULL, the way version 1 stores it,
+ * and add its size to *size. A raw chunk continued in the next fragment
+ * keeps its whole length in the header.
  */
-int prelude_msg_dynamic_new(prelude_msg_t **ret, int (*flush_msg_cb)(prelude_msg_t **msg, void *data), void *data)
+static int put_v1_chunk(prelude_msg_t *msg, chunk_t *chunk, unsigned char *dst, uint32_t *size)
 {
-        prelude_msg_t *msg;
+        int ret;
+        uint32_t len, nlen;
+        void *buf = chunk->data;
+        unsigned char intbuf[sizeof(uint64_t)];
 
-        msg = malloc(sizeof(prelude_msg_t) + MSGBUF_SIZE);
-        if ( ! msg )
-                return prelude_error_from_errno(errno);
+        len = chunk->len;
 
-        msg->refcount = 1;
-        msg->hdr.tag = 0;
-        msg->hdr.priority = 0;
-        msg->hdr.is_fragment = 0;
-        msg->hdr.version = PRELUDE_MSG_VERSION;
-        msg->hdr.datalen = MSGBUF_SIZE;
+        if ( chunk->type == CHUNK_TYPE_DICT ) {
+                ret = get_dict_string(msg, chunk, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+        }
 
-        msg->payload = (unsigned char *) msg + sizeof(prelude_msg_t);
+        else if ( chunk->type != CHUNK_TYPE_RAW ) {
+                get_chunk_integer(chunk, intbuf);
+                buf = intbuf;
+        }
 
-        msg->header_index = 0;
-        msg->send_msg_data = data;
-        msg->read_index = 0;
-        msg->flush_msg_cb = flush_msg_cb;
-        msg->write_index = PRELUDE_MSG_HDR_SIZE;
-        msg->fd_write_index = 0;
+        if ( dst ) {
+                nlen = htonl(len);
 
-        *ret = msg;
+                dst[*size] = chunk->tag;
+                memcpy(dst + *size + 1, &nlen, sizeof(nlen));
+        }
+
+        *size += 1 + sizeof(uint32_t);
+
+        if ( chunk->type == CHUNK_TYPE_RAW )
+                len = chunk->size;
+
+        if ( dst )
+                memcpy(dst + *size, buf, len);
+
+        *size += len;
 
         return 0;
 }
 
 
-/**
- * prelude_msg_set_tag:
- * @msg: Pointer on a #prelude_msg_t object.
- * @tag: Tag to associate with @msg.
- *
- * Tag @msg.
+
+/*
+ * Copy the chunks of @msg up to @end to @dst, when not NULL, with
+ * dictionary chunks turned into raw ones, or every chunk turned into
+ * a version 1 one if @v1 is set. *size is set to the size of the result.
  */
-void prelude_msg_set_tag(prelude_msg_t *msg, uint8_t tag)
+static int expand_chunks(prelude_msg_t *msg, uint32_t end, prelude_bool_t v1, unsigned char *dst, uint32_t *size)
 {
-        msg->hdr.tag = tag;
-}
+        int ret;
+        chunk_t chunk;
+        void *buf = NULL;
+        uint32_t len = 0, start, index = msg->chunk_index;
 
+        if ( dst )
+                memcpy(dst, msg->payload, index);
 
+        *size = index;
 
-/**
- * prelude_msg_set_priority:
- * @msg: Pointer on a #prelude_msg_t object.
- * @priority: Priority to associate with @msg.
- *
- * Associate @priority with @msg.
- */
-void prelude_msg_set_priority(prelude_msg_t *msg, prelude_msg_priority_t priority)
-{
-        msg->hdr.priority = priority;
-}
+        while ( index < end ) {
+                start = index;
 
+                ret = next_chunk(msg->payload, end, &index, &chunk);
+                if ( ret < 0 )
+                        return ret;
 
+                if ( v1 ) {
+                        ret = put_v1_chunk(msg, &chunk, dst, size);
+                        if ( ret < 0 )
+                                return ret;
 
+                        continue;
+                }
 
-/**
- * prelude_msg_get_tag:
- * @msg: Pointer on a #prelude_msg_t object.
- *
- * prelude_msg_get_tag() return the tag contained in the @msg header.
- *
- * Returns: A tag.
- */
-uint8_t prelude_msg_get_tag(prelude_msg_t *msg)
-{
-        return msg->hdr.tag;
+                if ( chunk.type != CHUNK_TYPE_DICT ) {
+                        if ( dst )
+                                memcpy(dst + *size, msg->payload + start, index - start);
+
+                        *size += index - start;
+                        continue;
+                }
+
+                ret = get_dict_string(msg, &chunk, &len, &buf);
+                if ( ret < 0 )
+                        return ret;
+
+                if ( dst ) {
+                        dst[*size] = chunk.tag;
+                        *size += 1 + varint_encode(dst + *size + 1, (uint64_t) len << 2 | CHUNK_TYPE_RAW);
+                        memcpy(dst + *size, buf, len);
+                } else
+                        *size += 1 + varint_size((uint64_t) len << 2 | CHUNK_TYPE_RAW);
+
+                *size += len;
+        }
+
+        return 0;
 }
 
 
 
-/**
- * prelude_msg_get_priority:
- * @msg: Pointer on a #prelude_msg_t object.
- *
- * prelude_msg_get_priority() return the priority contained in the @msg header.
- *
- * Returns: A priority.
- */
-prelude_msg_priority_t prelude_msg_get_priority(prelude_msg_t *msg)
+static int msg_transcode(prelude_msg_t *msg, prelude_bool_t v1, prelude_msg_t **out)
 {
-        return msg->hdr.priority;
-}
+        int ret;
+        uint32_t size, end;
+        prelude_msg_t *new;
 
+        end = get_write_len(msg);
 
+        ret = expand_chunks(msg, end, v1, NULL, &size);
+        if ( ret < 0 )
+                return ret;
 
+        new = msg_pool_alloc(size);
+        if ( ! new )
+                return prelude_error_from_errno(errno);
 
-/**
- * prelude_msg_get_datalen:
- * @msg: Pointer on a #prelude_msg_t object.
- *
- * prelude_msg_get_datalen() return the len of the whole message
- * contained in the @msg header.
- *
- * Returns: Len of the message.
- */
-uint32_t prelude_msg_get_datalen(prelude_msg_t *msg)
-{
-        return msg->hdr.datalen;
+        new->refcount = 1;
+        new->hdr = msg->hdr;
+        new->hdr.datalen = size - PRELUDE_MSG_HDR_SIZE;
+
+        if ( v1 )
+                new->hdr.version = PRELUDE_MSG_VERSION_1;
+        new->payload = (unsigned char *) new + sizeof(*new);
+        new->header_index = 0;
+        new->fd_write_index = 0;
+        new->read_index = PRELUDE_MSG_HDR_SIZE;
+        new->flush_msg_cb = NULL;
+        new->send_msg_data = NULL;
+
+        ret = expand_chunks(msg, end, v1, new->payload, &new->write_index);
+        if ( ret < 0 ) {
+                msg_pool_release(new);
+                return ret;
+        }
+
+        write_message_header(new);
+        *out = new;
+
+        return 0;
 }
 
 
 
-/**
- * prelude_msg_get_len:
- * @msg: Pointer on a #prelude_msg_t object.
- *
- * prelude_msg_get_len() return the currently used
- * len for the @msg message.
- *
- * Returns: Len of the message.
+/*
+ * Make a copy of @msg that does not depend on any dictionary, or
+ * reference @msg if it already does not.
  */
-uint32_t prelude_msg_get_len(prelude_msg_t *msg)
+int _prelude_msg_expand(prelude_msg_t *msg, prelude_msg_t **out)
 {
-        return msg->write_index;
-}
+        if ( ! msg->dict_end ) {
+                *out = prelude_msg_ref(msg);
+                return 0;
+        }
 
+        return msg_transcode(msg, FALSE, out);
+}
 
 
 
-/**
- * prelude_msg_destroy:
- * @msg: Pointer on a #prelude_msg_t object.
- *
- * prelude_msg_destroy() destroy the #prelude_msg_t object pointed
- * to by @msg. All the ressources for this message are freed.
+/*
+ * Make a version 1 copy of @msg, which any peer can read, or reference
+ * @msg if it already is one. The copy does not depend on any dictionary.
  */
-void prelude_msg_destroy(prelude_msg_t *msg)
+int _prelude_msg_downgrade(prelude_msg_t *msg, prelude_msg_t **out)
 {
-        if ( --msg->refcount == 0 )
-                free(msg);
-}
+        if ( msg->hdr.version != PRELUDE_MSG_VERSION_2 ) {
+                *out = prelude_msg_ref(msg);
+                return 0;
+        }
 
+        return msg_transcode(msg, TRUE, out);
+}
 
 
 
-/**
- * prelude_msg_set_callback:
- * @msg: Pointer on a #prelude_msg_t object.
- * @flush_msg_cb: Pointer on a function responssible of sending the message.
- *
- * prelude_msg_set_callback() allow to change the callback used
- * to flush a message created with prelude_msg_dynamic_new().
+/*
+ * Get the message to send to a peer which dictionary is *peer, and
+ * which knows its *count first identifiers. @msg is referenced if the
+ * peer can decode it, otherwise it is expanded and its dictionary
+ * flagged so that the writer starts a new one.
  */
-void prelude_msg_set_callback(prelude_msg_t *msg, int (*flush_msg_cb)(prelude_msg_t **msg, void *data))
+int _prelude_msg_dict_prepare(prelude_msg_t *msg, prelude_msg_dict_t **peer, uint32_t *count, prelude_msg_t **out)
 {
-        msg->flush_msg_cb = flush_msg_cb;
+        if ( ! msg->dict_end ) {
+                *out = prelude_msg_ref(msg);
+                return 0;
+        }
+
+        if ( msg->dict_first == 0 && *peer != msg->dict ) {
+                if ( *peer )
+                        _prelude_msg_dict_destroy(*peer);
+
+                *peer = dict_ref(msg->dict);
+                *count = 0;
+        }
+
+        /*
+         * The last condition matches a message being sent again
+         * after a partial write.
+         */
+        if ( *peer == msg->dict &&
+             ((msg->dict_first == DICT_NO_ID && msg->dict_end <= *count) || msg->dict_first == *count || msg->dict_end == *count) ) {
+                *count = MAX(*count, msg->dict_end);
+                *out = prelude_msg_ref(msg);
+                return 0;
+        }
+
+        msg->dict->desync = TRUE;
+
+        return _prelude_msg_expand(msg, out);
 }
 
 
 
 /**
- * prelude_msg_set_data:
- * @msg: Pointer on a #prelude_msg_t object.
- * @data: Pointer on the data to associate to this message.
+ * prelude_msg_pool_set_high_water_mark:
+ * @size: Maximum number of bytes.
  *
- * prelude_msg_set_data() allow to change the data passed
- * to the message sending callback.
+ * Set the maximum number of bytes of unused message buffer kept in the
+ * shared message pool. Buffers released above this limit are given back
+ * to the system. Each thread additionally caches a small number of buffers
+ * on its own.
  */
-void prelude_msg_set_data(prelude_msg_t *msg, void *data)
+void prelude_msg_pool_set_high_water_mark(size_t size)
 {
-        msg->send_msg_data = data;
-}
+        gl_lock_lock(msg_pool_mutex);
+
+        msg_pool_high_water_mark = size;
+        msg_pool_depot_trim();
 
+        gl_lock_unlock(msg_pool_mutex);
+}
 
 
 
 /**
- * prelude_msg_get_data:
- * @msg: Pointer on a #prelude_msg_t object.
+ * prelude_msg_pool_get_stats:
+ * @stats: Pointer to a #prelude_msg_pool_stats_t object where to store the statistics.
  *
- * prelude_msg_get_data() allow to retrieve the data passed
- * to the message sending callback.
+ * Retrieve message pool statistics: the number of message buffer
+ * allocation that were served from the pool (@hits) or from the system
+ * (@misses), and the number of bytes of unused buffer currently kept
+ * by the pool (@resident_bytes).
  *
- * Returns: Pointer to the data
+ * Counters of threads other than the caller are sampled without
+ * synchronization, and should be considered approximate.
  */
-void *prelude_msg_get_data(prelude_msg_t *msg)
+void prelude_msg_pool_get_stats(prelude_msg_pool_stats_t *stats)
 {
-        return msg->send_msg_data;
-}
+        int i;
+        prelude_list_t *tmp;
+        msg_pool_cache_t *cache;
 
+        prelude_return_if_fail(stats);
 
+        gl_lock_lock(msg_pool_mutex);
 
-/**
- * prelude_msg_is_fragment:
- * @msg: Pointer on a #prelude_msg_t object.
- *
- * Returns: true if @msg only contain a fragment of message.
- */
-int prelude_msg_is_fragment(prelude_msg_t *msg)
-{
-        return msg->hdr.is_fragment ? 1 : 0;
-}
+        stats->hits = msg_pool_hits;
+        stats->misses = msg_pool_misses;
+        stats->resident_bytes = msg_pool_depot_size;
 
+        prelude_list_for_each(&msg_pool_cache_list, tmp) {
+                cache = prelude_list_entry(tmp, msg_pool_cache_t, list);
 
+                stats->hits += cache->hits;
+                stats->misses += cache->misses;
 
-/**
- * prelude_msg_is_empty:
- * @msg: Pointer on a #prelude_msg_t object.
- *
- * Returns: true if @msg doesn't contain any data to send.
- */
-int prelude_msg_is_empty(prelude_msg_t *msg)
-{
-        return (msg->write_index - msg->header_index - PRELUDE_MSG_HDR_SIZE <= 0) ? 1 : 0;
+                for ( i = 0; i < MSG_POOL_CLASS_COUNT; i++ )
+                        stats->resident_bytes += cache->count[i] * msg_pool_block_size(i);
+        }
+
+        gl_lock_unlock(msg_pool_mutex);
 }
 
 
 
-struct timeval *prelude_msg_get_time(prelude_msg_t *msg, struct timeval *tv)
+void _prelude_msg_pool_deinit(void)
 {
-        tv->tv_sec = msg->hdr.tv_sec;
-        tv->tv_usec = msg->hdr.tv_usec;
+        int i;
+        msg_pool_cache_t *cache;
 
-        return tv;
-}
+        gl_once(msg_pool_once, msg_pool_init);
 
+        cache = gl_tls_get(msg_pool_key);
+        if ( cache ) {
+                for ( i = 0; i < MSG_POOL_CLASS_COUNT; i++ )
+                        msg_pool_cache_drain(cache, i, cache->count[i]);
+        }
 
+        gl_lock_lock(msg_pool_mutex);
 
-prelude_msg_t *prelude_msg_ref(prelude_msg_t *msg)
-{
-        msg->refcount++;
-        return msg;
+        for ( i = 0; i < MSG_POOL_CLASS_COUNT; i++ ) {
+                msg_pool_block_t *block;
+
+                while ( (block = msg_pool_depot[i]) ) {
+                        msg_pool_depot[i] = block->next;
+                        free(block);
+                }
+        }
+
+        msg_pool_depot_size = 0;
+
+        gl_lock_unlock(msg_pool_mutex);
 }
 
 
 
-const unsigned char *prelude_msg_get_message_data(prelude_msg_t *msg)
+void _prelude_msg_fork_prepare(void)
 {
-        /*
-         * if the message header index is 0 (write called, without
-         * prelude_msg_mark_end() first), mark end of the message
-         * cause the caller didn't do it in this case.
-         */
-        if ( msg->header_index == 0 )
-                write_message_header(msg);
-
-        return msg->payload + msg->fd_write_index;
+        gl_lock_lock(msg_pool_mutex);
 }
 
 
 
-int prelude_msg_clone(prelude_msg_t **dst, const prelude_msg_t *src)
+void _prelude_msg_fork_parent(void)
 {
-        size_t size = sizeof(*src) + src->hdr.datalen;
-
-        *dst = malloc(size);
-        if ( ! *dst )
-                return prelude_error_from_errno(errno);
+        gl_lock_unlock(msg_pool_mutex);
+}
 
-        memcpy(*dst, src, size);
 
-        if ( src->payload )
-                (*dst)->payload = (unsigned char *) (*dst) + sizeof(**dst);
 
-        return 0;
+void _prelude_msg_fork_child(void)
+{
+        gl_lock_init(msg_pool_mutex);
 }
@@ -42,6 +42,7 @@ struct prelude_msgbuf {
         int flags;
         void *data;
         prelude_msg_t *msg;
+        prelude_msg_dict_t *dict;
         int (*send_msg)(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg);
 };
 
@@ -49,6 +50,27 @@ struct prelude_msgbuf {
 static int default_send_msg_cb(prelude_msg_t **msg, void *data);
 
 
+
+static void set_msg_version(prelude_msgbuf_t *msgbuf)
+{
+        prelude_msg_dict_t *dict = NULL;
+
+        prelude_msg_set_version(msgbuf->msg, (msgbuf->flags & PRELUDE_MSGBUF_FLAGS_COMPACT) ? PRELUDE_MSG_VERSION_2 : PRELUDE_MSG_VERSION_1);
+
+        /*
+         * Dictionary chunks only exist in PRELUDE_MSG_VERSION_2.
+         */
+        if ( (msgbuf->flags & PRELUDE_MSGBUF_FLAGS_DICTIONARY) && (msgbuf->flags & PRELUDE_MSGBUF_FLAGS_COMPACT) ) {
+                if ( ! msgbuf->dict && _prelude_msg_dict_renew(&msgbuf->dict) < 0 )
+                        return;
+
+                dict = msgbuf->dict;
+        }
+
+        _prelude_msg_set_dict(msgbuf->msg, dict);
+}
+
+
 static int do_send_msg(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg) 
 {
         int ret;
@@ -59,6 +81,7 @@ static int do_send_msg(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg)
         
         prelude_msg_recycle(msg);
         prelude_msg_set_priority(msg, PRELUDE_MSG_PRIORITY_NONE);
+        set_msg_version(msgbuf);
         
         return ret;
 }
@@ -77,6 +100,8 @@ static int do_send_msg_async(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg)
         if ( ret < 0 )
                 return ret;
 
+        set_msg_version(msgbuf);
+
         return 0;
 }
 
@@ -118,6 +143,60 @@ int prelude_msgbuf_set(prelude_msgbuf_t *msgbuf, uint8_t tag, uint32_t len, cons
 
 
 
+/**
+ * prelude_msgbuf_set_uint:
+ * @msgbuf: Pointer on a #prelude_msgbuf_t object to store the data to.
+ * @tag: 8 bits unsigned integer describing the kind of data.
+ * @size: size of the integer, in bytes (1, 2, 4 or 8).
+ * @value: unsigned integer to store.
+ *
+ * See prelude_msg_set_uint().
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_msgbuf_set_uint(prelude_msgbuf_t *msgbuf, uint8_t tag, size_t size, uint64_t value)
+{
+        return prelude_msg_set_uint(msgbuf->msg, tag, size, value);
+}
+
+
+
+/**
+ * prelude_msgbuf_set_int:
+ * @msgbuf: Pointer on a #prelude_msgbuf_t object to store the data to.
+ * @tag: 8 bits unsigned integer describing the kind of data.
+ * @size: size of the integer, in bytes (1, 2, 4 or 8).
+ * @value: signed integer to store.
+ *
+ * See prelude_msg_set_int().
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_msgbuf_set_int(prelude_msgbuf_t *msgbuf, uint8_t tag, size_t size, int64_t value)
+{
+        return prelude_msg_set_int(msgbuf->msg, tag, size, value);
+}
+
+
+
+/**
+ * prelude_msgbuf_set_string:
+ * @msgbuf: Pointer on a #prelude_msgbuf_t object to store the data to.
+ * @tag: 8 bits unsigned integer describing the kind of data.
+ * @str: nul terminated string to store.
+ * @len: length of @str, not including the terminating nul byte.
+ *
+ * See prelude_msg_set_string().
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_msgbuf_set_string(prelude_msgbuf_t *msgbuf, uint8_t tag, const char *str, size_t len)
+{
+        return prelude_msg_set_string(msgbuf->msg, tag, str, len);
+}
+
+
+
 
 /**
  * prelude_msgbuf_new:
@@ -178,6 +257,16 @@ void prelude_msgbuf_mark_end(prelude_msgbuf_t *msgbuf)
          * only flush the message if we're not under an alert burst.
          */
         default_send_msg_cb(&msgbuf->msg, msgbuf);
+
+        /*
+         * A message could not be decoded by a peer using our dictionary:
+         * start a new one, which the next messages will define again.
+         */
+        if ( msgbuf->dict && _prelude_msg_dict_is_desync(msgbuf->dict) && prelude_msg_is_empty(msgbuf->msg) ) {
+                _prelude_msg_dict_destroy(msgbuf->dict);
+                msgbuf->dict = NULL;
+                set_msg_version(msgbuf);
+        }
 }
 
 
@@ -197,6 +286,9 @@ void prelude_msgbuf_destroy(prelude_msgbuf_t *msgbuf)
         if ( msgbuf->msg )
                 prelude_msg_destroy(msgbuf->msg);
 
+        if ( msgbuf->dict )
+                _prelude_msg_dict_destroy(msgbuf->dict);
+
         free(msgbuf);
 }
 
@@ -232,9 +324,18 @@ void *prelude_msgbuf_get_data(prelude_msgbuf_t *msgbuf)
 }
 
 
+/*
+ * With PRELUDE_MSGBUF_FLAGS_COMPACT, messages are written using
+ * PRELUDE_MSG_VERSION_2, starting with the next message. Adding
+ * PRELUDE_MSGBUF_FLAGS_DICTIONARY makes prelude_msgbuf_set_string()
+ * only send repeated strings once.
+ */
 void prelude_msgbuf_set_flags(prelude_msgbuf_t *msgbuf, prelude_msgbuf_flags_t flags)
 {        
         msgbuf->flags = flags;
+
+        if ( prelude_msg_is_empty(msgbuf->msg) )
+                set_msg_version(msgbuf);
 }
 
 
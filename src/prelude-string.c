@@ -39,6 +39,7 @@
 #include "prelude-log.h"
 #include "prelude-inttypes.h"
 #include "prelude-string.h"
+#include "prelude-arena.h"
 
 
 #define PRELUDE_ERROR_SOURCE_DEFAULT PRELUDE_ERROR_SOURCE_STRING
@@ -196,7 +197,7 @@ static int allocate_more_chunk_if_needed(prelude_string_t *s, size_t needed_len)
  */
 int prelude_string_new(prelude_string_t **string)
 {
-        *string = calloc(1, sizeof(**string));
+        *string = _prelude_object_calloc(sizeof(**string));
         if ( ! *string )
                 return prelude_error_from_errno(errno);
 
@@ -790,7 +791,7 @@ void prelude_string_destroy(prelude_string_t *string)
         prelude_string_destroy_internal(string);
 
         if ( string->flags & PRELUDE_STRING_OWN_STRUCTURE )
-                free(string);
+                _prelude_object_free(string);
 }
 
 
@@ -22,15 +22,21 @@
 *****/
 
 #include "config.h"
+#include "libmissing.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
 #include <assert.h>
 
+#if HAVE_SYS_TIME_H
+# include <sys/time.h>
+#endif
+
 #include "glthread/thread.h"
 #include "glthread/lock.h"
-#include "glthread/cond.h"
+#include "glthread/tls.h"
 
 #include "prelude-log.h"
 #include "prelude-list.h"
@@ -40,322 +46,486 @@
 
 #include "prelude-timer.h"
 
+
+/*
+ * Hierarchical timer wheel with millisecond resolution: the first level
+ * holds one slot per millisecond for the next 256 milliseconds, each of the
+ * following levels covers 64 times the range of the previous one. Timers
+ * move down one level each time the lower level wraps, which make timer
+ * insertion and removal O(1).
+ */
+#define TVR_BITS 8
+#define TVN_BITS 6
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVN_COUNT 4
+
+#define TVN_INDEX(clk, level) (((clk) >> (TVR_BITS + (level) * TVN_BITS)) & TVN_MASK)
+
+#define MAX_TIMEOUT ((((uint64_t) 1) << (TVR_BITS + TVN_COUNT * TVN_BITS)) - 1)
+
+/*
+ * Longest time the asynchronous timer thread sleeps without checking
+ * the global base.
+ */
+#define MAX_WAIT 1000
+
 #ifndef MIN
 # define MIN(x, y) (((x) < (y)) ? (x) : (y))
 #endif
 
-static PRELUDE_LIST(timer_list);
-static int next_wakeup = 0;
-static time_t last_wakeup = 0;
-static gl_lock_t mutex = gl_lock_initializer;
+
+struct prelude_timer_base {
+        gl_lock_t mutex;
+
+        uint64_t clk;
+        unsigned int count;
+
+        prelude_list_t tv1[TVR_SIZE];
+        prelude_list_t tvn[TVN_COUNT][TVN_SIZE];
+};
 
 
+static prelude_timer_base_t global_base;
 
-inline static void timer_lock_list(void)
+/*
+ * Time at which the global base will be serviced next, and callback
+ * to run when a timer expiring earlier is added, both protected by the
+ * global base mutex.
+ */
+static uint64_t global_armed = 0;
+static void (*global_notify)(void) = NULL;
+
+static gl_tls_key_t thread_base_key;
+gl_once_define(static, timer_once);
+
+
+
+static uint64_t get_real_msec(void)
 {
-        gl_lock_lock(mutex);
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+
+        return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
 
 
-inline static void timer_unlock_list(void)
+static uint64_t get_msec(time_t *sec)
 {
-        gl_lock_unlock(mutex);
+        time_t now;
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+
+        /*
+         * time() might lag behind gettimeofday(): never go past the second
+         * it returns, so that timers set in seconds don't expire before
+         * time() reached their expiration.
+         */
+        now = time(NULL);
+        if ( now < tv.tv_sec ) {
+                tv.tv_sec = now;
+                tv.tv_usec = 999999;
+        }
+
+        if ( sec )
+                *sec = tv.tv_sec;
+
+        return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
 
 
+static void timer_base_init(prelude_timer_base_t *base)
+{
+        int i, j;
 
-/*
- * Return the time elapsed by a timer 'timer' from now,
- * to the time it was created / reset.
- */
-static time_t time_elapsed(prelude_timer_t *timer, time_t now)
+        gl_lock_init(base->mutex);
+
+        base->count = 0;
+        base->clk = get_msec(NULL);
+
+        for ( i = 0; i < TVR_SIZE; i++ )
+                prelude_list_init(&base->tv1[i]);
+
+        for ( i = 0; i < TVN_COUNT; i++ ) {
+                for ( j = 0; j < TVN_SIZE; j++ )
+                        prelude_list_init(&base->tvn[i][j]);
+        }
+}
+
+
+
+static void timer_init_once(void)
 {
-        return now - timer->start_time;
+        gl_tls_key_init(thread_base_key, NULL);
+        timer_base_init(&global_base);
 }
 
 
 
+static prelude_timer_base_t *get_current_base(void)
+{
+        prelude_timer_base_t *base;
+
+        gl_once(timer_once, timer_init_once);
 
-static time_t time_remaining(prelude_timer_t *timer, time_t now)
+        base = gl_tls_get(thread_base_key);
+
+        return (base) ? base : &global_base;
+}
+
+
+
+static void wheel_add(prelude_timer_base_t *base, prelude_timer_t *timer)
 {
-        return timer->expire - time_elapsed(timer, now);
+        int level;
+        prelude_list_t *slot;
+        uint64_t due = timer->_due, delta;
+
+        if ( due < base->clk )
+                due = base->clk;
+
+        /*
+         * Timers beyond the range of the wheel are placed in its farthest
+         * slot, and requeued from there as their real due time is kept.
+         */
+        delta = due - base->clk;
+        if ( delta > MAX_TIMEOUT ) {
+                delta = MAX_TIMEOUT;
+                due = base->clk + delta;
+        }
+
+        if ( delta < TVR_SIZE )
+                slot = &base->tv1[due & TVR_MASK];
+        else {
+                for ( level = 0; level < TVN_COUNT - 1; level++ ) {
+                        if ( delta < ((uint64_t) 1 << (TVR_BITS + (level + 1) * TVN_BITS)) )
+                                break;
+                }
+
+                slot = &base->tvn[level][TVN_INDEX(due, level)];
+        }
+
+        prelude_list_add_tail(slot, &timer->list);
 }
 
 
 
+static void wheel_take(prelude_list_t *slot, prelude_list_t *expired)
+{
+        prelude_list_splice_tail(expired, slot);
+        prelude_list_init(slot);
+}
+
+
 
 /*
- * If timer 'timer' need to be waked up (it elapsed >= time
- * for it to expire), call it's callback function, with it's
- * registered argument.
- *
- * All expired timer should be destroyed.
+ * Move timers of the current slot of @level down the wheel,
+ * returns the index of that slot.
  */
-static int wake_up_if_needed(prelude_timer_t *timer, time_t now)
+static unsigned int wheel_cascade(prelude_timer_base_t *base, int level)
 {
-        assert(timer->start_time != -1);
+        prelude_list_t *tmp, *bkp;
+        prelude_timer_t *timer;
+        PRELUDE_LIST(cascade);
+        unsigned int index = TVN_INDEX(base->clk, level);
 
-        if ( now == -1 || time_elapsed(timer, now) >= prelude_timer_get_expire(timer) ) {
-                timer->start_time = -1;
+        wheel_take(&base->tvn[level][index], &cascade);
 
-                prelude_timer_get_callback(timer)(prelude_timer_get_data(timer));
+        prelude_list_for_each_safe(&cascade, tmp, bkp) {
+                timer = prelude_list_entry(tmp, prelude_timer_t, list);
 
-                return 0;
+                prelude_list_del(&timer->list);
+                wheel_add(base, timer);
         }
 
-        return (int) time_remaining(timer, now);
+        return index;
 }
 
 
 
+static void timer_destroy_unlocked(prelude_timer_t *timer)
+{
+        if ( ! prelude_list_is_empty(&timer->list) ) {
+                prelude_list_del_init(&timer->list);
+                timer->_base->count--;
+        }
+}
+
+
 
-static prelude_timer_t *get_next_timer(void)
+/*
+ * Returns TRUE if the servicing thread needs to be notified of the
+ * new timer.
+ */
+static prelude_bool_t timer_init_unlocked(prelude_timer_base_t *base, prelude_timer_t *timer)
 {
-        prelude_list_t *tmp;
-        prelude_timer_t *timer = NULL;
+        uint64_t now;
 
-        gl_lock_lock(mutex);
+        now = get_msec(&timer->start_time);
 
-        prelude_list_for_each(&timer_list, tmp) {
-                timer = prelude_list_entry(tmp, prelude_timer_t, list);
-                break;
-        }
+        /*
+         * Don't have the next wake-up walk through the time the wheel was empty.
+         */
+        if ( base->count == 0 )
+                base->clk = now;
+
+        /*
+         * Timers set in seconds expire on a second boundary, as they always did.
+         * Millisecond timers start from the unclamped time, so that they never
+         * expire early.
+         */
+        if ( timer->_expire_ms )
+                timer->_due = get_real_msec() + timer->_expire_ms;
+        else
+                timer->_due = ((uint64_t) timer->start_time + timer->expire) * 1000;
 
-        gl_lock_unlock(mutex);
+        timer->_base = base;
+        base->count++;
 
-        return timer;
+        wheel_add(base, timer);
+
+        if ( base != &global_base || ! global_notify || timer->_due >= global_armed )
+                return FALSE;
+
+        global_armed = timer->_due;
+
+        return TRUE;
 }
 
 
 
 /*
- * Walk the list of timer,
- * call the wake_up_if_need_function on each timer.
+ * Put timers from @expired that are not due yet back in the wheel.
  */
-static void walk_and_wake_up_timer(time_t now)
+static void wheel_requeue(prelude_timer_base_t *base, prelude_list_t *expired)
 {
-        int ret, woke = 0;
+        prelude_list_t *tmp, *bkp;
         prelude_timer_t *timer;
 
-        while ( (timer = get_next_timer()) ) {
+        prelude_list_for_each_safe(expired, tmp, bkp) {
+                timer = prelude_list_entry(tmp, prelude_timer_t, list);
 
-                ret = wake_up_if_needed(timer, now);
-                if ( ret != 0 ) {
-                        next_wakeup = ret;
-                        break;
+                if ( timer->_due >= base->clk ) {
+                        prelude_list_del(&timer->list);
+                        wheel_add(base, timer);
                 }
-
-                woke++;
         }
-
-        prelude_log_debug(5, "woke up %d timer, next wakeup in %d seconds\n", woke, next_wakeup);
 }
 
 
 
 /*
- * search the timer list forward for the timer entry
- * that should be before our inserted timer.
+ * Call the callback of each timer in @expired, with @base locked.
  */
-static prelude_list_t *search_previous_forward(prelude_timer_t *timer, time_t expire)
+static unsigned int timer_expire_list(prelude_timer_base_t *base, prelude_list_t *expired)
 {
-        int hop = 0;
-        prelude_timer_t *cur;
-        prelude_list_t *tmp, *prev = NULL;
+        unsigned int woke = 0;
+        prelude_timer_t *timer;
 
-        prelude_list_for_each(&timer_list, tmp) {
-                cur = prelude_list_entry(tmp, prelude_timer_t, list);
+        /*
+         * The lock is released while callbacks run: a timer can be
+         * reset or destroyed from its own, or another timer, callback.
+         */
+        while ( ! prelude_list_is_empty(expired) ) {
+                timer = prelude_list_entry(expired->next, prelude_timer_t, list);
 
-                hop++;
+                prelude_list_del_init(&timer->list);
+                timer->start_time = -1;
+                base->count--;
 
-                if ( (cur->start_time + cur->expire) < expire ) {
-                        /*
-                         * we found a previous timer (expiring before us),
-                         * but we're walking the list forward, and there could be more...
-                         * save and continue.
-                         */
-                        prev = tmp;
-                        continue;
-                }
+                gl_lock_unlock(base->mutex);
 
-                else if ( (cur->start_time + cur->expire) == expire ) {
-                        /*
-                         * we found a timer that's expiring at the same time
-                         * as us. Return it as the previous insertion point.
-                         */
-                        prelude_log_debug(5, "[expire=%d] found forward in %d hop at %p\n", timer->expire, hop, cur);
-                        return tmp;
-                }
+                prelude_timer_get_callback(timer)(prelude_timer_get_data(timer));
+                woke++;
 
-                else if ( (cur->start_time + cur->expire) > expire ) {
-                        /*
-                         * we found a timer expiring after us. We can return
-                         * the previously saved entry.
-                         */
-                        prelude_log_debug(5, "[expire=%d] found forward in %d hop at %p\n", timer->expire, hop, cur);
-                        assert(prev);
-                        return prev;
-                }
+                gl_lock_lock(base->mutex);
         }
 
-        /*
-         * this should never happen, as search_previous_timer verify
-         * if timer should be inserted last.
-         */
-        abort();
+        return woke;
 }
 
 
 
-
 /*
- * search the timer list backward for the timer entry
- * that should be before our inserted timer.
+ * Run timers of @base expiring up to @now.
  */
-static prelude_list_t *search_previous_backward(prelude_timer_t *timer, time_t expire)
+static unsigned int timer_run(prelude_timer_base_t *base, uint64_t now)
 {
-        int hop = 0;
-        prelude_timer_t *cur;
-        prelude_list_t *tmp;
+        int level;
+        unsigned int index, woke = 0;
+        PRELUDE_LIST(expired);
+
+        gl_lock_lock(base->mutex);
 
-        for ( tmp = timer_list.prev; tmp != &timer_list; tmp = tmp->prev ) {
+        /*
+         * Nothing to cascade when the wheel is empty.
+         */
+        if ( base->count == 0 && base->clk <= now )
+                base->clk = now + 1;
 
-                cur = prelude_list_entry(tmp, prelude_timer_t, list);
+        while ( base->clk <= now ) {
+                index = base->clk & TVR_MASK;
 
-                if ( (cur->start_time + cur->expire) <= expire ) {
-                        prelude_log_debug(5, "[expire=%d] found backward in %d hop at %p\n", timer->expire, hop + 1, cur);
-                        assert(tmp);
-                        return tmp;
+                for ( level = 0; ! index && level < TVN_COUNT; level++ ) {
+                        if ( wheel_cascade(base, level) != 0 )
+                                break;
                 }
 
-                hop++;
+                base->clk++;
+
+                if ( prelude_list_is_empty(&base->tv1[index]) )
+                        continue;
+
+                wheel_take(&base->tv1[index], &expired);
+                wheel_requeue(base, &expired);
+
+                woke += timer_expire_list(base, &expired);
         }
 
-        /*
-         * this should never happen, as search_previous_timer verify
-         * if timer should be inserted first.
-         */
-        abort();
-}
+        gl_lock_unlock(base->mutex);
 
+        return woke;
+}
 
 
 
-inline static prelude_timer_t *get_first_timer(void)
+/*
+ * Expire every timer of @base.
+ */
+static void timer_flush(prelude_timer_base_t *base)
 {
-        return prelude_list_entry(timer_list.next, prelude_timer_t, list);
-}
+        int i, j;
+        PRELUDE_LIST(expired);
 
+        gl_lock_lock(base->mutex);
 
+        /*
+         * Callbacks might reinsert timers, which are then handled by the next pass.
+         */
+        while ( base->count ) {
+                for ( i = 0; i < TVR_SIZE; i++ )
+                        wheel_take(&base->tv1[(base->clk + i) & TVR_MASK], &expired);
 
+                for ( i = 0; i < TVN_COUNT; i++ ) {
+                        for ( j = 0; j < TVN_SIZE; j++ )
+                                wheel_take(&base->tvn[i][(TVN_INDEX(base->clk, i) + j) & TVN_MASK], &expired);
+                }
 
-inline static prelude_timer_t *get_last_timer(void)
-{
-        return prelude_list_entry(timer_list.prev, prelude_timer_t, list);
+                timer_expire_list(base, &expired);
+        }
+
+        gl_lock_unlock(base->mutex);
 }
 
 
 
 /*
- * On entering in this function, we know that :
- * - expire is > than first_expire.
- * - expire is < than last_expire.
+ * Return the number of milliseconds until the next timer of @base
+ * might expire, at most @max, called with @base locked.
  */
-static prelude_list_t *search_previous_timer(prelude_timer_t *timer)
+static uint64_t timer_next_expire(prelude_timer_base_t *base, uint64_t max)
 {
-        prelude_timer_t *last, *first;
-        time_t last_remaining, first_remaining;
+        int level;
+        unsigned int i, shift;
+        uint64_t next, ret = max;
 
-        last = get_last_timer();
-        first = get_first_timer();
+        if ( base->count == 0 )
+                return ret;
 
-        /*
-         * timer we want to insert expire after (or at the same time) the known
-         * to be expiring last timer. This mean we should insert the new timer
-         * at the end of the list.
-         */
-        if ( timer->expire >= time_remaining(last, timer->start_time) ) {
-                assert(timer_list.prev);
-                prelude_log_debug(5, "[expire=%d] found without search (insert last)\n", timer->expire);
-                return timer_list.prev;
+        for ( i = 0; i < TVR_SIZE && i < ret; i++ ) {
+                if ( ! prelude_list_is_empty(&base->tv1[(base->clk + i) & TVR_MASK]) ) {
+                        ret = i;
+                        break;
+                }
         }
 
         /*
-         * timer we want to insert expire before (or at the same time), the known
-         * to be expiring first timer. This mean we should insert the new timer at
-         * the beginning of the list.
+         * Timers from higher levels expire at the earliest when their
+         * slot gets cascaded.
          */
-        if ( timer->expire <= time_remaining(first, timer->start_time) ) {
-                prelude_log_debug(5, "[expire=%d] found without search (insert first)\n", timer->expire);
-                return &timer_list;
+        for ( level = 0; level < TVN_COUNT; level++ ) {
+                shift = TVR_BITS + level * TVN_BITS;
+
+                for ( i = 1; i <= TVN_SIZE; i++ ) {
+                        next = (((base->clk >> shift) + i) << shift) - base->clk;
+                        if ( next >= ret )
+                                break;
+
+                        if ( ! prelude_list_is_empty(&base->tvn[level][(TVN_INDEX(base->clk, level) + i) & TVN_MASK]) ) {
+                                ret = next;
+                                break;
+                        }
+                }
         }
 
-        /*
-         * we now know we expire after the first expiring timer,
-         * but before the last expiring one.
-         *
-         * compute expiration time for current, last, and first timer.
-         */
-        last_remaining = time_remaining(last, timer->start_time);
-        first_remaining = time_remaining(first, timer->start_time);
-
-        /*
-         * use the better list iterating function to find the previous timer.
-         */
-        if ( (last_remaining - timer->expire) > (timer->expire - first_remaining) )
-                /*
-                 * previous is probably near the beginning of the list.
-                 */
-                return search_previous_forward(timer, timer->expire + timer->start_time);
-        else
-                /*
-                 * previous is probably near the end of the list.
-                 */
-                return search_previous_backward(timer, timer->expire + timer->start_time);
+        return ret;
 }
 
 
 
-static void timer_destroy_unlocked(prelude_timer_t *timer)
+/*
+ * Run timers of @base that expired, then return the number of
+ * milliseconds until the next one might, at most @max.
+ */
+static uint64_t timer_wake_up(prelude_timer_base_t *base, uint64_t max)
 {
-        if ( ! prelude_list_is_empty(&timer->list) )
-                prelude_list_del_init(&timer->list);
-}
-
+        uint64_t now, ret;
 
+        now = get_msec(NULL);
+        timer_run(base, now);
 
+        gl_lock_lock(base->mutex);
 
-static void timer_init_unlocked(prelude_timer_t *timer)
-{
-        prelude_list_t *prev;
+        /*
+         * The wheel is ahead of @now once it was run: its next slot is
+         * at least one millisecond away.
+         */
+        ret = timer_next_expire(base, max);
+        if ( base->clk > now )
+                ret = MIN(ret + (base->clk - now), max);
 
-        timer->start_time = time(NULL);
+        if ( base == &global_base )
+                global_armed = now + ret;
 
-        if ( ! prelude_list_is_empty(&timer_list) )
-                prev = search_previous_timer(timer);
-        else
-                prev = &timer_list;
+        gl_lock_unlock(base->mutex);
 
-        prelude_list_add(prev, &timer->list);
-        next_wakeup = MIN(next_wakeup, prelude_timer_get_expire(timer));
+        return ret;
 }
 
 
 
+static void timer_notify(prelude_bool_t notify)
+{
+        if ( notify )
+                global_notify();
+}
+
+
 
 /**
  * prelude_timer_init:
  * @timer: timer to initialize.
  *
- * Initialize a timer (add it to the timer list).
+ * Initialize a timer (add it to the timer list). The timer is handled by
+ * the timer base of the calling thread if one was set using
+ * prelude_timer_set_thread_base(), by the global timer base otherwise.
  */
 void prelude_timer_init(prelude_timer_t *timer)
 {
-        timer_lock_list();
-        timer_init_unlocked(timer);
-        timer_unlock_list();
+        prelude_bool_t notify;
+        prelude_timer_base_t *base = get_current_base();
+
+        gl_lock_lock(base->mutex);
+        notify = timer_init_unlocked(base, timer);
+        gl_lock_unlock(base->mutex);
+
+        timer_notify(notify);
 }
 
 
@@ -371,6 +541,7 @@ void prelude_timer_init(prelude_timer_t *timer)
  */
 void prelude_timer_init_list(prelude_timer_t *timer)
 {
+        timer->_base = NULL;
         prelude_list_init(&timer->list);
 }
 
@@ -384,12 +555,17 @@ void prelude_timer_init_list(prelude_timer_t *timer)
  */
 void prelude_timer_reset(prelude_timer_t *timer)
 {
-        timer_lock_list();
+        prelude_bool_t notify;
+        prelude_timer_base_t *base = (timer->_base) ? timer->_base : get_current_base();
+
+        gl_lock_lock(base->mutex);
 
         timer_destroy_unlocked(timer);
-        timer_init_unlocked(timer);
+        notify = timer_init_unlocked(base, timer);
+
+        gl_lock_unlock(base->mutex);
 
-        timer_unlock_list();
+        timer_notify(notify);
 }
 
 
@@ -404,9 +580,14 @@ void prelude_timer_reset(prelude_timer_t *timer)
  */
 void prelude_timer_destroy(prelude_timer_t *timer)
 {
-        timer_lock_list();
+        prelude_timer_base_t *base = timer->_base;
+
+        if ( ! base )
+                return;
+
+        gl_lock_lock(base->mutex);
         timer_destroy_unlocked(timer);
-        timer_unlock_list();
+        gl_lock_unlock(base->mutex);
 }
 
 
@@ -414,23 +595,24 @@ void prelude_timer_destroy(prelude_timer_t *timer)
 /**
  * prelude_timer_wake_up:
  *
- * Wake up timer that need it.
- * This function should be called every second to work properly.
+ * Wake up timer that need it. When no timer is pending, this function
+ * should be called again within a second, so that timers initialized in
+ * the meantime are handled.
  *
  * Returns: Number of second in which prelude_timer_wake_up() should be called again.
  */
 int prelude_timer_wake_up(void)
 {
-        time_t now = time(NULL);
+        uint64_t next;
 
-        if ( now - last_wakeup >= next_wakeup ) {
-                walk_and_wake_up_timer(now);
-                last_wakeup = now;
-        }
+        gl_once(timer_once, timer_init_once);
 
-        return next_wakeup;
-}
+        next = timer_wake_up(&global_base, MAX_TIMEOUT);
+        if ( next == MAX_TIMEOUT )
+                return 1;
 
+        return (next + 999) / 1000;
+}
 
 
 
@@ -441,11 +623,95 @@ int prelude_timer_wake_up(void)
  */
 void prelude_timer_flush(void)
 {
-        walk_and_wake_up_timer(-1);
+        gl_once(timer_once, timer_init_once);
+        timer_flush(&global_base);
 }
 
 
 
+/**
+ * prelude_timer_base_new:
+ * @base: Pointer where to store the created #prelude_timer_base_t object.
+ *
+ * Create a new timer base. Timers initialized from a thread using @base
+ * as its timer base (see prelude_timer_set_thread_base()) are only woken
+ * up by prelude_timer_base_wake_up(), and don't contend with timers from
+ * other threads.
+ *
+ * Returns: 0 on success, a negative value if an error occured.
+ */
+int prelude_timer_base_new(prelude_timer_base_t **base)
+{
+        *base = malloc(sizeof(**base));
+        if ( ! *base )
+                return prelude_error_from_errno(errno);
+
+        timer_base_init(*base);
+
+        return 0;
+}
+
+
+
+/**
+ * prelude_timer_base_destroy:
+ * @base: Pointer to a #prelude_timer_base_t object.
+ *
+ * Destroy @base. Timers still registered in @base should have been
+ * destroyed beforehand.
+ */
+void prelude_timer_base_destroy(prelude_timer_base_t *base)
+{
+        assert(base->count == 0);
+
+        gl_lock_destroy(base->mutex);
+        free(base);
+}
+
+
+
+/**
+ * prelude_timer_set_thread_base:
+ * @base: Pointer to a #prelude_timer_base_t object, or NULL.
+ *
+ * Timers initialized by the calling thread will be registered in @base,
+ * or in the global timer base if @base is NULL.
+ */
+void prelude_timer_set_thread_base(prelude_timer_base_t *base)
+{
+        gl_once(timer_once, timer_init_once);
+        gl_tls_set(thread_base_key, base);
+}
+
+
+
+/**
+ * prelude_timer_get_thread_base:
+ *
+ * Returns: the timer base set for the calling thread, or NULL.
+ */
+prelude_timer_base_t *prelude_timer_get_thread_base(void)
+{
+        gl_once(timer_once, timer_init_once);
+        return gl_tls_get(thread_base_key);
+}
+
+
+
+/**
+ * prelude_timer_base_wake_up:
+ * @base: Pointer to a #prelude_timer_base_t object.
+ *
+ * Wake up timers from @base that need it.
+ *
+ * Returns: Number of milliseconds in which prelude_timer_base_wake_up() should be called again.
+ */
+unsigned int prelude_timer_base_wake_up(prelude_timer_base_t *base)
+{
+        return timer_wake_up(base, 1000);
+}
+
+
 
 /**
  * prelude_timer_lock_critical_region:
@@ -454,7 +720,8 @@ void prelude_timer_flush(void)
  */
 void prelude_timer_lock_critical_region(void)
 {
-        timer_lock_list();
+        gl_once(timer_once, timer_init_once);
+        gl_lock_lock(global_base.mutex);
 }
 
 
@@ -466,18 +733,48 @@ void prelude_timer_lock_critical_region(void)
  */
 void prelude_timer_unlock_critical_region(void)
 {
-        timer_unlock_list();
+        gl_lock_unlock(global_base.mutex);
 }
 
 
 
 int _prelude_timer_init(void)
 {
+        gl_once(timer_once, timer_init_once);
         return 0;
 }
 
 
 
+/*
+ * Wake up timers from the global base, returns the number of milliseconds
+ * in which _prelude_timer_wake_up() should be called again, unless the
+ * notification callback is run first.
+ */
+unsigned int _prelude_timer_wake_up(void)
+{
+        gl_once(timer_once, timer_init_once);
+        return timer_wake_up(&global_base, MAX_WAIT);
+}
+
+
+
+/*
+ * @notify is called when a timer added to the global base expires before
+ * the time returned by the last call to _prelude_timer_wake_up().
+ */
+void _prelude_timer_set_notify(void (*notify)(void))
+{
+        gl_once(timer_once, timer_init_once);
+
+        gl_lock_lock(global_base.mutex);
+        global_notify = notify;
+        global_armed = 0;
+        gl_lock_unlock(global_base.mutex);
+}
+
+
+
 void _prelude_timer_fork_prepare(void)
 {
         prelude_timer_lock_critical_region();
@@ -492,6 +789,5 @@ void _prelude_timer_fork_parent(void)
 
 void _prelude_timer_fork_child(void)
 {
-        prelude_list_init(&timer_list);
-        gl_lock_init(mutex);
+        timer_base_init(&global_base);
 }
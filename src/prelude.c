@@ -40,6 +40,7 @@
 #include "prelude-timer.h"
 #include "variable.h"
 #include "tls-auth.h"
+#include "prelude-arena.h"
 
 
 int _prelude_internal_argc = 0;
@@ -214,6 +215,9 @@ void prelude_deinit(void)
         tls_auth_deinit();
         gnutls_global_deinit();
 
+        _prelude_arena_deinit();
+        _prelude_msg_pool_deinit();
+
         _prelude_thread_deinit();
 }
 
@@ -316,6 +320,7 @@ void prelude_fork_prepare(void)
 
         _prelude_async_fork_prepare();
         _prelude_timer_fork_prepare();
+        _prelude_msg_fork_prepare();
 
         _idmef_path_cache_lock();
         gl_lock_lock(_criteria_parse_mutex);
@@ -330,6 +335,7 @@ void prelude_fork_parent(void)
 
         _prelude_async_fork_parent();
         _prelude_timer_fork_parent();
+        _prelude_msg_fork_parent();
 
         _idmef_path_cache_unlock();
         gl_lock_unlock(_criteria_parse_mutex);
@@ -344,6 +350,7 @@ void prelude_fork_child(void)
 
         _prelude_async_fork_child();
         _prelude_timer_fork_child();
+        _prelude_msg_fork_child();
 
         _idmef_path_cache_reinit();
         gl_lock_init(_criteria_parse_mutex);
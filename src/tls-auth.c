@@ -29,7 +29,9 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <errno.h>
+#include <poll.h>
 
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
@@ -44,6 +46,7 @@
 #include "prelude-client.h"
 #include "prelude-message-id.h"
 #include "prelude-extract.h"
+#include "prelude-list.h"
 
 #include "tls-util.h"
 #include "tls-auth.h"
@@ -59,41 +62,124 @@ static gnutls_priority_t tls_priority;
 static prelude_bool_t priority_set = FALSE;
 
 
+typedef enum {
+        TLS_AUTH_STEP_HANDSHAKE,
+        TLS_AUTH_STEP_RESULT,
+        TLS_AUTH_STEP_BYE,
+        TLS_AUTH_STEP_DONE
+} tls_auth_step_t;
 
-static int read_auth_result(prelude_io_t *fd)
+
+struct tls_auth_state {
+        int fd;
+        int crypt;
+        prelude_io_t *io;
+        prelude_msg_t *msg;
+        tls_auth_step_t step;
+        gnutls_session_t session;
+
+        /*
+         * Session resumption: credentials the session was established with,
+         * and identity of the peer as recorded by a previous full handshake.
+         */
+        void *cred;
+        prelude_bool_t resumed;
+        uint64_t peer_analyzerid;
+        prelude_connection_permission_t peer_permission;
+        struct timeval start;
+
+        /*
+         * Protocol extensions advertised by the manager.
+         */
+        uint32_t peer_features;
+};
+
+
+/*
+ * Credentials are shared by all profiles using the same key and
+ * certificates, and sessions are kept by credentials and peer, so
+ * that reconnecting to a manager only needs an abbreviated handshake.
+ */
+typedef struct {
+        prelude_list_t list;
+        unsigned int refcount;
+        char *id;
+        gnutls_certificate_credentials_t cred;
+} tls_credentials_t;
+
+
+typedef struct {
+        prelude_list_t list;
+        void *cred;
+        uint64_t analyzerid;
+        prelude_connection_permission_t permission;
+        gnutls_datum_t data;
+} tls_session_t;
+
+
+static PRELUDE_LIST(credentials_list);
+static PRELUDE_LIST(session_list);
+static gl_lock_t cache_mutex = gl_lock_initializer;
+static prelude_connection_tls_stats_t tls_stats;
+
+
+
+static int read_auth_result(prelude_io_t *fd, prelude_msg_t **msg, uint32_t *features)
 {
         int ret;
         void *buf;
         uint8_t tag;
         uint32_t len;
-        prelude_msg_t *msg = NULL;
 
-        do {
-                ret = prelude_msg_read(&msg, fd);
-        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+        /*
+         * On a non blocking socket, a partially read message is kept
+         * in *msg so that reading can be resumed later on.
+         */
+        ret = prelude_msg_read(msg, fd);
+        if ( ret < 0 ) {
+                if ( prelude_error_get_code(ret) != PRELUDE_ERROR_EAGAIN && *msg ) {
+                        prelude_msg_destroy(*msg);
+                        *msg = NULL;
+                }
 
-        if ( ret < 0 )
                 return ret;
-
-        if ( prelude_msg_get_tag(msg) != PRELUDE_MSG_AUTH ) {
-                prelude_msg_destroy(msg);
-                return prelude_error(PRELUDE_ERROR_INVAL_MESSAGE);
         }
 
-        ret = prelude_msg_get(msg, &tag, &len, &buf);
-        if ( ret < 0 ) {
-                prelude_msg_destroy(msg);
-                return ret;
+        if ( prelude_msg_get_tag(*msg) != PRELUDE_MSG_AUTH ) {
+                ret = prelude_error(PRELUDE_ERROR_INVAL_MESSAGE);
+                goto out;
         }
 
+        ret = prelude_msg_get(*msg, &tag, &len, &buf);
+        if ( ret < 0 )
+                goto out;
+
         if ( tag != PRELUDE_MSG_AUTH_SUCCEED ) {
-                prelude_msg_destroy(msg);
-                return prelude_error(PRELUDE_ERROR_TLS_AUTH_REJECTED);
+                ret = prelude_error(PRELUDE_ERROR_TLS_AUTH_REJECTED);
+                goto out;
         }
 
-        prelude_msg_destroy(msg);
+        /*
+         * Managers supporting protocol extensions advertise them in an
+         * additional chunk, older ones don't send anything more.
+         */
+        while ( (ret = prelude_msg_get(*msg, &tag, &len, &buf)) == 0 ) {
+                if ( tag != PRELUDE_MSG_AUTH_FEATURES )
+                        continue;
 
-        return 0;
+                ret = prelude_extract_uint32_safe(features, buf, len);
+                if ( ret < 0 )
+                        goto out;
+        }
+
+        if ( prelude_error_get_code(ret) == PRELUDE_ERROR_EOF )
+                ret = 0;
+
+ out:
+        prelude_msg_destroy(*msg);
+        *msg = NULL;
+
+        return ret;
 }
 
 
@@ -266,12 +352,132 @@ static ssize_t tls_push(gnutls_transport_ptr_t fd, const void *buf, size_t count
 }
 
 
-int tls_auth_connection(prelude_client_profile_t *cp, prelude_io_t *io, int crypt,
-                        uint64_t *analyzerid, prelude_connection_permission_t *permission)
+static tls_session_t *session_cache_get(void *cred, uint64_t analyzerid)
 {
+        prelude_list_t *tmp;
+        tls_session_t *session;
+
+        prelude_list_for_each(&session_list, tmp) {
+                session = prelude_list_entry(tmp, tls_session_t, list);
+
+                if ( session->cred == cred && session->analyzerid == analyzerid )
+                        return session;
+        }
+
+        return NULL;
+}
+
+
+
+static void session_cache_del(tls_session_t *session)
+{
+        prelude_list_del(&session->list);
+        gnutls_free(session->data.data);
+        free(session);
+}
+
+
+
+static void session_cache_restore(tls_auth_state_t *state)
+{
+        tls_session_t *session;
+
+        if ( ! state->peer_analyzerid )
+                return;
+
+        gl_lock_lock(cache_mutex);
+
+        session = session_cache_get(state->cred, state->peer_analyzerid);
+        if ( session ) {
+                state->peer_permission = session->permission;
+                gnutls_session_set_data(state->session, session->data.data, session->data.size);
+        }
+
+        gl_lock_unlock(cache_mutex);
+}
+
+
+
+static void session_cache_store(tls_auth_state_t *state, uint64_t analyzerid, prelude_connection_permission_t permission)
+{
+        int ret;
+        gnutls_datum_t data;
+        tls_session_t *session;
+
+        ret = gnutls_session_get_data2(state->session, &data);
+        if ( ret < 0 )
+                return;
+
+        gl_lock_lock(cache_mutex);
+
+        session = session_cache_get(state->cred, analyzerid);
+        if ( session )
+                gnutls_free(session->data.data);
+
+        else {
+                session = malloc(sizeof(*session));
+                if ( ! session ) {
+                        gl_lock_unlock(cache_mutex);
+                        gnutls_free(data.data);
+                        return;
+                }
+
+                session->cred = state->cred;
+                session->analyzerid = analyzerid;
+                prelude_list_add_tail(&session_list, &session->list);
+        }
+
+        session->data = data;
+        session->permission = permission;
+
+        gl_lock_unlock(cache_mutex);
+}
+
+
+
+static void update_handshake_stats(tls_auth_state_t *state)
+{
+        uint64_t usec;
+        struct timeval end;
+
+        gettimeofday(&end, NULL);
+        usec = (uint64_t) (end.tv_sec - state->start.tv_sec) * 1000000 + (end.tv_usec - state->start.tv_usec);
+
+        gl_lock_lock(cache_mutex);
+
+        tls_stats.handshakes++;
+        tls_stats.handshake_usec += usec;
+
+        if ( state->resumed )
+                tls_stats.resumed_handshakes++;
+
+        gl_lock_unlock(cache_mutex);
+
+        prelude_log_debug(3, "TLS %s handshake completed in %" PRELUDE_PRIu64 " usec.\n",
+                          (state->resumed) ? "abbreviated" : "full", usec);
+}
+
+
+
+void tls_auth_get_stats(prelude_connection_tls_stats_t *stats)
+{
+        gl_lock_lock(cache_mutex);
+        *stats = tls_stats;
+        gl_lock_unlock(cache_mutex);
+}
+
+
+
+/*
+ * If @peer_analyzerid is known, from a previous connection to the same
+ * manager, the session established at that time is resumed if possible.
+ */
+int tls_auth_connection_start(prelude_client_profile_t *cp, prelude_io_t *io, int crypt,
+                              uint64_t peer_analyzerid, tls_auth_state_t **out)
+{
+        int ret;
         void *cred;
-        int ret, fd;
-        gnutls_session_t session;
+        tls_auth_state_t *state;
 
         if ( ! priority_set ) {
                 ret = tls_auth_init_priority(NULL);
@@ -283,60 +489,218 @@ int tls_auth_connection(prelude_client_profile_t *cp, prelude_io_t *io, int cryp
         if ( ret < 0 )
                 return ret;
 
-        ret = gnutls_init(&session, GNUTLS_CLIENT);
-        if ( ret < 0 )
+        state = calloc(1, sizeof(*state));
+        if ( ! state )
+                return prelude_error_from_errno(errno);
+
+        ret = gnutls_init(&state->session, GNUTLS_CLIENT);
+        if ( ret < 0 ) {
+                free(state);
                 return prelude_error_verbose(PRELUDE_ERROR_PROFILE, "TLS initialization error: %s", gnutls_strerror(ret));
+        }
 
-        set_default_priority(session);
-        gnutls_credentials_set(session, GNUTLS_CRD_CERTIFICATE, cred);
+        set_default_priority(state->session);
+        gnutls_credentials_set(state->session, GNUTLS_CRD_CERTIFICATE, cred);
 
-        fd = prelude_io_get_fd(io);
-        gnutls_transport_set_ptr(session, fd_to_ptr(fd));
-        gnutls_transport_set_pull_function(session, tls_pull);
-        gnutls_transport_set_push_function(session, tls_push);
+        state->io = io;
+        state->cred = cred;
+        state->crypt = crypt;
+        state->fd = prelude_io_get_fd(io);
+        state->step = TLS_AUTH_STEP_HANDSHAKE;
+        state->peer_analyzerid = peer_analyzerid;
 
-        do {
-                ret = gnutls_handshake(session);
-        } while ( ret < 0 && handle_gnutls_error(session, ret) == 0 );
+        session_cache_restore(state);
+        gettimeofday(&state->start, NULL);
 
-        if ( ret < 0 ) {
-                gnutls_deinit(session);
-                return prelude_error_verbose(PRELUDE_ERROR_PROFILE, "TLS handshake failed: %s", gnutls_strerror(ret));
-        }
+        gnutls_transport_set_ptr(state->session, fd_to_ptr(state->fd));
+        gnutls_transport_set_pull_function(state->session, tls_pull);
+        gnutls_transport_set_push_function(state->session, tls_push);
+
+        *out = state;
+
+        return 0;
+}
+
+
+
+/*
+ * Drive the authentication as far as possible without blocking.
+ * PRELUDE_ERROR_EAGAIN is returned when the underlying socket is not
+ * ready, in which case the caller should wait for it to become readable
+ * or writable (see tls_auth_connection_want_write()) and call us again.
+ */
+int tls_auth_connection_resume(tls_auth_state_t *state, uint64_t *analyzerid, prelude_connection_permission_t *permission)
+{
+        int ret;
+
+        switch ( state->step ) {
+
+        case TLS_AUTH_STEP_HANDSHAKE:
+                do {
+                        ret = gnutls_handshake(state->session);
+                } while ( ret < 0 && ret != GNUTLS_E_AGAIN && handle_gnutls_error(state->session, ret) == 0 );
+
+                if ( ret == GNUTLS_E_AGAIN )
+                        return prelude_error(PRELUDE_ERROR_EAGAIN);
+
+                if ( ret < 0 )
+                        return prelude_error_verbose(PRELUDE_ERROR_PROFILE, "TLS handshake failed: %s", gnutls_strerror(ret));
+
+                state->resumed = gnutls_session_is_resumed(state->session) ? TRUE : FALSE;
+                update_handshake_stats(state);
+
+                /*
+                 * A resumed session was verified by the handshake that established it.
+                 */
+                if ( ! state->resumed ) {
+                        ret = verify_certificate(state->session);
+                        if ( ret < 0 )
+                                return ret;
+                }
+
+                /*
+                 * From now on, the session belong to the prelude_io_t object.
+                 */
+                prelude_io_set_tls_io(state->io, state->session);
+                state->step = TLS_AUTH_STEP_RESULT;
+
+                /* fall through */
+
+        case TLS_AUTH_STEP_RESULT:
+                /*
+                 * Data already decrypted by GnuTLS won't trigger any
+                 * further event on the socket: consume it now.
+                 */
+                do {
+                        ret = read_auth_result(state->io, &state->msg, &state->peer_features);
+                } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN &&
+                          gnutls_record_check_pending(state->session) > 0 );
+
+                if ( ret < 0 )
+                        return ret;
+
+                if ( state->resumed ) {
+                        *analyzerid = state->peer_analyzerid;
+                        *permission = state->peer_permission;
+                } else {
+                        ret = tls_certificate_get_peer_analyzerid(state->session, analyzerid);
+                        if ( ret < 0 )
+                                return ret;
+
+                        ret = tls_certificate_get_permission(state->session, permission);
+                        if ( ret < 0 )
+                                return ret;
+                }
+
+                /*
+                 * With TLS 1.3, the ticket is only sent after the handshake:
+                 * it was received along with the authentication result.
+                 */
+                session_cache_store(state, *analyzerid, *permission);
+
+                if ( state->crypt ) {
+                        state->step = TLS_AUTH_STEP_DONE;
+                        return 0;
+                }
+
+                state->step = TLS_AUTH_STEP_BYE;
+
+                /* fall through */
+
+        case TLS_AUTH_STEP_BYE:
+                do {
+                        ret = gnutls_bye(state->session, GNUTLS_SHUT_RDWR);
+                } while ( ret < 0 && ret != GNUTLS_E_AGAIN && handle_gnutls_error(state->session, ret) == 0 );
+
+                if ( ret == GNUTLS_E_AGAIN )
+                        return prelude_error(PRELUDE_ERROR_EAGAIN);
+
+                if ( ret < 0 )
+                        ret = prelude_error_verbose(PRELUDE_ERROR_TLS, "TLS bye failed: %s", gnutls_strerror(ret));
+
+                gnutls_deinit(state->session);
+                prelude_io_set_sys_io(state->io, state->fd);
+                state->step = TLS_AUTH_STEP_DONE;
 
-        ret = verify_certificate(session);
-        if ( ret < 0 ) {
-                gnutls_deinit(session);
                 return ret;
+
+        case TLS_AUTH_STEP_DONE:
+        default:
+                return 0;
         }
+}
 
-        prelude_io_set_tls_io(io, session);
 
-        ret = read_auth_result(io);
-        if ( ret < 0 )
-                return ret;
 
-        ret = tls_certificate_get_peer_analyzerid(session, analyzerid);
-        if ( ret < 0 )
-                return ret;
+prelude_connection_feature_t tls_auth_connection_get_peer_features(tls_auth_state_t *state)
+{
+        return state->peer_features;
+}
+
+
 
-        ret = tls_certificate_get_permission(session, permission);
+prelude_bool_t tls_auth_connection_want_write(tls_auth_state_t *state)
+{
+        if ( state->step == TLS_AUTH_STEP_DONE )
+                return FALSE;
+
+        return (gnutls_record_get_direction(state->session) == 1) ? TRUE : FALSE;
+}
+
+
+
+/*
+ * Release the authentication state. If the authentication did not
+ * complete, the session is released and the prelude_io_t object is
+ * switched back to system IO, so that closing it won't attempt a
+ * TLS shutdown with a peer we did not authenticate.
+ */
+void tls_auth_connection_destroy(tls_auth_state_t *state)
+{
+        if ( state->step == TLS_AUTH_STEP_HANDSHAKE )
+                gnutls_deinit(state->session);
+
+        else if ( state->step != TLS_AUTH_STEP_DONE ) {
+                gnutls_deinit(state->session);
+                prelude_io_set_sys_io(state->io, state->fd);
+        }
+
+        if ( state->msg )
+                prelude_msg_destroy(state->msg);
+
+        free(state);
+}
+
+
+
+int tls_auth_connection(prelude_client_profile_t *cp, prelude_io_t *io, int crypt,
+                        uint64_t *analyzerid, prelude_connection_permission_t *permission)
+{
+        int ret;
+        struct pollfd pfd;
+        tls_auth_state_t *state;
+
+        ret = tls_auth_connection_start(cp, io, crypt, 0, &state);
         if ( ret < 0 )
                 return ret;
 
-        if ( ! crypt ) {
+        pfd.fd = prelude_io_get_fd(io);
 
-                do {
-                        ret = gnutls_bye(session, GNUTLS_SHUT_RDWR);
-                } while ( ret < 0 && handle_gnutls_error(session, ret) == 0 );
+        while ( (ret = tls_auth_connection_resume(state, analyzerid, permission)) < 0 ) {
+                if ( prelude_error_get_code(ret) != PRELUDE_ERROR_EAGAIN )
+                        break;
 
-                if ( ret < 0 )
-                        ret = prelude_error_verbose(PRELUDE_ERROR_TLS, "TLS bye failed: %s", gnutls_strerror(ret));
+                pfd.events = tls_auth_connection_want_write(state) ? POLLOUT : POLLIN;
 
-                gnutls_deinit(session);
-                prelude_io_set_sys_io(io, fd);
+                ret = poll(&pfd, 1, -1);
+                if ( ret < 0 && errno != EINTR ) {
+                        ret = prelude_error_from_errno(errno);
+                        break;
+                }
         }
 
+        tls_auth_connection_destroy(state);
+
         return ret;
 }
 
@@ -411,8 +775,116 @@ int tls_auth_init(prelude_client_profile_t *cp, gnutls_certificate_credentials_t
 }
 
 
+/*
+ * Credentials are looked up by the files they are loaded from.
+ */
+int tls_auth_get_credentials(prelude_client_profile_t *cp, gnutls_certificate_credentials_t *cred)
+{
+        int ret;
+        prelude_list_t *tmp;
+        tls_credentials_t *entry;
+        char keyfile[PATH_MAX], certfile[PATH_MAX], trustfile[PATH_MAX], id[3 * PATH_MAX];
+
+        prelude_client_profile_get_tls_key_filename(cp, keyfile, sizeof(keyfile));
+        prelude_client_profile_get_tls_client_keycert_filename(cp, certfile, sizeof(certfile));
+        prelude_client_profile_get_tls_client_trusted_cert_filename(cp, trustfile, sizeof(trustfile));
+        snprintf(id, sizeof(id), "%s:%s:%s", keyfile, certfile, trustfile);
+
+        gl_lock_lock(cache_mutex);
+
+        prelude_list_for_each(&credentials_list, tmp) {
+                entry = prelude_list_entry(tmp, tls_credentials_t, list);
+
+                if ( strcmp(entry->id, id) == 0 ) {
+                        entry->refcount++;
+                        *cred = entry->cred;
+                        gl_lock_unlock(cache_mutex);
+                        return 0;
+                }
+        }
+
+        entry = malloc(sizeof(*entry));
+        if ( ! entry ) {
+                gl_lock_unlock(cache_mutex);
+                return prelude_error_from_errno(errno);
+        }
+
+        entry->id = strdup(id);
+        if ( ! entry->id ) {
+                free(entry);
+                gl_lock_unlock(cache_mutex);
+                return prelude_error_from_errno(errno);
+        }
+
+        ret = tls_auth_init(cp, &entry->cred);
+        if ( ret < 0 ) {
+                free(entry->id);
+                free(entry);
+                gl_lock_unlock(cache_mutex);
+                return ret;
+        }
+
+        entry->refcount = 1;
+        prelude_list_add_tail(&credentials_list, &entry->list);
+
+        *cred = entry->cred;
+        gl_lock_unlock(cache_mutex);
+
+        return 0;
+}
+
+
+
+void tls_auth_release_credentials(gnutls_certificate_credentials_t cred)
+{
+        tls_session_t *session;
+        tls_credentials_t *entry = NULL;
+        prelude_list_t *tmp, *bkp;
+
+        gl_lock_lock(cache_mutex);
+
+        prelude_list_for_each(&credentials_list, tmp) {
+                entry = prelude_list_entry(tmp, tls_credentials_t, list);
+
+                if ( entry->cred == cred )
+                        break;
+
+                entry = NULL;
+        }
+
+        if ( ! entry || --entry->refcount ) {
+                gl_lock_unlock(cache_mutex);
+                return;
+        }
+
+        prelude_list_for_each_safe(&session_list, tmp, bkp) {
+                session = prelude_list_entry(tmp, tls_session_t, list);
+
+                if ( session->cred == cred )
+                        session_cache_del(session);
+        }
+
+        prelude_list_del(&entry->list);
+        gl_lock_unlock(cache_mutex);
+
+        gnutls_certificate_free_credentials(entry->cred);
+        free(entry->id);
+        free(entry);
+}
+
+
+
 void tls_auth_deinit(void)
 {
+        prelude_list_t *tmp, *bkp;
+
+        gl_lock_lock(cache_mutex);
+
+        prelude_list_for_each_safe(&session_list, tmp, bkp)
+                session_cache_del(prelude_list_entry(tmp, tls_session_t, list));
+
+        gl_lock_unlock(cache_mutex);
+
 #ifdef HAVE_GNUTLS_STRING_PRIORITY
         if ( priority_set ) {
                 gnutls_priority_deinit(tls_priority);
@@ -0,0 +1,470 @@
+#include "config.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include "prelude.h"
+
+#include "glthread/lock.h"
+#include "glthread/cond.h"
+
+#define QUEUE_COUNT 4
+#define JOB_COUNT 200
+#define QUEUE_LIMIT 10
+
+
+struct asyncobj {
+        PRELUDE_ASYNC_OBJECT;
+        unsigned int queue;
+        unsigned int seq;
+};
+
+
+static unsigned int next_seq[QUEUE_COUNT];
+static unsigned int overflowed;
+static unsigned int processed[QUEUE_COUNT];
+static unsigned int order[JOB_COUNT], order_count;
+static unsigned int done;
+static prelude_bool_t stalled;
+static gl_lock_t lock = gl_lock_initializer;
+static gl_lock_t stall = gl_lock_initializer;
+static gl_cond_t cond = gl_cond_initializer;
+
+
+static void async_func(void *obj, void *data)
+{
+        struct asyncobj *ptr = obj;
+
+        /*
+         * Stall the first queue: the others must still make progress.
+         */
+        if ( ptr->queue == 0 && ptr->seq == 0 ) {
+                gl_lock_lock(lock);
+                stalled = TRUE;
+                gl_cond_broadcast(cond);
+                gl_lock_unlock(lock);
+
+                gl_lock_lock(stall);
+                gl_lock_unlock(stall);
+        }
+
+        gl_lock_lock(lock);
+        assert(next_seq[ptr->queue] <= ptr->seq);
+        next_seq[ptr->queue] = ptr->seq + 1;
+        processed[ptr->queue]++;
+
+        if ( ptr->seq && order_count < JOB_COUNT )
+                order[order_count++] = ptr->queue;
+
+        done++;
+        gl_cond_broadcast(cond);
+        gl_lock_unlock(lock);
+
+        free(ptr);
+}
+
+
+static void overflow_func(void *obj, void *data)
+{
+        gl_lock_lock(lock);
+        overflowed++;
+        done++;
+        gl_cond_broadcast(cond);
+        gl_lock_unlock(lock);
+
+        free(obj);
+}
+
+
+static void add_job_priority(prelude_async_queue_t *queue, unsigned int qid, unsigned int seq, unsigned int priority)
+{
+        struct asyncobj *obj;
+
+        obj = malloc(sizeof(*obj));
+        assert(obj);
+
+        obj->queue = qid;
+        obj->seq = seq;
+        prelude_async_set_callback((prelude_async_object_t *) obj, async_func);
+        prelude_async_queue_add_priority(queue, (prelude_async_object_t *) obj, priority);
+}
+
+
+static void add_job(prelude_async_queue_t *queue, unsigned int qid, unsigned int seq)
+{
+        add_job_priority(queue, qid, seq, 0);
+}
+
+
+static void reset_seq(void)
+{
+        unsigned int i;
+
+        gl_lock_lock(lock);
+
+        for ( i = 0; i < QUEUE_COUNT; i++ )
+                next_seq[i] = processed[i] = 0;
+
+        order_count = JOB_COUNT;
+        done = 0;
+
+        gl_lock_unlock(lock);
+}
+
+
+static void wait_stalled(void)
+{
+        gl_lock_lock(lock);
+
+        while ( ! stalled )
+                gl_cond_wait(cond, lock);
+
+        stalled = FALSE;
+        gl_lock_unlock(lock);
+}
+
+
+/*
+ * Wait for @count objects to be either processed or overflowed, then
+ * for @queue to account for them.
+ */
+static void wait_done(prelude_async_queue_t *queue, unsigned int count)
+{
+        prelude_async_stats_t stats;
+
+        gl_lock_lock(lock);
+
+        while ( done < count )
+                gl_cond_wait(cond, lock);
+
+        gl_lock_unlock(lock);
+
+        do {
+                prelude_async_queue_get_stats(queue, &stats);
+        } while ( stats.queued );
+}
+
+
+static void test_ordering(void)
+{
+        unsigned int i, j;
+        prelude_async_stats_t stats;
+        prelude_async_queue_t *queue[QUEUE_COUNT];
+
+        reset_seq();
+
+        for ( i = 0; i < QUEUE_COUNT; i++ )
+                assert(prelude_async_queue_new(&queue[i]) == 0);
+
+        gl_lock_lock(stall);
+
+        for ( j = 0; j < JOB_COUNT; j++ ) {
+                for ( i = 0; i < QUEUE_COUNT; i++ )
+                        add_job(queue[i], i, j);
+        }
+
+        /*
+         * The other queues complete while the first one is stalled.
+         */
+        wait_done(queue[1], (QUEUE_COUNT - 1) * JOB_COUNT);
+
+        gl_lock_lock(lock);
+        assert(processed[0] == 0);
+        for ( i = 1; i < QUEUE_COUNT; i++ )
+                assert(next_seq[i] == JOB_COUNT);
+        gl_lock_unlock(lock);
+
+        wait_stalled();
+        gl_lock_unlock(stall);
+
+        wait_done(queue[0], QUEUE_COUNT * JOB_COUNT);
+
+        for ( i = 0; i < QUEUE_COUNT; i++ ) {
+                prelude_async_queue_get_stats(queue[i], &stats);
+
+                assert(stats.processed == JOB_COUNT);
+                assert(stats.max_queued > 0 && stats.max_queued <= JOB_COUNT);
+
+                prelude_async_queue_destroy(queue[i]);
+        }
+}
+
+
+static void test_overflow(void)
+{
+        unsigned int i;
+        prelude_async_stats_t stats;
+        prelude_async_queue_t *queue;
+
+        reset_seq();
+
+        prelude_async_set_queue_limit(QUEUE_LIMIT);
+        prelude_async_set_overflow_policy(PRELUDE_ASYNC_OVERFLOW_POLICY_DROP_OLDEST);
+
+        assert(prelude_async_queue_new(&queue) == 0);
+        prelude_async_queue_set_overflow_callback(queue, overflow_func);
+
+        gl_lock_lock(stall);
+
+        add_job(queue, 0, 0);
+        wait_stalled();
+
+        for ( i = 1; i < JOB_COUNT; i++ )
+                add_job(queue, 0, i);
+
+        gl_lock_unlock(stall);
+        wait_done(queue, JOB_COUNT);
+
+        prelude_async_queue_get_stats(queue, &stats);
+
+        /*
+         * Room is made as objects are added: the stalled object counts
+         * in the limit, along with the most recent ones.
+         */
+        assert(stats.overflowed == overflowed);
+        assert(stats.processed == QUEUE_LIMIT);
+        assert(stats.processed + stats.overflowed == JOB_COUNT);
+        assert(next_seq[0] == JOB_COUNT);
+
+        /*
+         * With the blocking policy, producers wait for room in the queue.
+         */
+        prelude_async_set_overflow_policy(PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK);
+
+        reset_seq();
+        for ( i = 0; i < JOB_COUNT; i++ )
+                add_job(queue, 1, i);
+
+        wait_done(queue, JOB_COUNT);
+        prelude_async_queue_get_stats(queue, &stats);
+
+        assert(stats.max_queued <= JOB_COUNT);
+        assert(stats.overflowed == overflowed);
+        assert(next_seq[1] == JOB_COUNT);
+
+        prelude_async_set_queue_limit(0);
+        prelude_async_queue_destroy(queue);
+}
+
+
+static void reentrant_func(void *obj, void *data)
+{
+        unsigned int i;
+
+        /*
+         * Workers adding to their own full queue do not wait for room.
+         */
+        for ( i = 1; i <= 2 * QUEUE_LIMIT; i++ )
+                add_job(data, 2, i);
+
+        free(obj);
+}
+
+
+static void test_block_reentrant(void)
+{
+        prelude_async_object_t *obj;
+        prelude_async_queue_t *queue;
+
+        reset_seq();
+
+        prelude_async_set_queue_limit(QUEUE_LIMIT);
+        prelude_async_set_overflow_policy(PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK);
+
+        assert(prelude_async_queue_new(&queue) == 0);
+
+        obj = malloc(sizeof(struct asyncobj));
+        assert(obj);
+
+        prelude_async_set_data(obj, queue);
+        prelude_async_set_callback(obj, reentrant_func);
+        prelude_async_queue_add(queue, obj);
+
+        wait_done(queue, 2 * QUEUE_LIMIT);
+        assert(next_seq[2] == 2 * QUEUE_LIMIT + 1);
+
+        prelude_async_set_queue_limit(0);
+        prelude_async_queue_destroy(queue);
+}
+
+
+/*
+ * Stall @queue, then fill it with @count objects of each priority, the
+ * priority being used as the object queue identifier.
+ */
+static void fill_priorities(prelude_async_queue_t *queue, unsigned int count)
+{
+        unsigned int i, j;
+
+        reset_seq();
+        gl_lock_lock(stall);
+
+        add_job(queue, 0, 0);
+        wait_stalled();
+
+        for ( i = 1; i <= count; i++ ) {
+                for ( j = 0; j < QUEUE_COUNT; j++ )
+                        add_job_priority(queue, j, i, j);
+        }
+
+        gl_lock_lock(lock);
+        order_count = 0;
+        gl_lock_unlock(lock);
+
+        gl_lock_unlock(stall);
+}
+
+
+static void test_priority(void)
+{
+        unsigned int i, count[QUEUE_COUNT];
+        prelude_async_stats_t stats;
+        prelude_async_queue_t *queue;
+
+        assert(QUEUE_COUNT == PRELUDE_ASYNC_PRIORITY_COUNT);
+        assert(prelude_async_queue_new(&queue) == 0);
+
+        /*
+         * With strict scheduling, higher priorities go first.
+         */
+        fill_priorities(queue, JOB_COUNT / QUEUE_COUNT);
+        wait_done(queue, JOB_COUNT + 1);
+
+        assert(order_count == JOB_COUNT);
+        for ( i = 1; i < JOB_COUNT; i++ )
+                assert(order[i] <= order[i - 1]);
+
+        /*
+         * With weighted scheduling, each priority gets twice the share
+         * of the one below.
+         */
+        prelude_async_set_scheduling(PRELUDE_ASYNC_SCHEDULING_WEIGHTED);
+        assert(prelude_async_get_scheduling() == PRELUDE_ASYNC_SCHEDULING_WEIGHTED);
+
+        fill_priorities(queue, JOB_COUNT / QUEUE_COUNT);
+        wait_done(queue, JOB_COUNT + 1);
+
+        for ( i = 0; i < QUEUE_COUNT; i++ )
+                count[i] = 0;
+
+        for ( i = 0; i < (1 << QUEUE_COUNT) - 1; i++ )
+                count[order[i]]++;
+
+        for ( i = 0; i < QUEUE_COUNT; i++ ) {
+                assert(count[i] == 1U << i);
+                assert(next_seq[i] == JOB_COUNT / QUEUE_COUNT + 1);
+        }
+
+        prelude_async_set_scheduling(PRELUDE_ASYNC_SCHEDULING_STRICT);
+
+        /*
+         * The lowest priority is shed first.
+         */
+        prelude_async_set_queue_limit(QUEUE_LIMIT);
+        prelude_async_set_overflow_policy(PRELUDE_ASYNC_OVERFLOW_POLICY_DROP_OLDEST);
+        prelude_async_queue_set_overflow_callback(queue, overflow_func);
+
+        fill_priorities(queue, QUEUE_LIMIT);
+        wait_done(queue, QUEUE_COUNT * QUEUE_LIMIT + 1);
+
+        prelude_async_queue_get_stats(queue, &stats);
+        assert(stats.overflowed == (QUEUE_COUNT - 1) * QUEUE_LIMIT + 1);
+        assert(processed[QUEUE_COUNT - 1] == QUEUE_LIMIT - 1);
+
+        for ( i = 0; i < QUEUE_COUNT - 1; i++ )
+                assert(processed[i] == ((i == 0) ? 1 : 0));
+
+        /*
+         * A full queue never gives up higher priority objects for a
+         * lower priority one: the new object is shed instead.
+         */
+        reset_seq();
+        gl_lock_lock(stall);
+
+        add_job(queue, 0, 0);
+        wait_stalled();
+
+        for ( i = 1; i < QUEUE_LIMIT; i++ )
+                add_job_priority(queue, QUEUE_COUNT - 1, i, QUEUE_COUNT - 1);
+
+        add_job_priority(queue, 1, 1, 1);
+
+        gl_lock_unlock(stall);
+        wait_done(queue, QUEUE_LIMIT + 1);
+
+        prelude_async_queue_get_stats(queue, &stats);
+        assert(stats.overflowed == (QUEUE_COUNT - 1) * QUEUE_LIMIT + 2);
+        assert(processed[QUEUE_COUNT - 1] == QUEUE_LIMIT - 1);
+        assert(processed[1] == 0);
+
+        prelude_async_set_overflow_policy(PRELUDE_ASYNC_OVERFLOW_POLICY_BLOCK);
+        prelude_async_set_queue_limit(0);
+        prelude_async_queue_destroy(queue);
+}
+
+
+static void test_del(void)
+{
+        struct asyncobj *obj;
+        prelude_async_queue_t *queue;
+
+        reset_seq();
+        assert(prelude_async_queue_new(&queue) == 0);
+
+        gl_lock_lock(stall);
+
+        add_job(queue, 0, 0);
+        wait_stalled();
+
+        /*
+         * A removed object is never processed, and can be released
+         * right away.
+         */
+        obj = malloc(sizeof(*obj));
+        assert(obj);
+
+        obj->queue = 1;
+        obj->seq = 0;
+        prelude_async_set_callback((prelude_async_object_t *) obj, async_func);
+        prelude_async_queue_add(queue, (prelude_async_object_t *) obj);
+
+        prelude_async_del((prelude_async_object_t *) obj);
+        free(obj);
+
+        add_job(queue, 1, 1);
+
+        gl_lock_unlock(stall);
+        wait_done(queue, 2);
+
+        assert(processed[1] == 1);
+        assert(next_seq[1] == 2);
+
+        prelude_async_queue_destroy(queue);
+}
+
+
+int main(void)
+{
+        prelude_async_stats_t stats;
+
+        assert(prelude_init(NULL, NULL) == 0);
+
+        prelude_async_set_worker_count(QUEUE_COUNT);
+        assert(prelude_async_get_worker_count() == QUEUE_COUNT);
+        assert(prelude_async_init() == 0);
+
+        test_ordering();
+        test_overflow();
+        test_block_reentrant();
+        test_priority();
+        test_del();
+
+        prelude_async_exit();
+
+        prelude_async_get_stats(&stats);
+        assert(stats.queued == 0);
+        assert(stats.processed >= QUEUE_COUNT * JOB_COUNT);
+        assert(stats.latency_max >= stats.latency_total / stats.processed);
+
+        prelude_deinit();
+        exit(0);
+}
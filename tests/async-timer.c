@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/time.h>
 #include "prelude.h"
 
 #include "glthread/lock.h"
@@ -28,6 +29,24 @@ static void timer_cb(void *data)
 }
 
 
+static uint64_t get_msec(void)
+{
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+
+        return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+
+static void ms_timer_cb(void *data)
+{
+        gl_lock_lock(lock);
+        *(uint64_t *) data = get_msec();
+        gl_lock_unlock(lock);
+}
+
+
 static void async_func(void *obj, void *data)
 {
         struct asyncobj *ptr = obj;
@@ -41,7 +60,8 @@ static void async_func(void *obj, void *data)
 
 int main(void)
 {
-        prelude_timer_t timer;
+        uint64_t start, expired = 0;
+        prelude_timer_t timer, ms_timer;
         struct asyncobj myobj;
 
         assert(prelude_init(NULL, NULL) == 0);
@@ -59,6 +79,23 @@ int main(void)
         assert(timer_count >= 2);
         gl_lock_unlock(lock);
 
+        /*
+         * Millisecond timers are handled as they expire, not on the
+         * next one second tick.
+         */
+        prelude_timer_set_expire_ms(&ms_timer, 50);
+        prelude_timer_set_data(&ms_timer, &expired);
+        prelude_timer_set_callback(&ms_timer, ms_timer_cb);
+
+        start = get_msec();
+        prelude_timer_init(&ms_timer);
+
+        usleep(500000);
+
+        gl_lock_lock(lock);
+        assert(expired >= start + 50 && expired < start + 500);
+        gl_lock_unlock(lock);
+
         myobj.myval = 10;
         prelude_async_set_callback((prelude_async_object_t *) &myobj, async_func);
         prelude_async_add((prelude_async_object_t *) &myobj);
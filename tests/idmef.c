@@ -1,13 +1,439 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <sys/socket.h>
 #include "prelude.h"
+#include "prelude-message-id.h"
+#include "idmef-message-id.h"
+#include "glthread/thread.h"
 
 #define TEST_STR "abcdefghijklmnopqrstuvwxyz"
+#define TEST_LARGE_SIZE 20000
 #define MAX_LAG_SEC 3
 
 
+int _prelude_msg_downgrade(prelude_msg_t *msg, prelude_msg_t **out);
+
+
+static int send_msg(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg)
+{
+        return prelude_msg_write(msg, prelude_msgbuf_get_data(msgbuf));
+}
+
+
+static int send_downgraded_msg(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg)
+{
+        int ret;
+        prelude_msg_t *v1;
+
+        ret = _prelude_msg_downgrade(msg, &v1);
+        if ( ret < 0 )
+                return ret;
+
+        ret = prelude_msg_write(v1, prelude_msgbuf_get_data(msgbuf));
+        prelude_msg_destroy(v1);
+
+        return ret;
+}
+
+
+static void test_read_borrowed(void)
+{
+        int fds[2], ret;
+        char *res;
+        prelude_io_t *in, *out;
+        prelude_msg_t *msg = NULL;
+        prelude_msgbuf_t *msgbuf;
+        idmef_message_t *idmef, *copy;
+        idmef_classification_t *classification;
+
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(prelude_io_new(&out) == 0);
+        assert(prelude_io_new(&in) == 0);
+        prelude_io_set_sys_io(out, fds[0]);
+        prelude_io_set_sys_io(in, fds[1]);
+
+        assert(idmef_message_new(&idmef) == 0);
+        assert(idmef_message_set_string(idmef, "alert.classification.text", TEST_STR) == 0);
+
+        assert(prelude_msgbuf_new(&msgbuf) == 0);
+        prelude_msgbuf_set_data(msgbuf, out);
+        prelude_msgbuf_set_callback(msgbuf, send_msg);
+
+        assert(idmef_message_write(idmef, msgbuf) == 0);
+        prelude_msgbuf_mark_end(msgbuf);
+
+        do {
+                ret = prelude_msg_read(&msg, in);
+        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+        assert(ret == 0);
+
+        assert(idmef_message_read_borrowed(&copy, msg) == 0);
+        assert(idmef_message_get_string(copy, "alert.classification.text", &res) > 0);
+        assert(strcmp(res, TEST_STR) == 0);
+        free(res);
+
+        /*
+         * Objects referenced on their own must outlive the message.
+         */
+        classification = idmef_classification_ref(idmef_alert_get_classification(idmef_message_get_alert(copy)));
+        idmef_message_destroy(copy);
+
+        assert(strcmp(prelude_string_get_string(idmef_classification_get_text(classification)), TEST_STR) == 0);
+        idmef_classification_destroy(classification);
+
+        idmef_message_destroy(idmef);
+        prelude_msgbuf_destroy(msgbuf);
+        prelude_io_close(out);
+        prelude_io_close(in);
+        prelude_io_destroy(out);
+        prelude_io_destroy(in);
+}
+
+
+static idmef_message_t *lazy_shared, *eager_shared;
+
+
+static void *compare_lazy(void *arg)
+{
+        return (void *) (long) idmef_message_compare(eager_shared, lazy_shared);
+}
+
+
+
+static void test_read_lazy(void)
+{
+        int fds[2], ret, i;
+        char *res;
+        void *retval;
+        prelude_io_t *in, *out;
+        prelude_msg_t *msg[3];
+        prelude_msgbuf_t *msgbuf;
+        gl_thread_t thread[4];
+        idmef_message_t *idmef, *eager, *lazy;
+
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(prelude_io_new(&out) == 0);
+        assert(prelude_io_new(&in) == 0);
+        prelude_io_set_sys_io(out, fds[0]);
+        prelude_io_set_sys_io(in, fds[1]);
+
+        assert(idmef_message_new(&idmef) == 0);
+        assert(idmef_message_set_string(idmef, "alert.classification.text", TEST_STR) == 0);
+        assert(idmef_message_set_string(idmef, "alert.source(0).node.name", TEST_STR) == 0);
+        assert(idmef_message_set_string(idmef, "alert.source(1).node.name", TEST_STR) == 0);
+        assert(idmef_message_set_string(idmef, "alert.additional_data(0).data", TEST_STR) == 0);
+
+        assert(prelude_msgbuf_new(&msgbuf) == 0);
+        prelude_msgbuf_set_data(msgbuf, out);
+        prelude_msgbuf_set_callback(msgbuf, send_msg);
+
+        for ( i = 0; i < 3; i++ ) {
+                assert(idmef_message_write(idmef, msgbuf) == 0);
+                prelude_msgbuf_mark_end(msgbuf);
+
+                msg[i] = NULL;
+                do {
+                        ret = prelude_msg_read(&msg[i], in);
+                } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+                assert(ret == 0);
+        }
+
+        assert(idmef_message_read_lazy(&lazy, msg[0]) == 0);
+        assert(idmef_message_get_string(lazy, "alert.source(1).node.name", &res) > 0);
+        assert(strcmp(res, TEST_STR) == 0);
+        free(res);
+
+        assert(idmef_message_get_string(lazy, "alert.additional_data(0).data", &res) > 0);
+        assert(strcmp(res, TEST_STR) == 0);
+        free(res);
+
+        /*
+         * Fields that were not accessed yet are decoded by the comparison.
+         */
+        assert(idmef_message_read_borrowed(&eager, msg[1]) == 0);
+        assert(idmef_message_compare(eager, lazy) == 0);
+
+        /*
+         * Threads sharing a lazily read message decode it in turn.
+         */
+        eager_shared = eager;
+        assert(idmef_message_read_lazy(&lazy_shared, msg[2]) == 0);
+
+        for ( i = 0; i < 4; i++ )
+                thread[i] = gl_thread_create(compare_lazy, NULL);
+
+        for ( i = 0; i < 4; i++ ) {
+                gl_thread_join(thread[i], &retval);
+                assert(retval == NULL);
+        }
+
+        idmef_message_destroy(lazy_shared);
+        idmef_message_destroy(eager);
+        idmef_message_destroy(lazy);
+        idmef_message_destroy(idmef);
+        prelude_msgbuf_destroy(msgbuf);
+        prelude_io_close(out);
+        prelude_io_close(in);
+        prelude_io_destroy(out);
+        prelude_io_destroy(in);
+}
+
+
+static prelude_msg_t *new_alert_msg(prelude_io_t *out, prelude_io_t *in, uint8_t tag, size_t len, unsigned int end)
+{
+        int ret;
+        unsigned int i;
+        prelude_msg_t *msg, *copy = NULL;
+
+        assert(prelude_msg_new(&msg, 2 + end, len, PRELUDE_MSG_IDMEF, 0) == 0);
+        assert(prelude_msg_set(msg, IDMEF_MSG_ALERT_TAG, 0, NULL) == 0);
+        assert(prelude_msg_set(msg, tag, len, TEST_STR) == 0);
+
+        for ( i = 0; i < end; i++ )
+                assert(prelude_msg_set(msg, IDMEF_MSG_END_OF_TAG, 0, NULL) == 0);
+
+        assert(prelude_msg_write(msg, out) == 0);
+        prelude_msg_destroy(msg);
+
+        do {
+                ret = prelude_msg_read(&copy, in);
+        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+        assert(ret == 0);
+
+        return copy;
+}
+
+
+static void test_read_lazy_error(void)
+{
+        int fds[2];
+        char *res;
+        prelude_msg_t *msg;
+        prelude_io_t *in, *out;
+        idmef_message_t *lazy;
+
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(prelude_io_new(&out) == 0);
+        assert(prelude_io_new(&in) == 0);
+        prelude_io_set_sys_io(out, fds[0]);
+        prelude_io_set_sys_io(in, fds[1]);
+
+        /*
+         * A truncated alert is refused when it is indexed.
+         */
+        msg = new_alert_msg(out, in, IDMEF_MSG_ALERT_MESSAGEID, sizeof(TEST_STR), 0);
+        assert(idmef_message_read_lazy(&lazy, msg) < 0);
+        prelude_msg_destroy(msg);
+
+        /*
+         * A malformed child (a time of the wrong size) only fails once
+         * decoded, and then for any field of the alert.
+         */
+        msg = new_alert_msg(out, in, IDMEF_MSG_ALERT_CREATE_TIME, sizeof(TEST_STR), 2);
+        assert(idmef_message_read_lazy(&lazy, msg) == 0);
+        assert(idmef_message_get_string(lazy, "alert.create_time", &res) < 0);
+        assert(idmef_message_get_string(lazy, "alert.create_time", &res) < 0);
+        assert(idmef_message_get_string(lazy, "alert.messageid", &res) < 0);
+
+        idmef_message_destroy(lazy);
+
+        prelude_io_close(out);
+        prelude_io_close(in);
+        prelude_io_destroy(out);
+        prelude_io_destroy(in);
+}
+
+
+static void test_read_paths(void)
+{
+        int fds[2], ret, i;
+        prelude_io_t *in, *out;
+        prelude_msg_t *msg = NULL;
+        prelude_msgbuf_t *msgbuf;
+        idmef_message_t *idmef;
+        idmef_path_t *path[4];
+        idmef_value_t *value[4];
+        const char *name[] = {
+                "alert.classification.text", "alert.source(1).node.name",
+                "alert.target(0).node.name", "alert.source.node.name"
+        };
+
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(prelude_io_new(&out) == 0);
+        assert(prelude_io_new(&in) == 0);
+        prelude_io_set_sys_io(out, fds[0]);
+        prelude_io_set_sys_io(in, fds[1]);
+
+        assert(idmef_message_new(&idmef) == 0);
+        assert(idmef_message_set_string(idmef, "alert.classification.text", TEST_STR) == 0);
+        assert(idmef_message_set_string(idmef, "alert.source(0).node.name", "source0") == 0);
+        assert(idmef_message_set_string(idmef, "alert.source(1).node.name", TEST_STR) == 0);
+        assert(idmef_message_set_string(idmef, "alert.source(1).node.location", "location") == 0);
+        assert(idmef_message_set_string(idmef, "alert.additional_data(0).data", TEST_STR) == 0);
+
+        assert(prelude_msgbuf_new(&msgbuf) == 0);
+        prelude_msgbuf_set_data(msgbuf, out);
+        prelude_msgbuf_set_callback(msgbuf, send_msg);
+
+        assert(idmef_message_write(idmef, msgbuf) == 0);
+        prelude_msgbuf_mark_end(msgbuf);
+
+        do {
+                ret = prelude_msg_read(&msg, in);
+        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+        assert(ret == 0);
+
+        for ( i = 0; i < 4; i++ )
+                assert(idmef_path_new_fast(&path[i], name[i]) == 0);
+
+        assert(idmef_message_read_paths(msg, path, 4, value) == 3);
+        assert(strcmp(prelude_string_get_string(idmef_value_get_string(value[0])), TEST_STR) == 0);
+        assert(strcmp(prelude_string_get_string(idmef_value_get_string(value[1])), TEST_STR) == 0);
+        assert(value[2] == NULL);
+        assert(idmef_value_get_count(value[3]) == 2);
+
+        for ( i = 0; i < 4; i++ ) {
+                if ( value[i] )
+                        idmef_value_destroy(value[i]);
+
+                idmef_path_destroy(path[i]);
+        }
+
+        prelude_msg_destroy(msg);
+        idmef_message_destroy(idmef);
+        prelude_msgbuf_destroy(msgbuf);
+        prelude_io_close(out);
+        prelude_io_close(in);
+        prelude_io_destroy(out);
+        prelude_io_destroy(in);
+}
+
+
+static void test_compact(void)
+{
+        int fds[2], ret, i;
+        char *large;
+        uint32_t hlen[2];
+        prelude_io_t *in, *out;
+        prelude_msg_t *msg[3];
+        prelude_msgbuf_t *msgbuf;
+        idmef_message_t *idmef, *copy;
+
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(prelude_io_new(&out) == 0);
+        assert(prelude_io_new(&in) == 0);
+        prelude_io_set_sys_io(out, fds[0]);
+        prelude_io_set_sys_io(in, fds[1]);
+
+        assert(idmef_message_new(&idmef) == 0);
+        assert(idmef_message_set_string(idmef, "alert.classification.text", TEST_STR) == 0);
+        assert(idmef_message_set_string(idmef, "alert.source(0).service.port", "80") == 0);
+        assert(idmef_message_set_string(idmef, "alert.source(0).service.iana_protocol_number", "6") == 0);
+        assert(idmef_message_set_string(idmef, "alert.target(0).process.pid", "4294967295") == 0);
+        assert(idmef_message_set_string(idmef, "alert.assessment.impact.severity", "high") == 0);
+        assert(idmef_message_set_string(idmef, "alert.additional_data(0).data", "-12345") == 0);
+        assert(idmef_message_set_string(idmef, "alert.additional_data(0).type", "integer") == 0);
+
+        /*
+         * Large enough for the message to be written as several fragments.
+         */
+        large = malloc(TEST_LARGE_SIZE);
+        assert(large);
+        memset(large, 'a', TEST_LARGE_SIZE - 1);
+        large[TEST_LARGE_SIZE - 1] = 0;
+        assert(idmef_message_set_string(idmef, "alert.additional_data(1).data", large) == 0);
+        free(large);
+
+        assert(prelude_msgbuf_new(&msgbuf) == 0);
+        prelude_msgbuf_set_data(msgbuf, out);
+        prelude_msgbuf_set_callback(msgbuf, send_msg);
+
+        /*
+         * Write the message with the default encoding, then the compact
+         * one, then the compact one turned back into the default one.
+         */
+        for ( i = 0; i < 3; i++ ) {
+                if ( i == 1 )
+                        prelude_msgbuf_set_flags(msgbuf, PRELUDE_MSGBUF_FLAGS_COMPACT);
+
+                if ( i == 2 )
+                        prelude_msgbuf_set_callback(msgbuf, send_downgraded_msg);
+
+                assert(idmef_message_write(idmef, msgbuf) == 0);
+                prelude_msgbuf_mark_end(msgbuf);
+
+                msg[i] = NULL;
+                do {
+                        ret = prelude_msg_read(&msg[i], in);
+                } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+                assert(ret == 0);
+        }
+
+        assert(prelude_msg_get_version(msg[0]) == PRELUDE_MSG_VERSION_1);
+        assert(prelude_msg_get_version(msg[1]) == PRELUDE_MSG_VERSION_2);
+        assert(prelude_msg_get_len(msg[1]) < prelude_msg_get_len(msg[0]));
+
+        assert(prelude_msg_get_version(msg[2]) == PRELUDE_MSG_VERSION_1);
+        assert(prelude_msg_get_datalen(msg[2]) == prelude_msg_get_datalen(msg[0]));
+
+        for ( i = 0; i < 2; i++ )
+                hlen[i] = prelude_msg_get_len(msg[i * 2]) - prelude_msg_get_datalen(msg[i * 2]);
+
+        assert(memcmp(prelude_msg_get_message_data(msg[0]) + hlen[0],
+                      prelude_msg_get_message_data(msg[2]) + hlen[1], prelude_msg_get_datalen(msg[0])) == 0);
+
+        for ( i = 0; i < 3; i++ ) {
+                assert(idmef_message_new(&copy) == 0);
+                assert(idmef_message_read(copy, msg[i]) == 0);
+                assert(idmef_message_compare(idmef, copy) == 0);
+                idmef_message_destroy(copy);
+                prelude_msg_destroy(msg[i]);
+        }
+
+        idmef_message_destroy(idmef);
+        prelude_msgbuf_destroy(msgbuf);
+        prelude_io_close(out);
+        prelude_io_close(in);
+        prelude_io_destroy(out);
+        prelude_io_destroy(in);
+}
+
+
+static void test_new_with_arena(void)
+{
+        int i;
+        char *res;
+        idmef_alert_t *alert;
+        idmef_message_t *idmef;
+        idmef_source_t *source;
+        idmef_classification_t *classification;
+
+        /*
+         * Run twice so that the second message reuses the cached arena.
+         */
+        for ( i = 0; i < 2; i++ ) {
+                assert(idmef_message_new_with_arena(&idmef) == 0);
+                assert(idmef_message_new_alert(idmef, &alert) == 0);
+                assert(idmef_alert_new_source(alert, &source, IDMEF_LIST_APPEND) == 0);
+                assert(idmef_message_set_string(idmef, "alert.classification.text", TEST_STR) == 0);
+                assert(idmef_message_set_string(idmef, "alert.source(0).node.name", TEST_STR) == 0);
+
+                assert(idmef_message_get_string(idmef, "alert.source(0).node.name", &res) > 0);
+                assert(strcmp(res, TEST_STR) == 0);
+                free(res);
+
+                classification = idmef_classification_ref(idmef_alert_get_classification(alert));
+                idmef_message_destroy(idmef);
+
+                assert(strcmp(prelude_string_get_string(idmef_classification_get_text(classification)), TEST_STR) == 0);
+                idmef_classification_destroy(classification);
+        }
+}
+
+
 int main(void)
 {
         time_t now;
@@ -24,5 +450,12 @@ int main(void)
         now = time(NULL);
         assert(now - idmef_time_get_sec(ctime) < MAX_LAG_SEC);
 
+        test_read_borrowed();
+        test_read_lazy();
+        test_read_lazy_error();
+        test_read_paths();
+        test_compact();
+        test_new_with_arena();
+
         exit(0);
 }
@@ -0,0 +1,744 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <assert.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "prelude.h"
+
+#define TEST_COUNT 3
+#define TEST_TAG 42
+#define TEST_STR "abcdefghijklmnopqrstuvwxyz"
+#define TEST_BACKLOG 4
+#define TEST_ASYNC_COUNT 32
+#define TEST_ASYNC_SIZE (64 * 1024)
+#define TEST_REPLAY_RATE 50
+
+
+int _prelude_client_profile_new(prelude_client_profile_t **ret);
+
+
+static prelude_msg_t *new_msg(uint8_t tag)
+{
+        prelude_msg_t *msg;
+
+        assert(prelude_msg_new(&msg, 1, sizeof(TEST_STR), tag, 0) == 0);
+        assert(prelude_msg_set(msg, TEST_TAG, sizeof(TEST_STR), TEST_STR) == 0);
+
+        return msg;
+}
+
+
+static void send_msg(prelude_io_t *io, uint8_t tag)
+{
+        prelude_msg_t *msg = new_msg(tag);
+
+        assert(prelude_msg_write(msg, io) == 0);
+        prelude_msg_destroy(msg);
+}
+
+
+static void establish_connection(prelude_connection_pool_t *pool, prelude_connection_t *cnx, prelude_io_t **peer)
+{
+        int fds[2];
+        prelude_io_t *io;
+
+        assert(! prelude_connection_is_alive(cnx));
+
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(prelude_io_new(&io) == 0);
+        assert(prelude_io_new(peer) == 0);
+        prelude_io_set_sys_io(io, fds[0]);
+        prelude_io_set_sys_io(*peer, fds[1]);
+
+        prelude_connection_set_fd_nodup(cnx, io);
+        prelude_connection_set_state(cnx, prelude_connection_get_state(cnx) | PRELUDE_CONNECTION_STATE_ESTABLISHED);
+        assert(prelude_connection_pool_set_connection_alive(pool, cnx) == 0);
+}
+
+
+/*
+ * The connection fails at first, and is then handed
+ * an already established socket.
+ */
+static void add_connection(prelude_connection_pool_t *pool, prelude_connection_t **cnx, prelude_io_t **peer)
+{
+        assert(prelude_connection_new(cnx, "unix:/nonexistent") == 0);
+        assert(prelude_connection_pool_add_connection(pool, *cnx) == 0);
+        assert(prelude_connection_pool_init(pool) == 0);
+
+        establish_connection(pool, *cnx, peer);
+}
+
+
+static void test_recv(prelude_client_profile_t *cp)
+{
+        int i;
+        prelude_io_t *peer;
+        prelude_msg_t *msg;
+        prelude_connection_t *cnx, *out;
+        prelude_connection_pool_t *pool;
+
+        assert(prelude_connection_pool_new(&pool, cp, 0) == 0);
+        prelude_connection_pool_set_flags(pool, 0);
+        add_connection(pool, &cnx, &peer);
+
+        assert(prelude_connection_pool_recv(pool, 0, &out, &msg) == 0);
+
+        /*
+         * Messages arriving together are all received, even though
+         * their arrival is notified once.
+         */
+        for ( i = 0; i < TEST_COUNT; i++ )
+                send_msg(peer, TEST_TAG + i);
+
+        for ( i = 0; i < TEST_COUNT; i++ ) {
+                assert(prelude_connection_pool_recv(pool, 1000, &out, &msg) == 1);
+                assert(out == cnx);
+                assert(prelude_msg_get_tag(msg) == TEST_TAG + i);
+                prelude_msg_destroy(msg);
+        }
+
+        assert(prelude_connection_pool_recv(pool, 0, &out, &msg) == 0);
+
+        /*
+         * Closing the peer kills the connection.
+         */
+        prelude_io_close(peer);
+        prelude_io_destroy(peer);
+
+        prelude_connection_pool_recv(pool, 1000, &out, &msg);
+        assert(! prelude_connection_is_alive(cnx));
+
+        prelude_connection_pool_destroy(pool);
+}
+
+
+static void broadcast_msg(prelude_connection_pool_t *pool, uint8_t tag)
+{
+        prelude_msg_t *msg = new_msg(tag);
+
+        prelude_connection_pool_broadcast(pool, msg);
+        prelude_msg_destroy(msg);
+}
+
+
+static void read_msgs(prelude_io_t *peer, unsigned int count)
+{
+        unsigned int i;
+        prelude_msg_t *msg;
+
+        for ( i = 0; i < count; i++ ) {
+                msg = NULL;
+                assert(prelude_msg_read(&msg, peer) == 0);
+                assert(prelude_msg_get_tag(msg) == TEST_TAG + i);
+                prelude_msg_destroy(msg);
+        }
+
+        assert(prelude_io_pending(peer) == 0);
+}
+
+
+static unsigned int count_msgs(prelude_io_t *peer)
+{
+        prelude_msg_t *msg;
+        unsigned int count = 0;
+
+        while ( prelude_io_pending(peer) > 0 ) {
+                msg = NULL;
+                assert(prelude_msg_read(&msg, peer) == 0);
+                prelude_msg_destroy(msg);
+                count++;
+        }
+
+        return count;
+}
+
+
+static void test_batch(prelude_client_profile_t *cp)
+{
+        int i;
+        size_t len;
+        prelude_msg_t *msg;
+        prelude_io_t *peer;
+        prelude_connection_t *cnx;
+        prelude_connection_pool_t *pool;
+
+        msg = new_msg(TEST_TAG);
+        len = prelude_msg_get_len(msg);
+        prelude_msg_destroy(msg);
+
+        assert(prelude_connection_pool_new(&pool, cp, 0) == 0);
+        prelude_connection_pool_set_flags(pool, PRELUDE_CONNECTION_POOL_FLAGS_BATCH);
+        prelude_connection_pool_set_batch_size(pool, TEST_COUNT * len);
+        prelude_connection_pool_set_batch_delay(pool, 10 * 1000 * 1000);
+        add_connection(pool, &cnx, &peer);
+
+        /*
+         * Messages are only written once the batch is full.
+         */
+        for ( i = 0; i < TEST_COUNT - 1; i++ )
+                broadcast_msg(pool, TEST_TAG + i);
+
+        assert(prelude_io_pending(peer) == 0);
+
+        broadcast_msg(pool, TEST_TAG + i);
+        read_msgs(peer, TEST_COUNT);
+
+        /*
+         * Or once the first message waited for the batch delay.
+         */
+        prelude_connection_pool_set_batch_delay(pool, 10 * 1000);
+        broadcast_msg(pool, TEST_TAG);
+        assert(prelude_io_pending(peer) == 0);
+
+        usleep(50 * 1000);
+        prelude_timer_wake_up();
+        read_msgs(peer, 1);
+
+        /*
+         * The pool event loop writes the batch as well, whatever the
+         * timers do.
+         */
+        broadcast_msg(pool, TEST_TAG);
+        assert(prelude_io_pending(peer) == 0);
+
+        usleep(50 * 1000);
+        prelude_connection_pool_check_event(pool, 0, NULL, NULL);
+        read_msgs(peer, 1);
+
+        /*
+         * Waiting messages are written when the pool is destroyed.
+         */
+        prelude_connection_pool_set_batch_delay(pool, 10 * 1000 * 1000);
+        broadcast_msg(pool, TEST_TAG);
+        assert(prelude_io_pending(peer) == 0);
+
+        prelude_connection_pool_destroy(pool);
+        read_msgs(peer, 1);
+
+        prelude_io_close(peer);
+        prelude_io_destroy(peer);
+}
+
+
+static void read_replayed_msgs(prelude_io_t *peer, unsigned int first, unsigned int count)
+{
+        unsigned int i;
+        prelude_msg_t *msg;
+
+        for ( i = first; i < first + count; i++ ) {
+                msg = NULL;
+                assert(prelude_msg_read(&msg, peer) == 0);
+                assert(prelude_msg_get_tag(msg) == (uint8_t) (TEST_TAG + i));
+                prelude_msg_destroy(msg);
+        }
+}
+
+
+static void test_replay(prelude_client_profile_t *cp)
+{
+        unsigned int i, count;
+        prelude_io_t *peer;
+        prelude_connection_t *cnx;
+        prelude_connection_pool_t *pool;
+        prelude_connection_pool_replay_stats_t stats;
+        char dirname[] = "/tmp/prelude-replay-XXXXXX", buf[PATH_MAX], cmd[PATH_MAX + 16];
+
+        assert(mkdtemp(dirname));
+        assert(prelude_client_profile_set_prefix(cp, dirname) == 0);
+        assert(prelude_client_profile_set_name(cp, "test") == 0);
+
+        /*
+         * Only spool within the temporary prefix.
+         */
+        prelude_client_profile_get_backup_dirname(cp, buf, sizeof(buf));
+        if ( strncmp(buf, dirname, strlen(dirname)) == 0 ) {
+                snprintf(cmd, sizeof(cmd), "mkdir -p %s", buf);
+                assert(system(cmd) == 0);
+
+                assert(prelude_connection_pool_new(&pool, cp, 0) == 0);
+                prelude_connection_pool_set_flags(pool, PRELUDE_CONNECTION_POOL_FLAGS_FAILOVER|PRELUDE_CONNECTION_POOL_FLAGS_REPLAY);
+                prelude_connection_pool_set_replay_rate(pool, TEST_REPLAY_RATE);
+
+                assert(prelude_connection_new(&cnx, "unix:/nonexistent") == 0);
+                assert(prelude_connection_pool_add_connection(pool, cnx) == 0);
+                assert(prelude_connection_pool_init(pool) == 0);
+
+                for ( i = 0; i < TEST_REPLAY_RATE; i++ )
+                        broadcast_msg(pool, TEST_TAG + i);
+
+                establish_connection(pool, cnx, &peer);
+                assert(prelude_io_pending(peer) == 0);
+
+                assert(prelude_connection_pool_get_replay_stats(pool, NULL, &stats) == 0);
+                assert(stats.replayed_msg == 0);
+                assert(stats.remaining_msg == TEST_REPLAY_RATE);
+                assert(stats.eta == 1);
+
+                /*
+                 * Messages are replayed at the configured rate, not all at once.
+                 */
+                usleep(200 * 1000);
+                prelude_timer_wake_up();
+
+                assert(prelude_connection_pool_get_replay_stats(pool, NULL, &stats) == 0);
+                count = stats.replayed_msg;
+                assert(count > 0 && count < TEST_REPLAY_RATE);
+                assert(stats.remaining_msg == TEST_REPLAY_RATE - count);
+
+                read_replayed_msgs(peer, 0, count);
+                assert(prelude_io_pending(peer) == 0);
+
+                /*
+                 * The slice is sized from the elapsed time, however late
+                 * the timer is serviced.
+                 */
+                usleep(1100 * 1000);
+                prelude_timer_wake_up();
+
+                assert(prelude_connection_pool_get_replay_stats(pool, NULL, &stats) == 0);
+                assert(stats.replayed_msg == TEST_REPLAY_RATE);
+                assert(stats.remaining_msg == 0);
+
+                read_replayed_msgs(peer, count, TEST_REPLAY_RATE - count);
+                assert(prelude_io_pending(peer) == 0);
+
+                prelude_connection_pool_destroy(pool);
+                prelude_io_close(peer);
+                prelude_io_destroy(peer);
+        }
+
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", dirname);
+        assert(system(cmd) == 0);
+}
+
+
+static void test_ack(prelude_client_profile_t *cp)
+{
+        int i;
+        prelude_msg_t *msg;
+        prelude_io_t *peer;
+        prelude_connection_t *cnx, *manager;
+        prelude_connection_pool_t *pool;
+
+        assert(prelude_connection_pool_new(&pool, cp, 0) == 0);
+        prelude_connection_pool_set_flags(pool, PRELUDE_CONNECTION_POOL_FLAGS_ACK);
+        prelude_connection_pool_set_ack_window(pool, TEST_COUNT);
+        add_connection(pool, &cnx, &peer);
+        prelude_connection_set_features(cnx, PRELUDE_CONNECTION_FEATURE_ACK);
+
+        assert(prelude_connection_new(&manager, "unix:/nonexistent") == 0);
+        prelude_connection_set_fd_nodup(manager, peer);
+        prelude_connection_set_state(manager, prelude_connection_get_state(manager) | PRELUDE_CONNECTION_STATE_ESTABLISHED);
+        prelude_connection_set_features(manager, PRELUDE_CONNECTION_FEATURE_ACK);
+
+        /*
+         * Messages are kept until the peer acknowledges them.
+         */
+        for ( i = 0; i < TEST_COUNT; i++ )
+                broadcast_msg(pool, TEST_TAG + i);
+
+        assert(prelude_connection_get_sent_count(cnx) == TEST_COUNT);
+        assert(prelude_connection_pool_get_unacked_msg_count(pool) == TEST_COUNT);
+
+        for ( i = 0; i < TEST_COUNT - 1; i++ ) {
+                msg = NULL;
+                assert(prelude_connection_recv(manager, &msg) == 0);
+                assert(prelude_msg_get_tag(msg) == TEST_TAG + i);
+                prelude_msg_destroy(msg);
+        }
+
+        assert(prelude_connection_send_ack(manager) == 0);
+        prelude_connection_pool_check_event(pool, 1000, NULL, NULL);
+
+        assert(prelude_connection_is_alive(cnx));
+        assert(prelude_connection_get_acked_count(cnx) == TEST_COUNT - 1);
+        assert(prelude_connection_pool_get_unacked_msg_count(pool) == 1);
+
+        /*
+         * Without failover, sending is never delayed: the oldest
+         * messages are forgotten once the window is full, and counted.
+         */
+        assert(prelude_connection_pool_get_ack_dropped_msg_count(pool) == 0);
+
+        for ( i = 0; i < TEST_COUNT; i++ )
+                broadcast_msg(pool, TEST_TAG + i);
+
+        assert(prelude_connection_get_sent_count(cnx) == 2 * TEST_COUNT);
+        assert(prelude_connection_pool_get_unacked_msg_count(pool) == TEST_COUNT);
+        assert(prelude_connection_pool_get_ack_dropped_msg_count(pool) == 1);
+
+        prelude_connection_destroy(manager);
+        prelude_connection_pool_destroy(pool);
+}
+
+
+static int send_msgbuf_to_pool(prelude_msgbuf_t *msgbuf, prelude_msg_t *msg)
+{
+        prelude_connection_pool_broadcast(prelude_msgbuf_get_data(msgbuf), msg);
+        return 0;
+}
+
+
+/*
+ * Send @count times the same string, in a message that might be
+ * fragmented, and check that the manager decodes it.
+ */
+static uint32_t send_string(prelude_msgbuf_t *msgbuf, prelude_connection_t *manager, unsigned int count)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+        unsigned int i;
+        prelude_msg_t *msg = NULL;
+
+        prelude_msg_set_tag(prelude_msgbuf_get_msg(msgbuf), TEST_TAG);
+
+        for ( i = 0; i < count; i++ )
+                assert(prelude_msgbuf_set_string(msgbuf, TEST_TAG, TEST_STR, strlen(TEST_STR)) == 0);
+
+        prelude_msgbuf_mark_end(msgbuf);
+
+        do {
+                ret = prelude_connection_recv(manager, &msg);
+        } while ( prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+
+        assert(ret == 0);
+
+        for ( i = 0; i < count; i++ ) {
+                assert(prelude_msg_get(msg, &tag, &len, &buf) == 0);
+                assert(tag == TEST_TAG && len == sizeof(TEST_STR) && strcmp(buf, TEST_STR) == 0);
+        }
+
+        assert(prelude_msg_get(msg, &tag, &len, &buf) < 0);
+
+        len = prelude_msg_get_datalen(msg);
+        prelude_msg_destroy(msg);
+
+        return len;
+}
+
+
+static void new_manager(prelude_connection_t **manager, prelude_io_t *peer)
+{
+        assert(prelude_connection_new(manager, "unix:/nonexistent") == 0);
+        prelude_connection_set_fd_nodup(*manager, peer);
+        prelude_connection_set_state(*manager, prelude_connection_get_state(*manager) | PRELUDE_CONNECTION_STATE_ESTABLISHED);
+        prelude_connection_set_features(*manager, PRELUDE_CONNECTION_FEATURE_COMPACT|PRELUDE_CONNECTION_FEATURE_DICTIONARY);
+}
+
+
+static void establish_connection_again(prelude_connection_pool_t *pool, prelude_connection_t *cnx, prelude_connection_t **manager)
+{
+        prelude_io_t *peer;
+
+        prelude_connection_destroy(*manager);
+        assert(prelude_connection_pool_set_connection_dead(pool, cnx) == 0);
+
+        establish_connection(pool, cnx, &peer);
+        prelude_connection_set_features(cnx, PRELUDE_CONNECTION_FEATURE_COMPACT|PRELUDE_CONNECTION_FEATURE_DICTIONARY);
+        new_manager(manager, peer);
+}
+
+
+static void test_dictionary(prelude_client_profile_t *cp)
+{
+        uint32_t len[TEST_COUNT];
+        prelude_io_t *peer;
+        prelude_msgbuf_t *msgbuf;
+        prelude_connection_t *cnx, *manager;
+        prelude_connection_pool_t *pool;
+
+        assert(prelude_connection_pool_new(&pool, cp, 0) == 0);
+        prelude_connection_pool_set_flags(pool, PRELUDE_CONNECTION_POOL_FLAGS_COMPACT|PRELUDE_CONNECTION_POOL_FLAGS_DICTIONARY);
+        add_connection(pool, &cnx, &peer);
+        prelude_connection_set_features(cnx, PRELUDE_CONNECTION_FEATURE_COMPACT|PRELUDE_CONNECTION_FEATURE_DICTIONARY);
+        new_manager(&manager, peer);
+
+        assert(prelude_msgbuf_new(&msgbuf) == 0);
+        prelude_msgbuf_set_data(msgbuf, pool);
+        prelude_msgbuf_set_callback(msgbuf, send_msgbuf_to_pool);
+        prelude_msgbuf_set_flags(msgbuf, PRELUDE_MSGBUF_FLAGS_COMPACT|PRELUDE_MSGBUF_FLAGS_DICTIONARY);
+
+        /*
+         * The string is defined the second time it is sent, and
+         * then only referenced.
+         */
+        len[0] = send_string(msgbuf, manager, 1);
+        len[1] = send_string(msgbuf, manager, 1);
+        len[2] = send_string(msgbuf, manager, 1);
+        assert(len[1] > len[0] && len[2] < len[0]);
+
+        /*
+         * A new session starts without any dictionary: the reference
+         * is expanded, and the writer starts a new dictionary.
+         */
+        establish_connection_again(pool, cnx, &manager);
+
+        assert(send_string(msgbuf, manager, 1) == len[0]);
+        assert(send_string(msgbuf, manager, 1) == len[0]);
+        assert(send_string(msgbuf, manager, 1) == len[1]);
+        assert(send_string(msgbuf, manager, 1) == len[2]);
+
+        /*
+         * Fragments are decoded, and expanded, on their own.
+         */
+        send_string(msgbuf, manager, 3000);
+        establish_connection_again(pool, cnx, &manager);
+        send_string(msgbuf, manager, 3000);
+
+        prelude_msgbuf_destroy(msgbuf);
+        prelude_connection_destroy(manager);
+        prelude_connection_pool_destroy(pool);
+}
+
+
+static void test_balance(prelude_client_profile_t *cp)
+{
+        int i, n = 0;
+        unsigned int count[2];
+        prelude_list_t *tmp;
+        prelude_io_t *peer[2];
+        prelude_connection_t *cnx[2];
+        prelude_connection_pool_t *pool;
+
+        assert(prelude_connection_pool_new(&pool, cp, 0) == 0);
+        prelude_connection_pool_set_flags(pool, 0);
+
+        assert(prelude_connection_pool_set_connection_string(pool, "unix:/nonexistent && unix:/nonexistent2 <> unix:/nonexistent3") == 0);
+        assert(prelude_connection_pool_init(pool) < 0);
+
+        assert(prelude_connection_pool_set_connection_string(pool, "unix:/nonexistent <> unix:/nonexistent2") == 0);
+        assert(prelude_connection_pool_init(pool) == 0);
+
+        prelude_list_for_each(prelude_connection_pool_get_connection_list(pool), tmp) {
+                cnx[n] = prelude_linked_object_get_object(tmp);
+                establish_connection(pool, cnx[n], &peer[n]);
+                n++;
+        }
+
+        assert(n == 2);
+
+        /*
+         * Members are used in turn.
+         */
+        for ( i = 0; i < 2 * TEST_COUNT; i++ )
+                broadcast_msg(pool, TEST_TAG);
+
+        assert(count_msgs(peer[0]) == TEST_COUNT);
+        assert(count_msgs(peer[1]) == TEST_COUNT);
+
+        /*
+         * With hashing, the analyzer sticks to a single member...
+         */
+        prelude_connection_pool_set_balance(pool, PRELUDE_CONNECTION_POOL_BALANCE_HASH);
+
+        for ( i = 0; i < 2 * TEST_COUNT; i++ )
+                broadcast_msg(pool, TEST_TAG);
+
+        count[0] = count_msgs(peer[0]);
+        count[1] = count_msgs(peer[1]);
+        assert(count[0] + count[1] == 2 * TEST_COUNT);
+        assert(count[0] == 0 || count[1] == 0);
+
+        /*
+         * ...unless it is dead.
+         */
+        n = (count[0]) ? 0 : 1;
+        assert(prelude_connection_pool_set_connection_dead(pool, cnx[n]) == 0);
+
+        for ( i = 0; i < TEST_COUNT; i++ )
+                broadcast_msg(pool, TEST_TAG);
+
+        assert(count_msgs(peer[n]) == 0);
+        assert(count_msgs(peer[1 - n]) == TEST_COUNT);
+
+        prelude_connection_pool_destroy(pool);
+
+        for ( i = 0; i < 2; i++ ) {
+                prelude_io_close(peer[i]);
+                prelude_io_destroy(peer[i]);
+        }
+}
+
+
+static void broadcast_big_msg(prelude_connection_pool_t *pool, uint8_t tag)
+{
+        prelude_msg_t *msg;
+        static char buf[TEST_ASYNC_SIZE];
+
+        assert(prelude_msg_new(&msg, 1, sizeof(buf), tag, 0) == 0);
+        assert(prelude_msg_set(msg, TEST_TAG, sizeof(buf), buf) == 0);
+
+        prelude_connection_pool_broadcast_async(pool, msg);
+}
+
+
+static void read_msgs_timeout(prelude_io_t *peer, unsigned int count)
+{
+        unsigned int i;
+        prelude_msg_t *msg;
+        struct pollfd pfd;
+
+        pfd.fd = prelude_io_get_fd(peer);
+        pfd.events = POLLIN;
+
+        for ( i = 0; i < count; i++ ) {
+                msg = NULL;
+                assert(poll(&pfd, 1, 10 * 1000) == 1);
+                assert(prelude_msg_read(&msg, peer) == 0);
+                assert(prelude_msg_get_tag(msg) == TEST_TAG + i);
+                prelude_msg_destroy(msg);
+        }
+}
+
+
+static void test_async(prelude_client_profile_t *cp)
+{
+        int i, n = 0;
+        prelude_list_t *tmp;
+        prelude_io_t *peer[2];
+        prelude_async_stats_t stats;
+        prelude_connection_t *cnx[2];
+        prelude_connection_pool_t *pool;
+
+        prelude_async_set_worker_count(2);
+        assert(prelude_async_init() == 0);
+
+        assert(prelude_connection_pool_new(&pool, cp, 0) == 0);
+        prelude_connection_pool_set_flags(pool, 0);
+
+        for ( i = 0; i < 2; i++ ) {
+                assert(prelude_connection_new(&cnx[i], "unix:/nonexistent") == 0);
+                assert(prelude_connection_pool_add_connection(pool, cnx[i]) == 0);
+        }
+
+        assert(prelude_connection_pool_init(pool) == 0);
+
+        prelude_list_for_each(prelude_connection_pool_get_connection_list(pool), tmp) {
+                cnx[n] = prelude_linked_object_get_object(tmp);
+                establish_connection(pool, cnx[n], &peer[n]);
+                n++;
+        }
+
+        assert(n == 2);
+
+        /*
+         * The first peer does not read: writes to it block once the
+         * socket buffers are full, but the second one gets everything.
+         */
+        for ( i = 0; i < TEST_ASYNC_COUNT; i++ )
+                broadcast_big_msg(pool, TEST_TAG + i);
+
+        read_msgs_timeout(peer[1], TEST_ASYNC_COUNT);
+        read_msgs_timeout(peer[0], TEST_ASYNC_COUNT);
+
+        do {
+                prelude_connection_pool_get_async_stats(pool, &stats);
+        } while ( stats.queued );
+
+        assert(stats.processed == 2 * TEST_ASYNC_COUNT);
+        assert(stats.overflowed == 0);
+
+        prelude_connection_pool_destroy(pool);
+        prelude_async_exit();
+
+        for ( i = 0; i < 2; i++ ) {
+                prelude_io_close(peer[i]);
+                prelude_io_destroy(peer[i]);
+        }
+}
+
+
+static void test_connect_nonblock(prelude_client_profile_t *cp)
+{
+        time_t start;
+        socklen_t len;
+        char addr[64];
+        struct sockaddr_in sin;
+        int i, ret, sock, fillers[TEST_BACKLOG];
+        prelude_connection_t *cnx;
+
+        /*
+         * A manager with a full listen queue never completes the TCP
+         * handshake: connecting to it must not block.
+         */
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        assert(sock >= 0);
+
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        len = sizeof(sin);
+        assert(bind(sock, (struct sockaddr *) &sin, sizeof(sin)) == 0);
+        assert(getsockname(sock, (struct sockaddr *) &sin, &len) == 0);
+        assert(listen(sock, 0) == 0);
+
+        for ( i = 0; i < TEST_BACKLOG; i++ ) {
+                fillers[i] = socket(AF_INET, SOCK_STREAM, 0);
+                assert(fillers[i] >= 0);
+                assert(fcntl(fillers[i], F_SETFL, O_NONBLOCK) == 0);
+                connect(fillers[i], (struct sockaddr *) &sin, sizeof(sin));
+        }
+
+        snprintf(addr, sizeof(addr), "127.0.0.1:%u", ntohs(sin.sin_port));
+        assert(prelude_connection_new(&cnx, addr) == 0);
+
+        start = time(NULL);
+
+        ret = prelude_connection_connect_nonblock(cnx, cp, PRELUDE_CONNECTION_PERMISSION_IDMEF_WRITE);
+        assert(prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN);
+        assert(prelude_connection_connect_want_write(cnx));
+
+        ret = prelude_connection_connect_resume(cnx);
+        assert(prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN);
+
+        assert(time(NULL) - start < 2);
+        assert(! prelude_connection_is_alive(cnx));
+
+        /*
+         * Closing the connection aborts the attempt.
+         */
+        prelude_connection_close(cnx);
+        assert(! prelude_connection_connect_want_write(cnx));
+        prelude_connection_destroy(cnx);
+
+        for ( i = 0; i < TEST_BACKLOG; i++ )
+                close(fillers[i]);
+
+        close(sock);
+}
+
+
+int main(void)
+{
+        prelude_client_profile_t *cp;
+
+        assert(prelude_init(NULL, NULL) == 0);
+        assert(_prelude_client_profile_new(&cp) == 0);
+
+        test_recv(cp);
+        test_batch(cp);
+        test_replay(cp);
+        test_ack(cp);
+        test_dictionary(cp);
+        test_balance(cp);
+        test_async(cp);
+        test_connect_nonblock(cp);
+
+        prelude_client_profile_destroy(cp);
+        prelude_deinit();
+
+        return 0;
+}
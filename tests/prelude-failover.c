@@ -0,0 +1,290 @@
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <assert.h>
+#include <sys/resource.h>
+#include "prelude.h"
+#include "prelude-failover.h"
+
+#define TEST_COUNT 25
+#define TEST_BATCH 10
+#define TEST_TAG 42
+#define TEST_STR "abcdefghijklmnopqrstuvwxyz"
+#define TEST_SEGMENT_SIZE (64 * 1024)
+#define TEST_SEGMENT_COUNT 10000
+
+
+static void save_msg(prelude_failover_t *failover, unsigned int i)
+{
+        prelude_msg_t *msg;
+
+        assert(prelude_msg_new(&msg, 1, sizeof(TEST_STR), i, 0) == 0);
+        assert(prelude_msg_set(msg, TEST_TAG, sizeof(TEST_STR), TEST_STR) == 0);
+        assert(prelude_failover_save_msg(failover, msg) == 0);
+
+        prelude_msg_destroy(msg);
+}
+
+
+static void read_msg(prelude_failover_t *failover, unsigned int i)
+{
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+        prelude_msg_t *msg;
+
+        assert(prelude_failover_get_saved_msg(failover, &msg) > 0);
+        assert(prelude_msg_get_tag(msg) == i);
+
+        assert(prelude_msg_get(msg, &tag, &len, &buf) == 0);
+        assert(tag == TEST_TAG);
+        assert(memcmp(buf, TEST_STR, len) == 0);
+
+        prelude_msg_destroy(msg);
+}
+
+
+static void test_group_commit(const char *dirname)
+{
+        unsigned int i;
+        prelude_failover_t *failover;
+        prelude_failover_stats_t before, stats;
+
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        prelude_failover_set_group_commit(failover, TEST_BATCH, 0);
+        prelude_failover_set_durability(failover, PRELUDE_FAILOVER_DURABILITY_BATCH);
+
+        prelude_failover_get_stats(failover, &before);
+
+        for ( i = 0; i < TEST_COUNT; i++ )
+                save_msg(failover, i);
+
+        /*
+         * Only full batches are written, each with a single journal update.
+         */
+        prelude_failover_get_stats(failover, &stats);
+        assert(stats.saved_msg == TEST_COUNT);
+        assert(stats.journal_writes == before.journal_writes + TEST_COUNT / TEST_BATCH);
+        assert(stats.syncs == 2 * (TEST_COUNT / TEST_BATCH));
+        assert(prelude_failover_get_available_msg_count(failover) == TEST_COUNT);
+
+        /*
+         * Reading flushes the pending batch.
+         */
+        for ( i = 0; i < TEST_COUNT; i++ )
+                read_msg(failover, i);
+
+        assert(prelude_failover_get_available_msg_count(failover) == 0);
+        prelude_failover_destroy(failover);
+}
+
+
+static void test_group_commit_delay(const char *dirname)
+{
+        prelude_failover_t *failover;
+        prelude_failover_stats_t before, stats;
+
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        prelude_failover_set_group_commit(failover, TEST_BATCH, 10);
+
+        prelude_failover_get_stats(failover, &before);
+        save_msg(failover, 0);
+
+        prelude_failover_get_stats(failover, &stats);
+        assert(stats.journal_writes == before.journal_writes);
+
+        usleep(50 * 1000);
+        prelude_timer_wake_up();
+
+        prelude_failover_get_stats(failover, &stats);
+        assert(stats.journal_writes == before.journal_writes + 1);
+        assert(stats.syncs == 0);
+
+        prelude_failover_destroy(failover);
+
+        /*
+         * The message written once the delay expired is still there.
+         */
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        assert(prelude_failover_get_available_msg_count(failover) == 1);
+        read_msg(failover, 0);
+        prelude_failover_destroy(failover);
+}
+
+
+static void test_group_commit_error(const char *dirname)
+{
+        unsigned int i;
+        prelude_msg_t *msg;
+        struct rlimit old, rl;
+        prelude_failover_t *failover;
+
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        prelude_failover_set_group_commit(failover, TEST_BATCH, 0);
+
+        for ( i = 0; i < TEST_BATCH - 1; i++ )
+                save_msg(failover, i);
+
+        /*
+         * A batch that could not be written is reported, and kept.
+         */
+        signal(SIGXFSZ, SIG_IGN);
+        assert(getrlimit(RLIMIT_FSIZE, &old) == 0);
+
+        rl = old;
+        rl.rlim_cur = 1;
+        assert(setrlimit(RLIMIT_FSIZE, &rl) == 0);
+
+        assert(prelude_msg_new(&msg, 1, sizeof(TEST_STR), i, 0) == 0);
+        assert(prelude_msg_set(msg, TEST_TAG, sizeof(TEST_STR), TEST_STR) == 0);
+        assert(prelude_failover_save_msg(failover, msg) < 0);
+        prelude_msg_destroy(msg);
+
+        assert(setrlimit(RLIMIT_FSIZE, &old) == 0);
+        signal(SIGXFSZ, SIG_DFL);
+
+        save_msg(failover, TEST_BATCH);
+        assert(prelude_failover_get_available_msg_count(failover) == TEST_BATCH + 1);
+
+        prelude_failover_destroy(failover);
+
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        assert(prelude_failover_get_available_msg_count(failover) == TEST_BATCH + 1);
+
+        for ( i = 0; i <= TEST_BATCH; i++ )
+                read_msg(failover, i);
+
+        prelude_failover_destroy(failover);
+}
+
+
+static void test_segments(const char *dirname)
+{
+        ssize_t ret;
+        unsigned int i, j;
+        prelude_msg_t *msgs[TEST_BATCH];
+        prelude_failover_t *failover;
+
+        prelude_failover_set_default_segment_size(TEST_SEGMENT_SIZE);
+
+        /*
+         * Messages span several segments, and survive a restart.
+         */
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        for ( i = 0; i < TEST_SEGMENT_COUNT; i++ )
+                save_msg(failover, i % 256);
+
+        prelude_failover_destroy(failover);
+
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        assert(prelude_failover_get_available_msg_count(failover) == TEST_SEGMENT_COUNT);
+
+        for ( i = 0; i < TEST_SEGMENT_COUNT / 2; i++ )
+                read_msg(failover, i % 256);
+
+        for ( i = TEST_SEGMENT_COUNT / 2; i < TEST_SEGMENT_COUNT; i += ret ) {
+                ret = prelude_failover_get_saved_msgs(failover, msgs, TEST_BATCH);
+                assert(ret > 0);
+
+                for ( j = 0; j < (unsigned int) ret; j++ ) {
+                        assert(prelude_msg_get_tag(msgs[j]) == (i + j) % 256);
+                        prelude_msg_destroy(msgs[j]);
+                }
+        }
+
+        assert(prelude_failover_get_saved_msgs(failover, msgs, TEST_BATCH) == 0);
+        assert(prelude_failover_get_available_msg_count(failover) == 0);
+
+        /*
+         * Going over quota deletes the oldest segments.
+         */
+        for ( i = 0; i < TEST_SEGMENT_COUNT; i++ )
+                save_msg(failover, i % 256);
+
+        prelude_failover_set_quota(failover, 2 * TEST_SEGMENT_SIZE);
+        assert(prelude_failover_get_deleted_msg_count(failover) > 0);
+        assert(prelude_failover_get_available_msg_count(failover) + prelude_failover_get_deleted_msg_count(failover) == TEST_SEGMENT_COUNT);
+
+        i = TEST_SEGMENT_COUNT - prelude_failover_get_available_msg_count(failover);
+        for ( ; i < TEST_SEGMENT_COUNT; i++ )
+                read_msg(failover, i % 256);
+
+        assert(prelude_failover_get_available_msg_count(failover) == 0);
+        prelude_failover_destroy(failover);
+
+        prelude_failover_set_default_segment_size(0);
+}
+
+
+static void test_compression(const char *dirname)
+{
+        ssize_t ret;
+        unsigned int i, j;
+        prelude_failover_t *failover;
+        prelude_msg_t *msgs[TEST_BATCH];
+        prelude_failover_stats_t stats;
+
+        prelude_failover_set_default_segment_size(TEST_SEGMENT_SIZE);
+        assert(prelude_failover_set_default_compression(PRELUDE_FAILOVER_COMPRESSION_DEFLATE) == 0);
+
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        for ( i = 0; i < TEST_SEGMENT_COUNT; i++ )
+                save_msg(failover, i % 256);
+
+        prelude_failover_get_stats(failover, &stats);
+        assert(stats.stored_bytes * 2 < stats.saved_bytes);
+        prelude_failover_destroy(failover);
+
+        /*
+         * Compressed messages are recovered after a restart, even with
+         * compression disabled.
+         */
+        assert(prelude_failover_set_default_compression(PRELUDE_FAILOVER_COMPRESSION_NONE) == 0);
+
+        assert(prelude_failover_new(&failover, dirname) == 0);
+        assert(prelude_failover_get_available_msg_count(failover) == TEST_SEGMENT_COUNT);
+
+        for ( i = 0; i < TEST_SEGMENT_COUNT / 2; i++ )
+                read_msg(failover, i % 256);
+
+        for ( i = TEST_SEGMENT_COUNT / 2; i < TEST_SEGMENT_COUNT; i += ret ) {
+                ret = prelude_failover_get_saved_msgs(failover, msgs, TEST_BATCH);
+                assert(ret > 0);
+
+                for ( j = 0; j < (unsigned int) ret; j++ ) {
+                        assert(prelude_msg_get_tag(msgs[j]) == (i + j) % 256);
+                        prelude_msg_destroy(msgs[j]);
+                }
+        }
+
+        assert(prelude_failover_get_available_msg_count(failover) == 0);
+        prelude_failover_destroy(failover);
+
+        prelude_failover_set_default_segment_size(0);
+}
+
+
+int main(void)
+{
+        char dirname[] = "/tmp/prelude-failover-XXXXXX", cmd[sizeof(dirname) + 16];
+
+        assert(prelude_init(NULL, NULL) == 0);
+        assert(mkdtemp(dirname));
+
+        test_group_commit(dirname);
+        test_group_commit_delay(dirname);
+        test_group_commit_error(dirname);
+        test_segments(dirname);
+        test_compression(dirname);
+
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", dirname);
+        assert(system(cmd) == 0);
+
+        prelude_deinit();
+
+        return 0;
+}
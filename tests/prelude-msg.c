@@ -0,0 +1,266 @@
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/socket.h>
+#include "prelude.h"
+
+#define TEST_COUNT 3
+#define TEST_TAG 42
+#define TEST_STR "abcdefghijklmnopqrstuvwxyz"
+#define TEST_TAG_STR "42"
+
+/*
+ * Size of the buffer inflated data is read into.
+ */
+#define TEST_PLAIN_SIZE (64 * 1024)
+
+
+static void read_msg(prelude_io_t *pio, unsigned int i)
+{
+        int ret;
+        void *buf;
+        uint8_t tag;
+        uint32_t len;
+        prelude_msg_t *msg = NULL;
+
+        do {
+                ret = prelude_msg_read(&msg, pio);
+        } while ( ret < 0 && prelude_error_get_code(ret) == PRELUDE_ERROR_EAGAIN );
+
+        assert(ret == 0);
+        assert(prelude_msg_get_tag(msg) == i);
+
+        assert(prelude_msg_get(msg, &tag, &len, &buf) == 0);
+        assert(tag == TEST_TAG);
+        assert(len == sizeof(TEST_STR));
+        assert(memcmp(buf, TEST_STR, len) == 0);
+
+        prelude_msg_destroy(msg);
+}
+
+
+static void test_pool(void)
+{
+        prelude_msg_t *msg;
+        prelude_msg_pool_stats_t before, after;
+
+        prelude_msg_pool_get_stats(&before);
+
+        assert(prelude_msg_new(&msg, 1, sizeof(TEST_STR), 0, 0) == 0);
+        prelude_msg_destroy(msg);
+
+        assert(prelude_msg_new(&msg, 1, sizeof(TEST_STR), 0, 0) == 0);
+        prelude_msg_destroy(msg);
+
+        prelude_msg_pool_get_stats(&after);
+        assert(after.hits >= before.hits + 1);
+        assert(after.hits + after.misses == before.hits + before.misses + 2);
+        assert(after.resident_bytes > 0);
+
+        prelude_msg_pool_set_high_water_mark(0);
+}
+
+
+/*
+ * Forward TEST_COUNT chunks, each with a header, to @dst: they are
+ * batched into a single write.
+ */
+static void test_forward(prelude_io_t *dst, prelude_io_t *peer)
+{
+        int fds[2];
+        size_t len;
+        ssize_t ret;
+        unsigned int i;
+        prelude_io_t *src;
+        prelude_io_stats_t stats;
+        char buf[TEST_COUNT * (sizeof(TEST_TAG_STR) + sizeof(TEST_STR))], *ptr;
+
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(prelude_io_new(&src) == 0);
+        prelude_io_set_sys_io(src, fds[1]);
+
+        for ( i = 0; i < TEST_COUNT; i++ )
+                assert(write(fds[0], TEST_STR, sizeof(TEST_STR)) == sizeof(TEST_STR));
+
+        prelude_io_reset_stats(dst);
+
+        for ( i = 0; i < TEST_COUNT; i++ )
+                assert(prelude_io_forward_full(dst, src, TEST_TAG_STR, sizeof(TEST_TAG_STR), sizeof(TEST_STR),
+                                               (i < TEST_COUNT - 1) ? PRELUDE_IO_FORWARD_FLAGS_MORE : 0) == sizeof(TEST_STR));
+
+        prelude_io_get_stats(dst, &stats);
+        assert(stats.write_syscalls == 1);
+        assert(stats.write_bytes == sizeof(buf));
+
+        for ( len = 0; len < sizeof(buf); len += ret ) {
+                ret = prelude_io_read(peer, buf + len, sizeof(buf) - len);
+                assert(ret > 0);
+        }
+
+        for ( ptr = buf, i = 0; i < TEST_COUNT; i++ ) {
+                assert(memcmp(ptr, TEST_TAG_STR, sizeof(TEST_TAG_STR)) == 0);
+                ptr += sizeof(TEST_TAG_STR);
+
+                assert(memcmp(ptr, TEST_STR, sizeof(TEST_STR)) == 0);
+                ptr += sizeof(TEST_STR);
+        }
+
+        close(fds[0]);
+        prelude_io_close(src);
+        prelude_io_destroy(src);
+}
+
+
+#ifdef HAVE_ZLIB
+static void test_compression(void)
+{
+        int fds[2];
+        unsigned int i;
+        size_t windex = 0;
+        unsigned char *buf;
+        prelude_io_t *in, *out;
+        prelude_io_stats_t istats, ostats;
+        prelude_msg_t *msgs[TEST_COUNT];
+
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        assert(prelude_io_new(&out) == 0);
+        assert(prelude_io_new(&in) == 0);
+        prelude_io_set_sys_io(out, fds[0]);
+        prelude_io_set_sys_io(in, fds[1]);
+
+        assert(prelude_io_set_compression(out, PRELUDE_IO_COMPRESSION_DEFLATE) == 0);
+        assert(prelude_io_set_compression(in, PRELUDE_IO_COMPRESSION_DEFLATE) == 0);
+        assert(prelude_io_get_compression(out) == PRELUDE_IO_COMPRESSION_DEFLATE);
+
+        for ( i = 0; i < TEST_COUNT; i++ ) {
+                assert(prelude_msg_new(&msgs[i], 1, sizeof(TEST_STR), i, 0) == 0);
+                assert(prelude_msg_set(msgs[i], TEST_TAG, sizeof(TEST_STR), TEST_STR) == 0);
+        }
+
+        /*
+         * Every write is flushed, so that the message can be read at once.
+         */
+        for ( i = 0; i < TEST_COUNT; i++ ) {
+                assert(prelude_msg_write(msgs[i], out) == 0);
+                read_msg(in, i);
+        }
+
+        /*
+         * Messages of a batch are inflated together.
+         */
+        assert(prelude_msg_writev(msgs, TEST_COUNT, out, &windex) == 0);
+
+        read_msg(in, 0);
+        assert(prelude_io_pending(in) > 0);
+
+        for ( i = 1; i < TEST_COUNT; i++ )
+                read_msg(in, i);
+
+        assert(prelude_io_pending(in) == 0);
+
+        prelude_io_get_stats(out, &ostats);
+        prelude_io_get_stats(in, &istats);
+
+        assert(ostats.write_bytes == 2 * TEST_COUNT * prelude_msg_get_len(msgs[0]));
+        assert(ostats.compressed_write_bytes < ostats.write_bytes);
+        assert(istats.read_bytes == ostats.write_bytes);
+        assert(istats.compressed_read_bytes == ostats.compressed_write_bytes);
+
+        /*
+         * Data filling the inflate buffer exactly is not followed by
+         * anything buffered: the next read goes to the socket.
+         */
+        buf = calloc(1, TEST_PLAIN_SIZE);
+        assert(buf);
+
+        for ( i = 0; i < 2; i++ ) {
+                assert(prelude_io_write(out, buf, TEST_PLAIN_SIZE) == TEST_PLAIN_SIZE);
+                assert(prelude_io_read_wait(in, buf, TEST_PLAIN_SIZE) == TEST_PLAIN_SIZE);
+
+                if ( i == 1 )
+                        assert(prelude_io_pending(in) == 0);
+
+                assert(prelude_io_write(out, TEST_STR, sizeof(TEST_STR)) == (ssize_t) sizeof(TEST_STR));
+                assert(prelude_io_read(in, buf, sizeof(TEST_STR)) == (ssize_t) sizeof(TEST_STR));
+                assert(memcmp(buf, TEST_STR, sizeof(TEST_STR)) == 0);
+        }
+
+        free(buf);
+
+        for ( i = 0; i < TEST_COUNT; i++ )
+                prelude_msg_destroy(msgs[i]);
+
+        prelude_io_close(out);
+        prelude_io_close(in);
+        prelude_io_destroy(out);
+        prelude_io_destroy(in);
+}
+#endif
+
+
+int main(void)
+{
+        int fds[2];
+        unsigned int i;
+        size_t windex = 0;
+        prelude_io_t *in, *out, *buffer;
+        prelude_io_stats_t stats;
+        prelude_msg_t *msgs[TEST_COUNT];
+
+        assert(prelude_init(NULL, NULL) == 0);
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+        assert(prelude_io_new(&out) == 0);
+        assert(prelude_io_new(&in) == 0);
+        prelude_io_set_sys_io(out, fds[0]);
+        prelude_io_set_sys_io(in, fds[1]);
+
+        for ( i = 0; i < TEST_COUNT; i++ ) {
+                assert(prelude_msg_new(&msgs[i], 1, sizeof(TEST_STR), i, 0) == 0);
+                assert(prelude_msg_set(msgs[i], TEST_TAG, sizeof(TEST_STR), TEST_STR) == 0);
+        }
+
+        assert(prelude_msg_writev(msgs, TEST_COUNT, out, &windex) == 0);
+        assert(windex == 0);
+
+        prelude_io_get_stats(out, &stats);
+        assert(stats.write_syscalls == 1);
+        assert(stats.write_bytes == TEST_COUNT * prelude_msg_get_len(msgs[0]));
+
+        for ( i = 0; i < TEST_COUNT; i++ ) {
+                read_msg(in, i);
+                prelude_msg_destroy(msgs[i]);
+        }
+
+        prelude_io_reset_stats(out);
+        prelude_io_get_stats(out, &stats);
+        assert(stats.write_syscalls == 0 && stats.write_bytes == 0);
+
+        /*
+         * Between sockets, and through a buffer.
+         */
+        test_forward(out, in);
+
+        assert(prelude_io_new(&buffer) == 0);
+        assert(prelude_io_set_buffer_io(buffer) == 0);
+        test_forward(buffer, buffer);
+        prelude_io_close(buffer);
+        prelude_io_destroy(buffer);
+
+        prelude_io_close(out);
+        prelude_io_close(in);
+        prelude_io_destroy(out);
+        prelude_io_destroy(in);
+
+        test_pool();
+
+#ifdef HAVE_ZLIB
+        test_compression();
+#endif
+
+        prelude_deinit();
+        exit(0);
+}
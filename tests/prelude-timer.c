@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/time.h>
 #include "prelude.h"
 
 #ifndef MAX
@@ -41,6 +42,103 @@ static void timer_callback(void *data)
 
 
 
+static uint64_t get_msec(void)
+{
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+
+        return (uint64_t) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+
+
+static void ms_timer_callback(void *data)
+{
+        uint64_t *expired = data;
+
+        *expired = get_msec();
+}
+
+
+
+static void test_timer_base(void)
+{
+        unsigned int i, next;
+        uint64_t start, expired[4];
+        prelude_timer_t timer[4];
+        prelude_timer_base_t *base;
+        const unsigned int expire[4] = { 5, 20, 300, 1500 };
+
+        assert(prelude_timer_base_new(&base) == 0);
+        prelude_timer_set_thread_base(base);
+        assert(prelude_timer_get_thread_base() == base);
+
+        start = get_msec();
+
+        for ( i = 0; i < 4; i++ ) {
+                expired[i] = 0;
+                prelude_timer_set_callback(&timer[i], ms_timer_callback);
+                prelude_timer_set_data(&timer[i], &expired[i]);
+                prelude_timer_set_expire_ms(&timer[i], expire[i]);
+                prelude_timer_init(&timer[i]);
+        }
+
+        /*
+         * A cancelled timer must never fire.
+         */
+        prelude_timer_destroy(&timer[3]);
+
+        /*
+         * Timers from a thread base are not handled by the global one.
+         */
+        prelude_timer_wake_up();
+        prelude_timer_flush();
+        assert(expired[0] == 0);
+
+        while ( ! expired[2] ) {
+                next = prelude_timer_base_wake_up(base);
+                assert(next <= 1000);
+                usleep(next * 1000);
+        }
+
+        for ( i = 0; i < 3; i++ )
+                assert(expired[i] >= start + expire[i]);
+
+        assert(expired[0] <= expired[1] && expired[1] <= expired[2]);
+        assert(expired[3] == 0);
+
+        prelude_timer_set_thread_base(NULL);
+        prelude_timer_base_destroy(base);
+}
+
+
+
+static void test_timer_far(void)
+{
+        prelude_timer_t timer;
+        uint64_t expired = 0;
+
+        /*
+         * Beyond the range of the wheel: the timer must not fire early,
+         * and the next wake-up is the real delay.
+         */
+        prelude_timer_set_callback(&timer, ms_timer_callback);
+        prelude_timer_set_data(&timer, &expired);
+        prelude_timer_set_expire(&timer, 60 * 24 * 60 * 60);
+        assert(prelude_timer_get_expire_ms(&timer) == (uint64_t) 60 * 24 * 60 * 60 * 1000);
+
+        prelude_timer_init(&timer);
+
+        assert(prelude_timer_wake_up() > 24 * 60 * 60);
+        assert(expired == 0);
+
+        prelude_timer_destroy(&timer);
+        assert(prelude_timer_wake_up() == 1);
+}
+
+
+
 int main(int argc, char **argv)
 {
         int ret;
@@ -49,6 +147,9 @@ int main(int argc, char **argv)
         unsigned int i, expire, max_expire = 0;
 
         prelude_init(NULL, NULL);
+        test_timer_base();
+        test_timer_far();
+
         start = time(NULL);
 
         /*